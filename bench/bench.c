@@ -0,0 +1,233 @@
+/*
+ * Micro-benchmarks for the host side of the library.
+ *
+ * None of them needs a device.  The results are written as JSON (to
+ * stdout or to the file given with -o) so that they can be compared
+ * between builds:
+ *
+ *   {"min_time": 0.2, "repeat": 5, "count_allocs": true,
+ *    "benchmarks": [
+ *      {"name": "cache_lru_get_hit", "iters": 4194304,
+ *       "ns_per_op": 21.3, "ns_per_op_min": 21.1, "allocs_per_op": 0},
+ *      ...]}
+ *
+ * ns_per_op is the median over the repeats and ns_per_op_min the
+ * best one.  allocs_per_op counts the calls to malloc(), calloc(),
+ * realloc() and strdup() made by the library and the benchmark code
+ * (not those made inside the C library).  It is null if the build
+ * can't count them (see bench/CMakeLists.txt).
+ *
+ * Usage: gpuarray-bench [-o file] [--min-time=sec] [--repeat=n]
+ *                       [--list] [filter ...]
+ *
+ * Only the benchmarks whose name contains one of the filters are run.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+
+#define MAX_REPEAT 64
+#define MAX_ITERS ((size_t)1 << 32)
+
+volatile size_t bench_sink;
+
+#ifdef BENCH_COUNT_ALLOCS
+/* Installed with the --wrap option of the linker */
+static size_t nallocs;
+
+void *__real_malloc(size_t sz);
+void *__real_calloc(size_t n, size_t sz);
+void *__real_realloc(void *p, size_t sz);
+char *__real_strdup(const char *s);
+
+void *__wrap_malloc(size_t sz) {
+  nallocs++;
+  return __real_malloc(sz);
+}
+
+void *__wrap_calloc(size_t n, size_t sz) {
+  nallocs++;
+  return __real_calloc(n, sz);
+}
+
+void *__wrap_realloc(void *p, size_t sz) {
+  nallocs++;
+  return __real_realloc(p, sz);
+}
+
+char *__wrap_strdup(const char *s) {
+  nallocs++;
+  return __real_strdup(s);
+}
+#define ALLOCS() nallocs
+#else
+#define ALLOCS() 0
+#endif
+
+static const bench *tables[] = {bench_cache, bench_gen, bench_util};
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static double measure(const bench *b, void *data, size_t iters,
+                      size_t *allocs) {
+  size_t a = ALLOCS();
+  double start = now_ns();
+  b->run(data, iters);
+  start = now_ns() - start;
+  *allocs = ALLOCS() - a;
+  return start;
+}
+
+static int cmp_double(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static int selected(const char *name, int nfilt, char **filt) {
+  int i;
+  if (nfilt == 0) return 1;
+  for (i = 0; i < nfilt; i++)
+    if (strstr(name, filt[i]) != NULL) return 1;
+  return 0;
+}
+
+static int run_one(FILE *out, const bench *b, double min_ns, int repeat,
+                   int first) {
+  double t[MAX_REPEAT];
+  void *data = NULL;
+  size_t iters = 1;
+  size_t allocs;
+  double next;
+  int i;
+
+  if (b->setup != NULL && b->setup(&data) != 0) {
+    fprintf(stderr, "%s: setup failed, skipped\n", b->name);
+    return 1;
+  }
+
+  /* Find a number of iterations that lasts at least min_ns */
+  for (;;) {
+    t[0] = measure(b, data, iters, &allocs);
+    if (t[0] >= min_ns || iters >= MAX_ITERS)
+      break;
+    if (t[0] <= 0)
+      next = (double)iters * 10;
+    else
+      next = (double)iters * 1.2 * min_ns / t[0];
+    if (next > (double)iters * 100)
+      next = (double)iters * 100;
+    if (next > (double)MAX_ITERS)
+      next = (double)MAX_ITERS;
+    iters = (size_t)next > iters ? (size_t)next : iters + 1;
+  }
+
+  for (i = 0; i < repeat; i++)
+    t[i] = measure(b, data, iters, &allocs) / (double)iters;
+
+  if (b->teardown != NULL)
+    b->teardown(data);
+
+  qsort(t, repeat, sizeof(double), cmp_double);
+  fprintf(out, "%s\n    {\"name\": \"%s\", \"iters\": %zu, "
+          "\"ns_per_op\": %.3f, \"ns_per_op_min\": %.3f, ",
+          first ? "" : ",", b->name, iters, t[repeat / 2], t[0]);
+#ifdef BENCH_COUNT_ALLOCS
+  fprintf(out, "\"allocs_per_op\": %.3f}", (double)allocs / (double)iters);
+#else
+  fprintf(out, "\"allocs_per_op\": null}");
+#endif
+  fflush(out);
+  return 0;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr, "Usage: %s [-o file] [--min-time=sec] [--repeat=n] "
+          "[--list] [filter ...]\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+  FILE *out = stdout;
+  double min_time = 0.2;
+  int repeat = 5;
+  int list = 0;
+  char **filt;
+  int nfilt = 0;
+  int failed = 0;
+  int first = 1;
+  const bench *b;
+  size_t i;
+  int j;
+
+  filt = calloc(argc, sizeof(char *));
+  if (filt == NULL) {
+    perror("calloc");
+    return 2;
+  }
+
+  for (j = 1; j < argc; j++) {
+    if (strcmp(argv[j], "-o") == 0 && j + 1 < argc) {
+      out = fopen(argv[++j], "w");
+      if (out == NULL) {
+        perror(argv[j]);
+        return 2;
+      }
+    } else if (strncmp(argv[j], "--min-time=", 11) == 0) {
+      min_time = atof(argv[j] + 11);
+    } else if (strncmp(argv[j], "--repeat=", 9) == 0) {
+      repeat = atoi(argv[j] + 9);
+      if (repeat < 1 || repeat > MAX_REPEAT) {
+        fprintf(stderr, "--repeat must be between 1 and %d\n", MAX_REPEAT);
+        return 2;
+      }
+    } else if (strcmp(argv[j], "--list") == 0) {
+      list = 1;
+    } else if (argv[j][0] == '-') {
+      usage(argv[0]);
+      return 2;
+    } else {
+      filt[nfilt++] = argv[j];
+    }
+  }
+
+  if (list) {
+    for (i = 0; i < sizeof(tables)/sizeof(tables[0]); i++)
+      for (b = tables[i]; b->name != NULL; b++)
+        if (selected(b->name, nfilt, filt))
+          printf("%s\n", b->name);
+    free(filt);
+    return 0;
+  }
+
+  fprintf(out, "{\"min_time\": %g, \"repeat\": %d, \"count_allocs\": %s,\n"
+          "  \"benchmarks\": [", min_time, repeat,
+#ifdef BENCH_COUNT_ALLOCS
+          "true"
+#else
+          "false"
+#endif
+          );
+  for (i = 0; i < sizeof(tables)/sizeof(tables[0]); i++) {
+    for (b = tables[i]; b->name != NULL; b++) {
+      if (!selected(b->name, nfilt, filt))
+        continue;
+      if (run_one(out, b, min_time * 1e9, repeat, first))
+        failed = 1;
+      else
+        first = 0;
+    }
+  }
+  fprintf(out, "\n  ]}\n");
+
+  if (out != stdout)
+    fclose(out);
+  free(filt);
+  return failed;
+}
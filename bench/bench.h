@@ -0,0 +1,53 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stddef.h>
+
+#include "private.h"
+
+/*
+ * A micro-benchmark.
+ *
+ * setup() is called once before the measurements and returns the
+ * state in *data (non-zero on error, which skips the benchmark).
+ * run() must perform `iters` operations on that state.  It is called
+ * with an increasing number of iterations until a run lasts long
+ * enough to be measured.  teardown() releases the state.
+ *
+ * setup and teardown may be NULL.
+ */
+typedef struct _bench {
+  const char *name;
+  int (*setup)(void **data);
+  void (*run)(void *data, size_t iters);
+  void (*teardown)(void *data);
+} bench;
+
+/* The benchmark tables, each ends with an entry with a NULL name */
+extern const bench bench_cache[];
+extern const bench bench_gen[];
+extern const bench bench_util[];
+
+/*
+ * Context with backend operations that don't touch any device.
+ *
+ * Buffers have no storage, kernels are accepted without compilation
+ * and launches do nothing.  This is enough to drive the kernel
+ * source generators and the launch scheduling code.
+ *
+ * Release it with gpucontext_deref().
+ */
+gpucontext *stub_context_new(void);
+
+/*
+ * Drop the kernels of the context that are cached by signature so
+ * that the next GpuKernel_init_keyed() generates the source again.
+ */
+void stub_context_flush(gpucontext *ctx);
+
+/*
+ * Keep the compiler from removing the computation of a value.
+ */
+extern volatile size_t bench_sink;
+
+#endif
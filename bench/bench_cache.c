@@ -0,0 +1,187 @@
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+
+/*
+ * The keys and values are small integers stored in the pointers so
+ * that only the allocations of the caches themselves are counted.
+ */
+#define NKEYS 1024
+#define NHIT 256
+#define NDISK 64
+#define MISS_BASE ((size_t)1 << 30)
+/* Size of the values on disk, about that of a small kernel binary */
+#define DISK_VSIZE 4096
+
+typedef struct _cache_state {
+  cache *c;
+  size_t next;
+  char dir[64];
+} cache_state;
+
+static int int_eq(cache_key_t a, cache_key_t b) {
+  return a == b;
+}
+
+static uint32_t int_hash(cache_key_t k) {
+  return (uint32_t)(size_t)k * 2654435761U;
+}
+
+static void no_free(void *p) {
+}
+
+static int int_write(strb *res, cache_key_t k) {
+  size_t v = (size_t)k;
+  strb_appendn(res, (const char *)&v, sizeof(v));
+  return strb_error(res);
+}
+
+static cache_key_t int_read(const strb *b) {
+  size_t v;
+  if (b->l != sizeof(v)) return NULL;
+  memcpy(&v, b->s, sizeof(v));
+  return (cache_key_t)v;
+}
+
+static int val_write(strb *res, cache_value_t val) {
+  static const char pad[DISK_VSIZE - sizeof(size_t)];
+  int_write(res, val);
+  strb_appendn(res, pad, sizeof(pad));
+  return strb_error(res);
+}
+
+static cache_value_t val_read(const strb *b) {
+  size_t v;
+  if (b->l != DISK_VSIZE) return NULL;
+  memcpy(&v, b->s, sizeof(v));
+  return (cache_value_t)v;
+}
+
+static void fill(cache_state *s, size_t n) {
+  for (s->next = 1; s->next <= n; s->next++)
+    cache_add(s->c, (cache_key_t)s->next, (cache_value_t)s->next);
+}
+
+static int setup_mem(void **data, cache *c) {
+  cache_state *s;
+
+  if (c == NULL)
+    return 1;
+  s = calloc(1, sizeof(*s));
+  if (s == NULL) {
+    cache_destroy(c);
+    return 1;
+  }
+  s->c = c;
+  fill(s, NKEYS);
+  *data = s;
+  return 0;
+}
+
+static int setup_lru(void **data) {
+  return setup_mem(data, cache_lru(NKEYS, 64, int_eq, int_hash,
+                                   no_free, no_free, global_err));
+}
+
+static int setup_twoq(void **data) {
+  return setup_mem(data, cache_twoq(NKEYS / 4, NKEYS / 2, NKEYS / 4, 64,
+                                    int_eq, int_hash, no_free, no_free,
+                                    global_err));
+}
+
+static int rm_entry(const char *path, const struct stat *st, int flag,
+                    struct FTW *ftw) {
+  return remove(path);
+}
+
+static int setup_disk(void **data) {
+  cache_state *s;
+  cache *mem;
+
+  s = calloc(1, sizeof(*s));
+  if (s == NULL)
+    return 1;
+  strcpy(s->dir, "/tmp/gpuarray_benchXXXXXX");
+  if (mkdtemp(s->dir) == NULL) {
+    free(s);
+    return 1;
+  }
+  /* The memory cache is too small to hold the keys used for the
+     lookups so that they always go to the disk */
+  mem = cache_lru(1, 1, int_eq, int_hash, no_free, no_free, global_err);
+  if (mem == NULL)
+    goto fail;
+  s->c = cache_disk(s->dir, mem, int_write, val_write, int_read, val_read,
+                    global_err);
+  if (s->c == NULL) {
+    cache_destroy(mem);
+    goto fail;
+  }
+  fill(s, NDISK);
+  *data = s;
+  return 0;
+ fail:
+  nftw(s->dir, rm_entry, 8, FTW_DEPTH|FTW_PHYS);
+  free(s);
+  return 1;
+}
+
+static void teardown(void *data) {
+  cache_state *s = data;
+  cache_destroy(s->c);
+  if (s->dir[0] != '\0')
+    nftw(s->dir, rm_entry, 8, FTW_DEPTH|FTW_PHYS);
+  free(s);
+}
+
+/* Adds new keys to a full cache, so every add evicts */
+static void run_add(void *data, size_t iters) {
+  cache_state *s = data;
+  size_t i;
+  for (i = 0; i < iters; i++, s->next++)
+    cache_add(s->c, (cache_key_t)s->next, (cache_value_t)s->next);
+}
+
+/* Lookups of the most recently added keys */
+static void run_get_hit(void *data, size_t iters) {
+  cache_state *s = data;
+  size_t base = s->next - NHIT;
+  size_t acc = 0;
+  size_t i;
+  for (i = 0; i < iters; i++)
+    acc += (size_t)cache_get(s->c, (cache_key_t)(base + i % NHIT));
+  bench_sink = acc;
+}
+
+static void run_get_miss(void *data, size_t iters) {
+  cache_state *s = data;
+  size_t acc = 0;
+  size_t i;
+  for (i = 0; i < iters; i++)
+    acc += (size_t)cache_get(s->c, (cache_key_t)(MISS_BASE + i % NKEYS));
+  bench_sink = acc;
+}
+
+static void run_disk_hit(void *data, size_t iters) {
+  cache_state *s = data;
+  size_t acc = 0;
+  size_t i;
+  for (i = 0; i < iters; i++)
+    acc += (size_t)cache_get(s->c, (cache_key_t)(1 + i % NDISK));
+  bench_sink = acc;
+}
+
+const bench bench_cache[] = {
+  {"cache_lru_add_evict", setup_lru, run_add, teardown},
+  {"cache_lru_get_hit", setup_lru, run_get_hit, teardown},
+  {"cache_lru_get_miss", setup_lru, run_get_miss, teardown},
+  {"cache_twoq_add_evict", setup_twoq, run_add, teardown},
+  {"cache_twoq_get_hit", setup_twoq, run_get_hit, teardown},
+  {"cache_twoq_get_miss", setup_twoq, run_get_miss, teardown},
+  {"cache_disk_get_hit", setup_disk, run_disk_hit, teardown},
+  {"cache_disk_get_miss", setup_disk, run_get_miss, teardown},
+  {NULL, NULL, NULL, NULL}
+};
@@ -0,0 +1,220 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+
+#include "gpuarray/array.h"
+#include "gpuarray/elemwise.h"
+#include "gpuarray/kernel.h"
+
+/*
+ * Kernel source generation and launch preparation, on the stub
+ * context.  The "cold" variants drop the kernels cached by signature
+ * after each operation so that the source is generated every time.
+ */
+
+typedef struct _gen_state {
+  gpucontext *ctx;
+  gpuelemwise_arg args[3];
+  GpuElemwise *ge;
+  GpuArray a, b, c;
+  void *cargs[3];
+  GpuKernel k;
+} gen_state;
+
+static const char *ew_expr = "c = a * b + a";
+
+static void teardown(void *data) {
+  gen_state *s = data;
+  if (s->ge != NULL)
+    GpuElemwise_free(s->ge);
+  if (s->k.k != NULL)
+    GpuKernel_clear(&s->k);
+  GpuArray_clear(&s->a);
+  GpuArray_clear(&s->b);
+  GpuArray_clear(&s->c);
+  gpucontext_deref(s->ctx);
+  free(s);
+}
+
+static gen_state *new_state(void) {
+  gen_state *s = calloc(1, sizeof(*s));
+  if (s == NULL)
+    return NULL;
+  s->ctx = stub_context_new();
+  if (s->ctx == NULL) {
+    free(s);
+    return NULL;
+  }
+  s->args[0].name = "a";
+  s->args[0].typecode = GA_FLOAT;
+  s->args[0].flags = GE_READ;
+  s->args[1].name = "b";
+  s->args[1].typecode = GA_FLOAT;
+  s->args[1].flags = GE_READ;
+  s->args[2].name = "c";
+  s->args[2].typecode = GA_FLOAT;
+  s->args[2].flags = GE_WRITE;
+  s->cargs[0] = &s->a;
+  s->cargs[1] = &s->b;
+  s->cargs[2] = &s->c;
+  return s;
+}
+
+static int setup_ctx(void **data) {
+  gen_state *s = new_state();
+  if (s == NULL)
+    return 1;
+  *data = s;
+  return 0;
+}
+
+static void run_ew_new(gen_state *s, size_t iters, int cold) {
+  GpuElemwise *ge;
+  size_t i;
+  for (i = 0; i < iters; i++) {
+    ge = GpuElemwise_new(s->ctx, NULL, ew_expr, 3, s->args, 3, 0);
+    if (ge != NULL)
+      GpuElemwise_free(ge);
+    if (cold)
+      stub_context_flush(s->ctx);
+  }
+}
+
+static void run_ew_new_cold(void *data, size_t iters) {
+  run_ew_new(data, iters, 1);
+}
+
+static void run_ew_new_warm(void *data, size_t iters) {
+  run_ew_new(data, iters, 0);
+}
+
+/*
+ * a and c are contiguous, b is either contiguous or a strided view
+ * of a bigger array.
+ */
+static int setup_ew_call(void **data, int strided) {
+  static const size_t dims[3] = {64, 32, 16};
+  static const size_t bdims[3] = {128, 32, 32};
+  static const ssize_t starts[3] = {0, 0, 0};
+  static const ssize_t stops[3] = {128, 32, 32};
+  static const ssize_t steps[3] = {2, 1, 2};
+  gen_state *s = new_state();
+  GpuArray tmp;
+
+  if (s == NULL)
+    return 1;
+  *data = s;
+  if (GpuArray_empty(&s->a, s->ctx, GA_FLOAT, 3, dims, GA_C_ORDER) ||
+      GpuArray_empty(&s->c, s->ctx, GA_FLOAT, 3, dims, GA_C_ORDER))
+    goto fail;
+  if (strided) {
+    if (GpuArray_empty(&tmp, s->ctx, GA_FLOAT, 3, bdims, GA_C_ORDER))
+      goto fail;
+    if (GpuArray_index(&s->b, &tmp, starts, stops, steps)) {
+      GpuArray_clear(&tmp);
+      goto fail;
+    }
+    GpuArray_clear(&tmp);
+  } else if (GpuArray_empty(&s->b, s->ctx, GA_FLOAT, 3, dims, GA_C_ORDER)) {
+    goto fail;
+  }
+  s->ge = GpuElemwise_new(s->ctx, NULL, ew_expr, 3, s->args, 3, 0);
+  if (s->ge == NULL || GpuElemwise_call(s->ge, s->cargs, 0) != GA_NO_ERROR)
+    goto fail;
+  return 0;
+ fail:
+  teardown(s);
+  return 1;
+}
+
+static int setup_ew_contig(void **data) {
+  return setup_ew_call(data, 0);
+}
+
+static int setup_ew_strided(void **data) {
+  return setup_ew_call(data, 1);
+}
+
+static void run_ew_call(void *data, size_t iters) {
+  gen_state *s = data;
+  size_t i;
+  for (i = 0; i < iters; i++)
+    GpuElemwise_call(s->ge, s->cargs, 0);
+}
+
+static int setup_maxandargmax(void **data) {
+  static const size_t dims[3] = {32, 256, 64};
+  static const size_t rdims[2] = {32, 64};
+  static const unsigned int redux[1] = {1};
+  gen_state *s = new_state();
+
+  if (s == NULL)
+    return 1;
+  *data = s;
+  if (GpuArray_empty(&s->a, s->ctx, GA_FLOAT, 3, dims, GA_C_ORDER) ||
+      GpuArray_empty(&s->b, s->ctx, GA_FLOAT, 2, rdims, GA_C_ORDER) ||
+      GpuArray_empty(&s->c, s->ctx, GA_ULONG, 2, rdims, GA_C_ORDER) ||
+      GpuArray_maxandargmax(&s->b, &s->c, &s->a, 1, redux) != GA_NO_ERROR) {
+    teardown(s);
+    return 1;
+  }
+  return 0;
+}
+
+static void run_maxandargmax(gen_state *s, size_t iters, int cold) {
+  static const unsigned int redux[1] = {1};
+  size_t i;
+  for (i = 0; i < iters; i++) {
+    GpuArray_maxandargmax(&s->b, &s->c, &s->a, 1, redux);
+    if (cold)
+      stub_context_flush(s->ctx);
+  }
+}
+
+static void run_maxandargmax_cold(void *data, size_t iters) {
+  run_maxandargmax(data, iters, 1);
+}
+
+static void run_maxandargmax_warm(void *data, size_t iters) {
+  run_maxandargmax(data, iters, 0);
+}
+
+static int setup_sched(void **data) {
+  static const char *src = "KERNEL void k(GLOBAL_MEM float *a) {}";
+  static const int types[1] = {GA_BUFFER};
+  gen_state *s = new_state();
+
+  if (s == NULL)
+    return 1;
+  *data = s;
+  if (GpuKernel_init(&s->k, s->ctx, 1, &src, NULL, "k", 1, types, 0,
+                     NULL) != GA_NO_ERROR) {
+    teardown(s);
+    return 1;
+  }
+  return 0;
+}
+
+static void run_sched(void *data, size_t iters) {
+  gen_state *s = data;
+  size_t gs, ls, acc = 0;
+  size_t i;
+  for (i = 0; i < iters; i++) {
+    gs = ls = 0;
+    GpuKernel_sched(&s->k, 1000 + (i % 1024) * 997, &gs, &ls);
+    acc += gs + ls;
+  }
+  bench_sink = acc;
+}
+
+const bench bench_gen[] = {
+  {"elemwise_new_cold", setup_ctx, run_ew_new_cold, teardown},
+  {"elemwise_new_warm", setup_ctx, run_ew_new_warm, teardown},
+  {"elemwise_call_contig", setup_ew_contig, run_ew_call, teardown},
+  {"elemwise_call_strided", setup_ew_strided, run_ew_call, teardown},
+  {"maxandargmax_cold", setup_maxandargmax, run_maxandargmax_cold, teardown},
+  {"maxandargmax_warm", setup_maxandargmax, run_maxandargmax_warm, teardown},
+  {"kernel_sched", setup_sched, run_sched, teardown},
+  {NULL, NULL, NULL, NULL}
+};
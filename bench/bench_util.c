@@ -0,0 +1,171 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+
+#include "gpuarray/util.h"
+#include "util/integerfactoring.h"
+#include "util/skein.h"
+#include "util/xxhash.h"
+
+#define NARGS 3
+#define ND 4
+
+/*
+ * The shape is 8x16x1x32 with one argument transposed on the last
+ * two dimensions, so two of the dimensions can be collapsed.
+ */
+static const size_t collapse_dims[ND] = {8, 16, 1, 32};
+static const ssize_t collapse_strs[NARGS][ND] = {
+  {2048, 128, 128, 4},
+  {2048, 128, 128, 4},
+  {2048, 4, 4, 64},
+};
+
+static void run_collapse(void *data, size_t iters) {
+  size_t dims[ND];
+  ssize_t _strs[NARGS][ND];
+  ssize_t *strs[NARGS];
+  unsigned int nd;
+  size_t acc = 0;
+  size_t i;
+  unsigned int j;
+
+  for (j = 0; j < NARGS; j++)
+    strs[j] = _strs[j];
+  for (i = 0; i < iters; i++) {
+    nd = ND;
+    memcpy(dims, collapse_dims, sizeof(dims));
+    memcpy(_strs, collapse_strs, sizeof(_strs));
+    gpuarray_elemwise_collapse(NARGS, &nd, dims, strs);
+    acc += nd;
+  }
+  bench_sink = acc;
+}
+
+/*
+ * Sizes of the kind seen by the reduction scheduler: powers of two,
+ * odd sizes, primes and products of large primes.
+ */
+static const uint64_t factor_n[] = {
+  1000, 1023, 1024, 4097, 10007, 65537, 100000, 999983,
+  1048575, 2000006, 3628800, 16777213, 25165824, 100000007,
+  4294967291ULL, 1099511627776ULL,
+};
+#define NFACTOR (sizeof(factor_n)/sizeof(factor_n[0]))
+
+static void run_factorize(void *data, size_t iters) {
+  ga_factor_list fl;
+  uint64_t n;
+  size_t acc = 0;
+  size_t i;
+
+  for (i = 0; i < iters; i++) {
+    n = factor_n[i % NFACTOR];
+    acc += gaIFactorize(n, (uint64_t)(n * 1.1), 1024, &fl);
+  }
+  bench_sink = acc;
+}
+
+typedef struct _ifl_state {
+  ga_factor_list bs[3];
+  ga_factor_list gs[3];
+  ga_factor_list cs[3];
+} ifl_state;
+
+/* The starting point of maxandargmaxSchedule() for a 1000x300x77 output */
+static int setup_ifl(void **data) {
+  static const uint64_t dims[3] = {1000, 300, 77};
+  ifl_state *s = malloc(sizeof(*s));
+  int i;
+
+  if (s == NULL)
+    return 1;
+  for (i = 0; i < 3; i++) {
+    gaIFLInit(&s->bs[i]);
+    gaIFLInit(&s->gs[i]);
+    gaIFLInit(&s->cs[i]);
+  }
+  gaIFactorize(32, 0, 0, &s->bs[0]);
+  gaIFactorize((dims[0] + 31) / 32, (uint64_t)((dims[0] + 31) / 32 * 1.1),
+               1024, &s->cs[0]);
+  gaIFactorize(dims[1], (uint64_t)(dims[1] * 1.1), 1024, &s->cs[1]);
+  gaIFactorize(dims[2], (uint64_t)(dims[2] * 1.1), 64, &s->cs[2]);
+  *data = s;
+  return 0;
+}
+
+static void run_ifl_schedule(void *data, size_t iters) {
+  static const uint64_t maxBind[3] = {1024, 1024, 64};
+  static const uint64_t maxGind[3] = {2147483647, 65535, 65535};
+  ifl_state *s = data;
+  ga_factor_list bs[3], gs[3], cs[3];
+  size_t acc = 0;
+  size_t i;
+
+  for (i = 0; i < iters; i++) {
+    memcpy(bs, s->bs, sizeof(bs));
+    memcpy(gs, s->gs, sizeof(gs));
+    memcpy(cs, s->cs, sizeof(cs));
+    gaIFLSchedule(3, 1024, maxBind, 2147483647, maxGind, bs, gs, cs);
+    acc += gaIFLGetProduct(&bs[0]) + gaIFLGetProduct(&gs[0]);
+  }
+  bench_sink = acc;
+}
+
+static int setup_buf(void **data, size_t sz) {
+  unsigned char *b = malloc(sz + sizeof(size_t));
+  size_t i;
+
+  if (b == NULL)
+    return 1;
+  memcpy(b, &sz, sizeof(size_t));
+  for (i = 0; i < sz; i++)
+    b[sizeof(size_t) + i] = (unsigned char)(i * 31 + 7);
+  *data = b;
+  return 0;
+}
+
+static int setup_64(void **data) {
+  return setup_buf(data, 64);
+}
+
+static int setup_4k(void **data) {
+  return setup_buf(data, 4096);
+}
+
+static void run_xxh32(void *data, size_t iters) {
+  size_t sz;
+  size_t acc = 0;
+  size_t i;
+
+  memcpy(&sz, data, sizeof(size_t));
+  for (i = 0; i < iters; i++)
+    acc += XXH32((char *)data + sizeof(size_t), sz, (unsigned)i);
+  bench_sink = acc;
+}
+
+static void run_skein(void *data, size_t iters) {
+  unsigned char hash[64];
+  size_t sz;
+  size_t acc = 0;
+  size_t i;
+
+  memcpy(&sz, data, sizeof(size_t));
+  for (i = 0; i < iters; i++) {
+    Skein_512((unsigned char *)data + sizeof(size_t), sz, hash);
+    acc += hash[i % 64];
+  }
+  bench_sink = acc;
+}
+
+const bench bench_util[] = {
+  {"elemwise_collapse", NULL, run_collapse, NULL},
+  {"ifactorize", NULL, run_factorize, NULL},
+  {"ifl_schedule", setup_ifl, run_ifl_schedule, free},
+  {"xxh32_64B", setup_64, run_xxh32, free},
+  {"xxh32_4KiB", setup_4k, run_xxh32, free},
+  {"skein512_64B", setup_64, run_skein, free},
+  {"skein512_4KiB", setup_4k, run_skein, free},
+  {NULL, NULL, NULL, NULL}
+};
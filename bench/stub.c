@@ -0,0 +1,232 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+
+#include "gpuarray/error.h"
+
+/*
+ * The device is described as a 80 multiprocessor GPU with the
+ * residency limits of a V100 so that the scheduling code takes the
+ * same paths as on real hardware.
+ */
+#define STUB_NUMPROCS 80
+#define STUB_WARP 32
+#define STUB_MAXLSIZE 1024
+#define STUB_THREADS_MP 2048
+#define STUB_BLOCKS_MP 32
+#define STUB_REGS_MP 65536
+#define STUB_LMEM_MP 98304
+#define STUB_KERNEL_REGS 32
+
+typedef struct _stub_data {
+  void *devptr;
+  gpucontext *ctx;
+  unsigned int refcnt;
+  size_t sz;
+} stub_data;
+
+typedef struct _stub_kernel {
+  gpucontext *ctx;
+  unsigned int refcnt;
+  unsigned int numargs;
+  int *types;
+} stub_kernel;
+
+static const gpuarray_buffer_ops stub_ops;
+
+static void stub_deinit(gpucontext *ctx) {
+  error_free(ctx->err);
+  free(ctx);
+}
+
+static gpudata *stub_alloc(gpucontext *ctx, size_t sz, void *data,
+                           int flags) {
+  stub_data *res = malloc(sizeof(*res));
+  if (res == NULL) {
+    error_sys(ctx->err, "malloc");
+    return NULL;
+  }
+  res->devptr = NULL;
+  res->ctx = ctx;
+  res->refcnt = 1;
+  res->sz = sz;
+  return (gpudata *)res;
+}
+
+static void stub_retain(gpudata *b) {
+  ((stub_data *)b)->refcnt++;
+}
+
+static void stub_release(gpudata *b) {
+  stub_data *d = (stub_data *)b;
+  if (--d->refcnt == 0)
+    free(d);
+}
+
+static int stub_newkernel(gpukernel **k, gpucontext *ctx, unsigned int count,
+                          const char **strings, const size_t *lengths,
+                          const char *fname, unsigned int numargs,
+                          const int *typecodes, int flags, char **err_str) {
+  stub_kernel *res = malloc(sizeof(*res));
+  if (res == NULL)
+    return error_sys(ctx->err, "malloc");
+  res->types = memdup(typecodes, numargs * sizeof(int));
+  if (res->types == NULL && numargs != 0) {
+    free(res);
+    return error_sys(ctx->err, "malloc");
+  }
+  res->ctx = ctx;
+  res->refcnt = 1;
+  res->numargs = numargs;
+  *k = (gpukernel *)res;
+  return GA_NO_ERROR;
+}
+
+static void stub_retainkernel(gpukernel *k) {
+  ((stub_kernel *)k)->refcnt++;
+}
+
+static void stub_releasekernel(gpukernel *k) {
+  stub_kernel *sk = (stub_kernel *)k;
+  if (--sk->refcnt == 0) {
+    free(sk->types);
+    free(sk);
+  }
+}
+
+static int stub_kernelsetarg(gpukernel *k, unsigned int i, void *a) {
+  return GA_NO_ERROR;
+}
+
+static int stub_callkernel(gpukernel *k, unsigned int n,
+                           const size_t *gs, const size_t *ls,
+                           size_t shared, void **args) {
+  return GA_NO_ERROR;
+}
+
+static int stub_property(gpucontext *ctx, gpudata *buf, gpukernel *k,
+                         int prop_id, void *res) {
+  if (ctx == NULL && buf != NULL)
+    ctx = ((stub_data *)buf)->ctx;
+  if (ctx == NULL && k != NULL)
+    ctx = ((stub_kernel *)k)->ctx;
+
+  switch (prop_id) {
+  case GA_CTX_PROP_DEVNAME:
+    *((char **)res) = strdup("stub");
+    if (*((char **)res) == NULL)
+      return error_sys(ctx->err, "strdup");
+    return GA_NO_ERROR;
+  case GA_CTX_PROP_LMEMSIZE:
+    *((size_t *)res) = 49152;
+    return GA_NO_ERROR;
+  case GA_CTX_PROP_NUMPROCS:
+    *((unsigned int *)res) = STUB_NUMPROCS;
+    return GA_NO_ERROR;
+  case GA_CTX_PROP_NATIVE_FLOAT16:
+    *((int *)res) = 0;
+    return GA_NO_ERROR;
+  case GA_CTX_PROP_MAXGSIZE0:
+    *((size_t *)res) = 2147483647;
+    return GA_NO_ERROR;
+  case GA_CTX_PROP_MAXGSIZE1:
+  case GA_CTX_PROP_MAXGSIZE2:
+    *((size_t *)res) = 65535;
+    return GA_NO_ERROR;
+  case GA_CTX_PROP_MAXLSIZE0:
+  case GA_CTX_PROP_MAXLSIZE1:
+    *((size_t *)res) = STUB_MAXLSIZE;
+    return GA_NO_ERROR;
+  case GA_CTX_PROP_MAXLSIZE2:
+    *((size_t *)res) = 64;
+    return GA_NO_ERROR;
+  case GA_CTX_PROP_MAXTHREADS_MP:
+    *((unsigned int *)res) = STUB_THREADS_MP;
+    return GA_NO_ERROR;
+  case GA_CTX_PROP_MAXBLOCKS_MP:
+    *((unsigned int *)res) = STUB_BLOCKS_MP;
+    return GA_NO_ERROR;
+  case GA_CTX_PROP_REGS_MP:
+    *((unsigned int *)res) = STUB_REGS_MP;
+    return GA_NO_ERROR;
+  case GA_CTX_PROP_LMEMSIZE_MP:
+    *((size_t *)res) = STUB_LMEM_MP;
+    return GA_NO_ERROR;
+  case GA_BUFFER_PROP_REFCNT:
+    *((unsigned int *)res) = ((stub_data *)buf)->refcnt;
+    return GA_NO_ERROR;
+  case GA_BUFFER_PROP_SIZE:
+    *((size_t *)res) = ((stub_data *)buf)->sz;
+    return GA_NO_ERROR;
+  case GA_KERNEL_PROP_MAXLSIZE:
+    *((size_t *)res) = STUB_MAXLSIZE;
+    return GA_NO_ERROR;
+  case GA_KERNEL_PROP_PREFLSIZE:
+    *((size_t *)res) = STUB_WARP;
+    return GA_NO_ERROR;
+  case GA_KERNEL_PROP_NUMARGS:
+    *((unsigned int *)res) = ((stub_kernel *)k)->numargs;
+    return GA_NO_ERROR;
+  case GA_KERNEL_PROP_TYPES:
+    *((const int **)res) = ((stub_kernel *)k)->types;
+    return GA_NO_ERROR;
+  case GA_KERNEL_PROP_NUMREGS:
+    *((unsigned int *)res) = STUB_KERNEL_REGS;
+    return GA_NO_ERROR;
+  case GA_KERNEL_PROP_LMEMSIZE:
+    *((size_t *)res) = 0;
+    return GA_NO_ERROR;
+  default:
+    return error_fmt(ctx->err, GA_INVALID_ERROR,
+                     "Property %d not supported by the stub", prop_id);
+  }
+}
+
+static const char *stub_error(gpucontext *ctx) {
+  if (ctx == NULL)
+    return error_msg(global_err);
+  return error_msg(ctx->err);
+}
+
+static const gpuarray_buffer_ops stub_ops = {NULL, /* get_platform_count */
+                                             NULL, /* get_device_count */
+                                             NULL, /* buffer_init */
+                                             stub_deinit,
+                                             stub_alloc,
+                                             stub_retain,
+                                             stub_release,
+                                             NULL, /* buffer_share */
+                                             NULL, /* buffer_move */
+                                             NULL, /* buffer_read */
+                                             NULL, /* buffer_write */
+                                             NULL, /* buffer_memset */
+                                             stub_newkernel,
+                                             stub_retainkernel,
+                                             stub_releasekernel,
+                                             stub_kernelsetarg,
+                                             stub_callkernel,
+                                             NULL, /* buffer_sync */
+                                             NULL, /* buffer_transfer */
+                                             stub_property,
+                                             stub_error};
+
+gpucontext *stub_context_new(void) {
+  gpucontext *res = calloc(1, sizeof(*res));
+  if (res == NULL)
+    return NULL;
+  if (error_alloc(&res->err)) {
+    free(res);
+    return NULL;
+  }
+  res->ops = &stub_ops;
+  res->refcnt = 1;
+  return res;
+}
+
+void stub_context_flush(gpucontext *ctx) {
+  if (ctx->keyed_kernels != NULL) {
+    cache_destroy(ctx->keyed_kernels);
+    ctx->keyed_kernels = NULL;
+  }
+}
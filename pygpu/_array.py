@@ -1,7 +1,7 @@
 from __future__ import division
 import numpy as np
 
-from .elemwise import elemwise1, elemwise2, ielemwise2, compare, arg, GpuElemwise, as_argument
+from .elemwise import elemwise1, elemwise2, ielemwise2, compare, elemwise_multi
 from .reduction import reduce1
 from .dtypes import dtype_to_ctype, get_np_obj, get_common_dtype
 from . import gpuarray
@@ -130,55 +130,55 @@ class ndgpuarray(gpuarray.GpuArray):
         return ielemwise2(self, '%', other, **kw)
 
     # divmod
-    def __divmod__(self, other):
-        if not isinstance(other, gpuarray.GpuArray):
-            other = np.asarray(other)
-        odtype = get_common_dtype(self, other, True)
-
-        a_arg = as_argument(self, 'a', read=True)
-        b_arg = as_argument(other, 'b', read=True)
-        args = [arg('div', odtype, write=True), arg('mod', odtype, write=True), a_arg, b_arg]
-
-        div = self._empty_like_me(dtype=odtype)
-        mod = self._empty_like_me(dtype=odtype)
-
+    def _divmod(self, a, b, out):
+        odtype = get_common_dtype(a, b, True)
+        ctype = dtype_to_ctype(np.dtype('float32') if odtype == np.float16
+                               else odtype)
         if odtype.kind == 'f':
-            tmpl = ("div = floor((%(out_t)s)a / (%(out_t)s)b),"
+            tmpl = ("div = floor((%(out_t)s)a / (%(out_t)s)b);"
                     "mod = fmod((%(out_t)s)a, (%(out_t)s)b)")
         else:
-            tmpl = ("div = (%(out_t)s)a / (%(out_t)s)b,"
+            tmpl = ("div = (%(out_t)s)a / (%(out_t)s)b;"
                     "mod = a %% b")
+        # self goes first so that the results get its class
+        inputs = [('a', a), ('b', b)]
+        if b is self:
+            inputs.reverse()
+        return elemwise_multi(inputs, [('div', odtype), ('mod', odtype)],
+                              tmpl % {'out_t': ctype},
+                              out=out, broadcast=True)
+
+    def divmod(self, other, out=None):
+        """
+        divmod(other, out=None)
+
+        Returns the floor division and remainder as a tuple, computed
+        in one pass.  `out` can be a tuple of two arrays (or None) to
+        store the results.
+        """
+        return self._divmod(self, other, out)
 
-        ksrc = tmpl % {'out_t': dtype_to_ctype(odtype)}
-
-        k = GpuElemwise(self.context, ksrc, args)
-        k(div, mod, self, other, broadcast=True)
-        return (div, mod)
+    def __divmod__(self, other):
+        return self._divmod(self, other, None)
 
     def __rdivmod__(self, other):
-        if not isinstance(other, gpuarray.GpuArray):
-            other = np.asarray(other)
-        odtype = get_common_dtype(other, self, True)
-
-        a_arg = as_argument(other, 'a', read=True)
-        b_arg = as_argument(self, 'b', read=True)
-        args = [arg('div', odtype, write=True), arg('mod', odtype, write=True), a_arg, b_arg]
-
-        div = self._empty_like_me(dtype=odtype)
-        mod = self._empty_like_me(dtype=odtype)
-
-        if odtype.kind == 'f':
-            tmpl = ("div = floor((%(out_t)s)a / (%(out_t)s)b),"
-                    "mod = fmod((%(out_t)s)a, (%(out_t)s)b)")
-        else:
-            tmpl = ("div = (%(out_t)s)a / (%(out_t)s)b,"
-                    "mod = a %% b")
-
-        ksrc = tmpl % {'out_t': dtype_to_ctype(odtype)}
-
-        k = GpuElemwise(self.context, ksrc, args)
-        k(div, mod, other, self, broadcast=True)
-        return (div, mod)
+        return self._divmod(other, self, None)
+
+    def modf(self, out=None):
+        """
+        modf(out=None)
+
+        Returns the fractional and integral parts as a tuple, computed
+        in one pass.  `out` can be a tuple of two arrays (or None) to
+        store the results.
+        """
+        odtype = np.modf(np.ones(1, dtype=self.dtype))[0].dtype
+        ctype = dtype_to_ctype(np.dtype('float32') if odtype == np.float16
+                               else odtype)
+        return elemwise_multi([('a', self)], [('frac', odtype), ('ip', odtype)],
+                              "t = trunc((%s)a); frac = (%s)a - t; ip = t" %
+                              (ctype, ctype),
+                              out=out, temps=[('t', odtype)])
 
     def __neg__(self):
         return elemwise1(self, '-')
@@ -189,6 +189,10 @@ class ndgpuarray(gpuarray.GpuArray):
     def __abs__(self):
         if self.dtype.kind == 'u':
             return self.copy()
+        if self.dtype.kind == 'c':
+            odtype = np.dtype('f%d' % (self.dtype.itemsize // 2,))
+            oper = "res = %s_abs(a)" % (dtype_to_ctype(self.dtype),)
+            return elemwise_multi([('a', self)], [('res', odtype)], oper)[0]
         if self.dtype.kind == 'f':
             oper = "res = fabs(a)"
         elif self.dtype.itemsize < 4:
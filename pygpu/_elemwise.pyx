@@ -4,7 +4,8 @@ from pygpu.gpuarray cimport (gpucontext, GA_NO_ERROR, get_typecode,
                              get_exc, gpuarray_get_elsize)
 from pygpu.gpuarray cimport (GA_BUFFER, GA_SIZE, GA_SSIZE, GA_ULONG, GA_LONG,
                              GA_UINT, GA_INT, GA_USHORT, GA_SHORT,
-                             GA_UBYTE, GA_BYTE, GA_DOUBLE, GA_FLOAT)
+                             GA_UBYTE, GA_BYTE, GA_DOUBLE, GA_FLOAT,
+                             GA_CFLOAT, GA_CDOUBLE)
 from libc.string cimport memset, memcpy, strdup
 from libc.stdlib cimport malloc, calloc, free
 
@@ -34,6 +35,7 @@ cdef extern from "gpuarray/elemwise.h":
                                   int flags)
     void GpuElemwise_free(_GpuElemwise *ge)
     int GpuElemwise_call(_GpuElemwise *ge, void **args, int flags)
+    int GpuElemwise_specialize(_GpuElemwise *ge, unsigned int threshold)
 
     cdef int GE_NOADDR64
     cdef int GE_CONVERT_F16
@@ -97,7 +99,8 @@ cdef class GpuElemwise:
     cdef unsigned int n
 
     def __cinit__(self, GpuContext ctx, expr, args, unsigned int nd=0,
-                  preamble=b"", bint convert_f16=False):
+                  preamble=b"", bint convert_f16=False,
+                  unsigned int specialize=0):
         cdef gpuelemwise_arg *_args;
         cdef unsigned int i
         cdef arg aa
@@ -142,6 +145,9 @@ cdef class GpuElemwise:
             free(_args)
         if self.ge is NULL:
             raise GpuArrayException("Could not initialize C GpuElemwise instance")
+        if specialize != 0:
+            if GpuElemwise_specialize(self.ge, specialize) != GA_NO_ERROR:
+                raise MemoryError
 
     def __dealloc__(self):
         cdef unsigned int i
@@ -171,6 +177,14 @@ cdef class GpuElemwise:
             (<float *>self.callbuf[index])[0] = o
         elif typecode == GA_DOUBLE:
             (<double *>self.callbuf[index])[0] = o
+        elif typecode == GA_CFLOAT:
+            o = complex(o)
+            (<float *>self.callbuf[index])[0] = o.real
+            (<float *>self.callbuf[index])[1] = o.imag
+        elif typecode == GA_CDOUBLE:
+            o = complex(o)
+            (<double *>self.callbuf[index])[0] = o.real
+            (<double *>self.callbuf[index])[1] = o.imag
         elif typecode == GA_BYTE:
             (<signed char *>self.callbuf[index])[0] = o
         elif typecode == GA_UBYTE:
@@ -0,0 +1,40 @@
+"""
+Benchmarks of the pygpu operations.
+
+Run them with::
+
+    python -m pygpu.benchmarks -d cuda0 -o results.json
+
+The device defaults to $GPUARRAY_TEST_DEVICE or $DEVICE, and then to
+the first CUDA or OpenCL device that can be opened.
+
+The report is a JSON object with these keys:
+
+schema
+    'pygpu-bench/1', changed when the layout below changes
+created, pygpu_version, api_version, abi_version, python, numpy, platform
+    where and when the results were obtained
+device
+    kind and properties of the context ('dev', 'kind', 'devname',
+    'unique_id', 'bin_id', 'numprocs', ...), null when not available
+settings
+    the options of the run
+results
+    one object per benchmark with 'id', 'suite', 'name', 'params',
+    'status' ('ok', 'skipped' or 'error') and 'reason', and for those
+    that ran:
+
+    warm
+        time of one call once the kernels are built: 'median_s',
+        'min_s', 'stddev_s' over 'samples' samples of 'calls' queued
+        calls each
+    cold_s
+        time of the first call in a new process with an empty kernel
+        cache (null if not measured)
+    disk_s
+        the same, with the kernel cache on disk filled by the cold run
+    bytes, gb_per_s, flops, gflop_per_s
+        work done by one call and the rates for the median time, null
+        when they don't apply
+"""
+from .harness import run, cases, Skip  # noqa
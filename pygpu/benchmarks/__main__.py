@@ -0,0 +1,60 @@
+from __future__ import print_function
+
+import argparse
+import json
+import sys
+
+from . import harness
+
+
+def main(argv=None):
+    p = argparse.ArgumentParser(prog='python -m pygpu.benchmarks',
+                                description="Run the pygpu benchmarks.")
+    p.add_argument('-d', '--device', default=None,
+                   help="device to use (default: $GPUARRAY_TEST_DEVICE, "
+                   "$DEVICE or the first one that works)")
+    p.add_argument('-o', '--output', default=None,
+                   help="file to write the results to (default: stdout)")
+    p.add_argument('--min-time', type=float, default=0.05,
+                   help="minimum duration of a sample in seconds")
+    p.add_argument('--repeat', type=int, default=5,
+                   help="number of samples")
+    p.add_argument('--max-size', type=int, default=None,
+                   help="skip the cases with more elements than this")
+    p.add_argument('--no-cold', action='store_true',
+                   help="don't measure the first calls in new processes")
+    p.add_argument('--list', action='store_true',
+                   help="list the benchmarks and exit")
+    p.add_argument('--probe', help=argparse.SUPPRESS)
+    p.add_argument('--kernel-cache', help=argparse.SUPPRESS)
+    p.add_argument('filters', nargs='*',
+                   help="only run the benchmarks whose id contains one "
+                   "of these")
+    args = p.parse_args(argv)
+
+    if args.probe is not None:
+        print(json.dumps(harness.probe(args.device, args.probe,
+                                       args.kernel_cache)))
+        return 0
+
+    if args.list:
+        for c in harness.cases():
+            if not args.filters or any(f in c.id for f in args.filters):
+                print(c.id)
+        return 0
+
+    res = harness.run(args.device, args.filters, min_time=args.min_time,
+                      repeat=args.repeat, cold=not args.no_cold,
+                      max_size=args.max_size)
+    out = sys.stdout if args.output is None else open(args.output, 'w')
+    try:
+        json.dump(res, out, indent=1, sort_keys=True)
+        out.write('\n')
+    finally:
+        if out is not sys.stdout:
+            out.close()
+    return 0 if all(r['status'] != 'error' for r in res['results']) else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
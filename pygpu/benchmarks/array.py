@@ -0,0 +1,103 @@
+from __future__ import division
+
+import numpy
+
+from .. import gpuarray
+from ..operations import concatenate
+from .harness import case, Skip
+
+SIZES = [2**10, 2**16, 2**20, 2**24]
+
+
+def _rand(ctx, shape, dtype='float32'):
+    return gpuarray.asarray(numpy.random.rand(*shape).astype(dtype),
+                            context=ctx)
+
+
+@case('array', 'take1', size=SIZES)
+def take1(ctx, size):
+    # Rows of 64 floats, half of them picked at random
+    rows = max(size // 64, 1)
+    a = _rand(ctx, (rows, 64))
+    idx = gpuarray.asarray(numpy.random.randint(0, rows, rows // 2 or 1)
+                           .astype('int64'), context=ctx)
+
+    def fn():
+        return a.take1(idx)
+    return fn, dict(bytes=(rows // 2 or 1) * (2 * 64 * 4 + 8))
+
+
+@case('array', 'copy', size=SIZES, layout=['contiguous', 'transposed'])
+def copy(ctx, size, layout):
+    rows = 2 ** ((size.bit_length() - 1) // 2)
+    a = _rand(ctx, (rows, size // rows))
+    if layout == 'transposed':
+        a = a.T
+
+    def fn():
+        return a.copy(order='C')
+    return fn, dict(bytes=2 * size * 4)
+
+
+@case('array', 'astype', size=SIZES, dtype=['float64', 'int32'])
+def astype(ctx, size, dtype):
+    a = _rand(ctx, (size,))
+    osz = numpy.dtype(dtype).itemsize
+
+    def fn():
+        return a.astype(dtype)
+    return fn, dict(bytes=size * (4 + osz))
+
+
+@case('array', 'concatenate', size=SIZES, axis=[0, 1])
+def concatenate_(ctx, size, axis):
+    # Three pieces that together hold `size` elements
+    rows = 2 ** ((size.bit_length() - 1) // 2)
+    cols = size // rows
+    if axis == 0:
+        shapes = [(rows // 4, cols), (rows // 4, cols), (rows // 2, cols)]
+    else:
+        shapes = [(rows, cols // 4), (rows, cols // 4), (rows, cols // 2)]
+    arys = [_rand(ctx, s) for s in shapes]
+
+    def fn():
+        return concatenate(arys, axis=axis, context=ctx)
+    return fn, dict(bytes=2 * size * 4)
+
+
+@case('array', 'transfer', compiles=False, size=SIZES,
+      direction=['h2d', 'd2h'], host=['pageable', 'managed'])
+def transfer(ctx, size, direction, host):
+    """
+    Copies between the host and the device.  pygpu has no way to
+    allocate pinned host memory, so the alternative to pageable
+    numpy buffers is managed memory migrated with prefetch().
+    """
+    if host == 'pageable':
+        h = numpy.random.rand(size).astype('float32')
+        d = gpuarray.empty((size,), dtype='float32', context=ctx)
+        if direction == 'h2d':
+            def fn():
+                d.write(h)
+        else:
+            def fn():
+                d.read(h)
+        # read() and write() are synchronous
+        return fn, dict(bytes=size * 4)
+
+    try:
+        m = gpuarray.empty((size,), dtype='float32', context=ctx,
+                           managed=True)
+    except gpuarray.UnsupportedException:
+        raise Skip("managed memory is not supported")
+    m.host_view()[...] = 1
+    location = 'device' if direction == 'h2d' else 'host'
+    other = 'host' if direction == 'h2d' else 'device'
+
+    def fn():
+        m.prefetch(location)
+        m.sync()
+        m.prefetch(other)
+        return m
+    # Each call moves the data there and back
+    return fn, dict(bytes=2 * size * 4)
@@ -0,0 +1,61 @@
+from __future__ import division
+
+import numpy
+
+from .. import gpuarray
+from .harness import case, Skip
+
+try:
+    from .. import blas
+except ImportError:
+    blas = None
+
+
+def _rand(ctx, shape, dtype):
+    return gpuarray.asarray(numpy.random.rand(*shape).astype(dtype),
+                            context=ctx)
+
+
+def _check():
+    if blas is None:
+        raise Skip("pygpu was built without blas")
+
+
+@case('blas', 'gemm', compiles=False, n=[128, 512, 2048],
+      dtype=['float32', 'float64'])
+def gemm(ctx, n, dtype):
+    _check()
+    A = _rand(ctx, (n, n), dtype)
+    B = _rand(ctx, (n, n), dtype)
+    C = gpuarray.zeros((n, n), dtype=dtype, context=ctx)
+
+    def fn():
+        return blas.gemm(1.0, A, B, 0.0, C, overwrite_c=True)
+    return fn, dict(flops=2 * n ** 3)
+
+
+@case('blas', 'gemv', compiles=False, n=[1024, 4096],
+      dtype=['float32', 'float64'], trans=[False, True])
+def gemv(ctx, n, dtype, trans):
+    _check()
+    A = _rand(ctx, (n, n), dtype)
+    X = _rand(ctx, (n,), dtype)
+    Y = gpuarray.zeros((n,), dtype=dtype, context=ctx)
+    isz = numpy.dtype(dtype).itemsize
+
+    def fn():
+        return blas.gemv(1.0, A, X, 0.0, Y, trans_a=trans, overwrite_y=True)
+    return fn, dict(flops=2 * n * n, bytes=(n * n + 2 * n) * isz)
+
+
+@case('blas', 'gemmBatch_3d', compiles=False, batch=[16, 256], n=[32, 128],
+      dtype=['float32'])
+def gemmBatch_3d(ctx, batch, n, dtype):
+    _check()
+    A = _rand(ctx, (batch, n, n), dtype)
+    B = _rand(ctx, (batch, n, n), dtype)
+    C = gpuarray.zeros((batch, n, n), dtype=dtype, context=ctx)
+
+    def fn():
+        return blas.gemmBatch_3d(1.0, A, B, 0.0, C, overwrite_c=True)
+    return fn, dict(flops=2 * batch * n ** 3)
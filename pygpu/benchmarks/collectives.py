@@ -0,0 +1,56 @@
+from __future__ import division
+
+import numpy
+
+from .. import gpuarray
+from .harness import case, Skip
+
+try:
+    from ..collectives import GpuCommCliqueId, GpuComm
+except ImportError:
+    GpuComm = None
+
+SIZES = [2**10, 2**20, 2**24]
+
+_comms = {}
+
+
+def _comm(ctx):
+    """
+    Communicator of a clique with only this context.  It only measures
+    the overhead of the calls, the benchmark runs in a single process.
+    """
+    if GpuComm is None:
+        raise Skip("pygpu was built without collectives")
+    if ctx not in _comms:
+        try:
+            cid = GpuCommCliqueId(context=ctx)
+            _comms[ctx] = GpuComm(cid, 1, 0)
+        except gpuarray.GpuArrayException as e:
+            raise Skip(str(e))
+    return _comms[ctx]
+
+
+@case('collectives', 'all_reduce', compiles=False, size=SIZES)
+def all_reduce(ctx, size):
+    comm = _comm(ctx)
+    src = gpuarray.asarray(numpy.random.rand(size).astype('float32'),
+                           context=ctx)
+    dest = gpuarray.empty((size,), dtype='float32', context=ctx)
+
+    def fn():
+        comm.all_reduce(src, '+', dest)
+        return dest
+    return fn, dict(bytes=2 * size * 4)
+
+
+@case('collectives', 'broadcast', compiles=False, size=SIZES)
+def broadcast(ctx, size):
+    comm = _comm(ctx)
+    a = gpuarray.asarray(numpy.random.rand(size).astype('float32'),
+                         context=ctx)
+
+    def fn():
+        comm.broadcast(a)
+        return a
+    return fn, dict(bytes=size * 4)
@@ -0,0 +1,53 @@
+from __future__ import division
+
+import numpy
+
+from .. import gpuarray
+from ..elemwise import elemwise1, elemwise2, elemwise_multi
+from .harness import case
+
+SIZES = [2**10, 2**16, 2**20, 2**24]
+
+
+def _rand(ctx, shape, dtype='float32'):
+    return gpuarray.asarray(numpy.random.rand(*shape).astype(dtype),
+                            context=ctx)
+
+
+@case('elemwise', 'add', size=SIZES,
+      layout=['contiguous', 'transposed', 'broadcast'])
+def add(ctx, size, layout):
+    rows = 2 ** ((size.bit_length() - 1) // 2)
+    cols = size // rows
+    if layout == 'contiguous':
+        a = _rand(ctx, (size,))
+        b = _rand(ctx, (size,))
+        bw = 3 * size * 4
+    elif layout == 'transposed':
+        a = _rand(ctx, (cols, rows)).T
+        b = _rand(ctx, (rows, cols))
+        bw = 3 * size * 4
+    else:
+        a = _rand(ctx, (rows, cols))
+        b = _rand(ctx, (1, cols))
+        bw = (2 * size + cols) * 4
+
+    def fn():
+        return elemwise2(a, '+', b, a, broadcast=(layout == 'broadcast'))
+    return fn, dict(bytes=bw)
+
+
+@case('elemwise', 'sincos', size=SIZES, mode=['fused', 'separate'])
+def sincos(ctx, size, mode):
+    a = _rand(ctx, (size,))
+    if mode == 'fused':
+        def fn():
+            return elemwise_multi([('a', a)], [('s', None), ('c', None)],
+                                  "s = sin(a); c = cos(a)")
+        bw = 3 * size * 4
+    else:
+        def fn():
+            return (elemwise1(a, None, oper="res = sin(a)"),
+                    elemwise1(a, None, oper="res = cos(a)"))
+        bw = 4 * size * 4
+    return fn, dict(bytes=bw)
@@ -0,0 +1,259 @@
+from __future__ import print_function, division
+
+import itertools
+import json
+import os
+import platform
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+import timeit
+
+import numpy
+
+from .. import gpuarray
+
+SCHEMA = 'pygpu-bench/1'
+
+_cases = []
+
+
+class Skip(Exception):
+    """Raised by a benchmark setup when it can't run on this context."""
+
+
+class Case(object):
+    def __init__(self, suite, name, params, setup, compiles):
+        self.suite = suite
+        self.name = name
+        self.params = params
+        self.setup = setup
+        self.compiles = compiles
+        self.id = '%s.%s' % (suite, name)
+        if params:
+            self.id += '[%s]' % ','.join('%s=%s' % (k, params[k])
+                                         for k in sorted(params))
+
+
+def case(suite, name, compiles=True, **grid):
+    """
+    Register a benchmark.
+
+    The decorated function is called as `setup(ctx, **params)` for
+    each combination of the values in `grid` and must return a pair
+    `(fn, work)`.  `fn()` performs one operation and returns the
+    array(s) to wait for.  `work` is a dict that may have 'bytes'
+    and 'flops' for one call, to report rates.  The setup raises
+    :class:`Skip` if the operation is not available.
+
+    `compiles` marks the operations that build kernels on their first
+    call, for which the time of that first call is also measured.
+    """
+    def deco(setup):
+        keys = sorted(grid)
+        for vals in itertools.product(*[grid[k] for k in keys]):
+            _cases.append(Case(suite, name, dict(zip(keys, vals)), setup,
+                               compiles))
+        return setup
+    return deco
+
+
+def cases():
+    # Importing the modules registers their cases
+    from . import elemwise, reduction, array, blas, collectives  # noqa
+    return list(_cases)
+
+
+def _sync(r):
+    if isinstance(r, gpuarray.GpuArray):
+        r.sync()
+    elif isinstance(r, (list, tuple)):
+        for a in r:
+            _sync(a)
+
+
+def _run(fn, n):
+    r = None
+    start = timeit.default_timer()
+    for _ in range(n):
+        r = fn()
+    _sync(r)
+    return timeit.default_timer() - start
+
+
+def measure(fn, min_time, repeat):
+    """
+    Time `fn` once it is warm.
+
+    The number of calls per sample is raised until a sample lasts at
+    least `min_time` seconds.  The calls are only waited for at the
+    end of a sample, so this is the throughput of queued calls.
+    """
+    _sync(fn())
+    n = 1
+    while True:
+        t = _run(fn, n)
+        if t >= min_time or n >= 1 << 20:
+            break
+        if t <= 0:
+            n *= 10
+        else:
+            n = max(n + 1, int(n * min(100, 1.2 * min_time / t)))
+    samples = sorted(_run(fn, n) / n for _ in range(repeat))
+    mean = sum(samples) / len(samples)
+    var = sum((s - mean) ** 2 for s in samples) / len(samples)
+    return dict(calls=n, samples=repeat, median_s=samples[len(samples) // 2],
+                min_s=samples[0], stddev_s=var ** 0.5)
+
+
+def first_call(ctx, c):
+    """Time the first call of a case in `ctx`."""
+    fn, _ = c.setup(ctx, **c.params)
+    start = timeit.default_timer()
+    _sync(fn())
+    return timeit.default_timer() - start
+
+
+def _probe(dev, c, cache_dir):
+    cmd = [sys.executable, '-m', 'pygpu.benchmarks', '--probe', c.id,
+           '-d', dev, '--kernel-cache', cache_dir]
+    try:
+        out = subprocess.check_output(cmd)
+        return json.loads(out.decode('ascii').strip().splitlines()[-1])
+    except (subprocess.CalledProcessError, ValueError, IndexError):
+        return None
+
+
+def cold_timings(dev, c):
+    """
+    Time the first call in a new process, with an empty kernel cache
+    and then with the cache filled by the first run.
+    """
+    cache_dir = tempfile.mkdtemp(prefix='pygpu_bench')
+    try:
+        return _probe(dev, c, cache_dir), _probe(dev, c, cache_dir)
+    finally:
+        shutil.rmtree(cache_dir, ignore_errors=True)
+
+
+_DEVICE_PROPS = ('devname', 'unique_id', 'bin_id', 'devno', 'numprocs',
+                 'lmemsize', 'total_gmem', 'maxlsize0', 'maxlsize1',
+                 'maxlsize2', 'maxgsize0', 'maxgsize1', 'maxgsize2')
+
+
+def device_info(ctx, dev):
+    info = dict(dev=dev, kind=ctx.kind.decode('ascii'))
+    for p in _DEVICE_PROPS:
+        try:
+            v = getattr(ctx, p)
+        except Exception:
+            v = None
+        if isinstance(v, bytes):
+            v = v.decode('ascii', 'replace')
+        info[p] = v
+    return info
+
+
+def default_device():
+    for name in ['GPUARRAY_TEST_DEVICE', 'DEVICE']:
+        if name in os.environ:
+            return os.environ[name]
+    for dev in ['cuda', 'opencl0:0']:
+        try:
+            gpuarray.init(dev)
+            return dev
+        except Exception:
+            pass
+    raise RuntimeError("No usable device found.  Specify one with -d or "
+                       "the DEVICE environment variable.")
+
+
+def _result(c):
+    return dict(id=c.id, suite=c.suite, name=c.name, params=c.params,
+                status='ok', reason=None, warm=None, cold_s=None,
+                disk_s=None, bytes=None, flops=None, gb_per_s=None,
+                gflop_per_s=None)
+
+
+def run_case(ctx, dev, c, min_time, repeat, cold):
+    res = _result(c)
+    try:
+        fn, work = c.setup(ctx, **c.params)
+        res['warm'] = measure(fn, min_time, repeat)
+    except Skip as e:
+        res['status'] = 'skipped'
+        res['reason'] = str(e)
+        return res
+    except gpuarray.UnsupportedException as e:
+        res['status'] = 'skipped'
+        res['reason'] = str(e)
+        return res
+    except Exception as e:
+        res['status'] = 'error'
+        res['reason'] = '%s: %s' % (type(e).__name__, e)
+        return res
+    del fn
+    t = res['warm']['median_s']
+    if work.get('bytes') is not None:
+        res['bytes'] = work['bytes']
+        res['gb_per_s'] = work['bytes'] / t / 1e9
+    if work.get('flops') is not None:
+        res['flops'] = work['flops']
+        res['gflop_per_s'] = work['flops'] / t / 1e9
+    if cold and c.compiles:
+        cold_r, disk_r = cold_timings(dev, c)
+        if cold_r is not None:
+            res['cold_s'] = cold_r['first_s']
+        if disk_r is not None:
+            res['disk_s'] = disk_r['first_s']
+    return res
+
+
+def run(dev=None, filters=(), min_time=0.05, repeat=5, cold=True,
+        max_size=None, log=sys.stderr):
+    """
+    Run the benchmarks on device `dev` and return the report.
+
+    Only the cases whose id contains one of `filters` are run, if
+    any are given.  Cases with a `size` parameter bigger than
+    `max_size` are left out.
+    """
+    from .. import __version__
+    if dev is None:
+        dev = default_device()
+    ctx = gpuarray.init(dev)
+    results = []
+    for c in cases():
+        if filters and not any(f in c.id for f in filters):
+            continue
+        if max_size is not None and c.params.get('size', 0) > max_size:
+            continue
+        if log is not None:
+            print(c.id, file=log)
+        results.append(run_case(ctx, dev, c, min_time, repeat, cold))
+    return dict(
+        schema=SCHEMA,
+        created=time.strftime('%Y-%m-%dT%H:%M:%SZ', time.gmtime()),
+        pygpu_version=__version__,
+        api_version=list(gpuarray.api_version()),
+        abi_version=list(gpuarray.abi_version()),
+        python=platform.python_version(),
+        numpy=numpy.__version__,
+        platform=platform.platform(),
+        device=device_info(ctx, dev),
+        settings=dict(min_time=min_time, repeat=repeat, cold=cold,
+                      max_size=max_size, filters=list(filters)),
+        results=results)
+
+
+def probe(dev, case_id, cache_dir):
+    """Entry point of the process started by :func:`cold_timings`."""
+    for c in cases():
+        if c.id == case_id:
+            break
+    else:
+        raise ValueError("unknown case: %s" % (case_id,))
+    ctx = gpuarray.init(dev, kernel_cache_path=cache_dir)
+    return dict(id=case_id, first_s=first_call(ctx, c))
@@ -0,0 +1,50 @@
+from __future__ import division
+
+import numpy
+
+from .. import gpuarray
+from ..reduction import ReductionKernel, reduce1
+from .harness import case
+
+SIZES = [2**16, 2**20, 2**24]
+
+
+def _rand(ctx, size):
+    rows = 2 ** ((size.bit_length() - 1) // 2)
+    return gpuarray.asarray(
+        numpy.random.rand(rows, size // rows).astype('float32'), context=ctx)
+
+
+def _redux(axis):
+    return [axis in (0, None), axis in (1, None)]
+
+
+@case('reduction', 'reduction_kernel', size=SIZES, axis=[0, 1, None])
+def reduction_kernel(ctx, size, axis):
+    a = _rand(ctx, size)
+    # The kernels are built on the first call
+    k = ReductionKernel(ctx, dtype_out='float32', neutral='0',
+                        reduce_expr='a + b', redux=_redux(axis))
+
+    def fn():
+        return k(a)
+    return fn, dict(bytes=size * 4)
+
+
+@case('reduction', 'reduce1', size=SIZES, axis=[0, 1, None])
+def reduce1_(ctx, size, axis):
+    a = _rand(ctx, size)
+
+    def fn():
+        return reduce1(a, op='+', neutral='0', out_type='float32', axis=axis)
+    return fn, dict(bytes=size * 4)
+
+
+@case('reduction', 'maxandargmax', size=SIZES, axis=[0, 1, None])
+def maxandargmax(ctx, size, axis):
+    a = _rand(ctx, size)
+    axes = [0, 1] if axis is None else [axis]
+
+    def fn():
+        return gpuarray.maxandargmax(a, axes)
+    return fn, dict(bytes=size * 4)
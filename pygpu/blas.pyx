@@ -79,17 +79,23 @@ def dot(GpuArray X, GpuArray Y, GpuArray Z=None, overwrite_z=False):
     pygpu_blas_rdot(X, Y, Z, 0)
     return Z
 
+cdef cb_transpose _trans(t) except *:
+    if t == 'c' or t == 'C':
+        return cb_conj_trans
+    if t:
+        return cb_trans
+    return cb_no_trans
+
 def gemv(double alpha, GpuArray A, GpuArray X, double beta=0.0,
          GpuArray Y=None, trans_a=False, overwrite_y=False):
     """gemv(alpha, A, X, beta=0.0, Y=None, trans_a=False, overwrite_y=False)
+
+    `trans_a` can also be 'c' for the conjugate transpose.
     """
     cdef cb_transpose transA
     cdef size_t Yshp
 
-    if trans_a:
-        transA = cb_trans
-    else:
-        transA = cb_no_trans
+    transA = _trans(trans_a)
 
     if A.ga.nd != 2:
         raise TypeError("A is not a matrix")
@@ -112,19 +118,15 @@ def gemv(double alpha, GpuArray A, GpuArray X, double beta=0.0,
 def gemm(double alpha, GpuArray A, GpuArray B, double beta, GpuArray C=None,
          trans_a=False, trans_b=False, overwrite_c=False):
     """gemm(alpha, A, B, beta, C=None, trans_a=False, trans_b=False, overwrite_c=False)
+
+    `trans_a` and `trans_b` can also be 'c' for the conjugate transpose.
     """
     cdef cb_transpose transA
     cdef cb_transpose transB
     cdef size_t[2] Cshp
 
-    if trans_a:
-        transA = cb_trans
-    else:
-        transA = cb_no_trans
-    if trans_b:
-        transB = cb_trans
-    else:
-        transB = cb_no_trans
+    transA = _trans(trans_a)
+    transB = _trans(trans_b)
 
     if A.ga.nd != 2:
         raise TypeError("A is not a matrix")
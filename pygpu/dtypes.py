@@ -91,6 +91,8 @@ def _fill_dtype_registry():
 
     register_dtype(np.float32, ["ga_float", "float"])
     register_dtype(np.float64, ["ga_double", "double"])
+    register_dtype(np.complex64, ["ga_cfloat"])
+    register_dtype(np.complex128, ["ga_cdouble"])
 
 # }}}
 
@@ -5,7 +5,8 @@ from . import gpuarray
 from ._elemwise import GpuElemwise, arg
 
 __all__ = ['GpuElemwise', 'arg', 'as_argument',
-           'elemwise1', 'elemwise2', 'ielemwise2', 'compare']
+           'elemwise1', 'elemwise2', 'ielemwise2', 'compare',
+           'elemwise_multi']
 
 
 def _dtype(o):
@@ -14,6 +15,35 @@ def _dtype(o):
     return numpy.asarray(o).dtype
 
 
+# Complex values are structs in the kernels, operators go through the
+# helpers from cluda.h.
+_complex_ops = {'+': 'add', '-': 'sub', '*': 'mul', '/': 'div'}
+
+
+def complex_cast(name, dtype, odtype):
+    """
+    Return an expression converting `name` of type `dtype` to the
+    complex type `odtype`.
+    """
+    dtype = numpy.dtype(dtype)
+    odtype = numpy.dtype(odtype)
+    if dtype == odtype:
+        return name
+    ctype = dtype_to_ctype(odtype)
+    if dtype.kind == 'c':
+        return "%s_make(%s.r, %s.i)" % (ctype, name, name)
+    return "%s_make(%s, 0)" % (ctype, name)
+
+
+def _complex_binop(op, a, adtype, b, bdtype, odtype):
+    if op not in _complex_ops:
+        raise TypeError("operation %s is not supported for complex "
+                        "types" % (op,))
+    return "%s_%s(%s, %s)" % (dtype_to_ctype(odtype), _complex_ops[op],
+                              complex_cast(a, adtype, odtype),
+                              complex_cast(b, bdtype, odtype))
+
+
 def as_argument(o, name, read=False, write=False):
     if (not read) and (not write):
         raise ValueError('argument is neither read not write')
@@ -30,7 +60,16 @@ def elemwise1(a, op, oper=None, op_tmpl="res = %(op)sa", out=None,
         res = out
 
     if oper is None:
-        oper = op_tmpl % {'op': op}
+        if a.dtype.kind == 'c':
+            if op == '-':
+                oper = "res = %s_neg(a)" % (dtype_to_ctype(a.dtype),)
+            elif op == '+':
+                oper = "res = a"
+            else:
+                raise TypeError("operation %s is not supported for complex "
+                                "types" % (op,))
+        else:
+            oper = op_tmpl % {'op': op}
 
     k = GpuElemwise(a.context, oper, args, convert_f16=convert_f16)
     k(res, a)
@@ -68,6 +107,9 @@ def elemwise2(a, op, b, ary, odtype=None, oper=None,
     else:
         res = ary._empty_like_me(dtype=odtype)
 
+    if oper is None and numpy.dtype(odtype).kind == 'c':
+        oper = "res = " + _complex_binop(op, 'a', a.dtype, 'b', b.dtype,
+                                         odtype)
     if oper is None:
         if convert_f16 and odtype == 'float16':
             odtype = numpy.dtype('float32')
@@ -89,7 +131,11 @@ def ielemwise2(a, op, b, oper=None, op_tmpl="a = a %(op)s b",
     args = [a_arg, b_arg]
 
     if oper is None:
-        oper = op_tmpl % {'op': op}
+        if a.dtype.kind == 'c':
+            oper = "a = " + _complex_binop(op, 'a', a.dtype, 'b', b.dtype,
+                                           a.dtype)
+        else:
+            oper = op_tmpl % {'op': op}
 
     k = GpuElemwise(a.context, oper, args, convert_f16=convert_f16)
     k(a, b, broadcast=broadcast)
@@ -97,6 +143,106 @@ def ielemwise2(a, op, b, oper=None, op_tmpl="a = a %(op)s b",
 
 
 def compare(a, op, b, broadcast=False, convert_f16=True):
-    return elemwise2(a, op, b, a, odtype=numpy.dtype('bool'),
+    oper = None
+    if _dtype(a).kind == 'c' or _dtype(b).kind == 'c':
+        if op not in ('==', '!='):
+            raise TypeError("complex types are not ordered")
+        ct = get_common_dtype(a, b, True)
+        ca = complex_cast('a', _dtype(a), ct)
+        cb = complex_cast('b', _dtype(b), ct)
+        oper = "res = %s((%s).r == (%s).r && (%s).i == (%s).i)" % (
+            '!' if op == '!=' else '', ca, cb, ca, cb)
+    return elemwise2(a, op, b, a, odtype=numpy.dtype('bool'), oper=oper,
                      op_tmpl="res = (a %(op)s b)",
                      broadcast=broadcast, convert_f16=convert_f16)
+
+
+def _broadcast_shape(arrays):
+    nd = max(a.ndim for a in arrays)
+    shape = [1] * nd
+    for a in arrays:
+        for i, d in enumerate(a.shape, nd - a.ndim):
+            if d != 1:
+                shape[i] = d
+    return tuple(shape)
+
+
+def _common_dtype(objs):
+    res = objs[0]
+    for o in objs[1:]:
+        res = numpy.ones(1, dtype=get_common_dtype(res, o, True))
+    return numpy.dtype(res.dtype)
+
+
+def elemwise_multi(inputs, outputs, oper, out=None, temps=(), preamble="",
+                   broadcast=False, convert_f16=True):
+    """
+    Compute several results in a single pass over the inputs.
+
+    Parameters
+    ----------
+    inputs
+        Sequence of (name, value) pairs, the values are GpuArrays or
+        scalars.  At least one of them must be a GpuArray.
+    outputs
+        Sequence of (name, dtype) pairs.  A dtype of None uses the
+        common type of the inputs.
+    oper
+        Code that assigns all the outputs, statements are separated
+        by ';'.
+    out
+        None or a tuple with a GpuArray or None for each output.  The
+        outputs that are not provided are allocated with the
+        broadcasted shape of the inputs.
+    temps
+        Sequence of (name, dtype) pairs for temporaries that are
+        declared before `oper` to share computations between the
+        outputs.
+
+    Returns a tuple of the outputs.
+    """
+    ins = []
+    in_args = []
+    for name, v in inputs:
+        if not isinstance(v, gpuarray.GpuArray):
+            v = numpy.asarray(v)
+        ins.append(v)
+        in_args.append(as_argument(v, name, read=True))
+    arrays = [v for v in ins if isinstance(v, gpuarray.GpuArray)]
+    if len(arrays) == 0:
+        raise ValueError("elemwise_multi needs at least one array input")
+    ary = arrays[0]
+
+    if out is None:
+        out = (None,) * len(outputs)
+    out = tuple(out)
+    if len(out) != len(outputs):
+        raise ValueError("out must have one entry per output")
+
+    shape = None
+    res = []
+    args = []
+    for (name, odtype), o in zip(outputs, out):
+        if o is None:
+            if odtype is None:
+                odtype = _common_dtype(ins)
+            if shape is None:
+                shape = _broadcast_shape(arrays)
+            o = gpuarray.empty(shape, dtype=odtype, context=ary.context,
+                               cls=ary.__class__)
+        res.append(o)
+        args.append(arg(name, o.dtype, write=True))
+
+    decls = []
+    for name, dtype in temps:
+        dtype = numpy.dtype(dtype)
+        if convert_f16 and dtype == 'float16':
+            dtype = numpy.dtype('float32')
+        decls.append('%s %s;' % (dtype_to_ctype(dtype), name))
+    if decls:
+        oper = ' '.join(decls) + ' ' + oper
+
+    k = GpuElemwise(ary.context, oper, args + in_args, preamble=preamble,
+                    convert_f16=convert_f16)
+    k(*(res + ins), broadcast=broadcast)
+    return tuple(res)
@@ -12,6 +12,8 @@ cimport numpy as np
 
 cdef extern from "numpy/arrayobject.h":
     object _PyArray_Empty "PyArray_Empty" (int, np.npy_intp *, np.dtype, int)
+    object _PyArray_NewFromDescr "PyArray_NewFromDescr" (type, np.dtype, int, np.npy_intp *, np.npy_intp *, void *, int, object)
+    int _PyArray_SetBaseObject "PyArray_SetBaseObject" (np.ndarray, object) except -1
 
 cdef object PyArray_Empty(int a, np.npy_intp *b, np.dtype c, int d)
 
@@ -43,6 +45,8 @@ cdef extern from "gpuarray/types.h":
         GA_UINT,
         GA_LONG,
         GA_ULONG,
+        GA_LONGLONG,
+        GA_ULONGLONG,
         GA_FLOAT,
         GA_DOUBLE,
         GA_CFLOAT,
@@ -89,10 +93,15 @@ cdef extern from "gpuarray/buffer.h":
     int gpucontext_init(gpucontext **res, const char *name, gpucontext_props *p)
     void gpucontext_deref(gpucontext *ctx)
     char *gpucontext_error(gpucontext *ctx, int err)
+    int gpucontext_trim_cache(gpucontext *ctx, size_t *freed) nogil
     int gpudata_property(gpudata *ctx, int prop_id, void *res)
     int gpucontext_property(gpucontext *ctx, int prop_id, void *res)
     int gpukernel_property(gpukernel *k, int prop_id, void *res)
     gpucontext *gpudata_context(gpudata *)
+    gpudata *gpudata_alloc(gpucontext *ctx, size_t sz, void *data, int flags, int *ret)
+    void gpudata_release(gpudata *)
+    int gpudata_prefetch(gpudata *b, size_t off, size_t sz, int location) nogil
+    int gpudata_advise(gpudata *b, size_t off, size_t sz, int advice, int location)
     gpucontext *gpukernel_context(gpukernel *)
 
     int GA_CTX_SCHED_AUTO
@@ -113,8 +122,34 @@ cdef extern from "gpuarray/buffer.h":
     int GA_CTX_PROP_MAXGSIZE1
     int GA_CTX_PROP_MAXGSIZE2
     int GA_CTX_PROP_LARGEST_MEMBLOCK
+    int GA_CTX_PROP_DEVNO
+    int GA_CTX_PROP_CACHE_RECLAIMED
+    int GA_CTX_PROP_MEM_RESERVED
+    int GA_CTX_PROP_MEM_IN_USE
+    int GA_CTX_PROP_MEM_CACHED
+    int GA_CTX_PROP_MEM_PEAK
+    int GA_CTX_PROP_MEM_SPLITS
+    int GA_CTX_PROP_MEM_MERGES
+    int GA_CTX_PROP_MEM_LARGEST_FREE
+    int GA_CTX_PROP_MEM_FREE_BUCKETS
+    int GA_CTX_PROP_MEM_BLOCKS
+    enum:
+        GA_MEM_NBUCKETS
 
     int GA_BUFFER_PROP_SIZE
+    int GA_BUFFER_PROP_HOSTPOINTER
+
+    int GA_BUFFER_MANAGED
+
+    int GA_LOCATION_DEVICE
+    int GA_LOCATION_HOST
+
+    int GA_ADVISE_READ_MOSTLY
+    int GA_ADVISE_NO_READ_MOSTLY
+    int GA_ADVISE_PREFERRED_LOCATION
+    int GA_ADVISE_NO_PREFERRED_LOCATION
+    int GA_ADVISE_ACCESSED_BY
+    int GA_ADVISE_NOT_ACCESSED_BY
 
     int GA_KERNEL_PROP_MAXLSIZE
     int GA_KERNEL_PROP_PREFLSIZE
@@ -177,6 +212,10 @@ cdef extern from "gpuarray/array.h":
     int GpuArray_index(_GpuArray *r, _GpuArray *a, const ssize_t *starts,
                        const ssize_t *stops, const ssize_t *steps)
     int GpuArray_take1(_GpuArray *r, _GpuArray *a, _GpuArray *i, int check_err)
+    int GpuArray_gather(_GpuArray *r, _GpuArray *v, unsigned int axis,
+                        unsigned int nidx, const _GpuArray **idx, int check_err)
+    int GpuArray_scatter(_GpuArray *a, _GpuArray *v, unsigned int axis,
+                         unsigned int nidx, const _GpuArray **idx, int check_err)
     int GpuArray_setarray(_GpuArray *v, _GpuArray *a)
     int GpuArray_reshape(_GpuArray *res, _GpuArray *a, unsigned int nd,
                          const size_t *newdims, ga_order ord, int nocopy)
@@ -184,6 +223,9 @@ cdef extern from "gpuarray/array.h":
                                  const size_t *newdims, ga_order ord)
     int GpuArray_transpose(_GpuArray *res, _GpuArray *a,
                            const unsigned int *new_axes)
+    int GpuArray_maxandargmax(_GpuArray *dstMax, _GpuArray *dstArgmax,
+                              const _GpuArray *src, unsigned int reduxLen,
+                              const unsigned int *reduxList)
 
     void GpuArray_clear(_GpuArray *a)
 
@@ -193,6 +235,10 @@ cdef extern from "gpuarray/array.h":
     int GpuArray_move(_GpuArray *dst, _GpuArray *src)
     int GpuArray_write(_GpuArray *dst, void *src, size_t src_sz) nogil
     int GpuArray_read(void *dst, size_t dst_sz, _GpuArray *src) nogil
+    int GpuArray_write_strided(_GpuArray *dst, const void *src,
+                               const ssize_t *src_strides) nogil
+    int GpuArray_read_strided(void *dst, const ssize_t *dst_strides,
+                              const _GpuArray *src) nogil
     int GpuArray_memset(_GpuArray *a, int data)
     int GpuArray_copy(_GpuArray *res, _GpuArray *a, ga_order order)
 
@@ -243,6 +289,10 @@ cdef int array_index(GpuArray r, GpuArray a, const ssize_t *starts,
                      const ssize_t *stops, const ssize_t *steps) except -1
 cdef int array_take1(GpuArray r, GpuArray a, GpuArray i,
                      int check_err) except -1
+cdef int array_gather(GpuArray r, GpuArray v, unsigned int axis, list idx,
+                      int check_err) except -1
+cdef int array_scatter(GpuArray a, GpuArray v, unsigned int axis, list idx,
+                       int check_err) except -1
 cdef int array_setarray(GpuArray v, GpuArray a) except -1
 cdef int array_reshape(GpuArray res, GpuArray a, unsigned int nd,
                        const size_t *newdims, ga_order ord,
@@ -255,6 +305,8 @@ cdef gpucontext *array_context(GpuArray a) except NULL
 cdef int array_move(GpuArray a, GpuArray src) except -1
 cdef int array_write(GpuArray a, void *src, size_t sz) except -1
 cdef int array_read(void *dst, size_t sz, GpuArray src) except -1
+cdef int array_write_strided(GpuArray a, void *src, ssize_t *strides) except -1
+cdef int array_read_strided(void *dst, ssize_t *strides, GpuArray src) except -1
 cdef int array_memset(GpuArray a, int data) except -1
 cdef int array_copy(GpuArray res, GpuArray a, ga_order order) except -1
 cdef int array_transfer(GpuArray res, GpuArray a) except -1
@@ -335,12 +387,30 @@ cdef api class GpuArray [type PyGpuArrayType, object PyGpuArrayObject]:
     cdef __index_helper(self, key, unsigned int i, ssize_t *start,
                         ssize_t *stop, ssize_t *step)
     cdef __cgetitem__(self, idx)
+    cdef bint _same_shape(self, np.ndarray a)
+
+ctypedef int (*kernel_argsetter)(void **slot, object o, int typecode) except -1
 
 cdef api class GpuKernel [type PyGpuKernelType, object PyGpuKernelObject]:
     cdef _GpuKernel k
     cdef readonly GpuContext context
     cdef void **callbuf
     cdef object __weakref__
-
+    cdef int *_types
+    cdef kernel_argsetter *_setters
+    cdef unsigned int _numargs
+    cdef size_t _sched_n
+    cdef size_t _sched_gs
+    cdef size_t _sched_ls
+    cdef list _bound
+    cdef object _call_gs
+    cdef object _call_ls
+    cdef unsigned int _call_nd
+    cdef size_t _call_gsv[3]
+    cdef size_t _call_lsv[3]
+
+    cpdef launch(self, tuple args, size_t n, size_t shared=*)
     cdef do_call(self, py_n, py_gs, py_ls, py_args, size_t shared)
+    cdef int _bind(self, tuple args) except -1
+    cdef int _sched(self, size_t n, size_t *gs, size_t *ls) except -1
     cdef _setarg(self, unsigned int index, int typecode, object o)
@@ -8,8 +8,13 @@ import numpy as np
 
 import sys
 
-from cpython cimport Py_INCREF, PyNumber_Index
+from cpython cimport Py_INCREF, Py_DECREF, PyNumber_Index
 from cpython.object cimport Py_EQ, Py_NE
+from cpython.pycapsule cimport (PyCapsule_New, PyCapsule_IsValid,
+                                PyCapsule_GetPointer, PyCapsule_SetName,
+                                PyCapsule_Destructor)
+from libc.stdint cimport (int8_t, int16_t, int32_t, int64_t, uint8_t,
+                          uint16_t, uint32_t, uint64_t)
 
 def api_version():
     """api_version()
@@ -339,6 +344,44 @@ cdef int array_take1(GpuArray r, GpuArray a, GpuArray i,
             raise IndexError, GpuArray_error(&r.ga, err)
         raise get_exc(err), GpuArray_error(&r.ga, err)
 
+cdef int array_gather(GpuArray r, GpuArray v, unsigned int axis, list idx,
+                      int check_err) except -1:
+    cdef const _GpuArray **ia
+    cdef Py_ssize_t i
+    cdef int err
+    ia = <const _GpuArray **>PyMem_Malloc(sizeof(_GpuArray *) * len(idx))
+    if ia == NULL:
+        raise MemoryError()
+    try:
+        for i in range(len(idx)):
+            ia[i] = &(<GpuArray>idx[i]).ga
+        err = GpuArray_gather(&r.ga, &v.ga, axis, len(idx), ia, check_err)
+    finally:
+        PyMem_Free(ia)
+    if err != GA_NO_ERROR:
+        if err == GA_VALUE_ERROR:
+            raise IndexError, GpuArray_error(&r.ga, err)
+        raise get_exc(err), GpuArray_error(&r.ga, err)
+
+cdef int array_scatter(GpuArray a, GpuArray v, unsigned int axis, list idx,
+                       int check_err) except -1:
+    cdef const _GpuArray **ia
+    cdef Py_ssize_t i
+    cdef int err
+    ia = <const _GpuArray **>PyMem_Malloc(sizeof(_GpuArray *) * len(idx))
+    if ia == NULL:
+        raise MemoryError()
+    try:
+        for i in range(len(idx)):
+            ia[i] = &(<GpuArray>idx[i]).ga
+        err = GpuArray_scatter(&a.ga, &v.ga, axis, len(idx), ia, check_err)
+    finally:
+        PyMem_Free(ia)
+    if err != GA_NO_ERROR:
+        if err == GA_VALUE_ERROR:
+            raise IndexError, GpuArray_error(&a.ga, err)
+        raise get_exc(err), GpuArray_error(&a.ga, err)
+
 cdef int array_setarray(GpuArray v, GpuArray a) except -1:
     cdef int err
     err = GpuArray_setarray(&v.ga, &a.ga)
@@ -393,6 +436,20 @@ cdef int array_read(void *dst, size_t sz, GpuArray src) except -1:
     if err != GA_NO_ERROR:
         raise get_exc(err), GpuArray_error(&src.ga, err)
 
+cdef int array_write_strided(GpuArray a, void *src, ssize_t *strides) except -1:
+    cdef int err
+    with nogil:
+        err = GpuArray_write_strided(&a.ga, src, strides)
+    if err != GA_NO_ERROR:
+        raise get_exc(err), GpuArray_error(&a.ga, err)
+
+cdef int array_read_strided(void *dst, ssize_t *strides, GpuArray src) except -1:
+    cdef int err
+    with nogil:
+        err = GpuArray_read_strided(dst, strides, &src.ga)
+    if err != GA_NO_ERROR:
+        raise get_exc(err), GpuArray_error(&src.ga, err)
+
 cdef int array_memset(GpuArray a, int data) except -1:
     cdef int err
     err = GpuArray_memset(&a.ga, data)
@@ -693,6 +750,41 @@ cdef GpuArray pygpu_empty(unsigned int nd, const size_t *dims, int typecode,
     array_empty(res, context.ctx, typecode, nd, dims, order)
     return res
 
+cdef GpuArray pygpu_empty_managed(unsigned int nd, const size_t *dims,
+                                  int typecode, ga_order order,
+                                  GpuContext context, object cls):
+    cdef gpudata *buf
+    cdef ssize_t *strides
+    cdef size_t size
+    cdef int err
+    cdef int i
+
+    context = ensure_context(context)
+
+    size = gpuarray_get_elsize(typecode)
+    strides = <ssize_t *>calloc(nd, sizeof(ssize_t))
+    if strides == NULL and nd != 0:
+        raise MemoryError, "could not allocate strides"
+    try:
+        if order == GA_F_ORDER:
+            for i in range(nd):
+                strides[i] = size
+                size *= dims[i]
+        else:
+            for i in range(<int>nd - 1, -1, -1):
+                strides[i] = size
+                size *= dims[i]
+        buf = gpudata_alloc(context.ctx, size, NULL, GA_BUFFER_MANAGED, &err)
+        if buf is NULL:
+            raise get_exc(err), gpucontext_error(context.ctx, err)
+        try:
+            return pygpu_fromgpudata(buf, 0, typecode, nd, dims, strides,
+                                     context, True, None, cls)
+        finally:
+            gpudata_release(buf)
+    finally:
+        free(strides)
+
 cdef GpuArray pygpu_fromgpudata(gpudata *buf, size_t offset, int typecode,
                                 unsigned int nd, const size_t *dims,
                                 const ssize_t *strides, GpuContext context,
@@ -716,9 +808,9 @@ cdef int pygpu_move(GpuArray a, GpuArray src) except -1:
     return 0
 
 def empty(shape, dtype=GA_DOUBLE, order='C', GpuContext context=None,
-          cls=None):
+          cls=None, managed=False):
     """
-    empty(shape, dtype='float64', order='C', context=None, cls=None)
+    empty(shape, dtype='float64', order='C', context=None, cls=None, managed=False)
 
     Returns an empty (uninitialized) array of the requested shape,
     type and order.
@@ -735,6 +827,9 @@ def empty(shape, dtype=GA_DOUBLE, order='C', GpuContext context=None,
         context in which to do the allocation
     cls: type
         class of the returned array (must inherit from GpuArray)
+    managed: bool
+        allocate the array in managed memory, which can be accessed
+        from the host with :meth:`GpuArray.host_view` (CUDA only)
 
     """
     cdef size_t *cdims
@@ -752,6 +847,9 @@ def empty(shape, dtype=GA_DOUBLE, order='C', GpuContext context=None,
     try:
         for i, d in enumerate(shape):
             cdims[i] = d
+        if managed:
+            return pygpu_empty_managed(nd, cdims, dtype_to_typecode(dtype),
+                                       to_ga_order(order), context, cls)
         return pygpu_empty(nd, cdims,
                            dtype_to_typecode(dtype), to_ga_order(order),
                            context, cls)
@@ -1055,7 +1153,7 @@ cdef class GpuContext:
             gpucontext_deref(self.ctx)
 
     def __reduce__(self):
-        raise RuntimeError, "Cannot pickle GpuContext object"
+        raise RuntimeError, "Cannot pickle GpuContext object (see pygpu.ipc.enable_pickling)"
 
     def __init__(self):
         if type(self) is GpuContext:
@@ -1179,6 +1277,70 @@ cdef class GpuContext:
             ctx_property(self, GA_CTX_PROP_LARGEST_MEMBLOCK, &res)
             return res
 
+    property devno:
+        "Device ordinal for this context (CUDA only)"
+        def __get__(self):
+            cdef int res
+            ctx_property(self, GA_CTX_PROP_DEVNO, &res)
+            return res
+
+    property cache_reclaimed:
+        "Total bytes returned to the driver by trimming the allocation cache"
+        def __get__(self):
+            cdef size_t res
+            ctx_property(self, GA_CTX_PROP_CACHE_RECLAIMED, &res)
+            return res
+
+    def memory_stats(self):
+        """
+        memory_stats()
+
+        Return a dict describing the state of the allocator.
+
+        The keys are 'reserved' (bytes obtained from the driver),
+        'in_use', 'cached', 'peak' (highest 'in_use'), 'blocks'
+        (number of live buffers), 'splits', 'merges', 'largest_free',
+        'reclaimed' (see :meth:`trim_cache`) and 'free_buckets', which
+        maps a power of two to the number of cached blocks of at least
+        that size but smaller than the next power.
+        """
+        cdef size_t buckets[GA_MEM_NBUCKETS]
+        cdef size_t i
+        res = {}
+        for name, prop in (('reserved', GA_CTX_PROP_MEM_RESERVED),
+                           ('in_use', GA_CTX_PROP_MEM_IN_USE),
+                           ('cached', GA_CTX_PROP_MEM_CACHED),
+                           ('peak', GA_CTX_PROP_MEM_PEAK),
+                           ('blocks', GA_CTX_PROP_MEM_BLOCKS),
+                           ('splits', GA_CTX_PROP_MEM_SPLITS),
+                           ('merges', GA_CTX_PROP_MEM_MERGES),
+                           ('largest_free', GA_CTX_PROP_MEM_LARGEST_FREE),
+                           ('reclaimed', GA_CTX_PROP_CACHE_RECLAIMED)):
+            ctx_property(self, prop, &i)
+            res[name] = i
+        ctx_property(self, GA_CTX_PROP_MEM_FREE_BUCKETS, buckets)
+        res['free_buckets'] = dict((1 << i, buckets[i])
+                                   for i in range(GA_MEM_NBUCKETS)
+                                   if buckets[i] != 0)
+        return res
+
+    def trim_cache(self):
+        """
+        trim_cache()
+
+        Return the unused blocks of the allocation cache to the driver.
+
+        This happens automatically when an allocation runs out of
+        memory.  Returns the number of bytes freed.
+        """
+        cdef size_t freed
+        cdef int err
+        with nogil:
+            err = gpucontext_trim_cache(self.ctx, &freed)
+        if err != GA_NO_ERROR:
+            raise get_exc(err), gpucontext_error(self.ctx, err)
+        return freed
+
 
 cdef class flags(object):
     cdef int fl
@@ -1379,6 +1541,83 @@ cdef GpuArray pygpu_empty_like(GpuArray a, ga_order ord, int typecode):
                 a.ga.nd, a.ga.dimensions, ord)
     return res
 
+cdef int _location(object location) except -1:
+    if location == 'device':
+        return GA_LOCATION_DEVICE
+    if location == 'host':
+        return GA_LOCATION_HOST
+    raise ValueError, "location must be 'device' or 'host'"
+
+_advices = {'read_mostly': GA_ADVISE_READ_MOSTLY,
+            'no_read_mostly': GA_ADVISE_NO_READ_MOSTLY,
+            'preferred_location': GA_ADVISE_PREFERRED_LOCATION,
+            'no_preferred_location': GA_ADVISE_NO_PREFERRED_LOCATION,
+            'accessed_by': GA_ADVISE_ACCESSED_BY,
+            'not_accessed_by': GA_ADVISE_NOT_ACCESSED_BY}
+
+cdef int _array_span(GpuArray a, size_t *start, size_t *size) except -1:
+    # Byte range of the buffer covered by the elements of the array
+    cdef size_t lo = 0
+    cdef size_t hi = gpuarray_get_elsize(a.ga.typecode)
+    cdef unsigned int i
+    for i in range(a.ga.nd):
+        if a.ga.dimensions[i] == 0:
+            start[0] = a.ga.offset
+            size[0] = 0
+            return 0
+        if a.ga.strides[i] < 0:
+            lo += (a.ga.dimensions[i] - 1) * <size_t>(-a.ga.strides[i])
+        else:
+            hi += (a.ga.dimensions[i] - 1) * <size_t>a.ga.strides[i]
+    start[0] = a.ga.offset - lo
+    size[0] = lo + hi
+    return 0
+
+cdef int pygpu_prefetch(GpuArray a, int location) except -1:
+    cdef size_t start, size
+    cdef int err
+    _array_span(a, &start, &size)
+    with nogil:
+        err = gpudata_prefetch(a.ga.data, start, size, location)
+    if err != GA_NO_ERROR:
+        raise get_exc(err), GpuArray_error(&a.ga, err)
+    return 0
+
+cdef int pygpu_advise(GpuArray a, int advice, int location) except -1:
+    cdef size_t start, size
+    cdef int err
+    _array_span(a, &start, &size)
+    err = gpudata_advise(a.ga.data, start, size, advice, location)
+    if err != GA_NO_ERROR:
+        raise get_exc(err), GpuArray_error(&a.ga, err)
+    return 0
+
+cdef np.ndarray pygpu_host_view(GpuArray a):
+    cdef np.ndarray res
+    cdef np.dtype dt
+    cdef char *p
+    cdef int err
+    cdef int flags = 0
+
+    err = gpudata_property(a.ga.data, GA_BUFFER_PROP_HOSTPOINTER, &p)
+    if err != GA_NO_ERROR:
+        raise get_exc(err), GpuArray_error(&a.ga, err)
+    # Host access is only safe once the device is done with the buffer
+    array_sync(a)
+    if py_CHKFLAGS(a, GA_WRITEABLE):
+        flags = np.NPY_ARRAY_WRITEABLE
+    dt = a.dtype
+    # PyArray_NewFromDescr steals the dtype reference
+    Py_INCREF(dt)
+    res = _PyArray_NewFromDescr(np.ndarray, dt, a.ga.nd,
+                                <np.npy_intp *>a.ga.dimensions,
+                                <np.npy_intp *>a.ga.strides,
+                                p + a.ga.offset, flags, None)
+    # PyArray_SetBaseObject steals the base reference
+    Py_INCREF(a)
+    _PyArray_SetBaseObject(res, a)
+    return res
+
 cdef np.ndarray pygpu_as_ndarray(GpuArray a):
     return _pygpu_as_ndarray(a, None)
 
@@ -1511,11 +1750,63 @@ def _concatenate(list al, unsigned int axis, int restype, object cls,
     finally:
         PyMem_Free(als)
 
+def maxandargmax(GpuArray a not None, axes):
+    """
+    maxandargmax(a, axes)
+
+    Return the maxima of `a` over `axes` and their positions.
+
+    The result is a pair of C-contiguous arrays with the shape of `a`
+    without the reduced axes.  The positions are int64 and count in C
+    order over the reduced axes, taken in the order given in `axes`.
+    """
+    cdef unsigned int *redux
+    cdef size_t *dims
+    cdef unsigned int i, j, nd
+    cdef GpuArray rmax, rarg
+    cdef int err
+    axes = list(axes)
+    for i in range(len(axes)):
+        if axes[i] < 0:
+            axes[i] += a.ga.nd
+        if axes[i] < 0 or axes[i] >= a.ga.nd:
+            raise ValueError, "axis out of bounds"
+    if len(axes) == 0 or len(set(axes)) != len(axes):
+        raise ValueError, "expected a non-empty list of distinct axes"
+    redux = <unsigned int *>PyMem_Malloc(sizeof(unsigned int) * len(axes))
+    if redux == NULL:
+        raise MemoryError()
+    dims = <size_t *>PyMem_Malloc(sizeof(size_t) * a.ga.nd)
+    if dims == NULL:
+        PyMem_Free(redux)
+        raise MemoryError()
+    try:
+        nd = 0
+        for j in range(a.ga.nd):
+            if j not in axes:
+                dims[nd] = a.ga.dimensions[j]
+                nd += 1
+        for i in range(len(axes)):
+            redux[i] = axes[i]
+        rmax = pygpu_empty(nd, dims, a.ga.typecode, GA_C_ORDER, a.context,
+                           None)
+        rarg = pygpu_empty(nd, dims, GA_LONG, GA_C_ORDER, a.context, None)
+        err = GpuArray_maxandargmax(&rmax.ga, &rarg.ga, &a.ga, len(axes),
+                                    redux)
+        if err != GA_NO_ERROR:
+            raise get_exc(err), GpuArray_error(&a.ga, err)
+        return rmax, rarg
+    finally:
+        PyMem_Free(redux)
+        PyMem_Free(dims)
+
 cdef int (*cuda_get_ipc_handle)(gpudata *, GpuArrayIpcMemHandle *)
 cdef gpudata *(*cuda_open_ipc_handle)(gpucontext *, GpuArrayIpcMemHandle *, size_t)
+cdef int (*cuda_get_ipc_range)(gpudata *, size_t *, size_t *)
 
 cuda_get_ipc_handle = <int (*)(gpudata *, GpuArrayIpcMemHandle *)>gpuarray_get_extension("cuda_get_ipc_handle")
 cuda_open_ipc_handle = <gpudata *(*)(gpucontext *, GpuArrayIpcMemHandle *, size_t)>gpuarray_get_extension("cuda_open_ipc_handle")
+cuda_get_ipc_range = <int (*)(gpudata *, size_t *, size_t *)>gpuarray_get_extension("cuda_get_ipc_range")
 
 def open_ipc_handle(GpuContext c, bytes hpy, size_t l):
     """
@@ -1545,6 +1836,367 @@ def open_ipc_handle(GpuContext c, bytes hpy, size_t l):
         raise GpuArrayException, gpucontext_error(c.ctx, 0)
     return <size_t>d
 
+def open_ipc_array(GpuContext c, bytes hpy, size_t l):
+    """
+    open_ipc_array(c, hpy, l)
+
+    Open an IPC handle as a uint8 GpuArray covering the whole block.
+
+    Unlike :func:`open_ipc_handle`, the mapping belongs to the
+    returned array and is closed when it and all the arrays built
+    from its data are gone.
+
+    Parameters
+    ----------
+    c: GpuContext
+        context
+    hpy: bytes
+        binary handle data received
+    l: int
+        size of the referred memory block
+
+    """
+    cdef GpuArrayIpcMemHandle h
+    cdef gpudata *d
+    cdef size_t dims[1]
+    cdef ssize_t strides[1]
+
+    if cuda_open_ipc_handle is NULL:
+        raise SystemError, "Could not get necessary extension"
+    if len(hpy) != sizeof(h):
+        raise ValueError, "Invalid IPC handle"
+    memcpy(&h, <char *>hpy, sizeof(h))
+    d = cuda_open_ipc_handle(c.ctx, &h, l)
+    if d is NULL:
+        raise GpuArrayException, gpucontext_error(c.ctx, 0)
+    dims[0] = l
+    strides[0] = 1
+    try:
+        return pygpu_fromgpudata(d, 0, GA_UBYTE, 1, dims, strides, c, True,
+                                 None, None)
+    finally:
+        gpudata_release(d)
+
+def _from_block(GpuArray block, size_t offset, dtype, shape, strides,
+                base, cls):
+    # Like from_gpudata() on the data of `block`, which python can't see
+    return from_gpudata(<size_t>block.ga.data, offset, dtype, shape,
+                        context=block.context, strides=strides, base=base,
+                        cls=cls)
+
+# DLPack structures (https://github.com/dmlc/dlpack, ABI version 0.x).
+# Only the layout matters here so we declare them ourselves instead of
+# depending on the header.
+cdef enum DLDeviceType:
+    kDLCPU = 1
+    kDLCUDA = 2
+    kDLCUDAHost = 3
+    kDLOpenCL = 4
+    kDLCUDAManaged = 13
+
+cdef enum DLDataTypeCode:
+    kDLInt = 0
+    kDLUInt = 1
+    kDLFloat = 2
+    kDLComplex = 5
+    kDLBool = 6
+
+cdef struct DLDevice:
+    DLDeviceType device_type
+    int32_t device_id
+
+cdef struct DLDataType:
+    uint8_t code
+    uint8_t bits
+    uint16_t lanes
+
+cdef struct DLTensor:
+    void *data
+    DLDevice device
+    int32_t ndim
+    DLDataType dtype
+    int64_t *shape
+    int64_t *strides
+    uint64_t byte_offset
+
+cdef struct DLManagedTensor:
+    DLTensor dl_tensor
+    void *manager_ctx
+    void (*deleter)(DLManagedTensor *) nogil
+
+cdef gpudata *(*cuda_make_buf)(gpucontext *, size_t, size_t)
+
+cuda_make_buf = <gpudata *(*)(gpucontext *, size_t, size_t)>gpuarray_get_extension("cuda_make_buf")
+
+cdef dict DL_TO_KIND = {kDLInt: 'int', kDLUInt: 'uint', kDLFloat: 'float',
+                        kDLComplex: 'complex'}
+cdef dict KIND_TO_DL = {'i': kDLInt, 'u': kDLUInt, 'f': kDLFloat,
+                        'c': kDLComplex, 'b': kDLBool}
+
+cdef void _dlpack_deleter(DLManagedTensor *t) with gil:
+    # The shape and strides are allocated in the same block as the
+    # tensor.  manager_ctx holds a reference to the exported GpuArray
+    # which keeps the gpudata retained.
+    Py_DECREF(<object>t.manager_ctx)
+    free(t)
+
+cdef void _dlpack_capsule_destructor(object cap):
+    cdef DLManagedTensor *t
+    # A consumer renames the capsule when it takes ownership.
+    if PyCapsule_IsValid(cap, "dltensor"):
+        t = <DLManagedTensor *>PyCapsule_GetPointer(cap, "dltensor")
+        t.deleter(t)
+
+cdef class _DLPackOwner:
+    """
+    Keeps an imported DLPack tensor alive for as long as the arrays
+    that map its memory.
+    """
+    cdef DLManagedTensor *t
+
+    def __dealloc__(self):
+        if self.t != NULL and self.t.deleter != NULL:
+            self.t.deleter(self.t)
+        self.t = NULL
+
+def from_dlpack(obj, GpuContext context=None):
+    """
+    from_dlpack(obj, context=None)
+
+    Map the memory of a DLPack tensor into a new GpuArray without
+    copying.
+
+    Parameters
+    ----------
+    obj: object
+        an object implementing `__dlpack__` or a "dltensor" capsule
+    context: GpuContext
+        CUDA context for the device that holds the data
+
+    Notes
+    -----
+    The producer is kept alive until the returned array and all of
+    its views are gone.
+    """
+    cdef DLManagedTensor *t
+    cdef DLTensor *dl
+    cdef _DLPackOwner owner
+    cdef gpudata *buf
+    cdef size_t *cdims = NULL
+    cdef ssize_t *cstrides = NULL
+    cdef size_t elsize
+    cdef size_t lo, hi
+    cdef bint empty
+    cdef int typecode
+    cdef int i
+
+    context = ensure_context(context)
+    if context.kind != b'cuda':
+        raise ValueError, "DLPack import only works for cuda contexts"
+    if cuda_make_buf is NULL:
+        raise SystemError, "Could not get necessary extension"
+
+    if hasattr(obj, '__dlpack__'):
+        cap = obj.__dlpack__()
+    else:
+        cap = obj
+    if not PyCapsule_IsValid(cap, "dltensor"):
+        raise ValueError, "Expected an unconsumed DLPack capsule"
+    t = <DLManagedTensor *>PyCapsule_GetPointer(cap, "dltensor")
+    dl = &t.dl_tensor
+
+    if (dl.device.device_type != kDLCUDA and
+        dl.device.device_type != kDLCUDAManaged):
+        raise ValueError, "DLPack tensor is not on a CUDA device"
+    if dl.device.device_id != context.devno:
+        raise ValueError, "DLPack tensor is on another device than the context"
+    if dl.dtype.lanes != 1:
+        raise TypeError, "Vector DLPack types are not supported"
+    if dl.dtype.code == kDLBool:
+        dtype = 'bool'
+    elif dl.dtype.code in DL_TO_KIND:
+        dtype = DL_TO_KIND[dl.dtype.code] + str(dl.dtype.bits)
+    else:
+        raise TypeError, "Unsupported DLPack type code %d" % (dl.dtype.code,)
+    typecode = dtype_to_typecode(dtype)
+    elsize = gpuarray_get_elsize(typecode)
+
+    # Take ownership now so that the deleter is called even if we fail
+    # below.
+    owner = _DLPackOwner.__new__(_DLPackOwner)
+    owner.t = t
+    PyCapsule_SetName(cap, "used_dltensor")
+
+    try:
+        cdims = <size_t *>calloc(dl.ndim, sizeof(size_t))
+        cstrides = <ssize_t *>calloc(dl.ndim, sizeof(ssize_t))
+        if (cdims == NULL or cstrides == NULL) and dl.ndim != 0:
+            raise MemoryError
+        # Compute the extent of the mapped region relative to the
+        # first element, like GpuArray_maxandmin_size.
+        lo = 0
+        hi = elsize
+        empty = False
+        for i in range(dl.ndim - 1, -1, -1):
+            cdims[i] = dl.shape[i]
+            if dl.strides == NULL:
+                if i == dl.ndim - 1:
+                    cstrides[i] = elsize
+                else:
+                    cstrides[i] = cstrides[i+1] * cdims[i+1]
+            else:
+                cstrides[i] = dl.strides[i] * elsize
+            if cdims[i] == 0:
+                empty = True
+            elif cstrides[i] < 0:
+                lo += (cdims[i] - 1) * <size_t>(-cstrides[i])
+            else:
+                hi += (cdims[i] - 1) * cstrides[i]
+        if empty:
+            lo = hi = 0
+
+        buf = cuda_make_buf(context.ctx,
+                            <size_t>dl.data + dl.byte_offset - lo,
+                            lo + hi)
+        if buf is NULL:
+            raise GpuArrayException, gpucontext_error(context.ctx, 0)
+        try:
+            return pygpu_fromgpudata(buf, lo, typecode, dl.ndim, cdims,
+                                     cstrides, context, True, owner, None)
+        finally:
+            gpudata_release(buf)
+    finally:
+        free(cdims)
+        free(cstrides)
+
+cdef bint _is_advanced(object k):
+    return isinstance(k, (list, np.ndarray, GpuArray))
+
+cdef tuple _broadcast_shapes(list shapes):
+    cdef unsigned int nd = 0
+    cdef unsigned int i, j
+    for s in shapes:
+        if len(s) > nd:
+            nd = len(s)
+    res = [1] * nd
+    for s in shapes:
+        for i in range(len(s)):
+            j = nd - len(s) + i
+            if res[j] == 1:
+                res[j] = s[i]
+            elif s[i] != 1 and s[i] != res[j]:
+                raise IndexError, "shape mismatch: indexing arrays could not be broadcast together"
+    return tuple(res)
+
+cdef tuple _fancy_prepare(GpuArray a, tuple key):
+    """
+    Split an advanced index into a basic view of `a` and a list of
+    index arrays for the gather and scatter kernels.
+
+    Returns (view, axis, idx, ishape) where the index arrays in `idx`
+    apply to the consecutive axes of `view` starting at `axis` and
+    are all C-contiguous integer GpuArrays of shape `ishape`.
+    """
+    cdef GpuArray view
+    cdef GpuArray g
+    cdef unsigned int nd = a.ga.nd
+    cdef unsigned int axis
+    cdef list nkey = []
+    cdef list adv
+    cdef list idx
+
+    if countis(key, None) != 0:
+        raise NotImplementedError, "newaxis is not supported with fancy indexing"
+    if countis(key, Ellipsis) > 1:
+        raise IndexError, "cannot use more than one Ellipsis"
+
+    for k in key:
+        if isinstance(k, (list, np.ndarray)):
+            k = numpy.asarray(k)
+            if k.dtype == numpy.bool_:
+                # Masks come from the host so this doesn't sync anything.
+                nkey.extend(k.nonzero())
+                continue
+            if k.dtype.kind not in 'iu':
+                if k.size != 0:
+                    raise IndexError, "arrays used as indices must be of integer type"
+                k = k.astype('int64')
+        elif isinstance(k, GpuArray):
+            if k.dtype == numpy.bool_:
+                raise NotImplementedError, "boolean GpuArray indices are not supported"
+            if k.dtype.kind not in 'iu':
+                raise IndexError, "arrays used as indices must be of integer type"
+        nkey.append(k)
+
+    for i in range(len(nkey)):
+        if nkey[i] is Ellipsis:
+            nkey[i:i+1] = [slice(None)] * (nd - (len(nkey) - 1))
+            break
+    if len(nkey) > nd:
+        raise IndexError, "too many indices"
+    nkey.extend([slice(None)] * (nd - len(nkey)))
+
+    # Integers count as advanced indices when arrays are present (like
+    # numpy) since this changes where the indexed dimensions end up.
+    adv = [i for i in range(nd) if not isinstance(nkey[i], slice)]
+    view = a.__cgetitem__(tuple(slice(None) if not isinstance(k, slice)
+                                else k for k in nkey))
+
+    idx = []
+    for i in adv:
+        k = nkey[i]
+        if not isinstance(k, (np.ndarray, GpuArray)):
+            k = numpy.asarray(PyNumber_Index(k), dtype='int64')
+        idx.append(k)
+    ishape = _broadcast_shapes([k.shape for k in idx])
+
+    for i in range(len(idx)):
+        k = idx[i]
+        if isinstance(k, GpuArray):
+            g = <GpuArray>k
+            if (g.shape != ishape or not py_CHKFLAGS(g, GA_C_CONTIGUOUS) or
+                    g.context is not a.context):
+                if g.context is not a.context:
+                    raise ValueError, "index array is not in the same context"
+                g = empty(ishape, dtype=g.ga.typecode, context=a.context)
+                array_setarray(g, <GpuArray>k)
+        else:
+            k = numpy.ascontiguousarray(numpy.broadcast_to(k, ishape))
+            g = carray(k, None, False, 'C', 0, a.context, GpuArray)
+        idx[i] = g
+
+    if adv == list(range(adv[0], adv[0] + len(adv))):
+        axis = adv[0]
+    else:
+        # Non-adjacent advanced indices put the indexed dimensions
+        # first, like numpy.
+        view = view.transpose(adv + [i for i in range(nd) if i not in adv])
+        axis = 0
+    return view, axis, idx, ishape
+
+cdef GpuArray _fancy_getitem(GpuArray a, tuple key):
+    cdef GpuArray view, res
+    cdef unsigned int axis
+    view, axis, idx, ishape = _fancy_prepare(a, key)
+    if len(idx) == 1 and axis == 0 and len(ishape) == 1:
+        return view.take1(idx[0])
+    shape = view.shape[:axis] + ishape + view.shape[axis + len(idx):]
+    res = empty(shape, dtype=a.ga.typecode, context=a.context, cls=type(a))
+    array_gather(res, view, axis, idx, 1)
+    return res
+
+cdef _fancy_setitem(GpuArray a, tuple key, v):
+    cdef GpuArray view, gv, tmp
+    cdef unsigned int axis
+    view, axis, idx, ishape = _fancy_prepare(a, key)
+    shape = view.shape[:axis] + ishape + view.shape[axis + len(idx):]
+    gv = carray(v, a.ga.typecode, False, 'A', 0, a.context, GpuArray)
+    if gv.shape != shape or not py_CHKFLAGS(gv, GA_C_CONTIGUOUS):
+        tmp = empty(shape, dtype=a.ga.typecode, context=a.context)
+        array_setarray(tmp, gv)
+        gv = tmp
+    array_scatter(view, gv, axis, idx, 1)
+
 cdef class GpuArray:
     """
     Device array
@@ -1575,7 +2227,7 @@ cdef class GpuArray:
             raise RuntimeError, "Called raw GpuArray.__init__"
 
     def __reduce__(self):
-        raise RuntimeError, "Cannot pickle GpuArray object"
+        raise RuntimeError, "Cannot pickle GpuArray object (see pygpu.ipc.enable_pickling)"
 
     cdef __index_helper(self, key, unsigned int i, ssize_t *start,
                         ssize_t *stop, ssize_t *step):
@@ -1605,6 +2257,15 @@ cdef class GpuArray:
         else:
             raise IndexError, "cannot index with: %s" % (key,)
 
+    cdef bint _same_shape(self, np.ndarray a):
+        cdef unsigned int i
+        if np.PyArray_NDIM(a) != self.ga.nd:
+            return False
+        for i in range(self.ga.nd):
+            if <size_t>np.PyArray_DIM(a, i) != self.ga.dimensions[i]:
+                return False
+        return True
+
     def write(self, np.ndarray src not None):
         """
         write(src)
@@ -1615,11 +2276,14 @@ cdef class GpuArray:
         skips possible allocation of a buffer in device's memory. It uses this
         already allocated GpuArray buffer to contain `src` array from host's
         memory. It is required though that the GpuArray and the Numpy array are
-        compatible in byte size and data type. It is also needed for the
-        GpuArray to be well behaved and contiguous. If `src` is not aligned or
-        compatible in contiguity it will be copied to a new Numpy array in order
-        to be. It is allowed for this GpuArray and `src` to have different
-        shapes.
+        compatible in byte size and data type.
+
+        If `src` has the same shape as this GpuArray, any layout is
+        accepted on either side and the data is transferred directly
+        with strided copies, without an intermediate host copy.
+        Otherwise the two arrays may have different shapes and `src`
+        is copied to a new Numpy array if it does not match the
+        contiguity of this GpuArray.
 
         Parameters
         ----------
@@ -1630,19 +2294,21 @@ cdef class GpuArray:
         ------
         ValueError
             If this GpuArray is not compatible with `src` or if it is
-            not well behaved or contiguous.
+            not well behaved.
 
         """
         if not self.flags.behaved:
             raise ValueError, "Destination GpuArray is not well behaved: aligned and writeable"
-        if self.flags.c_contiguous:
-            src = np.asarray(src, order='C')
-        elif self.flags.f_contiguous:
-            src = np.asarray(src, order='F')
-        else:
-            raise ValueError, "Destination GpuArray is not contiguous"
         if self.dtype != src.dtype:
             raise ValueError, "GpuArray and Numpy array do not have matching data types"
+        if self._same_shape(src):
+            array_write_strided(self, np.PyArray_DATA(src),
+                                <ssize_t *>np.PyArray_STRIDES(src))
+            return
+        if self.flags.f_contiguous and not self.flags.c_contiguous:
+            src = np.asarray(src, order='F')
+        else:
+            src = np.asarray(src, order='C')
         cdef size_t npsz = np.PyArray_NBYTES(src)
         cdef size_t sz = gpuarray_get_elsize(self.ga.typecode)
         cdef unsigned i
@@ -1663,10 +2329,12 @@ cdef class GpuArray:
         buffer in host's memory to contain device's GpuArray. It uses an
         existing Numpy ndarray as a buffer to get the GpuArray. It is required
         though that the GpuArray and the Numpy array to be compatible in byte
-        size, contiguity and data type. It is also needed for `dst` to be
-        writeable and properly aligned in host's memory and for `self` to be
-        contiguous. It is allowed for this GpuArray and `dst` to have different
-        shapes.
+        size and data type. It is also needed for `dst` to be writeable
+        and properly aligned in host's memory.
+
+        If `dst` has the same shape as this GpuArray, any layout is
+        accepted on either side. Otherwise the two arrays may have
+        different shapes but must match in contiguity.
 
         Parameters
         ----------
@@ -1682,13 +2350,17 @@ cdef class GpuArray:
         """
         if not np.PyArray_ISBEHAVED(dst):
             raise ValueError, "Destination Numpy array is not well behaved: aligned and writeable"
+        if self.dtype != dst.dtype:
+            raise ValueError, "GpuArray and Numpy array do not have matching data types"
+        if self._same_shape(dst):
+            array_read_strided(np.PyArray_DATA(dst),
+                               <ssize_t *>np.PyArray_STRIDES(dst), self)
+            return
         if (not ((self.flags.c_contiguous and self.flags.aligned and
                   dst.flags['C_CONTIGUOUS']) or
                 (self.flags.f_contiguous and self.flags.aligned and
                  dst.flags['F_CONTIGUOUS']))):
             raise ValueError, "GpuArray and Numpy array do not match in contiguity or GpuArray is not aligned"
-        if self.dtype != dst.dtype:
-            raise ValueError, "GpuArray and Numpy array do not have matching data types"
         cdef size_t npsz = np.PyArray_NBYTES(dst)
         cdef size_t sz = gpuarray_get_elsize(self.ga.typecode)
         cdef unsigned i
@@ -1714,6 +2386,108 @@ cdef class GpuArray:
         res = <bytes>(<char *>&h)[:sizeof(h)]
         return res
 
+    def get_ipc_range(self):
+        """
+        get_ipc_range()
+
+        Return the offset of this array's buffer in the block of its IPC
+        handle and the size of that block, as `(offset, size)`.
+
+        The offset of the array itself is not included.
+        """
+        cdef size_t off, sz
+        cdef int err
+        if cuda_get_ipc_range is NULL:
+            raise SystemError, "Could not get necessary extension"
+        if self.context.kind != b'cuda':
+            raise ValueError, "Only works for cuda contexts"
+        err = cuda_get_ipc_range(self.ga.data, &off, &sz)
+        if err != GA_NO_ERROR:
+            raise get_exc(err), GpuArray_error(&self.ga, err)
+        return off, sz
+
+    def __dlpack_device__(self):
+        """
+        __dlpack_device__()
+
+        Return the DLPack (device_type, device_id) pair for this array.
+        """
+        if self.context.kind != b'cuda':
+            raise TypeError("DLPack export is only supported for CUDA arrays.")
+        return (kDLCUDA, self.context.devno)
+
+    def __dlpack__(self, stream=None):
+        """
+        __dlpack__(stream=None)
+
+        Export this array as a DLPack capsule without copying.
+
+        Pending work on the array is waited for before returning so
+        the consumer can use the data on any stream.
+        """
+        cdef DLManagedTensor *t
+        cdef np.dtype dt
+        cdef size_t elsize
+        cdef unsigned int i
+
+        if self.context.kind != b'cuda':
+            raise TypeError("DLPack export is only supported for CUDA arrays.")
+        dt = typecode_to_dtype(self.ga.typecode)
+        if dt.kind not in KIND_TO_DL:
+            raise TypeError("Type %s can't be exported through DLPack" % (dt,))
+        elsize = dt.itemsize
+        for i in range(self.ga.nd):
+            if self.ga.strides[i] % <ssize_t>elsize != 0:
+                raise BufferError("DLPack requires strides that are a multiple of the element size")
+
+        # One block for the tensor and its shape and strides.
+        t = <DLManagedTensor *>malloc(sizeof(DLManagedTensor) +
+                                      2 * self.ga.nd * sizeof(int64_t))
+        if t == NULL:
+            raise MemoryError
+        t.dl_tensor.shape = <int64_t *>&t[1]
+        t.dl_tensor.strides = t.dl_tensor.shape + self.ga.nd
+        for i in range(self.ga.nd):
+            t.dl_tensor.shape[i] = self.ga.dimensions[i]
+            t.dl_tensor.strides[i] = self.ga.strides[i] // <ssize_t>elsize
+        # The offset is folded into the pointer since many consumers
+        # ignore byte_offset for device memory.
+        t.dl_tensor.data = <void *><size_t>self.gpudata
+        t.dl_tensor.byte_offset = 0
+        t.dl_tensor.device.device_type = kDLCUDA
+        t.dl_tensor.device.device_id = self.context.devno
+        t.dl_tensor.ndim = self.ga.nd
+        t.dl_tensor.dtype.code = KIND_TO_DL[dt.kind]
+        t.dl_tensor.dtype.bits = elsize * 8
+        t.dl_tensor.dtype.lanes = 1
+        # The reference to self keeps the gpudata retained until the
+        # consumer calls the deleter.
+        Py_INCREF(self)
+        t.manager_ctx = <void *>self
+        t.deleter = _dlpack_deleter
+
+        array_sync(self)
+        return PyCapsule_New(t, "dltensor",
+                             <PyCapsule_Destructor>_dlpack_capsule_destructor)
+
+    property __cuda_array_interface__:
+        "CUDA Array Interface (version 3) description of this array."
+        def __get__(self):
+            cdef np.dtype dt
+            if self.context.kind != b'cuda':
+                raise AttributeError("__cuda_array_interface__ is only available for CUDA arrays.")
+            dt = typecode_to_dtype(self.ga.typecode)
+            # We wait for pending work instead of exporting a stream
+            # since gpudata may be used by more than one stream.
+            array_sync(self)
+            return {'shape': self.shape,
+                    'typestr': dt.str,
+                    'data': (self.gpudata,
+                             not py_CHKFLAGS(self, GA_WRITEABLE)),
+                    'strides': (None if py_CHKFLAGS(self, GA_C_CONTIGUOUS)
+                                else self.strides),
+                    'version': 3}
+
     def __array__(self, ldtype=None):
         """
         __array__(ldtype=None)
@@ -1800,6 +2574,60 @@ cdef class GpuArray:
         """
         pygpu_sync(self)
 
+    def prefetch(self, location='device'):
+        """
+        prefetch(location='device')
+
+        Migrate the data of a managed array.
+
+        The migration is asynchronous and ordered with the other
+        operations on the array.
+
+        Parameters
+        ----------
+        location: {'device', 'host'}
+            where to move the data
+
+        """
+        pygpu_prefetch(self, _location(location))
+
+    def advise(self, advice, location='device'):
+        """
+        advise(advice, location='device')
+
+        Give a hint about how the data of a managed array is accessed.
+
+        Parameters
+        ----------
+        advice: str
+            one of 'read_mostly', 'preferred_location', 'accessed_by'
+            or their negation 'no_read_mostly',
+            'no_preferred_location', 'not_accessed_by'
+        location: {'device', 'host'}
+            location the hint applies to (ignored for read_mostly)
+
+        """
+        try:
+            a = _advices[advice]
+        except KeyError:
+            raise ValueError, "Unknown advice: %r" % (advice,)
+        pygpu_advise(self, a, _location(location))
+
+    def host_view(self):
+        """
+        host_view()
+
+        Return a :class:`numpy.ndarray` sharing memory with this
+        managed array.
+
+        Pending operations on the array are waited for, but the view
+        must not be used while device work on the array is in
+        progress.  Call :meth:`sync` before accessing it again after
+        launching such work.
+
+        """
+        return pygpu_host_view(self)
+
     def view(self, object cls=GpuArray):
         """
         view(cls=GpuArray)
@@ -1921,25 +2749,25 @@ cdef class GpuArray:
         if key is Ellipsis:
             return self.__cgetitem__(key)
 
-        # A list or a sequence of list should trigger "fancy" indexing.
-        # This is not implemented yet.
-        # Conversely, if a list contains slice or Ellipsis objects, it behaves
-        # the same as a tuple.
+        # A list, an array or a sequence containing those triggers
+        # "fancy" indexing.  Conversely, if a list contains slice or
+        # Ellipsis objects, it behaves the same as a tuple.
         if isinstance(key, list):
             if any(isinstance(k, slice) or k is Ellipsis for k in key):
                 return self.__getitem__(tuple(key))
             else:
-                raise NotImplementedError, "fancy indexing not supported"
+                return _fancy_getitem(self, (key,))
+        if isinstance(key, (np.ndarray, GpuArray)):
+            return _fancy_getitem(self, (key,))
 
         try:
             iter(key)
         except TypeError:
             key = (key,)
         else:
-            if all(isinstance(k, list) for k in key):
-                raise NotImplementedError, "fancy indexing not supported"
-
             key = tuple(key)
+            if any(_is_advanced(k) for k in key):
+                return _fancy_getitem(self, key)
 
         # Need to massage Ellipsis here, to avoid packing it into a tuple.
         if countis(key, Ellipsis) > 1:
@@ -2064,17 +2892,22 @@ cdef class GpuArray:
         if isinstance(idx, list):
             if any(isinstance(i, slice) or i is Ellipsis for i in idx):
                 self.__setitem__(tuple(idx), v)
+                return
             else:
-                raise NotImplementedError, "fancy indexing not supported"
+                _fancy_setitem(self, (idx,), v)
+                return
+        if isinstance(idx, (np.ndarray, GpuArray)):
+            _fancy_setitem(self, (idx,), v)
+            return
         try:
             iter(idx)
         except TypeError:
             idx = (idx,)
         else:
-            if all(isinstance(i, list) for i in idx):
-                raise NotImplementedError, "fancy indexing not supported"
-
             idx = tuple(idx)
+            if any(_is_advanced(i) for i in idx):
+                _fancy_setitem(self, idx, v)
+                return
 
         if countis(idx, Ellipsis) > 1:
             raise IndexError, "cannot use more than one Ellipsis"
@@ -2256,6 +3089,172 @@ cdef class GpuArray:
 
 
 
+# Argument setters for GpuKernel.  One is picked per argument when
+# the kernel is built so that calls don't have to dispatch on the
+# typecode.
+cdef int _set_buffer(void **slot, object o, int typecode) except -1:
+    if not isinstance(o, GpuArray):
+        raise TypeError, "expected a GpuArray"
+    slot[0] = <void *>((<GpuArray>o).ga.data)
+    return 0
+
+cdef int _set_bool(void **slot, object o, int typecode) except -1:
+    (<uint8_t *>slot[0])[0] = 1 if o else 0
+    return 0
+
+cdef int _set_byte(void **slot, object o, int typecode) except -1:
+    (<int8_t *>slot[0])[0] = o
+    return 0
+
+cdef int _set_ubyte(void **slot, object o, int typecode) except -1:
+    (<uint8_t *>slot[0])[0] = o
+    return 0
+
+cdef int _set_short(void **slot, object o, int typecode) except -1:
+    (<int16_t *>slot[0])[0] = o
+    return 0
+
+cdef int _set_ushort(void **slot, object o, int typecode) except -1:
+    (<uint16_t *>slot[0])[0] = o
+    return 0
+
+cdef int _set_int(void **slot, object o, int typecode) except -1:
+    (<int32_t *>slot[0])[0] = o
+    return 0
+
+cdef int _set_uint(void **slot, object o, int typecode) except -1:
+    (<uint32_t *>slot[0])[0] = o
+    return 0
+
+cdef int _set_long(void **slot, object o, int typecode) except -1:
+    (<int64_t *>slot[0])[0] = o
+    return 0
+
+cdef int _set_ulong(void **slot, object o, int typecode) except -1:
+    (<uint64_t *>slot[0])[0] = o
+    return 0
+
+# ga_longlong and ga_ulonglong are 128-bit, stored little-endian
+cdef int _set_longlong(void **slot, object o, int typecode) except -1:
+    cdef uint64_t *p = <uint64_t *>slot[0]
+    o = PyNumber_Index(o)
+    if typecode == GA_LONGLONG:
+        if not (-(1 << 127) <= o < (1 << 127)):
+            raise OverflowError, "value too large for ga_longlong"
+    elif not (0 <= o < (1 << 128)):
+        raise OverflowError, "value out of range for ga_ulonglong"
+    p[0] = <uint64_t>(o & 0xFFFFFFFFFFFFFFFF)
+    p[1] = <uint64_t>((o >> 64) & 0xFFFFFFFFFFFFFFFF)
+    return 0
+
+cdef int _set_float(void **slot, object o, int typecode) except -1:
+    (<float *>slot[0])[0] = o
+    return 0
+
+cdef int _set_double(void **slot, object o, int typecode) except -1:
+    (<double *>slot[0])[0] = o
+    return 0
+
+cdef int _set_size(void **slot, object o, int typecode) except -1:
+    (<size_t *>slot[0])[0] = o
+    return 0
+
+cdef int _set_ssize(void **slot, object o, int typecode) except -1:
+    (<ssize_t *>slot[0])[0] = o
+    return 0
+
+# Half, complex, vector and registered types go through numpy
+cdef int _set_numpy(void **slot, object o, int typecode) except -1:
+    cdef np.ndarray a = np.asarray(o, dtype=typecode_to_dtype(typecode))
+    if np.PyArray_NDIM(a) != 0:
+        raise ValueError, "expected a scalar argument"
+    memcpy(slot[0], np.PyArray_DATA(a), gpuarray_get_elsize(typecode))
+    return 0
+
+cdef kernel_argsetter get_argsetter(int typecode):
+    if typecode == GA_BUFFER:
+        return _set_buffer
+    elif typecode == GA_BOOL:
+        return _set_bool
+    elif typecode == GA_BYTE:
+        return _set_byte
+    elif typecode == GA_UBYTE:
+        return _set_ubyte
+    elif typecode == GA_SHORT:
+        return _set_short
+    elif typecode == GA_USHORT:
+        return _set_ushort
+    elif typecode == GA_INT:
+        return _set_int
+    elif typecode == GA_UINT:
+        return _set_uint
+    elif typecode == GA_LONG:
+        return _set_long
+    elif typecode == GA_ULONG:
+        return _set_ulong
+    elif typecode == GA_LONGLONG or typecode == GA_ULONGLONG:
+        return _set_longlong
+    elif typecode == GA_FLOAT:
+        return _set_float
+    elif typecode == GA_DOUBLE:
+        return _set_double
+    elif typecode == GA_SIZE:
+        return _set_size
+    elif typecode == GA_SSIZE:
+        return _set_ssize
+    return _set_numpy
+
+# Reads the gs and ls of a kernel call into arrays of 3 and returns
+# the number of dimensions.
+cdef int parse_sizes(py_gs, py_ls, size_t *gs, size_t *ls) except -1:
+    cdef unsigned int nd = 0
+
+    if py_ls is None:
+        ls[0] = 0
+        nd = 1
+    else:
+        if isinstance(py_ls, int):
+            ls[0] = py_ls
+            nd = 1
+        elif isinstance(py_ls, (list, tuple)):
+            if len(py_ls) > 3:
+                raise ValueError, "ls is not of length 3 or less"
+            nd = len(py_ls)
+
+            if nd >= 3:
+                ls[2] = py_ls[2]
+            if nd >= 2:
+                ls[1] = py_ls[1]
+            if nd >= 1:
+                ls[0] = py_ls[0]
+        else:
+            raise TypeError, "ls is not int or list"
+
+    if py_gs is None:
+        if nd != 1:
+            raise ValueError, "nd mismatch for gs (None)"
+        gs[0] = 0
+    else:
+        if isinstance(py_gs, int):
+            if nd != 1:
+                raise ValueError, "nd mismatch for gs (int)"
+            gs[0] = py_gs
+        elif isinstance(py_gs, (list, tuple)):
+            if len(py_gs) > 3:
+                raise ValueError, "gs is not of length 3 or less"
+            if len(py_gs) != nd:
+                raise ValueError, "nd mismatch for gs (tuple)"
+
+            if nd >= 3:
+                gs[2] = py_gs[2]
+            if nd >= 2:
+                gs[1] = py_gs[1]
+            if nd >= 1:
+                gs[0] = py_gs[0]
+        else:
+            raise TypeError, "gs is not int or list"
+    return nd
+
 cdef class GpuKernel:
     """
     GpuKernel(source, name, types, context=None, have_double=False, have_small=False, have_complex=False, have_half=False, cuda=False, opencl=False)
@@ -2291,6 +3290,12 @@ cdef class GpuKernel:
     If you choose to use this interface, make sure to stay within the
     limits of `k.maxlsize` or the call will fail.
 
+    For tight loops, :meth:`launch` takes the arguments as a tuple
+    and skips keyword handling::
+
+        args = (param1, param2)
+        k.launch(args, n)
+
     Parameters
     ----------
     source: str
@@ -2330,24 +3335,18 @@ cdef class GpuKernel:
 
     """
     def __dealloc__(self):
-        cdef unsigned int numargs
-        cdef int *types
         cdef unsigned int i
-        cdef int res
         # We need to do all of this at the C level to avoid touching
         # python stuff that could be gone and to avoid exceptions
-        if self.k.k is not NULL:
-            res = gpukernel_property(self.k.k, GA_KERNEL_PROP_NUMARGS, &numargs)
-            if res != GA_NO_ERROR:
-                return
-            res = gpukernel_property(self.k.k, GA_KERNEL_PROP_TYPES, &types)
-            if res != GA_NO_ERROR:
-                return
-            for i in range(numargs):
-                if types[i] != GA_BUFFER:
+        if self.callbuf is not NULL and self._types is not NULL:
+            for i in range(self._numargs):
+                if self._types[i] != GA_BUFFER:
                     free(self.callbuf[i])
+        if self.k.k is not NULL:
             kernel_clear(self)
         free(self.callbuf)
+        free(self._types)
+        free(self._setters)
 
     def __reduce__(self):
         raise RuntimeError, "Cannot pickle GpuKernel object"
@@ -2359,7 +3358,6 @@ cdef class GpuKernel:
         cdef size_t l
         cdef unsigned int numargs
         cdef unsigned int i
-        cdef int *_types
         cdef int flags = 0
 
         source = _s(source)
@@ -2383,25 +3381,26 @@ cdef class GpuKernel:
         s[0] = source
         l = len(source)
         numargs = <unsigned int>len(types)
-        self.callbuf = <void **>calloc(len(types), sizeof(void *))
-        if self.callbuf == NULL:
+        self.callbuf = <void **>calloc(numargs, sizeof(void *))
+        self._types = <int *>calloc(numargs, sizeof(int))
+        self._setters = <kernel_argsetter *>calloc(numargs,
+                                                   sizeof(kernel_argsetter))
+        if (self.callbuf == NULL or self._types == NULL or
+                self._setters == NULL):
             raise MemoryError
-        _types = <int *>calloc(numargs, sizeof(int))
-        if _types == NULL:
-            raise MemoryError
-        try:
-            for i in range(numargs):
-                if (types[i] == GpuArray):
-                    _types[i] = GA_BUFFER
-                else:
-                    _types[i] = dtype_to_typecode(types[i])
-                    self.callbuf[i] = malloc(gpuarray_get_elsize(_types[i]))
-                    if self.callbuf[i] == NULL:
-                        raise MemoryError
-            kernel_init(self, self.context.ctx, 1, s, &l,
-                        name, numargs, _types, flags)
-        finally:
-            free(_types)
+        self._numargs = numargs
+        self._bound = [None] * numargs
+        for i in range(numargs):
+            if (types[i] == GpuArray):
+                self._types[i] = GA_BUFFER
+            else:
+                self._types[i] = dtype_to_typecode(types[i])
+                self.callbuf[i] = malloc(gpuarray_get_elsize(self._types[i]))
+                if self.callbuf[i] == NULL:
+                    raise MemoryError
+            self._setters[i] = get_argsetter(self._types[i])
+        kernel_init(self, self.context.ctx, 1, s, &l,
+                    name, numargs, self._types, flags)
 
     def __call__(self, *args, n=None, gs=None, ls=None, shared=0):
         """
@@ -2411,108 +3410,94 @@ cdef class GpuKernel:
             raise ValueError, "Must specify size (n) or both gs and ls"
         self.do_call(n, gs, ls, args, shared)
 
+    cpdef launch(self, tuple args, size_t n, size_t shared=0):
+        """
+        launch(args, n, shared=0)
+
+        Run the kernel over at least `n` threads with the arguments
+        in the tuple `args`.
+
+        This is the same as ``k(*args, n=n, shared=shared)`` with less
+        call overhead.  The schedule computed for the last `n` is
+        reused when the same `n` is used again.
+        """
+        cdef size_t gs = 0
+        cdef size_t ls = 0
+        self._bind(args)
+        self._sched(n, &gs, &ls)
+        kernel_call(self, 1, &gs, &ls, shared, self.callbuf)
+
     cdef do_call(self, py_n, py_gs, py_ls, py_args, size_t shared):
-        cdef size_t n
         cdef size_t gs[3]
         cdef size_t ls[3]
-        cdef size_t tmp
         cdef unsigned int nd
-        cdef const int *types
-        cdef unsigned int numargs
         cdef unsigned int i
 
-        nd = 0
-
-        if py_ls is None:
-            ls[0] = 0
-            nd = 1
-        else:
-            if isinstance(py_ls, int):
-                ls[0] = py_ls
-                nd = 1
-            elif isinstance(py_ls, (list, tuple)):
-                if len(py_ls) > 3:
-                    raise ValueError, "ls is not of length 3 or less"
-                nd = len(py_ls)
-
-                if nd >= 3:
-                    ls[2] = py_ls[2]
-                if nd >= 2:
-                    ls[1] = py_ls[1]
-                if nd >= 1:
-                    ls[0] = py_ls[0]
-            else:
-                raise TypeError, "ls is not int or list"
-
-        if py_gs is None:
-            if nd != 1:
-                raise ValueError, "nd mismatch for gs (None)"
-            gs[0] = 0
+        # Reuse the sizes parsed on the last call if they are the same
+        # objects.  Lists can change between calls so they are never
+        # kept.
+        if (self._call_nd != 0 and py_gs is self._call_gs and
+                py_ls is self._call_ls):
+            nd = self._call_nd
+            for i in range(nd):
+                gs[i] = self._call_gsv[i]
+                ls[i] = self._call_lsv[i]
         else:
-            if isinstance(py_gs, int):
-                if nd != 1:
-                    raise ValueError, "nd mismatch for gs (int)"
-                gs[0] = py_gs
-            elif isinstance(py_gs, (list, tuple)):
-                if len(py_gs) > 3:
-                    raise ValueError, "gs is not of length 3 or less"
-                if len(py_ls) != nd:
-                    raise ValueError, "nd mismatch for gs (tuple)"
-
-                if nd >= 3:
-                    gs[2] = py_gs[2]
-                if nd >= 2:
-                    gs[1] = py_gs[1]
-                if nd >= 1:
-                    gs[0] = py_gs[0]
+            nd = parse_sizes(py_gs, py_ls, gs, ls)
+            if isinstance(py_gs, list) or isinstance(py_ls, list):
+                self._call_nd = 0
             else:
-                raise TypeError, "gs is not int or list"
+                self._call_gs = py_gs
+                self._call_ls = py_ls
+                self._call_nd = nd
+                for i in range(nd):
+                    self._call_gsv[i] = gs[i]
+                    self._call_lsv[i] = ls[i]
 
-        numargs = self.numargs
-        if len(py_args) != numargs:
-            raise TypeError, "Expected %d arguments, got %d," % (numargs, len(py_args))
-        kernel_property(self, GA_KERNEL_PROP_TYPES, &types)
-        for i in range(numargs):
-            self._setarg(i, types[i], py_args[i])
+        self._bind(py_args)
         if py_n is not None:
             if nd != 1:
                 raise ValueError, "n is specified and nd != 1"
-            n = py_n
-            kernel_sched(self, n, &gs[0], &ls[0])
+            self._sched(py_n, &gs[0], &ls[0])
         kernel_call(self, nd, gs, ls, shared, self.callbuf)
 
+    cdef int _bind(self, tuple args) except -1:
+        cdef unsigned int i
+        cdef list bound = self._bound
+        if len(args) != self._numargs:
+            raise TypeError, "Expected %d arguments, got %d," % (self._numargs, len(args))
+        for i in range(self._numargs):
+            o = args[i]
+            # The data of a GpuArray can be moved, so buffers are
+            # always set.  Numbers are immutable so the same object
+            # still has the value in callbuf.
+            if self._types[i] != GA_BUFFER:
+                if bound[i] is not None and o is bound[i]:
+                    continue
+                bound[i] = None
+            self._setters[i](&self.callbuf[i], o, self._types[i])
+            if (self._types[i] != GA_BUFFER and
+                    isinstance(o, (int, float, np.generic))):
+                bound[i] = o
+        return 0
+
+    cdef int _sched(self, size_t n, size_t *gs, size_t *ls) except -1:
+        if gs[0] != 0 or ls[0] != 0:
+            kernel_sched(self, n, gs, ls)
+            return 0
+        if n != 0 and n == self._sched_n:
+            gs[0] = self._sched_gs
+            ls[0] = self._sched_ls
+            return 0
+        kernel_sched(self, n, gs, ls)
+        self._sched_n = n
+        self._sched_gs = gs[0]
+        self._sched_ls = ls[0]
+        return 0
+
     cdef _setarg(self, unsigned int index, int typecode, object o):
-        if typecode == GA_BUFFER:
-            if not isinstance(o, GpuArray):
-                raise TypeError, "expected a GpuArray"
-            self.callbuf[index] = <void *>((<GpuArray>o).ga.data)
-        elif typecode == GA_SIZE:
-            (<size_t *>self.callbuf[index])[0] = o
-        elif typecode == GA_SSIZE:
-            (<ssize_t *>self.callbuf[index])[0] = o
-        elif typecode == GA_FLOAT:
-            (<float *>self.callbuf[index])[0] = o
-        elif typecode == GA_DOUBLE:
-            (<double *>self.callbuf[index])[0] = o
-        elif typecode == GA_BYTE:
-            (<signed char *>self.callbuf[index])[0] = o
-        elif typecode == GA_UBYTE:
-            (<unsigned char *>self.callbuf[index])[0] = o
-        elif typecode == GA_SHORT:
-            (<short *>self.callbuf[index])[0] = o
-        elif typecode == GA_USHORT:
-            (<unsigned short *>self.callbuf[index])[0] = o
-        elif typecode == GA_INT:
-            (<int *>self.callbuf[index])[0] = o
-        elif typecode == GA_UINT:
-            (<unsigned int *>self.callbuf[index])[0] = o
-        elif typecode == GA_LONG:
-            (<long *>self.callbuf[index])[0] = o
-        elif typecode == GA_ULONG:
-            (<unsigned long *>self.callbuf[index])[0] = o
-        else:
-            raise ValueError("Bad typecode in _setarg: %d "
-                             "(please report this, it is a bug)" % (typecode,))
+        self._bound[index] = None
+        get_argsetter(typecode)(&self.callbuf[index], o, typecode)
 
     property maxlsize:
         "Maximum local size for this kernel"
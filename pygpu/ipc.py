@@ -0,0 +1,346 @@
+"""
+Sharing GpuArrays between processes without copies, through CUDA IPC
+memory handles.
+
+An exported array is described by an :class:`IpcDescriptor` which
+holds the handle of the driver allocation it lives in, where it is in
+that allocation and its dtype, shape and strides.  Importing it in
+another process maps the allocation once per context: the mappings are
+kept in a cache keyed by the handle bytes and shared by all the arrays
+imported from them, and closed when the last of those arrays goes away.
+
+Pickling of GpuArray and GpuContext objects stays disabled unless
+:func:`enable_pickling` is called, since the pickles only make sense
+while the exporting process keeps the arrays alive.  It covers
+:mod:`pickle` and the queues and pipes of :mod:`multiprocessing`::
+
+    from pygpu import ipc
+    ipc.enable_pickling()
+    queue.put(batch)   # the consumer gets a view of the same memory
+"""
+import struct
+import threading
+import weakref
+from collections import namedtuple
+
+import numpy
+
+from . import gpuarray
+
+__all__ = ['IpcDescriptor', 'HandleCache', 'export', 'import_array',
+           'get_cache', 'enable_pickling', 'disable_pickling']
+
+IPC_VERSION = 1
+
+_MAGIC = b'GAIPC'
+# magic, version, devno, block size, offset, nd
+_HEAD = struct.Struct('<5sBiQQB')
+
+
+def _pack_bytes(b):
+    return struct.pack('<H', len(b)) + b
+
+
+def _unpack_bytes(buf, pos):
+    n, = struct.unpack_from('<H', buf, pos)
+    pos += 2
+    if pos + n > len(buf):
+        raise ValueError("Truncated IPC descriptor")
+    return bytes(buf[pos:pos + n]), pos + n
+
+
+class IpcDescriptor(namedtuple('IpcDescriptor',
+                               'kind devno unique_id handle size offset '
+                               'dtype shape strides')):
+    """
+    Description of an exported array.
+
+    `handle` refers to a block of `size` bytes on the device with PCI
+    bus id `unique_id` (ordinal `devno` in the exporting process) and
+    the array starts `offset` bytes into it.  `kind` and `unique_id`
+    are str, `dtype` is the numpy dtype string.
+    """
+    __slots__ = ()
+
+    def to_bytes(self):
+        """Serialise to a compact little-endian binary form."""
+        nd = len(self.shape)
+        return b''.join([
+            _HEAD.pack(_MAGIC, IPC_VERSION, self.devno, self.size,
+                       self.offset, nd),
+            _pack_bytes(self.kind.encode('ascii')),
+            _pack_bytes(self.unique_id.encode('ascii')),
+            _pack_bytes(self.handle),
+            _pack_bytes(self.dtype.encode('ascii')),
+            struct.pack('<%dQ%dq' % (nd, nd),
+                        *(tuple(self.shape) + tuple(self.strides)))])
+
+    @classmethod
+    def from_bytes(cls, buf):
+        """Parse the output of :meth:`to_bytes`."""
+        if len(buf) < _HEAD.size:
+            raise ValueError("Truncated IPC descriptor")
+        magic, version, devno, size, offset, nd = _HEAD.unpack_from(buf, 0)
+        if magic != _MAGIC:
+            raise ValueError("Not an IPC descriptor")
+        if version != IPC_VERSION:
+            raise ValueError("Unsupported IPC descriptor version %d" %
+                             (version,))
+        pos = _HEAD.size
+        kind, pos = _unpack_bytes(buf, pos)
+        unique_id, pos = _unpack_bytes(buf, pos)
+        handle, pos = _unpack_bytes(buf, pos)
+        dtype, pos = _unpack_bytes(buf, pos)
+        dims = struct.Struct('<%dQ%dq' % (nd, nd))
+        if pos + dims.size != len(buf):
+            raise ValueError("Bad IPC descriptor length")
+        vals = dims.unpack_from(buf, pos)
+        return cls(kind.decode('ascii'), devno, unique_id.decode('ascii'),
+                   handle, size, offset, dtype.decode('ascii'),
+                   tuple(vals[:nd]), tuple(vals[nd:]))
+
+    def check(self):
+        """Make sure the array fits in its block."""
+        itemsize = numpy.dtype(self.dtype).itemsize
+        lo = hi = self.offset
+        if any(d == 0 for d in self.shape):
+            return
+        for d, s in zip(self.shape, self.strides):
+            if s < 0:
+                lo += (d - 1) * s
+            else:
+                hi += (d - 1) * s
+        if lo < 0 or hi + itemsize > self.size:
+            raise ValueError("Array is outside of its IPC block")
+
+
+class _Mapping(object):
+    """
+    An opened handle.
+
+    Imported arrays keep it alive through their base, which is what
+    keeps it in the cache.
+    """
+    __slots__ = ('handle', 'block', '__weakref__')
+
+    def __init__(self, handle, block):
+        self.handle = handle
+        self.block = block
+
+
+class HandleCache(object):
+    """
+    Opened IPC handles of a context, keyed by the handle bytes.
+
+    `opener(handle, size)` maps a handle.  An entry lives as long as
+    one of the objects returned by :meth:`open` for it, so handles are
+    only mapped once no matter how many arrays come from them.  If
+    given, `on_empty(cache)` is called when the last entry goes away.
+    """
+    def __init__(self, opener, on_empty=None):
+        self._opener = opener
+        self._on_empty = on_empty
+        self._maps = weakref.WeakValueDictionary()
+        self._live = set()
+        self._lock = threading.Lock()
+        self.opened = 0
+
+    def _released(self, ref):
+        # Runs from the garbage collector, so it takes no lock
+        self._live.discard(ref)
+        if not self._live and self._on_empty is not None:
+            self._on_empty(self)
+
+    def open(self, handle, size):
+        with self._lock:
+            m = self._maps.get(handle)
+            if m is None:
+                m = _Mapping(handle, self._opener(handle, size))
+                self._maps[handle] = m
+                self._live.add(weakref.ref(m, self._released))
+                self.opened += 1
+            return m
+
+    def empty(self):
+        """True if no entry is alive."""
+        return not self._live
+
+    def __contains__(self, handle):
+        return handle in self._maps
+
+    def __len__(self):
+        return len(self._maps)
+
+
+# Guards _caches and _contexts.  Reentrant since the last mapping of a
+# cache can die, and prune it, while the same thread holds it.
+_lock = threading.RLock()
+
+# Keyed by the context pointer, the cache keeps the context alive.
+# It is dropped when its last mapping goes away.
+_caches = {}
+# Caches that became empty, to drop at the next chance
+_empty = []
+
+
+def _flush():
+    # Called with _lock held
+    while _empty:
+        ptr, cache = _empty.pop()
+        if _caches.get(ptr) is cache and cache.empty():
+            del _caches[ptr]
+
+
+def _prune(ptr, cache):
+    # This runs from the garbage collector, which may interrupt a
+    # thread holding the lock of `cache` while another one holds _lock
+    # and waits for it, so it must not block.
+    _empty.append((ptr, cache))
+    if _lock.acquire(False):
+        try:
+            _flush()
+        finally:
+            _lock.release()
+
+
+def get_cache(context):
+    """Return the :class:`HandleCache` of `context`."""
+    with _lock:
+        _flush()
+        c = _caches.get(context.ptr)
+        if c is None:
+            def opener(handle, size, context=context):
+                return gpuarray.open_ipc_array(context, handle, size)
+
+            def on_empty(cache, ptr=context.ptr):
+                _prune(ptr, cache)
+            c = HandleCache(opener, on_empty)
+            _caches[context.ptr] = c
+        return c
+
+
+def _open(context, handle, size):
+    with _lock:
+        c = get_cache(context)
+        m = c.open(handle, size)
+        # The cache may have been pruned in between by the collector
+        _caches[context.ptr] = c
+        return m
+
+
+def export(a):
+    """Return the :class:`IpcDescriptor` of the GpuArray `a`."""
+    ctx = a.context
+    if ctx.kind != b'cuda':
+        raise ValueError("IPC is only supported on cuda")
+    base, size = a.get_ipc_range()
+    return IpcDescriptor(ctx.kind.decode('ascii'), ctx.devno, ctx.unique_id,
+                         a.get_ipc_handle(), size, base + a.offset,
+                         a.dtype.str, tuple(a.shape), tuple(a.strides))
+
+
+# Contexts made by the importer, keyed by unique_id
+_contexts = {}
+
+
+def _find_context(kind, devno, unique_id):
+    ctx = gpuarray.get_default_context()
+    if ctx is not None and ctx.kind.decode('ascii') == kind and \
+            ctx.unique_id == unique_id:
+        return ctx
+    with _lock:
+        ctx = _contexts.get(unique_id)
+        if ctx is not None:
+            return ctx
+        # The ordinals may differ between processes
+        # (CUDA_VISIBLE_DEVICES), so try the one of the exporter first
+        # and then all of them.
+        ndev = gpuarray.count_devices(kind, 0)
+        for d in [devno] + [i for i in range(ndev) if i != devno]:
+            if d >= ndev:
+                continue
+            ctx = gpuarray.init('%s%d' % (kind, d))
+            if ctx.unique_id == unique_id:
+                _contexts[unique_id] = ctx
+                return ctx
+    raise ValueError("No device with PCI bus id %s" % (unique_id,))
+
+
+def import_array(desc, context=None, cls=None):
+    """
+    Build an array from an :class:`IpcDescriptor` (or its bytes).
+
+    The array shares memory with the exported one.  If `context` is
+    not given, one for the same device is found or created.
+    """
+    if isinstance(desc, bytes):
+        desc = IpcDescriptor.from_bytes(desc)
+    desc.check()
+    if context is None:
+        context = _find_context(desc.kind, desc.devno, desc.unique_id)
+    elif context.unique_id != desc.unique_id:
+        raise ValueError("Context is not on the device of the array")
+    m = _open(context, desc.handle, desc.size)
+    return gpuarray._from_block(m.block, desc.offset,
+                                numpy.dtype(desc.dtype), desc.shape,
+                                desc.strides, m, cls)
+
+
+def _rebuild_array(data, cls):
+    return import_array(IpcDescriptor.from_bytes(data), cls=cls)
+
+
+def _reduce_array(a):
+    cls = type(a)
+    if cls is gpuarray.GpuArray:
+        cls = None
+    return _rebuild_array, (export(a).to_bytes(), cls)
+
+
+def _rebuild_context(kind, devno, unique_id):
+    return _find_context(kind, devno, unique_id)
+
+
+def _reduce_context(ctx):
+    return _rebuild_context, (ctx.kind.decode('ascii'), ctx.devno,
+                              ctx.unique_id)
+
+
+_registered = set()
+
+
+def _picklers():
+    from six.moves import copyreg
+    res = [copyreg.dispatch_table]
+    try:
+        from multiprocessing.reduction import ForkingPickler
+        res.append(ForkingPickler._extra_reducers)
+    except (ImportError, AttributeError):
+        pass
+    return res
+
+
+def enable_pickling(*classes):
+    """
+    Pickle GpuContext and the given GpuArray classes through IPC.
+
+    With no arguments this covers GpuArray and ndgpuarray.  Subclasses
+    have to be listed since pickle looks up reducers by exact type.
+    """
+    from ._array import ndgpuarray
+    if not classes:
+        classes = (gpuarray.GpuArray, ndgpuarray)
+    for table in _picklers():
+        table[gpuarray.GpuContext] = _reduce_context
+        for cls in classes:
+            table[cls] = _reduce_array
+    _registered.update(classes)
+
+
+def disable_pickling():
+    """Undo :func:`enable_pickling`."""
+    for table in _picklers():
+        table.pop(gpuarray.GpuContext, None)
+        for cls in _registered:
+            table.pop(cls, None)
+    _registered.clear()
@@ -7,7 +7,8 @@ import numpy
 
 from . import gpuarray
 from .tools import ScalarArg, ArrayArg, check_args, prod, lru_cache
-from .dtypes import parse_c_arg_backend
+from .dtypes import parse_c_arg_backend, dtype_to_ctype
+from .elemwise import complex_cast
 
 
 def parse_c_args(arguments):
@@ -179,7 +180,7 @@ class ReductionKernel(object):
         have_small = False
         have_double = False
         have_complex = False
-        for arg in self.arguments:
+        for arg in list(self.arguments) + [self.out_arg]:
             if arg.dtype.itemsize < 4 and type(arg) == ArrayArg:
                 have_small = True
             if arg.dtype in [numpy.float64, numpy.complex128]:
@@ -308,12 +309,31 @@ def reduce1(ary, op, neutral, out_type, axis=None, out=None, oper=None):
                 raise ValueError('axis out of bounds')
             redux[ax] = True
 
-    if oper is None:
+    map_expr = None
+    out_type = numpy.dtype(out_type)
+    if oper is None and out_type.kind == 'c':
+        ctype = dtype_to_ctype(out_type)
+        if op == '+':
+            reduce_expr = "%s_add(a, b)" % (ctype,)
+        elif op == '*':
+            reduce_expr = "%s_mul(a, b)" % (ctype,)
+        else:
+            raise TypeError("reduction %s is not supported for complex "
+                            "types" % (op,))
+        neutral = "%s_make(%s, 0)" % (ctype, neutral)
+        map_expr = complex_cast("a[i]", ary.dtype, out_type)
+    elif oper is None:
         reduce_expr = "a %s b" % (op,)
+        if ary.dtype.kind == 'c':
+            if op not in ('&&', '||'):
+                raise TypeError("complex input needs a complex output "
+                                "type for reduction %s" % (op,))
+            map_expr = "(a[i].r != 0 || a[i].i != 0)"
     else:
         reduce_expr = oper
 
     r = ReductionKernel(ary.context, dtype_out=out_type, neutral=neutral,
                         reduce_expr=reduce_expr, redux=redux,
+                        map_expr=map_expr,
                         arguments=[ArrayArg(ary.dtype, 'a')])
     return r(ary, out=out)
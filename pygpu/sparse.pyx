@@ -0,0 +1,292 @@
+"""
+Sparse matrices in CSR and COO formats.
+
+A :class:`SparseMatrix` holds three 1d GpuArrays (the values, their
+columns and either the row starts for CSR or the row of each value for
+COO) and a shape.  They can be built from arrays, from a 2d GpuArray
+(the conversion is done on the device) or from a :mod:`scipy.sparse`
+matrix, and multiplied with dense vectors and matrices::
+
+    from pygpu import sparse
+    m = sparse.from_scipy(scipy_matrix, context=ctx)
+    y = m.dot(x)
+
+The values must be float32 or float64 and the indices int32 or int64.
+"""
+import numpy
+
+from pygpu.gpuarray cimport (GpuContext, _GpuArray, GpuArray,
+                             ensure_context, get_exc, gpucontext_error,
+                             pygpu_fromgpudata, pygpu_empty, GA_C_ORDER,
+                             GA_NO_ERROR)
+from pygpu import gpuarray
+
+__all__ = ['SparseMatrix', 'csr_matrix', 'coo_matrix', 'from_dense',
+           'from_scipy', 'spmv', 'spmm']
+
+cdef extern from "gpuarray/sparse.h":
+    ctypedef struct _GpuSparse "GpuSparse":
+        _GpuArray data
+        _GpuArray indices
+        _GpuArray ptr
+        size_t rows
+        size_t cols
+        size_t nnz
+        size_t max_row
+        int format
+
+    ctypedef enum ga_sparse_format:
+        GA_SPARSE_CSR,
+        GA_SPARSE_COO
+
+    ctypedef enum ga_spmv_algo:
+        GA_SPMV_AUTO,
+        GA_SPMV_CSR_VECTOR,
+        GA_SPMV_MERGE_PATH,
+        GA_SPMV_COO
+
+    int GpuSparse_csr(_GpuSparse *s, const _GpuArray *data,
+                      const _GpuArray *indices, const _GpuArray *indptr,
+                      size_t rows, size_t cols)
+    int GpuSparse_coo(_GpuSparse *s, const _GpuArray *data,
+                      const _GpuArray *row, const _GpuArray *col,
+                      size_t rows, size_t cols)
+    int GpuSparse_from_dense(_GpuSparse *s, const _GpuArray *a, int format,
+                             int idxcode)
+    void GpuSparse_clear(_GpuSparse *s)
+    int GpuSparse_spmv_algo(const _GpuSparse *s)
+    int GpuSparse_spmv(double alpha, const _GpuSparse *s,
+                       const _GpuArray *x, double beta, _GpuArray *y,
+                       int algo)
+    int GpuSparse_spmm(double alpha, const _GpuSparse *s,
+                       const _GpuArray *B, double beta, _GpuArray *C)
+
+_formats = {'csr': GA_SPARSE_CSR, 'coo': GA_SPARSE_COO}
+_algos = {'auto': GA_SPMV_AUTO, 'csr_vector': GA_SPMV_CSR_VECTOR,
+          'merge_path': GA_SPMV_MERGE_PATH, 'coo': GA_SPMV_COO}
+_algo_names = dict((v, k) for k, v in _algos.items())
+
+
+cdef int sparse_check(GpuContext ctx, int err) except -1:
+    if err != GA_NO_ERROR:
+        raise get_exc(err), gpucontext_error(ctx.ctx, err)
+    return 0
+
+
+cdef GpuArray wrap_part(GpuContext ctx, _GpuArray *a):
+    return pygpu_fromgpudata(a.data, a.offset, a.typecode, a.nd,
+                             a.dimensions, a.strides, ctx, True, None, None)
+
+
+cdef class SparseMatrix:
+    """
+    A sparse matrix on the device.
+
+    Use :func:`csr_matrix`, :func:`coo_matrix`, :func:`from_dense` or
+    :func:`from_scipy` to build one.
+
+    `data`, `indices` and `ptr` share memory with the matrix.  For CSR
+    `ptr` holds the start of each row (scipy's `indptr`), for COO the
+    row of each value (scipy's `row`, `indices` being `col`).
+    """
+    cdef _GpuSparse sp
+    cdef readonly GpuContext context
+    cdef readonly GpuArray data
+    cdef readonly GpuArray indices
+    cdef readonly GpuArray ptr
+
+    def __dealloc__(self):
+        GpuSparse_clear(&self.sp)
+
+    cdef _wrap(self):
+        self.data = wrap_part(self.context, &self.sp.data)
+        self.indices = wrap_part(self.context, &self.sp.indices)
+        self.ptr = wrap_part(self.context, &self.sp.ptr)
+
+    property format:
+        "'csr' or 'coo'"
+        def __get__(self):
+            return 'csr' if self.sp.format == GA_SPARSE_CSR else 'coo'
+
+    property shape:
+        def __get__(self):
+            return (self.sp.rows, self.sp.cols)
+
+    property nnz:
+        "Number of stored values"
+        def __get__(self):
+            return self.sp.nnz
+
+    property dtype:
+        def __get__(self):
+            return self.data.dtype
+
+    property max_row:
+        "Number of values in the longest row (CSR only)"
+        def __get__(self):
+            return self.sp.max_row
+
+    property spmv_algo:
+        "Name of the kernel :meth:`dot` uses for vectors by default"
+        def __get__(self):
+            return _algo_names[GpuSparse_spmv_algo(&self.sp)]
+
+    def dot(self, x, out=None, alpha=1.0, beta=0.0, algo='auto'):
+        """
+        dot(x, out=None, alpha=1.0, beta=0.0, algo='auto')
+
+        Return `alpha * self . x + beta * out`.
+
+        `x` is a 1d or 2d GpuArray.  If `out` is None, a new array is
+        allocated and `beta` is ignored.  `algo` picks the kernel for
+        1d `x`, one of 'auto', 'csr_vector', 'merge_path' or 'coo'.
+        """
+        if x.ndim == 1:
+            return spmv(self, x, out, alpha, beta, algo)
+        return spmm(self, x, out, alpha, beta)
+
+    def to_scipy(self):
+        """Copy the matrix to the host as a :mod:`scipy.sparse` matrix."""
+        import scipy.sparse
+        data = numpy.asarray(self.data)
+        indices = numpy.asarray(self.indices)
+        ptr = numpy.asarray(self.ptr)
+        if self.sp.format == GA_SPARSE_CSR:
+            return scipy.sparse.csr_matrix((data, indices, ptr),
+                                           shape=self.shape)
+        return scipy.sparse.coo_matrix((data, (ptr, indices)),
+                                       shape=self.shape)
+
+    def __repr__(self):
+        return '<%dx%d sparse matrix of type %s with %d stored values in %s format>' % (
+            self.sp.rows, self.sp.cols, self.dtype, self.sp.nnz,
+            self.format.upper())
+
+
+cdef SparseMatrix new_sparse(GpuContext ctx):
+    cdef SparseMatrix res = SparseMatrix.__new__(SparseMatrix)
+    res.context = ctx
+    return res
+
+
+def csr_matrix(data, indices, indptr, shape, GpuContext context=None):
+    """
+    csr_matrix(data, indices, indptr, shape, context=None)
+
+    Build a CSR matrix from its arrays, as in :mod:`scipy.sparse`.
+
+    The arrays are copied to `context` unless they already are
+    GpuArrays.  `indptr` is read back once to compute the row
+    statistics used to pick the SpMV kernel.
+    """
+    cdef GpuArray d, i, p
+    cdef SparseMatrix res
+    if isinstance(data, GpuArray) and context is None:
+        context = data.context
+    context = ensure_context(context)
+    d = gpuarray.asarray(data, context=context)
+    i = gpuarray.asarray(indices, context=context)
+    p = gpuarray.asarray(indptr, context=context)
+    res = new_sparse(context)
+    sparse_check(context, GpuSparse_csr(&res.sp, &d.ga, &i.ga, &p.ga,
+                                        shape[0], shape[1]))
+    res._wrap()
+    return res
+
+
+def coo_matrix(data, row, col, shape, GpuContext context=None):
+    """
+    coo_matrix(data, row, col, shape, context=None)
+
+    Build a COO matrix from its arrays.  Duplicates are summed.
+    """
+    cdef GpuArray d, r, c
+    cdef SparseMatrix res
+    if isinstance(data, GpuArray) and context is None:
+        context = data.context
+    context = ensure_context(context)
+    d = gpuarray.asarray(data, context=context)
+    r = gpuarray.asarray(row, context=context)
+    c = gpuarray.asarray(col, context=context)
+    res = new_sparse(context)
+    sparse_check(context, GpuSparse_coo(&res.sp, &d.ga, &r.ga, &c.ga,
+                                        shape[0], shape[1]))
+    res._wrap()
+    return res
+
+
+def from_dense(GpuArray a, format='csr', index_dtype='int32'):
+    """
+    from_dense(a, format='csr', index_dtype='int32')
+
+    Build a sparse matrix from the non-zero values of the 2d array `a`.
+    """
+    cdef SparseMatrix res
+    res = new_sparse(a.context)
+    sparse_check(a.context,
+                 GpuSparse_from_dense(&res.sp, &a.ga, _formats[format],
+                                      gpuarray.dtype_to_typecode(index_dtype)))
+    res._wrap()
+    return res
+
+
+def from_scipy(m, GpuContext context=None, index_dtype=None):
+    """
+    from_scipy(m, context=None, index_dtype=None)
+
+    Copy a :mod:`scipy.sparse` matrix to the device.
+
+    COO matrices stay COO, all the other formats become CSR.  The
+    indices keep their type unless `index_dtype` is given.
+    """
+    if m.format == 'coo':
+        row, col = m.row, m.col
+        if index_dtype is not None:
+            row = row.astype(index_dtype)
+            col = col.astype(index_dtype)
+        return coo_matrix(m.data, row, col, m.shape, context=context)
+    m = m.tocsr()
+    indices, indptr = m.indices, m.indptr
+    if index_dtype is not None:
+        indices = indices.astype(index_dtype)
+        indptr = indptr.astype(index_dtype)
+    return csr_matrix(m.data, indices, indptr, m.shape, context=context)
+
+
+def spmv(SparseMatrix m, GpuArray x, GpuArray out=None, double alpha=1.0,
+         double beta=0.0, algo='auto'):
+    """
+    spmv(m, x, out=None, alpha=1.0, beta=0.0, algo='auto')
+
+    Compute `alpha * m . x + beta * out` with `x` a vector.
+    """
+    cdef size_t dims[1]
+    if out is None:
+        dims[0] = m.sp.rows
+        out = pygpu_empty(1, dims, x.ga.typecode, GA_C_ORDER, m.context,
+                          None)
+        beta = 0.0
+    sparse_check(m.context, GpuSparse_spmv(alpha, &m.sp, &x.ga, beta,
+                                           &out.ga, _algos[algo]))
+    return out
+
+
+def spmm(SparseMatrix m, GpuArray b, GpuArray out=None, double alpha=1.0,
+         double beta=0.0):
+    """
+    spmm(m, b, out=None, alpha=1.0, beta=0.0)
+
+    Compute `alpha * m . b + beta * out` with `b` a matrix.
+    """
+    cdef size_t dims[2]
+    if b.ga.nd != 2:
+        raise ValueError("b must be 2d")
+    if out is None:
+        dims[0] = m.sp.rows
+        dims[1] = b.ga.dimensions[1]
+        out = pygpu_empty(2, dims, b.ga.typecode, GA_C_ORDER, m.context,
+                          None)
+        beta = 0.0
+    sparse_check(m.context, GpuSparse_spmm(alpha, &m.sp, &b.ga, beta,
+                                           &out.ga))
+    return out
@@ -13,6 +13,7 @@ try:
 except ImportError as e:
     raise SkipTest("no scipy blas to compare against")
 
+from pygpu import gpuarray
 import pygpu.blas as gblas
 
 
@@ -144,6 +145,50 @@ def gemm(m, n, k, dtype, order, trans, offseted_o, sliced, overwrite,
     numpy.testing.assert_allclose(cr, numpy.asarray(gr), rtol=1e-6)
 
 
+def test_gemm_complex():
+    for dtype, order, trans in product(['complex64', 'complex128'],
+                                       product('fc', 'fc'),
+                                       product([False, True, 'c'],
+                                               [False, 'c'])):
+        yield gemm_complex, dtype, order, trans
+
+
+def _op(a, trans):
+    if trans == 'c':
+        return a.T.conj()
+    if trans:
+        return a.T
+    return a
+
+
+def _gen_complex(shp, dtype, order):
+    c = (numpy.random.uniform(-1, 1, shp) +
+         1j * numpy.random.uniform(-1, 1, shp)).astype(dtype)
+    g = gpuarray.array(c, context=context)
+    if order == 'f':
+        c = numpy.asfortranarray(c)
+        g = gpuarray.asfortranarray(g)
+    return c, g
+
+
+@guard_devsup
+def gemm_complex(dtype, order, trans):
+    m, n, k = 7, 5, 6
+    cA, gA = _gen_complex((k, m) if trans[0] else (m, k), dtype, order[0])
+    cB, gB = _gen_complex((n, k) if trans[1] else (k, n), dtype, order[1])
+
+    cr = 0.5 * numpy.dot(_op(cA, trans[0]), _op(cB, trans[1]))
+    gr = gblas.gemm(0.5, gA, gB, 0.0, trans_a=trans[0], trans_b=trans[1])
+
+    numpy.testing.assert_allclose(cr, numpy.asarray(gr), rtol=1e-5)
+
+    cv, gv = _gen_complex((k,), dtype, 'c')
+    cr = numpy.dot(_op(cA, trans[0]), cv)
+    gr = gblas.gemv(1.0, gA, gv, trans_a=trans[0])
+
+    numpy.testing.assert_allclose(cr, numpy.asarray(gr), rtol=1e-5)
+
+
 def test_ger():
     bools = [False, True]
     for (m, n), order, sliced_x, sliced_y in product(
@@ -5,7 +5,7 @@ from mako.template import Template
 from unittest import TestCase
 from pygpu import gpuarray, ndgpuarray as elemary
 from pygpu.dtypes import dtype_to_ctype, get_common_dtype
-from pygpu.elemwise import as_argument, ielemwise2
+from pygpu.elemwise import as_argument, ielemwise2, elemwise_multi
 from pygpu._elemwise import GpuElemwise, arg
 
 from six import PY2
@@ -269,6 +269,61 @@ def divmod_mixed(dtype, shape, elem):
     assert numpy.allclose(out_c[1], numpy.asarray(out_g[1]))
 
 
+@guard_devsup
+def test_elemwise_multi():
+    ac, ag = gen_gpuarray((3, 5), 'float32', ctx=context)
+    bc, bg = gen_gpuarray((5,), 'float32', ctx=context)
+
+    s, c = elemwise_multi([('a', ag), ('b', bg)],
+                          [('s', None), ('c', 'float32')],
+                          "t = a + b; s = sin(t); c = cos(t)",
+                          temps=[('t', 'float32')], broadcast=True)
+    assert s.shape == (3, 5)
+    assert s.dtype == numpy.float32
+    assert numpy.allclose(numpy.asarray(s), numpy.sin(ac + bc), atol=1e-6)
+    assert numpy.allclose(numpy.asarray(c), numpy.cos(ac + bc), atol=1e-6)
+
+    # Outputs provided in out are reused, the others are allocated
+    s2, c2 = elemwise_multi([('a', ag), ('x', 2)],
+                            [('s', None), ('c', 'float32')],
+                            "s = a * x; c = a - x", out=(s, None))
+    assert s2 is s
+    assert c2 is not c
+    assert numpy.allclose(numpy.asarray(s2), ac * 2)
+    assert numpy.allclose(numpy.asarray(c2), ac - 2)
+
+
+@guard_devsup
+def test_divmod_out():
+    ac, ag = gen_gpuarray((50,), 'float32', ctx=context, cls=elemary)
+    bc, bg = gen_gpuarray((50,), 'float32', nozeros=True, ctx=context,
+                          cls=elemary)
+    d = gpuarray.empty((50,), dtype='float32', context=context)
+    m = gpuarray.empty((50,), dtype='float32', context=context)
+
+    res = ag.divmod(bg, out=(d, m))
+    assert res[0] is d
+    assert res[1] is m
+    out_c = divmod(ac, bc)
+    assert numpy.allclose(out_c[0], numpy.asarray(d))
+    assert numpy.allclose(out_c[1], numpy.asarray(m))
+
+
+@guard_devsup
+def test_modf():
+    for dtype in ['float32', 'float64', 'int16']:
+        c, g = gen_gpuarray((50,), dtype, ctx=context, cls=elemary)
+        if dtype != 'int16':
+            c = c * 3.7
+            g = gpuarray.array(c, context=context, cls=elemary)
+        out_c = numpy.modf(c)
+        out_g = g.modf()
+        assert out_c[0].dtype == out_g[0].dtype
+        assert out_c[1].dtype == out_g[1].dtype
+        assert numpy.allclose(out_c[0], numpy.asarray(out_g[0]))
+        assert numpy.allclose(out_c[1], numpy.asarray(out_g[1]))
+
+
 def test_elemwise_bool():
     a = gpuarray.empty((2,), context=context)
     exc = None
@@ -307,6 +362,24 @@ def broadcast(shapea, shapeb):
     check_meta_content(rg, rc)
 
 
+def test_specialize():
+    ac, ag = gen_gpuarray((3, 4), 'float32', sliced=2, ctx=context)
+    bc, bg = gen_gpuarray((3, 4), 'float32', order='f', ctx=context)
+    args = [arg('a', ag.dtype, read=True), arg('b', bg.dtype, read=True),
+            arg('c', ag.dtype, write=True)]
+    k = GpuElemwise(context, 'c = a + b', args, specialize=2)
+    for _ in range(4):
+        cg = gpuarray.zeros((3, 4), dtype='float32', context=context)
+        k(ag, bg, cg)
+        assert numpy.array_equal(numpy.asarray(cg), ac + bc)
+    # A shape that wasn't specialised
+    ac, ag = gen_gpuarray((4, 3), 'float32', sliced=2, ctx=context)
+    bc, bg = gen_gpuarray((4, 3), 'float32', order='f', ctx=context)
+    cg = gpuarray.zeros((4, 3), dtype='float32', context=context)
+    k(ag, bg, cg)
+    assert numpy.array_equal(numpy.asarray(cg), ac + bc)
+
+
 _inf_preamb_tpl = Template('''
 WITHIN_KERNEL ${flt}
 infinity() {return INFINITY;}
@@ -339,3 +412,44 @@ def test_infinity():
                              preamble=preamble)
         kernel(out_g)
         assert numpy.array_equal(ac, numpy.asarray(out_g))
+
+
+def _gen_complex(shape, dtype):
+    c = (numpy.random.uniform(-10, 10, shape) +
+         1j * numpy.random.uniform(-10, 10, shape)).astype(dtype)
+    return c, gpuarray.array(c, context=context, cls=elemary)
+
+
+def test_elemwise_complex():
+    for dtype in ['complex64', 'complex128']:
+        yield elemwise_complex, dtype
+
+
+@guard_devsup
+def elemwise_complex(dtype):
+    ca, ga = _gen_complex((50,), dtype)
+    cb, gb = _gen_complex((50,), dtype)
+    cr, gr = gen_gpuarray((50,), 'float32', ctx=context, cls=elemary)
+
+    for op in [operator.add, operator.sub, operator.mul, operator.truediv]:
+        for b_c, b_g in [(cb, gb), (cr, gr), (2, 2), (1.5 - 2j, 1.5 - 2j)]:
+            out_c = op(ca, b_c)
+            out_g = op(ga, b_g)
+            assert out_c.dtype == out_g.dtype
+            assert numpy.allclose(out_c, numpy.asarray(out_g), rtol=1e-5)
+
+    for op in [operator.neg, operator.pos, operator.abs]:
+        out_c = op(ca)
+        out_g = op(ga)
+        assert out_c.dtype == out_g.dtype
+        assert numpy.allclose(out_c, numpy.asarray(out_g), rtol=1e-5)
+
+    assert numpy.asarray(ga == ga).all()
+    assert not numpy.asarray(ga != ga).any()
+    assert numpy.array_equal(ca == cb, numpy.asarray(ga == gb))
+
+    ga += gb
+    ca += cb
+    ga *= 2
+    ca *= 2
+    assert numpy.allclose(ca, numpy.asarray(ga), rtol=1e-5)
@@ -9,6 +9,7 @@ import pickle
 import numpy
 
 from nose.tools import assert_raises
+from nose.plugins.skip import SkipTest
 import pygpu
 from pygpu.gpuarray import GpuArray, GpuKernel
 
@@ -400,10 +401,173 @@ class WriteReadTest(unittest.TestCase):
         self.assertRaises(ValueError, self.gpu.read, self.cpu)
         self.cpu = numpy.ndarray((3, 4, 5), dtype="float64", order='C')
         self.assertRaises(ValueError, self.gpu.read, self.cpu)
-        self.cpu = numpy.ndarray((3, 4, 5), dtype="float32", order='F')
+        self.cpu = numpy.ndarray((2, 10), dtype="float32", order='F')
         self.assertRaises(ValueError, self.gpu.read, self.cpu)
-        self.cpu = numpy.ndarray((3, 4, 2, 5), dtype="float32", order='C')
-        self.assertRaises(ValueError, self.gpu.read, self.cpu[:, :, 0, :])
+
+    def test_read_strided(self):
+        ref = numpy.asarray(self.gpu)
+        cpu = numpy.zeros((3, 4, 5), dtype="float32", order='F')
+        self.gpu.read(cpu)
+        assert numpy.all(cpu == ref)
+        cpu = numpy.zeros((3, 4, 2, 5), dtype="float32", order='C')
+        self.gpu.read(cpu[:, :, 0, :])
+        assert numpy.all(cpu[:, :, 0, :] == ref)
+        assert numpy.all(cpu[:, :, 1, :] == 0)
+
+        for sl in [(slice(None), slice(1, 3)),
+                   (slice(None, None, -1), slice(None), slice(None, None, 2)),
+                   (0, slice(None), slice(3, 4))]:
+            cpu = numpy.zeros(ref[sl].shape, dtype="float32")
+            self.gpu[sl].read(cpu)
+            assert numpy.all(cpu == ref[sl])
+            cpu = numpy.zeros(ref[sl].shape[::-1], dtype="float32").T
+            self.gpu[sl].read(cpu)
+            assert numpy.all(cpu == ref[sl])
+
+        a = numpy.random.random((2, 3, 4, 5, 6)).astype('float32')
+        g = pygpu.array(a, context=ctx)
+        cpu = numpy.zeros((2, 4, 6, 3, 5), dtype='float32')
+        g.transpose(0, 2, 4, 1, 3).read(cpu)
+        assert numpy.all(cpu == a.transpose(0, 2, 4, 1, 3))
+
+    def test_write_strided(self):
+        src = numpy.random.random((3, 4, 10)).astype('float32')
+        for sl in [(slice(None), slice(1, 3)),
+                   (slice(None, None, -1), slice(None), slice(None, None, 2)),
+                   (0, slice(None), slice(3, 4))]:
+            gpu = pygpu.zeros((3, 4, 5), dtype='float32', context=ctx)
+            ref = numpy.zeros((3, 4, 5), dtype='float32')
+            s = src[..., ::2][sl]
+            gpu[sl].write(s)
+            ref[sl] = s
+            assert numpy.all(numpy.asarray(gpu) == ref)
+
+        a = numpy.random.random((2, 3, 4, 5, 6)).astype('float32')
+        g = pygpu.zeros((2, 4, 6, 3, 5), dtype='float32', context=ctx)
+        g.write(a.transpose(0, 2, 4, 1, 3))
+        assert numpy.all(numpy.asarray(g) == a.transpose(0, 2, 4, 1, 3))
+
+
+def test_kernel_args():
+    k = GpuKernel("#include \"cluda.h\"\n"
+                  "KERNEL void k(GLOBAL_MEM ga_double *out, ga_ubyte a, "
+                  "ga_short b, ga_uint c, ga_long d, ga_ulong e, "
+                  "ga_float f, ga_double g) {"
+                  "if (LID_0 == 0 && GID_0 == 0) {"
+                  "out[0] = a; out[1] = b; out[2] = c; out[3] = d;"
+                  "out[4] = e; out[5] = f; out[6] = g;}}", "k",
+                  [GpuArray, 'uint8', 'int16', 'uint32', 'int64', 'uint64',
+                   'float32', 'float64'], context=ctx, have_double=True,
+                  have_small=True)
+    out = pygpu.zeros((7,), dtype='float64', context=ctx)
+    vals = (200, -3, 70000, -(1 << 40), 1 << 41, 1.5, 0.25)
+    k(out, *vals, n=1)
+    assert numpy.all(numpy.asarray(out) == vals)
+
+    out2 = pygpu.zeros((7,), dtype='float64', context=ctx)
+    args = (out2,) + vals
+    k.launch(args, 1)
+    k.launch(args, 1)
+    assert numpy.all(numpy.asarray(out2) == vals)
+
+    assert_raises(TypeError, k.launch, args[:-1], 1)
+    assert_raises(TypeError, k.launch, (numpy.zeros(7),) + vals, 1)
+    assert_raises(OverflowError, k, out, 256, *vals[1:], n=1)
+
+    # Arguments that changed since the last call are set again
+    out.write(numpy.zeros((7,)))
+    k(out, *vals, n=1)
+    assert numpy.all(numpy.asarray(out) == vals)
+
+    g = numpy.array(0.5)
+    sizes = (1,)
+    k(out2, *(vals[:-1] + (g,)), gs=sizes, ls=sizes)
+    g[()] = 8.5
+    k(out2, *(vals[:-1] + (g,)), gs=sizes, ls=sizes)
+    assert numpy.asarray(out2)[6] == 8.5
+
+
+def test_dlpack():
+    if ctx.kind != b'cuda':
+        raise SkipTest("DLPack is only supported on cuda")
+    for shp in [(), (5,), (6, 7), (4, 8, 9)]:
+        for dtype in dtypes_all:
+            for offseted in [True, False]:
+                yield dlpack, shp, dtype, offseted
+
+
+def dlpack(shp, dtype, offseted):
+    a, b = gen_gpuarray(shp, dtype, offseted, ctx=ctx)
+    assert b.__dlpack_device__() == (2, ctx.devno)
+    c = pygpu.gpuarray.from_dlpack(b, context=ctx)
+    assert c.shape == b.shape
+    assert c.strides == b.strides
+    assert c.dtype == b.dtype
+    assert c.gpudata == b.gpudata
+    del b
+    assert numpy.allclose(numpy.asarray(c), a)
+
+
+def test_cuda_array_interface():
+    if ctx.kind != b'cuda':
+        raise SkipTest("__cuda_array_interface__ is only supported on cuda")
+    a, b = gen_gpuarray((4, 8, 9), 'float32', True, sliced=2, ctx=ctx)
+    cai = b.__cuda_array_interface__
+    assert cai['version'] == 3
+    assert cai['shape'] == b.shape
+    assert cai['strides'] == b.strides
+    assert cai['data'] == (b.gpudata, False)
+    assert numpy.dtype(cai['typestr']) == b.dtype
+
+
+def test_managed():
+    if ctx.kind != b'cuda':
+        raise SkipTest("Managed memory is only supported on cuda")
+    a = numpy.arange(24, dtype='float32').reshape(4, 6)
+    b = pygpu.empty(a.shape, dtype='float32', context=ctx, managed=True)
+    b[...] = a
+    b.advise('preferred_location', 'device')
+    b.prefetch('host')
+    v = b.host_view()
+    assert v.shape == b.shape
+    assert v.strides == b.strides
+    assert numpy.all(v == a)
+    v[1] = -1
+    b.prefetch('device')
+    assert numpy.all(numpy.asarray(b)[1] == -1)
+    assert numpy.all(b[:, ::2].host_view() == v[:, ::2])
+
+    c = pygpu.empty((3,), dtype='float32', context=ctx)
+    assert_raises(ValueError, c.host_view)
+    assert_raises(ValueError, b.prefetch, 'nowhere')
+    assert_raises(ValueError, b.advise, 'sometimes')
+
+
+def test_trim_cache():
+    before = ctx.cache_reclaimed
+    a = pygpu.empty((1024, 1024), dtype='float32', context=ctx)
+    del a
+    freed = ctx.trim_cache()
+    assert ctx.cache_reclaimed == before + freed
+    assert ctx.trim_cache() == 0
+
+
+def test_memory_stats():
+    if ctx.kind != b'cuda':
+        raise SkipTest("Allocator statistics are only available on cuda")
+    before = ctx.memory_stats()
+    a = pygpu.empty((1000,), dtype='float32', context=ctx)
+    st = ctx.memory_stats()
+    assert st['in_use'] >= before['in_use'] + 4000
+    assert st['blocks'] == before['blocks'] + 1
+    assert st['peak'] >= st['in_use']
+    assert st['reserved'] == st['in_use'] + st['cached']
+    del a
+    st = ctx.memory_stats()
+    assert st['blocks'] == before['blocks']
+    if st['cached'] != 0:
+        assert 0 < st['largest_free'] <= st['cached']
+        assert sum(st['free_buckets'].values()) > 0
 
 
 def test_copy_view():
@@ -753,6 +917,69 @@ def do_take1(shp, idx, offseted):
     check_content(rg, rc)
 
 
+def test_fancy_getitem():
+    idx = numpy.asarray([3, 0, -1, 2])
+    idx2 = numpy.asarray([[1, 0], [2, 1]])
+    yield fancy_getitem, (5, 4, 3), ([1, 0, 4],), False
+    yield fancy_getitem, (5, 4, 3), (idx,), True
+    yield fancy_getitem, (5, 4, 3), (slice(None), [3, 0]), False
+    yield fancy_getitem, (5, 4, 3), (slice(1, None), idx2), True
+    yield fancy_getitem, (5, 4, 3), (idx2, idx2), False
+    yield fancy_getitem, (5, 4, 3), (idx2, slice(None), [0, 2]), True
+    yield fancy_getitem, (5, 4, 3), (1, slice(None), [0, 2]), False
+    yield fancy_getitem, (5, 4, 3), (Ellipsis, [2, 0]), False
+    yield fancy_getitem, (5, 4, 3), ([True, False, True, False, True],), True
+
+
+def fancy_getitem(shp, key, offseted):
+    c, g = gen_gpuarray(shp, dtype='float32', offseted_outer=offseted,
+                        ctx=ctx)
+    assert g[key].shape == c[key].shape
+    check_content(g[key], c[key])
+    # The index can also live on the device
+    gkey = tuple(pygpu.asarray(k, context=ctx)
+                 if isinstance(k, (list, numpy.ndarray)) and
+                 numpy.asarray(k).dtype != numpy.bool_ else k
+                 for k in key)
+    check_content(g[gkey], c[key])
+
+
+def test_fancy_getitem_errors():
+    c, g = gen_gpuarray((5, 4), dtype='float32', ctx=ctx)
+    assert_raises(IndexError, g.__getitem__, ([5],))
+    assert_raises(IndexError, g.__getitem__, ([-6],))
+    assert_raises(IndexError, g.__getitem__, ([0, 1], [0, 1, 2]))
+    assert_raises(IndexError, g.__getitem__, ([0.5],))
+    # 64-bit indices must not wrap around when offsets are 32-bit
+    big = pygpu.asarray(numpy.array([2**32 + 1], dtype='int64'), context=ctx)
+    assert_raises(IndexError, g.__getitem__, (big,))
+    assert_raises(IndexError, g.__getitem__, (big, [0]))
+    # Unsigned indices are not negative ones wrapped around
+    huge = numpy.array([2**64 - 1], dtype='uint64')
+    assert_raises(IndexError, g.__getitem__, huge)
+    assert_raises(IndexError, g.__getitem__, (huge,))
+    assert_raises(IndexError, g.__getitem__,
+                  pygpu.asarray(huge, context=ctx))
+
+
+def test_fancy_setitem():
+    yield fancy_setitem, (5, 4, 3), ([1, 0, 4],), 2
+    yield fancy_setitem, (5, 4, 3), (slice(None), [3, 0]), 'same'
+    yield fancy_setitem, (5, 4, 3), ([[1, 0], [2, 1]], slice(None), [0, 2]), 'same'
+    yield fancy_setitem, (5, 4, 3), (1, slice(None), [0, 2]), 'row'
+
+
+def fancy_setitem(shp, key, val):
+    c, g = gen_gpuarray(shp, dtype='float32', ctx=ctx)
+    if val == 'same':
+        val = numpy.random.rand(*c[key].shape).astype('float32')
+    elif val == 'row':
+        val = numpy.random.rand(c[key].shape[-1]).astype('float32')
+    c[key] = val
+    g[key] = val
+    check_content(g, c)
+
+
 def test_flags():
     for fl in ['C', 'F', 'W', 'B', 'O', 'A', 'U', 'CA', 'FA', 'FNC', 'FORC',
                'CARRAY', 'FARRAY', 'FORTRAN', 'BEHAVED', 'OWNDATA', 'ALIGNED',
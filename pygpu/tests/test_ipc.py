@@ -0,0 +1,202 @@
+import gc
+import pickle
+
+import numpy
+
+from nose.tools import assert_raises
+from nose.plugins.skip import SkipTest
+
+from pygpu import gpuarray
+from pygpu.ipc import IpcDescriptor, HandleCache
+
+
+def make_desc(**kw):
+    d = dict(kind='cuda', devno=1, unique_id='0000:82:00.0',
+             handle=bytes(bytearray(range(64))), size=4096, offset=256,
+             dtype='<f4', shape=(3, 4), strides=(16, 4))
+    d.update(kw)
+    return IpcDescriptor(**d)
+
+
+def test_descriptor_roundtrip():
+    for kw in [{}, dict(shape=(), strides=()),
+               dict(shape=(2, 3), strides=(4, 8), dtype='<i8'),
+               dict(shape=(5,), strides=(-4,), offset=16)]:
+        d = make_desc(**kw)
+        b = d.to_bytes()
+        assert isinstance(b, bytes)
+        assert IpcDescriptor.from_bytes(b) == d
+        assert pickle.loads(pickle.dumps(d)) == d
+
+
+def test_descriptor_bad():
+    b = make_desc().to_bytes()
+    assert_raises(ValueError, IpcDescriptor.from_bytes, b[:10])
+    assert_raises(ValueError, IpcDescriptor.from_bytes, b[:-1])
+    assert_raises(ValueError, IpcDescriptor.from_bytes, b + b'\0')
+    assert_raises(ValueError, IpcDescriptor.from_bytes, b'XXXXX' + b[5:])
+    assert_raises(ValueError, IpcDescriptor.from_bytes,
+                  b[:5] + b'\x63' + b[6:])
+
+
+def test_descriptor_check():
+    make_desc().check()
+    make_desc(shape=(0, 4), offset=5000).check()
+    make_desc(offset=4096 - 48).check()
+    assert_raises(ValueError, make_desc(offset=4096 - 47).check)
+    make_desc(shape=(5,), strides=(-4,), offset=16).check()
+    assert_raises(ValueError,
+                  make_desc(shape=(5,), strides=(-4,), offset=15).check)
+
+
+class Block(object):
+    closed = 0
+
+    def __del__(self):
+        Block.closed += 1
+
+
+def test_handle_cache():
+    calls = []
+
+    def opener(handle, size):
+        calls.append((handle, size))
+        return Block()
+
+    c = HandleCache(opener)
+    Block.closed = 0
+    m1 = c.open(b'a', 10)
+    m2 = c.open(b'a', 10)
+    m3 = c.open(b'b', 20)
+    assert m1 is m2
+    assert calls == [(b'a', 10), (b'b', 20)]
+    assert len(c) == 2 and c.opened == 2
+
+    del m1
+    gc.collect()
+    assert b'a' in c
+    del m2
+    gc.collect()
+    assert b'a' not in c
+    assert Block.closed == 1
+
+    # Reopened once released
+    m1 = c.open(b'a', 10)
+    assert len(calls) == 3
+    del m1, m3
+    gc.collect()
+    assert len(c) == 0
+    assert Block.closed == 3
+
+
+def test_handle_cache_empty():
+    emptied = []
+    c = HandleCache(lambda handle, size: Block(), emptied.append)
+    m1 = c.open(b'a', 10)
+    m2 = c.open(b'b', 10)
+    assert not c.empty()
+    del m1
+    gc.collect()
+    assert emptied == []
+    del m2
+    gc.collect()
+    assert emptied == [c]
+    assert c.empty()
+
+
+def test_caches_pruned():
+    from pygpu import ipc
+
+    class Ctx(object):
+        ptr = 1234
+
+    c = ipc.get_cache(Ctx())
+    assert ipc._caches[1234] is c
+    c._opener = lambda handle, size: Block()
+    m = c.open(b'a', 10)
+    assert ipc.get_cache(Ctx()) is c
+    del m
+    gc.collect()
+    assert 1234 not in ipc._caches
+
+
+def test_pickling_opt_in():
+    from pygpu import ipc
+    from pygpu._array import ndgpuarray
+    from six.moves import copyreg
+    assert gpuarray.GpuArray not in copyreg.dispatch_table
+    ipc.enable_pickling()
+    try:
+        for cls in (gpuarray.GpuArray, ndgpuarray, gpuarray.GpuContext):
+            assert cls in copyreg.dispatch_table
+    finally:
+        ipc.disable_pickling()
+    assert gpuarray.GpuArray not in copyreg.dispatch_table
+    assert gpuarray.GpuContext not in copyreg.dispatch_table
+
+
+def test_export():
+    from .support import context
+    from pygpu import ipc
+    if context.kind != b'cuda':
+        raise SkipTest("IPC is only supported on cuda")
+    a = gpuarray.array(numpy.arange(48, dtype='float32').reshape(6, 8),
+                       context=context)
+    b = a[1:, 2::2]
+    d = ipc.export(b)
+    assert d.shape == b.shape
+    assert d.strides == b.strides
+    assert d.dtype == '<f4'
+    assert d.unique_id == context.unique_id
+    assert d.handle == a.get_ipc_handle()
+    assert d.offset - ipc.export(a).offset == b.offset - a.offset
+    d.check()
+    # Can't open our own handle, but the pickle must at least be built
+    ipc.enable_pickling()
+    try:
+        assert len(pickle.dumps(b)) > 0
+    finally:
+        ipc.disable_pickling()
+
+
+def _ipc_child(data, queue):
+    from pygpu import ipc
+    try:
+        a = ipc.import_array(data)
+        h = numpy.asarray(a)
+        queue.put(h.tolist())
+        a[...] = h * 2
+        # Make sure the write landed before the parent reads
+        a.sync()
+        del a
+        queue.put(None)
+    except Exception as e:
+        queue.put(repr(e))
+
+
+def test_two_process_roundtrip():
+    import multiprocessing
+    from .support import context
+    from pygpu import ipc
+    if context.kind != b'cuda':
+        raise SkipTest("IPC is only supported on cuda")
+    try:
+        mp = multiprocessing.get_context('spawn')
+    except (AttributeError, ValueError):
+        raise SkipTest("needs the spawn start method")
+    a = gpuarray.array(numpy.arange(48, dtype='float32').reshape(6, 8),
+                       context=context)
+    b = a[1:, 2::2]
+    ref = numpy.asarray(b)
+    queue = mp.Queue()
+    p = mp.Process(target=_ipc_child, args=(ipc.export(b).to_bytes(), queue))
+    p.start()
+    try:
+        assert queue.get(timeout=60) == ref.tolist()
+        assert queue.get(timeout=60) is None
+    finally:
+        p.join(60)
+    assert p.exitcode == 0
+    numpy.testing.assert_equal(numpy.asarray(b), ref * 2)
+    # Only the view was touched
+    numpy.testing.assert_equal(numpy.asarray(a[0]), numpy.arange(8))
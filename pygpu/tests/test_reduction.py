@@ -105,6 +105,32 @@ def reduction_op(op, dtype, axis):
     check_meta_content(outg, outc)
 
 
+def test_reduction_complex():
+    for dtype in ['complex64', 'complex128']:
+        for axis in [None, 0, 1]:
+            yield reduction_complex, dtype, axis
+
+
+@guard_devsup
+def reduction_complex(dtype, axis):
+    c = (numpy.random.uniform(0, 2, (2, 3)) +
+         1j * numpy.random.uniform(0, 2, (2, 3))).astype(dtype)
+    g = gpuarray.array(c, context=context, cls=elemary)
+
+    for op in ['sum', 'prod']:
+        rc = getattr(c, op)(axis=axis)
+        rg = getattr(g, op)(axis=axis)
+        assert rc.dtype == rg.dtype
+        assert numpy.allclose(rc, numpy.asarray(rg), rtol=1e-5)
+
+    c[0] = 0
+    g = gpuarray.array(c, context=context, cls=elemary)
+    for op in ['all', 'any']:
+        rc = getattr(c, op)(axis=axis)
+        rg = getattr(g, op)(axis=axis)
+        assert numpy.array_equal(rc, numpy.asarray(rg))
+
+
 def test_reduction_wrong_type():
     c, g = gen_gpuarray((2, 3), dtype='float32', ctx=context, cls=elemary)
     out1 = gpuarray.empty((2, 3), dtype='int32', context=context)
@@ -141,3 +167,27 @@ def test_reduction_f16():
     c, g = gen_gpuarray((3,), dtype='float16', ctx=context, cls=elemary)
 
     assert_raises(NotImplementedError, g.sum)
+
+
+def test_maxandargmax():
+    for axes in [[0], [1], [2], [2, 0], [0, 1, 2]]:
+        yield maxandargmax, 'float32', (8, 5, 10), axes
+
+
+@guard_devsup
+def maxandargmax(dtype, shape, axes):
+    c, g = gen_gpuarray(shape, dtype, ctx=context)
+    # Move the reduced axes last, in order, and flatten them
+    keep = [i for i in range(len(shape)) if i not in axes]
+    t = c.transpose(keep + axes).reshape(
+        [shape[i] for i in keep] + [-1])
+
+    rmax, rarg = gpuarray.maxandargmax(g, axes)
+
+    assert rmax.shape == t.shape[:-1]
+    assert rarg.dtype == numpy.dtype('int64')
+    assert numpy.array_equal(numpy.asarray(rmax), t.max(axis=-1))
+    assert numpy.array_equal(numpy.asarray(rarg), t.argmax(axis=-1))
+
+    assert_raises(ValueError, gpuarray.maxandargmax, g, [])
+    assert_raises(ValueError, gpuarray.maxandargmax, g, [0, 0])
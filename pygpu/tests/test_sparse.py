@@ -0,0 +1,149 @@
+from itertools import product
+
+import numpy
+from nose.plugins.skip import SkipTest
+
+from .support import (guard_devsup, gen_gpuarray, context)
+
+from pygpu import gpuarray, sparse
+
+
+def rand_sparse(shape, dtype, long_row=False):
+    rng = numpy.random.RandomState(42)
+    a = rng.uniform(-1, 1, size=shape).astype(dtype)
+    a[rng.uniform(size=shape) > (0.01 if long_row else 0.1)] = 0
+    a[::7] = 0
+    if long_row:
+        a[3] = rng.uniform(1, 2, size=shape[1])
+    return a
+
+
+def test_spmv():
+    for fmt, dtype, long_row, sliced in product(
+            ['csr', 'coo'], ['float32', 'float64'], [False, True], [1, -2]):
+        yield spmv, fmt, dtype, 'int32', long_row, sliced
+    yield spmv, 'csr', 'float32', 'int64', True, 1
+    for algo in ['csr_vector', 'merge_path']:
+        yield spmv, 'csr', 'float32', 'int32', False, 1, algo
+
+
+@guard_devsup
+def spmv(fmt, dtype, idx, long_row, sliced, algo='auto'):
+    a = rand_sparse((300, 2000) if long_row else (300, 200), dtype, long_row)
+    ga = gpuarray.array(a, context=context)
+    m = sparse.from_dense(ga, format=fmt, index_dtype=idx)
+    assert m.format == fmt
+    assert m.shape == a.shape
+    assert m.nnz == numpy.count_nonzero(a)
+    if fmt == 'coo':
+        assert m.spmv_algo == 'coo'
+    elif long_row:
+        assert m.spmv_algo == 'merge_path'
+    else:
+        assert m.spmv_algo == 'csr_vector'
+
+    cx, gx = gen_gpuarray((a.shape[1],), dtype, sliced=sliced, ctx=context)
+    cy, gy = gen_gpuarray((a.shape[0],), dtype, sliced=sliced, ctx=context)
+    rtol = 1e-4 if dtype == 'float32' else 1e-10
+
+    r = m.dot(gx, algo=algo)
+    numpy.testing.assert_allclose(numpy.asarray(r), a.dot(cx), rtol=rtol,
+                                  atol=rtol)
+
+    sparse.spmv(m, gx, gy, alpha=-2, beta=0.5, algo=algo)
+    numpy.testing.assert_allclose(numpy.asarray(gy), -2 * a.dot(cx) + 0.5 * cy,
+                                  rtol=rtol, atol=rtol)
+
+
+def test_spmm():
+    for fmt, dtype, order in product(['csr', 'coo'], ['float32', 'float64'],
+                                     'cf'):
+        yield spmm, fmt, dtype, order
+
+
+@guard_devsup
+def spmm(fmt, dtype, order):
+    a = rand_sparse((120, 90), dtype)
+    m = sparse.from_dense(gpuarray.array(a, context=context), format=fmt)
+    cb, gb = gen_gpuarray((90, 17), dtype, order=order, ctx=context)
+    cc, gc = gen_gpuarray((120, 17), dtype, order=order, ctx=context)
+    rtol = 1e-4 if dtype == 'float32' else 1e-10
+
+    r = m.dot(gb)
+    numpy.testing.assert_allclose(numpy.asarray(r), a.dot(cb), rtol=rtol,
+                                  atol=rtol)
+
+    sparse.spmm(m, gb, gc, alpha=0.5, beta=-1)
+    numpy.testing.assert_allclose(numpy.asarray(gc), 0.5 * a.dot(cb) - cc,
+                                  rtol=rtol, atol=rtol)
+
+
+@guard_devsup
+def test_from_arrays():
+    # [[1, 0, 2], [0, 0, 0], [0, 3, 0]]
+    m = sparse.csr_matrix(numpy.array([1, 2, 3], dtype='float32'),
+                          numpy.array([0, 2, 1], dtype='int32'),
+                          numpy.array([0, 2, 2, 3], dtype='int32'),
+                          (3, 3), context=context)
+    assert m.max_row == 2
+    x = gpuarray.array(numpy.array([1, 10, 100], dtype='float32'),
+                       context=context)
+    numpy.testing.assert_equal(numpy.asarray(m.dot(x)), [201, 0, 30])
+
+    # Duplicates are summed
+    m = sparse.coo_matrix(numpy.array([1, 2, 3, 4], dtype='float32'),
+                          numpy.array([0, 2, 0, 0], dtype='int32'),
+                          numpy.array([0, 1, 2, 0], dtype='int32'),
+                          (3, 3), context=context)
+    numpy.testing.assert_equal(numpy.asarray(m.dot(x)), [305, 0, 20])
+
+    try:
+        sparse.csr_matrix(numpy.array([1, 2, 3], dtype='float32'),
+                          numpy.array([0, 2, 1], dtype='int32'),
+                          numpy.array([0, 2, 1, 3], dtype='int32'),
+                          (3, 3), context=context)
+    except ValueError:
+        pass
+    else:
+        raise AssertionError("decreasing indptr accepted")
+
+    for args in [(numpy.array([0, 3, 1], dtype='int32'),
+                  numpy.array([0, 2, 2, 3], dtype='int32')),
+                 (numpy.array([0, -1, 1], dtype='int32'),
+                  numpy.array([0, 2, 2, 3], dtype='int32'))]:
+        try:
+            sparse.csr_matrix(numpy.array([1, 2, 3], dtype='float32'),
+                              *args, shape=(3, 3), context=context)
+        except ValueError:
+            pass
+        else:
+            raise AssertionError("column out of range accepted")
+    try:
+        sparse.coo_matrix(numpy.array([1, 2], dtype='float32'),
+                          numpy.array([0, 3], dtype='int32'),
+                          numpy.array([0, 1], dtype='int32'),
+                          (3, 3), context=context)
+    except ValueError:
+        pass
+    else:
+        raise AssertionError("row out of range accepted")
+
+
+@guard_devsup
+def test_scipy():
+    try:
+        import scipy.sparse
+    except ImportError:
+        raise SkipTest("no scipy")
+    a = rand_sparse((50, 40), 'float64')
+    for s in [scipy.sparse.csr_matrix(a), scipy.sparse.coo_matrix(a),
+              scipy.sparse.csc_matrix(a)]:
+        m = sparse.from_scipy(s, context=context)
+        assert m.format == ('coo' if s.format == 'coo' else 'csr')
+        numpy.testing.assert_equal(m.to_scipy().toarray(), a)
+        x = numpy.arange(40, dtype='float64')
+        gx = gpuarray.array(x, context=context)
+        numpy.testing.assert_allclose(numpy.asarray(m.dot(gx)), s.dot(x))
+    m = sparse.from_scipy(scipy.sparse.csr_matrix(a), context=context,
+                          index_dtype='int64')
+    assert m.indices.dtype == numpy.dtype('int64')
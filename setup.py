@@ -133,12 +133,20 @@ exts = [Extension('pygpu.gpuarray',
                   library_dirs=library_dirs,
                   extra_compile_args=ea,
                   define_macros=[('GPUARRAY_SHARED', None)]
+                  ),
+        Extension('pygpu.sparse',
+                  sources=['pygpu/sparse.pyx'],
+                  include_dirs=include_dirs,
+                  libraries=['gpuarray'],
+                  library_dirs=library_dirs,
+                  extra_compile_args=ea,
+                  define_macros=[('GPUARRAY_SHARED', None)]
                   )]
 
 setup(name='pygpu',
       version=FULLVERSION,
       description='numpy-like wrapper on libgpuarray for GPU computations',
-      packages=['pygpu', 'pygpu/tests'],
+      packages=['pygpu', 'pygpu/tests', 'pygpu/benchmarks'],
       include_package_data=True,
       package_data={'pygpu': ['gpuarray.h', 'gpuarray_api.h',
                               'blas_api.h', 'numpy_compat.h',
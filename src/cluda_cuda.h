@@ -76,6 +76,51 @@ static __device__ inline ga_half ga_float2half(float f) {
   return r;
 }
 
+/* ga_cfloat, ga_cdouble: same layout as the host types */
+#define gen_complex(name, type, hypotfn)                                \
+  struct name {                                                         \
+    type r;                                                             \
+    type i;                                                             \
+  };                                                                    \
+  static __device__ inline name name##_make(type r, type i) {           \
+    name res;                                                           \
+    res.r = r;                                                          \
+    res.i = i;                                                          \
+    return res;                                                         \
+  }                                                                     \
+  static __device__ inline name name##_add(name a, name b) {            \
+    return name##_make(a.r + b.r, a.i + b.i);                           \
+  }                                                                     \
+  static __device__ inline name name##_sub(name a, name b) {            \
+    return name##_make(a.r - b.r, a.i - b.i);                           \
+  }                                                                     \
+  static __device__ inline name name##_mul(name a, name b) {            \
+    return name##_make(a.r * b.r - a.i * b.i, a.r * b.i + a.i * b.r);   \
+  }                                                                     \
+  static __device__ inline name name##_div(name a, name b) {            \
+    type t, d;                                                          \
+    if (fabs(b.r) >= fabs(b.i)) {                                       \
+      t = b.i / b.r;                                                    \
+      d = b.r + b.i * t;                                                \
+      return name##_make((a.r + a.i * t) / d, (a.i - a.r * t) / d);     \
+    }                                                                   \
+    t = b.r / b.i;                                                      \
+    d = b.r * t + b.i;                                                  \
+    return name##_make((a.r * t + a.i) / d, (a.i * t - a.r) / d);       \
+  }                                                                     \
+  static __device__ inline name name##_neg(name a) {                    \
+    return name##_make(-a.r, -a.i);                                     \
+  }                                                                     \
+  static __device__ inline name name##_conj(name a) {                   \
+    return name##_make(a.r, -a.i);                                      \
+  }                                                                     \
+  static __device__ inline type name##_abs(name a) {                    \
+    return hypotfn(a.r, a.i);                                           \
+  }
+
+gen_complex(ga_cfloat, ga_float, hypotf)
+gen_complex(ga_cdouble, ga_double, hypot)
+
 /* ga_int */
 #define atom_add_ig(a, b) atomicAdd(a, b)
 #define atom_add_il(a, b) atomicAdd(a, b)
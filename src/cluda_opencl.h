@@ -51,6 +51,54 @@ static inline ga_half ga_float2half(ga_float f) {
   return r;
 }
 
+/* ga_cfloat, ga_cdouble: same layout as the host types */
+#define gen_complex(name, type)                                         \
+  typedef struct _##name {                                              \
+    type r;                                                             \
+    type i;                                                             \
+  } name;                                                               \
+  static inline name name##_make(type r, type i) {                      \
+    name res;                                                           \
+    res.r = r;                                                          \
+    res.i = i;                                                          \
+    return res;                                                         \
+  }                                                                     \
+  static inline name name##_add(name a, name b) {                       \
+    return name##_make(a.r + b.r, a.i + b.i);                           \
+  }                                                                     \
+  static inline name name##_sub(name a, name b) {                       \
+    return name##_make(a.r - b.r, a.i - b.i);                           \
+  }                                                                     \
+  static inline name name##_mul(name a, name b) {                       \
+    return name##_make(a.r * b.r - a.i * b.i, a.r * b.i + a.i * b.r);   \
+  }                                                                     \
+  static inline name name##_div(name a, name b) {                       \
+    type t, d;                                                          \
+    if (fabs(b.r) >= fabs(b.i)) {                                       \
+      t = b.i / b.r;                                                    \
+      d = b.r + b.i * t;                                                \
+      return name##_make((a.r + a.i * t) / d, (a.i - a.r * t) / d);     \
+    }                                                                   \
+    t = b.r / b.i;                                                      \
+    d = b.r * t + b.i;                                                  \
+    return name##_make((a.r * t + a.i) / d, (a.i * t - a.r) / d);       \
+  }                                                                     \
+  static inline name name##_neg(name a) {                               \
+    return name##_make(-a.r, -a.i);                                     \
+  }                                                                     \
+  static inline name name##_conj(name a) {                              \
+    return name##_make(a.r, -a.i);                                      \
+  }                                                                     \
+  static inline type name##_abs(name a) {                               \
+    return hypot(a.r, a.i);                                             \
+  }
+
+gen_complex(ga_cfloat, ga_float)
+/* double needs cl_khr_fp64, which is only enabled with GA_USE_DOUBLE */
+#ifdef GA_CLUDA_DOUBLE
+gen_complex(ga_cdouble, ga_double)
+#endif
+
 #pragma OPENCL_EXTENSION cl_khr_int64_base_atomics: enable
 
 #define gen_atom32_add(name, argtype, aspace)                     \
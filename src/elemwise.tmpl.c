@@ -0,0 +1,294 @@
+/* Generated by tmpl.py from elemwise.tmpl, do not edit. */
+
+static const tmpl_part tmpl_ew_dim_parts[] = {
+  {"const ga_size dim",
+   17, 0},
+  {", ",
+   2, -1},
+};
+static const tmpl tmpl_ew_dim = {"u", 2, tmpl_ew_dim_parts, 19};
+
+static const tmpl_part tmpl_ew_scalar_parts[] = {
+  {"",
+   0, 0},
+  {" ",
+   1, 1},
+  {"",
+   0, -1},
+};
+static const tmpl tmpl_ew_scalar = {"ts", 3, tmpl_ew_scalar_parts, 1};
+
+static const tmpl_part tmpl_ew_decl_parts[] = {
+  {"",
+   0, 0},
+  {" ",
+   1, 1},
+  {";",
+   1, -1},
+};
+static const tmpl tmpl_ew_decl = {"ts", 3, tmpl_ew_decl_parts, 2};
+
+static const tmpl_part tmpl_ew_basic_array_parts[] = {
+  {"GLOBAL_MEM ",
+   11, 0},
+  {" *",
+   2, 1},
+  {"_data, const ga_size ",
+   21, 1},
+  {"_offset",
+   7, 2},
+  {"",
+   0, -1},
+};
+static const tmpl tmpl_ew_basic_array = {"tss", 5, tmpl_ew_basic_array_parts, 41};
+
+static const tmpl_part tmpl_ew_basic_str_parts[] = {
+  {"const ga_ssize ",
+   15, 0},
+  {"_str_",
+   5, 1},
+  {"",
+   0, 2},
+  {"",
+   0, -1},
+};
+static const tmpl tmpl_ew_basic_str = {"sus", 4, tmpl_ew_basic_str_parts, 20};
+
+static const tmpl_part tmpl_ew_basic_start_parts[] = {
+  {") {\n"
+   "const ",
+   10, 0},
+  {" idx = LDIM_0 * GID_0 + LID_0;\n"
+   "const ",
+   37, 0},
+  {" numThreads = LDIM_0 * GDIM_0;\n",
+   31, 0},
+  {" i;\n"
+   "for(i = idx; i < n; i += numThreads) {\n",
+   43, -1},
+};
+static const tmpl tmpl_ew_basic_start = {"s", 4, tmpl_ew_basic_start_parts, 121};
+
+static const tmpl_part tmpl_ew_basic_pos_parts[] = {
+  {"",
+   0, 0},
+  {" ii = i;\n",
+   9, 0},
+  {" pos;\n",
+   6, -1},
+};
+static const tmpl tmpl_ew_basic_pos = {"s", 3, tmpl_ew_basic_pos_parts, 15};
+
+static const tmpl_part tmpl_ew_basic_ptr_parts[] = {
+  {"",
+   0, 0},
+  {" ",
+   1, 1},
+  {"_p = ",
+   5, 1},
+  {"_offset;\n",
+   9, -1},
+};
+static const tmpl tmpl_ew_basic_ptr = {"ss", 4, tmpl_ew_basic_ptr_parts, 15};
+
+static const tmpl_part tmpl_ew_basic_div_parts[] = {
+  {"pos = ii % (",
+   12, 0},
+  {")dim",
+   4, 1},
+  {";\n"
+   "ii = ii / (",
+   13, 0},
+  {")dim",
+   4, 1},
+  {";\n",
+   2, -1},
+};
+static const tmpl tmpl_ew_basic_div = {"su", 5, tmpl_ew_basic_div_parts, 35};
+
+static const tmpl_part tmpl_ew_basic_step_parts[] = {
+  {"",
+   0, 0},
+  {"_p += pos * (",
+   13, 1},
+  {")",
+   1, 0},
+  {"_str_",
+   5, 2},
+  {";\n",
+   2, -1},
+};
+static const tmpl tmpl_ew_basic_step = {"ssu", 5, tmpl_ew_basic_step_parts, 21};
+
+static const tmpl_part tmpl_ew_basic_load_parts[] = {
+  {"",
+   0, 0},
+  {" = *(GLOBAL_MEM ",
+   16, 1},
+  {" *)(((GLOBAL_MEM char *)",
+   24, 0},
+  {"_data) + ",
+   9, 0},
+  {"_p);\n",
+   5, -1},
+};
+static const tmpl tmpl_ew_basic_load = {"st", 5, tmpl_ew_basic_load_parts, 54};
+
+static const tmpl_part tmpl_ew_basic_load_half_parts[] = {
+  {"",
+   0, 0},
+  {" = ga_half2float(*(GLOBAL_MEM ga_half *)(((GLOBAL_MEM char *)",
+   61, 0},
+  {"_data) + ",
+   9, 0},
+  {"_p));\n",
+   6, -1},
+};
+static const tmpl tmpl_ew_basic_load_half = {"s", 4, tmpl_ew_basic_load_half_parts, 76};
+
+static const tmpl_part tmpl_ew_basic_store_parts[] = {
+  {"*(GLOBAL_MEM ",
+   13, 0},
+  {" *)(((GLOBAL_MEM char *)",
+   24, 1},
+  {"_data) + ",
+   9, 1},
+  {"_p) = ",
+   6, 1},
+  {";\n",
+   2, -1},
+};
+static const tmpl tmpl_ew_basic_store = {"ts", 5, tmpl_ew_basic_store_parts, 54};
+
+static const tmpl_part tmpl_ew_basic_store_half_parts[] = {
+  {"*(GLOBAL_MEM ga_half *)(((GLOBAL_MEM char *)",
+   44, 0},
+  {"_data) + ",
+   9, 0},
+  {"_p) = ga_float2half(",
+   20, 0},
+  {");\n",
+   3, -1},
+};
+static const tmpl tmpl_ew_basic_store_half = {"s", 4, tmpl_ew_basic_store_half_parts, 76};
+
+static const tmpl_part tmpl_ew_spec_start_parts[] = {
+  {") {\n"
+   "const ",
+   10, 0},
+  {" idx = LDIM_0 * GID_0 + LID_0;\n"
+   "const ",
+   37, 0},
+  {" numThreads = LDIM_0 * GDIM_0;\n",
+   31, 0},
+  {" i;\n"
+   "for(i = idx; i < ",
+   21, 1},
+  {"; i += numThreads) {\n",
+   21, -1},
+};
+static const tmpl tmpl_ew_spec_start = {"sz", 5, tmpl_ew_spec_start_parts, 120};
+
+static const tmpl_part tmpl_ew_spec_div_parts[] = {
+  {"pos = ii % (",
+   12, 0},
+  {")",
+   1, 1},
+  {";\n"
+   "ii = ii / (",
+   13, 0},
+  {")",
+   1, 1},
+  {";\n",
+   2, -1},
+};
+static const tmpl tmpl_ew_spec_div = {"sz", 5, tmpl_ew_spec_div_parts, 29};
+
+static const tmpl_part tmpl_ew_spec_step_parts[] = {
+  {"",
+   0, 0},
+  {"_p += pos * (",
+   13, 1},
+  {")",
+   1, 2},
+  {";\n",
+   2, -1},
+};
+static const tmpl tmpl_ew_spec_step = {"ssZ", 4, tmpl_ew_spec_step_parts, 16};
+
+static const tmpl_part tmpl_ew_contig_array_parts[] = {
+  {"GLOBAL_MEM ",
+   11, 0},
+  {" *",
+   2, 1},
+  {"_p,  const ga_size ",
+   19, 1},
+  {"_offset",
+   7, -1},
+};
+static const tmpl tmpl_ew_contig_array = {"ts", 4, tmpl_ew_contig_array_parts, 39};
+
+static const tmpl_part tmpl_ew_contig_start_parts[] = {
+  {") {\n"
+   "const ga_size idx = LDIM_0 * GID_0 + LID_0;\n"
+   "const ga_size numThreads = LDIM_0 * GDIM_0;\n"
+   "ga_size i;\n"
+   "GLOBAL_MEM char *tmp;\n"
+   "\n",
+   126, -1},
+};
+static const tmpl tmpl_ew_contig_start = {"", 1, tmpl_ew_contig_start_parts, 126};
+
+static const tmpl_part tmpl_ew_contig_offset_parts[] = {
+  {"tmp = (GLOBAL_MEM char *)",
+   25, 0},
+  {"_p;tmp += ",
+   10, 0},
+  {"_offset; ",
+   9, 0},
+  {"_p = (GLOBAL_MEM ",
+   17, 1},
+  {" *)tmp;",
+   7, -1},
+};
+static const tmpl tmpl_ew_contig_offset = {"st", 5, tmpl_ew_contig_offset_parts, 68};
+
+static const tmpl_part tmpl_ew_contig_load_parts[] = {
+  {"",
+   0, 0},
+  {" = ",
+   3, 0},
+  {"_p[i];\n",
+   7, -1},
+};
+static const tmpl tmpl_ew_contig_load = {"s", 3, tmpl_ew_contig_load_parts, 10};
+
+static const tmpl_part tmpl_ew_contig_load_half_parts[] = {
+  {"",
+   0, 0},
+  {" = ga_half2float(",
+   17, 0},
+  {"_p[i]);\n",
+   8, -1},
+};
+static const tmpl tmpl_ew_contig_load_half = {"s", 3, tmpl_ew_contig_load_half_parts, 25};
+
+static const tmpl_part tmpl_ew_contig_store_parts[] = {
+  {"",
+   0, 0},
+  {"_p[i] = ",
+   8, 0},
+  {";\n",
+   2, -1},
+};
+static const tmpl tmpl_ew_contig_store = {"s", 3, tmpl_ew_contig_store_parts, 10};
+
+static const tmpl_part tmpl_ew_contig_store_half_parts[] = {
+  {"",
+   0, 0},
+  {"_p[i] = ga_float2half(",
+   22, 0},
+  {");\n",
+   3, -1},
+};
+static const tmpl tmpl_ew_contig_store_half = {"s", 3, tmpl_ew_contig_store_half_parts, 25};
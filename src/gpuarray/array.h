@@ -15,8 +15,20 @@ extern "C" {
 }
 #endif
 
+/**
+ * Number of dimensions for which the shape is stored inside the
+ * GpuArray structure itself.  Arrays with more dimensions use heap
+ * storage.
+ */
+#define GA_INLINE_ND 8
+
 /**
  * Main array structure.
+ *
+ * Since ABI version 4.0, #dimensions and #strides may point inside
+ * the structure.  A GpuArray must therefore not be copied by value
+ * (use GpuArray_view()) and the shape arrays must not be freed or
+ * replaced directly.
  */
 typedef struct _GpuArray {
   /**
@@ -98,6 +110,12 @@ typedef struct _GpuArray {
      NPY_UPDATEIFCOPY: cannot support without refcount (or somesuch)
 
      Maybe will define other flags later */
+
+  /** @cond NEVER */
+  /* Storage for #dimensions and #strides when nd <= GA_INLINE_ND */
+  size_t _dimensions_inline[GA_INLINE_ND];
+  ssize_t _strides_inline[GA_INLINE_ND];
+  /** @endcond */
 } GpuArray;
 
 /**
@@ -355,6 +373,55 @@ GPUARRAY_PUBLIC int GpuArray_index_inplace(GpuArray *a, const ssize_t *starts,
 GPUARRAY_PUBLIC int GpuArray_take1(GpuArray *a, const GpuArray *v,
                                    const GpuArray *i, int check_error);
 
+/**
+ * Gather elements of an array using integer index arrays.
+ *
+ * This is the equivalent of `r = v[:, ..., idx[0], ..., idx[nidx-1], ...]`
+ * in numpy, with the index arrays applied to the consecutive axes
+ * `axis` to `axis + nidx - 1` of `v`.  All the index arrays must have
+ * the same shape and the result must have shape `v.shape[:axis] +
+ * idx[0].shape + v.shape[axis+nidx:]`.
+ *
+ * Negative indices count from the end of the dimension.  See
+ * GpuArray_take1() for the meaning of `check_error`.
+ *
+ * \param r the result array (C-contiguous)
+ * \param v the source array
+ * \param axis first indexed axis of `v`
+ * \param nidx number of index arrays
+ * \param idx the index arrays (C-contiguous, integer type)
+ * \param check_error whether to check for index errors or not
+ *
+ * \return GA_NO_ERROR if the operation was succesful.
+ * \return an error code otherwise
+ */
+GPUARRAY_PUBLIC int GpuArray_gather(GpuArray *r, const GpuArray *v,
+                                    unsigned int axis, unsigned int nidx,
+                                    const GpuArray **idx, int check_error);
+
+/**
+ * Scatter elements into an array using integer index arrays.
+ *
+ * This is the reverse of GpuArray_gather(): it performs the numpy
+ * assignment `a[:, ..., idx[0], ..., idx[nidx-1], ...] = v`.  `v`
+ * must have the shape of the corresponding gather result.  If an
+ * element is indexed more than once, which value is stored is
+ * unspecified.
+ *
+ * \param a the destination array
+ * \param v the value array (C-contiguous)
+ * \param axis first indexed axis of `a`
+ * \param nidx number of index arrays
+ * \param idx the index arrays (C-contiguous, integer type)
+ * \param check_error whether to check for index errors or not
+ *
+ * \return GA_NO_ERROR if the operation was succesful.
+ * \return an error code otherwise
+ */
+GPUARRAY_PUBLIC int GpuArray_scatter(GpuArray *a, const GpuArray *v,
+                                     unsigned int axis, unsigned int nidx,
+                                     const GpuArray **idx, int check_error);
+
 /**
  * Sets the content of an array to the content of another array.
  *
@@ -471,7 +538,10 @@ GPUARRAY_PUBLIC int GpuArray_move(GpuArray *dst, const GpuArray *src);
 /**
  * Copy data from the host memory to the device memory.
  *
- * \param dst destination array (must be contiguous)
+ * If `dst` is not contiguous, `src_sz` must match its size and the
+ * host memory is taken to be in C order.
+ *
+ * \param dst destination array
  * \param src source host memory (contiguous block)
  * \param src_sz size of data to copy (in bytes)
  *
@@ -484,9 +554,12 @@ GPUARRAY_PUBLIC int GpuArray_write(GpuArray *dst, const void *src,
 /**
  * Copy data from the device memory to the host memory.
  *
+ * If `src` is not contiguous, `dst_sz` must match its size and the
+ * host memory is filled in C order.
+ *
  * \param dst destination host memory (contiguous block)
  * \param dst_sz size of data to copy (in bytes)
- * \param src source array (must be contiguous)
+ * \param src source array
  *
  * \return GA_NO_ERROR if the operation was succesful.
  * \return an error code otherwise
@@ -494,6 +567,40 @@ GPUARRAY_PUBLIC int GpuArray_write(GpuArray *dst, const void *src,
 GPUARRAY_PUBLIC int GpuArray_read(void *dst, size_t dst_sz,
                                   const GpuArray *src);
 
+/**
+ * Copy a strided host array to the device.
+ *
+ * The host array has the same shape as `dst` and the strides given
+ * in `src_strides`.  Layouts that reduce to three or fewer
+ * non-contiguous dimensions are copied directly with a rectangular
+ * transfer, other layouts go through a device temporary.
+ *
+ * \param dst destination array
+ * \param src pointer to the first element of the host array
+ * \param src_strides strides of the host array (in bytes)
+ *
+ * \return GA_NO_ERROR if the operation was succesful.
+ * \return an error code otherwise
+ */
+GPUARRAY_PUBLIC int GpuArray_write_strided(GpuArray *dst, const void *src,
+                                           const ssize_t *src_strides);
+
+/**
+ * Copy an array from the device into a strided host array.
+ *
+ * See GpuArray_write_strided() for details.
+ *
+ * \param dst pointer to the first element of the host array
+ * \param dst_strides strides of the host array (in bytes)
+ * \param src source array
+ *
+ * \return GA_NO_ERROR if the operation was succesful.
+ * \return an error code otherwise
+ */
+GPUARRAY_PUBLIC int GpuArray_read_strided(void *dst,
+                                          const ssize_t *dst_strides,
+                                          const GpuArray *src);
+
 /**
  * Set all of an array's data to a byte pattern.
  *
@@ -523,8 +630,11 @@ GPUARRAY_PUBLIC int GpuArray_copy(GpuArray *res, const GpuArray *a,
  * This works like GpuArray_move() except it will work between arrays
  * that aren't in the same context.
  *
- * Source and target arrays must be contiguous.  This restriction may
- * be lifted in the future.
+ * If both arrays are contiguous, their data is copied as is.
+ * Otherwise they must have the same shape and the ones that are not
+ * C-contiguous are packed to (or unpacked from) a contiguous
+ * temporary on their own device, so that only dense data goes
+ * between the devices.
  *
  * \param res result array
  * \param a array to transfer
@@ -534,6 +644,24 @@ GPUARRAY_PUBLIC int GpuArray_copy(GpuArray *res, const GpuArray *a,
  */
 GPUARRAY_PUBLIC int GpuArray_transfer(GpuArray *res, const GpuArray *a);
 
+/**
+ * Transfer each array in `as` to the matching one in `rs`.
+ *
+ * This works like calling GpuArray_transfer() on each pair, except
+ * that the copies between contiguous arrays are issued together with
+ * gpudata_transfer_many() so that the ones to different devices can
+ * overlap.
+ *
+ * \param rs list of result arrays
+ * \param as list of arrays to transfer
+ * \param n number of arrays in both lists
+ *
+ * \return GA_NO_ERROR if the operation was succesful.
+ * \return an error code otherwise
+ */
+GPUARRAY_PUBLIC int GpuArray_transfer_many(GpuArray **rs, const GpuArray **as,
+                                           size_t n);
+
 /**
  * Split an array into multiple views.
  *
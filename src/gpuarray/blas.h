@@ -20,12 +20,16 @@ GPUARRAY_PUBLIC int GpuArray_rgemv(cb_transpose transA, double alpha,
 #define GpuArray_hgemv GpuArray_rgemv
 #define GpuArray_sgemv GpuArray_rgemv
 #define GpuArray_dgemv GpuArray_rgemv
+#define GpuArray_cgemv GpuArray_rgemv
+#define GpuArray_zgemv GpuArray_rgemv
 GPUARRAY_PUBLIC int GpuArray_rgemm(cb_transpose transA, cb_transpose transB,
                                    double alpha, GpuArray *A, GpuArray *B,
                                    double beta, GpuArray *C, int nocopy);
 #define GpuArray_hgemm GpuArray_rgemm
 #define GpuArray_sgemm GpuArray_rgemm
 #define GpuArray_dgemm GpuArray_rgemm
+#define GpuArray_cgemm GpuArray_rgemm
+#define GpuArray_zgemm GpuArray_rgemm
 GPUARRAY_PUBLIC int GpuArray_rger(double alpha, GpuArray *X, GpuArray *Y,
                                   GpuArray *A, int nocopy);
 #define GpuArray_hger GpuArray_rger
@@ -43,6 +43,13 @@ struct _gpukernel;
  */
 typedef struct _gpukernel gpukernel;
 
+struct _gpugraph;
+
+/**
+ * Opaque struct for a recorded sequence of operations.
+ */
+typedef struct _gpugraph gpugraph;
+
 /**
  * Gets information about the number of available platforms for the
  * backend specified in `name`.
@@ -142,6 +149,11 @@ GPUARRAY_PUBLIC int gpucontext_props_sched(gpucontext_props *p, int sched);
  * Multi-work scheduling.  Try to not keep the CPU busy more than
  * necessary and let other threads a chance at some CPU time.  This
  * may increase the latency when waiting for GPU operations.
+ *
+ * Contexts created with this mode may be shared between threads.
+ * The allocator, the kernel caches and the error buffer of the
+ * context are protected by a lock.  Individual buffers, kernels and
+ * arrays must still not be modified concurrently.
  */
 #define GA_CTX_SCHED_MULTI  2
 
@@ -191,6 +203,27 @@ GPUARRAY_PUBLIC int gpucontext_props_kernel_cache(gpucontext_props *p,
 GPUARRAY_PUBLIC int gpucontext_props_alloc_cache(gpucontext_props *p,
                                                  size_t initial, size_t max);
 
+/**
+ * Record the allocations of the context to a file.
+ *
+ * Every buffer allocation of the context, and the release of its last
+ * reference, is written to the file at `path` with a timestamp, the
+ * requested size and the current tag (see gpucontext_alloc_tag()).
+ * Threads sharing the context write to the same trace.  The file can be replayed
+ * with the `gpuarray-alloc-replay` tool to evaluate allocator
+ * settings offline.
+ *
+ * If this is not set, the `GPUARRAY_ALLOC_TRACE` environment
+ * variable is used instead.
+ *
+ * \param p properties object
+ * \param path file to write the trace to (truncated if it exists)
+ *
+ * \returns GA_NO_ERROR or an error code if an error occurred.
+ */
+GPUARRAY_PUBLIC int gpucontext_props_alloc_trace(gpucontext_props *p,
+                                                 const char *path);
+
 /**
  * Free a properties object.
  *
@@ -256,7 +289,11 @@ GPUARRAY_PUBLIC int gpucontext_property(gpucontext *ctx, int prop_id,
  *
  * If you need to get a description of a error that occurred during
  * context creation, call this function using NULL as the context.
- * This version of the call is not thread-safe.
+ *
+ * Errors are recorded per thread: this returns the last error that
+ * happened in the calling thread, even if other threads use the same
+ * context.  The returned string is valid until the next error in the
+ * same thread.
  *
  * \param ctx the context in which the error occured
  * \param err error code
@@ -265,6 +302,119 @@ GPUARRAY_PUBLIC int gpucontext_property(gpucontext *ctx, int prop_id,
  */
 GPUARRAY_PUBLIC const char *gpucontext_error(gpucontext *ctx, int err);
 
+/**
+ * Return cached allocations to the driver.
+ *
+ * Blocks held by the allocation cache that are entirely unused are
+ * freed after waiting for the operations that touched them.  This is
+ * done automatically when an allocation fails for lack of memory,
+ * but can be useful before handing memory over to another library.
+ *
+ * The running total of the bytes freed this way is available as the
+ * `GA_CTX_PROP_CACHE_RECLAIMED` property.
+ *
+ * \param ctx context
+ * \param freed if not NULL, the number of bytes freed by this call
+ *
+ * \returns GA_NO_ERROR or an error code if an error occurred.
+ */
+GPUARRAY_PUBLIC int gpucontext_trim_cache(gpucontext *ctx, size_t *freed);
+
+/**
+ * Produce a JSON dump instead of text in gpucontext_dump_allocator().
+ */
+#define GA_DUMP_JSON 0x1
+
+/**
+ * Describe the state of the allocator of a context.
+ *
+ * The report contains the values of the `GA_CTX_PROP_MEM_*`
+ * properties, either as lines of text or as a JSON object (with
+ * `GA_DUMP_JSON`).
+ *
+ * \param ctx context
+ * \param res the report is returned here and must be freed with free()
+ * \param flags 0 or `GA_DUMP_JSON`
+ *
+ * \returns GA_NO_ERROR or an error code if an error occurred.
+ * Backends without a pooling allocator return GA_DEVSUP_ERROR.
+ */
+GPUARRAY_PUBLIC int gpucontext_dump_allocator(gpucontext *ctx, char **res,
+                                              int flags);
+
+/**
+ * Set the tag attached to the following allocation trace events.
+ *
+ * This is used to attribute allocations to phases or layers of a
+ * program when reading a trace.  It does nothing if the context is
+ * not recording a trace (see gpucontext_props_alloc_trace()).
+ *
+ * \param ctx context
+ * \param tag name of the tag or NULL to clear it
+ *
+ * \returns GA_NO_ERROR or an error code if an error occurred.
+ */
+GPUARRAY_PUBLIC int gpucontext_alloc_tag(gpucontext *ctx, const char *tag);
+
+/**
+ * Start recording the operations issued on a context.
+ *
+ * Until gpucontext_capture_end() is called, kernel calls
+ * (gpukernel_call()), buffer moves (gpudata_move()), memsets
+ * (gpudata_memset()) and writes from host memory (gpudata_write())
+ * on `ctx` are recorded instead of being executed.  Host data passed
+ * to gpudata_write() is copied at record time.
+ *
+ * Operations that need their result on the host (reads, syncs,
+ * transfers to other contexts) and BLAS or collective calls fail
+ * while a capture is in progress.
+ *
+ * Buffers and kernels used by the recorded operations are kept alive
+ * until the graph is released.  Allocations are not recorded and
+ * happen immediately.
+ *
+ * \warning Capture applies to every thread using `ctx`.
+ *
+ * \param ctx context
+ *
+ * \returns GA_NO_ERROR or an error code if an error occurred.
+ */
+GPUARRAY_PUBLIC int gpucontext_capture_begin(gpucontext *ctx);
+
+/**
+ * Stop recording and return the recorded graph.
+ *
+ * The capture is stopped even if this function fails.
+ *
+ * \param ctx context
+ * \param ret error return location.  Will be ignored if set to NULL.
+ *
+ * \returns the graph or NULL if an error occurred.
+ */
+GPUARRAY_PUBLIC gpugraph *gpucontext_capture_end(gpucontext *ctx, int *ret);
+
+/**
+ * Replay a recorded graph.
+ *
+ * The operations are issued in recording order with the same
+ * arguments as when they were captured, without any of the checks
+ * and argument processing done by the higher-level calls.  With the
+ * CUDA backend this launches a CUDA graph when the driver supports
+ * them.
+ *
+ * \param g graph
+ *
+ * \returns GA_NO_ERROR or an error code if an error occurred.
+ */
+GPUARRAY_PUBLIC int gpugraph_launch(gpugraph *g);
+
+/**
+ * Release a graph and the references it holds.
+ *
+ * \param g graph
+ */
+GPUARRAY_PUBLIC void gpugraph_release(gpugraph *g);
+
 /**
  * Allocates a buffer of size `sz` in context `ctx`.
  *
@@ -337,6 +487,20 @@ GPUARRAY_PUBLIC gpudata *gpudata_alloc(gpucontext *ctx, size_t sz, void *data,
 
 /*#define GA_BUFFER_USE_DATA   0x10*/
 
+/**
+ * Allocate the buffer in managed (unified) memory.
+ *
+ * The contents can be accessed from the host through the pointer
+ * returned by the `GA_BUFFER_PROP_HOSTPOINTER` property once all
+ * device work on the buffer is done (see gpudata_sync()).  The driver
+ * pages the data between host and device on demand, which allows
+ * allocating more than the device memory.  Use gpudata_prefetch()
+ * and gpudata_advise() to control the placement.
+ *
+ * Only supported on CUDA.
+ */
+#define GA_BUFFER_MANAGED    0x20
+
 /* The upper 16 bits are private flags */
 #define GA_BUFFER_MASK       0xffff
 
@@ -418,6 +582,28 @@ GPUARRAY_PUBLIC int gpudata_transfer(gpudata *dst, size_t dstoff,
                                      gpudata *src, size_t srcoff,
                                      size_t sz);
 
+/**
+ * Transfer a batch of buffer regions across contexts.
+ *
+ * This is equivalent to calling gpudata_transfer() for each `i` in
+ * `[0, n)`, but the backend may issue the copies together and
+ * overlap them.  In CUDA the copies from each peer device go on their
+ * own stream and only the events needed to order them with the
+ * surrounding work are waited on.
+ *
+ * \param dst buffers to transfer to
+ * \param dstoff offsets in the destination buffers
+ * \param src buffers to transfer from
+ * \param srcoff offsets in the source buffers
+ * \param sz sizes of the regions to transfer
+ * \param n number of transfers
+ *
+ * \returns GA_NO_ERROR or an error code if an error occurred.
+ */
+GPUARRAY_PUBLIC int gpudata_transfer_many(gpudata **dst, const size_t *dstoff,
+                                          gpudata **src, const size_t *srcoff,
+                                          const size_t *sz, size_t n);
+
 /**
  * Transfer data from a buffer to memory.
  *
@@ -449,6 +635,59 @@ GPUARRAY_PUBLIC int gpudata_read(void *dst,
 GPUARRAY_PUBLIC int gpudata_write(gpudata *dst, size_t dstoff,
                                   const void *src, size_t sz);
 
+/**
+ * Transfer a rectangular region from a buffer to memory.
+ *
+ * The region is made of `depth` slices of `height` rows of `width`
+ * bytes each.  Rows are `rpitch` bytes apart and slices `spitch`
+ * bytes apart on each side.  The slice pitch must be a multiple of
+ * the row pitch.  Pitches for dimensions of size 1 are ignored.
+ *
+ * \param dst destination in memory
+ * \param dst_rpitch row pitch of the destination (in bytes)
+ * \param dst_spitch slice pitch of the destination (in bytes)
+ * \param src source buffer
+ * \param srcoff offset of the region inside the source buffer
+ * \param src_rpitch row pitch of the source (in bytes)
+ * \param src_spitch slice pitch of the source (in bytes)
+ * \param width size of a row (in bytes)
+ * \param height number of rows in a slice
+ * \param depth number of slices
+ *
+ * \returns GA_NO_ERROR or an error code if an error occurred.
+ */
+GPUARRAY_PUBLIC int gpudata_read_rect(void *dst,
+                                      size_t dst_rpitch, size_t dst_spitch,
+                                      gpudata *src, size_t srcoff,
+                                      size_t src_rpitch, size_t src_spitch,
+                                      size_t width, size_t height,
+                                      size_t depth);
+
+/**
+ * Transfer a rectangular region from memory to a buffer.
+ *
+ * See gpudata_read_rect() for the description of the region.
+ *
+ * \param dst destination buffer
+ * \param dstoff offset of the region inside the destination buffer
+ * \param dst_rpitch row pitch of the destination (in bytes)
+ * \param dst_spitch slice pitch of the destination (in bytes)
+ * \param src source in memory
+ * \param src_rpitch row pitch of the source (in bytes)
+ * \param src_spitch slice pitch of the source (in bytes)
+ * \param width size of a row (in bytes)
+ * \param height number of rows in a slice
+ * \param depth number of slices
+ *
+ * \returns GA_NO_ERROR or an error code if an error occurred.
+ */
+GPUARRAY_PUBLIC int gpudata_write_rect(gpudata *dst, size_t dstoff,
+                                       size_t dst_rpitch, size_t dst_spitch,
+                                       const void *src,
+                                       size_t src_rpitch, size_t src_spitch,
+                                       size_t width, size_t height,
+                                       size_t depth);
+
 /**
  * Set a buffer to a byte pattern.
  *
@@ -476,6 +715,101 @@ GPUARRAY_PUBLIC int gpudata_memset(gpudata *dst, size_t dstoff, int data);
  */
 GPUARRAY_PUBLIC int gpudata_sync(gpudata *b);
 
+/**
+ * \defgroup location Memory locations
+ * @{
+ */
+
+/**
+ * The device of the context that owns the buffer.
+ */
+#define GA_LOCATION_DEVICE 0
+
+/**
+ * Host memory.
+ */
+#define GA_LOCATION_HOST   1
+
+/**
+ * @}
+ */
+
+/**
+ * Migrate a range of a managed buffer.
+ *
+ * This is asynchronous and ordered with the other operations on the
+ * buffer.  The buffer must have been allocated with
+ * `GA_BUFFER_MANAGED`.
+ *
+ * \param b buffer
+ * \param off offset of the range in the buffer
+ * \param sz size of the range
+ * \param location where to move the data (from \ref location "Memory
+ * locations")
+ *
+ * \returns GA_NO_ERROR or an error code if an error occurred.
+ */
+GPUARRAY_PUBLIC int gpudata_prefetch(gpudata *b, size_t off, size_t sz,
+                                     int location);
+
+/**
+ * \defgroup advice Access advice
+ * @{
+ */
+
+/**
+ * The range is mostly read, allowing read-only copies on each
+ * processor that accesses it.
+ */
+#define GA_ADVISE_READ_MOSTLY            1
+
+/**
+ * Undo `GA_ADVISE_READ_MOSTLY`.
+ */
+#define GA_ADVISE_NO_READ_MOSTLY         2
+
+/**
+ * Prefer keeping the range at the given location.
+ */
+#define GA_ADVISE_PREFERRED_LOCATION     3
+
+/**
+ * Undo `GA_ADVISE_PREFERRED_LOCATION`.
+ */
+#define GA_ADVISE_NO_PREFERRED_LOCATION  4
+
+/**
+ * The range will be accessed from the given location, keep it mapped
+ * there.
+ */
+#define GA_ADVISE_ACCESSED_BY            5
+
+/**
+ * Undo `GA_ADVISE_ACCESSED_BY`.
+ */
+#define GA_ADVISE_NOT_ACCESSED_BY        6
+
+/**
+ * @}
+ */
+
+/**
+ * Give a hint about the access pattern of a range of a managed
+ * buffer.
+ *
+ * \param b buffer
+ * \param off offset of the range in the buffer
+ * \param sz size of the range
+ * \param advice the hint (from \ref advice "Access advice")
+ * \param location location the hint applies to (from \ref location
+ * "Memory locations"), ignored for `GA_ADVISE_READ_MOSTLY` and
+ * `GA_ADVISE_NO_READ_MOSTLY`
+ *
+ * \returns GA_NO_ERROR or an error code if an error occurred.
+ */
+GPUARRAY_PUBLIC int gpudata_advise(gpudata *b, size_t off, size_t sz,
+                                   int advice, int location);
+
 /**
  * Fetch a buffer property.
  *
@@ -737,6 +1071,122 @@ GPUARRAY_PUBLIC gpucontext *gpukernel_context(gpukernel *k);
  */
 #define GA_CTX_PROP_LARGEST_MEMBLOCK 20
 
+/**
+ * Get the device ordinal (as used by the driver) for the context.
+ *
+ * Type: `int`
+ */
+#define GA_CTX_PROP_DEVNO 21
+
+/**
+ * Total number of bytes returned to the driver by trimming the
+ * allocation cache (see gpucontext_trim_cache()).
+ *
+ * Type: `size_t`
+ */
+#define GA_CTX_PROP_CACHE_RECLAIMED 22
+
+/**
+ * Bytes obtained from the driver by the allocator.
+ *
+ * Type: `size_t`
+ */
+#define GA_CTX_PROP_MEM_RESERVED 23
+
+/**
+ * Bytes held by live buffers.
+ *
+ * Type: `size_t`
+ */
+#define GA_CTX_PROP_MEM_IN_USE 24
+
+/**
+ * Bytes held by the allocation cache (reserved but not in use).
+ *
+ * Type: `size_t`
+ */
+#define GA_CTX_PROP_MEM_CACHED 25
+
+/**
+ * Highest value reached by `GA_CTX_PROP_MEM_IN_USE`.
+ *
+ * Type: `size_t`
+ */
+#define GA_CTX_PROP_MEM_PEAK 26
+
+/**
+ * Number of times a cached block was split to satisfy a request.
+ *
+ * Type: `size_t`
+ */
+#define GA_CTX_PROP_MEM_SPLITS 27
+
+/**
+ * Number of times freed blocks were merged with a neighbour.
+ *
+ * Type: `size_t`
+ */
+#define GA_CTX_PROP_MEM_MERGES 28
+
+/**
+ * Size of the largest block in the allocation cache.
+ *
+ * Type: `size_t`
+ */
+#define GA_CTX_PROP_MEM_LARGEST_FREE 29
+
+/**
+ * Number of size buckets in `GA_CTX_PROP_MEM_FREE_BUCKETS`.
+ */
+#define GA_MEM_NBUCKETS 64
+
+/**
+ * Number of blocks in the allocation cache by size.
+ *
+ * Entry `i` counts the blocks with a size between 2^i (inclusive)
+ * and 2^(i+1) (exclusive).
+ *
+ * Type: `size_t[GA_MEM_NBUCKETS]`
+ */
+#define GA_CTX_PROP_MEM_FREE_BUCKETS 30
+
+/**
+ * Number of live buffers.
+ *
+ * Type: `size_t`
+ */
+#define GA_CTX_PROP_MEM_BLOCKS 31
+
+/**
+ * Maximum number of threads resident on a multiprocessor (compute
+ * unit).  0 if unknown.
+ *
+ * Type: `unsigned int`
+ */
+#define GA_CTX_PROP_MAXTHREADS_MP 32
+
+/**
+ * Maximum number of blocks resident on a multiprocessor.  0 if
+ * unknown.
+ *
+ * Type: `unsigned int`
+ */
+#define GA_CTX_PROP_MAXBLOCKS_MP 33
+
+/**
+ * Number of registers available on a multiprocessor.  0 if unknown.
+ *
+ * Type: `unsigned int`
+ */
+#define GA_CTX_PROP_REGS_MP 34
+
+/**
+ * Local memory available on a multiprocessor.  0 if unknown.
+ *
+ * Type: `size_t`
+ */
+#define GA_CTX_PROP_LMEMSIZE_MP 35
+
 /* Start at 512 for GA_BUFFER_PROP_ */
 #define GA_BUFFER_PROP_START  512
 
@@ -764,6 +1214,15 @@ GPUARRAY_PUBLIC gpucontext *gpukernel_context(gpukernel *k);
  */
 #define GA_BUFFER_PROP_SIZE  514
 
+/**
+ * Host pointer to the contents of the buffer.
+ *
+ * Only available for buffers allocated with `GA_BUFFER_MANAGED`.
+ *
+ * Type: `void *`
+ */
+#define GA_BUFFER_PROP_HOSTPOINTER 515
+
 /* Start at 1024 for GA_KERNEL_PROP_ */
 #define GA_KERNEL_PROP_START     1024
 
@@ -807,6 +1266,22 @@ GPUARRAY_PUBLIC gpucontext *gpukernel_context(gpukernel *k);
  */
 #define GA_KERNEL_PROP_TYPES     1028
 
+/**
+ * Get the number of registers used by each thread of the kernel.  0
+ * if unknown.
+ *
+ * Type: `unsigned int`
+ */
+#define GA_KERNEL_PROP_NUMREGS   1029
+
+/**
+ * Get the amount of local memory statically allocated by the kernel
+ * for each block.
+ *
+ * Type: `size_t`
+ */
+#define GA_KERNEL_PROP_LMEMSIZE  1030
+
 /**
  * @}
  */
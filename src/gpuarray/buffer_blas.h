@@ -89,6 +89,34 @@ GPUARRAY_PUBLIC int gpublas_dgemm(
   gpudata *A, size_t offA, size_t lda, gpudata *B, size_t offB, size_t ldb,
   double beta, gpudata *C, size_t offC, size_t ldc);
 
+/*
+ * The complex variants take alpha and beta as pointers to a (real,
+ * imaginary) pair and operate on interleaved ga_cfloat/ga_cdouble data.
+ */
+GPUARRAY_PUBLIC int gpublas_cgemv(
+  cb_order order, cb_transpose transA, size_t M, size_t N,
+  const float *alpha, gpudata *A, size_t offA, size_t lda,
+  gpudata *X, size_t offX, int incX,
+  const float *beta, gpudata *Y, size_t offY, int incY);
+
+GPUARRAY_PUBLIC int gpublas_zgemv(
+  cb_order order, cb_transpose transA, size_t M, size_t N,
+  const double *alpha, gpudata *A, size_t offA, size_t lda,
+  gpudata *X, size_t offX, int incX,
+  const double *beta, gpudata *Y, size_t offY, int incY);
+
+GPUARRAY_PUBLIC int gpublas_cgemm(
+  cb_order order, cb_transpose transA, cb_transpose transB,
+  size_t M, size_t N, size_t K, const float *alpha,
+  gpudata *A, size_t offA, size_t lda, gpudata *B, size_t offB, size_t ldb,
+  const float *beta, gpudata *C, size_t offC, size_t ldc);
+
+GPUARRAY_PUBLIC int gpublas_zgemm(
+  cb_order order, cb_transpose transA, cb_transpose transB,
+  size_t M, size_t N, size_t K, const double *alpha,
+  gpudata *A, size_t offA, size_t lda, gpudata *B, size_t offB, size_t ldb,
+  const double *beta, gpudata *C, size_t offC, size_t ldc);
+
 GPUARRAY_PUBLIC int gpublas_hger(
   cb_order order, size_t M, size_t N, float alpha,
   gpudata *X, size_t offX, int incX,
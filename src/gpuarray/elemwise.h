@@ -139,6 +139,28 @@ GPUARRAY_PUBLIC void GpuElemwise_free(GpuElemwise *ge);
  */
 GPUARRAY_PUBLIC int GpuElemwise_call(GpuElemwise *ge, void **args, int flags);
 
+/**
+ * Compile kernels specialised for the shapes that are used often.
+ *
+ * Once the same shape and strides (after dimension collapsing) have
+ * been seen in more than `threshold` calls that can't use the
+ * contiguous kernel, a kernel with those values compiled in as
+ * constants is built and used for the calls that match them exactly.
+ * Other calls use the generic kernels.  Only a few shapes are tracked
+ * per GpuElemwise.
+ *
+ * Specialisation is disabled by default.
+ *
+ * \param ge the GpuElemwise
+ * \param threshold number of calls before a shape is specialised or
+ *                  0 to disable (this also frees the specialised
+ *                  kernels)
+ *
+ * \returns GA_NO_ERROR or an error code
+ */
+GPUARRAY_PUBLIC int GpuElemwise_specialize(GpuElemwise *ge,
+                                           unsigned int threshold);
+
 
 /**
  * \defgroup elem_call_flags GpuElemwise call flags
@@ -24,6 +24,7 @@ static int (*cuda_record)(gpudata *, int);
 static CUipcMemHandle (*cuda_get_ipc_handle)(gpudata *d);
 static gpudata *(*cuda_open_ipc_handle)(gpucontext *c, CUipcMemHandle h,
                                         size_t sz);
+static int (*cuda_get_ipc_range)(gpudata *d, size_t *off, size_t *sz);
 /** @endcond */
 
 static void setup_ext_cuda(void) {
@@ -38,6 +39,7 @@ static void setup_ext_cuda(void) {
   cuda_record = (int (*)(gpudata *, int))gpuarray_get_extension("cuda_record");
   cuda_get_ipc_handle = (CUipcMemHandle (*)(gpudata *))gpuarray_get_extension("cuda_get_ipc_handle");
   cuda_open_ipc_handle = (gpudata *(*)(gpucontext *c, CUipcMemHandle h, size_t sz))gpuarray_get_extension("cuda_open_ipc_handle");
+  cuda_get_ipc_range = (int (*)(gpudata *, size_t *, size_t *))gpuarray_get_extension("cuda_get_ipc_range");
 }
 
 #ifdef __cplusplus
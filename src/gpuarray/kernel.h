@@ -57,6 +57,53 @@ GPUARRAY_PUBLIC int GpuKernel_init(GpuKernel *k, gpucontext *ctx,
                                    unsigned int argcount, const int *types,
                                    int flags, char **err_str);
 
+/**
+ * Source generator for GpuKernel_init_keyed().
+ *
+ * \param data the `data` argument of GpuKernel_init_keyed()
+ * \param src the source must be returned here, allocated with malloc()
+ * \param len the length of the source must be returned here
+ *
+ * \return GA_NO_ERROR if the operation is successful
+ * \return any other value if an error occured
+ */
+typedef int (*GpuKernel_gen_fn)(void *data, char **src, size_t *len);
+
+/**
+ * Initialize a kernel structure from a signature.
+ *
+ * The signature `key` is a compact binary description of everything
+ * that the source depends on (types, number of dimensions, ...).
+ * Kernels are looked up in a per-context cache using the signature,
+ * the name, the argument types and the flags.  The source is only
+ * generated, by calling `gen`, if the kernel is not found.
+ *
+ * Two different sources must never be generated for the same
+ * signature and name.
+ *
+ * \param k a kernel structure
+ * \param ctx context in which to build the kernel
+ * \param key signature of the kernel
+ * \param keylen size of the signature in bytes
+ * \param gen source generator
+ * \param data passed to `gen`
+ * \param name name of the kernel function
+ * \param argcount number of kerner arguments
+ * \param types typecode for each argument
+ * \param flags kernel use flags (see \ref ga_usefl)
+ * \param err_str (if not NULL) location to write GPU-backend provided debug info
+ *
+ * \return GA_NO_ERROR if the operation is successful
+ * \return any other value if an error occured
+ */
+GPUARRAY_PUBLIC int GpuKernel_init_keyed(GpuKernel *k, gpucontext *ctx,
+                                         const void *key, size_t keylen,
+                                         GpuKernel_gen_fn gen, void *data,
+                                         const char *name,
+                                         unsigned int argcount,
+                                         const int *types, int flags,
+                                         char **err_str);
+
 /**
  * Clear and release data associated with a kernel.
  *
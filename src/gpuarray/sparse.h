@@ -0,0 +1,207 @@
+#ifndef GPUARRAY_SPARSE_H
+#define GPUARRAY_SPARSE_H
+/** \file sparse.h
+ *  \brief Sparse matrices in CSR and COO formats.
+ */
+
+#include <gpuarray/array.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#ifdef CONFUSE_EMACS
+}
+#endif
+
+/**
+ * Storage formats of a GpuSparse.
+ */
+typedef enum _ga_sparse_format {
+  /** Compressed rows: `ptr` holds the start of each row in `data` */
+  GA_SPARSE_CSR = 0,
+  /** Coordinates: `ptr` holds the row of each element */
+  GA_SPARSE_COO = 1
+} ga_sparse_format;
+
+/**
+ * Sparse matrix-vector product kernels, see GpuSparse_spmv().
+ */
+typedef enum _ga_spmv_algo {
+  /** Pick one from the row length statistics */
+  GA_SPMV_AUTO = 0,
+  /** A group of up to a warp of threads per row (CSR) */
+  GA_SPMV_CSR_VECTOR = 1,
+  /** Equal shares of rows + nonzeros per thread (CSR) */
+  GA_SPMV_MERGE_PATH = 2,
+  /** One thread per nonzero with atomic adds (COO) */
+  GA_SPMV_COO = 3
+} ga_spmv_algo;
+
+/**
+ * Sparse matrix structure.
+ *
+ * The three arrays are 1d, C-contiguous and in the same context.
+ * `indices` and `ptr` are both GA_INT or both GA_LONG.  `data` is
+ * GA_FLOAT or GA_DOUBLE.
+ *
+ * The fields can be read but should not be modified directly.
+ */
+typedef struct _GpuSparse {
+  /** Values of the stored elements (`nnz`) */
+  GpuArray data;
+  /** Column of each stored element (`nnz`) */
+  GpuArray indices;
+  /**
+   * For CSR, start of each row in `data` followed by `nnz` (`rows + 1`).
+   * For COO, row of each stored element (`nnz`).
+   */
+  GpuArray ptr;
+  /** Number of rows */
+  size_t rows;
+  /** Number of columns */
+  size_t cols;
+  /** Number of stored elements */
+  size_t nnz;
+  /** Length of the longest row (CSR only) */
+  size_t max_row;
+  /** Storage format (see ::ga_sparse_format) */
+  int format;
+} GpuSparse;
+
+/**
+ * Build a CSR matrix from existing arrays.
+ *
+ * `s` takes views of the arrays.  `indptr` is read back to check it
+ * and to compute the row length statistics and the columns are
+ * checked on the device, so this should be done once per matrix
+ * rather than once per product.  The arrays must not be modified
+ * afterwards since the products index with them unchecked.
+ *
+ * \param s the sparse matrix structure to initialize
+ * \param data values of the stored elements
+ * \param indices column of each element
+ * \param indptr start of each row, must begin with 0 and end with nnz
+ * \param rows number of rows
+ * \param cols number of columns
+ *
+ * \return GA_NO_ERROR if the operation is successful
+ * \return GA_VALUE_ERROR if `indptr` or `indices` are out of range
+ * \return GA_XLARGE_ERROR if `cols` doesn't fit in the index type
+ * \return an error code otherwise
+ */
+GPUARRAY_PUBLIC int GpuSparse_csr(GpuSparse *s, const GpuArray *data,
+                                  const GpuArray *indices,
+                                  const GpuArray *indptr,
+                                  size_t rows, size_t cols);
+
+/**
+ * Build a COO matrix from existing arrays.
+ *
+ * `s` takes views of the arrays.  The elements may be in any order
+ * and duplicates are summed.  The rows and columns are checked on the
+ * device, the arrays must not be modified afterwards since the
+ * products index with them unchecked.
+ *
+ * \param s the sparse matrix structure to initialize
+ * \param data values of the stored elements
+ * \param row row of each element
+ * \param col column of each element
+ * \param rows number of rows
+ * \param cols number of columns
+ *
+ * \return GA_NO_ERROR if the operation is successful
+ * \return GA_VALUE_ERROR if `row` or `col` are out of range
+ * \return GA_XLARGE_ERROR if `rows` or `cols` don't fit in the index
+ *         type
+ * \return an error code otherwise
+ */
+GPUARRAY_PUBLIC int GpuSparse_coo(GpuSparse *s, const GpuArray *data,
+                                  const GpuArray *row, const GpuArray *col,
+                                  size_t rows, size_t cols);
+
+/**
+ * Build a sparse matrix holding the non-zero elements of a 2d array.
+ *
+ * The elements are stored in row-major order.  The counting and the
+ * copy are done on the device, only the per-row counts make a round
+ * trip to the host.
+ *
+ * \param s the sparse matrix structure to initialize
+ * \param a the dense array (GA_FLOAT or GA_DOUBLE)
+ * \param format the storage format (see ::ga_sparse_format)
+ * \param idxcode the type of the indices (GA_INT or GA_LONG)
+ *
+ * \return GA_NO_ERROR if the operation is successful
+ * \return GA_XLARGE_ERROR if the shape doesn't fit in the index type
+ * \return an error code otherwise
+ */
+GPUARRAY_PUBLIC int GpuSparse_from_dense(GpuSparse *s, const GpuArray *a,
+                                         int format, int idxcode);
+
+/**
+ * Release the arrays of a sparse matrix.
+ *
+ * \param s the sparse matrix structure to clear
+ */
+GPUARRAY_PUBLIC void GpuSparse_clear(GpuSparse *s);
+
+/**
+ * Pick the SpMV kernel for a sparse matrix.
+ *
+ * COO matrices always use ::GA_SPMV_COO.  CSR matrices use
+ * ::GA_SPMV_MERGE_PATH if the longest row is much longer than the
+ * average one, since a thread or group per row would then leave most
+ * of the device waiting on a few rows, and ::GA_SPMV_CSR_VECTOR
+ * otherwise.
+ *
+ * \param s a sparse matrix
+ *
+ * \return a ::ga_spmv_algo other than ::GA_SPMV_AUTO
+ */
+GPUARRAY_PUBLIC int GpuSparse_spmv_algo(const GpuSparse *s);
+
+/**
+ * Compute y = alpha * S x + beta * y.
+ *
+ * `x` and `y` are 1d with the type of `s->data` and may be strided.
+ * If beta is 0, `y` is not read.
+ *
+ * \param alpha scale of the product
+ * \param s the sparse matrix
+ * \param x input vector (`s->cols`)
+ * \param beta scale of `y`
+ * \param y output vector (`s->rows`)
+ * \param algo the kernel to use (see ::ga_spmv_algo), must match the
+ *             format of `s`
+ *
+ * \return GA_NO_ERROR if the operation is successful
+ * \return an error code otherwise
+ */
+GPUARRAY_PUBLIC int GpuSparse_spmv(double alpha, const GpuSparse *s,
+                                   const GpuArray *x, double beta,
+                                   GpuArray *y, int algo);
+
+/**
+ * Compute C = alpha * S B + beta * C.
+ *
+ * `B` and `C` are 2d with the type of `s->data` and may be strided.
+ * If beta is 0, `C` is not read.
+ *
+ * \param alpha scale of the product
+ * \param s the sparse matrix
+ * \param B dense input (`s->cols` x k)
+ * \param beta scale of `C`
+ * \param C dense output (`s->rows` x k)
+ *
+ * \return GA_NO_ERROR if the operation is successful
+ * \return an error code otherwise
+ */
+GPUARRAY_PUBLIC int GpuSparse_spmm(double alpha, const GpuSparse *s,
+                                   const GpuArray *B, double beta,
+                                   GpuArray *C);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
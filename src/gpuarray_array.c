@@ -18,8 +18,11 @@
 
 #include "util/error.h"
 #include "util/strb.h"
+#include "util/tmpl.h"
 #include "util/xxhash.h"
 
+#include "take1.tmpl.c"
+
 struct extcopy_args {
   int itype;
   int otype;
@@ -39,15 +42,15 @@ static uint32_t extcopy_hash(cache_key_t k) {
   return XXH32(k, sizeof(struct extcopy_args), 42);
 }
 
-static int ga_extcopy(GpuArray *dst, const GpuArray *src) {
+/*
+ * Find or build the copy kernel and call it.  Must be called with the
+ * context lock held, which it releases while it builds the kernel.
+ */
+static int do_extcopy(gpucontext *ctx, GpuArray *dst, const GpuArray *src) {
   struct extcopy_args a, *aa;
-  gpucontext *ctx = GpuArray_context(dst);
-  GpuElemwise *k = NULL;
+  GpuElemwise *k = NULL, *other = NULL;
   void *args[2];
 
-  if (ctx != GpuArray_context(src))
-    return error_set(ctx->err, GA_INVALID_ERROR, "src and dst context differ");
-
   a.itype = src->typecode;
   a.otype = dst->typecode;
 
@@ -61,33 +64,150 @@ static int ga_extcopy(GpuArray *dst, const GpuArray *src) {
     gargs[1].name = "dst";
     gargs[1].typecode = dst->typecode;
     gargs[1].flags = GE_WRITE;
+    ga_lock_release(ctx->lock);
     k = GpuElemwise_new(ctx, "", "dst = src", 2, gargs, 0, GE_CONVERT_F16);
+    ga_lock_acquire(ctx->lock);
     if (k == NULL)
-      return ctx->err->code;
-    aa = memdup(&a, sizeof(a));
-    if (aa == NULL) {
+      return error_code(ctx->err);
+    /* Another thread may have built it meanwhile */
+    if (ctx->extcopy_cache != NULL)
+      other = cache_get(ctx->extcopy_cache, &a);
+    if (other != NULL) {
       GpuElemwise_free(k);
-      return error_sys(ctx->err, "memdup");
+      k = other;
+    } else {
+      aa = memdup(&a, sizeof(a));
+      if (aa == NULL) {
+        GpuElemwise_free(k);
+        return error_sys(ctx->err, "memdup");
+      }
+      if (ctx->extcopy_cache == NULL)
+        ctx->extcopy_cache = cache_twoq(4, 8, 8, 2, extcopy_eq, extcopy_hash,
+                                        extcopy_free,
+                                        (cache_freev_fn)GpuElemwise_free,
+                                        ctx->err);
+      if (ctx->extcopy_cache == NULL)
+        return error_code(ctx->err);
+      if (cache_add(ctx->extcopy_cache, aa, k) != 0)
+        return error_set(ctx->err, GA_MISC_ERROR,
+                         "Could not store GpuElemwise copy kernel in context cache");
     }
-    if (ctx->extcopy_cache == NULL)
-      ctx->extcopy_cache = cache_twoq(4, 8, 8, 2, extcopy_eq, extcopy_hash,
-                                      extcopy_free,
-                                      (cache_freev_fn)GpuElemwise_free,
-                                      ctx->err);
-    if (ctx->extcopy_cache == NULL)
-      return ctx->err->code;
-    if (cache_add(ctx->extcopy_cache, aa, k) != 0)
-      return error_set(ctx->err, GA_MISC_ERROR,
-                       "Could not store GpuElemwise copy kernel in context cache");
   }
   args[0] = (void *)src;
   args[1] = (void *)dst;
   return GpuElemwise_call(k, args, GE_BROADCAST);
 }
 
+static int ga_extcopy(GpuArray *dst, const GpuArray *src) {
+  gpucontext *ctx = GpuArray_context(dst);
+  int err;
+
+  if (ctx != GpuArray_context(src))
+    return error_set(ctx->err, GA_INVALID_ERROR, "src and dst context differ");
+
+  /* The cached kernels are shared, so the call has to be covered too */
+  ga_lock_acquire(ctx->lock);
+  err = do_extcopy(ctx, dst, src);
+  ga_lock_release(ctx->lock);
+  return err;
+}
+
 /* Value below which a size_t multiplication will never overflow. */
 #define MUL_NO_OVERFLOW (1ULL << (sizeof(size_t) * 4))
 
+/*
+ * Point the shape of `a` to storage for `nd` dimensions, using the
+ * inline storage when it is large enough.  The previous shape must
+ * have been released.
+ */
+static int ga_shape_alloc(GpuArray *a, unsigned int nd) {
+  if (nd <= GA_INLINE_ND) {
+    a->dimensions = a->_dimensions_inline;
+    a->strides = a->_strides_inline;
+    return GA_NO_ERROR;
+  }
+  a->dimensions = calloc(nd, sizeof(size_t));
+  a->strides = calloc(nd, sizeof(ssize_t));
+  if (a->dimensions == NULL || a->strides == NULL) {
+    free(a->dimensions);
+    free(a->strides);
+    a->dimensions = NULL;
+    a->strides = NULL;
+    return GA_MEMORY_ERROR;
+  }
+  return GA_NO_ERROR;
+}
+
+static void ga_shape_free(GpuArray *a) {
+  if (a->dimensions != a->_dimensions_inline)
+    free(a->dimensions);
+  if (a->strides != a->_strides_inline)
+    free(a->strides);
+  a->dimensions = NULL;
+  a->strides = NULL;
+}
+
+/*
+ * Replace the shape of `a`.  `dims` and `strs` may point to the
+ * current shape of `a`.  On error `a` is left untouched.
+ */
+static int ga_shape_set(GpuArray *a, unsigned int nd, const size_t *dims,
+                        const ssize_t *strs) {
+  size_t *d = a->_dimensions_inline;
+  ssize_t *s = a->_strides_inline;
+
+  if (nd > GA_INLINE_ND) {
+    d = calloc(nd, sizeof(size_t));
+    s = calloc(nd, sizeof(ssize_t));
+    if (d == NULL || s == NULL) {
+      free(d);
+      free(s);
+      return GA_MEMORY_ERROR;
+    }
+  }
+  memmove(d, dims, nd*sizeof(size_t));
+  memmove(s, strs, nd*sizeof(ssize_t));
+  ga_shape_free(a);
+  a->dimensions = d;
+  a->strides = s;
+  a->nd = nd;
+  return GA_NO_ERROR;
+}
+
+/*
+ * Scratch space to compute a new shape without going to the heap for
+ * small arrays.
+ */
+typedef struct _shape_tmp {
+  size_t *dims;
+  ssize_t *strs;
+  size_t _dims[GA_INLINE_ND];
+  ssize_t _strs[GA_INLINE_ND];
+} shape_tmp;
+
+static int shape_tmp_init(shape_tmp *t, unsigned int nd) {
+  if (nd <= GA_INLINE_ND) {
+    t->dims = t->_dims;
+    t->strs = t->_strs;
+    return GA_NO_ERROR;
+  }
+  t->dims = calloc(nd, sizeof(size_t));
+  t->strs = calloc(nd, sizeof(ssize_t));
+  if (t->dims == NULL || t->strs == NULL) {
+    free(t->dims);
+    free(t->strs);
+    return GA_MEMORY_ERROR;
+  }
+  return GA_NO_ERROR;
+}
+
+static void shape_tmp_clear(shape_tmp *t) {
+  if (t->dims != t->_dims)
+    free(t->dims);
+  if (t->strs != t->_strs)
+    free(t->strs);
+}
+
 void GpuArray_fix_flags(GpuArray *a) {
   /* Only keep the writable flag */
   a->flags &= GA_WRITEABLE;
@@ -128,7 +248,7 @@ int GpuArray_empty(GpuArray *a, gpucontext *ctx, int typecode,
 #endif
 
   a->data = gpudata_alloc(ctx, size, NULL, 0, &res);
-  if (a->data == NULL) return ctx->err->code;
+  if (a->data == NULL) return error_code(ctx->err);
   a->nd = nd;
 #ifdef DEBUG
   a->offset = 64;
@@ -136,15 +256,13 @@ int GpuArray_empty(GpuArray *a, gpucontext *ctx, int typecode,
   a->offset = 0;
 #endif
   a->typecode = typecode;
-  a->dimensions = calloc(nd, sizeof(size_t));
-  a->strides = calloc(nd, sizeof(ssize_t));
   /* F/C distinction comes later */
   a->flags = GA_BEHAVED;
-  if (a->dimensions == NULL || a->strides == NULL) {
+  if (ga_shape_alloc(a, nd) != GA_NO_ERROR) {
     GpuArray_clear(a);
     return error_sys(ctx->err, "calloc");
   }
-  /* Mult will not overflow since calloc succeded */
+  /* Mult will not overflow since the size check passed */
   memcpy(a->dimensions, dims, sizeof(size_t)*nd);
 
   size = gpuarray_get_elsize(typecode);
@@ -202,10 +320,8 @@ int GpuArray_fromdata(GpuArray *a, gpudata *data, size_t offset, int typecode,
   a->nd = nd;
   a->offset = offset;
   a->typecode = typecode;
-  a->dimensions = calloc(nd, sizeof(size_t));
-  a->strides = calloc(nd, sizeof(ssize_t));
   a->flags = (writeable ? GA_WRITEABLE : 0);
-  if (a->dimensions == NULL || a->strides == NULL) {
+  if (ga_shape_alloc(a, nd) != GA_NO_ERROR) {
     GpuArray_clear(a);
     return error_set(ctx->err, GA_MEMORY_ERROR, "Out of memory");
   }
@@ -225,9 +341,7 @@ int GpuArray_view(GpuArray *v, const GpuArray *a) {
   v->offset = a->offset;
   v->typecode = a->typecode;
   v->flags = a->flags;
-  v->dimensions = calloc(v->nd, sizeof(size_t));
-  v->strides = calloc(v->nd, sizeof(ssize_t));
-  if (v->dimensions == NULL || v->strides == NULL) {
+  if (ga_shape_alloc(v, v->nd) != GA_NO_ERROR) {
     GpuArray_clear(v);
     return error_set(ctx->err, GA_MEMORY_ERROR, "Out of memory");
   }
@@ -245,6 +359,7 @@ int GpuArray_index_inplace(GpuArray *a, const ssize_t *starts,
   gpucontext *ctx = GpuArray_context(a);
   unsigned int i, new_i;
   unsigned int new_nd = a->nd;
+  shape_tmp t;
   size_t *newdims;
   ssize_t *newstrs;
   size_t new_offset = a->offset;
@@ -255,20 +370,16 @@ int GpuArray_index_inplace(GpuArray *a, const ssize_t *starts,
   for (i = 0; i < a->nd; i++) {
     if (steps[i] == 0) new_nd -= 1;
   }
-  newdims = calloc(new_nd, sizeof(size_t));
-  newstrs = calloc(new_nd, sizeof(ssize_t));
-  if (newdims == NULL || newstrs == NULL) {
-    free(newdims);
-    free(newstrs);
+  if (shape_tmp_init(&t, new_nd) != GA_NO_ERROR)
     return error_sys(ctx->err, "calloc");
-  }
+  newdims = t.dims;
+  newstrs = t.strs;
 
   new_i = 0;
   for (i = 0; i < a->nd; i++) {
     if (starts[i] < -1 || (starts[i] > 0 &&
                            (size_t)starts[i] > a->dimensions[i])) {
-      free(newdims);
-      free(newstrs);
+      shape_tmp_clear(&t);
       return error_fmt(ctx->err, GA_VALUE_ERROR,
                        "Invalid slice value: slice(%lld, %lld, %lld) when "
                        "indexing array on dimension %u of length %lld",
@@ -276,8 +387,7 @@ int GpuArray_index_inplace(GpuArray *a, const ssize_t *starts,
     }
     if (steps[i] == 0 &&
         (starts[i] == -1 || (size_t)starts[i] >= a->dimensions[i])) {
-      free(newdims);
-      free(newstrs);
+      shape_tmp_clear(&t);
       return error_fmt(ctx->err, GA_VALUE_ERROR,
                        "Invalid slice value: slice(%lld, %lld, %lld) when "
                        "indexing array on dimension %u of length %lld",
@@ -288,8 +398,7 @@ int GpuArray_index_inplace(GpuArray *a, const ssize_t *starts,
       if ((stops[i] < -1 || (stops[i] > 0 &&
                              (size_t)stops[i] > a->dimensions[i])) ||
           (stops[i]-starts[i])/steps[i] < 0) {
-        free(newdims);
-        free(newstrs);
+        shape_tmp_clear(&t);
         return error_fmt(ctx->err, GA_VALUE_ERROR,
                          "Invalid slice value: slice(%lld, %lld, %lld) when "
                          "indexing array on dimension %u of length %lld",
@@ -301,12 +410,12 @@ int GpuArray_index_inplace(GpuArray *a, const ssize_t *starts,
       new_i++;
     }
   }
-  a->nd = new_nd;
+  if (ga_shape_set(a, new_nd, newdims, newstrs) != GA_NO_ERROR) {
+    shape_tmp_clear(&t);
+    return error_sys(ctx->err, "calloc");
+  }
+  shape_tmp_clear(&t);
   a->offset = new_offset;
-  free(a->dimensions);
-  a->dimensions = newdims;
-  free(a->strides);
-  a->strides = newstrs;
   GpuArray_fix_flags(a);
 
   return GA_NO_ERROR;
@@ -322,13 +431,72 @@ int GpuArray_index(GpuArray *r, const GpuArray *a, const ssize_t *starts,
   return err;
 }
 
+struct take1_args {
+  gpucontext *ctx;
+  const GpuArray *a;
+  const GpuArray *v;
+  const GpuArray *ind;
+  int addr32;
+};
+
+static int idx_signed(int typecode) {
+  return typecode == GA_BYTE || typecode == GA_SHORT ||
+    typecode == GA_INT || typecode == GA_LONG;
+}
+
+static int gen_take1_src(void *data, char **src, size_t *len) {
+  struct take1_args *t = data;
+  const GpuArray *a = t->a;
+  const GpuArray *v = t->v;
+  const GpuArray *ind = t->ind;
+  strb sb = STRB_STATIC_INIT;
+  char *sz, *ssz;
+  unsigned int i;
+
+  if (t->addr32) {
+    sz = "ga_uint";
+    ssz = "ga_int";
+  } else {
+    sz = "ga_size";
+    ssz = "ga_ssize";
+  }
+
+  strb_ensure(&sb, tmpl_take1_head.len + tmpl_take1_start.len +
+              tmpl_take1_ind_signed.len + tmpl_take1_loop.len +
+              tmpl_take1_end.len + v->nd * (tmpl_take1_dim.len + 64) + 64);
+  tmpl_render(&sb, &tmpl_take1_head, a->typecode, v->typecode);
+  for (i = 0; i < v->nd; i++)
+    tmpl_render(&sb, &tmpl_take1_arg, i);
+  tmpl_render(&sb, &tmpl_take1_start, a->typecode, ind->typecode, sz);
+  /* Unsigned indices are not wrapped, see gen_take_src() */
+  if (idx_signed(ind->typecode))
+    tmpl_render(&sb, &tmpl_take1_ind_signed, sz);
+  else
+    tmpl_render(&sb, &tmpl_take1_ind_unsigned, sz);
+  tmpl_render(&sb, &tmpl_take1_loop, sz);
+  if (v->nd > 1) {
+    tmpl_render(&sb, &tmpl_take1_pos, sz);
+    for (i = v->nd - 1; i > 1; i--)
+      tmpl_render(&sb, &tmpl_take1_dim, sz, ssz, i);
+    tmpl_render(&sb, &tmpl_take1_dim1, ssz);
+  }
+  tmpl_render(&sb, &tmpl_take1_end, sz, v->typecode);
+  if (strb_error(&sb)) {
+    strb_clear(&sb);
+    return error_set(t->ctx->err, GA_MEMORY_ERROR, "Out of memory");
+  }
+  *src = sb.s;
+  *len = sb.l;
+  return GA_NO_ERROR;
+}
+
 static int gen_take1_kernel(GpuKernel *k, gpucontext *ctx, char **err_str,
                             GpuArray *a, const GpuArray *v,
                             const GpuArray *ind, int addr32) {
-  strb sb = STRB_STATIC_INIT;
+  struct take1_args t;
   int *atypes;
-  char *sz, *ssz;
-  unsigned int i, i2;
+  int key[6];
+  unsigned int i;
   unsigned int nargs, apos;
   int flags = 0;
   int res;
@@ -339,86 +507,38 @@ static int gen_take1_kernel(GpuKernel *k, gpucontext *ctx, char **err_str,
   if (atypes == NULL)
     return error_set(ctx->err, GA_MEMORY_ERROR, "Out of memory");
 
-  if (addr32) {
-    sz = "ga_uint";
-    ssz = "ga_int";
-  } else {
-    sz = "ga_size";
-    ssz = "ga_ssize";
-  }
-
   apos = 0;
-  strb_appendf(&sb, "#include \"cluda.h\"\n"
-               "KERNEL void take1(GLOBAL_MEM %s *r, ga_size r_off, "
-               "GLOBAL_MEM const %s *v, ga_size v_off,",
-               gpuarray_get_type(a->typecode)->cluda_name,
-               gpuarray_get_type(v->typecode)->cluda_name);
   atypes[apos++] = GA_BUFFER;
   atypes[apos++] = GA_SIZE;
   atypes[apos++] = GA_BUFFER;
   atypes[apos++] = GA_SIZE;
   for (i = 0; i < v->nd; i++) {
-    strb_appendf(&sb, " ga_ssize s%u, ga_size d%u,", i, i);
     atypes[apos++] = GA_SSIZE;
     atypes[apos++] = GA_SIZE;
   }
-  strb_appendf(&sb, " GLOBAL_MEM const %s *ind, ga_size i_off, "
-               "ga_size n0, ga_size n1, GLOBAL_MEM int* err) {\n",
-               gpuarray_get_type(ind->typecode)->cluda_name);
   atypes[apos++] = GA_BUFFER;
   atypes[apos++] = GA_SIZE;
   atypes[apos++] = GA_SIZE;
   atypes[apos++] = GA_SIZE;
   atypes[apos++] = GA_BUFFER;
   assert(apos == nargs);
-  strb_appendf(&sb, "  const %s idx0 = LDIM_0 * GID_0 + LID_0;\n"
-               "  const %s numThreads0 = LDIM_0 * GDIM_0;\n"
-               "  const %s idx1 = LDIM_1 * GID_1 + LID_1;\n"
-               "  const %s numThreads1 = LDIM_1 * GDIM_1;\n"
-               "  %s i0, i1;\n", sz, sz, sz, sz, sz);
-  strb_appends(&sb, "  if (idx0 >= n0 || idx1 >= n1) return;\n");
-  strb_appendf(&sb, "  r = (GLOBAL_MEM %s *)(((GLOBAL_MEM char *)r) + r_off);\n"
-               "  ind = (GLOBAL_MEM %s *)(((GLOBAL_MEM char *)ind) + i_off);\n",
-               gpuarray_get_type(a->typecode)->cluda_name,
-               gpuarray_get_type(ind->typecode)->cluda_name);
-  strb_appendf(&sb, "  for (i0 = idx0; i0 < n0; i0 += numThreads0) {\n"
-               "    %s ii0 = ind[i0];\n"
-               "    %s pos0 = v_off;\n"
-               "    if (ii0 < 0) ii0 += d0;\n"
-               "    if ((ii0 < 0) || (ii0 >= (%s)d0)) {\n"
-               "      *err = -1;\n"
-               "      continue;\n"
-               "    }\n"
-               "    pos0 += ii0 * (%s)s0;\n"
-               "    for (i1 = idx1; i1 < n1; i1 += numThreads1) {\n"
-               "      %s p = pos0;\n", ssz, sz, ssz, sz, sz);
-  if (v->nd > 1) {
-    strb_appendf(&sb, "      %s pos, ii = i1;\n", sz);
-    for (i2 = v->nd; i2 > 1; i2--) {
-      i = i2 - 1;
-      if (i > 1)
-        strb_appendf(&sb, "      pos = ii %% (%s)d%u;\n"
-                     "      ii /= (%s)d%u;\n", sz, i, sz, i);
-      else
-        strb_appends(&sb, "      pos = ii;\n");
-      strb_appendf(&sb, "      p += pos * (%s)s%u;\n", ssz, i);
-    }
-  }
-  strb_appendf(&sb, "      r[i0*((%s)n1) + i1] = *((GLOBAL_MEM %s *)(((GLOBAL_MEM char *)v) + p));\n",
-               sz, gpuarray_get_type(v->typecode)->cluda_name);
-  strb_appends(&sb, "    }\n"
-               "  }\n"
-               "}\n");
-  if (strb_error(&sb)) {
-    res = error_set(ctx->err, GA_MEMORY_ERROR, "Out of memory");
-    goto bail;
-  }
+
+  key[0] = a->typecode;
+  key[1] = v->typecode;
+  key[2] = ind->typecode;
+  key[3] = v->nd;
+  key[4] = addr32;
+  key[5] = idx_signed(ind->typecode);
+  t.ctx = ctx;
+  t.a = a;
+  t.v = v;
+  t.ind = ind;
+  t.addr32 = addr32;
+
   flags |= gpuarray_type_flags(a->typecode, v->typecode, GA_BYTE, -1);
-  res = GpuKernel_init(k, ctx, 1, (const char **)&sb.s, &sb.l, "take1",
-                       nargs, atypes, flags, err_str);
-bail:
+  res = GpuKernel_init_keyed(k, ctx, key, sizeof(key), gen_take1_src, &t,
+                             "take1", nargs, atypes, flags, err_str);
   free(atypes);
-  strb_clear(&sb);
   return res;
 }
 
@@ -432,6 +552,7 @@ int GpuArray_take1(GpuArray *a, const GpuArray *v, const GpuArray *i,
   char *errstr = NULL;
 #endif
   GpuKernel k;
+  void **args;
   unsigned int j;
   unsigned int argp;
   int err, kerr = 0;
@@ -515,23 +636,368 @@ int GpuArray_take1(GpuArray *a, const GpuArray *v, const GpuArray *i,
     gs[1] = 1;
   }
 
+  /* The kernel is shared through the cache, so the arguments are
+     passed to the call rather than set on it */
+  args = calloc(v->nd * 2 + 9, sizeof(void *));
+  if (args == NULL) {
+    err = error_sys(ctx->err, "calloc");
+    goto out;
+  }
   argp = 0;
-  GpuKernel_setarg(&k, argp++, a->data);
-  GpuKernel_setarg(&k, argp++, (void *)&a->offset);
-  GpuKernel_setarg(&k, argp++, v->data);
+  args[argp++] = a->data;
+  args[argp++] = (void *)&a->offset;
+  args[argp++] = v->data;
   /* The cast is to avoid a warning about const */
-  GpuKernel_setarg(&k, argp++, (void *)&v->offset);
+  args[argp++] = (void *)&v->offset;
   for (j = 0; j < v->nd; j++) {
-    GpuKernel_setarg(&k, argp++, &v->strides[j]);
-    GpuKernel_setarg(&k, argp++, &v->dimensions[j]);
+    args[argp++] = (void *)&v->strides[j];
+    args[argp++] = (void *)&v->dimensions[j];
+  }
+  args[argp++] = i->data;
+  args[argp++] = (void *)&i->offset;
+  args[argp++] = &n[0];
+  args[argp++] = &n[1];
+  args[argp++] = errbuf;
+
+  /* The error buffer is shared by all users of the context */
+  ga_lock_acquire(ctx->lock);
+  err = GpuKernel_call(&k, 2, gs, ls, 0, args);
+  if (check_error && err == GA_NO_ERROR) {
+    err = gpudata_read(&kerr, errbuf, 0, sizeof(int));
+    if (err == GA_NO_ERROR && kerr != 0) {
+      err = error_set(ctx->err, GA_VALUE_ERROR, "Index out of bounds");
+      kerr = 0;
+      /* We suppose this will not fail */
+      gpudata_write(errbuf, 0, &kerr, sizeof(int));
+    }
+  }
+  ga_lock_release(ctx->lock);
+  free(args);
+
+out:
+  GpuKernel_clear(&k);
+  return err;
+}
+
+struct take_args {
+  gpucontext *ctx;
+  const GpuArray *c;
+  const GpuArray *s;
+  unsigned int axis;
+  unsigned int nidx;
+  const GpuArray **idx;
+  int scatter;
+  int addr32;
+};
+
+static int gen_take_src(void *data, char **src, size_t *len) {
+  struct take_args *t = data;
+  const GpuArray *c = t->c;
+  const GpuArray *s = t->s;
+  const GpuArray **idx = t->idx;
+  unsigned int axis = t->axis;
+  unsigned int nidx = t->nidx;
+  strb sb = STRB_STATIC_INIT;
+  const char *ctype, *stype;
+  char *sz, *ssz;
+  unsigned int i, j, post;
+
+  post = axis + nidx;
+
+  if (t->addr32) {
+    sz = "ga_uint";
+    ssz = "ga_int";
+  } else {
+    sz = "ga_size";
+    ssz = "ga_ssize";
   }
-  GpuKernel_setarg(&k, argp++, i->data);
-  GpuKernel_setarg(&k, argp++, (void *)&i->offset);
-  GpuKernel_setarg(&k, argp++, &n[0]);
-  GpuKernel_setarg(&k, argp++, &n[1]);
-  GpuKernel_setarg(&k, argp++, errbuf);
+  ctype = gpuarray_get_type(c->typecode)->cluda_name;
+  stype = gpuarray_get_type(s->typecode)->cluda_name;
 
-  err = GpuKernel_call(&k, 2, gs, ls, 0, NULL);
+  strb_appendf(&sb, "#include \"cluda.h\"\n"
+               "KERNEL void take(GLOBAL_MEM %s *c, ga_size c_off, "
+               "GLOBAL_MEM %s *s, ga_size s_off,", ctype, stype);
+  for (i = 0; i < s->nd; i++)
+    strb_appendf(&sb, " ga_ssize s%u, ga_size d%u,", i, i);
+  for (j = 0; j < nidx; j++)
+    strb_appendf(&sb, " GLOBAL_MEM const %s *ind%u, ga_size ind%u_off,",
+                 gpuarray_get_type(idx[j]->typecode)->cluda_name, j, j);
+  strb_appends(&sb, " ga_size m, ga_size n, GLOBAL_MEM int* err) {\n");
+  strb_appendf(&sb, "  const %s idx = LDIM_0 * GID_0 + LID_0;\n"
+               "  const %s numThreads = LDIM_0 * GDIM_0;\n"
+               "  %s o;\n", sz, sz, sz);
+  strb_appendf(&sb, "  c = (GLOBAL_MEM %s *)(((GLOBAL_MEM char *)c) + c_off);\n",
+               ctype);
+  for (j = 0; j < nidx; j++)
+    strb_appendf(&sb, "  ind%u = (GLOBAL_MEM %s *)(((GLOBAL_MEM char *)ind%u) + ind%u_off);\n",
+                 j, gpuarray_get_type(idx[j]->typecode)->cluda_name, j, j);
+  strb_appendf(&sb, "  for (o = idx; o < n; o += numThreads) {\n"
+               "    %s ii = o;\n"
+               "    %s p = s_off;\n"
+               "    %s j;\n"
+               "    ga_ssize t;\n"
+               "    ga_size u;\n", sz, sz, sz);
+  /* Dimensions after the indexed ones */
+  for (i = s->nd; i > post; i--) {
+    strb_appendf(&sb, "    p += (ii %% (%s)d%u) * (%s)s%u;\n"
+                 "    ii /= (%s)d%u;\n", sz, i-1, ssz, i-1, sz, i-1);
+  }
+  strb_appendf(&sb, "    j = ii %% (%s)m;\n"
+               "    ii /= (%s)m;\n", sz, sz);
+  /* Dimensions before the indexed ones */
+  for (i = axis; i > 0; i--) {
+    if (i > 1)
+      strb_appendf(&sb, "    p += (ii %% (%s)d%u) * (%s)s%u;\n"
+                   "    ii /= (%s)d%u;\n", sz, i-1, ssz, i-1, sz, i-1);
+    else
+      strb_appendf(&sb, "    p += ii * (%s)s0;\n", ssz);
+  }
+  /*
+   * The indexed dimensions.  The index is checked at full width and
+   * only narrowed to the offset type once it is known to be in range,
+   * otherwise a large 64-bit index could wrap into a valid 32-bit one.
+   */
+  for (j = 0; j < nidx; j++) {
+    if (idx_signed(idx[j]->typecode))
+      strb_appendf(&sb, "    t = ind%u[j];\n"
+                   "    if (t < 0) t += d%u;\n"
+                   "    if ((t < 0) || (t >= (ga_ssize)d%u)) {\n"
+                   "      *err = -1;\n"
+                   "      continue;\n"
+                   "    }\n"
+                   "    p += (%s)t * (%s)s%u;\n", j, axis + j, axis + j,
+                   ssz, ssz, axis + j);
+    else
+      strb_appendf(&sb, "    u = ind%u[j];\n"
+                   "    if (u >= d%u) {\n"
+                   "      *err = -1;\n"
+                   "      continue;\n"
+                   "    }\n"
+                   "    p += (%s)u * (%s)s%u;\n", j, axis + j,
+                   ssz, ssz, axis + j);
+  }
+  if (t->scatter)
+    strb_appendf(&sb, "    *((GLOBAL_MEM %s *)(((GLOBAL_MEM char *)s) + p)) = c[o];\n",
+                 stype);
+  else
+    strb_appendf(&sb, "    c[o] = *((GLOBAL_MEM %s *)(((GLOBAL_MEM char *)s) + p));\n",
+                 stype);
+  strb_appends(&sb, "  }\n"
+               "}\n");
+  if (strb_error(&sb)) {
+    strb_clear(&sb);
+    return error_set(t->ctx->err, GA_MEMORY_ERROR, "Out of memory");
+  }
+  *src = sb.s;
+  *len = sb.l;
+  return GA_NO_ERROR;
+}
+
+/*
+ * Generates the kernel for GpuArray_gather() and GpuArray_scatter().
+ *
+ * `c` is the C-contiguous side (result of a gather or values of a
+ * scatter) and `s` is the strided side that is indexed.
+ */
+static int gen_take_kernel(GpuKernel *k, gpucontext *ctx, char **err_str,
+                           const GpuArray *c, const GpuArray *s,
+                           unsigned int axis, unsigned int nidx,
+                           const GpuArray **idx, int scatter, int addr32) {
+  struct take_args t;
+  int *atypes;
+  int *key;
+  unsigned int i, j;
+  unsigned int nargs, apos;
+  int flags = 0;
+  int res;
+
+  nargs = 4 + 2 * s->nd + 2 * nidx + 3;
+
+  atypes = calloc(nargs, sizeof(int));
+  key = calloc(7 + nidx, sizeof(int));
+  if (atypes == NULL || key == NULL) {
+    free(atypes);
+    free(key);
+    return error_set(ctx->err, GA_MEMORY_ERROR, "Out of memory");
+  }
+
+  apos = 0;
+  atypes[apos++] = GA_BUFFER;
+  atypes[apos++] = GA_SIZE;
+  atypes[apos++] = GA_BUFFER;
+  atypes[apos++] = GA_SIZE;
+  for (i = 0; i < s->nd; i++) {
+    atypes[apos++] = GA_SSIZE;
+    atypes[apos++] = GA_SIZE;
+  }
+  for (j = 0; j < nidx; j++) {
+    atypes[apos++] = GA_BUFFER;
+    atypes[apos++] = GA_SIZE;
+  }
+  atypes[apos++] = GA_SIZE;
+  atypes[apos++] = GA_SIZE;
+  atypes[apos++] = GA_BUFFER;
+  assert(apos == nargs);
+
+  key[0] = c->typecode;
+  key[1] = s->typecode;
+  key[2] = s->nd;
+  key[3] = axis;
+  key[4] = nidx;
+  key[5] = scatter;
+  key[6] = addr32;
+  for (j = 0; j < nidx; j++)
+    key[7 + j] = idx[j]->typecode;
+  t.ctx = ctx;
+  t.c = c;
+  t.s = s;
+  t.axis = axis;
+  t.nidx = nidx;
+  t.idx = idx;
+  t.scatter = scatter;
+  t.addr32 = addr32;
+
+  flags |= gpuarray_type_flags(c->typecode, s->typecode, GA_BYTE, -1);
+  res = GpuKernel_init_keyed(k, ctx, key, (7 + nidx) * sizeof(int),
+                             gen_take_src, &t, "take", nargs, atypes,
+                             flags, err_str);
+  free(atypes);
+  free(key);
+  return res;
+}
+
+static int ga_take(GpuArray *c, const GpuArray *s, unsigned int axis,
+                   unsigned int nidx, const GpuArray **idx,
+                   int check_error, int scatter) {
+  gpucontext *ctx = GpuArray_context(c);
+  size_t n, m, ext, ls = 0, gs = 0;
+  gpudata *errbuf;
+#if DEBUG
+  char *errstr = NULL;
+#endif
+  GpuKernel k;
+  void **args;
+  unsigned int j, post;
+  unsigned int argp;
+  int err, kerr = 0;
+  int addr32 = 0;
+
+  if (!GpuArray_ISWRITEABLE(scatter ? s : c))
+    return error_set(ctx->err, GA_VALUE_ERROR, "Destination array not writeable");
+
+  if (GpuArray_context(s) != ctx)
+    return error_set(ctx->err, GA_VALUE_ERROR, "Arrays are not in the same context");
+
+  if (c->typecode != s->typecode)
+    return error_set(ctx->err, GA_VALUE_ERROR, "Arrays have different types");
+
+  if (!GpuArray_ISALIGNED(c) || !GpuArray_ISALIGNED(s))
+    return error_set(ctx->err, GA_UNALIGNED_ERROR, "Not all arrays are aligned");
+
+  if (!GpuArray_IS_C_CONTIGUOUS(c))
+    return error_set(ctx->err, GA_INVALID_ERROR,
+                     scatter ? "Value array not C-contiguous" :
+                     "Destination array not C-contiguous");
+
+  if (nidx == 0 || axis + nidx > s->nd)
+    return error_fmt(ctx->err, GA_VALUE_ERROR, "Invalid indexed axes. "
+                     "axis = %u, nidx = %u, nd = %u", axis, nidx, s->nd);
+  post = axis + nidx;
+
+  for (j = 0; j < nidx; j++) {
+    if (!GpuArray_ISALIGNED(idx[j]) || !GpuArray_IS_C_CONTIGUOUS(idx[j]))
+      return error_fmt(ctx->err, GA_INVALID_ERROR,
+                       "Index array %u is not aligned and C-contiguous", j);
+    if (idx[j]->typecode < GA_BYTE || idx[j]->typecode > GA_ULONG)
+      return error_fmt(ctx->err, GA_VALUE_ERROR,
+                       "Index array %u is not of integer type", j);
+    if (idx[j]->nd != idx[0]->nd ||
+        memcmp(idx[j]->dimensions, idx[0]->dimensions,
+               idx[0]->nd * sizeof(size_t)) != 0)
+      return error_fmt(ctx->err, GA_VALUE_ERROR,
+                       "Index array %u does not have the same shape as index array 0", j);
+  }
+
+  /* c must have shape s[:axis] + idx[0].shape + s[axis+nidx:] */
+  if (c->nd != s->nd - nidx + idx[0]->nd)
+    return error_fmt(ctx->err, GA_VALUE_ERROR, "Dimension mismatch. "
+                     "nd = %u, expected %u", c->nd, s->nd - nidx + idx[0]->nd);
+  m = 1;
+  for (j = 0; j < idx[0]->nd; j++)
+    m *= idx[0]->dimensions[j];
+  if (memcmp(c->dimensions, s->dimensions, axis * sizeof(size_t)) != 0 ||
+      memcmp(c->dimensions + axis, idx[0]->dimensions,
+             idx[0]->nd * sizeof(size_t)) != 0 ||
+      memcmp(c->dimensions + axis + idx[0]->nd, s->dimensions + post,
+             (s->nd - post) * sizeof(size_t)) != 0)
+    return error_set(ctx->err, GA_VALUE_ERROR, "Shape mismatch");
+
+  n = 1;
+  for (j = 0; j < c->nd; j++)
+    n *= c->dimensions[j];
+  if (n == 0)
+    return GA_NO_ERROR;
+
+  /* The positions in s also have to fit */
+  ext = s->offset + gpuarray_get_elsize(s->typecode);
+  for (j = 0; j < s->nd; j++)
+    ext += (s->dimensions[j] - 1) *
+      (size_t)(s->strides[j] < 0 ? -s->strides[j] : s->strides[j]);
+  if (n < SADDR32_MAX && ext < SADDR32_MAX) {
+    addr32 = 1;
+  }
+
+  err = gpudata_property(s->data, GA_CTX_PROP_ERRBUF, &errbuf);
+  if (err != GA_NO_ERROR)
+    return err;
+
+  err = gen_take_kernel(&k, ctx,
+#if DEBUG
+                        &errstr,
+#else
+                        NULL,
+#endif
+                        c, s, axis, nidx, idx, scatter, addr32);
+#if DEBUG
+  if (errstr != NULL) {
+    fprintf(stderr, "%s\n", errstr);
+    free(errstr);
+  }
+#endif
+  if (err != GA_NO_ERROR)
+    return err;
+
+  err = GpuKernel_sched(&k, n, &gs, &ls);
+  if (err != GA_NO_ERROR)
+    goto out;
+
+  /* The kernel is shared through the cache, so the arguments are
+     passed to the call rather than set on it */
+  args = calloc((s->nd + nidx) * 2 + 7, sizeof(void *));
+  if (args == NULL) {
+    err = error_sys(ctx->err, "calloc");
+    goto out;
+  }
+  argp = 0;
+  args[argp++] = c->data;
+  args[argp++] = (void *)&c->offset;
+  args[argp++] = s->data;
+  args[argp++] = (void *)&s->offset;
+  for (j = 0; j < s->nd; j++) {
+    args[argp++] = (void *)&s->strides[j];
+    args[argp++] = (void *)&s->dimensions[j];
+  }
+  for (j = 0; j < nidx; j++) {
+    args[argp++] = idx[j]->data;
+    args[argp++] = (void *)&idx[j]->offset;
+  }
+  args[argp++] = &m;
+  args[argp++] = &n;
+  args[argp++] = errbuf;
+
+  /* The error buffer is shared by all users of the context */
+  ga_lock_acquire(ctx->lock);
+  err = GpuKernel_call(&k, 1, &gs, &ls, 0, args);
   if (check_error && err == GA_NO_ERROR) {
     err = gpudata_read(&kerr, errbuf, 0, sizeof(int));
     if (err == GA_NO_ERROR && kerr != 0) {
@@ -541,12 +1007,26 @@ int GpuArray_take1(GpuArray *a, const GpuArray *v, const GpuArray *i,
       gpudata_write(errbuf, 0, &kerr, sizeof(int));
     }
   }
+  ga_lock_release(ctx->lock);
+  free(args);
 
 out:
   GpuKernel_clear(&k);
   return err;
 }
 
+int GpuArray_gather(GpuArray *r, const GpuArray *v, unsigned int axis,
+                    unsigned int nidx, const GpuArray **idx,
+                    int check_error) {
+  return ga_take(r, v, axis, nidx, idx, check_error, 0);
+}
+
+int GpuArray_scatter(GpuArray *a, const GpuArray *v, unsigned int axis,
+                     unsigned int nidx, const GpuArray **idx,
+                     int check_error) {
+  return ga_take((GpuArray *)v, a, axis, nidx, idx, check_error, 1);
+}
+
 int GpuArray_setarray(GpuArray *a, const GpuArray *v) {
   gpucontext *ctx = GpuArray_context(a);
   GpuArray tv;
@@ -627,8 +1107,8 @@ int GpuArray_reshape(GpuArray *res, const GpuArray *a, unsigned int nd,
 int GpuArray_reshape_inplace(GpuArray *a, unsigned int nd,
                              const size_t *newdims, ga_order ord) {
   gpucontext *ctx = GpuArray_context(a);
+  shape_tmp t;
   ssize_t *newstrides;
-  size_t *tmpdims;
   size_t np;
   size_t op;
   size_t newsize = 1;
@@ -640,6 +1120,7 @@ int GpuArray_reshape_inplace(GpuArray *a, unsigned int nd,
   unsigned int nk;
   unsigned int ok;
   unsigned int i;
+  int err;
 
   if (ord == GA_ANY_ORDER && GpuArray_ISFORTRAN(a) && a->nd > 1)
     ord = GA_F_ORDER;
@@ -666,9 +1147,9 @@ int GpuArray_reshape_inplace(GpuArray *a, unsigned int nd,
     goto do_final_copy;
   }
 
-  newstrides = calloc(nd, sizeof(ssize_t));
-  if (newstrides == NULL)
+  if (shape_tmp_init(&t, nd) != GA_NO_ERROR)
     return error_sys(ctx->err, "calloc");
+  newstrides = t.strs;
 
   if (newsize != 0) {
     while (ni < nd && oi < a->nd) {
@@ -720,53 +1201,35 @@ int GpuArray_reshape_inplace(GpuArray *a, unsigned int nd,
     }
   }
 
-  /* We can reuse newstrides since it was allocated in this function.
-     Can't do the same with newdims (which is a parameter). */
-  tmpdims = calloc(nd, sizeof(size_t));
-  if (tmpdims == NULL) {
-    return error_sys(ctx->err, "calloc");
-  }
-  memcpy(tmpdims, newdims, nd*sizeof(size_t));
-  a->nd = nd;
-  free(a->dimensions);
-  free(a->strides);
-  a->dimensions = tmpdims;
-  a->strides = newstrides;
-
-  goto fix_flags;
+  goto set_shape;
  need_copy:
-  free(newstrides);
+  shape_tmp_clear(&t);
   return error_set(ctx->err, GA_COPY_ERROR, "Copy is needed but disallowed by parameters");
 
  do_final_copy:
-  tmpdims = calloc(nd, sizeof(size_t));
-  newstrides = calloc(nd, sizeof(ssize_t));
-  if (tmpdims == NULL || newstrides == NULL) {
-    free(tmpdims);
-    free(newstrides);
+  if (shape_tmp_init(&t, nd) != GA_NO_ERROR)
     return error_sys(ctx->err, "calloc");
-  }
-  memcpy(tmpdims, newdims, nd*sizeof(size_t));
+  newstrides = t.strs;
   if (nd > 0) {
     if (ord == GA_F_ORDER) {
       newstrides[0] = gpuarray_get_elsize(a->typecode);
       for (i = 1; i < nd; i++) {
-        newstrides[i] = newstrides[i-1] * tmpdims[i-1];
+        newstrides[i] = newstrides[i-1] * newdims[i-1];
       }
     } else {
       newstrides[nd-1] = gpuarray_get_elsize(a->typecode);
       for (i = nd-1; i > 0; i--) {
-        newstrides[i-1] = newstrides[i] * tmpdims[i];
+        newstrides[i-1] = newstrides[i] * newdims[i];
       }
     }
   }
-  free(a->dimensions);
-  free(a->strides);
-  a->nd = nd;
-  a->dimensions = tmpdims;
-  a->strides = newstrides;
 
- fix_flags:
+ set_shape:
+  /* newdims may point to a->dimensions, ga_shape_set() handles that. */
+  err = ga_shape_set(a, nd, newdims, newstrides);
+  shape_tmp_clear(&t);
+  if (err != GA_NO_ERROR)
+    return error_sys(ctx->err, "calloc");
   GpuArray_fix_flags(a);
   return GA_NO_ERROR;
 }
@@ -784,19 +1247,17 @@ int GpuArray_transpose(GpuArray *res, const GpuArray *a,
 
 int GpuArray_transpose_inplace(GpuArray *a, const unsigned int *new_axes) {
   gpucontext *ctx = GpuArray_context(a);
+  shape_tmp t;
   size_t *newdims;
   ssize_t *newstrs;
   unsigned int i;
   unsigned int j;
   unsigned int k;
 
-  newdims = calloc(a->nd, sizeof(size_t));
-  newstrs = calloc(a->nd, sizeof(ssize_t));
-  if (newdims == NULL || newstrs == NULL) {
-    free(newdims);
-    free(newstrs);
+  if (shape_tmp_init(&t, a->nd) != GA_NO_ERROR)
     return error_set(ctx->err, GA_MEMORY_ERROR, "Out of memory");
-  }
+  newdims = t.dims;
+  newstrs = t.strs;
 
   for (i = 0; i < a->nd; i++) {
     if (new_axes == NULL) {
@@ -806,8 +1267,7 @@ int GpuArray_transpose_inplace(GpuArray *a, const unsigned int *new_axes) {
       // Repeated axes will lead to a broken output
       for (k = 0; k < i; k++)
         if (j == new_axes[k]) {
-          free(newdims);
-          free(newstrs);
+          shape_tmp_clear(&t);
           return error_fmt(ctx->err, GA_VALUE_ERROR,
                            "Repeated axes in transpose: new_axes[%u] == new_axes[%u] == %u",
                            i, k, j);
@@ -817,10 +1277,11 @@ int GpuArray_transpose_inplace(GpuArray *a, const unsigned int *new_axes) {
     newstrs[i] = a->strides[j];
   }
 
-  free(a->dimensions);
-  free(a->strides);
-  a->dimensions = newdims;
-  a->strides = newstrs;
+  if (ga_shape_set(a, a->nd, newdims, newstrs) != GA_NO_ERROR) {
+    shape_tmp_clear(&t);
+    return error_set(ctx->err, GA_MEMORY_ERROR, "Out of memory");
+  }
+  shape_tmp_clear(&t);
 
   GpuArray_fix_flags(a);
 
@@ -830,8 +1291,7 @@ int GpuArray_transpose_inplace(GpuArray *a, const unsigned int *new_axes) {
 void GpuArray_clear(GpuArray *a) {
   if (a->data)
     gpudata_release(a->data);
-  free(a->dimensions);
-  free(a->strides);
+  ga_shape_free(a);
   memset(a, 0, sizeof(*a));
 }
 
@@ -876,20 +1336,342 @@ int GpuArray_move(GpuArray *dst, const GpuArray *src) {
   return gpudata_move(dst->data, dst->offset, src->data, src->offset, sz);
 }
 
+/*
+ * Description of a strided host<->device transfer as a (up to) 3-D
+ * rectangular copy.
+ */
+typedef struct _xfer_rect {
+  size_t doff;
+  ssize_t hoff;
+  size_t width;
+  size_t height;
+  size_t depth;
+  size_t drpitch;
+  size_t dspitch;
+  size_t hrpitch;
+  size_t hspitch;
+} xfer_rect;
+
+typedef struct _xfer_dim {
+  size_t d;
+  ssize_t ds;
+  ssize_t hs;
+} xfer_dim;
+
+/*
+ * Tries to map the transfer between `a` and a host array of the same
+ * shape with strides `hstr` to a rectangular copy.
+ *
+ * Dimensions of size 1 are dropped, dimensions with negative strides
+ * on both sides are flipped and dimensions that are contiguous on
+ * both sides are collapsed.  The copy is possible if at most two
+ * dimensions remain after the innermost contiguous run.
+ *
+ * Returns 1 if `r` was filled, 0 if the layout needs the packed path
+ * and -1 on memory errors.
+ */
+static int xfer_rect_layout(xfer_rect *r, const GpuArray *a,
+                            const ssize_t *hstr) {
+  xfer_dim _dd[GA_INLINE_ND];
+  xfer_dim *dd = _dd;
+  xfer_dim t;
+  size_t elsz = gpuarray_get_elsize(a->typecode);
+  unsigned int i, j, n, m;
+  int res = 0;
+
+  if (a->nd > GA_INLINE_ND) {
+    dd = calloc(a->nd, sizeof(xfer_dim));
+    if (dd == NULL) return -1;
+  }
+
+  r->doff = a->offset;
+  r->hoff = 0;
+  n = 0;
+  for (i = 0; i < a->nd; i++) {
+    if (a->dimensions[i] == 1) continue;
+    t.d = a->dimensions[i];
+    t.ds = a->strides[i];
+    t.hs = hstr[i];
+    if (t.ds < 0 && t.hs < 0) {
+      r->doff += (t.d - 1) * t.ds;
+      r->hoff += (t.d - 1) * t.hs;
+      t.ds = -t.ds;
+      t.hs = -t.hs;
+    }
+    if (t.ds <= 0 || t.hs <= 0) goto done;
+    /* Insertion sort by decreasing device stride */
+    for (j = n; j > 0 && dd[j-1].ds < t.ds; j--)
+      dd[j] = dd[j-1];
+    dd[j] = t;
+    n++;
+  }
+
+  m = 0;
+  for (i = 0; i < n; i++) {
+    if (m > 0 && dd[m-1].ds == dd[i].ds * (ssize_t)dd[i].d &&
+        dd[m-1].hs == dd[i].hs * (ssize_t)dd[i].d) {
+      dd[m-1].d *= dd[i].d;
+      dd[m-1].ds = dd[i].ds;
+      dd[m-1].hs = dd[i].hs;
+    } else {
+      dd[m++] = dd[i];
+    }
+  }
+
+  r->width = elsz;
+  if (m > 0 && dd[m-1].ds == (ssize_t)elsz && dd[m-1].hs == (ssize_t)elsz) {
+    r->width *= dd[m-1].d;
+    m--;
+  }
+  if (m > 2) goto done;
+
+  r->height = 1;
+  r->drpitch = r->hrpitch = r->width;
+  if (m > 0) {
+    r->height = dd[m-1].d;
+    r->drpitch = dd[m-1].ds;
+    r->hrpitch = dd[m-1].hs;
+  }
+  r->depth = 1;
+  r->dspitch = r->drpitch * r->height;
+  r->hspitch = r->hrpitch * r->height;
+  if (m > 1) {
+    r->depth = dd[0].d;
+    r->dspitch = dd[0].ds;
+    r->hspitch = dd[0].hs;
+  }
+
+  if (r->drpitch < r->width || r->hrpitch < r->width ||
+      r->dspitch < r->drpitch * r->height ||
+      r->hspitch < r->hrpitch * r->height ||
+      r->dspitch % r->drpitch != 0 || r->hspitch % r->hrpitch != 0)
+    goto done;
+
+  res = 1;
+ done:
+  if (dd != _dd) free(dd);
+  return res;
+}
+
+static size_t xfer_size(const GpuArray *a) {
+  size_t sz = gpuarray_get_elsize(a->typecode);
+  unsigned int i;
+
+  for (i = 0; i < a->nd; i++)
+    sz *= a->dimensions[i];
+  return sz;
+}
+
+static void host_strided_copy(char *dst, const ssize_t *dstr,
+                              const char *src, const ssize_t *sstr,
+                              unsigned int nd, const size_t *dims,
+                              size_t elsz) {
+  size_t i;
+
+  if (nd == 0) {
+    memcpy(dst, src, elsz);
+    return;
+  }
+  for (i = 0; i < dims[0]; i++)
+    host_strided_copy(dst + (ssize_t)i * dstr[0], dstr + 1,
+                      src + (ssize_t)i * sstr[0], sstr + 1,
+                      nd - 1, dims + 1, elsz);
+}
+
+/*
+ * Returns 1 if the host strides describe a dense block of memory
+ * starting at the base pointer.
+ */
+static int host_dense(const GpuArray *a, const ssize_t *hstr) {
+  size_t expected = gpuarray_get_elsize(a->typecode);
+  unsigned int i, j;
+
+  for (i = 0; i < a->nd; i++) {
+    for (j = 0; j < a->nd; j++)
+      if (a->dimensions[j] != 1 && hstr[j] == (ssize_t)expected)
+        break;
+    if (j == a->nd) break;
+    expected *= a->dimensions[j];
+  }
+  return expected == xfer_size(a);
+}
+
+/*
+ * Prepares a contiguous device temporary for the packed transfer
+ * path.  If the host side is dense its layout is reused, otherwise a
+ * C-contiguous layout is used and the host data needs to be packed.
+ */
+static int xfer_tmp(GpuArray *tmp, const GpuArray *a, const ssize_t *hstr,
+                    int *packed) {
+  gpucontext *ctx = GpuArray_context(a);
+  gpudata *buf;
+  int err;
+
+  if (host_dense(a, hstr)) {
+    *packed = 0;
+    buf = gpudata_alloc(ctx, xfer_size(a), NULL, 0, &err);
+    if (buf == NULL) return err;
+    err = GpuArray_fromdata(tmp, buf, 0, a->typecode, a->nd, a->dimensions,
+                            hstr, 1);
+    gpudata_release(buf);
+    return err;
+  }
+  *packed = 1;
+  return GpuArray_empty(tmp, ctx, a->typecode, a->nd, a->dimensions,
+                        GA_C_ORDER);
+}
+
+int GpuArray_write_strided(GpuArray *dst, const void *src,
+                           const ssize_t *src_strides) {
+  gpucontext *ctx = GpuArray_context(dst);
+  GpuArray tmp;
+  xfer_rect r;
+  void *pk = NULL;
+  size_t sz;
+  int packed;
+  int err;
+
+  if (!GpuArray_ISWRITEABLE(dst))
+    return error_set(ctx->err, GA_VALUE_ERROR, "Destination array (dst) not writeable");
+  sz = xfer_size(dst);
+  if (sz == 0)
+    return GA_NO_ERROR;
+
+  switch (xfer_rect_layout(&r, dst, src_strides)) {
+  case -1:
+    return error_set(ctx->err, GA_MEMORY_ERROR, "Out of memory");
+  case 1:
+    if (r.height == 1 && r.depth == 1)
+      return gpudata_write(dst->data, r.doff, (const char *)src + r.hoff,
+                           r.width);
+    return gpudata_write_rect(dst->data, r.doff, r.drpitch, r.dspitch,
+                              (const char *)src + r.hoff,
+                              r.hrpitch, r.hspitch,
+                              r.width, r.height, r.depth);
+  }
+
+  err = xfer_tmp(&tmp, dst, src_strides, &packed);
+  if (err != GA_NO_ERROR) return err;
+  if (packed) {
+    pk = malloc(sz);
+    if (pk == NULL) {
+      GpuArray_clear(&tmp);
+      return error_set(ctx->err, GA_MEMORY_ERROR, "Out of memory");
+    }
+    host_strided_copy(pk, tmp.strides, src, src_strides,
+                      dst->nd, dst->dimensions,
+                      gpuarray_get_elsize(dst->typecode));
+  }
+  err = gpudata_write(tmp.data, 0, packed ? pk : src, sz);
+  if (err == GA_NO_ERROR)
+    err = GpuArray_move(dst, &tmp);
+  free(pk);
+  GpuArray_clear(&tmp);
+  return err;
+}
+
+int GpuArray_read_strided(void *dst, const ssize_t *dst_strides,
+                          const GpuArray *src) {
+  gpucontext *ctx = GpuArray_context(src);
+  GpuArray tmp;
+  xfer_rect r;
+  void *pk = NULL;
+  size_t sz;
+  int packed;
+  int err;
+
+  sz = xfer_size(src);
+  if (sz == 0)
+    return GA_NO_ERROR;
+
+  switch (xfer_rect_layout(&r, src, dst_strides)) {
+  case -1:
+    return error_set(ctx->err, GA_MEMORY_ERROR, "Out of memory");
+  case 1:
+    if (r.height == 1 && r.depth == 1)
+      return gpudata_read((char *)dst + r.hoff, src->data, r.doff, r.width);
+    return gpudata_read_rect((char *)dst + r.hoff, r.hrpitch, r.hspitch,
+                             src->data, r.doff, r.drpitch, r.dspitch,
+                             r.width, r.height, r.depth);
+  }
+
+  err = xfer_tmp(&tmp, src, dst_strides, &packed);
+  if (err != GA_NO_ERROR) return err;
+  if (packed) {
+    pk = malloc(sz);
+    if (pk == NULL) {
+      GpuArray_clear(&tmp);
+      return error_set(ctx->err, GA_MEMORY_ERROR, "Out of memory");
+    }
+  }
+  err = GpuArray_move(&tmp, src);
+  if (err == GA_NO_ERROR)
+    err = gpudata_read(packed ? pk : dst, tmp.data, 0, sz);
+  if (err == GA_NO_ERROR && packed)
+    host_strided_copy(dst, dst_strides, pk, tmp.strides,
+                      src->nd, src->dimensions,
+                      gpuarray_get_elsize(src->typecode));
+  free(pk);
+  GpuArray_clear(&tmp);
+  return err;
+}
+
+/*
+ * Computes the C-contiguous host strides for the shape of `a`.
+ * Returns `buf` if it is large enough or a newly allocated array.
+ */
+static ssize_t *host_c_strides(ssize_t *buf, const GpuArray *a) {
+  ssize_t *strs = buf;
+  size_t sz = gpuarray_get_elsize(a->typecode);
+  unsigned int i;
+
+  if (a->nd > GA_INLINE_ND) {
+    strs = calloc(a->nd, sizeof(ssize_t));
+    if (strs == NULL) return NULL;
+  }
+  for (i = a->nd; i > 0; i--) {
+    strs[i-1] = sz;
+    sz *= a->dimensions[i-1];
+  }
+  return strs;
+}
+
 int GpuArray_write(GpuArray *dst, const void *src, size_t src_sz) {
   gpucontext *ctx = GpuArray_context(dst);
+  ssize_t _strs[GA_INLINE_ND];
+  ssize_t *strs;
+  int err;
+
   if (!GpuArray_ISWRITEABLE(dst))
     return error_set(ctx->err, GA_VALUE_ERROR, "Destination array (dst) not writeable");
-  if (!GpuArray_ISONESEGMENT(dst))
-    return error_set(ctx->err, GA_UNSUPPORTED_ERROR, "Destination array (dst) not one segment");
-  return gpudata_write(dst->data, dst->offset, src, src_sz);
+  if (GpuArray_ISONESEGMENT(dst))
+    return gpudata_write(dst->data, dst->offset, src, src_sz);
+  if (src_sz != xfer_size(dst))
+    return error_set(ctx->err, GA_VALUE_ERROR, "Source size does not match non-contiguous destination array (dst)");
+  strs = host_c_strides(_strs, dst);
+  if (strs == NULL)
+    return error_set(ctx->err, GA_MEMORY_ERROR, "Out of memory");
+  err = GpuArray_write_strided(dst, src, strs);
+  if (strs != _strs) free(strs);
+  return err;
 }
 
 int GpuArray_read(void *dst, size_t dst_sz, const GpuArray *src) {
   gpucontext *ctx = GpuArray_context(src);
-  if (!GpuArray_ISONESEGMENT(src))
-    return error_set(ctx->err, GA_UNSUPPORTED_ERROR, "Array (src) not one segment");
-  return gpudata_read(dst, src->data, src->offset, dst_sz);
+  ssize_t _strs[GA_INLINE_ND];
+  ssize_t *strs;
+  int err;
+
+  if (GpuArray_ISONESEGMENT(src))
+    return gpudata_read(dst, src->data, src->offset, dst_sz);
+  if (dst_sz != xfer_size(src))
+    return error_set(ctx->err, GA_VALUE_ERROR, "Destination size does not match non-contiguous array (src)");
+  strs = host_c_strides(_strs, src);
+  if (strs == NULL)
+    return error_set(ctx->err, GA_MEMORY_ERROR, "Out of memory");
+  err = GpuArray_read_strided(dst, strs, src);
+  if (strs != _strs) free(strs);
+  return err;
 }
 
 int GpuArray_memset(GpuArray *a, int data) {
@@ -912,13 +1694,13 @@ int GpuArray_copy(GpuArray *res, const GpuArray *a, ga_order order) {
 
 int GpuArray_transfer(GpuArray *res, const GpuArray *a) {
   gpucontext *ctx = GpuArray_context(res);
+  gpucontext *actx = GpuArray_context(a);
+  GpuArray tmp_a, tmp_r;
+  const GpuArray *src = a;
+  GpuArray *dst = res;
   size_t sz;
   unsigned int i;
-
-  if (!GpuArray_ISONESEGMENT(res))
-    return error_set(ctx->err, GA_UNSUPPORTED_ERROR, "Array (res) not one segment");
-  if (!GpuArray_ISONESEGMENT(a))
-    return error_set(ctx->err, GA_UNSUPPORTED_ERROR, "Array (a) not one segment");
+  int err;
 
   if (res->typecode != a->typecode)
     return error_set(ctx->err, GA_UNSUPPORTED_ERROR, "typecode mismatch");
@@ -926,7 +1708,105 @@ int GpuArray_transfer(GpuArray *res, const GpuArray *a) {
   sz = gpuarray_get_elsize(a->typecode);
   for (i = 0; i < a->nd; i++) sz *= a->dimensions[i];
 
- return gpudata_transfer(res->data, res->offset, a->data, a->offset, sz);
+  if (GpuArray_ISONESEGMENT(res) && GpuArray_ISONESEGMENT(a))
+    return gpudata_transfer(res->data, res->offset, a->data, a->offset, sz);
+
+  if (actx == ctx)
+    return GpuArray_move(res, a);
+
+  if (res->nd != a->nd)
+    return error_fmt(ctx->err, GA_VALUE_ERROR, "Dimension mismatch. "
+                     "res->nd = %u, a->nd = %u", res->nd, a->nd);
+  for (i = 0; i < a->nd; i++) {
+    if (res->dimensions[i] != a->dimensions[i])
+      return error_fmt(ctx->err, GA_VALUE_ERROR, "Dimension mismatch. "
+                       "res->dimensions[%u] = %" SPREFIX "u, "
+                       "a->dimensions[%u] = %" SPREFIX "u",
+                       i, res->dimensions[i], i, a->dimensions[i]);
+  }
+
+  /* Pack on the source device and unpack on the destination device
+     so that only dense data goes between them. */
+  if (!GpuArray_IS_C_CONTIGUOUS(a)) {
+    err = GpuArray_copy(&tmp_a, a, GA_C_ORDER);
+    if (err != GA_NO_ERROR)
+      return error_set(ctx->err, err, error_msg(actx->err));
+    src = &tmp_a;
+  }
+  if (!GpuArray_IS_C_CONTIGUOUS(res)) {
+    err = GpuArray_empty(&tmp_r, ctx, res->typecode, res->nd,
+                         res->dimensions, GA_C_ORDER);
+    if (err != GA_NO_ERROR)
+      goto out;
+    dst = &tmp_r;
+  }
+
+  err = gpudata_transfer(dst->data, dst->offset, src->data, src->offset, sz);
+  if (err == GA_NO_ERROR && dst != res)
+    err = GpuArray_move(res, dst);
+
+ out:
+  if (src != a)
+    GpuArray_clear(&tmp_a);
+  if (dst != res)
+    GpuArray_clear(&tmp_r);
+  return err;
+}
+
+int GpuArray_transfer_many(GpuArray **rs, const GpuArray **as, size_t n) {
+  gpudata **dst = NULL, **src = NULL;
+  size_t *dstoff = NULL, *srcoff = NULL, *sz = NULL;
+  size_t i, k = 0;
+  unsigned int j;
+  int err = GA_NO_ERROR;
+
+  if (n == 0)
+    return GA_NO_ERROR;
+
+  dst = calloc(n, sizeof(gpudata *));
+  src = calloc(n, sizeof(gpudata *));
+  dstoff = calloc(n, sizeof(size_t));
+  srcoff = calloc(n, sizeof(size_t));
+  sz = calloc(n, sizeof(size_t));
+  if (dst == NULL || src == NULL || dstoff == NULL || srcoff == NULL ||
+      sz == NULL) {
+    err = error_sys(GpuArray_context(rs[0])->err, "calloc");
+    goto out;
+  }
+
+  /* Contiguous pairs go together, the others through
+     GpuArray_transfer() since they need temporaries anyway. */
+  for (i = 0; i < n; i++) {
+    if (rs[i]->typecode != as[i]->typecode) {
+      err = error_fmt(GpuArray_context(rs[i])->err, GA_UNSUPPORTED_ERROR,
+                      "typecode mismatch (rs[%" SPREFIX "u])", i);
+      goto out;
+    }
+    if (GpuArray_context(rs[i]) == GpuArray_context(as[i]) ||
+        !GpuArray_ISONESEGMENT(rs[i]) || !GpuArray_ISONESEGMENT(as[i])) {
+      err = GpuArray_transfer(rs[i], as[i]);
+      if (err != GA_NO_ERROR)
+        goto out;
+      continue;
+    }
+    dst[k] = rs[i]->data;
+    dstoff[k] = rs[i]->offset;
+    src[k] = as[i]->data;
+    srcoff[k] = as[i]->offset;
+    sz[k] = gpuarray_get_elsize(as[i]->typecode);
+    for (j = 0; j < as[i]->nd; j++) sz[k] *= as[i]->dimensions[j];
+    k++;
+  }
+
+  err = gpudata_transfer_many(dst, dstoff, src, srcoff, sz, k);
+
+ out:
+  free(dst);
+  free(src);
+  free(dstoff);
+  free(srcoff);
+  free(sz);
+  return err;
 }
 
 int GpuArray_split(GpuArray **rs, const GpuArray *a, size_t n, size_t *p,
@@ -103,15 +103,20 @@ int GpuArray_rgemv(cb_transpose transA, double alpha, GpuArray *A,
   GpuArray *Xp = X;
   GpuArray copyX;
   GpuArray *Yp = Y;
+  GpuArray tmp;
   gpucontext *ctx = gpudata_context(Ap->data);
   size_t elsize;
   size_t m, n, lda;
   cb_order o;
+  float cab[4];
+  double zab[4];
   int err;
 
   if (A->typecode != GA_HALF &&
       A->typecode != GA_FLOAT &&
-      A->typecode != GA_DOUBLE)
+      A->typecode != GA_DOUBLE &&
+      A->typecode != GA_CFLOAT &&
+      A->typecode != GA_CDOUBLE)
     return error_set(ctx->err, GA_INVALID_ERROR, "Unsupported dtype");
 
   if (A->nd != 2 || X->nd != 1 || Y->nd != 1)
@@ -165,6 +170,20 @@ int GpuArray_rgemv(cb_transpose transA, double alpha, GpuArray *A,
     err = error_set(ctx->err, GA_VALUE_ERROR, "Negative strides for Y");
     goto cleanup;
   }
+  /* Not all libraries can conjugate a row-major matrix */
+  if (transA == cb_conj_trans && !(Ap->flags & GA_F_CONTIGUOUS)) {
+    if (nocopy) {
+      err = error_set(ctx->err, GA_COPY_ERROR, "Copy required for A");
+      goto cleanup;
+    }
+    err = GpuArray_copy(&tmp, Ap, GA_F_ORDER);
+    if (err != GA_NO_ERROR)
+      goto cleanup;
+    if (Ap == &copyA)
+      GpuArray_clear(&copyA);
+    copyA = tmp;
+    Ap = &copyA;
+  }
 
   if (Ap->flags & GA_F_CONTIGUOUS) {
     o = cb_fortran;
@@ -192,6 +211,14 @@ int GpuArray_rgemv(cb_transpose transA, double alpha, GpuArray *A,
   case GA_DOUBLE:
     err = gpublas_dgemv(o, transA, m, n, (double)alpha, Ap->data, Ap->offset / elsize, lda, Xp->data, Xp->offset / elsize, Xp->strides[0] / elsize, (double)beta, Yp->data, Yp->offset / elsize, Yp->strides[0] / elsize);
     break;
+  case GA_CFLOAT:
+    cab[0] = (float)alpha; cab[1] = 0; cab[2] = (float)beta; cab[3] = 0;
+    err = gpublas_cgemv(o, transA, m, n, cab, Ap->data, Ap->offset / elsize, lda, Xp->data, Xp->offset / elsize, Xp->strides[0] / elsize, cab + 2, Yp->data, Yp->offset / elsize, Yp->strides[0] / elsize);
+    break;
+  case GA_CDOUBLE:
+    zab[0] = alpha; zab[1] = 0; zab[2] = beta; zab[3] = 0;
+    err = gpublas_zgemv(o, transA, m, n, zab, Ap->data, Ap->offset / elsize, lda, Xp->data, Xp->offset / elsize, Xp->strides[0] / elsize, zab + 2, Yp->data, Yp->offset / elsize, Yp->strides[0] / elsize);
+    break;
   }
  cleanup:
   if (Ap == &copyA)
@@ -209,14 +236,18 @@ int GpuArray_rgemm(cb_transpose transA, cb_transpose transB, double alpha,
   GpuArray *Bp = B;
   GpuArray copyB;
   GpuArray *Cp = C;
+  GpuArray tmp;
   gpucontext *ctx = gpudata_context(Ap->data);
   size_t elsize;
   size_t m, n, k, lda, ldb, ldc;
   cb_order o;
+  float cab[4];
+  double zab[4];
   int err;
 
   if (A->typecode != GA_HALF && A->typecode != GA_FLOAT &&
-      A->typecode != GA_DOUBLE)
+      A->typecode != GA_DOUBLE && A->typecode != GA_CFLOAT &&
+      A->typecode != GA_CDOUBLE)
     return error_set(ctx->err, GA_INVALID_ERROR, "Unsupported dtype");
 
   if (A->nd != 2 || B->nd != 2 || C->nd != 2)
@@ -288,6 +319,21 @@ int GpuArray_rgemm(cb_transpose transA, cb_transpose transB, double alpha,
     err = error_set(ctx->err, GA_VALUE_ERROR, "Noncontiguous C");
     goto cleanup;
   }
+  /* Flipping the layout can't keep the conjugation */
+  if (transA == cb_conj_trans &&
+      !(Ap->flags & (o == cb_c ? GA_C_CONTIGUOUS : GA_F_CONTIGUOUS))) {
+    if (nocopy) {
+      err = error_set(ctx->err, GA_COPY_ERROR, "Need copy for A");
+      goto cleanup;
+    }
+    err = GpuArray_copy(&tmp, Ap, o == cb_c ? GA_C_ORDER : GA_F_ORDER);
+    if (err != GA_NO_ERROR)
+      goto cleanup;
+    if (Ap == &copyA)
+      GpuArray_clear(&copyA);
+    copyA = tmp;
+    Ap = &copyA;
+  }
   if (Ap->flags & GA_F_CONTIGUOUS) {
     lda = Ap->dimensions[0];
     if (o == cb_c) {
@@ -308,6 +354,20 @@ int GpuArray_rgemm(cb_transpose transA, cb_transpose transB, double alpha,
     err = error_set(ctx->err, GA_VALUE_ERROR, "Noncontiguous A");
     goto cleanup;
   }
+  if (transB == cb_conj_trans &&
+      !(Bp->flags & (o == cb_c ? GA_C_CONTIGUOUS : GA_F_CONTIGUOUS))) {
+    if (nocopy) {
+      err = error_set(ctx->err, GA_COPY_ERROR, "Need copy for B");
+      goto cleanup;
+    }
+    err = GpuArray_copy(&tmp, Bp, o == cb_c ? GA_C_ORDER : GA_F_ORDER);
+    if (err != GA_NO_ERROR)
+      goto cleanup;
+    if (Bp == &copyB)
+      GpuArray_clear(&copyB);
+    copyB = tmp;
+    Bp = &copyB;
+  }
   if (Bp->flags & GA_F_CONTIGUOUS) {
     ldb = Bp->dimensions[0];
     if (o == cb_c) {
@@ -344,6 +404,14 @@ int GpuArray_rgemm(cb_transpose transA, cb_transpose transB, double alpha,
   case GA_DOUBLE:
     err = gpublas_dgemm(o, transA, transB, m, n, k, (double)alpha, Ap->data, Ap->offset / elsize, lda, Bp->data, Bp->offset / elsize, ldb, (double)beta, Cp->data, Cp->offset / elsize, ldc);
     break;
+  case GA_CFLOAT:
+    cab[0] = (float)alpha; cab[1] = 0; cab[2] = (float)beta; cab[3] = 0;
+    err = gpublas_cgemm(o, transA, transB, m, n, k, cab, Ap->data, Ap->offset / elsize, lda, Bp->data, Bp->offset / elsize, ldb, cab + 2, Cp->data, Cp->offset / elsize, ldc);
+    break;
+  case GA_CDOUBLE:
+    zab[0] = alpha; zab[1] = 0; zab[2] = beta; zab[3] = 0;
+    err = gpublas_zgemm(o, transA, transB, m, n, k, zab, Ap->data, Ap->offset / elsize, lda, Bp->data, Bp->offset / elsize, ldb, zab + 2, Cp->data, Cp->offset / elsize, ldc);
+    break;
   }
 
  cleanup:
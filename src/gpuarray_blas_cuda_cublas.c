@@ -264,12 +264,18 @@ static int setup(gpucontext *c) {
   e = GpuKernel_init(&handle->dgerBH_gen_small, c, 1, &code_dgerBH_gen_small, NULL, "_dgerBH_gen_small", 10, types, GA_USE_DOUBLE, NULL);
   if (e != GA_NO_ERROR) goto e6;
 
-  ctx->blas_handle = handle;
-
-  cuda_exit(ctx);
-
-  return GA_NO_ERROR;
+  /* Another thread may have done the setup meanwhile */
+  ga_lock_acquire(ctx->lock);
+  if (ctx->blas_handle == NULL) {
+    ctx->blas_handle = handle;
+    ga_lock_release(ctx->lock);
+    cuda_exit(ctx);
+    return GA_NO_ERROR;
+  }
+  ga_lock_release(ctx->lock);
+  e = GA_NO_ERROR;
 
+  GpuKernel_clear(&handle->dgerBH_gen_small);
  e6:
   GpuKernel_clear(&handle->sgerBH_gen_small);
  e5:
@@ -425,6 +431,128 @@ static int dgemm(cb_order order, cb_transpose transA, cb_transpose transB,
   return GA_NO_ERROR;
 }
 
+static int cgemm(cb_order order, cb_transpose transA, cb_transpose transB,
+                 size_t M, size_t N, size_t K, const float *alpha,
+                 gpudata *A, size_t offA, size_t lda,
+                 gpudata *B, size_t offB, size_t ldb,
+                 const float *beta, gpudata *C, size_t offC, size_t ldc) {
+  cuda_context *ctx = A->ctx;
+  blas_handle *h = (blas_handle *)ctx->blas_handle;
+  gpudata *T;
+  size_t t;
+  cb_transpose transT;
+
+  ASSERT_BUF(A);
+  ASSERT_BUF(B);
+  ASSERT_BUF(C);
+
+  if (LARGE_VAL(M) || LARGE_VAL(N) || LARGE_VAL(K) ||
+      LARGE_VAL(lda) || LARGE_VAL(ldb) || LARGE_VAL(ldc) ||
+      LARGE_VAL(M * N) || LARGE_VAL(M * K) || LARGE_VAL(K * N))
+    return error_set(ctx->err, GA_XLARGE_ERROR, "Passed-in sizes would overflow the ints in the cublas interface");
+
+  if (order == cb_c) {
+    /* swap A and B */
+    t = N;
+    N = M;
+    M = t;
+    T = A;
+    A = B;
+    B = T;
+    t = lda;
+    lda = ldb;
+    ldb = t;
+    transT = transA;
+    transA = transB;
+    transB = transT;
+    t = offA;
+    offA = offB;
+    offB = t;
+  }
+
+  cuda_enter(ctx);
+
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_wait(A, CUDA_WAIT_READ));
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_wait(B, CUDA_WAIT_READ));
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_wait(C, CUDA_WAIT_ALL));
+
+  CUBLAS_EXIT_ON_ERROR(ctx, cublasCgemm(h->h,
+                                        convT(transA), convT(transB), M, N, K,
+                                        (const cuComplex *)alpha,
+                                        ((cuComplex *)A->ptr) + offA, lda,
+                                        ((cuComplex *)B->ptr) + offB, ldb,
+                                        (const cuComplex *)beta,
+                                        ((cuComplex *)C->ptr) + offC, ldc));
+
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_record(A, CUDA_WAIT_READ));
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_record(B, CUDA_WAIT_READ));
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_record(C, CUDA_WAIT_ALL));
+
+  cuda_exit(ctx);
+  return GA_NO_ERROR;
+}
+
+static int zgemm(cb_order order, cb_transpose transA, cb_transpose transB,
+                 size_t M, size_t N, size_t K, const double *alpha,
+                 gpudata *A, size_t offA, size_t lda,
+                 gpudata *B, size_t offB, size_t ldb,
+                 const double *beta, gpudata *C, size_t offC, size_t ldc) {
+  cuda_context *ctx = A->ctx;
+  blas_handle *h = (blas_handle *)ctx->blas_handle;
+  gpudata *T;
+  size_t t;
+  cb_transpose transT;
+
+  ASSERT_BUF(A);
+  ASSERT_BUF(B);
+  ASSERT_BUF(C);
+
+  if (LARGE_VAL(M) || LARGE_VAL(N) || LARGE_VAL(K) ||
+      LARGE_VAL(lda) || LARGE_VAL(ldb) || LARGE_VAL(ldc) ||
+      LARGE_VAL(M * N) || LARGE_VAL(M * K) || LARGE_VAL(K * N))
+    return error_set(ctx->err, GA_XLARGE_ERROR, "Passed-in sizes would overflow the ints in the cublas interface");
+
+  if (order == cb_c) {
+    /* swap A and B */
+    t = N;
+    N = M;
+    M = t;
+    T = A;
+    A = B;
+    B = T;
+    t = lda;
+    lda = ldb;
+    ldb = t;
+    transT = transA;
+    transA = transB;
+    transB = transT;
+    t = offA;
+    offA = offB;
+    offB = t;
+  }
+
+  cuda_enter(ctx);
+
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_wait(A, CUDA_WAIT_READ));
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_wait(B, CUDA_WAIT_READ));
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_wait(C, CUDA_WAIT_ALL));
+
+  CUBLAS_EXIT_ON_ERROR(ctx, cublasZgemm(h->h,
+                                        convT(transA), convT(transB), M, N, K,
+                                        (const cuDoubleComplex *)alpha,
+                                        ((cuDoubleComplex *)A->ptr) + offA, lda,
+                                        ((cuDoubleComplex *)B->ptr) + offB, ldb,
+                                        (const cuDoubleComplex *)beta,
+                                        ((cuDoubleComplex *)C->ptr) + offC, ldc));
+
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_record(A, CUDA_WAIT_READ));
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_record(B, CUDA_WAIT_READ));
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_record(C, CUDA_WAIT_ALL));
+
+  cuda_exit(ctx);
+  return GA_NO_ERROR;
+}
+
 static int hgemm(cb_order order, cb_transpose transA, cb_transpose transB,
                  size_t M, size_t N, size_t K, float alpha,
                  gpudata *A, size_t offA, size_t lda,
@@ -823,7 +951,7 @@ static int sgemmBatch(cb_order order, cb_transpose transA, cb_transpose transB,
                        NULL, 0, NULL);
     if (Ta == NULL) {
       cuda_exit(ctx);
-      return ctx->err->code;
+      return error_code(ctx->err);
     }
     Aa = *(CUdeviceptr *)Ta;
     Ba = Aa + (batchCount * sizeof(float *));
@@ -832,7 +960,7 @@ static int sgemmBatch(cb_order order, cb_transpose transA, cb_transpose transB,
     if (gpudata_write(Ta, 0, T_l, sizeof(float *) * batchCount * 3) != GA_NO_ERROR) {
       gpudata_release(Ta);
       cuda_exit(ctx);
-      return ctx->err->code;
+      return error_code(ctx->err);
     }
 
     err = cublasSgemmBatched(h->h,
@@ -950,7 +1078,7 @@ static int dgemmBatch(cb_order order, cb_transpose transA, cb_transpose transB,
                        NULL, 0, NULL);
     if (Ta == NULL) {
       cuda_exit(ctx);
-      return ctx->err->code;
+      return error_code(ctx->err);
     }
     Aa = *(CUdeviceptr *)Ta;
     Ba = Aa + (batchCount * sizeof(double *));
@@ -959,7 +1087,7 @@ static int dgemmBatch(cb_order order, cb_transpose transA, cb_transpose transB,
     if (gpudata_write(Ta, 0, T_l, sizeof(double *) * batchCount * 3) != GA_NO_ERROR) {
       gpudata_release(Ta);
       cuda_exit(ctx);
-      return ctx->err->code;
+      return error_code(ctx->err);
     }
 
     err = cublasDgemmBatched(h->h,
@@ -1164,6 +1292,114 @@ static int dgemv(cb_order order, cb_transpose transA, size_t M, size_t N,
   return GA_NO_ERROR;
 }
 
+static int cgemv(cb_order order, cb_transpose transA, size_t M, size_t N,
+                 const float *alpha, gpudata *A, size_t offA, size_t lda,
+                 gpudata *X, size_t offX, int incX,
+                 const float *beta, gpudata *Y, size_t offY, int incY) {
+  cuda_context *ctx = A->ctx;
+  blas_handle *h = (blas_handle *)ctx->blas_handle;
+  size_t t;
+
+  ASSERT_BUF(A);
+  ASSERT_BUF(X);
+  ASSERT_BUF(Y);
+
+  if (LARGE_VAL(M) || LARGE_VAL(N) || LARGE_VAL(M * N) ||
+      LARGE_VAL(lda) || LARGE_VAL(incX) || LARGE_VAL(incY))
+    return error_set(ctx->err, GA_XLARGE_ERROR, "Passed-in sizes would overflow the ints in the cublas interface");
+
+  if (order == cb_c) {
+    /* cublas can't conjugate without transposing */
+    if (transA == cb_conj_trans)
+      return error_set(ctx->err, GA_DEVSUP_ERROR, "Conjugate transpose of a row-major matrix is not supported");
+    t = N;
+    N = M;
+    M = t;
+
+    if (transA == cb_no_trans) {
+      transA = cb_trans;
+    } else {
+      transA = cb_no_trans;
+    }
+  }
+
+  cuda_enter(ctx);
+
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_wait(A, CUDA_WAIT_READ));
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_wait(X, CUDA_WAIT_READ));
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_wait(Y, CUDA_WAIT_ALL));
+
+  CUBLAS_EXIT_ON_ERROR(ctx, cublasCgemv(h->h,
+                                        convT(transA), M, N,
+                                        (const cuComplex *)alpha,
+                                        ((cuComplex *)A->ptr) + offA, lda,
+                                        ((cuComplex *)X->ptr) + offX, incX,
+                                        (const cuComplex *)beta,
+                                        ((cuComplex *)Y->ptr) + offY, incY));
+
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_record(A, CUDA_WAIT_READ));
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_record(X, CUDA_WAIT_READ));
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_record(Y, CUDA_WAIT_ALL));
+
+  cuda_exit(ctx);
+
+  return GA_NO_ERROR;
+}
+
+static int zgemv(cb_order order, cb_transpose transA, size_t M, size_t N,
+                 const double *alpha, gpudata *A, size_t offA, size_t lda,
+                 gpudata *X, size_t offX, int incX,
+                 const double *beta, gpudata *Y, size_t offY, int incY) {
+  cuda_context *ctx = A->ctx;
+  blas_handle *h = (blas_handle *)ctx->blas_handle;
+  size_t t;
+
+  ASSERT_BUF(A);
+  ASSERT_BUF(X);
+  ASSERT_BUF(Y);
+
+  if (LARGE_VAL(M) || LARGE_VAL(N) || LARGE_VAL(M * N) ||
+      LARGE_VAL(lda) || LARGE_VAL(incX) || LARGE_VAL(incY))
+    return error_set(ctx->err, GA_XLARGE_ERROR, "Passed-in sizes would overflow the ints in the cublas interface");
+
+  if (order == cb_c) {
+    /* cublas can't conjugate without transposing */
+    if (transA == cb_conj_trans)
+      return error_set(ctx->err, GA_DEVSUP_ERROR, "Conjugate transpose of a row-major matrix is not supported");
+    t = N;
+    N = M;
+    M = t;
+
+    if (transA == cb_no_trans) {
+      transA = cb_trans;
+    } else {
+      transA = cb_no_trans;
+    }
+  }
+
+  cuda_enter(ctx);
+
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_wait(A, CUDA_WAIT_READ));
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_wait(X, CUDA_WAIT_READ));
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_wait(Y, CUDA_WAIT_ALL));
+
+  CUBLAS_EXIT_ON_ERROR(ctx, cublasZgemv(h->h,
+                                        convT(transA), M, N,
+                                        (const cuDoubleComplex *)alpha,
+                                        ((cuDoubleComplex *)A->ptr) + offA, lda,
+                                        ((cuDoubleComplex *)X->ptr) + offX, incX,
+                                        (const cuDoubleComplex *)beta,
+                                        ((cuDoubleComplex *)Y->ptr) + offY, incY));
+
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_record(A, CUDA_WAIT_READ));
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_record(X, CUDA_WAIT_READ));
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_record(Y, CUDA_WAIT_ALL));
+
+  cuda_exit(ctx);
+
+  return GA_NO_ERROR;
+}
+
 static int sgemvBatch(cb_order order, cb_transpose transA,
                       size_t M, size_t N, float alpha,
                       gpudata **A, size_t *offA, size_t lda,
@@ -1236,20 +1472,24 @@ static int sgemvBatch(cb_order order, cb_transpose transA,
 
     Aa = cuda_ops.buffer_alloc((gpucontext *)ctx, sizeof(float *) * batchCount, A_l,
                                GA_BUFFER_INIT);
-    if (Aa == NULL)
-      return ctx->err->code;
+    if (Aa == NULL) {
+      cuda_exit(ctx);
+      return error_code(ctx->err);
+    }
     xa = cuda_ops.buffer_alloc((gpucontext *)ctx, sizeof(float *) * batchCount, x_l,
                                GA_BUFFER_INIT);
     if (xa == NULL) {
       cuda_ops.buffer_release(Aa);
-      return ctx->err->code;
+      cuda_exit(ctx);
+      return error_code(ctx->err);
     }
     ya = cuda_ops.buffer_alloc((gpucontext *)ctx, sizeof(float *) * batchCount, y_l,
                                GA_BUFFER_INIT);
     if (ya == NULL) {
       cuda_ops.buffer_release(Aa);
       cuda_ops.buffer_release(xa);
-      return ctx->err->code;
+      cuda_exit(ctx);
+      return error_code(ctx->err);
     }
   }
 
@@ -1359,20 +1599,24 @@ static int dgemvBatch(cb_order order, cb_transpose transA,
 
     Aa = cuda_ops.buffer_alloc((gpucontext *)ctx, sizeof(double *) * batchCount, A_l,
                                GA_BUFFER_INIT);
-    if (Aa == NULL)
-      return ctx->err->code;
+    if (Aa == NULL) {
+      cuda_exit(ctx);
+      return error_code(ctx->err);
+    }
     xa = cuda_ops.buffer_alloc((gpucontext *)ctx, sizeof(double *) * batchCount, x_l,
                                GA_BUFFER_INIT);
     if (xa == NULL) {
       cuda_ops.buffer_release(Aa);
-      return ctx->err->code;
+      cuda_exit(ctx);
+      return error_code(ctx->err);
     }
     ya = cuda_ops.buffer_alloc((gpucontext *)ctx, sizeof(double *) * batchCount, y_l,
                                GA_BUFFER_INIT);
     if (ya == NULL) {
       cuda_ops.buffer_release(Aa);
       cuda_ops.buffer_release(xa);
-      return ctx->err->code;
+      cuda_exit(ctx);
+      return error_code(ctx->err);
     }
   }
 
@@ -1595,20 +1839,24 @@ static int sgerBatch(cb_order order, size_t M, size_t N, float alpha,
 
     Aa = cuda_ops.buffer_alloc((gpucontext *)ctx, sizeof(float *) * batchCount, A_l,
                                GA_BUFFER_INIT);
-    if (Aa == NULL)
-      return ctx->err->code;
+    if (Aa == NULL) {
+      cuda_exit(ctx);
+      return error_code(ctx->err);
+    }
     xa = cuda_ops.buffer_alloc((gpucontext *)ctx, sizeof(float *) * batchCount, x_l,
                                GA_BUFFER_INIT);
     if (xa == NULL) {
       cuda_ops.buffer_release(Aa);
-      return ctx->err->code;
+      cuda_exit(ctx);
+      return error_code(ctx->err);
     }
     ya = cuda_ops.buffer_alloc((gpucontext *)ctx, sizeof(float *) * batchCount, y_l,
                                GA_BUFFER_INIT);
     if (ya == NULL) {
       cuda_ops.buffer_release(Aa);
       cuda_ops.buffer_release(xa);
-      return ctx->err->code;
+      cuda_exit(ctx);
+      return error_code(ctx->err);
     }
   }
 
@@ -1726,20 +1974,24 @@ static int dgerBatch(cb_order order, size_t M, size_t N, double alpha,
 
     Aa = cuda_ops.buffer_alloc((gpucontext *)ctx, sizeof(double *) * batchCount, A_l,
                                GA_BUFFER_INIT);
-    if (Aa == NULL)
-      return ctx->err->code;
+    if (Aa == NULL) {
+      cuda_exit(ctx);
+      return error_code(ctx->err);
+    }
     xa = cuda_ops.buffer_alloc((gpucontext *)ctx, sizeof(double *) * batchCount, x_l,
                                GA_BUFFER_INIT);
     if (xa == NULL) {
       cuda_ops.buffer_release(Aa);
-      return ctx->err->code;
+      cuda_exit(ctx);
+      return error_code(ctx->err);
     }
     ya = cuda_ops.buffer_alloc((gpucontext *)ctx, sizeof(double *) * batchCount, y_l,
                                GA_BUFFER_INIT);
     if (ya == NULL) {
       cuda_ops.buffer_release(Aa);
       cuda_ops.buffer_release(xa);
-      return ctx->err->code;
+      cuda_exit(ctx);
+      return error_code(ctx->err);
     }
   }
 
@@ -1801,5 +2053,9 @@ gpuarray_blas_ops cublas_ops = {
   dgerBatch,
   hgemm3D,
   sgemm3D,
-  dgemm3D
+  dgemm3D,
+  cgemv,
+  zgemv,
+  cgemm,
+  zgemm
 };
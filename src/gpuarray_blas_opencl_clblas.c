@@ -196,7 +196,7 @@ static int sdot(
   wbuf = opencl_ops.buffer_alloc((gpucontext*)ctx,
                                  N*sizeof(float), NULL, GA_BUFFER_READ_WRITE);
   if (wbuf == NULL)
-      return ctx->err->code;
+      return error_code(ctx->err);
 
   ARRAY_INIT(X);
   ARRAY_INIT(Y);
@@ -236,7 +236,7 @@ static int ddot(
   wbuf = opencl_ops.buffer_alloc((gpucontext*)ctx,
                                  N*sizeof(double), NULL, GA_BUFFER_READ_WRITE);
   if (wbuf == NULL)
-      return ctx->err->code;
+      return error_code(ctx->err);
 
   ARRAY_INIT(X);
   ARRAY_INIT(Y);
@@ -452,4 +452,8 @@ gpuarray_blas_ops clblas_ops = {
   NULL, /* hgemm3D */
   NULL, /* sgemm3D */
   NULL, /* dgemm3D */
+  NULL, /* cgemv */
+  NULL, /* zgemv */
+  NULL, /* cgemm */
+  NULL, /* zgemm */
 };
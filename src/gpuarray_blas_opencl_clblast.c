@@ -500,6 +500,130 @@ static int dger(cb_order order, size_t M, size_t N, double alpha,
   return GA_NO_ERROR;
 }
 
+static int cgemv(cb_order order, cb_transpose transA, size_t M, size_t N,
+                 const float *alpha, gpudata *A, size_t offA, size_t lda,
+                 gpudata *X, size_t offX, int incX, const float *beta,
+                 gpudata *Y, size_t offY, int incY) {
+  cl_ctx *ctx = A->ctx;
+  cl_event ev;
+  cl_float2 a, b;
+
+  a.s[0] = alpha[0];
+  a.s[1] = alpha[1];
+  b.s[0] = beta[0];
+  b.s[1] = beta[1];
+
+  ARRAY_INIT(A);
+  ARRAY_INIT(X);
+  ARRAY_INIT(Y);
+
+  CLBT_CHECK(ctx->err, CLBlastCgemv(convO(order), convT(transA), M, N, a,
+                                    A->buf, offA, lda, X->buf, offX, incX,
+                                    b, Y->buf, offY, incY, &ctx->q, &ev));
+
+  ARRAY_FINI(A);
+  ARRAY_FINI(X);
+  ARRAY_FINI(Y);
+
+  clReleaseEvent(ev);
+
+  return GA_NO_ERROR;
+}
+
+static int zgemv(cb_order order, cb_transpose transA, size_t M, size_t N,
+                 const double *alpha, gpudata *A, size_t offA, size_t lda,
+                 gpudata *X, size_t offX, int incX, const double *beta,
+                 gpudata *Y, size_t offY, int incY) {
+  cl_ctx *ctx = A->ctx;
+  cl_event ev;
+  cl_double2 a, b;
+
+  a.s[0] = alpha[0];
+  a.s[1] = alpha[1];
+  b.s[0] = beta[0];
+  b.s[1] = beta[1];
+
+  ARRAY_INIT(A);
+  ARRAY_INIT(X);
+  ARRAY_INIT(Y);
+
+  CLBT_CHECK(ctx->err, CLBlastZgemv(convO(order), convT(transA), M, N, a,
+                                    A->buf, offA, lda, X->buf, offX, incX,
+                                    b, Y->buf, offY, incY, &ctx->q, &ev));
+
+  ARRAY_FINI(A);
+  ARRAY_FINI(X);
+  ARRAY_FINI(Y);
+
+  clReleaseEvent(ev);
+
+  return GA_NO_ERROR;
+}
+
+static int cgemm(cb_order order, cb_transpose transA, cb_transpose transB,
+                 size_t M, size_t N, size_t K, const float *alpha,
+                 gpudata *A, size_t offA, size_t lda,
+                 gpudata *B, size_t offB, size_t ldb, const float *beta,
+                 gpudata *C, size_t offC, size_t ldc) {
+  cl_ctx *ctx = A->ctx;
+  cl_event ev;
+  cl_float2 a, b;
+
+  a.s[0] = alpha[0];
+  a.s[1] = alpha[1];
+  b.s[0] = beta[0];
+  b.s[1] = beta[1];
+
+  ARRAY_INIT(A);
+  ARRAY_INIT(B);
+  ARRAY_INIT(C);
+
+  CLBT_CHECK(ctx->err, CLBlastCgemm(convO(order), convT(transA), convT(transB),
+                                    M, N, K, a,
+                                    A->buf, offA, lda, B->buf, offB, ldb,
+                                    b, C->buf, offC, ldc, &ctx->q, &ev));
+
+  ARRAY_FINI(A);
+  ARRAY_FINI(B);
+  ARRAY_FINI(C);
+
+  clReleaseEvent(ev);
+
+  return GA_NO_ERROR;
+}
+
+static int zgemm(cb_order order, cb_transpose transA, cb_transpose transB,
+                 size_t M, size_t N, size_t K, const double *alpha,
+                 gpudata *A, size_t offA, size_t lda,
+                 gpudata *B, size_t offB, size_t ldb, const double *beta,
+                 gpudata *C, size_t offC, size_t ldc) {
+  cl_ctx *ctx = A->ctx;
+  cl_event ev;
+  cl_double2 a, b;
+
+  a.s[0] = alpha[0];
+  a.s[1] = alpha[1];
+  b.s[0] = beta[0];
+  b.s[1] = beta[1];
+
+  ARRAY_INIT(A);
+  ARRAY_INIT(B);
+  ARRAY_INIT(C);
+
+  CLBT_CHECK(ctx->err, CLBlastZgemm(convO(order), convT(transA), convT(transB),
+                                    M, N, K, a,
+                                    A->buf, offA, lda, B->buf, offB, ldb,
+                                    b, C->buf, offC, ldc, &ctx->q, &ev));
+
+  ARRAY_FINI(A);
+  ARRAY_FINI(B);
+  ARRAY_FINI(C);
+
+  clReleaseEvent(ev);
+
+  return GA_NO_ERROR;
+}
+
 gpuarray_blas_ops clblast_ops = {
   setup,
   teardown,
@@ -527,4 +651,8 @@ gpuarray_blas_ops clblast_ops = {
   NULL, /* hgemm3D */
   NULL, /* sgemm3D */
   NULL, /* dgemm3D */
+  cgemv,
+  zgemv,
+  cgemm,
+  zgemm,
 };
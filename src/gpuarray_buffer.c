@@ -7,6 +7,9 @@
 #include "gpuarray/error.h"
 
 #include "util/error.h"
+#include "util/strb.h"
+#include "util/alloctrace.h"
+#include "util/staging.h"
 #include "private.h"
 
 extern const gpuarray_buffer_ops cuda_ops;
@@ -18,7 +21,7 @@ const gpuarray_buffer_ops *gpuarray_get_ops(const char *name) {
   return NULL;
 }
 
-#define FAIL(v, e) { if (ret) *ret = (e)->code; return v; }
+#define FAIL(v, e) { if (ret) *ret = error_code(e); return v; }
 
 int gpu_get_platform_count(const char* name, unsigned int* platcount) {
   const gpuarray_buffer_ops* ops = gpuarray_get_ops(name);
@@ -46,6 +49,7 @@ int gpucontext_props_new(gpucontext_props **res) {
   r->kernel_cache_path = NULL;
   r->initial_cache_size = 0;
   r->max_cache_size = (size_t)-1;
+  r->alloc_trace_path = NULL;
   *res = r;
   return GA_NO_ERROR;
 }
@@ -97,24 +101,41 @@ int gpucontext_props_alloc_cache(gpucontext_props *p, size_t initial, size_t max
   return GA_NO_ERROR;
 }
 
+int gpucontext_props_alloc_trace(gpucontext_props *p, const char *path) {
+  p->alloc_trace_path = path;
+  return GA_NO_ERROR;
+}
+
 void gpucontext_props_del(gpucontext_props *p) {
   free(p);
 }
 
 int gpucontext_init(gpucontext **res, const char *name, gpucontext_props *p) {
   const gpuarray_buffer_ops *ops = gpuarray_get_ops(name);
+  const char *trace_path;
   gpucontext *r;
   if (ops == NULL) {
     gpucontext_props_del(p);
-    return global_err->code;
+    return error_code(global_err);
   }
   if (p == NULL && gpucontext_props_new(&p) != GA_NO_ERROR)
-    return global_err->code;
+    return error_code(global_err);
+  trace_path = p->alloc_trace_path;
+  if (trace_path == NULL)
+    trace_path = getenv("GPUARRAY_ALLOC_TRACE");
   r = ops->buffer_init(p);
   gpucontext_props_del(p);
-  if (r == NULL) return global_err->code;
+  if (r == NULL) return error_code(global_err);
   r->ops = ops;
   r->extcopy_cache = NULL;
+  r->keyed_kernels = NULL;
+  if (trace_path != NULL && trace_path[0] != '\0') {
+    r->trace = alloc_trace_open(trace_path, global_err);
+    if (r->trace == NULL) {
+      gpucontext_deref(r);
+      return error_code(global_err);
+    }
+  }
   *res = r;
   return GA_NO_ERROR;
 }
@@ -126,6 +147,10 @@ void gpucontext_deref(gpucontext *ctx) {
     cache_destroy(ctx->extcopy_cache);
     ctx->extcopy_cache = NULL;
   }
+  if (ctx->keyed_kernels != NULL) {
+    cache_destroy(ctx->keyed_kernels);
+    ctx->keyed_kernels = NULL;
+  }
   ctx->ops->buffer_deinit(ctx);
 }
 
@@ -135,15 +160,20 @@ int gpucontext_property(gpucontext *ctx, int prop_id, void *res) {
 
 const char *gpucontext_error(gpucontext *ctx, int err) {
   if (ctx == NULL)
-    return global_err->msg;
+    return error_msg(global_err);
   else
     return ctx->ops->ctx_error(ctx);
 }
 
+int gpucontext_alloc_tag(gpucontext *ctx, const char *tag) {
+  alloc_trace_tag(ctx->trace, tag);
+  return GA_NO_ERROR;
+}
+
 gpudata *gpudata_alloc(gpucontext *ctx, size_t sz, void *data, int flags,
                        int *ret) {
   gpudata *res = ctx->ops->buffer_alloc(ctx, sz, data, flags);
-  if (res == NULL && ret) *ret = ctx->err->code;
+  if (res == NULL && ret) *ret = error_code(ctx->err);
   return res;
 }
 
@@ -159,26 +189,48 @@ void gpudata_release(gpudata *b) {
 int gpudata_share(gpudata *a, gpudata *b, int *ret) {
   int res = ((partial_gpudata *)a)->ctx->ops->buffer_share(a, b);
   if (res == -1 && ret)
-    *ret = ((partial_gpudata *)a)->ctx->err->code;
+    *ret = error_code(((partial_gpudata *)a)->ctx->err);
   return res;
 }
 
 int gpudata_move(gpudata *dst, size_t dstoff, gpudata *src, size_t srcoff,
                  size_t sz) {
-  return ((partial_gpudata *)src)->ctx->ops->buffer_move(dst, dstoff,
-                                                         src, srcoff, sz);
+  gpucontext *ctx = ((partial_gpudata *)src)->ctx;
+  if (ctx->capture != NULL)
+    return graph_record_move(dst, dstoff, src, srcoff, sz);
+  return ctx->ops->buffer_move(dst, dstoff, src, srcoff, sz);
+}
+
+struct transfer_bufs {
+  gpudata *dst;
+  gpudata *src;
+};
+
+static int transfer_read(void *dst, size_t off, size_t sz, void *data) {
+  gpudata *src = ((struct transfer_bufs *)data)->src;
+  return ((partial_gpudata *)src)->ctx->ops->buffer_read(dst, src, off, sz);
 }
 
+static int transfer_write(size_t off, const void *src, size_t sz,
+                          unsigned int slot, void *data) {
+  gpudata *dst = ((struct transfer_bufs *)data)->dst;
+  return ((partial_gpudata *)dst)->ctx->ops->buffer_write(dst, off, src, sz);
+}
+
+static const staging_ops transfer_ops = {transfer_read, transfer_write, NULL};
+
 int gpudata_transfer(gpudata *dst, size_t dstoff, gpudata *src, size_t srcoff,
                      size_t sz) {
   gpucontext *src_ctx;
   gpucontext *dst_ctx;
-  void *tmp;
+  struct transfer_bufs b;
   int res;
   src_ctx = ((partial_gpudata *)src)->ctx;
   dst_ctx = ((partial_gpudata *)dst)->ctx;
   if (src_ctx == dst_ctx)
-    return src_ctx->ops->buffer_move(dst, dstoff, src, srcoff, sz);
+    return gpudata_move(dst, dstoff, src, srcoff, sz);
+  GRAPH_CHECK(src_ctx, "Transfer between contexts");
+  GRAPH_CHECK(dst_ctx, "Transfer between contexts");
   if (src_ctx->ops == dst_ctx->ops) {
     res = src_ctx->ops->buffer_transfer(dst, dstoff, src, srcoff, sz);
     if (res == GA_NO_ERROR)
@@ -186,36 +238,210 @@ int gpudata_transfer(gpudata *dst, size_t dstoff, gpudata *src, size_t srcoff,
   }
 
   /* Fallback to host copy */
-  tmp = malloc(sz);
-  if (tmp == NULL) {
-    error_sys(src_ctx->err, "malloc");
-    return error_sys(dst_ctx->err, "malloc");
+  b.dst = dst;
+  b.src = src;
+  return staging_copy(dst_ctx->err, &transfer_ops, &b, dstoff, srcoff, sz,
+                      STAGING_CHUNK);
+}
+
+int gpudata_transfer_many(gpudata **dst, const size_t *dstoff,
+                          gpudata **src, const size_t *srcoff,
+                          const size_t *sz, size_t n) {
+  const gpuarray_buffer_ops *ops;
+  gpucontext *ctx;
+  size_t i;
+  int res;
+
+  if (n == 0)
+    return GA_NO_ERROR;
+  ops = ((partial_gpudata *)dst[0])->ctx->ops;
+  for (i = 0; i < n; i++) {
+    ctx = ((partial_gpudata *)dst[i])->ctx;
+    if (ctx->ops != ops || ((partial_gpudata *)src[i])->ctx->ops != ops ||
+        ((partial_gpudata *)src[i])->ctx == ctx) {
+      ops = NULL;
+      break;
+    }
+    GRAPH_CHECK(ctx, "Transfer between contexts");
+    GRAPH_CHECK(((partial_gpudata *)src[i])->ctx, "Transfer between contexts");
   }
-  res = src_ctx->ops->buffer_read(tmp, src, srcoff, sz);
-  if (res != GA_NO_ERROR) {
-    free(tmp);
-    return res;
+  /* Some copies may have been issued when it fails, so redoing them
+     one at a time is not an option */
+  if (ops != NULL && ops->buffer_transfer_many != NULL)
+    return ops->buffer_transfer_many(dst, dstoff, src, srcoff, sz, n);
+
+  /* One at a time, with the fallbacks of gpudata_transfer() */
+  for (i = 0; i < n; i++) {
+    res = gpudata_transfer(dst[i], dstoff[i], src[i], srcoff[i], sz[i]);
+    if (res != GA_NO_ERROR)
+      return res;
   }
-  res = dst_ctx->ops->buffer_write(dst, dstoff, tmp, sz);
-  free(tmp);
-  return res;
+  return GA_NO_ERROR;
 }
 
 int gpudata_read(void *dst, gpudata *src, size_t srcoff, size_t sz) {
-  return ((partial_gpudata *)src)->ctx->ops->buffer_read(dst, src, srcoff, sz);
+  gpucontext *ctx = ((partial_gpudata *)src)->ctx;
+  GRAPH_CHECK(ctx, "Reading a buffer");
+  return ctx->ops->buffer_read(dst, src, srcoff, sz);
 }
 
 int gpudata_write(gpudata *dst, size_t dstoff, const void *src, size_t sz) {
-  return ((partial_gpudata *)dst)->ctx->ops->buffer_write(dst, dstoff,
-                                                          src, sz);
+  gpucontext *ctx = ((partial_gpudata *)dst)->ctx;
+  if (ctx->capture != NULL)
+    return graph_record_write(dst, dstoff, src, sz);
+  return ctx->ops->buffer_write(dst, dstoff, src, sz);
+}
+
+static int rect_check(gpucontext *ctx, size_t *rpitch, size_t *spitch,
+                      size_t width, size_t height, size_t depth) {
+  if (height == 1)
+    *rpitch = width;
+  if (depth == 1)
+    *spitch = *rpitch * height;
+  if (*rpitch < width || *spitch < *rpitch * height || *spitch % *rpitch != 0)
+    return error_set(ctx->err, GA_VALUE_ERROR, "Invalid pitch for rectangular copy");
+  return GA_NO_ERROR;
+}
+
+int gpudata_read_rect(void *dst, size_t dst_rpitch, size_t dst_spitch,
+                      gpudata *src, size_t srcoff,
+                      size_t src_rpitch, size_t src_spitch,
+                      size_t width, size_t height, size_t depth) {
+  gpucontext *ctx = ((partial_gpudata *)src)->ctx;
+  int err;
+
+  GRAPH_CHECK(ctx, "Reading a buffer");
+  if (width == 0 || height == 0 || depth == 0) return GA_NO_ERROR;
+  err = rect_check(ctx, &dst_rpitch, &dst_spitch, width, height, depth);
+  if (err != GA_NO_ERROR) return err;
+  err = rect_check(ctx, &src_rpitch, &src_spitch, width, height, depth);
+  if (err != GA_NO_ERROR) return err;
+  return ctx->ops->buffer_read_rect(dst, dst_rpitch, dst_spitch,
+                                    src, srcoff, src_rpitch, src_spitch,
+                                    width, height, depth);
+}
+
+int gpudata_write_rect(gpudata *dst, size_t dstoff,
+                       size_t dst_rpitch, size_t dst_spitch,
+                       const void *src, size_t src_rpitch, size_t src_spitch,
+                       size_t width, size_t height, size_t depth) {
+  gpucontext *ctx = ((partial_gpudata *)dst)->ctx;
+  int err;
+
+  GRAPH_CHECK(ctx, "Rectangular write");
+  if (width == 0 || height == 0 || depth == 0) return GA_NO_ERROR;
+  err = rect_check(ctx, &dst_rpitch, &dst_spitch, width, height, depth);
+  if (err != GA_NO_ERROR) return err;
+  err = rect_check(ctx, &src_rpitch, &src_spitch, width, height, depth);
+  if (err != GA_NO_ERROR) return err;
+  return ctx->ops->buffer_write_rect(dst, dstoff, dst_rpitch, dst_spitch,
+                                     src, src_rpitch, src_spitch,
+                                     width, height, depth);
 }
 
 int gpudata_memset(gpudata *dst, size_t dstoff, int data) {
-  return ((partial_gpudata *)dst)->ctx->ops->buffer_memset(dst, dstoff, data);
+  gpucontext *ctx = ((partial_gpudata *)dst)->ctx;
+  if (ctx->capture != NULL)
+    return graph_record_memset(dst, dstoff, data);
+  return ctx->ops->buffer_memset(dst, dstoff, data);
 }
 
 int gpudata_sync(gpudata *b) {
-  return ((partial_gpudata *)b)->ctx->ops->buffer_sync(b);
+  gpucontext *ctx = ((partial_gpudata *)b)->ctx;
+  GRAPH_CHECK(ctx, "Synchronizing a buffer");
+  return ctx->ops->buffer_sync(b);
+}
+
+int gpucontext_trim_cache(gpucontext *ctx, size_t *freed) {
+  size_t dummy;
+  if (freed == NULL)
+    freed = &dummy;
+  *freed = 0;
+  /* Backends without an allocation cache have nothing to trim */
+  if (ctx->ops->ctx_trim_cache == NULL)
+    return GA_NO_ERROR;
+  return ctx->ops->ctx_trim_cache(ctx, freed);
+}
+
+static const struct {
+  const char *name;
+  int prop;
+} alloc_props[] = {
+  {"reserved", GA_CTX_PROP_MEM_RESERVED},
+  {"in_use", GA_CTX_PROP_MEM_IN_USE},
+  {"cached", GA_CTX_PROP_MEM_CACHED},
+  {"peak", GA_CTX_PROP_MEM_PEAK},
+  {"blocks", GA_CTX_PROP_MEM_BLOCKS},
+  {"splits", GA_CTX_PROP_MEM_SPLITS},
+  {"merges", GA_CTX_PROP_MEM_MERGES},
+  {"largest_free", GA_CTX_PROP_MEM_LARGEST_FREE},
+  {"reclaimed", GA_CTX_PROP_CACHE_RECLAIMED},
+};
+
+int gpucontext_dump_allocator(gpucontext *ctx, char **res, int flags) {
+  strb sb = STRB_STATIC_INIT;
+  size_t buckets[GA_MEM_NBUCKETS];
+  size_t val;
+  unsigned int i;
+  int first = 1;
+
+  GA_CHECK(gpucontext_property(ctx, GA_CTX_PROP_MEM_FREE_BUCKETS, buckets));
+
+  if (flags & GA_DUMP_JSON) strb_appendc(&sb, '{');
+  for (i = 0; i < sizeof(alloc_props)/sizeof(alloc_props[0]); i++) {
+    if (gpucontext_property(ctx, alloc_props[i].prop, &val) != GA_NO_ERROR) {
+      strb_clear(&sb);
+      return error_code(ctx->err);
+    }
+    if (flags & GA_DUMP_JSON)
+      strb_appendf(&sb, "%s\"%s\": %zu", i ? ", " : "", alloc_props[i].name, val);
+    else
+      strb_appendf(&sb, "%-13s %zu\n", alloc_props[i].name, val);
+  }
+  if (flags & GA_DUMP_JSON)
+    strb_appends(&sb, ", \"free_buckets\": {");
+  else
+    strb_appends(&sb, "free blocks by size:\n");
+  for (i = 0; i < GA_MEM_NBUCKETS; i++) {
+    if (buckets[i] == 0) continue;
+    if (flags & GA_DUMP_JSON)
+      strb_appendf(&sb, "%s\"%zu\": %zu", first ? "" : ", ",
+                   (size_t)1 << i, buckets[i]);
+    else
+      strb_appendf(&sb, "  >= %-10zu %zu\n", (size_t)1 << i, buckets[i]);
+    first = 0;
+  }
+  if (flags & GA_DUMP_JSON)
+    strb_appends(&sb, "}}");
+
+  *res = strb_cstr(&sb);
+  if (*res == NULL)
+    return error_set(ctx->err, GA_MEMORY_ERROR, "Could not build allocator dump");
+  return GA_NO_ERROR;
+}
+
+int gpudata_prefetch(gpudata *b, size_t off, size_t sz, int location) {
+  gpucontext *ctx = ((partial_gpudata *)b)->ctx;
+  GRAPH_CHECK(ctx, "Prefetch");
+  if (location != GA_LOCATION_DEVICE && location != GA_LOCATION_HOST)
+    return error_set(ctx->err, GA_VALUE_ERROR, "Invalid location");
+  if (ctx->ops->buffer_prefetch == NULL)
+    return error_set(ctx->err, GA_DEVSUP_ERROR, "Managed memory is not supported by this backend");
+  if (sz == 0) return GA_NO_ERROR;
+  return ctx->ops->buffer_prefetch(b, off, sz, location);
+}
+
+int gpudata_advise(gpudata *b, size_t off, size_t sz, int advice,
+                   int location) {
+  gpucontext *ctx = ((partial_gpudata *)b)->ctx;
+  if (advice < GA_ADVISE_READ_MOSTLY || advice > GA_ADVISE_NOT_ACCESSED_BY)
+    return error_set(ctx->err, GA_VALUE_ERROR, "Invalid advice");
+  if (location != GA_LOCATION_DEVICE && location != GA_LOCATION_HOST)
+    return error_set(ctx->err, GA_VALUE_ERROR, "Invalid location");
+  if (ctx->ops->buffer_advise == NULL)
+    return error_set(ctx->err, GA_DEVSUP_ERROR, "Managed memory is not supported by this backend");
+  if (sz == 0) return GA_NO_ERROR;
+  return ctx->ops->buffer_advise(b, off, sz, advice, location);
 }
 
 int gpudata_property(gpudata *b, int prop_id, void *res) {
@@ -233,7 +459,7 @@ gpukernel *gpukernel_init(gpucontext *ctx, unsigned int count,
   err = ctx->ops->kernel_alloc(&res, ctx, count, strings, lengths, fname,
                                numargs, typecodes, flags, err_str);
   if (err != GA_NO_ERROR && ret != NULL)
-    *ret = ctx->err->code;
+    *ret = error_code(ctx->err);
   return res;
 }
 
@@ -246,13 +472,18 @@ void gpukernel_release(gpukernel *k) {
 }
 
 int gpukernel_setarg(gpukernel *k, unsigned int i, void *a) {
-  return ((partial_gpukernel *)k)->ctx->ops->kernel_setarg(k, i, a);
+  gpucontext *ctx = ((partial_gpukernel *)k)->ctx;
+  if (ctx->capture != NULL)
+    GA_CHECK(graph_record_setarg(k, i, a));
+  return ctx->ops->kernel_setarg(k, i, a);
 }
 
 int gpukernel_call(gpukernel *k, unsigned int n, const size_t *gs,
                    const size_t *ls, size_t shared, void **args) {
-  return ((partial_gpukernel *)k)->ctx->ops->kernel_call(k, n, gs, ls,
-                                                         shared, args);
+  gpucontext *ctx = ((partial_gpukernel *)k)->ctx;
+  if (ctx->capture != NULL)
+    return graph_record_call(k, n, gs, ls, shared, args);
+  return ctx->ops->kernel_call(k, n, gs, ls, shared, args);
 }
 
 int gpukernel_property(gpukernel *k, int prop_id, void *res) {
@@ -14,21 +14,36 @@ void gpublas_teardown(gpucontext *ctx) {
 }
 
 const char *gpublas_error(gpucontext *ctx) {
-  return ctx->err->msg;
+  return error_msg(ctx->err);
 }
 
+/*
+ * The library handle of a context is shared by the threads using it,
+ * so the calls are serialised.  They only queue work.
+ */
+#define BLAS_CALL(ctx, name, args)                                      \
+  do {                                                                  \
+    int r_;                                                             \
+    ga_lock_acquire((ctx)->lock);                                       \
+    r_ = (ctx)->blas_ops->name args;                                    \
+    ga_lock_release((ctx)->lock);                                       \
+    return r_;                                                          \
+  } while (0)
+
 #define BLAS_OP(buf, name, args)                                        \
   gpucontext *ctx = gpudata_context(buf);                               \
+  GRAPH_CHECK(ctx, "Blas operation");                                   \
   if (ctx->blas_ops->name)                                              \
-    return ctx->blas_ops->name args;                                    \
+    BLAS_CALL(ctx, name, args);                                         \
   else                                                                  \
     return error_fmt(ctx->err, GA_DEVSUP_ERROR, "Blas operation not supported by device or missing library: %s", #name)
 
 #define BLAS_OPF(buf, name, args)                                       \
   gpucontext *ctx = gpudata_context(buf);                               \
+  GRAPH_CHECK(ctx, "Blas operation");                                   \
   if (flags != 0) return error_set(ctx->err, GA_INVALID_ERROR, "flags is not 0"); \
-  if (ctx->blas_ops->name)						\
-    return ctx->blas_ops->name args;                                    \
+  if (ctx->blas_ops->name)                                              \
+    BLAS_CALL(ctx, name, args);                                         \
   else                                                                  \
     return error_fmt(ctx->err, GA_DEVSUP_ERROR, "Blas operation not supported by device or missing library: %s", #name)
 
@@ -114,6 +129,44 @@ int gpublas_dgemm(cb_order order, cb_transpose transA, cb_transpose transB,
                      B, offB, ldb, beta, C, offC, ldc));
 }
 
+int gpublas_cgemv(cb_order order, cb_transpose transA,
+                  size_t M, size_t N, const float *alpha,
+                  gpudata *A, size_t offA, size_t lda,
+                  gpudata *X, size_t offX, int incX,
+                  const float *beta,
+                  gpudata *Y, size_t offY, int incY) {
+  BLAS_OP(A, cgemv, (order, transA, M, N, alpha, A, offA, lda,
+                     X, offX, incX, beta, Y, offY, incY));
+}
+
+int gpublas_zgemv(cb_order order, cb_transpose transA,
+                  size_t M, size_t N, const double *alpha,
+                  gpudata *A, size_t offA, size_t lda,
+                  gpudata *X, size_t offX, int incX,
+                  const double *beta,
+                  gpudata *Y, size_t offY, int incY) {
+  BLAS_OP(A, zgemv, (order, transA, M, N, alpha, A, offA, lda,
+                     X, offX, incX, beta, Y, offY, incY));
+}
+
+int gpublas_cgemm(cb_order order, cb_transpose transA, cb_transpose transB,
+                  size_t M, size_t N, size_t K, const float *alpha,
+                  gpudata *A, size_t offA, size_t lda,
+                  gpudata *B, size_t offB, size_t ldb,
+                  const float *beta, gpudata *C, size_t offC, size_t ldc) {
+  BLAS_OP(A, cgemm, (order, transA, transB, M, N, K, alpha, A, offA, lda,
+                     B, offB, ldb, beta, C, offC, ldc));
+}
+
+int gpublas_zgemm(cb_order order, cb_transpose transA, cb_transpose transB,
+                  size_t M, size_t N, size_t K, const double *alpha,
+                  gpudata *A, size_t offA, size_t lda,
+                  gpudata *B, size_t offB, size_t ldb,
+                  const double *beta, gpudata *C, size_t offC, size_t ldc) {
+  BLAS_OP(A, zgemm, (order, transA, transB, M, N, K, alpha, A, offA, lda,
+                     B, offB, ldb, beta, C, offC, ldc));
+}
+
 int gpublas_hger(cb_order order, size_t M, size_t N, float alpha,
                  gpudata *X, size_t offX, int incX,
                  gpudata *Y, size_t offY, int incY,
@@ -143,7 +196,7 @@ int gpublas_dger(cb_order order, size_t M, size_t N, double alpha,
   if (batchCount == 0) return GA_NO_ERROR;                              \
   ctx = gpudata_context(l[0]);                                          \
   if (ctx->blas_ops->name)                                              \
-    return ctx->blas_ops->name args;                                    \
+    BLAS_CALL(ctx, name, args);                                         \
   else                                                                  \
     return error_fmt(ctx->err, GA_DEVSUP_ERROR, "Blas operation not supported by library in use: %s", #name)
 
@@ -153,7 +206,7 @@ int gpublas_dger(cb_order order, size_t M, size_t N, double alpha,
   ctx = gpudata_context(l[0]);                                          \
   if (flags != 0) return error_set(ctx->err, GA_INVALID_ERROR, "flags is not 0"); \
   if (ctx->blas_ops->name)                                              \
-    return ctx->blas_ops->name args;                                    \
+    BLAS_CALL(ctx, name, args);                                         \
   else                                                                  \
     return error_fmt(ctx->err, GA_DEVSUP_ERROR, "Blas operation not supported by library in use: %s", #name)
 
@@ -266,7 +319,7 @@ int gpublas_dgerBatch(cb_order order, size_t M, size_t N, double alpha,
   ctx = gpudata_context(b);                                             \
   if (flags != 0) return error_set(ctx->err, GA_INVALID_ERROR, "flags is not 0"); \
   if (ctx->blas_ops->name)                                              \
-    return ctx->blas_ops->name args;                                    \
+    BLAS_CALL(ctx, name, args);                                         \
   else                                                                  \
     return error_fmt(ctx->err, GA_DEVSUP_ERROR, "Blas operation not supported by library in use: %s", #name)
 
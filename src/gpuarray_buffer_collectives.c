@@ -22,7 +22,7 @@ void gpucomm_free(gpucomm* comm) {
 }
 
 const char* gpucomm_error(gpucontext* ctx) {
-  return ctx->err->msg;
+  return error_msg(ctx->err);
 }
 
 gpucontext* gpucomm_context(gpucomm* comm) {
@@ -54,6 +54,7 @@ int gpucomm_reduce(gpudata* src, size_t offsrc, gpudata* dest, size_t offdest,
   gpucontext* ctx = gpucomm_context(comm);
   if (ctx->comm_ops == NULL)
     return error_set(ctx->err, GA_DEVSUP_ERROR, "Collectives unavailable");
+  GRAPH_CHECK(ctx, "Collective operation");
   return ctx->comm_ops->reduce(src, offsrc, dest, offdest, count, typecode,
                                opcode, root, comm);
 }
@@ -64,6 +65,7 @@ int gpucomm_all_reduce(gpudata* src, size_t offsrc, gpudata* dest,
   gpucontext* ctx = gpucomm_context(comm);
   if (ctx->comm_ops == NULL)
     return error_set(ctx->err, GA_DEVSUP_ERROR, "Collectives unavailable");
+  GRAPH_CHECK(ctx, "Collective operation");
   return ctx->comm_ops->all_reduce(src, offsrc, dest, offdest, count, typecode,
                                    opcode, comm);
 }
@@ -74,6 +76,7 @@ int gpucomm_reduce_scatter(gpudata* src, size_t offsrc, gpudata* dest,
   gpucontext* ctx = gpucomm_context(comm);
   if (ctx->comm_ops == NULL)
     return error_set(ctx->err, GA_DEVSUP_ERROR, "Collectives unavailable");
+  GRAPH_CHECK(ctx, "Collective operation");
   return ctx->comm_ops->reduce_scatter(src, offsrc, dest, offdest, count,
                                        typecode, opcode, comm);
 }
@@ -83,6 +86,7 @@ int gpucomm_broadcast(gpudata* array, size_t offset, size_t count, int typecode,
   gpucontext* ctx = gpucomm_context(comm);
   if (ctx->comm_ops == NULL)
     return error_set(ctx->err, GA_DEVSUP_ERROR, "Collectives unavailable");
+  GRAPH_CHECK(ctx, "Collective operation");
   return ctx->comm_ops->broadcast(array, offset, count, typecode, root, comm);
 }
 
@@ -92,6 +96,7 @@ int gpucomm_all_gather(gpudata* src, size_t offsrc, gpudata* dest,
   gpucontext* ctx = gpucomm_context(comm);
   if (ctx->comm_ops == NULL)
     return error_set(ctx->err, GA_DEVSUP_ERROR, "Collectives unavailable");
+  GRAPH_CHECK(ctx, "Collective operation");
   return ctx->comm_ops->all_gather(src, offsrc, dest, offdest, count, typecode,
                                    comm);
 }
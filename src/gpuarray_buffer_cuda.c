@@ -15,6 +15,7 @@
 
 #include "util/strb.h"
 #include "util/xxhash.h"
+#include "util/alloctrace.h"
 
 #include "gpuarray/buffer.h"
 #include "gpuarray/util.h"
@@ -153,6 +154,106 @@ static strb *kernel_read(const strb *b) {
   return res;
 }
 
+/*
+ * Process-wide cache of compiled binaries.
+ *
+ * Contexts on devices of the same architecture share the binaries so
+ * that a kernel is compiled (or read from disk) once per process
+ * instead of once per context.  Only the module load is done per
+ * context.  The keys are the same as for the disk cache.
+ *
+ * `bin_lock` protects `bin_cache`.  A compilation holds the
+ * `bin_flight` lock selected by the hash of its key, so that contexts
+ * asking for the same binary at the same time wait for the first one
+ * rather than compiling it again.  Insertion checks for the key under
+ * `bin_lock` regardless, so there is never more than one entry for a
+ * key.
+ */
+#define BIN_FLIGHT_LOCKS 16
+
+static cache *bin_cache = NULL;
+static ga_lock *bin_lock = NULL;
+static ga_lock *bin_flight[BIN_FLIGHT_LOCKS];
+
+static void setup_bin_cache(void) {
+  unsigned int i;
+
+  bin_lock = ga_lock_new();
+  if (bin_lock == NULL)
+    return;
+  for (i = 0; i < BIN_FLIGHT_LOCKS; i++) {
+    bin_flight[i] = ga_lock_new();
+    if (bin_flight[i] == NULL)
+      goto fail;
+  }
+  bin_cache = cache_lru(128, 16,
+                        (cache_eq_fn)disk_eq,
+                        (cache_hash_fn)disk_hash,
+                        (cache_freek_fn)disk_free,
+                        (cache_freev_fn)strb_free,
+                        global_err);
+  if (bin_cache == NULL)
+    goto fail;
+  return;
+ fail:
+  while (i-- > 0)
+    ga_lock_free(bin_flight[i]);
+  ga_lock_free(bin_lock);
+  bin_lock = NULL;
+}
+
+/*
+ * Append the cached binary for `k` to `bin`.  Returns 1 if found.
+ */
+static int bin_cache_get(disk_key *k, strb *bin) {
+  strb *cbin;
+  int found = 0;
+
+  if (bin_cache == NULL) return 0;
+  ga_lock_acquire(bin_lock);
+  cbin = cache_get(bin_cache, k);
+  if (cbin != NULL) {
+    strb_appendb(bin, cbin);
+    found = 1;
+  }
+  ga_lock_release(bin_lock);
+  return found;
+}
+
+/*
+ * Copy the key and the binary into the process cache, unless it
+ * already has an entry for the key.  Failure only means that the
+ * binary will be compiled again.
+ */
+static void bin_cache_add(disk_key *k, strb *bin) {
+  disk_key *pk;
+  strb *cbin;
+
+  if (bin_cache == NULL) return;
+  pk = calloc(1, sizeof(disk_key));
+  if (pk == NULL) return;
+  memcpy(pk, k, DISK_KEY_MM);
+  strb_appendb(&pk->src, &k->src);
+  if (strb_error(&pk->src)) {
+    disk_free((cache_key_t)pk);
+    return;
+  }
+  cbin = strb_alloc(bin->l);
+  if (cbin == NULL) {
+    disk_free((cache_key_t)pk);
+    return;
+  }
+  strb_appendb(cbin, bin);
+  ga_lock_acquire(bin_lock);
+  if (cache_get(bin_cache, k) == NULL && cache_add(bin_cache, pk, cbin) == 0)
+    pk = NULL;
+  ga_lock_release(bin_lock);
+  if (pk != NULL) {
+    disk_free((cache_key_t)pk);
+    strb_free(cbin);
+  }
+}
+
 static int setup_done = 0;
 static int major = -1;
 static int minor = -1;
@@ -191,6 +292,7 @@ static int setup_lib(void) {
     }
     if (res != GA_NO_ERROR)
       return res;
+    setup_bin_cache();
     setup_done = 1;
   }
   return GA_NO_ERROR;
@@ -236,14 +338,21 @@ cuda_context *cuda_make_ctx(CUcontext ctx, gpucontext_props *p) {
   res->refcnt = 1;
   res->flags = p->flags;
   res->max_cache_size = p->max_cache_size;
-  res->enter = 0;
   res->major = major;
   res->minor = minor;
   res->freeblocks = NULL;
+  res->managedblocks = NULL;
   if (error_alloc(&res->err)) {
     error_set(global_err, GA_SYS_ERROR, "Could not create error context");
     goto fail_errmsg;
   }
+  if (ISSET(res->flags, GA_CTX_MULTI_THREAD)) {
+    res->lock = ga_lock_new();
+    if (res->lock == NULL) {
+      error_set(global_err, GA_SYS_ERROR, "Could not create context lock");
+      goto fail_stream;
+    }
+  }
   if (detect_arch(ARCH_PREFIX, res->bin_id, global_err)) {
     goto fail_stream;
   }
@@ -288,7 +397,7 @@ cuda_context *cuda_make_ctx(CUcontext ctx, gpucontext_props *p) {
                           global_err);
     if (mem_cache == NULL) {
       fprintf(stderr, "Error initializing mem cache for disk: %s\n",
-              global_err->msg);
+              error_msg(global_err));
       goto fail_disk_cache;
     }
     res->disk_cache = cache_disk(cache_path, mem_cache,
@@ -299,7 +408,7 @@ cuda_context *cuda_make_ctx(CUcontext ctx, gpucontext_props *p) {
                                  global_err);
     if (res->disk_cache == NULL) {
       fprintf(stderr, "Error initializing disk cache, disabling: %s\n",
-              global_err->msg);
+              error_msg(global_err));
       cache_destroy(mem_cache);
       goto fail_disk_cache;
     }
@@ -319,7 +428,7 @@ cuda_context *cuda_make_ctx(CUcontext ctx, gpucontext_props *p) {
   res->errbuf = new_gpudata(res, (CUdeviceptr)pp, 16);
   if (res->errbuf == NULL) {
     /* Copy the error from the context since we are getting rid of it */
-    error_set(global_err, res->err->code, res->err->msg);
+    error_set(global_err, error_code(res->err), error_msg(res->err));
     goto fail_end;
   }
   res->errbuf->flags |= CUDA_MAPPED_PTR;
@@ -342,42 +451,89 @@ cuda_context *cuda_make_ctx(CUcontext ctx, gpucontext_props *p) {
  fail_mem_stream:
   cuStreamDestroy(res->s);
  fail_stream:
+  ga_lock_free(res->lock);
   error_free(res->err);
  fail_errmsg:
   free(res);
   return NULL;
 }
 
+/*
+ * Nesting count of cuda_enter() for the contexts the current thread
+ * has entered.  The count is per thread so that entering a context
+ * doesn't need its lock: the lock only covers the shared state of
+ * the context (freelists, kernel cache, buffer events, peers) and is
+ * never held across driver waits or compiles.
+ *
+ * If a thread enters more than ENTER_SLOTS contexts at once, the
+ * extra ones are pushed on every call, which cuda_exit() balances.
+ */
+#define ENTER_SLOTS 8
+
+typedef struct _enter_slot {
+  cuda_context *ctx;
+  unsigned int n;
+} enter_slot;
+
+static GA_THREAD_LOCAL enter_slot entered[ENTER_SLOTS];
+
+static enter_slot *enter_find(cuda_context *ctx) {
+  unsigned int i;
+  for (i = 0; i < ENTER_SLOTS; i++)
+    if (entered[i].ctx == ctx && entered[i].n != 0)
+      return &entered[i];
+  return NULL;
+}
+
 static void deallocate(gpudata *);
 
 static void cuda_free_ctx(cuda_context *ctx) {
   gpudata *next, *curr;
+  cuda_peer *p, *pnext;
   CUdevice dev;
+  unsigned int refcnt;
 
   ASSERT_CTX(ctx);
-  ctx->refcnt--;
-  if (ctx->refcnt == 0) {
-    assert(ctx->enter == 0 && "Context was active when freed!");
+  ga_lock_acquire(ctx->lock);
+  refcnt = --ctx->refcnt;
+  ga_lock_release(ctx->lock);
+  if (refcnt == 0) {
+    assert(enter_find(ctx) == NULL && "Context was active when freed!");
     if (ctx->blas_handle != NULL) {
       ctx->blas_ops->teardown((gpucontext *)ctx);
     }
     cuMemFreeHost((void *)ctx->errbuf->ptr);
     deallocate(ctx->errbuf);
 
+    for (p = ctx->peers; p != NULL; p = pnext) {
+      pnext = p->next;
+      if (p->s != NULL)
+        cuStreamDestroy(p->s);
+      free(p);
+    }
+    if (ctx->peer_s != NULL)
+      cuStreamDestroy(ctx->peer_s);
     if (ISCLR(ctx->flags, GA_CTX_SINGLE_STREAM))
       cuStreamDestroy(ctx->mem_s);
     cuStreamDestroy(ctx->s);
 
-    /* Clear out the freelist */
+    /* Clear out the freelists */
     for (curr = ctx->freeblocks; curr != NULL; curr = next) {
       next = curr->next;
       cuMemFree(curr->ptr);
       deallocate(curr);
     }
+    for (curr = ctx->managedblocks; curr != NULL; curr = next) {
+      next = curr->next;
+      cuMemFree(curr->ptr);
+      deallocate(curr);
+    }
     cache_destroy(ctx->kernel_cache);
     if (ctx->disk_cache)
       cache_destroy(ctx->disk_cache);
+    alloc_trace_close(ctx->trace);
     error_free(ctx->err);
+    ga_lock_free(ctx->lock);
 
     if (!(ctx->flags & DONTFREE)) {
       cuCtxPushCurrent(ctx->ctx);
@@ -396,18 +552,33 @@ CUstream cuda_get_stream(cuda_context *ctx) {
 }
 
 void cuda_enter(cuda_context *ctx) {
+  enter_slot *e;
+  unsigned int i;
+
   ASSERT_CTX(ctx);
-  if (!ctx->enter)
-    cuCtxPushCurrent(ctx->ctx);
-  ctx->enter++;
+  e = enter_find(ctx);
+  if (e != NULL) {
+    e->n++;
+    return;
+  }
+  cuCtxPushCurrent(ctx->ctx);
+  for (i = 0; i < ENTER_SLOTS; i++) {
+    if (entered[i].n == 0) {
+      entered[i].ctx = ctx;
+      entered[i].n = 1;
+      return;
+    }
+  }
 }
 
 void cuda_exit(cuda_context *ctx) {
+  enter_slot *e;
+
   ASSERT_CTX(ctx);
-  assert(ctx->enter > 0);
-  ctx->enter--;
-  if (!ctx->enter)
-    cuCtxPopCurrent(NULL);
+  e = enter_find(ctx);
+  if (e != NULL && --e->n != 0)
+    return;
+  cuCtxPopCurrent(NULL);
 }
 
 static gpudata *new_gpudata(cuda_context *ctx, CUdeviceptr ptr, size_t size) {
@@ -423,6 +594,7 @@ static gpudata *new_gpudata(cuda_context *ctx, CUdeviceptr ptr, size_t size) {
 
   res->refcnt = 0;
   res->sz = size;
+  res->asz = 0;
 
   res->flags = 0;
   res->ls = NULL;
@@ -465,7 +637,9 @@ gpudata *cuda_make_buf(cuda_context *ctx, CUdeviceptr p, size_t sz) {
 
   res->refcnt = 1;
   res->flags |= DONTFREE;
+  ga_lock_acquire(ctx->lock);
   res->ctx->refcnt++;
+  ga_lock_release(ctx->lock);
 
   return res;
 }
@@ -523,7 +697,7 @@ static cuda_context *do_init(CUdevice dev, gpucontext_props *p, error *e) {
   if (res == NULL) {
     cuDevicePrimaryCtxRelease(dev);
     if (e != global_err)
-      error_set(e, global_err->code, global_err->msg);
+      error_set(e, error_code(global_err), error_msg(global_err));
     return NULL;
   }
 
@@ -578,16 +752,25 @@ static void cuda_deinit(gpucontext *c) {
   cuda_free_ctx((cuda_context *)c);
 }
 
+/*
+ * Get the free list for blocks of the kind described by `flags`.
+ */
+static inline gpudata **freelist(cuda_context *ctx, int flags) {
+  if (flags & CUDA_MANAGED_PTR)
+    return &ctx->managedblocks;
+  return &ctx->freeblocks;
+}
+
 /*
  * Find the block in the free list that is the best fit for the size
  * we want, which means the smallest that can still fit the size.
  */
 static void find_best(cuda_context *ctx, gpudata **best, gpudata **prev,
-                     size_t size) {
+                     size_t size, int flags) {
   gpudata *temp, *tempPrev = NULL;
   *best = NULL;
 
-  for (temp = ctx->freeblocks; temp; temp = temp->next) {
+  for (temp = *freelist(ctx, flags); temp; temp = temp->next) {
     if (temp->sz >= size && (!*best || temp->sz < (*best)->sz)) {
       *best = temp;
       *prev = tempPrev;
@@ -596,63 +779,183 @@ static void find_best(cuda_context *ctx, gpudata **best, gpudata **prev,
   }
 }
 
+/*
+ * Walk both free lists to find the largest cached block and, if
+ * `buckets` is not NULL, count the blocks by power of two size.
+ */
+static size_t free_stats(cuda_context *ctx, size_t *buckets) {
+  gpudata *lists[2];
+  gpudata *temp;
+  size_t largest = 0;
+  unsigned int i, b;
+
+  ga_lock_acquire(ctx->lock);
+  lists[0] = ctx->freeblocks;
+  lists[1] = ctx->managedblocks;
+  if (buckets != NULL)
+    memset(buckets, 0, sizeof(size_t) * GA_MEM_NBUCKETS);
+  for (i = 0; i < 2; i++) {
+    for (temp = lists[i]; temp; temp = temp->next) {
+      if (temp->sz > largest) largest = temp->sz;
+      if (buckets != NULL) {
+        for (b = 0; b < GA_MEM_NBUCKETS - 1 && (temp->sz >> (b + 1)) != 0; b++);
+        buckets[b]++;
+      }
+    }
+  }
+  ga_lock_release(ctx->lock);
+  return largest;
+}
+
 static size_t largest_size(cuda_context *ctx) {
   gpudata *temp;
   size_t sz, dummy;
   cuda_enter(ctx);
   cuMemGetInfo(&sz, &dummy);
-  cuda_exit(ctx);
    /* We guess that we can allocate at least a quarter of the free size
      in a single block. This might be wrong though. */
   sz /= 4;
+  cuda_exit(ctx);
+  ga_lock_acquire(ctx->lock);
   for (temp = ctx->freeblocks; temp; temp = temp->next) {
     if (temp->sz > sz) sz = temp->sz;
   }
+  ga_lock_release(ctx->lock);
   return sz;
 }
 
+/*
+ * Move the blocks of the list at `head` that cover a whole driver
+ * allocation (they are unused) to the list at `out` and add their
+ * size to `freed`.  Must be called with the context lock held.
+ */
+static void trim_list(cuda_context *ctx, gpudata **head, gpudata **out,
+                      size_t *freed) {
+  gpudata *curr, *prev = NULL, *next;
+
+  for (curr = *head; curr != NULL; curr = next) {
+    next = curr->next;
+    if ((curr->flags & CUDA_HEAD_ALLOC) && curr->sz == curr->asz) {
+      if (prev != NULL)
+        prev->next = next;
+      else
+        *head = next;
+      ctx->cache_size -= curr->sz;
+      *freed += curr->sz;
+      curr->next = *out;
+      *out = curr;
+    } else {
+      prev = curr;
+    }
+  }
+}
+
+static int cuda_trim_cache(gpucontext *c, size_t *freed) {
+  cuda_context *ctx = (cuda_context *)c;
+  gpudata *list = NULL, *next;
+  size_t n = 0;
+
+  ASSERT_CTX(ctx);
+
+  ga_lock_acquire(ctx->lock);
+  trim_list(ctx, &ctx->freeblocks, &list, &n);
+  trim_list(ctx, &ctx->managedblocks, &list, &n);
+  ctx->reclaimed += n;
+  ga_lock_release(ctx->lock);
+
+  /* The blocks are off the lists, so the waits can be done unlocked */
+  cuda_enter(ctx);
+  for (; list != NULL; list = next) {
+    next = list->next;
+    /* Pending work may still use the memory */
+    cuEventSynchronize(list->wev);
+    cuEventSynchronize(list->rev);
+    cuMemFree(list->ptr);
+    deallocate(list);
+  }
+  cuda_exit(ctx);
+  *freed = n;
+  return GA_NO_ERROR;
+}
+
 /*
  * Allocate a new block and place in on the freelist. Will allocate
  * the bigger of the requested size and BLOCK_SIZE to avoid allocating
  * multiple small blocks.
+ *
+ * If the cache limit is reached or the driver is out of memory, the
+ * unused blocks in the cache are released and the allocation is tried
+ * again.
+ *
+ * Called with ctx->lock held, which is released around the trim and
+ * the driver allocation since both can block.  The size of the block
+ * is counted in the cache size beforehand so that concurrent
+ * allocations don't go over the limit together.  If the caller holds
+ * the lock more than once (a BLAS operation that needs a workspace),
+ * the other threads still wait for the allocation to finish.
  */
 static int allocate(cuda_context *ctx, gpudata **res, gpudata **prev,
-                    size_t size) {
+                    size_t size, int flags) {
   CUdeviceptr ptr;
   gpudata *next;
   CUresult err;
+  size_t freed = 0;
 
   *prev = NULL;
 
   if (ctx->max_cache_size != 0) {
     if (size < BLOCK_SIZE) size = BLOCK_SIZE;
-    if (ctx->cache_size + size > ctx->max_cache_size)
-      return error_set(ctx->err, GA_VALUE_ERROR, "Maximum cache size reached");
+    if (ctx->cache_size + size > ctx->max_cache_size) {
+      ga_lock_release(ctx->lock);
+      cuda_trim_cache((gpucontext *)ctx, &freed);
+      ga_lock_acquire(ctx->lock);
+      if (ctx->cache_size + size > ctx->max_cache_size)
+        return error_set(ctx->err, GA_VALUE_ERROR, "Maximum cache size reached");
+    }
   }
+  ctx->cache_size += size;
+  ga_lock_release(ctx->lock);
 
   cuda_enter(ctx);
 
-  err = cuMemAlloc(&ptr, size);
+  if (flags & CUDA_MANAGED_PTR)
+    err = cuMemAllocManaged(&ptr, size, CU_MEM_ATTACH_GLOBAL);
+  else
+    err = cuMemAlloc(&ptr, size);
+  if (err == CUDA_ERROR_OUT_OF_MEMORY && freed == 0) {
+    cuda_trim_cache((gpucontext *)ctx, &freed);
+    if (freed != 0) {
+      if (flags & CUDA_MANAGED_PTR)
+        err = cuMemAllocManaged(&ptr, size, CU_MEM_ATTACH_GLOBAL);
+      else
+        err = cuMemAlloc(&ptr, size);
+    }
+  }
   if (err != CUDA_SUCCESS) {
     cuda_exit(ctx);
+    ga_lock_acquire(ctx->lock);
+    ctx->cache_size -= size;
     return error_cuda(ctx->err, "cuMemAlloc", err);
   }
 
   *res = new_gpudata(ctx, ptr, size);
+  if (*res == NULL)
+    cuMemFree(ptr);
 
   cuda_exit(ctx);
 
+  ga_lock_acquire(ctx->lock);
   if (*res == NULL) {
-    cuMemFree(ptr);
-    return ctx->err->code;
+    ctx->cache_size -= size;
+    return error_code(ctx->err);
   }
 
-  ctx->cache_size += size;
-
-  (*res)->flags |= CUDA_HEAD_ALLOC;
+  (*res)->flags |= CUDA_HEAD_ALLOC | (flags & CUDA_MANAGED_PTR);
+  (*res)->asz = size;
 
-  /* Now that the block is allocated, enter it in the freelist */
-  next = ctx->freeblocks;
+  /* Now that the block is allocated, enter it in the freelist.  It
+     may have changed while the lock was released. */
+  next = *freelist(ctx, flags);
   for (; next && next->ptr < (*res)->ptr; next = next->next) {
     *prev = next;
   }
@@ -660,7 +963,7 @@ static int allocate(cuda_context *ctx, gpudata **res, gpudata **prev,
   if (*prev)
     (*prev)->next = *res;
   else
-    ctx->freeblocks = *res;
+    *freelist(ctx, flags) = *res;
 
   return GA_NO_ERROR;
 }
@@ -682,20 +985,22 @@ static int extract(gpudata *curr, gpudata *prev, size_t size) {
   } else {
     split = new_gpudata(curr->ctx, curr->ptr + size, remaining);
     if (split == NULL)
-      return curr->ctx->err->code;
+      return error_code(curr->ctx->err);
+    split->flags |= curr->flags & CUDA_MANAGED_PTR;
     /* Make sure the chain keeps going */
     split->next = curr->next;
     curr->next = NULL;
     /* Make sure we don't start using the split buffer too soon */
     cuda_records(split, CUDA_WAIT_ALL, curr->ls);
     next = split;
+    curr->ctx->nsplits++;
     curr->sz = size;
   }
 
   if (prev != NULL)
     prev->next = next;
   else
-    curr->ctx->freeblocks = next;
+    *freelist(curr->ctx, curr->flags) = next;
 
   return GA_NO_ERROR;
 }
@@ -707,10 +1012,11 @@ static inline size_t roundup(size_t s, size_t m) {
   return ((s + (m - 1)) / m) * m;
 }
 
-static gpudata *cuda_alloc(gpucontext *c, size_t size, void *data, int flags) {
+static gpudata *do_alloc(cuda_context *ctx, size_t size, void *data,
+                         int flags) {
   gpudata *res = NULL, *prev = NULL;
-  cuda_context *ctx = (cuda_context *)c;
   size_t asize;
+  int mflags = 0;
 
   if (size == 0) size = 1;
 
@@ -730,18 +1036,26 @@ static gpudata *cuda_alloc(gpucontext *c, size_t size, void *data, int flags) {
     return NULL;
   }
 
+  if (flags & GA_BUFFER_MANAGED) {
+    if (cuMemAllocManaged == NULL) {
+      error_set(ctx->err, GA_DEVSUP_ERROR, "Managed memory is not supported by the driver");
+      return NULL;
+    }
+    mflags = CUDA_MANAGED_PTR;
+  }
+
   /* We don't want to manage really small allocations so we round up
    * to a multiple of FRAG_SIZE.  This also ensures that if we split a
    * block, the next block starts properly aligned for any data type.
    */
   if (ctx->max_cache_size != 0) {
     asize = roundup(size, FRAG_SIZE);
-    find_best(ctx, &res, &prev, asize);
+    find_best(ctx, &res, &prev, asize, mflags);
   } else {
     asize = size;
   }
 
-  if (res == NULL && allocate(ctx, &res, &prev, asize) != GA_NO_ERROR)
+  if (res == NULL && allocate(ctx, &res, &prev, asize, mflags) != GA_NO_ERROR)
     return NULL;
 
   if (extract(res, prev, asize) != GA_NO_ERROR)
@@ -752,13 +1066,34 @@ static gpudata *cuda_alloc(gpucontext *c, size_t size, void *data, int flags) {
   /* We consider this buffer allocated and ready to go */
   res->refcnt = 1;
 
-  if (flags & GA_BUFFER_INIT) {
+  ctx->in_use += res->sz;
+  ctx->nblocks++;
+  if (ctx->in_use > ctx->peak)
+    ctx->peak = ctx->in_use;
+
+  return res;
+}
+
+static gpudata *cuda_alloc(gpucontext *c, size_t size, void *data, int flags) {
+  cuda_context *ctx = (cuda_context *)c;
+  gpudata *res;
+
+  /* The freelists and the statistics are shared by all threads */
+  ga_lock_acquire(ctx->lock);
+  res = do_alloc(ctx, size, data, flags);
+  /* Under the lock so that it follows the free of the block it reuses */
+  if (res != NULL && ctx->trace != NULL) {
+    alloc_trace_alloc(ctx->trace, res, size, flags);
+    res->flags |= CUDA_TRACED;
+  }
+  ga_lock_release(ctx->lock);
+
+  if (res != NULL && (flags & GA_BUFFER_INIT)) {
     if (cuda_write(res, 0, data, size) != GA_NO_ERROR) {
       cuda_free(res);
       return NULL;
     }
   }
-
   return res;
 }
 
@@ -771,6 +1106,22 @@ int cuda_get_ipc_handle(gpudata *d, GpuArrayIpcMemHandle *h) {
   return GA_NO_ERROR;
 }
 
+/*
+ * The handle from cuda_get_ipc_handle() refers to the whole driver
+ * allocation, which the allocation cache may have split.  This gives
+ * the offset of `d` in it and its size, which is what
+ * cuda_open_ipc_handle() needs on the other side.
+ */
+int cuda_get_ipc_range(gpudata *d, size_t *off, size_t *sz) {
+  CUdeviceptr base;
+  ASSERT_BUF(d);
+  cuda_enter(d->ctx);
+  CUDA_EXIT_ON_ERROR(d->ctx, cuMemGetAddressRange(&base, sz, d->ptr));
+  cuda_exit(d->ctx);
+  *off = (size_t)(d->ptr - base);
+  return GA_NO_ERROR;
+}
+
 gpudata *cuda_open_ipc_handle(gpucontext *c, GpuArrayIpcMemHandle *h, size_t sz) {
   CUdeviceptr p;
   cuda_context *ctx = (cuda_context *)c;
@@ -788,12 +1139,17 @@ gpudata *cuda_open_ipc_handle(gpucontext *c, GpuArrayIpcMemHandle *h, size_t sz)
   d = cuda_make_buf(ctx, p, sz);
   if (d != NULL)
     d->flags |= CUDA_IPC_MEMORY;
+  else
+    cuIpcCloseMemHandle(p);
+  cuda_exit(ctx);
   return d;
 }
 
 static void cuda_retain(gpudata *d) {
   ASSERT_BUF(d);
+  ga_lock_acquire(d->ctx->lock);
   d->refcnt++;
+  ga_lock_release(d->ctx->lock);
 }
 
 static void deallocate(gpudata *d) {
@@ -805,14 +1161,23 @@ static void deallocate(gpudata *d) {
   free(d);
 }
 
-static void cuda_free(gpudata *d) {
+/*
+ * Returns 1 if the last reference to `d` was dropped, in which case
+ * the caller must release the reference `d` held on the context.
+ * This is not done here since it could free the context lock, which
+ * the caller holds.
+ */
+static int do_free(gpudata *d) {
   /* We ignore errors on free */
   ASSERT_BUF(d);
   d->refcnt--;
   if (d->refcnt == 0) {
-    /* Keep a reference to the context since we deallocate the gpudata
-     * object */
     cuda_context *ctx = d->ctx;
+    /* Before the block goes back to the freelist */
+    if (d->flags & CUDA_TRACED) {
+      alloc_trace_free(ctx->trace, d);
+      d->flags &= ~CUDA_TRACED;
+    }
     if (d->flags & DONTFREE) {
       /* This is the path for "external" buffers */
       deallocate(d);
@@ -821,16 +1186,22 @@ static void cuda_free(gpudata *d) {
       deallocate(d);
     } else if (ctx->max_cache_size == 0) {
       /* Just free the pointer */
+      ctx->in_use -= d->sz;
+      ctx->nblocks--;
+      ctx->cache_size -= d->sz;
       cuMemFree(d->ptr);
       deallocate(d);
     } else {
       /* Find the position in the freelist.  Freelist is kept in order
          of allocation address */
-      gpudata *next = d->ctx->freeblocks, *prev = NULL;
+      gpudata **head = freelist(d->ctx, d->flags);
+      gpudata *next = *head, *prev = NULL;
+      ctx->in_use -= d->sz;
+      ctx->nblocks--;
       for (; next && next->ptr < d->ptr; next = next->next) {
         prev = next;
       }
-      next = prev != NULL ? prev->next : d->ctx->freeblocks;
+      next = prev != NULL ? prev->next : *head;
 
       /* See if we can merge the block with the previous one */
       if (!(d->flags & CUDA_HEAD_ALLOC) &&
@@ -840,10 +1211,11 @@ static void cuda_free(gpudata *d) {
         cuda_records(prev, CUDA_WAIT_ALL, prev->ls);
         deallocate(d);
         d = prev;
+        ctx->nmerges++;
       } else if (prev != NULL) {
         prev->next = d;
       } else {
-        d->ctx->freeblocks = d;
+        *head = d;
       }
 
       /* See if we can merge with next */
@@ -854,16 +1226,31 @@ static void cuda_free(gpudata *d) {
         cuda_wait(next, CUDA_WAIT_ALL);
         cuda_record(d, CUDA_WAIT_ALL);
         deallocate(next);
+        ctx->nmerges++;
       } else {
         d->next = next;
       }
     }
-    /* We keep this at the end since the freed buffer could be the
-     * last reference to the context and therefore clearing the
-     * reference could trigger the freeing if the whole context
-     * including the freelist, which we manipulate. */
-    cuda_free_ctx(ctx);
+    return 1;
   }
+  return 0;
+}
+
+static void cuda_free(gpudata *d) {
+  /* Keep a reference to the context since we may deallocate the
+   * gpudata object */
+  cuda_context *ctx = d->ctx;
+  int last;
+
+  ga_lock_acquire(ctx->lock);
+  last = do_free(d);
+  ga_lock_release(ctx->lock);
+  /* We keep this at the end since the freed buffer could be the
+   * last reference to the context and therefore clearing the
+   * reference could trigger the freeing if the whole context
+   * including the freelist, which we manipulate. */
+  if (last)
+    cuda_free_ctx(ctx);
 }
 
 static int cuda_share(gpudata *a, gpudata *b) {
@@ -874,29 +1261,41 @@ static int cuda_share(gpudata *a, gpudata *b) {
            (b->ptr <= a->ptr && b->ptr + b->sz > a->ptr)));
 }
 
+/*
+ * The events of a buffer and its last stream are shared by all the
+ * threads using it, so they are only touched under the context lock.
+ * None of this blocks the host.
+ */
 static int cuda_waits(gpudata *a, int flags, CUstream s) {
+  cuda_context *ctx;
+  CUresult err = CUDA_SUCCESS;
+
   ASSERT_BUF(a);
+  ctx = a->ctx;
 
+  ga_lock_acquire(ctx->lock);
   /* Never skip the wait if CUDA_WAIT_FORCE */
   if (ISCLR(flags, CUDA_WAIT_FORCE)) {
-    if (ISSET(a->ctx->flags, GA_CTX_SINGLE_STREAM))
-      return GA_NO_ERROR;
-
     /* If the last stream to touch this buffer is the same, we don't
      * need to wait for anything. */
-    if (a->ls == s)
+    if (ISSET(ctx->flags, GA_CTX_SINGLE_STREAM) || a->ls == s) {
+      ga_lock_release(ctx->lock);
       return GA_NO_ERROR;
+    }
   }
 
-  cuda_enter(a->ctx);
+  cuda_enter(ctx);
   /* We wait for writes that happened before since multiple reads at
    * the same time are fine */
   if (ISSET(flags, CUDA_WAIT_READ) || ISSET(flags, CUDA_WAIT_WRITE))
-    CUDA_EXIT_ON_ERROR(a->ctx, cuStreamWaitEvent(s, a->wev, 0));
+    err = cuStreamWaitEvent(s, a->wev, 0);
   /* Make sure to not disturb previous reads */
-  if (ISSET(flags, CUDA_WAIT_WRITE))
-    CUDA_EXIT_ON_ERROR(a->ctx, cuStreamWaitEvent(s, a->rev, 0));
-  cuda_exit(a->ctx);
+  if (err == CUDA_SUCCESS && ISSET(flags, CUDA_WAIT_WRITE))
+    err = cuStreamWaitEvent(s, a->rev, 0);
+  cuda_exit(ctx);
+  ga_lock_release(ctx->lock);
+  if (err != CUDA_SUCCESS)
+    return error_cuda(ctx->err, "cuStreamWaitEvent", err);
   return GA_NO_ERROR;
 }
 
@@ -905,17 +1304,26 @@ int cuda_wait(gpudata *a, int flags) {
 }
 
 static int cuda_records(gpudata *a, int flags, CUstream s) {
+  cuda_context *ctx;
+  CUresult err = CUDA_SUCCESS;
+
   ASSERT_BUF(a);
+  ctx = a->ctx;
   if (ISCLR(flags, CUDA_WAIT_FORCE) &&
-      ISSET(a->ctx->flags, GA_CTX_SINGLE_STREAM))
+      ISSET(ctx->flags, GA_CTX_SINGLE_STREAM))
     return GA_NO_ERROR;
-  cuda_enter(a->ctx);
+  ga_lock_acquire(ctx->lock);
+  cuda_enter(ctx);
   if (ISSET(flags, CUDA_WAIT_READ))
-    CUDA_EXIT_ON_ERROR(a->ctx, cuEventRecord(a->rev, s));
-  if (ISSET(flags, CUDA_WAIT_WRITE))
-    CUDA_EXIT_ON_ERROR(a->ctx, cuEventRecord(a->wev, s));
-  cuda_exit(a->ctx);
-  a->ls = s;
+    err = cuEventRecord(a->rev, s);
+  if (err == CUDA_SUCCESS && ISSET(flags, CUDA_WAIT_WRITE))
+    err = cuEventRecord(a->wev, s);
+  cuda_exit(ctx);
+  if (err == CUDA_SUCCESS)
+    a->ls = s;
+  ga_lock_release(ctx->lock);
+  if (err != CUDA_SUCCESS)
+    return error_cuda(ctx->err, "cuEventRecord", err);
   return GA_NO_ERROR;
 }
 
@@ -1027,6 +1435,121 @@ static int cuda_write(gpudata *dst, size_t dstoff, const void *src,
     return GA_NO_ERROR;
 }
 
+static void rect_memcpy(char *dst, size_t dst_rpitch, size_t dst_spitch,
+                        const char *src, size_t src_rpitch, size_t src_spitch,
+                        size_t width, size_t height, size_t depth) {
+  size_t y, z;
+
+  for (z = 0; z < depth; z++)
+    for (y = 0; y < height; y++)
+      memcpy(dst + z*dst_spitch + y*dst_rpitch,
+             src + z*src_spitch + y*src_rpitch, width);
+}
+
+static int cuda_read_rect(void *dst, size_t dst_rpitch, size_t dst_spitch,
+                          gpudata *src, size_t srcoff,
+                          size_t src_rpitch, size_t src_spitch,
+                          size_t width, size_t height, size_t depth) {
+    cuda_context *ctx = src->ctx;
+    CUDA_MEMCPY3D cp;
+    size_t extent;
+
+    ASSERT_BUF(src);
+
+    extent = (depth - 1) * src_spitch + (height - 1) * src_rpitch + width;
+    if (srcoff > src->sz || (src->sz - srcoff) < extent)
+      return error_set(ctx->err, GA_VALUE_ERROR, "source is smaller than the read region");
+
+    cuda_enter(ctx);
+
+    if (src->flags & CUDA_MAPPED_PTR) {
+
+      if (ISSET(ctx->flags, GA_CTX_SINGLE_STREAM))
+        CUDA_EXIT_ON_ERROR(ctx, cuStreamSynchronize(ctx->s));
+      else
+        CUDA_EXIT_ON_ERROR(ctx, cuEventSynchronize(src->wev));
+
+      rect_memcpy(dst, dst_rpitch, dst_spitch,
+                  (const char *)(src->ptr + srcoff), src_rpitch, src_spitch,
+                  width, height, depth);
+    } else {
+      memset(&cp, 0, sizeof(cp));
+      cp.srcMemoryType = CU_MEMORYTYPE_DEVICE;
+      cp.srcDevice = src->ptr + srcoff;
+      cp.srcPitch = src_rpitch;
+      cp.srcHeight = src_spitch / src_rpitch;
+      cp.dstMemoryType = CU_MEMORYTYPE_HOST;
+      cp.dstHost = dst;
+      cp.dstPitch = dst_rpitch;
+      cp.dstHeight = dst_spitch / dst_rpitch;
+      cp.WidthInBytes = width;
+      cp.Height = height;
+      cp.Depth = depth;
+
+      GA_CUDA_EXIT_ON_ERROR(ctx,
+          cuda_waits(src, CUDA_WAIT_READ, ctx->mem_s));
+
+      CUDA_EXIT_ON_ERROR(ctx, cuMemcpy3DAsync(&cp, ctx->mem_s));
+
+      GA_CUDA_EXIT_ON_ERROR(ctx,
+          cuda_records(src, CUDA_WAIT_READ, ctx->mem_s));
+    }
+    cuda_exit(ctx);
+    return GA_NO_ERROR;
+}
+
+static int cuda_write_rect(gpudata *dst, size_t dstoff,
+                           size_t dst_rpitch, size_t dst_spitch,
+                           const void *src,
+                           size_t src_rpitch, size_t src_spitch,
+                           size_t width, size_t height, size_t depth) {
+    cuda_context *ctx = dst->ctx;
+    CUDA_MEMCPY3D cp;
+    size_t extent;
+
+    ASSERT_BUF(dst);
+
+    extent = (depth - 1) * dst_spitch + (height - 1) * dst_rpitch + width;
+    if (dstoff > dst->sz || (dst->sz - dstoff) < extent)
+      return error_set(ctx->err, GA_VALUE_ERROR, "Destination is smaller than the write region");
+
+    cuda_enter(ctx);
+
+    if (dst->flags & CUDA_MAPPED_PTR) {
+
+      if (ISSET(ctx->flags, GA_CTX_SINGLE_STREAM))
+        CUDA_EXIT_ON_ERROR(ctx, cuStreamSynchronize(ctx->s));
+      else
+        CUDA_EXIT_ON_ERROR(ctx, cuEventSynchronize(dst->rev));
+
+      rect_memcpy((char *)(dst->ptr + dstoff), dst_rpitch, dst_spitch,
+                  src, src_rpitch, src_spitch, width, height, depth);
+    } else {
+      memset(&cp, 0, sizeof(cp));
+      cp.srcMemoryType = CU_MEMORYTYPE_HOST;
+      cp.srcHost = src;
+      cp.srcPitch = src_rpitch;
+      cp.srcHeight = src_spitch / src_rpitch;
+      cp.dstMemoryType = CU_MEMORYTYPE_DEVICE;
+      cp.dstDevice = dst->ptr + dstoff;
+      cp.dstPitch = dst_rpitch;
+      cp.dstHeight = dst_spitch / dst_rpitch;
+      cp.WidthInBytes = width;
+      cp.Height = height;
+      cp.Depth = depth;
+
+      GA_CUDA_EXIT_ON_ERROR(ctx,
+          cuda_waits(dst, CUDA_WAIT_WRITE, ctx->mem_s));
+
+      CUDA_EXIT_ON_ERROR(ctx, cuMemcpy3DAsync(&cp, ctx->mem_s));
+
+      GA_CUDA_EXIT_ON_ERROR(ctx,
+          cuda_records(dst, CUDA_WAIT_WRITE, ctx->mem_s));
+    }
+    cuda_exit(ctx);
+    return GA_NO_ERROR;
+}
+
 static int cuda_memset(gpudata *dst, size_t dstoff, int data) {
     cuda_context *ctx = dst->ctx;
 
@@ -1048,6 +1571,62 @@ static int cuda_memset(gpudata *dst, size_t dstoff, int data) {
     return GA_NO_ERROR;
 }
 
+/* Must be called with the context entered, leaves it on error */
+static int managed_location(cuda_context *ctx, int location,
+                            CUdevice *dev) {
+  if (location == GA_LOCATION_HOST) {
+    *dev = CU_DEVICE_CPU;
+    return GA_NO_ERROR;
+  }
+  CUDA_EXIT_ON_ERROR(ctx, cuCtxGetDevice(dev));
+  return GA_NO_ERROR;
+}
+
+static int cuda_prefetch(gpudata *b, size_t off, size_t sz, int location) {
+  cuda_context *ctx = b->ctx;
+  CUdevice dev;
+
+  ASSERT_BUF(b);
+
+  if (!(b->flags & CUDA_MANAGED_PTR))
+    return error_set(ctx->err, GA_VALUE_ERROR, "Buffer is not managed");
+  if (off > b->sz || sz > b->sz - off)
+    return error_set(ctx->err, GA_VALUE_ERROR, "Range is outside of the buffer");
+  if (cuMemPrefetchAsync == NULL)
+    return error_set(ctx->err, GA_DEVSUP_ERROR, "Prefetch is not supported by the driver");
+
+  cuda_enter(ctx);
+  GA_CHECK(managed_location(ctx, location, &dev));
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_wait(b, CUDA_WAIT_ALL));
+  CUDA_EXIT_ON_ERROR(ctx, cuMemPrefetchAsync(b->ptr + off, sz, dev, ctx->s));
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_record(b, CUDA_WAIT_ALL));
+  cuda_exit(ctx);
+  return GA_NO_ERROR;
+}
+
+static int cuda_advise(gpudata *b, size_t off, size_t sz, int advice,
+                       int location) {
+  cuda_context *ctx = b->ctx;
+  CUdevice dev;
+
+  ASSERT_BUF(b);
+
+  if (!(b->flags & CUDA_MANAGED_PTR))
+    return error_set(ctx->err, GA_VALUE_ERROR, "Buffer is not managed");
+  if (off > b->sz || sz > b->sz - off)
+    return error_set(ctx->err, GA_VALUE_ERROR, "Range is outside of the buffer");
+  if (cuMemAdvise == NULL)
+    return error_set(ctx->err, GA_DEVSUP_ERROR, "Memory advice is not supported by the driver");
+
+  cuda_enter(ctx);
+  GA_CHECK(managed_location(ctx, location, &dev));
+  /* The GA_ADVISE_* values match the driver ones */
+  CUDA_EXIT_ON_ERROR(ctx, cuMemAdvise(b->ptr + off, sz, (CUmem_advise)advice,
+                                      dev));
+  cuda_exit(ctx);
+  return GA_NO_ERROR;
+}
+
 static int get_cc(CUdevice dev, int *maj, int *min, error *e) {
   CUresult err;
   err = cuDeviceGetAttribute(maj,
@@ -1194,29 +1773,29 @@ out:
   return res;
 }
 
-static int compile(cuda_context *ctx, strb *src, strb* bin, strb *log) {
+/*
+ * Get the binary for `k` from the context disk cache or compile it.
+ *
+ * The disk cache and its memory LRU have no lock of their own, so
+ * they are only touched under ctx->lock.  The compile runs unlocked.
+ */
+static int compile_bin(cuda_context *ctx, disk_key *k, strb *src, strb *bin,
+                       strb *log) {
   strb ptx = STRB_STATIC_INIT;
   strb *cbin;
-  disk_key k;
   disk_key *pk;
-
-  memset(&k, 0, sizeof(k));
-  k.version = 0;
-#ifdef DEBUG
-  k.debug = 1;
-#endif
-  k.major = ctx->major;
-  k.minor = ctx->minor;
-  memcpy(k.bin_id, ctx->bin_id, 64);
-  memcpy(&k.src, src, sizeof(strb));
+  int err;
 
   // Look up the binary in the disk cache
   if (ctx->disk_cache) {
-    cbin = cache_get(ctx->disk_cache, &k);
-    if (cbin != NULL) {
+    ga_lock_acquire(ctx->lock);
+    /* cbin may be evicted and freed as soon as the lock is released */
+    cbin = cache_get(ctx->disk_cache, k);
+    if (cbin != NULL)
       strb_appendb(bin, cbin);
+    ga_lock_release(ctx->lock);
+    if (cbin != NULL)
       return GA_NO_ERROR;
-    }
   }
 
   GA_CHECK(call_compiler(ctx, src, &ptx, log));
@@ -1228,15 +1807,15 @@ static int compile(cuda_context *ctx, strb *src, strb* bin, strb *log) {
     if (pk == NULL) {
       error_sys(ctx->err, "calloc");
       fprintf(stderr, "Error adding kernel to disk cache: %s\n",
-              ctx->err->msg);
+              error_msg(ctx->err));
       return GA_NO_ERROR;
     }
-    memcpy(pk, &k, DISK_KEY_MM);
+    memcpy(pk, k, DISK_KEY_MM);
     strb_appendb(&pk->src, src);
     if (strb_error(&pk->src)) {
       error_sys(ctx->err, "strb_appendb"); 
       fprintf(stderr, "Error adding kernel to disk cache %s\n",
-              ctx->err->msg);
+              error_msg(ctx->err));
       disk_free((cache_key_t)pk);
       return GA_NO_ERROR;
     }
@@ -1244,7 +1823,7 @@ static int compile(cuda_context *ctx, strb *src, strb* bin, strb *log) {
     if (cbin == NULL) {
       error_sys(ctx->err, "strb_alloc"); 
       fprintf(stderr, "Error adding kernel to disk cache: %s\n",
-              ctx->err->msg);
+              error_msg(ctx->err));
       disk_free((cache_key_t)pk);
       return GA_NO_ERROR;
     }
@@ -1252,12 +1831,15 @@ static int compile(cuda_context *ctx, strb *src, strb* bin, strb *log) {
     if (strb_error(cbin)) {
       error_sys(ctx->err, "strb_appendb"); 
       fprintf(stderr, "Error adding kernel to disk cache %s\n",
-              ctx->err->msg);
+              error_msg(ctx->err));
       disk_free((cache_key_t)pk);
       strb_free(cbin);
       return GA_NO_ERROR;
     }
-    if (cache_add(ctx->disk_cache, pk, cbin)) {
+    ga_lock_acquire(ctx->lock);
+    err = cache_add(ctx->disk_cache, pk, cbin);
+    ga_lock_release(ctx->lock);
+    if (err) {
       // TODO use better error messages
       fprintf(stderr, "Error adding kernel to disk cache\n");
     }
@@ -1266,9 +1848,50 @@ static int compile(cuda_context *ctx, strb *src, strb* bin, strb *log) {
   return GA_NO_ERROR;
 }
 
+static int compile(cuda_context *ctx, strb *src, strb* bin, strb *log) {
+  disk_key k;
+  ga_lock *flight;
+  int err;
+
+  memset(&k, 0, sizeof(k));
+  k.version = 0;
+#ifdef DEBUG
+  k.debug = 1;
+#endif
+  k.major = ctx->major;
+  k.minor = ctx->minor;
+  memcpy(k.bin_id, ctx->bin_id, 64);
+  memcpy(&k.src, src, sizeof(strb));
+
+  if (bin_cache_get(&k, bin))
+    return GA_NO_ERROR;
+
+  flight = bin_cache != NULL ?
+    bin_flight[(uint32_t)disk_hash(&k) % BIN_FLIGHT_LOCKS] : NULL;
+  ga_lock_acquire(flight);
+  /* Someone else may have built it while we waited */
+  if (bin_cache_get(&k, bin)) {
+    ga_lock_release(flight);
+    return GA_NO_ERROR;
+  }
+  err = compile_bin(ctx, &k, src, bin, log);
+  if (err == GA_NO_ERROR && !strb_error(bin))
+    bin_cache_add(&k, bin);
+  ga_lock_release(flight);
+  return err;
+}
+
 static void _cuda_freekernel(gpukernel *k) {
-  k->refcnt--;
-  if (k->refcnt == 0) {
+  unsigned int refcnt;
+
+  if (k->ctx != NULL) {
+    ga_lock_acquire(k->ctx->lock);
+    refcnt = --k->refcnt;
+    ga_lock_release(k->ctx->lock);
+  } else {
+    refcnt = --k->refcnt;
+  }
+  if (refcnt == 0) {
     if (k->ctx != NULL) {
       cuda_enter(k->ctx);
       cuModuleUnload(k->m);
@@ -1291,7 +1914,7 @@ static int cuda_newkernel(gpukernel **k, gpucontext *c, unsigned int count,
     strb src = STRB_STATIC_INIT;
     strb bin = STRB_STATIC_INIT;
     strb log = STRB_STATIC_INIT;
-    gpukernel *res;
+    gpukernel *res, *other;
     kernel_key k_key;
     kernel_key *p_key;
     CUdevice dev;
@@ -1313,22 +1936,20 @@ static int cuda_newkernel(gpukernel **k, gpucontext *c, unsigned int count,
       return error_cuda(ctx->err, "cuCtxGetDevice", err);
     }
 
-    if (get_cc(dev, &major, &minor, ctx->err) != GA_NO_ERROR)
-      return ctx->err->code;
+    if (get_cc(dev, &major, &minor, ctx->err) != GA_NO_ERROR) {
+      cuda_exit(ctx);
+      return error_code(ctx->err);
+    }
 
     // GA_USE_SMALL will always work
     // GA_USE_HALF should always work
+    // GA_USE_COMPLEX uses the helpers from cluda.h
     if (flags & GA_USE_DOUBLE) {
       if (major < 1 || (major == 1 && minor < 3)) {
         cuda_exit(ctx);
         return error_set(ctx->err, GA_DEVSUP_ERROR, "Requested double support and current device doesn't support them");
       }
     }
-    if (flags & GA_USE_COMPLEX) {
-      // just for now since it is most likely broken
-      cuda_exit(ctx);
-      return error_set(ctx->err, GA_UNSUPPORTED_ERROR, "Complex support is not there yet.");
-    }
 
     if (lengths == NULL) {
       for (i = 0; i < count; i++)
@@ -1353,14 +1974,22 @@ static int cuda_newkernel(gpukernel **k, gpucontext *c, unsigned int count,
     k_key.fname = fname;
     k_key.src = src;
 
+    ga_lock_acquire(ctx->lock);
     res = (gpukernel *)cache_get(ctx->kernel_cache, &k_key);
-    if (res != NULL) {
+    if (res != NULL)
       res->refcnt++;
+    ga_lock_release(ctx->lock);
+    if (res != NULL) {
       strb_clear(&src);
+      cuda_exit(ctx);
       *k = res;
       return GA_NO_ERROR;
     }
 
+    /* The compile is done without the lock, so another thread may
+       build the same kernel meanwhile.  The first one in the cache
+       wins. */
+
     if (compile(ctx, &src, &bin, &log) != GA_NO_ERROR) {
       if (err_str != NULL) {
         strb debug_msg = STRB_STATIC_INIT;
@@ -1376,7 +2005,7 @@ static int cuda_newkernel(gpukernel **k, gpucontext *c, unsigned int count,
       strb_clear(&bin);
       strb_clear(&log);
       cuda_exit(ctx);
-      return ctx->err->code;
+      return error_code(ctx->err);
     }
     strb_clear(&log);
 
@@ -1433,10 +2062,21 @@ static int cuda_newkernel(gpukernel **k, gpucontext *c, unsigned int count,
       return error_cuda(ctx->err, "cuModuleGetFunction", err);
     }
 
-    res->ctx = ctx;
-    ctx->refcnt++;
     cuda_exit(ctx);
     TAG_KER(res);
+
+    ga_lock_acquire(ctx->lock);
+    res->ctx = ctx;
+    ctx->refcnt++;
+    other = (gpukernel *)cache_get(ctx->kernel_cache, &k_key);
+    if (other != NULL) {
+      other->refcnt++;
+      ga_lock_release(ctx->lock);
+      _cuda_freekernel(res);
+      strb_clear(&src);
+      *k = other;
+      return GA_NO_ERROR;
+    }
     p_key = memdup(&k_key, sizeof(kernel_key));
     if (p_key != NULL) {
       p_key->fname = strdup(fname);
@@ -1453,13 +2093,16 @@ static int cuda_newkernel(gpukernel **k, gpucontext *c, unsigned int count,
     } else {
       strb_clear(&src);
     }
+    ga_lock_release(ctx->lock);
     *k = res;
     return GA_NO_ERROR;
 }
 
 static void cuda_retainkernel(gpukernel *k) {
   ASSERT_KER(k);
+  ga_lock_acquire(k->ctx->lock);
   k->refcnt++;
+  ga_lock_release(k->ctx->lock);
 }
 
 static void cuda_freekernel(gpukernel *k) {
@@ -1543,44 +2186,228 @@ static int cuda_sync(gpudata *b) {
   return err;
 }
 
+/*
+ * Stream of `ctx` for the copies from `src`.
+ *
+ * When `ctx` can access the memory of `src` directly, each pair of
+ * contexts gets its own stream so that the copies to different peers
+ * overlap with each other and with the work on ctx->s.  Otherwise the
+ * driver stages the copy through the host and it goes on ctx->mem_s.
+ *
+ * Must be called between cuda_enter(ctx) and cuda_exit(ctx).  The
+ * peer list is only touched under the lock of `ctx`, which is not held
+ * while `src` is queried so that no other context lock is taken under
+ * it.
+ */
+static int cuda_peer_stream(cuda_context *ctx, cuda_context *src,
+                            CUstream *s) {
+  cuda_peer *p, *q;
+  CUdevice dev, sdev;
+  CUresult err;
+  int access = 0;
+
+  ga_lock_acquire(ctx->lock);
+  for (p = ctx->peers; p != NULL; p = p->next) {
+    if (p->src == src->ctx) {
+      *s = (p->s != NULL) ? p->s : ctx->mem_s;
+      ga_lock_release(ctx->lock);
+      return GA_NO_ERROR;
+    }
+  }
+  ga_lock_release(ctx->lock);
+
+  if (ISCLR(ctx->flags, GA_CTX_SINGLE_STREAM)) {
+    if (src->ctx == ctx->ctx) {
+      access = 1;
+    } else {
+      cuCtxGetDevice(&dev);
+      cuda_enter(src);
+      cuCtxGetDevice(&sdev);
+      cuda_exit(src);
+      if (cuDeviceCanAccessPeer(&access, dev, sdev) != CUDA_SUCCESS)
+        access = 0;
+      if (access) {
+        err = cuCtxEnablePeerAccess(src->ctx, 0);
+        /* Running out of peer mappings is not an error for the copy */
+        access = (err == CUDA_SUCCESS ||
+                  err == CUDA_ERROR_PEER_ACCESS_ALREADY_ENABLED);
+      }
+    }
+  }
+
+  p = malloc(sizeof(*p));
+  if (p == NULL)
+    return error_sys(ctx->err, "malloc");
+  p->src = src->ctx;
+  p->s = NULL;
+  if (access) {
+    err = cuStreamCreate(&p->s, 0);
+    if (err != CUDA_SUCCESS) {
+      free(p);
+      return error_cuda(ctx->err, "cuStreamCreate", err);
+    }
+  }
+
+  ga_lock_acquire(ctx->lock);
+  /* Another thread may have added it meanwhile */
+  for (q = ctx->peers; q != NULL; q = q->next) {
+    if (q->src == src->ctx)
+      break;
+  }
+  if (q == NULL) {
+    p->next = ctx->peers;
+    ctx->peers = p;
+    q = p;
+    p = NULL;
+  }
+  *s = (q->s != NULL) ? q->s : ctx->mem_s;
+  ga_lock_release(ctx->lock);
+  if (p != NULL) {
+    if (p->s != NULL)
+      cuStreamDestroy(p->s);
+    free(p);
+  }
+  return GA_NO_ERROR;
+}
+
+/*
+ * Issue the copy of `sz` bytes from `src` to `dst` on the stream of
+ * the destination context for the source context.
+ */
+static int cuda_transfer_one(gpudata *dst, size_t dstoff,
+                             gpudata *src, size_t srcoff, size_t sz) {
+  cuda_context *ctx = dst->ctx;
+  cuda_context *sctx = src->ctx;
+  CUstream s;
+
+  cuda_enter(ctx);
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_peer_stream(ctx, sctx, &s));
+  if (ISSET(sctx->flags, GA_CTX_SINGLE_STREAM))
+    GA_CUDA_EXIT_ON_ERROR(ctx,
+        cuda_records(src, CUDA_WAIT_WRITE|CUDA_WAIT_FORCE, sctx->s));
+  GA_CUDA_EXIT_ON_ERROR(ctx,
+      cuda_waits(src, CUDA_WAIT_READ|CUDA_WAIT_FORCE, s));
+  GA_CUDA_EXIT_ON_ERROR(ctx, cuda_waits(dst, CUDA_WAIT_WRITE, s));
+
+  CUDA_EXIT_ON_ERROR(ctx,
+      cuMemcpyPeerAsync(dst->ptr + dstoff, ctx->ctx,
+                        src->ptr + srcoff, sctx->ctx, sz, s));
+
+  /* Forced since the source side waits on it */
+  GA_CUDA_EXIT_ON_ERROR(ctx,
+      cuda_records(dst, CUDA_WAIT_WRITE|CUDA_WAIT_FORCE, s));
+  cuda_exit(ctx);
+  return GA_NO_ERROR;
+}
+
+/*
+ * Make the writes to the source of a copy issued by
+ * cuda_transfer_one() wait for it.  The rest of the work in the
+ * source context doesn't.
+ */
+static int cuda_transfer_order(gpudata *dst, gpudata *src) {
+  cuda_context *sctx = src->ctx;
+  const char *what = "cuStreamWaitEvent";
+  CUresult err = CUDA_SUCCESS;
+  int res = GA_NO_ERROR;
+
+  /* Covers peer_s and the events of src */
+  ga_lock_acquire(sctx->lock);
+  cuda_enter(sctx);
+  if (ISSET(sctx->flags, GA_CTX_SINGLE_STREAM)) {
+    err = cuStreamWaitEvent(sctx->s, dst->wev, 0);
+  } else {
+    if (sctx->peer_s == NULL) {
+      what = "cuStreamCreate";
+      err = cuStreamCreate(&sctx->peer_s, 0);
+    }
+    /* Keep the reads that rev already covers */
+    if (err == CUDA_SUCCESS) {
+      what = "cuStreamWaitEvent";
+      err = cuStreamWaitEvent(sctx->peer_s, src->rev, 0);
+    }
+    if (err == CUDA_SUCCESS)
+      err = cuStreamWaitEvent(sctx->peer_s, dst->wev, 0);
+    if (err == CUDA_SUCCESS)
+      res = cuda_records(src, CUDA_WAIT_READ, sctx->peer_s);
+  }
+  cuda_exit(sctx);
+  ga_lock_release(sctx->lock);
+  if (err != CUDA_SUCCESS)
+    return error_cuda(sctx->err, what, err);
+  return res;
+}
+
+/*
+ * Only the events needed to order the copies are recorded: neither
+ * context stream waits on the other unless it was created with
+ * GA_CTX_SINGLE_STREAM, in which case the buffers have no events of
+ * their own.
+ *
+ * The copies are all issued before the source sides wait for them.
+ * If one fails, the sources of those already issued are still
+ * ordered before the error is returned.
+ */
+static int cuda_transfer_many(gpudata **dst, const size_t *dstoff,
+                              gpudata **src, const size_t *srcoff,
+                              const size_t *sz, size_t n) {
+  size_t i, j;
+  int res = GA_NO_ERROR;
+  int err;
+
+  for (i = 0; i < n; i++) {
+    ASSERT_BUF(src[i]);
+    ASSERT_BUF(dst[i]);
+  }
+
+  for (i = 0; i < n; i++) {
+    if (sz[i] == 0)
+      continue;
+    res = cuda_transfer_one(dst[i], dstoff[i], src[i], srcoff[i], sz[i]);
+    if (res != GA_NO_ERROR)
+      break;
+  }
+
+  for (j = 0; j < i; j++) {
+    if (sz[j] == 0)
+      continue;
+    err = cuda_transfer_order(dst[j], src[j]);
+    if (res == GA_NO_ERROR)
+      res = err;
+  }
+  return res;
+}
+
 static int cuda_transfer(gpudata *dst, size_t dstoff,
                          gpudata *src, size_t srcoff, size_t sz) {
-  ASSERT_BUF(src);
-  ASSERT_BUF(dst);
-
-  /* The forced synchronization are there because they are required
-     for proper inter-device correctness. */
-
-  cuda_enter(dst->ctx);
-  /* Make sure we have a rev for the source */
-  GA_CUDA_EXIT_ON_ERROR(dst->ctx,
-      cuda_records(src, CUDA_WAIT_READ|CUDA_WAIT_FORCE, src->ctx->mem_s));
-  /* Make the destination stream wait for it */
-  GA_CUDA_EXIT_ON_ERROR(dst->ctx,
-      cuda_waits(src, CUDA_WAIT_READ|CUDA_WAIT_FORCE, dst->ctx->mem_s));
-
-  /* Also wait on the destination buffer */
-  GA_CUDA_EXIT_ON_ERROR(dst->ctx,
-      cuda_waits(dst, CUDA_WAIT_WRITE, dst->ctx->mem_s));
-
-  CUDA_EXIT_ON_ERROR(dst->ctx,
-      cuMemcpyPeerAsync(dst->ptr+dstoff, dst->ctx->ctx,
-                        src->ptr+srcoff, src->ctx->ctx,
-                        sz, dst->ctx->mem_s));
-
-  /* This records the event in dst->wev */
-  GA_CUDA_EXIT_ON_ERROR(dst->ctx,
-      cuda_records(dst, CUDA_WAIT_WRITE|CUDA_WAIT_FORCE, dst->ctx->mem_s));
-  /* This makes the source stream wait on the wev of dst */
-  GA_CUDA_EXIT_ON_ERROR(dst->ctx,
-      cuda_waits(dst, CUDA_WAIT_WRITE|CUDA_WAIT_FORCE, src->ctx->mem_s));
-
-  /* This records the event on src->rev */
-  GA_CUDA_EXIT_ON_ERROR(dst->ctx,
-      cuda_records(src, CUDA_WAIT_READ, src->ctx->mem_s));
-
-  cuda_exit(dst->ctx);
-  return GA_NO_ERROR;
+  return cuda_transfer_many(&dst, &dstoff, &src, &srcoff, &sz, 1);
+}
+
+/*
+ * Resident block limit per multiprocessor, which the driver doesn't
+ * report before CUDA 11.  Returns 0 for unknown architectures.
+ */
+static unsigned int max_blocks_mp(int major, int minor) {
+  switch (major) {
+  case 1:
+  case 2:
+    return 8;
+  case 3:
+    return 16;
+  case 5:
+  case 6:
+    return 32;
+  case 7:
+    return minor == 5 ? 16 : 32;
+  case 8:
+    if (minor == 0) return 32;
+    if (minor == 9) return 24;
+    return 16;
+  case 9:
+    return 32;
+  default:
+    return 0;
+  }
 }
 
 static int cuda_property(gpucontext *c, gpudata *buf, gpukernel *k, int prop_id,
@@ -1621,7 +2448,7 @@ static int cuda_property(gpucontext *c, gpudata *buf, gpukernel *k, int prop_id,
 
   switch (prop_id) {
     CUdevice id;
-    int i;
+    int i, j;
     size_t sz;
 
   case GA_CTX_PROP_DEVNAME:
@@ -1642,6 +2469,53 @@ static int cuda_property(gpucontext *c, gpudata *buf, gpukernel *k, int prop_id,
     *((size_t *)res) = largest_size(ctx);
     return GA_NO_ERROR;
 
+  case GA_CTX_PROP_CACHE_RECLAIMED:
+    *((size_t *)res) = ctx->reclaimed;
+    return GA_NO_ERROR;
+
+  case GA_CTX_PROP_MEM_RESERVED:
+    *((size_t *)res) = ctx->cache_size;
+    return GA_NO_ERROR;
+
+  case GA_CTX_PROP_MEM_IN_USE:
+    *((size_t *)res) = ctx->in_use;
+    return GA_NO_ERROR;
+
+  case GA_CTX_PROP_MEM_CACHED:
+    *((size_t *)res) = ctx->cache_size - ctx->in_use;
+    return GA_NO_ERROR;
+
+  case GA_CTX_PROP_MEM_PEAK:
+    *((size_t *)res) = ctx->peak;
+    return GA_NO_ERROR;
+
+  case GA_CTX_PROP_MEM_SPLITS:
+    *((size_t *)res) = ctx->nsplits;
+    return GA_NO_ERROR;
+
+  case GA_CTX_PROP_MEM_MERGES:
+    *((size_t *)res) = ctx->nmerges;
+    return GA_NO_ERROR;
+
+  case GA_CTX_PROP_MEM_LARGEST_FREE:
+    *((size_t *)res) = free_stats(ctx, NULL);
+    return GA_NO_ERROR;
+
+  case GA_CTX_PROP_MEM_FREE_BUCKETS:
+    free_stats(ctx, (size_t *)res);
+    return GA_NO_ERROR;
+
+  case GA_CTX_PROP_MEM_BLOCKS:
+    *((size_t *)res) = ctx->nblocks;
+    return GA_NO_ERROR;
+
+  case GA_CTX_PROP_DEVNO:
+    cuda_enter(ctx);
+    CUDA_EXIT_ON_ERROR(ctx, cuCtxGetDevice(&id));
+    cuda_exit(ctx);
+    *((int *)res) = (int)id;
+    return GA_NO_ERROR;
+
   case GA_CTX_PROP_LMEMSIZE:
     GETPROP(CU_DEVICE_ATTRIBUTE_MAX_SHARED_MEMORY_PER_BLOCK, size_t);
     return GA_NO_ERROR;
@@ -1699,6 +2573,29 @@ static int cuda_property(gpucontext *c, gpudata *buf, gpukernel *k, int prop_id,
     GETPROP(CU_DEVICE_ATTRIBUTE_MAX_BLOCK_DIM_Z, size_t);
     return GA_NO_ERROR;
 
+  case GA_CTX_PROP_MAXTHREADS_MP:
+    GETPROP(CU_DEVICE_ATTRIBUTE_MAX_THREADS_PER_MULTIPROCESSOR, unsigned int);
+    return GA_NO_ERROR;
+
+  case GA_CTX_PROP_MAXBLOCKS_MP:
+    cuda_enter(ctx);
+    CUDA_EXIT_ON_ERROR(ctx, cuCtxGetDevice(&id));
+    if (get_cc(id, &i, &j, ctx->err) != GA_NO_ERROR) {
+      cuda_exit(ctx);
+      return error_code(ctx->err);
+    }
+    cuda_exit(ctx);
+    *((unsigned int *)res) = max_blocks_mp(i, j);
+    return GA_NO_ERROR;
+
+  case GA_CTX_PROP_REGS_MP:
+    GETPROP(CU_DEVICE_ATTRIBUTE_MAX_REGISTERS_PER_MULTIPROCESSOR, unsigned int);
+    return GA_NO_ERROR;
+
+  case GA_CTX_PROP_LMEMSIZE_MP:
+    GETPROP(CU_DEVICE_ATTRIBUTE_MAX_SHARED_MEMORY_PER_MULTIPROCESSOR, size_t);
+    return GA_NO_ERROR;
+
   case GA_BUFFER_PROP_REFCNT:
     *((unsigned int *)res) = buf->refcnt;
     return GA_NO_ERROR;
@@ -1707,6 +2604,12 @@ static int cuda_property(gpucontext *c, gpudata *buf, gpukernel *k, int prop_id,
     *((size_t *)res) = buf->sz;
     return GA_NO_ERROR;
 
+  case GA_BUFFER_PROP_HOSTPOINTER:
+    if (!(buf->flags & CUDA_MANAGED_PTR))
+      return error_set(ctx->err, GA_VALUE_ERROR, "Buffer is not managed");
+    *((void **)res) = (void *)(uintptr_t)buf->ptr;
+    return GA_NO_ERROR;
+
   case GA_BUFFER_PROP_CTX:
   case GA_KERNEL_PROP_CTX:
     *((gpucontext **)res) = (gpucontext *)ctx;
@@ -1735,18 +2638,142 @@ static int cuda_property(gpucontext *c, gpudata *buf, gpukernel *k, int prop_id,
     *((const int **)res) = k->types;
     return GA_NO_ERROR;
 
+  case GA_KERNEL_PROP_NUMREGS:
+    cuda_enter(ctx);
+    CUDA_EXIT_ON_ERROR(ctx, cuFuncGetAttribute(&i, CU_FUNC_ATTRIBUTE_NUM_REGS, k->k));
+    cuda_exit(ctx);
+    *((unsigned int *)res) = i;
+    return GA_NO_ERROR;
+
+  case GA_KERNEL_PROP_LMEMSIZE:
+    cuda_enter(ctx);
+    CUDA_EXIT_ON_ERROR(ctx, cuFuncGetAttribute(&i, CU_FUNC_ATTRIBUTE_SHARED_SIZE_BYTES, k->k));
+    cuda_exit(ctx);
+    *((size_t *)res) = i;
+    return GA_NO_ERROR;
+
   default:
     return error_fmt(ctx->err, GA_INVALID_ERROR, "Invalid property: %d", prop_id);
   }
 }
 
+static int cuda_graph_instantiate(gpugraph *g) {
+  cuda_context *ctx = (cuda_context *)g->ctx;
+  CUDA_KERNEL_NODE_PARAMS kp;
+  CUDA_MEMSET_NODE_PARAMS mp;
+  CUDA_MEMCPY3D cp;
+  CUgraphNode prev = NULL, cur;
+  CUgraphExec exec;
+  CUgraph graph;
+  graph_node *node;
+  CUresult err = CUDA_SUCCESS;
+  size_t i;
+
+  if (cuGraphCreate == NULL || cuGraphInstantiateWithFlags == NULL ||
+      cuGraphAddKernelNode == NULL || cuGraphAddMemcpyNode == NULL ||
+      cuGraphAddMemsetNode == NULL || cuGraphLaunch == NULL)
+    return error_set(ctx->err, GA_DEVSUP_ERROR, "CUDA graphs are not supported by the driver");
+
+  /* Host writes and mapped memory are replayed through the stream */
+  for (i = 0; i < g->nnodes; i++)
+    if (g->nodes[i].type == GRAPH_WRITE)
+      return error_set(ctx->err, GA_DEVSUP_ERROR, "Graph contains host writes");
+  for (i = 0; i < g->nbufs; i++)
+    if (g->bufs[i]->flags & CUDA_MAPPED_PTR)
+      return error_set(ctx->err, GA_DEVSUP_ERROR, "Graph uses mapped memory");
+
+  cuda_enter(ctx);
+  CUDA_EXIT_ON_ERROR(ctx, cuGraphCreate(&graph, 0));
+
+  /* The nodes form a chain to preserve the order of the stream */
+  for (i = 0; i < g->nnodes && err == CUDA_SUCCESS; i++) {
+    node = &g->nodes[i];
+    switch (node->type) {
+    case GRAPH_KERNEL:
+      memset(&kp, 0, sizeof(kp));
+      kp.func = node->k->k;
+      kp.gridDimX = node->gs[0];
+      kp.gridDimY = node->nd > 1 ? node->gs[1] : 1;
+      kp.gridDimZ = node->nd > 2 ? node->gs[2] : 1;
+      kp.blockDimX = node->ls[0];
+      kp.blockDimY = node->nd > 1 ? node->ls[1] : 1;
+      kp.blockDimZ = node->nd > 2 ? node->ls[2] : 1;
+      kp.sharedMemBytes = node->shared;
+      kp.kernelParams = node->args;
+      err = cuGraphAddKernelNode(&cur, graph, prev ? &prev : NULL,
+                                 prev ? 1 : 0, &kp);
+      break;
+    case GRAPH_MOVE:
+      if (node->sz == 0) continue;
+      memset(&cp, 0, sizeof(cp));
+      cp.srcMemoryType = CU_MEMORYTYPE_DEVICE;
+      cp.srcDevice = node->src->ptr + node->srcoff;
+      cp.dstMemoryType = CU_MEMORYTYPE_DEVICE;
+      cp.dstDevice = node->dst->ptr + node->dstoff;
+      cp.WidthInBytes = node->sz;
+      cp.Height = 1;
+      cp.Depth = 1;
+      err = cuGraphAddMemcpyNode(&cur, graph, prev ? &prev : NULL,
+                                 prev ? 1 : 0, &cp, ctx->ctx);
+      break;
+    case GRAPH_MEMSET:
+      if (node->dst->sz - node->dstoff == 0) continue;
+      memset(&mp, 0, sizeof(mp));
+      mp.dst = node->dst->ptr + node->dstoff;
+      mp.value = (unsigned char)node->data;
+      mp.elementSize = 1;
+      mp.width = node->dst->sz - node->dstoff;
+      mp.height = 1;
+      err = cuGraphAddMemsetNode(&cur, graph, prev ? &prev : NULL,
+                                 prev ? 1 : 0, &mp, ctx->ctx);
+      break;
+    default:
+      continue;
+    }
+    prev = cur;
+  }
+  if (err == CUDA_SUCCESS)
+    err = cuGraphInstantiateWithFlags(&exec, graph, 0);
+  cuGraphDestroy(graph);
+  if (err != CUDA_SUCCESS) {
+    cuda_exit(ctx);
+    return error_cuda(ctx->err, "cuGraph", err);
+  }
+  cuda_exit(ctx);
+  g->exec = exec;
+  return GA_NO_ERROR;
+}
+
+static int cuda_graph_launch(gpugraph *g) {
+  cuda_context *ctx = (cuda_context *)g->ctx;
+  size_t i;
+
+  cuda_enter(ctx);
+  for (i = 0; i < g->nbufs; i++)
+    GA_CUDA_EXIT_ON_ERROR(ctx, cuda_wait(g->bufs[i], CUDA_WAIT_ALL));
+  CUDA_EXIT_ON_ERROR(ctx, cuGraphLaunch((CUgraphExec)g->exec, ctx->s));
+  for (i = 0; i < g->nbufs; i++)
+    GA_CUDA_EXIT_ON_ERROR(ctx, cuda_record(g->bufs[i], CUDA_WAIT_ALL));
+  cuda_exit(ctx);
+  return GA_NO_ERROR;
+}
+
+static void cuda_graph_free(gpugraph *g) {
+  cuda_context *ctx = (cuda_context *)g->ctx;
+
+  cuda_enter(ctx);
+  cuGraphExecDestroy((CUgraphExec)g->exec);
+  cuda_exit(ctx);
+  g->exec = NULL;
+}
+
 static const char *cuda_error(gpucontext *c) {
   cuda_context *ctx = (cuda_context *)c;
   const char *errstr = NULL;
   if (ctx == NULL)
-    return global_err->msg;
+    return error_msg(global_err);
   else
-    return ctx->err->msg;
+    return error_msg(ctx->err);
   return errstr;
 }
 
@@ -1770,4 +2797,13 @@ const gpuarray_buffer_ops cuda_ops = {cuda_get_platform_count,
                                       cuda_sync,
                                       cuda_transfer,
                                       cuda_property,
-                                      cuda_error};
+                                      cuda_error,
+                                      cuda_read_rect,
+                                      cuda_write_rect,
+                                      cuda_graph_instantiate,
+                                      cuda_graph_launch,
+                                      cuda_graph_free,
+                                      cuda_prefetch,
+                                      cuda_advise,
+                                      cuda_trim_cache,
+                                      cuda_transfer_many};
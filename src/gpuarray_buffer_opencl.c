@@ -15,6 +15,9 @@
 #include "loaders/libclblas.h"
 #include "loaders/libclblast.h"
 
+#include "util/alloctrace.h"
+#include "util/staging.h"
+
 #include "cluda_opencl.h.c"
 
 #define _unused(x) ((void)x)
@@ -159,11 +162,25 @@ cl_ctx *cl_make_ctx(cl_context ctx, gpucontext_props *p) {
 
   res->ctx = ctx;
   res->ops = &opencl_ops;
+  res->capture = NULL;
+  res->trace = NULL;
+  res->flags = p->flags;
+  res->lock = NULL;
+  memset(&res->sched, 0, sizeof(res->sched));
   if (error_alloc(&res->err)) {
     error_set(global_err, GA_SYS_ERROR, "Could not create error context");
     free(res);
     return NULL;
   }
+  if (ISSET(res->flags, GA_CTX_MULTI_THREAD)) {
+    res->lock = ga_lock_new();
+    if (res->lock == NULL) {
+      error_set(global_err, GA_SYS_ERROR, "Could not create context lock");
+      error_free(res->err);
+      free(res);
+      return NULL;
+    }
+  }
 
   res->refcnt = 1;
   res->exts = NULL;
@@ -175,6 +192,7 @@ cl_ctx *cl_make_ctx(cl_context ctx, gpucontext_props *p) {
     &err);
   if (res->q == NULL) {
     error_cl(global_err, "clCreateCommandQueue", err);
+    ga_lock_free(res->lock);
     error_free(res->err);
     free(res);
     return NULL;
@@ -224,7 +242,7 @@ cl_ctx *cl_make_ctx(cl_context ctx, gpucontext_props *p) {
   return res;
 
  fail:
-  error_set(global_err, res->err->code, res->err->msg);
+  error_set(global_err, error_code(res->err), error_msg(res->err));
   cl_free_ctx(res);
   return NULL;
 }
@@ -235,11 +253,15 @@ cl_command_queue cl_get_stream(gpucontext *ctx) {
 }
 
 static void cl_free_ctx(cl_ctx *ctx) {
+  unsigned int refcnt;
+
   ASSERT_CTX(ctx);
 
   assert(ctx->refcnt != 0);
-  ctx->refcnt--;
-  if (ctx->refcnt == 0) {
+  ga_lock_acquire(ctx->lock);
+  refcnt = --ctx->refcnt;
+  ga_lock_release(ctx->lock);
+  if (refcnt == 0) {
     if (ctx->errbuf != NULL) {
       ctx->refcnt = 2; /* Avoid recursive release */
       cl_release(ctx->errbuf);
@@ -248,7 +270,9 @@ static void cl_free_ctx(cl_ctx *ctx) {
     clReleaseContext(ctx->ctx);
     if (ctx->options != NULL)
       free(ctx->options);
+    alloc_trace_close(ctx->trace);
     error_free(ctx->err);
+    ga_lock_free(ctx->lock);
     CLEAR(ctx);
     free(ctx);
   }
@@ -277,6 +301,7 @@ gpudata *cl_make_buf(gpucontext *c, cl_mem buf) {
   res->buf = buf;
   res->ev = NULL;
   res->refcnt = 1;
+  res->traced = 0;
   err = clRetainMemObject(buf);
   if (err != CL_SUCCESS) {
     free(res);
@@ -284,7 +309,9 @@ gpudata *cl_make_buf(gpucontext *c, cl_mem buf) {
     return NULL;
   }
   res->ctx = ctx;
+  ga_lock_acquire(ctx->lock);
   res->ctx->refcnt++;
+  ga_lock_release(ctx->lock);
 
   TAG_BUF(res);
   return res;
@@ -364,7 +391,7 @@ static int check_ext(cl_ctx *ctx, const char *name) {
 
   if (ctx->exts == NULL) {
     dev = get_dev(ctx->ctx, ctx->err);
-    if (dev == NULL) return ctx->err->code;
+    if (dev == NULL) return error_code(ctx->err);
 
     CL_GET_PROP(ctx->err, clGetDeviceInfo, dev, CL_DEVICE_EXTENSIONS, ctx->exts);
   }
@@ -487,6 +514,11 @@ static gpudata *cl_alloc(gpucontext *c, size_t size, void *data, int flags) {
     clflags |= CL_MEM_ALLOC_HOST_PTR;
   }
 
+  if (flags & GA_BUFFER_MANAGED) {
+    error_set(ctx->err, GA_DEVSUP_ERROR, "Managed memory is not supported on OpenCL");
+    return NULL;
+  }
+
   if (flags & GA_BUFFER_READ_ONLY) {
     if (flags & GA_BUFFER_WRITE_ONLY) {
       error_set(ctx->err, GA_VALUE_ERROR, "Invalid combinaison: READ_ONLY and WRITE_ONLY");
@@ -522,7 +554,12 @@ static gpudata *cl_alloc(gpucontext *c, size_t size, void *data, int flags) {
   }
 
   res->ctx = ctx;
+  ga_lock_acquire(ctx->lock);
   ctx->refcnt++;
+  ga_lock_release(ctx->lock);
+
+  res->traced = (ctx->trace != NULL);
+  alloc_trace_alloc(ctx->trace, res, size, flags);
 
   TAG_BUF(res);
   return res;
@@ -530,13 +567,21 @@ static gpudata *cl_alloc(gpucontext *c, size_t size, void *data, int flags) {
 
 static void cl_retain(gpudata *b) {
   ASSERT_BUF(b);
+  ga_lock_acquire(b->ctx->lock);
   b->refcnt++;
+  ga_lock_release(b->ctx->lock);
 }
 
 static void cl_release(gpudata *b) {
+  unsigned int refcnt;
+
   ASSERT_BUF(b);
-  b->refcnt--;
-  if (b->refcnt == 0) {
+  ga_lock_acquire(b->ctx->lock);
+  refcnt = --b->refcnt;
+  ga_lock_release(b->ctx->lock);
+  if (refcnt == 0) {
+    if (b->traced)
+      alloc_trace_free(b->ctx->trace, b);
     CLEAR(b);
     clReleaseMemObject(b->buf);
     if (b->ev != NULL)
@@ -588,7 +633,7 @@ static int cl_move(gpudata *dst, size_t dstoff, gpudata *src, size_t srcoff,
 
   if (dst->ctx != src->ctx) {
     error_set(src->ctx->err, GA_VALUE_ERROR, "Differing contexts for source and destination");
-    return error_set(dst->ctx->err, src->ctx->err->code, src->ctx->err->msg);
+    return error_set(dst->ctx->err, error_code(src->ctx->err), error_msg(src->ctx->err));
   }
   ctx = dst->ctx;
 
@@ -670,6 +715,83 @@ static int cl_write(gpudata *dst, size_t dstoff, const void *src, size_t sz) {
   return GA_NO_ERROR;
 }
 
+static int cl_read_rect(void *dst, size_t dst_rpitch, size_t dst_spitch,
+                        gpudata *src, size_t srcoff,
+                        size_t src_rpitch, size_t src_spitch,
+                        size_t width, size_t height, size_t depth) {
+  cl_ctx *ctx = src->ctx;
+  cl_event ev[1];
+  cl_event *evl = NULL;
+  cl_uint num_ev = 0;
+  size_t buf_origin[3] = {0, 0, 0};
+  size_t host_origin[3] = {0, 0, 0};
+  size_t region[3];
+
+  ASSERT_BUF(src);
+  ASSERT_CTX(ctx);
+
+  buf_origin[0] = srcoff;
+  region[0] = width;
+  region[1] = height;
+  region[2] = depth;
+
+  if (src->ev != NULL) {
+    ev[0] = src->ev;
+    evl = ev;
+    num_ev = 1;
+  }
+
+  CL_CHECK(ctx->err, clEnqueueReadBufferRect(ctx->q, src->buf, CL_TRUE,
+                                             buf_origin, host_origin, region,
+                                             src_rpitch, src_spitch,
+                                             dst_rpitch, dst_spitch,
+                                             dst, num_ev, evl, NULL));
+
+  if (src->ev != NULL) clReleaseEvent(src->ev);
+  src->ev = NULL;
+
+  return GA_NO_ERROR;
+}
+
+static int cl_write_rect(gpudata *dst, size_t dstoff,
+                         size_t dst_rpitch, size_t dst_spitch,
+                         const void *src,
+                         size_t src_rpitch, size_t src_spitch,
+                         size_t width, size_t height, size_t depth) {
+  cl_ctx *ctx = dst->ctx;
+  cl_event ev[1];
+  cl_event *evl = NULL;
+  cl_uint num_ev = 0;
+  size_t buf_origin[3] = {0, 0, 0};
+  size_t host_origin[3] = {0, 0, 0};
+  size_t region[3];
+
+  ASSERT_BUF(dst);
+  ASSERT_CTX(ctx);
+
+  buf_origin[0] = dstoff;
+  region[0] = width;
+  region[1] = height;
+  region[2] = depth;
+
+  if (dst->ev != NULL) {
+    ev[0] = dst->ev;
+    evl = ev;
+    num_ev = 1;
+  }
+
+  CL_CHECK(ctx->err, clEnqueueWriteBufferRect(ctx->q, dst->buf, CL_TRUE,
+                                              buf_origin, host_origin, region,
+                                              dst_rpitch, dst_spitch,
+                                              src_rpitch, src_spitch,
+                                              src, num_ev, evl, NULL));
+
+  if (dst->ev != NULL) clReleaseEvent(dst->ev);
+  dst->ev = NULL;
+
+  return GA_NO_ERROR;
+}
+
 static int cl_memset(gpudata *dst, size_t offset, int data) {
   char local_kern[256];
   cl_ctx *ctx = dst->ctx;
@@ -771,12 +893,10 @@ static int cl_check_extensions(const char **preamble, unsigned int *count,
   }
   if (flags & GA_USE_DOUBLE) {
     GA_CHECK(check_ext(ctx, CL_DOUBLE));
-    preamble[*count] = PRAGMA CL_DOUBLE ENABLE;
+    /* Also makes cluda.h declare the double complex helpers */
+    preamble[*count] = PRAGMA CL_DOUBLE ENABLE "#define GA_CLUDA_DOUBLE 1\n";
     (*count)++;
   }
-  if (flags & GA_USE_COMPLEX) {
-    return error_set(ctx->err, GA_UNSUPPORTED_ERROR, "Complex are not supported yet");
-  }
   if (flags & GA_USE_CUDA) {
     return error_set(ctx->err, GA_DEVSUP_ERROR, "Cuda kernels not supported on opencl devices");
   }
@@ -811,10 +931,10 @@ static int cl_newkernel(gpukernel **k, gpucontext *c, unsigned int count,
     return error_set(ctx->err, GA_VALUE_ERROR, "Empty kernel source list");
 
   dev = get_dev(ctx->ctx, ctx->err);
-  if (dev == NULL) return ctx->err->code;
+  if (dev == NULL) return error_code(ctx->err);
 
   if (cl_check_extensions(preamble, &n, flags, ctx))
-    return ctx->err->code;
+    return error_code(ctx->err);
 
   if (n != 0) {
     news = calloc(count+n, sizeof(const char *));
@@ -921,7 +1041,9 @@ static int cl_newkernel(gpukernel **k, gpucontext *c, unsigned int count,
   res->types = NULL;  /* This avoids a crash in cl_releasekernel */
   res->evr = NULL;   /* This avoids a crash in cl_releasekernel */
   res->ctx = ctx;
+  ga_lock_acquire(ctx->lock);
   ctx->refcnt++;
+  ga_lock_release(ctx->lock);
   clReleaseProgram(p);
   TAG_KER(res);
   if (err != CL_SUCCESS) {
@@ -947,14 +1069,20 @@ static int cl_newkernel(gpukernel **k, gpucontext *c, unsigned int count,
 
 static void cl_retainkernel(gpukernel *k) {
   ASSERT_KER(k);
+  ga_lock_acquire(k->ctx->lock);
   k->refcnt++;
+  ga_lock_release(k->ctx->lock);
 }
 
 static void cl_releasekernel(gpukernel *k) {
+  unsigned int refcnt;
+
   ASSERT_KER(k);
 
-  k->refcnt--;
-  if (k->refcnt == 0) {
+  ga_lock_acquire(k->ctx->lock);
+  refcnt = --k->refcnt;
+  ga_lock_release(k->ctx->lock);
+  if (refcnt == 0) {
     CLEAR(k);
     if (k->ev != NULL) clReleaseEvent(k->ev);
     if (k->k) clReleaseKernel(k->k);
@@ -965,7 +1093,8 @@ static void cl_releasekernel(gpukernel *k) {
   }
 }
 
-static int cl_setkernelarg(gpukernel *k, unsigned int i, void *a) {
+/* Must be called with ctx->lock held, the cl_kernel is shared */
+static int cl_setkernelarg_locked(gpukernel *k, unsigned int i, void *a) {
   cl_ctx *ctx = k->ctx;
   gpudata *btmp;
   cl_ulong temp;
@@ -993,9 +1122,24 @@ static int cl_setkernelarg(gpukernel *k, unsigned int i, void *a) {
   return GA_NO_ERROR;
 }
 
-static int cl_callkernel(gpukernel *k, unsigned int n,
-                         const size_t *gs, const size_t *ls,
-                         size_t shared, void **args) {
+static int cl_setkernelarg(gpukernel *k, unsigned int i, void *a) {
+  int err;
+
+  ga_lock_acquire(k->ctx->lock);
+  err = cl_setkernelarg_locked(k, i, a);
+  ga_lock_release(k->ctx->lock);
+  return err;
+}
+
+/*
+ * The arguments of a cl_kernel are part of the object, so they are
+ * set and the launch enqueued under ctx->lock.  Otherwise two threads
+ * sharing a kernel from the cache could launch with each other's
+ * arguments.
+ */
+static int cl_callkernel_locked(gpukernel *k, unsigned int n,
+                                const size_t *gs, const size_t *ls,
+                                size_t shared, void **args) {
   cl_ctx *ctx = k->ctx;
   size_t _gs[3];
   cl_event ev;
@@ -1012,11 +1156,11 @@ static int cl_callkernel(gpukernel *k, unsigned int n,
     return error_set(ctx->err, GA_VALUE_ERROR, "Call with more than 3 dimensions");
 
   dev = get_dev(ctx->ctx, ctx->err);
-  if (dev == NULL) return ctx->err->code;
+  if (dev == NULL) return error_code(ctx->err);
 
   if (args != NULL) {
     for (i = 0; i < k->argcount; i++) {
-      GA_CHECK(cl_setkernelarg(k, i, args[i]));
+      GA_CHECK(cl_setkernelarg_locked(k, i, args[i]));
     }
   }
 
@@ -1071,6 +1215,18 @@ static int cl_callkernel(gpukernel *k, unsigned int n,
   return GA_NO_ERROR;
 }
 
+static int cl_callkernel(gpukernel *k, unsigned int n,
+                         const size_t *gs, const size_t *ls,
+                         size_t shared, void **args) {
+  int err;
+
+  ASSERT_KER(k);
+  ga_lock_acquire(k->ctx->lock);
+  err = cl_callkernel_locked(k, n, gs, ls, shared, args);
+  ga_lock_release(k->ctx->lock);
+  return err;
+}
+
 static int cl_sync(gpudata *b) {
   cl_ctx *ctx = (cl_ctx *)b->ctx;
 
@@ -1085,12 +1241,131 @@ static int cl_sync(gpudata *b) {
   return GA_NO_ERROR;
 }
 
+/*
+ * Both buffers belong to the same OpenCL context (with different
+ * queues): copy on the queue of the destination.  The source stays
+ * where it is since its own queue will likely use it again.  When the
+ * copy overwrites the whole destination, it is first moved to the
+ * device of its queue without its content, which spares the runtime
+ * a transfer of data that is about to be replaced.  This needs
+ * OpenCL 1.2, older libraries just do the copy.
+ */
+static int cl_migrate(gpudata *dst, size_t dstoff, gpudata *src,
+                      size_t srcoff, size_t sz) {
+  cl_ctx *ctx = dst->ctx;
+  cl_event ev, mev = NULL;
+  cl_event evw[2];
+  cl_event *evl = NULL;
+  cl_uint num_ev = 0;
+  size_t dsz;
+  cl_int err;
+
+  if (clEnqueueMigrateMemObjects != NULL && dstoff == 0 &&
+      clGetMemObjectInfo(dst->buf, CL_MEM_SIZE, sizeof(dsz), &dsz,
+                         NULL) == CL_SUCCESS && sz == dsz) {
+    /* Ordered after the previous uses of dst */
+    CL_CHECK(ctx->err, clEnqueueMigrateMemObjects(
+                 ctx->q, 1, &dst->buf, CL_MIGRATE_MEM_OBJECT_CONTENT_UNDEFINED,
+                 dst->ev != NULL ? 1 : 0, dst->ev != NULL ? &dst->ev : NULL,
+                 &mev));
+  }
+
+  if (src->ev != NULL)
+    evw[num_ev++] = src->ev;
+  if (mev != NULL)
+    evw[num_ev++] = mev;
+  else if (dst->ev != NULL)
+    evw[num_ev++] = dst->ev;
+  if (num_ev > 0)
+    evl = evw;
+
+  err = clEnqueueCopyBuffer(ctx->q, src->buf, dst->buf, srcoff, dstoff, sz,
+                            num_ev, evl, &ev);
+  if (mev != NULL)
+    clReleaseEvent(mev);
+  if (err != CL_SUCCESS)
+    return error_cl(ctx->err, "clEnqueueCopyBuffer", err);
+
+  if (src->ev != NULL)
+    clReleaseEvent(src->ev);
+  if (dst->ev != NULL)
+    clReleaseEvent(dst->ev);
+  src->ev = ev;
+  dst->ev = ev;
+  clRetainEvent(ev);
+  return GA_NO_ERROR;
+}
+
+/* Host staging between two OpenCL contexts, see util/staging.h */
+struct cl_staging {
+  gpudata *dst;
+  gpudata *src;
+  cl_event ev[2];
+};
+
+static int cl_staging_read(void *dst, size_t off, size_t sz, void *data) {
+  return cl_read(dst, ((struct cl_staging *)data)->src, off, sz);
+}
+
+/* Doesn't block so that the next chunk can be read in the meantime */
+static int cl_staging_write(size_t off, const void *src, size_t sz,
+                            unsigned int slot, void *data) {
+  struct cl_staging *s = data;
+  gpudata *dst = s->dst;
+  cl_ctx *ctx = dst->ctx;
+  cl_event ev[1];
+  cl_event *evl = NULL;
+  cl_uint num_ev = 0;
+
+  if (dst->ev != NULL) {
+    ev[0] = dst->ev;
+    evl = ev;
+    num_ev = 1;
+  }
+
+  CL_CHECK(ctx->err, clEnqueueWriteBuffer(ctx->q, dst->buf, CL_FALSE, off, sz,
+                                          src, num_ev, evl, &s->ev[slot]));
+
+  if (dst->ev != NULL) clReleaseEvent(dst->ev);
+  dst->ev = s->ev[slot];
+  clRetainEvent(dst->ev);
+  return GA_NO_ERROR;
+}
+
+static int cl_staging_wait(unsigned int slot, void *data) {
+  struct cl_staging *s = data;
+  cl_int err;
+
+  err = clWaitForEvents(1, &s->ev[slot]);
+  clReleaseEvent(s->ev[slot]);
+  s->ev[slot] = NULL;
+  if (err != CL_SUCCESS)
+    return error_cl(s->dst->ctx->err, "clWaitForEvents", err);
+  return GA_NO_ERROR;
+}
+
+static const staging_ops cl_staging_ops = {cl_staging_read, cl_staging_write,
+                                           cl_staging_wait};
+
 static int cl_transfer(gpudata *dst, size_t dstoff,
                        gpudata *src, size_t srcoff, size_t sz) {
+  struct cl_staging s;
+
   ASSERT_BUF(dst);
   ASSERT_BUF(src);
 
-  return error_set(dst->ctx->err, GA_UNSUPPORTED_ERROR, "Operation not supported");
+  if (sz == 0) return GA_NO_ERROR;
+
+  /* Memory objects can only migrate within their context */
+  if (dst->ctx->ctx == src->ctx->ctx)
+    return cl_migrate(dst, dstoff, src, srcoff, sz);
+
+  s.dst = dst;
+  s.src = src;
+  s.ev[0] = NULL;
+  s.ev[1] = NULL;
+  return staging_copy(dst->ctx->err, &cl_staging_ops, &s, dstoff, srcoff, sz,
+                      STAGING_CHUNK);
 }
 
 static int cl_property(gpucontext *c, gpudata *buf, gpukernel *k, int prop_id,
@@ -1123,6 +1398,7 @@ static int cl_property(gpucontext *c, gpudata *buf, gpukernel *k, int prop_id,
     size_t *psz;
     cl_device_id id;
     cl_uint ui;
+    cl_ulong ul;
 
   case GA_CTX_PROP_DEVNAME:
     CL_CHECK(ctx->err, clGetContextInfo(ctx->ctx, CL_CONTEXT_DEVICES,
@@ -1134,6 +1410,25 @@ static int cl_property(gpucontext *c, gpudata *buf, gpukernel *k, int prop_id,
   case GA_CTX_PROP_UNIQUE_ID:
     return error_set(ctx->err, GA_DEVSUP_ERROR, "Can't get unique ID on OpenCL");
 
+  case GA_CTX_PROP_DEVNO:
+    return error_set(ctx->err, GA_DEVSUP_ERROR, "Can't get device ordinal on OpenCL");
+
+  case GA_CTX_PROP_CACHE_RECLAIMED:
+    /* There is no allocation cache */
+    *((size_t *)res) = 0;
+    return GA_NO_ERROR;
+
+  case GA_CTX_PROP_MEM_RESERVED:
+  case GA_CTX_PROP_MEM_IN_USE:
+  case GA_CTX_PROP_MEM_CACHED:
+  case GA_CTX_PROP_MEM_PEAK:
+  case GA_CTX_PROP_MEM_SPLITS:
+  case GA_CTX_PROP_MEM_MERGES:
+  case GA_CTX_PROP_MEM_LARGEST_FREE:
+  case GA_CTX_PROP_MEM_FREE_BUCKETS:
+  case GA_CTX_PROP_MEM_BLOCKS:
+    return error_set(ctx->err, GA_DEVSUP_ERROR, "Allocator statistics are not available on OpenCL");
+
   case GA_CTX_PROP_LMEMSIZE:
     CL_CHECK(ctx->err, clGetContextInfo(ctx->ctx, CL_CONTEXT_DEVICES,
                                         sizeof(id), &id, NULL));
@@ -1226,6 +1521,21 @@ static int cl_property(gpucontext *c, gpudata *buf, gpukernel *k, int prop_id,
     free(psz);
     return GA_NO_ERROR;
 
+  case GA_CTX_PROP_MAXTHREADS_MP:
+  case GA_CTX_PROP_MAXBLOCKS_MP:
+  case GA_CTX_PROP_REGS_MP:
+    /* Not exposed by OpenCL */
+    *((unsigned int *)res) = 0;
+    return GA_NO_ERROR;
+
+  case GA_CTX_PROP_LMEMSIZE_MP:
+    CL_CHECK(ctx->err, clGetContextInfo(ctx->ctx, CL_CONTEXT_DEVICES,
+                                        sizeof(id), &id, NULL));
+    CL_CHECK(ctx->err, clGetDeviceInfo(id, CL_DEVICE_LOCAL_MEM_SIZE,
+                                       sizeof(sz), &sz, NULL));
+    *((size_t *)res) = sz;
+    return GA_NO_ERROR;
+
   case GA_BUFFER_PROP_REFCNT:
     *((unsigned int *)res) = buf->refcnt;
     return GA_NO_ERROR;
@@ -1268,6 +1578,20 @@ static int cl_property(gpucontext *c, gpudata *buf, gpukernel *k, int prop_id,
     *((const int **)res) = k->types;
     return GA_NO_ERROR;
 
+  case GA_KERNEL_PROP_NUMREGS:
+    /* CL_KERNEL_PRIVATE_MEM_SIZE doesn't count registers */
+    *((unsigned int *)res) = 0;
+    return GA_NO_ERROR;
+
+  case GA_KERNEL_PROP_LMEMSIZE:
+    CL_CHECK(ctx->err, clGetContextInfo(ctx->ctx, CL_CONTEXT_DEVICES,
+                                        sizeof(id), &id, NULL));
+    CL_CHECK(ctx->err, clGetKernelWorkGroupInfo(k->k, id,
+                                                CL_KERNEL_LOCAL_MEM_SIZE,
+                                                sizeof(ul), &ul, NULL));
+    *((size_t *)res) = ul;
+    return GA_NO_ERROR;
+
   default:
     return error_fmt(ctx->err, GA_INVALID_ERROR, "Invalid property: %d", prop_id);
   }
@@ -1276,10 +1600,10 @@ static int cl_property(gpucontext *c, gpudata *buf, gpukernel *k, int prop_id,
 static const char *cl_error(gpucontext *c) {
   cl_ctx *ctx = (cl_ctx *)c;
   if (ctx == NULL){
-    return global_err->msg;
+    return error_msg(global_err);
   } else {
     ASSERT_CTX(ctx);
-    return ctx->err->msg;
+    return error_msg(ctx->err);
   }
 }
 
@@ -1303,4 +1627,13 @@ const gpuarray_buffer_ops opencl_ops = {cl_get_platform_count,
                                         cl_sync,
                                         cl_transfer,
                                         cl_property,
-                                        cl_error};
+                                        cl_error,
+                                        cl_read_rect,
+                                        cl_write_rect,
+                                        NULL,
+                                        NULL,
+                                        NULL,
+                                        NULL,
+                                        NULL,
+                                        NULL,
+                                        NULL};
@@ -97,7 +97,9 @@ static int comm_new(gpucomm **comm_ptr, gpucontext *ctx,
   }
   comm->ctx = (cuda_context *)ctx;  // convert to underlying cuda context
   // So that context would not be destroyed before communicator
+  ga_lock_acquire(comm->ctx->lock);
   comm->ctx->refcnt++;
+  ga_lock_release(comm->ctx->lock);
   cuda_enter(comm->ctx);  // Use device
   err = ncclCommInitRank(&comm->c, ndev, *((ncclUniqueId *)&comm_id), rank);
   cuda_exit(comm->ctx);
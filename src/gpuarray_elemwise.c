@@ -1,4 +1,6 @@
 #include <assert.h>
+#include <ctype.h>
+#include <limits.h>
 
 #include <gpuarray/elemwise.h>
 #include <gpuarray/array.h>
@@ -8,6 +10,26 @@
 
 #include "private.h"
 #include "util/strb.h"
+#include "util/tmpl.h"
+
+#include "elemwise.tmpl.c"
+
+/*
+ * A shape tracked for specialisation and its kernel once it has been
+ * built.  The strides of the arrays follow the dims in one block.
+ */
+struct spec_shape {
+  size_t *dims; /* NULL if the slot is free */
+  ssize_t *strides;
+  unsigned int nd;
+  int call32;
+  unsigned int count; /* Number of calls seen */
+  int failed; /* Building the kernel failed, don't retry */
+  GpuKernel k;
+};
+
+/* Maximum number of shapes tracked per GpuElemwise */
+#define SPEC_SLOTS 8
 
 struct _GpuElemwise {
   const char *expr; /* Expression code (to be able to build kernels on-demand) */
@@ -18,12 +40,22 @@ struct _GpuElemwise {
   GpuKernel *k_basic_32; /* 32-bit address basic kernels */
   size_t *dims; /* Preallocated shape buffer for dimension collapsing */
   ssize_t **strides; /* Preallocated strides buffer for dimension collapsing */
+  void **kargs; /* Preallocated launch arguments (see KARGS_LEN) */
   unsigned int nd; /* Current maximum number of dimensions allocated */
   unsigned int n; /* Number of arguments */
   unsigned int narray; /* Number of array arguments */
   int flags; /* Flags for the operation (none at the moment */
+  struct spec_shape *spec; /* Specialised shapes (see spec_kernel()) */
+  unsigned int spec_threshold; /* Calls before specialising a shape */
 };
 
+/*
+ * Length of the argument list of a basic kernel with nd dimensions,
+ * the longest of all.  The arguments go to GpuKernel_call() and are
+ * never set on the kernels since those are shared through the cache.
+ */
+#define KARGS_LEN(ge, nd) (1 + (nd) + (ge)->n + (ge)->narray * (1 + (nd)))
+
 #define GEN_ADDR32      0x1
 #define GEN_CONVERT_F16 0x2
 
@@ -37,10 +69,6 @@ static inline int k_initialized(GpuKernel *k) {
   return k->k != NULL;
 }
 
-static inline const char *ctype(int typecode) {
-  return gpuarray_get_type(typecode)->cluda_name;
-}
-
 /* dst has to be zero-initialized on entry */
 static int copy_arg(gpuelemwise_arg *dst, gpuelemwise_arg *src) {
   dst->name = strdup(src->name);
@@ -85,6 +113,209 @@ static void free_args(unsigned int n, gpuelemwise_arg *args) {
   free(args);
 }
 
+/*
+ * Canonicalisation of expressions.
+ *
+ * Arguments are renamed to positional identifiers (CANON_PREFIX
+ * followed by the index) and runs of whitespace are compacted, so
+ * that expressions that only differ in those aspects generate the
+ * same source and share kernels.
+ */
+#define CANON_PREFIX "ga_a"
+
+static inline int is_wordc(char c) {
+  return isalnum((unsigned char)c) || c == '_' || c == '"' || c == '\'';
+}
+
+static inline int is_opc(char c) {
+  return c != '\0' && strchr("+-*/%&|^<>=!~", c) != NULL;
+}
+
+/*
+ * Returns the length of the token that starts at `s`, which must not
+ * be whitespace.  `*ident` is set if the token is an identifier.
+ */
+static size_t next_token(const char *s, int *ident) {
+  const char *p = s;
+
+  *ident = 0;
+  if (*p == '"' || *p == '\'') {
+    for (p++; *p != '\0' && *p != *s; p++)
+      if (*p == '\\' && p[1] != '\0') p++;
+    return (*p == '\0') ? (size_t)(p - s) : (size_t)(p - s + 1);
+  }
+  if (p[0] == '/' && p[1] == '*') {
+    p = strstr(p + 2, "*/");
+    return (p == NULL) ? strlen(s) : (size_t)(p - s + 2);
+  }
+  if (p[0] == '/' && p[1] == '/') {
+    while (*p != '\0' && *p != '\n') p++;
+    return p - s;
+  }
+  if (isalpha((unsigned char)*p) || *p == '_') {
+    *ident = 1;
+    while (isalnum((unsigned char)*p) || *p == '_') p++;
+    return p - s;
+  }
+  if (isdigit((unsigned char)*p) || (*p == '.' && isdigit((unsigned char)p[1]))) {
+    while (isalnum((unsigned char)*p) || *p == '_' || *p == '.') p++;
+    return p - s;
+  }
+  return 1;
+}
+
+/* Returns the index of the argument named by the token or -1 */
+static int find_arg(const char *tok, size_t len, unsigned int n,
+                    gpuelemwise_arg *args) {
+  unsigned int j;
+
+  for (j = 0; j < n; j++)
+    if (strlen(args[j].name) == len && strncmp(args[j].name, tok, len) == 0)
+      return (int)j;
+  return -1;
+}
+
+/*
+ * Write the canonical form of `expr` to `sb`.  If `rename` is 0, the
+ * argument names are kept.  Whitespace is not compacted in the
+ * presence of preprocessor directives since it is significant there.
+ */
+static void canon_expr(strb *sb, const char *expr, unsigned int n,
+                       gpuelemwise_arg *args, int rename) {
+  const char *p = expr;
+  int compact = strchr(expr, '#') == NULL;
+  int ws = 0, lcomment = 0, ident, j;
+  char last = '\0', last2 = '\0';
+  size_t len;
+
+  while (*p != '\0') {
+    if (isspace((unsigned char)*p)) {
+      if (!compact)
+        strb_appendc(sb, *p);
+      ws = 1;
+      p++;
+      continue;
+    }
+    len = next_token(p, &ident);
+    if (compact && ws && last != '\0') {
+      /* A line comment must stay terminated */
+      if (lcomment)
+        strb_appendc(sb, '\n');
+      else if ((is_wordc(last) && is_wordc(*p)) || (is_opc(last) && is_opc(*p)))
+        strb_appendc(sb, ' ');
+    }
+    ws = 0;
+    lcomment = (p[0] == '/' && p[1] == '/');
+    /* Members (a.x, a->x) are not arguments */
+    if (rename && ident && last != '.' && !(last2 == '-' && last == '>') &&
+        (j = find_arg(p, len, n, args)) != -1) {
+      strb_appendf(sb, CANON_PREFIX "%d", j);
+    } else {
+      strb_appendn(sb, p, len);
+    }
+    if (len > 1)
+      last2 = p[len - 2];
+    else
+      last2 = last;
+    last = p[len - 1];
+    p += len;
+  }
+}
+
+/* Does `code` refer to an argument name as an identifier? */
+static int mentions_args(const char *code, unsigned int n,
+                         gpuelemwise_arg *args) {
+  const char *p = code;
+  size_t len;
+  int ident;
+
+  while (*p != '\0') {
+    if (isspace((unsigned char)*p)) {
+      p++;
+      continue;
+    }
+    len = next_token(p, &ident);
+    if (ident && find_arg(p, len, n, args) != -1)
+      return 1;
+    p += len;
+  }
+  return 0;
+}
+
+/*
+ * Canonicalise `ge->expr` and the names in `ge->args` in place.
+ *
+ * Arguments are not renamed if the preamble refers to them (through
+ * a macro for instance).
+ */
+static int canonicalise(GpuElemwise *ge) {
+  strb sb = STRB_STATIC_INIT;
+  unsigned int j;
+  int rename;
+  char *name;
+
+  rename = ge->preamble == NULL || !mentions_args(ge->preamble, ge->n, ge->args);
+  canon_expr(&sb, ge->expr, ge->n, ge->args, rename);
+  strb_append0(&sb);
+  if (strb_error(&sb)) {
+    strb_clear(&sb);
+    return -1;
+  }
+  free((void *)ge->expr);
+  ge->expr = sb.s;
+
+  if (rename) {
+    for (j = 0; j < ge->n; j++) {
+      name = malloc(sizeof(CANON_PREFIX) + 10);
+      if (name == NULL)
+        return -1;
+      sprintf(name, CANON_PREFIX "%u", j);
+      free((void *)ge->args[j].name);
+      ge->args[j].name = name;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Build the signature of a kernel for GpuKernel_init_keyed().  The
+ * canonical form makes it independent of the user's names.
+ */
+static void kernel_sig(strb *sb, char kind, const char *preamble,
+                       const char *expr, unsigned int nd, unsigned int n,
+                       gpuelemwise_arg *args, int gen_flags) {
+  unsigned int j;
+
+  strb_appendc(sb, kind);
+  strb_appendn(sb, (const char *)&gen_flags, sizeof(gen_flags));
+  strb_appendn(sb, (const char *)&nd, sizeof(nd));
+  for (j = 0; j < n; j++) {
+    strb_appendn(sb, (const char *)&args[j].typecode, sizeof(int));
+    strb_appendn(sb, (const char *)&args[j].flags, sizeof(int));
+    strb_appends(sb, args[j].name);
+    strb_appendc(sb, '\0');
+  }
+  if (preamble)
+    strb_appends(sb, preamble);
+  strb_appendc(sb, '\0');
+  strb_appends(sb, expr);
+}
+
+/* Source generation parameters for GpuKernel_init_keyed() */
+struct gen_args {
+  gpucontext *ctx;
+  const char *preamble;
+  const char *expr;
+  unsigned int nd;
+  unsigned int n;
+  gpuelemwise_arg *args;
+  int gen_flags;
+  /* Only for specialised kernels */
+  size_t size;
+  const size_t *dims;
+  const ssize_t *strides; /* nd for each array */
+};
+
 #define MUL_NO_OVERFLOW ((size_t)1 << (sizeof(size_t) * 4))
 
 static int reallocaz(void **p, size_t elsz, size_t old, size_t new) {
@@ -110,7 +341,9 @@ static int ge_grow(GpuElemwise *ge, unsigned int nd) {
 
   if (reallocaz((void **)&ge->k_basic, sizeof(GpuKernel), ge->nd, nd) ||
       reallocaz((void **)&ge->k_basic_32, sizeof(GpuKernel), ge->nd, nd) ||
-      reallocaz((void **)&ge->dims, sizeof(size_t), ge->nd, nd))
+      reallocaz((void **)&ge->dims, sizeof(size_t), ge->nd, nd) ||
+      reallocaz((void **)&ge->kargs, sizeof(void *), KARGS_LEN(ge, ge->nd),
+                KARGS_LEN(ge, nd)))
     return 1;
   for (i = 0; i < ge->narray; i++) {
     if (reallocaz((void **)&ge->strides[i], sizeof(ssize_t), ge->nd, nd))
@@ -120,6 +353,105 @@ static int ge_grow(GpuElemwise *ge, unsigned int nd) {
   return 0;
 }
 
+/*
+ * Loads, computation and stores of the basic and specialised kernels
+ * once the position of the element in each array (name_p) is known.
+ */
+static void basic_body(strb *sb, const struct gen_args *g) {
+  gpuelemwise_arg *args = g->args;
+  int gen_flags = g->gen_flags;
+  unsigned int j;
+
+  for (j = 0; j < g->n; j++) {
+    if (is_array(args[j])) {
+      tmpl_render(sb, &tmpl_ew_decl, ISSET(gen_flags, GEN_CONVERT_F16) && args[j].typecode == GA_HALF ?
+                  GA_FLOAT : args[j].typecode, args[j].name);
+      if (ISSET(args[j].flags, GE_READ)) {
+        if (args[j].typecode == GA_HALF && ISSET(gen_flags, GEN_CONVERT_F16))
+          tmpl_render(sb, &tmpl_ew_basic_load_half, args[j].name);
+        else
+          tmpl_render(sb, &tmpl_ew_basic_load, args[j].name, args[j].typecode);
+      }
+    }
+  }
+  strb_appends(sb, g->expr);
+  strb_appends(sb, ";\n");
+  for (j = 0; j < g->n; j++) {
+    if (is_array(args[j]) && ISSET(args[j].flags, GE_WRITE)) {
+      if (args[j].typecode == GA_HALF && ISSET(gen_flags, GEN_CONVERT_F16))
+        tmpl_render(sb, &tmpl_ew_basic_store_half, args[j].name);
+      else
+        tmpl_render(sb, &tmpl_ew_basic_store, args[j].typecode, args[j].name);
+    }
+  }
+  strb_appends(sb, "}\n}\n");
+}
+
+static int gen_elemwise_basic_src(void *data, char **src, size_t *len) {
+  struct gen_args *g = data;
+  const char *preamble = g->preamble;
+  const char *expr = g->expr;
+  unsigned int nd = g->nd;
+  unsigned int n = g->n;
+  gpuelemwise_arg *args = g->args;
+  int gen_flags = g->gen_flags;
+  strb sb = STRB_STATIC_INIT;
+  unsigned int i, _i, j;
+  char *size = "ga_size", *ssize = "ga_ssize";
+
+  if (ISSET(gen_flags, GEN_ADDR32)) {
+    size = "ga_uint";
+    ssize = "ga_int";
+  }
+
+  strb_ensure(&sb, 1024 + strlen(expr) + (preamble ? strlen(preamble) : 0) +
+              n * (nd + 1) * 128);
+  strb_appends(&sb, "#include \"cluda.h\"\n");
+  if (preamble)
+    strb_appends(&sb, preamble);
+  strb_appends(&sb, "\nKERNEL void elem(const ga_size n, ");
+  for (i = 0; i < nd; i++)
+    tmpl_render(&sb, &tmpl_ew_dim, i);
+  for (j = 0; j < n; j++) {
+    if (is_array(args[j])) {
+      tmpl_render(&sb, &tmpl_ew_basic_array, args[j].typecode, args[j].name,
+                  nd == 0 ? "" : ", ");
+      for (i = 0; i < nd; i++)
+        tmpl_render(&sb, &tmpl_ew_basic_str, args[j].name, i,
+                    (i == (nd - 1)) ? "": ", ");
+    } else {
+      tmpl_render(&sb, &tmpl_ew_scalar, args[j].typecode, args[j].name);
+    }
+    if (j != (n - 1)) strb_appends(&sb, ", ");
+  }
+  tmpl_render(&sb, &tmpl_ew_basic_start, size);
+  if (nd > 0)
+    tmpl_render(&sb, &tmpl_ew_basic_pos, size);
+  for (j = 0; j < n; j++) {
+    if (is_array(args[j]))
+      tmpl_render(&sb, &tmpl_ew_basic_ptr, size, args[j].name);
+  }
+  for (_i = nd; _i > 0; _i--) {
+    i = _i - 1;
+    if (i > 0)
+      tmpl_render(&sb, &tmpl_ew_basic_div, size, i);
+    else
+      strb_appends(&sb, "pos = ii;\n");
+    for (j = 0; j < n; j++) {
+      if (is_array(args[j]))
+        tmpl_render(&sb, &tmpl_ew_basic_step, args[j].name, ssize, i);
+    }
+  }
+  basic_body(&sb, g);
+  if (strb_error(&sb)) {
+    strb_clear(&sb);
+    return error_set(g->ctx->err, GA_MEMORY_ERROR, "Out of memory");
+  }
+  *src = sb.s;
+  *len = sb.l;
+  return GA_NO_ERROR;
+}
+
 static int gen_elemwise_basic_kernel(GpuKernel *k, gpucontext *ctx,
                                      char **err_str,
                                      const char *preamble,
@@ -128,19 +460,14 @@ static int gen_elemwise_basic_kernel(GpuKernel *k, gpucontext *ctx,
                                      unsigned int n, /* Length of args */
                                      gpuelemwise_arg *args,
                                      int gen_flags) {
-  strb sb = STRB_STATIC_INIT;
-  unsigned int i, _i, j;
+  strb sig = STRB_STATIC_INIT;
+  struct gen_args g;
+  unsigned int i, j;
   int *ktypes;
-  char *size = "ga_size", *ssize = "ga_ssize";
   unsigned int p;
   int flags = 0;
   int res;
 
-  if (ISSET(gen_flags, GEN_ADDR32)) {
-    size = "ga_uint";
-    ssize = "ga_int";
-  }
-
   flags |= gpuarray_type_flagsa(n, args);
 
   p = 1 + nd;
@@ -153,99 +480,169 @@ static int gen_elemwise_basic_kernel(GpuKernel *k, gpucontext *ctx,
     return error_sys(ctx->err, "calloc");
 
   p = 0;
-
-  strb_appends(&sb, "#include \"cluda.h\"\n");
-  if (preamble)
-    strb_appends(&sb, preamble);
-  strb_appends(&sb, "\nKERNEL void elem(const ga_size n, ");
   ktypes[p++] = GA_SIZE;
-  for (i = 0; i < nd; i++) {
-    strb_appendf(&sb, "const ga_size dim%u, ", i);
+  for (i = 0; i < nd; i++)
     ktypes[p++] = GA_SIZE;
-  }
   for (j = 0; j < n; j++) {
     if (is_array(args[j])) {
-      strb_appendf(&sb, "GLOBAL_MEM %s *%s_data, const ga_size %s_offset%s",
-                   ctype(args[j].typecode), args[j].name, args[j].name,
-                   nd == 0 ? "" : ", ");
       ktypes[p++] = GA_BUFFER;
       ktypes[p++] = GA_SIZE;
-
-      for (i = 0; i < nd; i++) {
-        strb_appendf(&sb, "const ga_ssize %s_str_%u%s", args[j].name, i,
-                     (i == (nd - 1)) ? "": ", ");
+      for (i = 0; i < nd; i++)
         ktypes[p++] = GA_SSIZE;
-      }
     } else {
-      strb_appendf(&sb, "%s %s", ctype(args[i].typecode), args[j].name);
       ktypes[p++] = args[j].typecode;
     }
-    if (j != (n - 1)) strb_appends(&sb, ", ");
   }
-  strb_appendf(&sb, ") {\n"
-               "const %s idx = LDIM_0 * GID_0 + LID_0;\n"
-               "const %s numThreads = LDIM_0 * GDIM_0;\n"
-               "%s i;\n", size, size, size);
 
-  strb_appends(&sb, "for(i = idx; i < n; i += numThreads) {\n");
-  if (nd > 0)
-    strb_appendf(&sb, "%s ii = i;\n%s pos;\n", size, size);
+  kernel_sig(&sig, 'b', preamble, expr, nd, n, args, gen_flags);
+  if (strb_error(&sig)) {
+    res = error_set(ctx->err, GA_MEMORY_ERROR, "Out of memory");
+    goto bail;
+  }
+
+  g.ctx = ctx;
+  g.preamble = preamble;
+  g.expr = expr;
+  g.nd = nd;
+  g.n = n;
+  g.args = args;
+  g.gen_flags = gen_flags;
+  res = GpuKernel_init_keyed(k, ctx, sig.s, sig.l, gen_elemwise_basic_src,
+                             &g, "elem", p, ktypes, flags, err_str);
+ bail:
+  free(ktypes);
+  strb_clear(&sig);
+  return res;
+}
+
+/*
+ * Same as the basic kernel, but the size, dims and strides are
+ * constants so that the compiler can fold the index computations.
+ * Only the data pointers, offsets and scalars are arguments.
+ */
+static int gen_elemwise_spec_src(void *data, char **src, size_t *len) {
+  struct gen_args *g = data;
+  const char *preamble = g->preamble;
+  unsigned int nd = g->nd;
+  unsigned int n = g->n;
+  gpuelemwise_arg *args = g->args;
+  strb sb = STRB_STATIC_INIT;
+  unsigned int i, _i, j, l;
+  char *size = "ga_size", *ssize = "ga_ssize";
+
+  if (ISSET(g->gen_flags, GEN_ADDR32)) {
+    size = "ga_uint";
+    ssize = "ga_int";
+  }
+
+  strb_ensure(&sb, 1024 + strlen(g->expr) +
+              (preamble ? strlen(preamble) : 0) + n * (nd + 1) * 128);
+  strb_appends(&sb, "#include \"cluda.h\"\n");
+  if (preamble)
+    strb_appends(&sb, preamble);
+  strb_appends(&sb, "\nKERNEL void elem(");
+  for (j = 0; j < n; j++) {
+    if (is_array(args[j]))
+      tmpl_render(&sb, &tmpl_ew_basic_array, args[j].typecode, args[j].name,
+                  "");
+    else
+      tmpl_render(&sb, &tmpl_ew_scalar, args[j].typecode, args[j].name);
+    if (j != (n - 1)) strb_appends(&sb, ", ");
+  }
+  tmpl_render(&sb, &tmpl_ew_spec_start, size, g->size);
+  tmpl_render(&sb, &tmpl_ew_basic_pos, size);
   for (j = 0; j < n; j++) {
     if (is_array(args[j]))
-      strb_appendf(&sb, "%s %s_p = %s_offset;\n",
-                   size, args[j].name, args[j].name);
+      tmpl_render(&sb, &tmpl_ew_basic_ptr, size, args[j].name);
   }
   for (_i = nd; _i > 0; _i--) {
     i = _i - 1;
+    /* pos is always 0 for those */
+    if (g->dims[i] == 1)
+      continue;
     if (i > 0)
-      strb_appendf(&sb, "pos = ii %% (%s)dim%u;\nii = ii / (%s)dim%u;\n", size, i, size, i);
+      tmpl_render(&sb, &tmpl_ew_spec_div, size, g->dims[i]);
     else
       strb_appends(&sb, "pos = ii;\n");
+    l = 0;
     for (j = 0; j < n; j++) {
-      if (is_array(args[j]))
-        strb_appendf(&sb, "%s_p += pos * (%s)%s_str_%u;\n", args[j].name,
-                     ssize, args[j].name, i);
-    }
-  }
-  for (j = 0; j < n; j++) {
-    if (is_array(args[j])) {
-      strb_appendf(&sb, "%s %s;", ctype(ISSET(gen_flags, GEN_CONVERT_F16) && args[j].typecode == GA_HALF ?
-                                        GA_FLOAT : args[j].typecode), args[j].name);
-      if (ISSET(args[j].flags, GE_READ)) {
-        if (args[j].typecode == GA_HALF && ISSET(gen_flags, GEN_CONVERT_F16)) {
-          strb_appendf(&sb, "%s = ga_half2float(*(GLOBAL_MEM ga_half *)(((GLOBAL_MEM char *)%s_data) + %s_p));\n",
-                       args[j].name, args[j].name, args[j].name);
-        } else {
-          strb_appendf(&sb, "%s = *(GLOBAL_MEM %s *)(((GLOBAL_MEM char *)%s_data) + %s_p);\n",
-                       args[j].name, ctype(args[j].typecode), args[j].name, args[j].name);
-        }
+      if (is_array(args[j])) {
+        if (g->strides[l * nd + i] != 0)
+          tmpl_render(&sb, &tmpl_ew_spec_step, args[j].name, ssize,
+                      g->strides[l * nd + i]);
+        l++;
       }
     }
   }
-  strb_appends(&sb, expr);
-  strb_appends(&sb, ";\n");
+  basic_body(&sb, g);
+  if (strb_error(&sb)) {
+    strb_clear(&sb);
+    return error_set(g->ctx->err, GA_MEMORY_ERROR, "Out of memory");
+  }
+  *src = sb.s;
+  *len = sb.l;
+  return GA_NO_ERROR;
+}
+
+static int gen_elemwise_spec_kernel(GpuKernel *k, gpucontext *ctx,
+                                    const char *preamble, const char *expr,
+                                    size_t size, unsigned int nd,
+                                    const size_t *dims, const ssize_t *strs,
+                                    unsigned int narray, unsigned int n,
+                                    gpuelemwise_arg *args, int gen_flags) {
+  strb sig = STRB_STATIC_INIT;
+  struct gen_args g;
+  unsigned int j;
+  int *ktypes;
+  unsigned int p;
+  int flags = 0;
+  int res;
+
+  flags |= gpuarray_type_flagsa(n, args);
+
+  p = 0;
+  for (j = 0; j < n; j++)
+    p += ISSET(args[j].flags, GE_SCALAR) ? 1 : 2;
+
+  ktypes = calloc(p, sizeof(int));
+  if (ktypes == NULL)
+    return error_sys(ctx->err, "calloc");
+
+  p = 0;
   for (j = 0; j < n; j++) {
-    if (is_array(args[j]) && ISSET(args[j].flags, GE_WRITE)) {
-      if (args[j].typecode == GA_HALF && ISSET(gen_flags, GEN_CONVERT_F16)) {
-        strb_appendf(&sb, "*(GLOBAL_MEM ga_half *)(((GLOBAL_MEM char *)%s_data) + %s_p) = ga_float2half(%s);\n",
-                     args[j].name, args[j].name, args[j].name);
-      } else {
-        strb_appendf(&sb, "*(GLOBAL_MEM %s *)(((GLOBAL_MEM char *)%s_data) + %s_p) = %s;\n",
-                     ctype(args[j].typecode), args[j].name, args[j].name, args[j].name);
-      }
+    if (is_array(args[j])) {
+      ktypes[p++] = GA_BUFFER;
+      ktypes[p++] = GA_SIZE;
+    } else {
+      ktypes[p++] = args[j].typecode;
     }
   }
-  strb_appends(&sb, "}\n}\n");
-  if (strb_error(&sb)) {
-    res = GA_MEMORY_ERROR;
+
+  /* The size follows from the dims */
+  kernel_sig(&sig, 's', preamble, expr, nd, n, args, gen_flags);
+  strb_appendc(&sig, '\0');
+  strb_appendn(&sig, (const char *)dims, nd * sizeof(size_t));
+  strb_appendn(&sig, (const char *)strs, narray * nd * sizeof(ssize_t));
+  if (strb_error(&sig)) {
+    res = error_set(ctx->err, GA_MEMORY_ERROR, "Out of memory");
     goto bail;
   }
 
-  res = GpuKernel_init(k, ctx, 1, (const char **)&sb.s, &sb.l, "elem",
-                       p, ktypes, flags, err_str);
+  g.ctx = ctx;
+  g.preamble = preamble;
+  g.expr = expr;
+  g.nd = nd;
+  g.n = n;
+  g.args = args;
+  g.gen_flags = gen_flags;
+  g.size = size;
+  g.dims = dims;
+  g.strides = strs;
+  res = GpuKernel_init_keyed(k, ctx, sig.s, sig.l, gen_elemwise_spec_src,
+                             &g, "elem", p, ktypes, flags, NULL);
  bail:
   free(ktypes);
-  strb_clear(&sb);
+  strb_clear(&sig);
   return res;
 }
 
@@ -382,6 +779,130 @@ static int check_basic(GpuElemwise *ge, void **args, int flags,
   return GA_NO_ERROR;
 }
 
+/*
+ * Put the data, offset and scalar arguments in ge->kargs starting at
+ * `p`.  This is the whole list for the contiguous and specialised
+ * kernels.
+ */
+static void flat_args(GpuElemwise *ge, unsigned int p, void **args) {
+  GpuArray *a;
+  unsigned int i;
+
+  for (i = 0; i < ge->n; i++) {
+    if (is_array(ge->args[i])) {
+      a = (GpuArray *)args[i];
+      ge->kargs[p++] = a->data;
+      ge->kargs[p++] = &a->offset;
+    } else {
+      ge->kargs[p++] = args[i];
+    }
+  }
+}
+
+/*
+ * Shape specialisation.
+ *
+ * When enabled by GpuElemwise_specialize(), the calls are counted per
+ * collapsed shape and strides.  Once a shape has been seen more than
+ * the threshold, a kernel with the size, shape and strides compiled
+ * in is built and used for the calls that match it exactly.
+ *
+ * Only SPEC_SLOTS shapes are tracked so that workloads with changing
+ * shapes don't accumulate state.  A new shape takes the place of the
+ * least used one that doesn't have a kernel yet.
+ */
+static int spec_match(GpuElemwise *ge, struct spec_shape *s, unsigned int nd,
+                      size_t *dims, ssize_t **strs, int call32) {
+  unsigned int l;
+
+  if (s->dims == NULL || s->nd != nd || s->call32 != call32 ||
+      memcmp(s->dims, dims, nd * sizeof(size_t)) != 0)
+    return 0;
+  for (l = 0; l < ge->narray; l++)
+    if (memcmp(s->strides + l * nd, strs[l], nd * sizeof(ssize_t)) != 0)
+      return 0;
+  return 1;
+}
+
+static void spec_clear(struct spec_shape *s) {
+  if (k_initialized(&s->k))
+    GpuKernel_clear(&s->k);
+  free(s->dims);
+  memset(s, 0, sizeof(*s));
+}
+
+static int spec_set(GpuElemwise *ge, struct spec_shape *s, unsigned int nd,
+                    size_t *dims, ssize_t **strs, int call32) {
+  unsigned int l;
+
+  spec_clear(s);
+  s->dims = malloc(nd * (ge->narray + 1) * sizeof(size_t));
+  if (s->dims == NULL)
+    return -1;
+  s->strides = (ssize_t *)(s->dims + nd);
+  memcpy(s->dims, dims, nd * sizeof(size_t));
+  for (l = 0; l < ge->narray; l++)
+    memcpy(s->strides + l * nd, strs[l], nd * sizeof(ssize_t));
+  s->nd = nd;
+  s->call32 = call32;
+  return 0;
+}
+
+/* Returns the specialised kernel for the shape or NULL if there is none */
+static GpuKernel *spec_kernel(GpuElemwise *ge, size_t n, unsigned int nd,
+                              size_t *dims, ssize_t **strs, int call32) {
+  struct spec_shape *s = NULL, *free_slot = NULL;
+  unsigned int i;
+  int err;
+
+  for (i = 0; i < SPEC_SLOTS; i++) {
+    if (spec_match(ge, &ge->spec[i], nd, dims, strs, call32)) {
+      s = &ge->spec[i];
+      break;
+    }
+    if (!k_initialized(&ge->spec[i].k) &&
+        (free_slot == NULL || ge->spec[i].count < free_slot->count))
+      free_slot = &ge->spec[i];
+  }
+  if (s == NULL) {
+    /* All the slots have a kernel */
+    if (free_slot == NULL)
+      return NULL;
+    if (spec_set(ge, free_slot, nd, dims, strs, call32) != 0)
+      return NULL;
+    s = free_slot;
+  }
+
+  if (k_initialized(&s->k))
+    return &s->k;
+  if (s->count < UINT_MAX)
+    s->count++;
+  if (s->failed || s->count <= ge->spec_threshold)
+    return NULL;
+
+  err = gen_elemwise_spec_kernel(&s->k, GpuKernel_context(&ge->k_contig),
+                                 ge->preamble, ge->expr, n, nd, s->dims,
+                                 s->strides, ge->narray, ge->n, ge->args,
+                                 ((call32 ? GEN_ADDR32 : 0) |
+                                  (ge->flags & GE_CONVERT_F16)));
+  /* The generic kernel can still be used */
+  if (err != GA_NO_ERROR) {
+    s->failed = 1;
+    return NULL;
+  }
+  return &s->k;
+}
+
+static int call_spec(GpuElemwise *ge, GpuKernel *k, void **args, size_t n) {
+  size_t ls = 0, gs = 0;
+  int err;
+
+  flat_args(ge, 0, args);
+  err = GpuKernel_sched(k, n, &gs, &ls);
+  if (err != GA_NO_ERROR) return err;
+  return GpuKernel_call(k, 1, &gs, &ls, 0, ge->kargs);
+}
+
 static int call_basic(GpuElemwise *ge, void **args, size_t n, unsigned int nd,
                       size_t *dims, ssize_t **strs, int call32) {
   GpuKernel *k;
@@ -391,6 +912,12 @@ static int call_basic(GpuElemwise *ge, void **args, size_t n, unsigned int nd,
 
   if (nd == 0) return error_set(GpuKernel_context(&ge->k_contig)->err, GA_VALUE_ERROR, "nd == 0");
 
+  if (ge->spec != NULL) {
+    k = spec_kernel(ge, n, nd, dims, strs, call32);
+    if (k != NULL)
+      return call_spec(ge, k, args, n);
+  }
+
   if (call32)
     k = &ge->k_basic_32[nd-1];
   else
@@ -405,40 +932,97 @@ static int call_basic(GpuElemwise *ge, void **args, size_t n, unsigned int nd,
       return err;
   }
 
-  err = GpuKernel_setarg(k, p++, &n);
-  if (err != GA_NO_ERROR) goto error_call_basic;
+  ge->kargs[p++] = &n;
 
-  for (i = 0; i < nd; i++) {
-    err = GpuKernel_setarg(k, p++, &dims[i]);
-    if (err != GA_NO_ERROR) goto error_call_basic;
-  }
+  for (i = 0; i < nd; i++)
+    ge->kargs[p++] = &dims[i];
 
   /* l is the number of arrays to date */
   l = 0;
   for (j = 0; j < ge->n; j++) {
     if (is_array(ge->args[j])) {
       GpuArray *v = (GpuArray *)args[j];
-      err = GpuKernel_setarg(k, p++, v->data);
-      if (err != GA_NO_ERROR) goto error_call_basic;
-      err = GpuKernel_setarg(k, p++, &v->offset);
-      if (err != GA_NO_ERROR) goto error_call_basic;
-      for (i = 0; i < nd; i++) {
-        err = GpuKernel_setarg(k, p++, &strs[l][i]);
-        if (err != GA_NO_ERROR) goto error_call_basic;
-      }
+      ge->kargs[p++] = v->data;
+      ge->kargs[p++] = &v->offset;
+      for (i = 0; i < nd; i++)
+        ge->kargs[p++] = &strs[l][i];
       l++;
     } else {
-      err = GpuKernel_setarg(k, p++, args[j]);
-      if (err != GA_NO_ERROR) goto error_call_basic;
+      ge->kargs[p++] = args[j];
     }
   }
 
   err = GpuKernel_sched(k, n, &gs, &ls);
-  if (err != GA_NO_ERROR) goto error_call_basic;
+  if (err != GA_NO_ERROR) return err;
 
-  err = GpuKernel_call(k, 1, &gs, &ls, 0, NULL);
- error_call_basic:
-  return err;
+  return GpuKernel_call(k, 1, &gs, &ls, 0, ge->kargs);
+}
+
+static int gen_elemwise_contig_src(void *data, char **src, size_t *len) {
+  struct gen_args *g = data;
+  const char *preamble = g->preamble;
+  const char *expr = g->expr;
+  unsigned int n = g->n;
+  gpuelemwise_arg *args = g->args;
+  int gen_flags = g->gen_flags;
+  strb sb = STRB_STATIC_INIT;
+  unsigned int j;
+
+  strb_ensure(&sb, 1024 + strlen(expr) + (preamble ? strlen(preamble) : 0) +
+              n * 256);
+  strb_appends(&sb, "#include \"cluda.h\"\n");
+  if (preamble)
+    strb_appends(&sb, preamble);
+  strb_appends(&sb, "\nKERNEL void elem(const ga_size n, ");
+  for (j = 0; j < n; j++) {
+    if (is_array(args[j]))
+      tmpl_render(&sb, &tmpl_ew_contig_array, args[j].typecode, args[j].name);
+    else
+      tmpl_render(&sb, &tmpl_ew_scalar, args[j].typecode, args[j].name);
+    if (j != (n - 1))
+      strb_appends(&sb, ", ");
+  }
+  tmpl_render(&sb, &tmpl_ew_contig_start);
+  for (j = 0; j < n; j++) {
+    if (is_array(args[j]))
+      tmpl_render(&sb, &tmpl_ew_contig_offset, args[j].name,
+                  args[j].typecode);
+  }
+
+  strb_appends(&sb, "for (i = idx; i < n; i += numThreads) {\n");
+  for (j = 0; j < n; j++) {
+    if (is_array(args[j])) {
+      tmpl_render(&sb, &tmpl_ew_decl, ISSET(gen_flags, GEN_CONVERT_F16) && args[j].typecode == GA_HALF ?
+                  GA_FLOAT : args[j].typecode, args[j].name);
+      strb_appendc(&sb, '\n');
+      if (ISSET(args[j].flags, GE_READ)) {
+        if (args[j].typecode == GA_HALF && ISSET(gen_flags, GEN_CONVERT_F16))
+          tmpl_render(&sb, &tmpl_ew_contig_load_half, args[j].name);
+        else
+          tmpl_render(&sb, &tmpl_ew_contig_load, args[j].name);
+      }
+    }
+  }
+  strb_appends(&sb, expr);
+  strb_appends(&sb, ";\n");
+
+  for (j = 0; j < n; j++) {
+    if (is_array(args[j]) && ISSET(args[j].flags, GE_WRITE)) {
+      if (args[j].typecode == GA_HALF && ISSET(gen_flags, GEN_CONVERT_F16))
+        tmpl_render(&sb, &tmpl_ew_contig_store_half, args[j].name);
+      else
+        tmpl_render(&sb, &tmpl_ew_contig_store, args[j].name);
+    }
+  }
+  strb_appends(&sb, "}\n}\n");
+
+  if (strb_error(&sb)) {
+    strb_clear(&sb);
+    return error_set(g->ctx->err, GA_MISC_ERROR, "Formatting error creating kernel source");
+  }
+  *src = sb.s;
+  *len = sb.l;
+  return GA_NO_ERROR;
 }
 
 static int gen_elemwise_contig_kernel(GpuKernel *k,
@@ -448,7 +1032,8 @@ static int gen_elemwise_contig_kernel(GpuKernel *k,
                                       unsigned int n,
                                       gpuelemwise_arg *args,
                                       int gen_flags) {
-  strb sb = STRB_STATIC_INIT;
+  strb sig = STRB_STATIC_INIT;
+  struct gen_args g;
   int *ktypes = NULL;
   unsigned int p;
   unsigned int j;
@@ -468,78 +1053,33 @@ static int gen_elemwise_contig_kernel(GpuKernel *k,
   }
 
   p = 0;
-
-  strb_appends(&sb, "#include \"cluda.h\"\n");
-  if (preamble)
-    strb_appends(&sb, preamble);
-  strb_appends(&sb, "\nKERNEL void elem(const ga_size n, ");
   ktypes[p++] = GA_SIZE;
   for (j = 0; j < n; j++) {
     if (is_array(args[j])) {
-      strb_appendf(&sb, "GLOBAL_MEM %s *%s_p,  const ga_size %s_offset",
-                   ctype(args[j].typecode), args[j].name, args[j].name);
       ktypes[p++] = GA_BUFFER;
       ktypes[p++] = GA_SIZE;
     } else {
-      strb_appendf(&sb, "%s %s", ctype(args[j].typecode), args[j].name);
       ktypes[p++] = args[j].typecode;
     }
-    if (j != (n - 1))
-      strb_appends(&sb, ", ");
-  }
-  strb_appends(&sb, ") {\n"
-               "const ga_size idx = LDIM_0 * GID_0 + LID_0;\n"
-               "const ga_size numThreads = LDIM_0 * GDIM_0;\n"
-               "ga_size i;\n"
-               "GLOBAL_MEM char *tmp;\n\n");
-  for (j = 0; j < n; j++) {
-    if (is_array(args[j])) {
-      strb_appendf(&sb, "tmp = (GLOBAL_MEM char *)%s_p;"
-                   "tmp += %s_offset; %s_p = (GLOBAL_MEM %s *)tmp;",
-                   args[j].name, args[j].name, args[j].name,
-                   ctype(args[j].typecode));
-    }
-  }
-
-  strb_appends(&sb, "for (i = idx; i < n; i += numThreads) {\n");
-  for (j = 0; j < n; j++) {
-    if (is_array(args[j])) {
-      strb_appendf(&sb, "%s %s;\n", ctype(ISSET(gen_flags, GEN_CONVERT_F16) && args[j].typecode == GA_HALF ?
-                                          GA_FLOAT : args[j].typecode), args[j].name);
-      if (ISSET(args[j].flags, GE_READ)) {
-        if (args[j].typecode == GA_HALF && ISSET(gen_flags, GEN_CONVERT_F16)) {
-          strb_appendf(&sb, "%s = ga_half2float(%s_p[i]);\n", args[j].name, args[j].name);
-        } else {
-          strb_appendf(&sb, "%s = %s_p[i];\n", args[j].name, args[j].name);
-        }
-      }
-    }
-  }
-  strb_appends(&sb, expr);
-  strb_appends(&sb, ";\n");
-
-  for (j = 0; j < n; j++) {
-    if (is_array(args[j])) {
-      if (ISSET(args[j].flags, GE_WRITE)) {
-        if (args[j].typecode == GA_HALF && ISSET(gen_flags, GEN_CONVERT_F16)) {
-          strb_appendf(&sb, "%s_p[i] = ga_float2half(%s);\n", args[j].name, args[j].name);
-        } else {
-          strb_appendf(&sb, "%s_p[i] = %s;\n", args[j].name, args[j].name);
-        }
-      }
-    }
   }
-  strb_appends(&sb, "}\n}\n");
 
-  if (strb_error(&sb)) {
-    res = error_set(ctx->err, GA_MISC_ERROR, "Formatting error creating kernel source");
+  kernel_sig(&sig, 'c', preamble, expr, 0, n, args, gen_flags);
+  if (strb_error(&sig)) {
+    res = error_set(ctx->err, GA_MEMORY_ERROR, "Out of memory");
     goto bail;
   }
 
-  res = GpuKernel_init(k, ctx, 1, (const char **)&sb.s, &sb.l, "elem",
-                       p, ktypes, flags, err_str);
+  g.ctx = ctx;
+  g.preamble = preamble;
+  g.expr = expr;
+  g.nd = 0;
+  g.n = n;
+  g.args = args;
+  g.gen_flags = gen_flags;
+  res = GpuKernel_init_keyed(k, ctx, sig.s, sig.l, gen_elemwise_contig_src,
+                             &g, "elem", p, ktypes, flags, err_str);
  bail:
-  strb_clear(&sb);
+  strb_clear(&sig);
   free(ktypes);
   return res;
 }
@@ -576,29 +1116,39 @@ static int check_contig(GpuElemwise *ge, void **args,
 }
 
 static int call_contig(GpuElemwise *ge, void **args, size_t n) {
-  GpuArray *a;
   size_t ls = 0, gs = 0;
-  unsigned int i, p;
   int err;
 
-  p = 0;
-  err = GpuKernel_setarg(&ge->k_contig, p++, &n);
-  if (err != GA_NO_ERROR) return err;
-  for (i = 0; i < ge->n; i++) {
-    if (is_array(ge->args[i])) {
-      a = (GpuArray *)args[i];
-      err = GpuKernel_setarg(&ge->k_contig, p++, a->data);
-      if (err != GA_NO_ERROR) return err;
-      err = GpuKernel_setarg(&ge->k_contig, p++, &a->offset);
-      if (err != GA_NO_ERROR) return err;
-    } else {
-      err = GpuKernel_setarg(&ge->k_contig, p++, args[i]);
-      if (err != GA_NO_ERROR) return err;
-    }
-  }
+  ge->kargs[0] = &n;
+  flat_args(ge, 1, args);
   err = GpuKernel_sched(&ge->k_contig, n, &gs, &ls);
   if (err != GA_NO_ERROR) return err;
-  return GpuKernel_call(&ge->k_contig, 1, &gs, &ls, 0, NULL);
+  return GpuKernel_call(&ge->k_contig, 1, &gs, &ls, 0, ge->kargs);
+}
+
+#ifdef DEBUG
+/* Map the names in the generated source back to the user's names */
+static void debug_names(GpuElemwise *ge, gpuelemwise_arg *uargs) {
+  unsigned int j;
+
+  fprintf(stderr, "Arguments:\n");
+  for (j = 0; j < ge->n; j++)
+    fprintf(stderr, "  %s: %s\n", ge->args[j].name, uargs[j].name);
+}
+#endif
+
+gpukernel *GpuElemwise_contig_kernel(GpuElemwise *ge) {
+  return ge->k_contig.k;
+}
+
+unsigned int GpuElemwise_spec_kernels(GpuElemwise *ge) {
+  unsigned int i, res = 0;
+
+  if (ge->spec == NULL) return 0;
+  for (i = 0; i < SPEC_SLOTS; i++)
+    if (k_initialized(&ge->spec[i].k))
+      res++;
+  return res;
 }
 
 GpuElemwise *GpuElemwise_new(gpucontext *ctx,
@@ -641,6 +1191,11 @@ GpuElemwise *GpuElemwise_new(gpucontext *ctx,
     goto fail;
   }
 
+  if (canonicalise(res) != 0) {
+    error_sys(ctx->err, "canonicalise");
+    goto fail;
+  }
+
   /* Count the arrays in the arguements */
   res->narray = 0;
   for (i = 0; i < res->n; i++)
@@ -657,6 +1212,11 @@ GpuElemwise *GpuElemwise_new(gpucontext *ctx,
     error_sys(ctx->err, "strides_array");
     goto fail;
   }
+  res->kargs = calloc(KARGS_LEN(res, res->nd), sizeof(void *));
+  if (res->kargs == NULL) {
+    error_sys(ctx->err, "calloc");
+    goto fail;
+  }
   res->k_basic = calloc(res->nd, sizeof(GpuKernel));
   if (res->k_basic == NULL) {
     error_sys(ctx->err, "calloc");
@@ -683,6 +1243,7 @@ GpuElemwise *GpuElemwise_new(gpucontext *ctx,
     if (errstr != NULL)
       fprintf(stderr, "%s\n", errstr);
     free(errstr);
+    debug_names(res, args);
 #endif
     goto fail;
   }
@@ -703,6 +1264,7 @@ GpuElemwise *GpuElemwise_new(gpucontext *ctx,
         if (errstr != NULL)
           fprintf(stderr, "%s\n", errstr);
         free(errstr);
+        debug_names(res, args);
 #endif
         goto fail;
       }
@@ -724,6 +1286,7 @@ GpuElemwise *GpuElemwise_new(gpucontext *ctx,
       if (errstr != NULL)
         fprintf(stderr, "%s\n", errstr);
       free(errstr);
+      debug_names(res, args);
 #endif
       goto fail;
     }
@@ -738,6 +1301,7 @@ GpuElemwise *GpuElemwise_new(gpucontext *ctx,
 
 void GpuElemwise_free(GpuElemwise *ge) {
   unsigned int i;
+  GpuElemwise_specialize(ge, 0);
   for (i = 0; i < ge->nd; i++) {
     if (k_initialized(&ge->k_basic_32[i]))
       GpuKernel_clear(&ge->k_basic_32[i]);
@@ -755,6 +1319,7 @@ void GpuElemwise_free(GpuElemwise *ge) {
   free((void *)ge->expr);
   free(ge->dims);
   free(ge->strides);
+  free(ge->kargs);
   free(ge);
 }
 
@@ -779,3 +1344,22 @@ int GpuElemwise_call(GpuElemwise *ge, void **args, int flags) {
   }
   return err;
 }
+
+int GpuElemwise_specialize(GpuElemwise *ge, unsigned int threshold) {
+  unsigned int i;
+
+  if (threshold == 0) {
+    if (ge->spec != NULL) {
+      for (i = 0; i < SPEC_SLOTS; i++)
+        spec_clear(&ge->spec[i]);
+      free(ge->spec);
+      ge->spec = NULL;
+    }
+  } else if (ge->spec == NULL) {
+    ge->spec = calloc(SPEC_SLOTS, sizeof(struct spec_shape));
+    if (ge->spec == NULL)
+      return error_sys(GpuKernel_context(&ge->k_contig)->err, "calloc");
+  }
+  ge->spec_threshold = threshold;
+  return GA_NO_ERROR;
+}
@@ -17,6 +17,7 @@ extern void *cuda_wait(void);
 extern void *cuda_record(void);
 extern void *cuda_get_ipc_handle(void);
 extern void *cuda_open_ipc_handle(void);
+extern void *cuda_get_ipc_range(void);
 
 extern void *cl_make_ctx(void);
 extern void *cl_get_stream(void);
@@ -34,6 +35,7 @@ static ext ext_list[] = {
   {"cuda_record", cuda_record},
   {"cuda_get_ipc_handle", cuda_get_ipc_handle},
   {"cuda_open_ipc_handle", cuda_open_ipc_handle},
+  {"cuda_get_ipc_range", cuda_get_ipc_range},
 
   {"cl_make_ctx", cl_make_ctx},
   {"cl_get_stream", cl_get_stream},
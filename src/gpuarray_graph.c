@@ -0,0 +1,327 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "private.h"
+
+#include "gpuarray/buffer.h"
+#include "gpuarray/error.h"
+#include "gpuarray/util.h"
+
+#include "util/error.h"
+
+/* Scalar arguments are copied in slots of this size and alignment */
+#define ARG_SLOT 16
+
+static void graph_free(gpugraph *g) {
+  size_t i;
+
+  if (g->exec != NULL && g->ctx->ops->graph_free != NULL)
+    g->ctx->ops->graph_free(g);
+  for (i = 0; i < g->nnodes; i++) {
+    if (g->nodes[i].type == GRAPH_KERNEL) {
+      gpukernel_release(g->nodes[i].k);
+      free(g->nodes[i].args);
+    }
+    free(g->nodes[i].host);
+  }
+  for (i = 0; i < g->nbufs; i++)
+    gpudata_release(g->bufs[i]);
+  for (i = 0; i < g->nkargs; i++)
+    free(g->kargs[i].vals);
+  free(g->kargs);
+  free(g->bufs);
+  free(g->nodes);
+  free(g);
+}
+
+static int graph_add_buf(gpugraph *g, gpudata *b) {
+  gpudata **tmp;
+  size_t i;
+
+  for (i = 0; i < g->nbufs; i++)
+    if (g->bufs[i] == b)
+      return GA_NO_ERROR;
+  if (g->nbufs == g->abufs) {
+    tmp = realloc(g->bufs, sizeof(gpudata *) * (g->abufs ? g->abufs * 2 : 8));
+    if (tmp == NULL)
+      return error_sys(g->ctx->err, "realloc");
+    g->bufs = tmp;
+    g->abufs = g->abufs ? g->abufs * 2 : 8;
+  }
+  gpudata_retain(b);
+  g->bufs[g->nbufs++] = b;
+  return GA_NO_ERROR;
+}
+
+static graph_node *graph_add_node(gpugraph *g, int type) {
+  graph_node *tmp;
+
+  if (g->nnodes == g->anodes) {
+    tmp = realloc(g->nodes,
+                  sizeof(graph_node) * (g->anodes ? g->anodes * 2 : 16));
+    if (tmp == NULL) {
+      error_sys(g->ctx->err, "realloc");
+      return NULL;
+    }
+    g->nodes = tmp;
+    g->anodes = g->anodes ? g->anodes * 2 : 16;
+  }
+  tmp = &g->nodes[g->nnodes];
+  memset(tmp, 0, sizeof(*tmp));
+  tmp->type = type;
+  return tmp;
+}
+
+static graph_kargs *graph_find_kargs(gpugraph *g, gpukernel *k, int create) {
+  graph_kargs *tmp;
+  size_t i;
+
+  for (i = 0; i < g->nkargs; i++)
+    if (g->kargs[i].k == k)
+      return &g->kargs[i];
+  if (!create)
+    return NULL;
+  tmp = realloc(g->kargs, sizeof(graph_kargs) * (g->nkargs + 1));
+  if (tmp == NULL) {
+    error_sys(g->ctx->err, "realloc");
+    return NULL;
+  }
+  g->kargs = tmp;
+  tmp = &g->kargs[g->nkargs];
+  if (gpukernel_property(k, GA_KERNEL_PROP_NUMARGS, &tmp->numargs) != GA_NO_ERROR ||
+      gpukernel_property(k, GA_KERNEL_PROP_TYPES, &tmp->types) != GA_NO_ERROR)
+    return NULL;
+  tmp->vals = calloc(tmp->numargs ? tmp->numargs : 1, sizeof(void *));
+  if (tmp->vals == NULL) {
+    error_sys(g->ctx->err, "calloc");
+    return NULL;
+  }
+  tmp->k = k;
+  g->nkargs++;
+  return tmp;
+}
+
+int graph_record_setarg(gpukernel *k, unsigned int i, void *a) {
+  gpucontext *ctx = gpukernel_context(k);
+  graph_kargs *ka;
+
+  ka = graph_find_kargs(ctx->capture, k, 1);
+  if (ka == NULL)
+    return error_code(ctx->err);
+  if (i >= ka->numargs)
+    return error_set(ctx->err, GA_VALUE_ERROR, "index is beyond the last argument");
+  ka->vals[i] = a;
+  return GA_NO_ERROR;
+}
+
+int graph_record_call(gpukernel *k, unsigned int n, const size_t *gs,
+                      const size_t *ls, size_t shared, void **args) {
+  gpucontext *ctx = gpukernel_context(k);
+  gpugraph *g = ctx->capture;
+  graph_kargs *ka;
+  graph_node *node;
+  const int *types;
+  unsigned int numargs;
+  unsigned int i;
+  char *slot;
+  void **nargs;
+  int err;
+
+  if (n == 0 || n > 3)
+    return error_set(ctx->err, GA_VALUE_ERROR, "Call with more than 3 dimensions");
+
+  if (args == NULL) {
+    ka = graph_find_kargs(g, k, 0);
+    if (ka == NULL)
+      return error_set(ctx->err, GA_VALUE_ERROR, "Kernel arguments must be set during the capture");
+    numargs = ka->numargs;
+    types = ka->types;
+    args = ka->vals;
+  } else {
+    GA_CHECK(gpukernel_property(k, GA_KERNEL_PROP_NUMARGS, &numargs));
+    GA_CHECK(gpukernel_property(k, GA_KERNEL_PROP_TYPES, &types));
+  }
+
+  nargs = malloc(numargs * (sizeof(void *) + ARG_SLOT) + 1);
+  if (nargs == NULL)
+    return error_sys(ctx->err, "malloc");
+  slot = (char *)(nargs + numargs);
+  for (i = 0; i < numargs; i++) {
+    if (args[i] == NULL) {
+      free(nargs);
+      return error_fmt(ctx->err, GA_VALUE_ERROR, "Kernel argument %u is not set", i);
+    }
+    if (types[i] == GA_BUFFER) {
+      err = graph_add_buf(g, (gpudata *)args[i]);
+      if (err != GA_NO_ERROR) {
+        free(nargs);
+        return err;
+      }
+      nargs[i] = args[i];
+    } else {
+      if (gpuarray_get_elsize(types[i]) > ARG_SLOT) {
+        free(nargs);
+        return error_set(ctx->err, GA_UNSUPPORTED_ERROR, "Argument type too large for capture");
+      }
+      memcpy(slot + i * ARG_SLOT, args[i], gpuarray_get_elsize(types[i]));
+      nargs[i] = slot + i * ARG_SLOT;
+    }
+  }
+
+  node = graph_add_node(g, GRAPH_KERNEL);
+  if (node == NULL) {
+    free(nargs);
+    return error_code(ctx->err);
+  }
+  node->k = k;
+  node->nd = n;
+  for (i = 0; i < n; i++) {
+    node->gs[i] = gs[i];
+    node->ls[i] = ls[i];
+  }
+  node->shared = shared;
+  node->args = nargs;
+  gpukernel_retain(k);
+  g->nnodes++;
+  return GA_NO_ERROR;
+}
+
+int graph_record_move(gpudata *dst, size_t dstoff, gpudata *src,
+                      size_t srcoff, size_t sz) {
+  gpucontext *ctx = gpudata_context(src);
+  gpugraph *g = ctx->capture;
+  graph_node *node;
+
+  GA_CHECK(graph_add_buf(g, dst));
+  GA_CHECK(graph_add_buf(g, src));
+  node = graph_add_node(g, GRAPH_MOVE);
+  if (node == NULL)
+    return error_code(ctx->err);
+  node->dst = dst;
+  node->dstoff = dstoff;
+  node->src = src;
+  node->srcoff = srcoff;
+  node->sz = sz;
+  g->nnodes++;
+  return GA_NO_ERROR;
+}
+
+int graph_record_memset(gpudata *dst, size_t dstoff, int data) {
+  gpucontext *ctx = gpudata_context(dst);
+  gpugraph *g = ctx->capture;
+  graph_node *node;
+
+  GA_CHECK(graph_add_buf(g, dst));
+  node = graph_add_node(g, GRAPH_MEMSET);
+  if (node == NULL)
+    return error_code(ctx->err);
+  node->dst = dst;
+  node->dstoff = dstoff;
+  node->data = data;
+  g->nnodes++;
+  return GA_NO_ERROR;
+}
+
+int graph_record_write(gpudata *dst, size_t dstoff, const void *src,
+                       size_t sz) {
+  gpucontext *ctx = gpudata_context(dst);
+  gpugraph *g = ctx->capture;
+  graph_node *node;
+  void *host;
+
+  GA_CHECK(graph_add_buf(g, dst));
+  host = memdup(src, sz ? sz : 1);
+  if (host == NULL)
+    return error_sys(ctx->err, "malloc");
+  node = graph_add_node(g, GRAPH_WRITE);
+  if (node == NULL) {
+    free(host);
+    return error_code(ctx->err);
+  }
+  node->dst = dst;
+  node->dstoff = dstoff;
+  node->host = host;
+  node->sz = sz;
+  g->nnodes++;
+  return GA_NO_ERROR;
+}
+
+int gpucontext_capture_begin(gpucontext *ctx) {
+  gpugraph *g;
+
+  if (ctx->capture != NULL)
+    return error_set(ctx->err, GA_INVALID_ERROR, "A capture is already in progress");
+  g = calloc(1, sizeof(*g));
+  if (g == NULL)
+    return error_sys(ctx->err, "calloc");
+  g->ctx = ctx;
+  ctx->capture = g;
+  return GA_NO_ERROR;
+}
+
+gpugraph *gpucontext_capture_end(gpucontext *ctx, int *ret) {
+  gpugraph *g = ctx->capture;
+  size_t i;
+  int err;
+
+  if (g == NULL) {
+    error_set(ctx->err, GA_INVALID_ERROR, "No capture in progress");
+    if (ret) *ret = GA_INVALID_ERROR;
+    return NULL;
+  }
+  ctx->capture = NULL;
+
+  /* The argument pointers are only valid during the capture */
+  for (i = 0; i < g->nkargs; i++)
+    free(g->kargs[i].vals);
+  free(g->kargs);
+  g->kargs = NULL;
+  g->nkargs = 0;
+
+  if (ctx->ops->graph_instantiate != NULL && g->nnodes != 0) {
+    err = ctx->ops->graph_instantiate(g);
+    if (err != GA_NO_ERROR && err != GA_DEVSUP_ERROR) {
+      graph_free(g);
+      if (ret) *ret = err;
+      return NULL;
+    }
+  }
+  return g;
+}
+
+int gpugraph_launch(gpugraph *g) {
+  const gpuarray_buffer_ops *ops = g->ctx->ops;
+  graph_node *node;
+  size_t i;
+
+  GRAPH_CHECK(g->ctx, "Launching a graph");
+  if (g->exec != NULL)
+    return ops->graph_launch(g);
+
+  for (i = 0; i < g->nnodes; i++) {
+    node = &g->nodes[i];
+    switch (node->type) {
+    case GRAPH_KERNEL:
+      GA_CHECK(ops->kernel_call(node->k, node->nd, node->gs, node->ls,
+                                node->shared, node->args));
+      break;
+    case GRAPH_MOVE:
+      GA_CHECK(ops->buffer_move(node->dst, node->dstoff,
+                                node->src, node->srcoff, node->sz));
+      break;
+    case GRAPH_MEMSET:
+      GA_CHECK(ops->buffer_memset(node->dst, node->dstoff, node->data));
+      break;
+    case GRAPH_WRITE:
+      GA_CHECK(ops->buffer_write(node->dst, node->dstoff,
+                                 node->host, node->sz));
+      break;
+    }
+  }
+  return GA_NO_ERROR;
+}
+
+void gpugraph_release(gpugraph *g) {
+  if (g != NULL)
+    graph_free(g);
+}
@@ -3,9 +3,63 @@
 #include "gpuarray/types.h"
 
 #include "util/error.h"
+#include "util/xxhash.h"
 #include "private.h"
 
 #include <stdlib.h>
+#include <string.h>
+
+typedef struct _keyed_key {
+  const char *name;
+  const int *types;
+  const void *key;
+  size_t keylen;
+  unsigned int argcount;
+  int flags;
+} keyed_key;
+
+static int keyed_eq(cache_key_t _k1, cache_key_t _k2) {
+  keyed_key *k1 = _k1;
+  keyed_key *k2 = _k2;
+  return (k1->keylen == k2->keylen && k1->argcount == k2->argcount &&
+          k1->flags == k2->flags &&
+          memcmp(k1->key, k2->key, k1->keylen) == 0 &&
+          memcmp(k1->types, k2->types, k1->argcount * sizeof(int)) == 0 &&
+          strcmp(k1->name, k2->name) == 0);
+}
+
+static uint32_t keyed_hash(cache_key_t _k) {
+  keyed_key *k = _k;
+  return XXH32(k->key, k->keylen, (uint32_t)k->argcount);
+}
+
+/* The key is allocated in one block with its data (see keyed_dup()) */
+static void keyed_free(cache_key_t k) {
+  free(k);
+}
+
+static keyed_key *keyed_dup(const keyed_key *k) {
+  size_t tsz = k->argcount * sizeof(int);
+  size_t nsz = strlen(k->name) + 1;
+  keyed_key *res;
+  char *p;
+
+  res = malloc(sizeof(*res) + tsz + k->keylen + nsz);
+  if (res == NULL)
+    return NULL;
+  *res = *k;
+  /* The types go first to keep them aligned */
+  p = (char *)(res + 1);
+  memcpy(p, k->types, tsz);
+  res->types = (const int *)p;
+  p += tsz;
+  memcpy(p, k->key, k->keylen);
+  res->key = p;
+  p += k->keylen;
+  memcpy(p, k->name, nsz);
+  res->name = p;
+  return res;
+}
 
 int GpuKernel_init(GpuKernel *k, gpucontext *ctx, unsigned int count,
                    const char **strs, const size_t *lens, const char *name,
@@ -23,6 +77,90 @@ int GpuKernel_init(GpuKernel *k, gpucontext *ctx, unsigned int count,
   return res;
 }
 
+/*
+ * Look up `kk` in the keyed cache of `ctx` and return a new reference
+ * to the kernel or NULL.  Must be called with the context lock held.
+ */
+static gpukernel *keyed_get(gpucontext *ctx, keyed_key *kk) {
+  gpukernel *res;
+
+  if (ctx->keyed_kernels == NULL)
+    return NULL;
+  res = cache_get(ctx->keyed_kernels, kk);
+  if (res != NULL)
+    gpukernel_retain(res);
+  return res;
+}
+
+int GpuKernel_init_keyed(GpuKernel *k, gpucontext *ctx, const void *key,
+                         size_t keylen, GpuKernel_gen_fn gen, void *data,
+                         const char *name, unsigned int argcount,
+                         const int *types, int flags, char **err_str) {
+  keyed_key kk;
+  keyed_key *pk;
+  gpukernel *res;
+  char *src;
+  size_t len;
+  int err;
+
+  kk.name = name;
+  kk.types = types;
+  kk.key = key;
+  kk.keylen = keylen;
+  kk.argcount = argcount;
+  kk.flags = flags;
+
+  /* The lock only covers the cache, the kernel is generated and
+     compiled without it. */
+  ga_lock_acquire(ctx->lock);
+  res = keyed_get(ctx, &kk);
+  ga_lock_release(ctx->lock);
+  if (res != NULL) {
+    k->args = calloc(argcount, sizeof(void *));
+    if (k->args == NULL) {
+      gpukernel_release(res);
+      return error_sys(ctx->err, "calloc");
+    }
+    k->k = res;
+    return GA_NO_ERROR;
+  }
+
+  err = gen(data, &src, &len);
+  if (err != GA_NO_ERROR)
+    return err;
+  err = GpuKernel_init(k, ctx, 1, (const char **)&src, &len, name,
+                       argcount, types, flags, err_str);
+  free(src);
+  if (err != GA_NO_ERROR)
+    return err;
+
+  ga_lock_acquire(ctx->lock);
+  /* If another thread built the same kernel meanwhile, use the one in
+     the cache so that there is only one. */
+  res = keyed_get(ctx, &kk);
+  if (res != NULL) {
+    ga_lock_release(ctx->lock);
+    gpukernel_release(k->k);
+    k->k = res;
+    return GA_NO_ERROR;
+  }
+  if (ctx->keyed_kernels == NULL)
+    ctx->keyed_kernels = cache_twoq(16, 64, 32, 8, keyed_eq, keyed_hash,
+                                    keyed_free,
+                                    (cache_freev_fn)gpukernel_release,
+                                    ctx->err);
+  /* Not being able to cache the kernel is not an error */
+  if (ctx->keyed_kernels != NULL) {
+    pk = keyed_dup(&kk);
+    if (pk != NULL) {
+      gpukernel_retain(k->k);
+      cache_add(ctx->keyed_kernels, pk, k->k);
+    }
+  }
+  ga_lock_release(ctx->lock);
+  return GA_NO_ERROR;
+}
+
 void GpuKernel_clear(GpuKernel *k) {
   if (k->k)
     gpukernel_release(k->k);
@@ -35,56 +173,66 @@ gpucontext *GpuKernel_context(GpuKernel *k) {
   return gpukernel_context(k->k);
 }
 
+/*
+ * Get the description of the device for the scheduler.  It doesn't
+ * change, so it is only queried once per context.  The warp size
+ * depends on the kernel and is filled in by the caller.
+ */
+static int sched_dev_get(gpukernel *k, sched_dev *d) {
+  gpucontext *ctx = gpukernel_context(k);
+  sched_dev tmp;
+  int err = GA_NO_ERROR;
+
+  ga_lock_acquire(ctx->lock);
+  if (ctx->sched.numprocs == 0) {
+    memset(&tmp, 0, sizeof(tmp));
+    err = gpukernel_property(k, GA_CTX_PROP_NUMPROCS, &tmp.numprocs);
+    if (err == GA_NO_ERROR)
+      err = gpukernel_property(k, GA_CTX_PROP_MAXGSIZE0, &tmp.max_g);
+    if (err == GA_NO_ERROR)
+      err = gpukernel_property(k, GA_CTX_PROP_MAXTHREADS_MP, &tmp.threads_mp);
+    if (err == GA_NO_ERROR)
+      err = gpukernel_property(k, GA_CTX_PROP_MAXBLOCKS_MP, &tmp.blocks_mp);
+    if (err == GA_NO_ERROR)
+      err = gpukernel_property(k, GA_CTX_PROP_REGS_MP, &tmp.regs_mp);
+    if (err == GA_NO_ERROR)
+      err = gpukernel_property(k, GA_CTX_PROP_LMEMSIZE_MP, &tmp.lmem_mp);
+    if (err == GA_NO_ERROR)
+      ctx->sched = tmp;
+  }
+  *d = ctx->sched;
+  ga_lock_release(ctx->lock);
+  return err;
+}
+
 int GpuKernel_sched(GpuKernel *k, size_t n, size_t *gs, size_t *ls) {
+  sched_dev d;
+  sched_kernel sk;
   size_t min_l;
-  size_t max_l;
-  size_t target_l;
-  size_t max_g;
-  size_t target_g;
-  unsigned int numprocs;
   int err;
-  int want_ls = 0;
 
-  err = gpukernel_property(k->k, GA_KERNEL_PROP_MAXLSIZE, &max_l);
+  err = sched_dev_get(k->k, &d);
   if (err != GA_NO_ERROR)
     return err;
   err = gpukernel_property(k->k, GA_KERNEL_PROP_PREFLSIZE, &min_l);
   if (err != GA_NO_ERROR)
     return err;
-  err = gpukernel_property(k->k, GA_CTX_PROP_NUMPROCS, &numprocs);
-  if (err != GA_NO_ERROR)
-    return err;
-  err = gpukernel_property(k->k, GA_CTX_PROP_MAXGSIZE0, &max_g);
+  d.warp = (unsigned int)min_l;
+
+  memset(&sk, 0, sizeof(sk));
+  err = gpukernel_property(k->k, GA_KERNEL_PROP_MAXLSIZE, &sk.max_l);
   if (err != GA_NO_ERROR)
     return err;
-
-  /* Do something about these hardcoded values */
-  target_g = numprocs * 32;
-  if (target_g > max_g)
-    target_g = max_g;
-  target_l = 512;
-  if (target_l > max_l)
-    target_l = max_l;
-
-  if (*ls == 0) {
-    want_ls = 1;
-    *ls = min_l;
-  }
-
-  if (*gs == 0) {
-    *gs = ((n-1) / *ls) + 1;
-    if (*gs > target_g)
-      *gs = target_g;
-  }
-
-  if (want_ls && n > (*ls * *gs)) {
-    /* The division and multiplication by min_l is to ensure we end up
-     * with a multiple of min_l */
-    *ls = ((n / min_l) / *gs) * min_l;
-    if (*ls > target_l)
-      *ls = target_l;
+  if (d.threads_mp != 0) {
+    err = gpukernel_property(k->k, GA_KERNEL_PROP_NUMREGS, &sk.regs);
+    if (err != GA_NO_ERROR)
+      return err;
+    err = gpukernel_property(k->k, GA_KERNEL_PROP_LMEMSIZE, &sk.lmem);
+    if (err != GA_NO_ERROR)
+      return err;
   }
 
+  sched_launch(&d, &sk, n, gs, ls);
   return GA_NO_ERROR;
 }
 
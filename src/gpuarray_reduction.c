@@ -18,8 +18,11 @@
 #include "gpuarray/util.h"
 
 #include "util/strb.h"
+#include "util/tmpl.h"
 #include "util/integerfactoring.h"
 
+#include "maxandargmax.tmpl.c"
+
 
 /* Datatypes */
 struct maxandargmax_ctx{
@@ -78,10 +81,11 @@ static void  appendIdxes                        (strb*              s,
 static int   maxandargmaxCheckargs              (maxandargmax_ctx*  ctx);
 static int   maxandargmaxSelectHwAxes           (maxandargmax_ctx*  ctx);
 static int   maxandargmaxGenSource              (maxandargmax_ctx*  ctx);
+static int   maxandargmaxGenSourceCb            (void*              data,
+                                                 char**             src,
+                                                 size_t*            len);
 static void  maxandargmaxAppendKernel           (maxandargmax_ctx*  ctx);
-static void  maxandargmaxAppendTypedefs         (maxandargmax_ctx*  ctx);
 static void  maxandargmaxAppendPrototype        (maxandargmax_ctx*  ctx);
-static void  maxandargmaxAppendOffsets          (maxandargmax_ctx*  ctx);
 static void  maxandargmaxAppendIndexDeclarations(maxandargmax_ctx*  ctx);
 static void  maxandargmaxAppendRangeCalculations(maxandargmax_ctx*  ctx);
 static void  maxandargmaxAppendLoops            (maxandargmax_ctx*  ctx);
@@ -113,7 +117,6 @@ GPUARRAY_PUBLIC int GpuArray_maxandargmax       (GpuArray*       dstMax,
 
 	if(maxandargmaxCheckargs   (ctx) == GA_NO_ERROR &&
 	   maxandargmaxSelectHwAxes(ctx) == GA_NO_ERROR &&
-	   maxandargmaxGenSource   (ctx) == GA_NO_ERROR &&
 	   maxandargmaxCompile     (ctx) == GA_NO_ERROR &&
 	   maxandargmaxSchedule    (ctx) == GA_NO_ERROR &&
 	   maxandargmaxInvoke      (ctx) == GA_NO_ERROR){
@@ -181,7 +184,7 @@ static void  appendIdxes                        (strb*              s,
 
 	strb_appends(s, prologue);
 	for(i=startIdx;i<endIdx;i++){
-		strb_appendf(s, "%s%d%s%s", prefix, i, suffix, &","[i==endIdx-1]);
+		tmpl_render(s, &tmpl_maa_idx, prefix, i, suffix, &","[i==endIdx-1]);
 	}
 	strb_appends(s, epilogue);
 }
@@ -321,65 +324,51 @@ static int   maxandargmaxGenSource              (maxandargmax_ctx*  ctx){
 	/* Return it. */
 	return ctx->ret=GA_NO_ERROR;
 }
+
+/**
+ * @brief Source generator callback for GpuKernel_init_keyed().
+ *
+ * The source is only generated when the kernel is not already cached.
+ */
+
+static int   maxandargmaxGenSourceCb            (void*              data,
+                                                 char**             src,
+                                                 size_t*            len){
+	maxandargmax_ctx* ctx = (maxandargmax_ctx*)data;
+
+	if(maxandargmaxGenSource(ctx) != GA_NO_ERROR){
+		return ctx->ret;
+	}
+
+	/* The source is handed over to the caller. */
+	*src            = ctx->sourceCode;
+	*len            = strlen(ctx->sourceCode);
+	ctx->sourceCode = NULL;
+	return GA_NO_ERROR;
+}
 static void  maxandargmaxAppendKernel           (maxandargmax_ctx*  ctx){
-	strb_appends           (&ctx->s, "#include \"cluda.h\"\n");
-	maxandargmaxAppendTypedefs         (ctx);
 	maxandargmaxAppendPrototype        (ctx);
-	strb_appends           (&ctx->s, "{\n");
-	maxandargmaxAppendOffsets          (ctx);
 	maxandargmaxAppendIndexDeclarations(ctx);
 	maxandargmaxAppendRangeCalculations(ctx);
 	maxandargmaxAppendLoops            (ctx);
 	strb_appends           (&ctx->s, "}\n");
 }
-static void  maxandargmaxAppendTypedefs         (maxandargmax_ctx*  ctx){
-	strb_appends(&ctx->s, "/* Typedefs */\n");
-	strb_appendf(&ctx->s, "typedef %s     T;/* The type of the array being processed. */\n", ctx->dstMaxType);
-	strb_appendf(&ctx->s, "typedef %s     X;/* Index type: signed 32/64-bit. */\n",          ctx->dstArgmaxType);
-	strb_appends(&ctx->s, "\n");
-	strb_appends(&ctx->s, "\n");
-	strb_appends(&ctx->s, "\n");
-}
 static void  maxandargmaxAppendPrototype        (maxandargmax_ctx*  ctx){
-	strb_appends(&ctx->s, "KERNEL void maxandargmax(const GLOBAL_MEM T*        src,\n");
-	strb_appends(&ctx->s, "                         const X         srcOff,\n");
-	strb_appends(&ctx->s, "                         const GLOBAL_MEM X*        srcSteps,\n");
-	strb_appends(&ctx->s, "                         const GLOBAL_MEM X*        srcSize,\n");
-	strb_appends(&ctx->s, "                         const GLOBAL_MEM X*        chunkSize,\n");
-	strb_appends(&ctx->s, "                         GLOBAL_MEM T*              dstMax,\n");
-	strb_appends(&ctx->s, "                         const X         dstMaxOff,\n");
-	strb_appends(&ctx->s, "                         const GLOBAL_MEM X*        dstMaxSteps,\n");
-	strb_appends(&ctx->s, "                         GLOBAL_MEM X*              dstArgmax,\n");
-	strb_appends(&ctx->s, "                         const X         dstArgmaxOff,\n");
-	strb_appends(&ctx->s, "                         const GLOBAL_MEM X*        dstArgmaxSteps)");
-}
-static void  maxandargmaxAppendOffsets          (maxandargmax_ctx*  ctx){
-	strb_appends(&ctx->s, "\t/* Add offsets */\n");
-	strb_appends(&ctx->s, "\tsrc       = (const GLOBAL_MEM T*)((const GLOBAL_MEM char*)src       + srcOff);\n");
-	strb_appends(&ctx->s, "\tdstMax    = (GLOBAL_MEM T*)      ((GLOBAL_MEM char*)      dstMax    + dstMaxOff);\n");
-	strb_appends(&ctx->s, "\tdstArgmax = (GLOBAL_MEM X*)      ((GLOBAL_MEM char*)      dstArgmax + dstArgmaxOff);\n");
-	strb_appends(&ctx->s, "\t\n");
-	strb_appends(&ctx->s, "\t\n");
+	/* Also has the typedefs, the offsets and the kernel coordinates. */
+	tmpl_render(&ctx->s, &tmpl_maa_head, ctx->dstMaxType, ctx->dstArgmaxType);
 }
 static void  maxandargmaxAppendIndexDeclarations(maxandargmax_ctx*  ctx){
 	int i;
-	strb_appends(&ctx->s, "\t/* GPU kernel coordinates. Always 3D. */\n");
 
-	strb_appends(&ctx->s, "\tX bi0 = GID_0,        bi1 = GID_1,        bi2 = GID_2;\n");
-	strb_appends(&ctx->s, "\tX bd0 = LDIM_0,       bd1 = LDIM_1,       bd2 = LDIM_2;\n");
-	strb_appends(&ctx->s, "\tX ti0 = LID_0,        ti1 = LID_1,        ti2 = LID_2;\n");
-	strb_appends(&ctx->s, "\tX gi0 = bi0*bd0+ti0,  gi1 = bi1*bd1+ti1,  gi2 = bi2*bd2+ti2;\n");
 	if(ctx->ndh>0){
 		strb_appends(&ctx->s, "\tX ");
 		for(i=0;i<ctx->ndh;i++){
-			strb_appendf(&ctx->s, "ci%u = chunkSize[%u]%s",
-			             i, i, (i==ctx->ndh-1) ? ";\n" : ", ");
+			tmpl_render(&ctx->s, &tmpl_maa_chunk, i,
+			            (i==ctx->ndh-1) ? ";\n" : ", ");
 		}
 	}
 
-	strb_appends(&ctx->s, "\t\n");
-	strb_appends(&ctx->s, "\t\n");
-	strb_appends(&ctx->s, "\t/* Free indices & Reduction indices */\n");
+	tmpl_render(&ctx->s, &tmpl_maa_free_indices);
 
 	if(ctx->nds > 0){appendIdxes (&ctx->s, "\tX ", "i", 0,               ctx->nds, "",        ";\n");}
 	if(ctx->nds > 0){appendIdxes (&ctx->s, "\tX ", "i", 0,               ctx->nds, "Dim",     ";\n");}
@@ -390,27 +379,26 @@ static void  maxandargmaxAppendIndexDeclarations(maxandargmax_ctx*  ctx){
 	if(ctx->ndd > 0){appendIdxes (&ctx->s, "\tX ", "i", 0,               ctx->ndd, "AStep",   ";\n");}
 	if(ctx->nds > ctx->ndd){appendIdxes (&ctx->s, "\tX ", "i", ctx->ndd, ctx->nds, "PDim",    ";\n");}
 
-	strb_appends(&ctx->s, "\t\n");
-	strb_appends(&ctx->s, "\t\n");
+	tmpl_render(&ctx->s, &tmpl_maa_blank);
 }
 static void  maxandargmaxAppendRangeCalculations(maxandargmax_ctx*  ctx){
 	size_t hwDim;
 	int    i;
 
 	/* Use internal remapping when computing the ranges for this thread. */
-	strb_appends(&ctx->s, "\t/* Compute ranges for this thread. */\n");
+	tmpl_render(&ctx->s, &tmpl_maa_ranges);
 
 	for(i=0;i<ctx->nds;i++){
-		strb_appendf(&ctx->s, "\ti%dDim     = srcSize[%d];\n", i, ctx->axisList[i]);
+		tmpl_render(&ctx->s, &tmpl_maa_dim, i, ctx->axisList[i]);
 	}
 	for(i=0;i<ctx->nds;i++){
-		strb_appendf(&ctx->s, "\ti%dSStep   = srcSteps[%d];\n", i, ctx->axisList[i]);
+		tmpl_render(&ctx->s, &tmpl_maa_sstep, i, ctx->axisList[i]);
 	}
 	for(i=0;i<ctx->ndd;i++){
-		strb_appendf(&ctx->s, "\ti%dMStep   = dstMaxSteps[%d];\n", i, i);
+		tmpl_render(&ctx->s, &tmpl_maa_mstep, i);
 	}
 	for(i=0;i<ctx->ndd;i++){
-		strb_appendf(&ctx->s, "\ti%dAStep   = dstArgmaxSteps[%d];\n", i, i);
+		tmpl_render(&ctx->s, &tmpl_maa_astep, i);
 	}
 	for(i=ctx->nds-1;i>=ctx->ndd;i--){
 		/**
@@ -419,9 +407,9 @@ static void  maxandargmaxAppendRangeCalculations(maxandargmax_ctx*  ctx){
 		 */
 
 		if(i == ctx->nds-1){
-			strb_appendf(&ctx->s, "\ti%dPDim    = 1;\n", i);
+			tmpl_render(&ctx->s, &tmpl_maa_pdim_last, i);
 		}else{
-			strb_appendf(&ctx->s, "\ti%dPDim    = i%dPDim * i%dDim;\n", i, i+1, i+1);
+			tmpl_render(&ctx->s, &tmpl_maa_pdim, i, i+1);
 		}
 	}
 	for(i=0;i<ctx->nds;i++){
@@ -431,9 +419,9 @@ static void  maxandargmaxAppendRangeCalculations(maxandargmax_ctx*  ctx){
 		 */
 
 		if(axisInSet(ctx->axisList[i], ctx->hwAxisList, ctx->ndh, &hwDim)){
-			strb_appendf(&ctx->s, "\ti%dStart   = gi%d * ci%d;\n", i, hwDim, hwDim);
+			tmpl_render(&ctx->s, &tmpl_maa_start_hw, i, (int)hwDim);
 		}else{
-			strb_appendf(&ctx->s, "\ti%dStart   = 0;\n", i);
+			tmpl_render(&ctx->s, &tmpl_maa_start, i);
 		}
 	}
 	for(i=0;i<ctx->nds;i++){
@@ -443,21 +431,15 @@ static void  maxandargmaxAppendRangeCalculations(maxandargmax_ctx*  ctx){
 		 */
 
 		if(axisInSet(ctx->axisList[i], ctx->hwAxisList, ctx->ndh, &hwDim)){
-			strb_appendf(&ctx->s, "\ti%dEnd     = i%dStart + ci%d;\n", i, i, hwDim);
+			tmpl_render(&ctx->s, &tmpl_maa_end_hw, i, (int)hwDim);
 		}else{
-			strb_appendf(&ctx->s, "\ti%dEnd     = i%dStart + i%dDim;\n", i, i, i);
+			tmpl_render(&ctx->s, &tmpl_maa_end, i);
 		}
 	}
 
-	strb_appends(&ctx->s, "\t\n");
-	strb_appends(&ctx->s, "\t\n");
+	tmpl_render(&ctx->s, &tmpl_maa_blank);
 }
 static void  maxandargmaxAppendLoops            (maxandargmax_ctx*  ctx){
-	strb_appends(&ctx->s, "\t/**\n");
-	strb_appends(&ctx->s, "\t * FREE LOOPS.\n");
-	strb_appends(&ctx->s, "\t */\n");
-	strb_appends(&ctx->s, "\t\n");
-
 	maxandargmaxAppendLoopMacroDefs  (ctx);
 	maxandargmaxAppendLoopOuter      (ctx);
 	maxandargmaxAppendLoopMacroUndefs(ctx);
@@ -466,16 +448,10 @@ static void  maxandargmaxAppendLoopMacroDefs    (maxandargmax_ctx*  ctx){
 	int i;
 
 	/**
-	 * FOROVER Macro
+	 * FOROVER and ESCAPE Macros
 	 */
 
-	strb_appends(&ctx->s, "#define FOROVER(idx)    for(i##idx = i##idx##Start; i##idx < i##idx##End; i##idx++)\n");
-
-	/**
-	 * ESCAPE Macro
-	 */
-
-	strb_appends(&ctx->s, "#define ESCAPE(idx)     if(i##idx >= i##idx##Dim){continue;}\n");
+	tmpl_render(&ctx->s, &tmpl_maa_loops);
 
 	/**
 	 * SRCINDEXER Macro
@@ -483,7 +459,7 @@ static void  maxandargmaxAppendLoopMacroDefs    (maxandargmax_ctx*  ctx){
 
 	appendIdxes (&ctx->s, "#define SRCINDEXER(", "i", 0, ctx->nds, "", ")   (*(GLOBAL_MEM T*)((GLOBAL_MEM char*)src + ");
 	for(i=0;i<ctx->nds;i++){
-		strb_appendf(&ctx->s, "i%d*i%dSStep + \\\n                                            ", i, i);
+		tmpl_render(&ctx->s, &tmpl_maa_src_term, i);
 	}
 	strb_appends(&ctx->s, "0))\n");
 
@@ -493,7 +469,7 @@ static void  maxandargmaxAppendLoopMacroDefs    (maxandargmax_ctx*  ctx){
 
 	appendIdxes (&ctx->s, "#define RDXINDEXER(", "i", ctx->ndd, ctx->nds, "", ")              (");
 	for(i=ctx->ndd;i<ctx->nds;i++){
-		strb_appendf(&ctx->s, "i%d*i%dPDim + \\\n                                        ", i, i);
+		tmpl_render(&ctx->s, &tmpl_maa_rdx_term, i);
 	}
 	strb_appends(&ctx->s, "0)\n");
 
@@ -503,7 +479,7 @@ static void  maxandargmaxAppendLoopMacroDefs    (maxandargmax_ctx*  ctx){
 
 	appendIdxes (&ctx->s, "#define DSTMINDEXER(", "i", 0, ctx->ndd, "", ")        (*(GLOBAL_MEM T*)((GLOBAL_MEM char*)dstMax + ");
 	for(i=0;i<ctx->ndd;i++){
-		strb_appendf(&ctx->s, "i%d*i%dMStep + \\\n                                                  ", i, i);
+		tmpl_render(&ctx->s, &tmpl_maa_dstm_term, i);
 	}
 	strb_appends(&ctx->s, "0))\n");
 
@@ -513,7 +489,7 @@ static void  maxandargmaxAppendLoopMacroDefs    (maxandargmax_ctx*  ctx){
 
 	appendIdxes (&ctx->s, "#define DSTAINDEXER(", "i", 0, ctx->ndd, "", ")        (*(GLOBAL_MEM X*)((GLOBAL_MEM char*)dstArgmax + ");
 	for(i=0;i<ctx->ndd;i++){
-		strb_appendf(&ctx->s, "i%d*i%dAStep + \\\n                                                     ", i, i);
+		tmpl_render(&ctx->s, &tmpl_maa_dsta_term, i);
 	}
 	strb_appends(&ctx->s, "0))\n");
 }
@@ -525,7 +501,7 @@ static void  maxandargmaxAppendLoopOuter        (maxandargmax_ctx*  ctx){
 	 */
 
 	for(i=0;i<ctx->ndd;i++){
-		strb_appendf(&ctx->s, "\tFOROVER(%d){ESCAPE(%d)\n", i, i);
+		tmpl_render(&ctx->s, &tmpl_maa_for, i);
 	}
 
 	/**
@@ -549,10 +525,7 @@ static void  maxandargmaxAppendLoopInner        (maxandargmax_ctx*  ctx){
 	 * Inner Loop Prologue
 	 */
 
-	strb_appends(&ctx->s, "\t/**\n");
-	strb_appends(&ctx->s, "\t * Reduction initialization.\n");
-	strb_appends(&ctx->s, "\t */\n");
-	strb_appends(&ctx->s, "\t\n");
+	tmpl_render(&ctx->s, &tmpl_maa_init);
 
 	appendIdxes (&ctx->s, "\tT maxV = SRCINDEXER(", "i", 0, ctx->ndd, "", "");
 	if(ctx->ndd && ctx->ndr){strb_appends(&ctx->s, ",");}
@@ -560,18 +533,14 @@ static void  maxandargmaxAppendLoopInner        (maxandargmax_ctx*  ctx){
 
 	appendIdxes (&ctx->s, "\tX maxI = RDXINDEXER(", "i", ctx->ndd, ctx->nds, "Start", ");\n");
 
-	strb_appends(&ctx->s, "\t\n");
-	strb_appends(&ctx->s, "\t/**\n");
-	strb_appends(&ctx->s, "\t * REDUCTION LOOPS.\n");
-	strb_appends(&ctx->s, "\t */\n");
-	strb_appends(&ctx->s, "\t\n");
+	tmpl_render(&ctx->s, &tmpl_maa_reduction);
 
 	/**
 	 * Inner Loop Header Generation
 	 */
 
 	for(i=ctx->ndd;i<ctx->nds;i++){
-		strb_appendf(&ctx->s, "\tFOROVER(%d){ESCAPE(%d)\n", i, i);
+		tmpl_render(&ctx->s, &tmpl_maa_for, i);
 	}
 
 	/**
@@ -579,9 +548,7 @@ static void  maxandargmaxAppendLoopInner        (maxandargmax_ctx*  ctx){
 	 */
 
 	appendIdxes (&ctx->s, "\tT V = SRCINDEXER(", "i", 0, ctx->nds, "", ");\n");
-	strb_appends(&ctx->s, "\t\n");
-	strb_appends(&ctx->s, "\tif(V > maxV){\n");
-	strb_appends(&ctx->s, "\t\tmaxV = V;\n");
+	tmpl_render(&ctx->s, &tmpl_maa_update);
 	appendIdxes (&ctx->s, "\t\tmaxI = RDXINDEXER(", "i", ctx->ndd, ctx->nds, "", ");\n");
 	strb_appends(&ctx->s, "\t}\n");
 
@@ -592,26 +559,17 @@ static void  maxandargmaxAppendLoopInner        (maxandargmax_ctx*  ctx){
 	for(i=ctx->ndd;i<ctx->nds;i++){
 		strb_appends(&ctx->s, "\t}\n");
 	}
-	strb_appends(&ctx->s, "\t\n");
 
 	/**
 	 * Inner Loop Epilogue Generation
 	 */
 
-	strb_appends(&ctx->s, "\t/**\n");
-	strb_appends(&ctx->s, "\t * Destination writeback.\n");
-	strb_appends(&ctx->s, "\t */\n");
-	strb_appends(&ctx->s, "\t\n");
+	tmpl_render(&ctx->s, &tmpl_maa_writeback);
 	appendIdxes (&ctx->s, "\tDSTMINDEXER(", "i", 0, ctx->ndd, "", ") = maxV;\n");
 	appendIdxes (&ctx->s, "\tDSTAINDEXER(", "i", 0, ctx->ndd, "", ") = maxI;\n");
 }
 static void  maxandargmaxAppendLoopMacroUndefs  (maxandargmax_ctx*  ctx){
-	strb_appends(&ctx->s, "#undef FOROVER\n");
-	strb_appends(&ctx->s, "#undef ESCAPE\n");
-	strb_appends(&ctx->s, "#undef SRCINDEXER\n");
-	strb_appends(&ctx->s, "#undef RDXINDEXER\n");
-	strb_appends(&ctx->s, "#undef DSTMINDEXER\n");
-	strb_appends(&ctx->s, "#undef DSTAINDEXER\n");
+	tmpl_render(&ctx->s, &tmpl_maa_undefs);
 }
 static void  maxandargmaxComputeAxisList        (maxandargmax_ctx*  ctx){
 	int i, f=0;
@@ -646,22 +604,41 @@ static int   maxandargmaxCompile                (maxandargmax_ctx*  ctx){
 		GA_BUFFER  /* dstArgmaxSteps */
 	};
 	const unsigned int ARG_TYPECODES_LEN = sizeof(ARG_TYPECODES)/sizeof(*ARG_TYPECODES);
-	const char*  SRCS[1];
-
-	SRCS[0] = ctx->sourceCode;
-
-	ctx->ret = GpuKernel_init(&ctx->kernel,
-	                          ctx->gpuCtx,
-	                          1,
-	                          SRCS,
-	                          NULL,
-	                          "maxandargmax",
-	                          ARG_TYPECODES_LEN,
-	                          ARG_TYPECODES,
-	                          0,
-	                          (char**)0);
-	free(ctx->sourceCode);
-	ctx->sourceCode = NULL;
+	int*         key;
+	size_t       keyLen;
+	int          i;
+
+	/**
+	 * The source only depends on the type, the dimensionalities and the
+	 * reduction and hardware axes, which form the kernel's signature.
+	 */
+
+	keyLen = 5 + ctx->ndr;
+	key    = malloc(keyLen * sizeof(*key));
+	if(!key){
+		return ctx->ret=GA_MEMORY_ERROR;
+	}
+	key[0] = ctx->src->typecode;
+	key[1] = ctx->nds;
+	key[2] = ctx->hwAxisList[0];
+	key[3] = ctx->hwAxisList[1];
+	key[4] = ctx->hwAxisList[2];
+	for(i=0;i<ctx->ndr;i++){
+		key[5+i] = ctx->reduxList[i];
+	}
+
+	ctx->ret = GpuKernel_init_keyed(&ctx->kernel,
+	                                ctx->gpuCtx,
+	                                key,
+	                                keyLen * sizeof(*key),
+	                                maxandargmaxGenSourceCb,
+	                                ctx,
+	                                "maxandargmax",
+	                                ARG_TYPECODES_LEN,
+	                                ARG_TYPECODES,
+	                                0,
+	                                (char**)0);
+	free(key);
 
 	return ctx->ret;
 }
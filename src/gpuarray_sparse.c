@@ -0,0 +1,840 @@
+#include <assert.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "private.h"
+#include "gpuarray/array.h"
+#include "gpuarray/error.h"
+#include "gpuarray/kernel.h"
+#include "gpuarray/sparse.h"
+#include "gpuarray/util.h"
+
+#include "util/error.h"
+#include "util/strb.h"
+#include "util/tmpl.h"
+
+#include "sparse.tmpl.c"
+
+/* Items of the merge path consumed by each thread */
+#define MERGE_ITEMS 8
+/* Block size of the CSR-vector kernel (upper bound) */
+#define VECTOR_BLOCK 128
+/* Largest group of threads working on one row in CSR-vector */
+#define VECTOR_MAX_WIDTH 32
+
+enum sparse_kernel {
+  SK_SCALE,
+  SK_CSR_VECTOR,
+  SK_MERGE_PATH,
+  SK_COO_SPMV,
+  SK_CSR_SPMM,
+  SK_COO_SPMM,
+  SK_DENSE_COUNT,
+  SK_DENSE_FILL,
+  SK_CSR_EXPAND,
+  SK_CHECK_INDEX,
+  SK_COUNT
+};
+
+/* Stands for the value type in the argument lists below */
+#define T_ARG -2
+#define SK_MAXARGS 20
+
+#define VEC_ARGS GA_BUFFER, GA_SIZE, GA_SSIZE
+#define MAT_ARGS GA_BUFFER, GA_SIZE, GA_SSIZE, GA_SSIZE
+#define SP_ARGS GA_BUFFER, GA_SIZE, GA_BUFFER, GA_SIZE, GA_BUFFER, GA_SIZE
+
+static const int sk_scale_args[] = {MAT_ARGS, GA_SIZE, GA_SIZE, T_ARG, -1};
+static const int sk_csr_vector_args[] = {SP_ARGS, VEC_ARGS, VEC_ARGS,
+                                         GA_SIZE, T_ARG, T_ARG, -1};
+static const int sk_merge_path_args[] = {SP_ARGS, VEC_ARGS, VEC_ARGS,
+                                         GA_SIZE, GA_SIZE, T_ARG, -1};
+static const int sk_coo_spmv_args[] = {SP_ARGS, VEC_ARGS, VEC_ARGS,
+                                       GA_SIZE, T_ARG, -1};
+static const int sk_csr_spmm_args[] = {SP_ARGS, MAT_ARGS, MAT_ARGS,
+                                       GA_SIZE, GA_SIZE, T_ARG, T_ARG, -1};
+static const int sk_coo_spmm_args[] = {SP_ARGS, MAT_ARGS, MAT_ARGS,
+                                       GA_SIZE, GA_SIZE, T_ARG, -1};
+static const int sk_dense_count_args[] = {MAT_ARGS, GA_SIZE, GA_SIZE,
+                                          GA_BUFFER, GA_SIZE, -1};
+static const int sk_dense_fill_args[] = {MAT_ARGS, GA_SIZE, GA_SIZE,
+                                         GA_BUFFER, GA_SIZE,
+                                         GA_BUFFER, GA_SIZE,
+                                         GA_BUFFER, GA_SIZE, -1};
+static const int sk_csr_expand_args[] = {GA_BUFFER, GA_SIZE,
+                                         GA_BUFFER, GA_SIZE, GA_SIZE, -1};
+static const int sk_check_index_args[] = {GA_BUFFER, GA_SIZE, GA_SIZE,
+                                          GA_SIZE, GA_BUFFER, GA_SIZE, -1};
+
+static const struct {
+  const char *name;
+  const tmpl *t;
+  const int *args;
+} sk_info[SK_COUNT] = {
+  {"sparse_scale", &tmpl_sparse_scale, sk_scale_args},
+  {"csr_vector", &tmpl_sparse_csr_vector, sk_csr_vector_args},
+  {"merge_path", &tmpl_sparse_merge_path, sk_merge_path_args},
+  {"coo_spmv", &tmpl_sparse_coo_spmv, sk_coo_spmv_args},
+  {"csr_spmm", &tmpl_sparse_csr_spmm, sk_csr_spmm_args},
+  {"coo_spmm", &tmpl_sparse_coo_spmm, sk_coo_spmm_args},
+  {"dense_count", &tmpl_sparse_dense_count, sk_dense_count_args},
+  {"dense_fill", &tmpl_sparse_dense_fill, sk_dense_fill_args},
+  {"csr_expand", &tmpl_sparse_csr_expand, sk_csr_expand_args},
+  {"check_index", &tmpl_sparse_check_index, sk_check_index_args},
+};
+
+struct sparse_args {
+  gpucontext *ctx;
+  int kind;
+  int T;
+  int I;
+  unsigned int p0;
+  unsigned int p1;
+};
+
+static int gen_sparse_src(void *data, char **src, size_t *len) {
+  struct sparse_args *a = data;
+  const tmpl *t = sk_info[a->kind].t;
+  strb sb = STRB_STATIC_INIT;
+
+  strb_ensure(&sb, tmpl_sparse_head.len + t->len + 64);
+  tmpl_render(&sb, &tmpl_sparse_head, a->T, a->I,
+              a->T == GA_FLOAT ? "atom_add_fg" : "atom_add_dg");
+  switch (a->kind) {
+  case SK_CSR_VECTOR:
+    tmpl_render(&sb, t, a->p0, a->p1);
+    break;
+  case SK_MERGE_PATH:
+    tmpl_render(&sb, t, a->p0);
+    break;
+  default:
+    tmpl_render(&sb, t);
+  }
+  if (strb_error(&sb)) {
+    strb_clear(&sb);
+    return error_set(a->ctx->err, GA_MEMORY_ERROR, "Out of memory");
+  }
+  *src = sb.s;
+  *len = sb.l;
+  return GA_NO_ERROR;
+}
+
+static int sparse_kernel(GpuKernel *k, gpucontext *ctx, int kind, int T,
+                         int I, unsigned int p0, unsigned int p1) {
+  struct sparse_args a;
+  int types[SK_MAXARGS];
+  int key[5];
+  const int *args = sk_info[kind].args;
+  unsigned int n;
+#if DEBUG
+  char *errstr = NULL;
+#endif
+  int err;
+
+  for (n = 0; args[n] != -1; n++) {
+    assert(n < SK_MAXARGS);
+    types[n] = (args[n] == T_ARG) ? T : args[n];
+  }
+
+  key[0] = kind;
+  key[1] = T;
+  key[2] = I;
+  key[3] = p0;
+  key[4] = p1;
+  a.ctx = ctx;
+  a.kind = kind;
+  a.T = T;
+  a.I = I;
+  a.p0 = p0;
+  a.p1 = p1;
+
+  err = GpuKernel_init_keyed(k, ctx, key, sizeof(key), gen_sparse_src, &a,
+                             sk_info[kind].name, n, types,
+                             gpuarray_type_flags(T, I, -1),
+#if DEBUG
+                             &errstr
+#else
+                             NULL
+#endif
+                             );
+#if DEBUG
+  if (errstr != NULL) {
+    fprintf(stderr, "%s\n", errstr);
+    free(errstr);
+  }
+#endif
+  return err;
+}
+
+/* Launch over n items, with a block size of ls if not 0 */
+static int sparse_call1(GpuKernel *k, size_t n, size_t ls, void **args) {
+  size_t gs = 0;
+  int err;
+
+  if (n == 0)
+    return GA_NO_ERROR;
+  err = GpuKernel_sched(k, n, &gs, &ls);
+  if (err != GA_NO_ERROR)
+    return err;
+  return GpuKernel_call(k, 1, &gs, &ls, 0, args);
+}
+
+/*
+ * Launch over n0 x n1 items.  Consecutive threads go over dimension 0
+ * (the columns of the dense matrices), so it gets up to a warp.
+ */
+static int sparse_call2(GpuKernel *k, size_t n0, size_t n1, void **args) {
+  size_t gs[2], ls[2];
+  size_t g = 0, l = 0, pl;
+  int err;
+
+  if (n0 == 0 || n1 == 0)
+    return GA_NO_ERROR;
+  err = GpuKernel_sched(k, n0 * n1, &g, &l);
+  if (err != GA_NO_ERROR)
+    return err;
+  err = gpukernel_property(k->k, GA_KERNEL_PROP_PREFLSIZE, &pl);
+  if (err != GA_NO_ERROR)
+    return err;
+  ls[0] = (pl < l) ? pl : l;
+  while (ls[0] > 1 && ls[0] / 2 >= n0)
+    ls[0] /= 2;
+  ls[1] = l / ls[0];
+  if (ls[1] == 0)
+    ls[1] = 1;
+  gs[0] = (n0 + ls[0] - 1) / ls[0];
+  if (gs[0] > g)
+    gs[0] = g;
+  gs[1] = g / gs[0];
+  if (gs[1] > (n1 + ls[1] - 1) / ls[1])
+    gs[1] = (n1 + ls[1] - 1) / ls[1];
+  if (gs[1] == 0)
+    gs[1] = 1;
+  return GpuKernel_call(k, 2, gs, ls, 0, args);
+}
+
+typedef union _sparse_scalar {
+  float f;
+  double d;
+} sparse_scalar;
+
+static void *sparse_scalar_set(sparse_scalar *s, int T, double v) {
+  if (T == GA_FLOAT) {
+    s->f = (float)v;
+    return &s->f;
+  }
+  s->d = v;
+  return &s->d;
+}
+
+/* Stride of dimension i of a in elements */
+static int elem_stride(gpucontext *ctx, const GpuArray *a, unsigned int i,
+                       ssize_t *s) {
+  ssize_t elsize = gpuarray_get_elsize(a->typecode);
+  if (a->strides[i] % elsize != 0)
+    return error_set(ctx->err, GA_UNALIGNED_ERROR,
+                     "Stride is not a multiple of the element size");
+  *s = a->strides[i] / elsize;
+  return GA_NO_ERROR;
+}
+
+static int check_part(gpucontext *ctx, const GpuArray *a, const char *name,
+                      int typecode, size_t n) {
+  if (GpuArray_context(a) != ctx)
+    return error_fmt(ctx->err, GA_VALUE_ERROR,
+                     "%s is not in the context of data", name);
+  if (a->typecode != typecode)
+    return error_fmt(ctx->err, GA_VALUE_ERROR, "Wrong type for %s", name);
+  if (a->nd != 1 || a->dimensions[0] != n)
+    return error_fmt(ctx->err, GA_VALUE_ERROR,
+                     "Shape mismatch for %s: expected (%llu,)", name,
+                     (unsigned long long)n);
+  if (!GpuArray_IS_C_CONTIGUOUS(a))
+    return error_fmt(ctx->err, GA_VALUE_ERROR, "%s is not contiguous", name);
+  return GA_NO_ERROR;
+}
+
+static int check_types(gpucontext *ctx, int T, int I) {
+  if (T != GA_FLOAT && T != GA_DOUBLE)
+    return error_set(ctx->err, GA_INVALID_ERROR, "Unsupported dtype");
+  if (I != GA_INT && I != GA_LONG)
+    return error_set(ctx->err, GA_INVALID_ERROR,
+                     "Indices must be int32 or int64");
+  return GA_NO_ERROR;
+}
+
+/*
+ * Make sure the stored indices fit in the index type.  The rows only
+ * appear in the indices for COO.
+ */
+static int check_dims(gpucontext *ctx, int I, int format, size_t rows,
+                      size_t cols) {
+  size_t max = (I == GA_INT) ? INT32_MAX : (size_t)INT64_MAX;
+
+  if (cols > max || (format == GA_SPARSE_COO && rows > max))
+    return error_set(ctx->err, GA_XLARGE_ERROR,
+                     I == GA_INT ? "Shape too large for int32 indices" :
+                     "Shape too large for int64 indices");
+  return GA_NO_ERROR;
+}
+
+/*
+ * Make sure all the indices in idx are below bound.  The kernels
+ * index the dense arrays and do atomic adds with them unchecked.
+ */
+static int check_index(gpucontext *ctx, int T, const GpuArray *idx,
+                       size_t bound, const char *name) {
+  GpuArray bad;
+  GpuKernel k;
+  void *args[6];
+  size_t n = idx->dimensions[0], one = 1;
+  int32_t h = 0;
+  int err;
+
+  if (n == 0)
+    return GA_NO_ERROR;
+  err = GpuArray_empty(&bad, ctx, GA_INT, 1, &one, GA_C_ORDER);
+  if (err != GA_NO_ERROR)
+    return err;
+  err = GpuArray_write(&bad, &h, sizeof(h));
+  if (err == GA_NO_ERROR)
+    err = sparse_kernel(&k, ctx, SK_CHECK_INDEX, T, idx->typecode, 0, 0);
+  if (err == GA_NO_ERROR) {
+    args[0] = idx->data;
+    args[1] = (void *)&idx->offset;
+    args[2] = &n;
+    args[3] = &bound;
+    args[4] = bad.data;
+    args[5] = &bad.offset;
+    err = sparse_call1(&k, n, 0, args);
+    GpuKernel_clear(&k);
+  }
+  if (err == GA_NO_ERROR)
+    err = GpuArray_read(&h, sizeof(h), &bad);
+  GpuArray_clear(&bad);
+  if (err == GA_NO_ERROR && h != 0)
+    err = error_fmt(ctx->err, GA_VALUE_ERROR, "%s out of range", name);
+  return err;
+}
+
+/* Set the row statistics from a host copy of ptr */
+static int csr_stats(gpucontext *ctx, GpuSparse *s, const void *h) {
+  size_t i, prev, cur;
+
+  prev = 0;
+  s->max_row = 0;
+  for (i = 0; i <= s->rows; i++) {
+    if (s->ptr.typecode == GA_INT) {
+      if (((const int32_t *)h)[i] < 0)
+        goto bad;
+      cur = ((const int32_t *)h)[i];
+    } else {
+      if (((const int64_t *)h)[i] < 0)
+        goto bad;
+      cur = ((const int64_t *)h)[i];
+    }
+    if (cur < prev || (i == 0 && cur != 0))
+      goto bad;
+    if (cur - prev > s->max_row)
+      s->max_row = cur - prev;
+    prev = cur;
+  }
+  if (prev != s->nnz)
+    goto bad;
+  return GA_NO_ERROR;
+ bad:
+  return error_set(ctx->err, GA_VALUE_ERROR,
+                   "indptr must go from 0 to nnz without decreasing");
+}
+
+int GpuSparse_csr(GpuSparse *s, const GpuArray *data,
+                  const GpuArray *indices, const GpuArray *indptr,
+                  size_t rows, size_t cols) {
+  gpucontext *ctx = GpuArray_context(data);
+  size_t len;
+  void *h;
+  int err;
+
+  memset(s, 0, sizeof(*s));
+  err = check_types(ctx, data->typecode, indices->typecode);
+  if (err != GA_NO_ERROR)
+    return err;
+  if (data->nd != 1)
+    return error_set(ctx->err, GA_VALUE_ERROR, "data must be 1d");
+  s->nnz = data->dimensions[0];
+  err = check_part(ctx, data, "data", data->typecode, s->nnz);
+  if (err == GA_NO_ERROR)
+    err = check_part(ctx, indices, "indices", indices->typecode, s->nnz);
+  if (err == GA_NO_ERROR)
+    err = check_part(ctx, indptr, "indptr", indices->typecode, rows + 1);
+  if (err == GA_NO_ERROR)
+    err = check_dims(ctx, indices->typecode, GA_SPARSE_CSR, rows, cols);
+  if (err != GA_NO_ERROR)
+    return err;
+
+  s->rows = rows;
+  s->cols = cols;
+  s->format = GA_SPARSE_CSR;
+  err = GpuArray_view(&s->data, data);
+  if (err == GA_NO_ERROR)
+    err = GpuArray_view(&s->indices, indices);
+  if (err == GA_NO_ERROR)
+    err = GpuArray_view(&s->ptr, indptr);
+  if (err != GA_NO_ERROR)
+    goto fail;
+
+  len = (rows + 1) * gpuarray_get_elsize(indptr->typecode);
+  h = malloc(len);
+  if (h == NULL) {
+    err = error_sys(ctx->err, "malloc");
+    goto fail;
+  }
+  err = GpuArray_read(h, len, indptr);
+  if (err == GA_NO_ERROR)
+    err = csr_stats(ctx, s, h);
+  free(h);
+  if (err == GA_NO_ERROR)
+    err = check_index(ctx, data->typecode, indices, cols, "indices");
+  if (err != GA_NO_ERROR)
+    goto fail;
+  return GA_NO_ERROR;
+ fail:
+  GpuSparse_clear(s);
+  return err;
+}
+
+int GpuSparse_coo(GpuSparse *s, const GpuArray *data, const GpuArray *row,
+                  const GpuArray *col, size_t rows, size_t cols) {
+  gpucontext *ctx = GpuArray_context(data);
+  int err;
+
+  memset(s, 0, sizeof(*s));
+  err = check_types(ctx, data->typecode, col->typecode);
+  if (err != GA_NO_ERROR)
+    return err;
+  if (data->nd != 1)
+    return error_set(ctx->err, GA_VALUE_ERROR, "data must be 1d");
+  s->nnz = data->dimensions[0];
+  err = check_part(ctx, data, "data", data->typecode, s->nnz);
+  if (err == GA_NO_ERROR)
+    err = check_part(ctx, col, "col", col->typecode, s->nnz);
+  if (err == GA_NO_ERROR)
+    err = check_part(ctx, row, "row", col->typecode, s->nnz);
+  if (err == GA_NO_ERROR)
+    err = check_dims(ctx, col->typecode, GA_SPARSE_COO, rows, cols);
+  if (err == GA_NO_ERROR)
+    err = check_index(ctx, data->typecode, col, cols, "col");
+  if (err == GA_NO_ERROR)
+    err = check_index(ctx, data->typecode, row, rows, "row");
+  if (err != GA_NO_ERROR)
+    return err;
+
+  s->rows = rows;
+  s->cols = cols;
+  s->format = GA_SPARSE_COO;
+  err = GpuArray_view(&s->data, data);
+  if (err == GA_NO_ERROR)
+    err = GpuArray_view(&s->indices, col);
+  if (err == GA_NO_ERROR)
+    err = GpuArray_view(&s->ptr, row);
+  if (err != GA_NO_ERROR)
+    GpuSparse_clear(s);
+  return err;
+}
+
+/* Turn the row counts in h[1:] into row starts */
+static int csr_scan(gpucontext *ctx, void *h, int I, size_t rows,
+                    size_t *nnz, size_t *max_row) {
+  size_t i, c, run = 0;
+
+  *max_row = 0;
+  for (i = 1; i <= rows; i++) {
+    if (I == GA_INT) {
+      c = ((int32_t *)h)[i];
+      if (run + c > INT32_MAX)
+        return error_set(ctx->err, GA_VALUE_ERROR,
+                         "Too many elements for int32 indices");
+      ((int32_t *)h)[i] = (int32_t)(run + c);
+    } else {
+      c = ((int64_t *)h)[i];
+      ((int64_t *)h)[i] = (int64_t)(run + c);
+    }
+    if (c > *max_row)
+      *max_row = c;
+    run += c;
+  }
+  if (I == GA_INT)
+    ((int32_t *)h)[0] = 0;
+  else
+    ((int64_t *)h)[0] = 0;
+  *nnz = run;
+  return GA_NO_ERROR;
+}
+
+int GpuSparse_from_dense(GpuSparse *s, const GpuArray *a, int format,
+                         int idxcode) {
+  gpucontext *ctx = GpuArray_context(a);
+  GpuArray ptr, row;
+  GpuKernel k;
+  void *args[12];
+  void *h = NULL;
+  size_t rows, cols, len, cnt_off;
+  ssize_t s0, s1;
+  int err;
+
+  memset(s, 0, sizeof(*s));
+  memset(&ptr, 0, sizeof(ptr));
+  memset(&row, 0, sizeof(row));
+  err = check_types(ctx, a->typecode, idxcode);
+  if (err != GA_NO_ERROR)
+    return err;
+  if (format != GA_SPARSE_CSR && format != GA_SPARSE_COO)
+    return error_set(ctx->err, GA_VALUE_ERROR, "Unknown sparse format");
+  if (a->nd != 2)
+    return error_set(ctx->err, GA_VALUE_ERROR, "Dense array must be 2d");
+  if (!GpuArray_ISALIGNED(a))
+    return error_set(ctx->err, GA_UNALIGNED_ERROR, "Unaligned input");
+  err = elem_stride(ctx, a, 0, &s0);
+  if (err == GA_NO_ERROR)
+    err = elem_stride(ctx, a, 1, &s1);
+  if (err != GA_NO_ERROR)
+    return err;
+
+  rows = a->dimensions[0];
+  cols = a->dimensions[1];
+  err = check_dims(ctx, idxcode, format, rows, cols);
+  if (err != GA_NO_ERROR)
+    return err;
+  s->rows = rows;
+  s->cols = cols;
+  s->format = format;
+  len = rows + 1;
+  err = GpuArray_empty(&ptr, ctx, idxcode, 1, &len, GA_C_ORDER);
+  if (err != GA_NO_ERROR)
+    return err;
+
+  /* Count the elements of each row into ptr[1:] */
+  err = sparse_kernel(&k, ctx, SK_DENSE_COUNT, a->typecode, idxcode, 0, 0);
+  if (err != GA_NO_ERROR)
+    goto fail;
+  cnt_off = ptr.offset + gpuarray_get_elsize(idxcode);
+  args[0] = a->data;
+  args[1] = (void *)&a->offset;
+  args[2] = &s0;
+  args[3] = &s1;
+  args[4] = &rows;
+  args[5] = &cols;
+  args[6] = ptr.data;
+  args[7] = &cnt_off;
+  err = sparse_call1(&k, rows, 0, args);
+  GpuKernel_clear(&k);
+  if (err != GA_NO_ERROR)
+    goto fail;
+
+  /* The scan over rows is cheap enough on the host */
+  len = (rows + 1) * gpuarray_get_elsize(idxcode);
+  h = calloc(1, len);
+  if (h == NULL) {
+    err = error_sys(ctx->err, "calloc");
+    goto fail;
+  }
+  if (rows != 0)
+    err = gpudata_read((char *)h + gpuarray_get_elsize(idxcode), ptr.data,
+                       cnt_off, len - gpuarray_get_elsize(idxcode));
+  if (err == GA_NO_ERROR)
+    err = csr_scan(ctx, h, idxcode, rows, &s->nnz, &s->max_row);
+  if (err == GA_NO_ERROR)
+    err = GpuArray_write(&ptr, h, len);
+  free(h);
+  if (err != GA_NO_ERROR)
+    goto fail;
+
+  err = GpuArray_empty(&s->data, ctx, a->typecode, 1, &s->nnz, GA_C_ORDER);
+  if (err == GA_NO_ERROR)
+    err = GpuArray_empty(&s->indices, ctx, idxcode, 1, &s->nnz, GA_C_ORDER);
+  if (err != GA_NO_ERROR)
+    goto fail;
+
+  err = sparse_kernel(&k, ctx, SK_DENSE_FILL, a->typecode, idxcode, 0, 0);
+  if (err != GA_NO_ERROR)
+    goto fail;
+  args[6] = ptr.data;
+  args[7] = &ptr.offset;
+  args[8] = s->data.data;
+  args[9] = &s->data.offset;
+  args[10] = s->indices.data;
+  args[11] = &s->indices.offset;
+  err = sparse_call1(&k, rows, 0, args);
+  GpuKernel_clear(&k);
+  if (err != GA_NO_ERROR)
+    goto fail;
+
+  if (format == GA_SPARSE_CSR) {
+    s->ptr = ptr;
+    return GA_NO_ERROR;
+  }
+
+  err = GpuArray_empty(&row, ctx, idxcode, 1, &s->nnz, GA_C_ORDER);
+  if (err != GA_NO_ERROR)
+    goto fail;
+  err = sparse_kernel(&k, ctx, SK_CSR_EXPAND, a->typecode, idxcode, 0, 0);
+  if (err != GA_NO_ERROR)
+    goto fail;
+  args[0] = ptr.data;
+  args[1] = &ptr.offset;
+  args[2] = row.data;
+  args[3] = &row.offset;
+  args[4] = &rows;
+  err = sparse_call1(&k, rows, 0, args);
+  GpuKernel_clear(&k);
+  if (err != GA_NO_ERROR)
+    goto fail;
+  GpuArray_clear(&ptr);
+  s->ptr = row;
+  s->max_row = 0;
+  return GA_NO_ERROR;
+ fail:
+  GpuArray_clear(&row);
+  GpuArray_clear(&ptr);
+  GpuSparse_clear(s);
+  return err;
+}
+
+void GpuSparse_clear(GpuSparse *s) {
+  GpuArray_clear(&s->data);
+  GpuArray_clear(&s->indices);
+  GpuArray_clear(&s->ptr);
+  memset(s, 0, sizeof(*s));
+}
+
+int GpuSparse_spmv_algo(const GpuSparse *s) {
+  size_t mean;
+
+  if (s->format == GA_SPARSE_COO)
+    return GA_SPMV_COO;
+  if (s->rows == 0)
+    return GA_SPMV_CSR_VECTOR;
+  mean = (s->nnz + s->rows - 1) / s->rows;
+  if (s->max_row > 16 * mean + 64)
+    return GA_SPMV_MERGE_PATH;
+  return GA_SPMV_CSR_VECTOR;
+}
+
+/* Threads per row for CSR-vector: the mean row length rounded up */
+static unsigned int vector_width(const GpuSparse *s) {
+  unsigned int w = 1;
+  size_t mean;
+
+  if (s->rows == 0)
+    return 1;
+  mean = (s->nnz + s->rows - 1) / s->rows;
+  while (w < mean && w < VECTOR_MAX_WIDTH)
+    w *= 2;
+  return w;
+}
+
+/* Scale the n0 x n1 array y by beta */
+static int sparse_scale(gpucontext *ctx, GpuArray *y, size_t n0, size_t n1,
+                        ssize_t s0, ssize_t s1, double beta) {
+  GpuKernel k;
+  sparse_scalar b;
+  void *args[7];
+  int err;
+
+  if (beta == 1.0)
+    return GA_NO_ERROR;
+  err = sparse_kernel(&k, ctx, SK_SCALE, y->typecode, GA_INT, 0, 0);
+  if (err != GA_NO_ERROR)
+    return err;
+  args[0] = y->data;
+  args[1] = &y->offset;
+  args[2] = &s0;
+  args[3] = &s1;
+  args[4] = &n0;
+  args[5] = &n1;
+  args[6] = sparse_scalar_set(&b, y->typecode, beta);
+  err = sparse_call1(&k, n0 * n1, 0, args);
+  GpuKernel_clear(&k);
+  return err;
+}
+
+static int check_dense(gpucontext *ctx, const GpuSparse *s, const GpuArray *a,
+                       const char *name, unsigned int nd, size_t d0) {
+  if (GpuArray_context(a) != ctx)
+    return error_fmt(ctx->err, GA_VALUE_ERROR,
+                     "%s is not in the context of the sparse matrix", name);
+  if (a->typecode != s->data.typecode)
+    return error_set(ctx->err, GA_VALUE_ERROR, "Inconsistent dtypes");
+  if (a->nd != nd || a->dimensions[0] != d0)
+    return error_fmt(ctx->err, GA_VALUE_ERROR, "Shape mismatch for %s",
+                     name);
+  if (!GpuArray_ISALIGNED(a))
+    return error_fmt(ctx->err, GA_UNALIGNED_ERROR, "%s is unaligned", name);
+  return GA_NO_ERROR;
+}
+
+int GpuSparse_spmv(double alpha, const GpuSparse *s, const GpuArray *x,
+                   double beta, GpuArray *y, int algo) {
+  gpucontext *ctx = GpuArray_context(&s->data);
+  GpuKernel k;
+  sparse_scalar a, b;
+  void *args[15];
+  ssize_t xs, ys, zero = 0;
+  size_t ls, maxl, rows = s->rows, nnz = s->nnz;
+  unsigned int w;
+  int err;
+
+  err = check_dense(ctx, s, x, "x", 1, s->cols);
+  if (err == GA_NO_ERROR)
+    err = check_dense(ctx, s, y, "y", 1, s->rows);
+  if (err != GA_NO_ERROR)
+    return err;
+  if (!GpuArray_ISWRITEABLE(y))
+    return error_set(ctx->err, GA_VALUE_ERROR, "y is not writeable");
+  err = elem_stride(ctx, x, 0, &xs);
+  if (err == GA_NO_ERROR)
+    err = elem_stride(ctx, y, 0, &ys);
+  if (err != GA_NO_ERROR)
+    return err;
+
+  if (algo == GA_SPMV_AUTO)
+    algo = GpuSparse_spmv_algo(s);
+  if ((algo == GA_SPMV_COO) != (s->format == GA_SPARSE_COO))
+    return error_set(ctx->err, GA_VALUE_ERROR,
+                     "SpMV algorithm does not match the format");
+
+  if (algo != GA_SPMV_CSR_VECTOR || nnz == 0 || alpha == 0.0) {
+    err = sparse_scale(ctx, y, rows, 1, ys, zero, beta);
+    if (err != GA_NO_ERROR || nnz == 0 || alpha == 0.0)
+      return err;
+  }
+
+  args[0] = s->data.data;
+  args[1] = (void *)&s->data.offset;
+  args[2] = s->indices.data;
+  args[3] = (void *)&s->indices.offset;
+  args[4] = s->ptr.data;
+  args[5] = (void *)&s->ptr.offset;
+  args[6] = x->data;
+  args[7] = (void *)&x->offset;
+  args[8] = &xs;
+  args[9] = y->data;
+  args[10] = &y->offset;
+  args[11] = &ys;
+
+  switch (algo) {
+  case GA_SPMV_CSR_VECTOR:
+    err = gpucontext_property(ctx, GA_CTX_PROP_MAXLSIZE0, &maxl);
+    if (err != GA_NO_ERROR)
+      return err;
+    ls = VECTOR_BLOCK;
+    while (ls > maxl && ls > 1)
+      ls /= 2;
+    w = vector_width(s);
+    if (w > ls)
+      w = (unsigned int)ls;
+    err = sparse_kernel(&k, ctx, SK_CSR_VECTOR, s->data.typecode,
+                        s->indices.typecode, w, (unsigned int)ls);
+    if (err != GA_NO_ERROR)
+      return err;
+    args[12] = &rows;
+    args[13] = sparse_scalar_set(&a, s->data.typecode, alpha);
+    args[14] = sparse_scalar_set(&b, s->data.typecode, beta);
+    err = sparse_call1(&k, rows * w, ls, args);
+    break;
+  case GA_SPMV_MERGE_PATH:
+    err = sparse_kernel(&k, ctx, SK_MERGE_PATH, s->data.typecode,
+                        s->indices.typecode, MERGE_ITEMS, 0);
+    if (err != GA_NO_ERROR)
+      return err;
+    args[12] = &rows;
+    args[13] = &nnz;
+    args[14] = sparse_scalar_set(&a, s->data.typecode, alpha);
+    err = sparse_call1(&k, (rows + nnz + MERGE_ITEMS - 1) / MERGE_ITEMS, 0,
+                       args);
+    break;
+  case GA_SPMV_COO:
+    err = sparse_kernel(&k, ctx, SK_COO_SPMV, s->data.typecode,
+                        s->indices.typecode, 0, 0);
+    if (err != GA_NO_ERROR)
+      return err;
+    args[12] = &nnz;
+    args[13] = sparse_scalar_set(&a, s->data.typecode, alpha);
+    err = sparse_call1(&k, nnz, 0, args);
+    break;
+  default:
+    return error_set(ctx->err, GA_VALUE_ERROR, "Unknown SpMV algorithm");
+  }
+  GpuKernel_clear(&k);
+  return err;
+}
+
+int GpuSparse_spmm(double alpha, const GpuSparse *s, const GpuArray *B,
+                   double beta, GpuArray *C) {
+  gpucontext *ctx = GpuArray_context(&s->data);
+  GpuKernel k;
+  sparse_scalar a, b;
+  void *args[18];
+  ssize_t bs0, bs1, cs0, cs1;
+  size_t rows = s->rows, nnz = s->nnz, kc;
+  int err;
+
+  err = check_dense(ctx, s, B, "B", 2, s->cols);
+  if (err == GA_NO_ERROR)
+    err = check_dense(ctx, s, C, "C", 2, s->rows);
+  if (err != GA_NO_ERROR)
+    return err;
+  if (B->dimensions[1] != C->dimensions[1])
+    return error_set(ctx->err, GA_VALUE_ERROR, "Shape mismatch for C");
+  if (!GpuArray_ISWRITEABLE(C))
+    return error_set(ctx->err, GA_VALUE_ERROR, "C is not writeable");
+  err = elem_stride(ctx, B, 0, &bs0);
+  if (err == GA_NO_ERROR)
+    err = elem_stride(ctx, B, 1, &bs1);
+  if (err == GA_NO_ERROR)
+    err = elem_stride(ctx, C, 0, &cs0);
+  if (err == GA_NO_ERROR)
+    err = elem_stride(ctx, C, 1, &cs1);
+  if (err != GA_NO_ERROR)
+    return err;
+  kc = C->dimensions[1];
+
+  if (s->format == GA_SPARSE_COO || nnz == 0 || alpha == 0.0) {
+    err = sparse_scale(ctx, C, rows, kc, cs0, cs1, beta);
+    if (err != GA_NO_ERROR || nnz == 0 || alpha == 0.0)
+      return err;
+  }
+
+  err = sparse_kernel(&k, ctx,
+                      s->format == GA_SPARSE_CSR ? SK_CSR_SPMM : SK_COO_SPMM,
+                      s->data.typecode, s->indices.typecode, 0, 0);
+  if (err != GA_NO_ERROR)
+    return err;
+  args[0] = s->data.data;
+  args[1] = (void *)&s->data.offset;
+  args[2] = s->indices.data;
+  args[3] = (void *)&s->indices.offset;
+  args[4] = s->ptr.data;
+  args[5] = (void *)&s->ptr.offset;
+  args[6] = B->data;
+  args[7] = (void *)&B->offset;
+  args[8] = &bs0;
+  args[9] = &bs1;
+  args[10] = C->data;
+  args[11] = &C->offset;
+  args[12] = &cs0;
+  args[13] = &cs1;
+  args[15] = &kc;
+  args[16] = sparse_scalar_set(&a, s->data.typecode, alpha);
+  if (s->format == GA_SPARSE_CSR) {
+    args[14] = &rows;
+    args[17] = sparse_scalar_set(&b, s->data.typecode, beta);
+    err = sparse_call2(&k, kc, rows, args);
+  } else {
+    args[14] = &nnz;
+    err = sparse_call2(&k, kc, nnz, args);
+  }
+  GpuKernel_clear(&k);
+  return err;
+}
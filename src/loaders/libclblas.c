@@ -23,7 +23,7 @@ static const char libname[] = "libclBLAS.so";
 #define DEF_PROC(ret, name, args)                 \
   name = (t##name *)ga_func_ptr(lib, #name, e);   \
   if (name == NULL) {                             \
-    return e->code;                               \
+    return error_code(e);                         \
   }
 
 static int loaded = 0;
@@ -36,7 +36,7 @@ int load_libclblas(error *e) {
 
   lib = ga_load_library(libname, e);
   if (lib == NULL)
-    return e->code;
+    return error_code(e);
 
   #include "libclblas.fn"
 
@@ -20,7 +20,7 @@
 #define DEF_PROC(name, args)                      \
   name = (t##name *)ga_func_ptr(lib, #name, e);   \
   if (name == NULL) {                             \
-    return e->code;                               \
+    return error_code(e);                         \
   }
 
 #define DEF_PROC_OPT(name, args)                \
@@ -29,7 +29,7 @@
 #define DEF_PROC_V2(name, args)                                   \
   name = (t##name *)ga_func_ptr(lib, STRINGIFY(name##_v2), e);    \
   if (name == NULL) {                                             \
-    return e->code;                                               \
+    return error_code(e);                                         \
   }
 
 static int loaded = 0;
@@ -70,7 +70,7 @@ int load_libcublas(int major, int minor, error *e) {
 #endif
 #endif
   if (lib == NULL)
-    return e->code;
+    return error_code(e);
 
 #include "libcublas.fn"
 
@@ -7,6 +7,14 @@ typedef struct {//__align__(2) {
   unsigned short x;
 } __half;
 
+typedef struct {
+  float x, y;
+} cuComplex;
+
+typedef struct {
+  double x, y;
+} cuDoubleComplex;
+
 
 /** @cond NEVER */
 
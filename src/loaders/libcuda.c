@@ -19,9 +19,11 @@ static char libname[] = "libcuda.so";
 
 #define DEF_PROC(name, args) t##name *name
 #define DEF_PROC_V2(name, args) DEF_PROC(name, args)
+#define DEF_PROC_OPT(name, args) DEF_PROC(name, args)
 
 #include "libcuda.fn"
 
+#undef DEF_PROC_OPT
 #undef DEF_PROC_V2
 #undef DEF_PROC
 
@@ -30,15 +32,19 @@ static char libname[] = "libcuda.so";
 #define DEF_PROC(name, args)                    \
   name = (t##name *)ga_func_ptr(lib, #name, e); \
   if (name == NULL) {                           \
-    return e->code;                             \
+    return error_code(e);                       \
   }
 
 #define DEF_PROC_V2(name, args)                                \
   name = (t##name *)ga_func_ptr(lib, STRINGIFY(name##_v2), e); \
   if (name == NULL) {                                          \
-    return e->code;                                            \
+    return error_code(e);                                      \
   }
 
+/* Optional entry points are left NULL when the driver is too old */
+#define DEF_PROC_OPT(name, args)                \
+  name = (t##name *)ga_func_ptr(lib, #name, e);
+
 static int loaded = 0;
 
 int load_libcuda(error *e) {
@@ -49,10 +55,11 @@ int load_libcuda(error *e) {
 
   lib = ga_load_library(libname, e);
   if (lib == NULL)
-    return e->code;
+    return error_code(e);
 
   #include "libcuda.fn"
 
+  error_set(e, GA_NO_ERROR, "No error");
   loaded = 1;
   return GA_NO_ERROR;
 }
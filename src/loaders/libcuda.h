@@ -12,7 +12,9 @@
 #endif
 
 typedef enum {
-  CUDA_SUCCESS = 0
+  CUDA_SUCCESS = 0,
+  CUDA_ERROR_OUT_OF_MEMORY = 2,
+  CUDA_ERROR_PEER_ACCESS_ALREADY_ENABLED = 704
 } CUresult;
 
 #if defined(_WIN64) || defined(__LP64__)
@@ -28,6 +30,10 @@ typedef struct CUfunc_st *CUfunction;
 typedef struct CUevent_st *CUevent;
 typedef struct CUstream_st *CUstream;
 typedef struct CUlinkState_st *CUlinkState;
+typedef struct CUarray_st *CUarray;
+typedef struct CUgraph_st *CUgraph;
+typedef struct CUgraphNode_st *CUgraphNode;
+typedef struct CUgraphExec_st *CUgraphExec;
 
 typedef enum CUdevice_attribute_enum CUdevice_attribute;
 typedef enum CUfunction_attribute_enum CUfunction_attribute;
@@ -36,9 +42,17 @@ typedef enum CUctx_flags_enum CUctx_flags;
 typedef enum CUipcMem_flags_enum CUipcMem_flags;
 typedef enum CUjit_option_enum CUjit_option;
 typedef enum CUjitInputType_enum CUjitInputType;
+typedef enum CUmemorytype_enum CUmemorytype;
+typedef enum CUmem_advise_enum CUmem_advise;
+typedef struct CUDA_MEMCPY3D_st CUDA_MEMCPY3D;
+typedef struct CUDA_KERNEL_NODE_PARAMS_st CUDA_KERNEL_NODE_PARAMS;
+typedef struct CUDA_MEMSET_NODE_PARAMS_st CUDA_MEMSET_NODE_PARAMS;
 
 #define CU_IPC_HANDLE_SIZE 64
 
+#define CU_MEM_ATTACH_GLOBAL 0x1
+#define CU_DEVICE_CPU ((CUdevice)-1)
+
 typedef struct CUipcMemHandle_st {
   char reserved[CU_IPC_HANDLE_SIZE];
 } CUipcMemHandle;
@@ -51,17 +65,21 @@ int load_libcuda(error *);
 
 #define DEF_PROC(name, args) typedef CUresult CUDAAPI t##name args
 #define DEF_PROC_V2(name, args) DEF_PROC(name, args)
+#define DEF_PROC_OPT(name, args) DEF_PROC(name, args)
 
 #include "libcuda.fn"
 
+#undef DEF_PROC_OPT
 #undef DEF_PROC_V2
 #undef DEF_PROC
 
 #define DEF_PROC(name, args) extern t##name *name
 #define DEF_PROC_V2(name, args) DEF_PROC(name, args)
+#define DEF_PROC_OPT(name, args) DEF_PROC(name, args)
 
 #include "libcuda.fn"
 
+#undef DEF_PROC_OPT
 #undef DEF_PROC_V2
 #undef DEF_PROC
 
@@ -225,6 +243,74 @@ enum CUjitInputType_enum {
     CU_JIT_NUM_INPUT_TYPES
 };
 
+enum CUmemorytype_enum {
+  CU_MEMORYTYPE_HOST    = 0x01,
+  CU_MEMORYTYPE_DEVICE  = 0x02,
+  CU_MEMORYTYPE_ARRAY   = 0x03,
+  CU_MEMORYTYPE_UNIFIED = 0x04
+};
+
+enum CUmem_advise_enum {
+  CU_MEM_ADVISE_SET_READ_MOSTLY          = 1,
+  CU_MEM_ADVISE_UNSET_READ_MOSTLY        = 2,
+  CU_MEM_ADVISE_SET_PREFERRED_LOCATION   = 3,
+  CU_MEM_ADVISE_UNSET_PREFERRED_LOCATION = 4,
+  CU_MEM_ADVISE_SET_ACCESSED_BY          = 5,
+  CU_MEM_ADVISE_UNSET_ACCESSED_BY        = 6
+};
+
+struct CUDA_MEMCPY3D_st {
+  size_t srcXInBytes;
+  size_t srcY;
+  size_t srcZ;
+  size_t srcLOD;
+  CUmemorytype srcMemoryType;
+  const void *srcHost;
+  CUdeviceptr srcDevice;
+  CUarray srcArray;
+  void *reserved0;
+  size_t srcPitch;
+  size_t srcHeight;
+
+  size_t dstXInBytes;
+  size_t dstY;
+  size_t dstZ;
+  size_t dstLOD;
+  CUmemorytype dstMemoryType;
+  void *dstHost;
+  CUdeviceptr dstDevice;
+  CUarray dstArray;
+  void *reserved1;
+  size_t dstPitch;
+  size_t dstHeight;
+
+  size_t WidthInBytes;
+  size_t Height;
+  size_t Depth;
+};
+
+struct CUDA_KERNEL_NODE_PARAMS_st {
+  CUfunction func;
+  unsigned int gridDimX;
+  unsigned int gridDimY;
+  unsigned int gridDimZ;
+  unsigned int blockDimX;
+  unsigned int blockDimY;
+  unsigned int blockDimZ;
+  unsigned int sharedMemBytes;
+  void **kernelParams;
+  void **extra;
+};
+
+struct CUDA_MEMSET_NODE_PARAMS_st {
+  CUdeviceptr dst;
+  size_t pitch;
+  unsigned int value;
+  unsigned int elementSize;
+  size_t width;
+  size_t height;
+};
+
 /** @endcond */
 
 #endif
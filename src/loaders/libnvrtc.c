@@ -15,7 +15,7 @@
 #define DEF_PROC(rt, name, args)                  \
   name = (t##name *)ga_func_ptr(lib, #name, e);   \
   if (name == NULL) {                             \
-    return e->code;                               \
+    return error_code(e);                         \
   }
 
 static int loaded = 0;
@@ -57,7 +57,7 @@ int load_libnvrtc(int major, int minor, error *e) {
 #endif
 #endif
   if (lib == NULL)
-    return e->code;
+    return error_code(e);
 
   #include "libnvrtc.fn"
 
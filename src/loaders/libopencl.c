@@ -15,17 +15,23 @@ static char libname[] = "libOpenCL.so";
 #endif
 
 #define DEF_PROC(ret, name, args) t##name *name
+#define DEF_PROC_OPT(ret, name, args) DEF_PROC(ret, name, args)
 
 #include "libopencl.fn"
 
+#undef DEF_PROC_OPT
 #undef DEF_PROC
 
 #define DEF_PROC(ret, name, args)                 \
   name = (t##name *)ga_func_ptr(lib, #name, e);   \
   if (name == NULL) {                             \
-    return e->code;                               \
+    return error_code(e);                         \
   }
 
+/* Optional entry points are left NULL when the library is too old */
+#define DEF_PROC_OPT(ret, name, args)             \
+  name = (t##name *)ga_func_ptr(lib, #name, e);
+
 static int loaded = 0;
 
 int load_libopencl(error *e) {
@@ -36,7 +42,7 @@ int load_libopencl(error *e) {
 
   lib = ga_load_library(libname, e);
   if (lib == NULL)
-    return e->code;
+    return error_code(e);
 
   #include "libopencl.fn"
 
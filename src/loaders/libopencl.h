@@ -31,6 +31,9 @@ typedef unsigned __int64 cl_ulong;
 typedef unsigned __int16 cl_half;
 typedef float cl_float;
 typedef double cl_double;
+
+typedef union { cl_float s[2]; } cl_float2;
+typedef union { cl_double s[2]; } cl_double2;
 #else
 #include <stdint.h>
 typedef int32_t cl_int __attribute__((aligned(4)));
@@ -41,6 +44,9 @@ typedef uint64_t cl_ulong __attribute__((aligned(8)));
 typedef uint16_t cl_half __attribute__((aligned(2)));
 typedef float cl_float __attribute__((aligned(4)));
 typedef double cl_double __attribute__((aligned(8)));
+
+typedef union { cl_float __attribute__((aligned(8))) s[2]; } cl_float2;
+typedef union { cl_double __attribute__((aligned(16))) s[2]; } cl_double2;
 #endif
 
 typedef cl_uint cl_bool;
@@ -53,6 +59,7 @@ typedef intptr_t cl_context_properties;
 typedef cl_uint cl_context_info;
 typedef cl_uint cl_mem_info;
 typedef cl_bitfield cl_mem_flags;
+typedef cl_bitfield cl_mem_migration_flags;
 typedef cl_uint cl_program_info;
 typedef cl_uint cl_program_build_info;
 typedef cl_uint cl_kernel_info;
@@ -65,15 +72,19 @@ int load_libopencl(error *);
 /** @cond NEVER */
 
 #define DEF_PROC(ret, name, args) typedef ret CL_API_CALL t##name args
+#define DEF_PROC_OPT(ret, name, args) DEF_PROC(ret, name, args)
 
 #include "libopencl.fn"
 
+#undef DEF_PROC_OPT
 #undef DEF_PROC
 
 #define DEF_PROC(ret, name, args) extern t##name *name
+#define DEF_PROC_OPT(ret, name, args) DEF_PROC(ret, name, args)
 
 #include "libopencl.fn"
 
+#undef DEF_PROC_OPT
 #undef DEF_PROC
 
 /* What follows is a bunch of defines from the official OpenCL spec.
@@ -291,6 +302,10 @@ int load_libopencl(error *);
 #define CL_MEM_HOST_WRITE_ONLY                      (1 << 7)
 #define CL_MEM_HOST_READ_ONLY                       (1 << 8)
 #define CL_MEM_HOST_NO_ACCESS                       (1 << 9)
+
+/* cl_mem_migration_flags - bitfield */
+#define CL_MIGRATE_MEM_OBJECT_HOST                  (1 << 0)
+#define CL_MIGRATE_MEM_OBJECT_CONTENT_UNDEFINED     (1 << 1)
 #define CL_MEM_SVM_FINE_GRAIN_BUFFER                (1 << 10)   /* used by cl_svm_mem_flags only */
 #define CL_MEM_SVM_ATOMICS                          (1 << 11)   /* used by cl_svm_mem_flags only */
 #define CL_MEM_KERNEL_READ_AND_WRITE                (1 << 12)
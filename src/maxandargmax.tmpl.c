@@ -0,0 +1,303 @@
+/* Generated by tmpl.py from maxandargmax.tmpl, do not edit. */
+
+static const tmpl_part tmpl_maa_head_parts[] = {
+  {"#include \"cluda.h\"\n"
+   "/* Typedefs */\n"
+   "typedef ",
+   42, 0},
+  {"     T;/* The type of the array being processed. */\n"
+   "typedef ",
+   60, 1},
+  {"     X;/* Index type: signed 32/64-bit. */\n"
+   "\n"
+   "\n"
+   "\n"
+   "KERNEL void maxandargmax(const GLOBAL_MEM T*        src,\n"
+   "                         const X         srcOff,\n"
+   "                         const GLOBAL_MEM X*        srcSteps,\n"
+   "                         const GLOBAL_MEM X*        srcSize,\n"
+   "                         const GLOBAL_MEM X*        chunkSize,\n"
+   "                         GLOBAL_MEM T*              dstMax,\n"
+   "                         const X         dstMaxOff,\n"
+   "                         const GLOBAL_MEM X*        dstMaxSteps,\n"
+   "                         GLOBAL_MEM X*              dstArgmax,\n"
+   "                         const X         dstArgmaxOff,\n"
+   "                         const GLOBAL_MEM X*        dstArgmaxSteps){\n"
+   "\t/* Add offsets */\n"
+   "\tsrc       = (const GLOBAL_MEM T*)((const GLOBAL_MEM char*)src       + srcOff);\n"
+   "\tdstMax    = (GLOBAL_MEM T*)      ((GLOBAL_MEM char*)      dstMax    + dstMaxOff);\n"
+   "\tdstArgmax = (GLOBAL_MEM X*)      ((GLOBAL_MEM char*)      dstArgmax + dstArgmaxOff);\n"
+   "\t\n"
+   "\t\n"
+   "\t/* GPU kernel coordinates. Always 3D. */\n"
+   "\tX bi0 = GID_0,        bi1 = GID_1,        bi2 = GID_2;\n"
+   "\tX bd0 = LDIM_0,       bd1 = LDIM_1,       bd2 = LDIM_2;\n"
+   "\tX ti0 = LID_0,        ti1 = LID_1,        ti2 = LID_2;\n"
+   "\tX gi0 = bi0*bd0+ti0,  gi1 = bi1*bd1+ti1,  gi2 = bi2*bd2+ti2;\n",
+   1247, -1},
+};
+static const tmpl tmpl_maa_head = {"ss", 3, tmpl_maa_head_parts, 1349};
+
+static const tmpl_part tmpl_maa_idx_parts[] = {
+  {"",
+   0, 0},
+  {"",
+   0, 1},
+  {"",
+   0, 2},
+  {"",
+   0, 3},
+  {"",
+   0, -1},
+};
+static const tmpl tmpl_maa_idx = {"sdss", 5, tmpl_maa_idx_parts, 0};
+
+static const tmpl_part tmpl_maa_chunk_parts[] = {
+  {"ci",
+   2, 0},
+  {" = chunkSize[",
+   13, 0},
+  {"]",
+   1, 1},
+  {"",
+   0, -1},
+};
+static const tmpl tmpl_maa_chunk = {"us", 4, tmpl_maa_chunk_parts, 16};
+
+static const tmpl_part tmpl_maa_free_indices_parts[] = {
+  {"\t\n"
+   "\t\n"
+   "\t/* Free indices & Reduction indices */\n",
+   44, -1},
+};
+static const tmpl tmpl_maa_free_indices = {"", 1, tmpl_maa_free_indices_parts, 44};
+
+static const tmpl_part tmpl_maa_blank_parts[] = {
+  {"\t\n"
+   "\t\n",
+   4, -1},
+};
+static const tmpl tmpl_maa_blank = {"", 1, tmpl_maa_blank_parts, 4};
+
+static const tmpl_part tmpl_maa_ranges_parts[] = {
+  {"\t/* Compute ranges for this thread. */\n",
+   39, -1},
+};
+static const tmpl tmpl_maa_ranges = {"", 1, tmpl_maa_ranges_parts, 39};
+
+static const tmpl_part tmpl_maa_dim_parts[] = {
+  {"\ti",
+   2, 0},
+  {"Dim     = srcSize[",
+   18, 1},
+  {"];\n",
+   3, -1},
+};
+static const tmpl tmpl_maa_dim = {"dd", 3, tmpl_maa_dim_parts, 23};
+
+static const tmpl_part tmpl_maa_sstep_parts[] = {
+  {"\ti",
+   2, 0},
+  {"SStep   = srcSteps[",
+   19, 1},
+  {"];\n",
+   3, -1},
+};
+static const tmpl tmpl_maa_sstep = {"dd", 3, tmpl_maa_sstep_parts, 24};
+
+static const tmpl_part tmpl_maa_mstep_parts[] = {
+  {"\ti",
+   2, 0},
+  {"MStep   = dstMaxSteps[",
+   22, 0},
+  {"];\n",
+   3, -1},
+};
+static const tmpl tmpl_maa_mstep = {"d", 3, tmpl_maa_mstep_parts, 27};
+
+static const tmpl_part tmpl_maa_astep_parts[] = {
+  {"\ti",
+   2, 0},
+  {"AStep   = dstArgmaxSteps[",
+   25, 0},
+  {"];\n",
+   3, -1},
+};
+static const tmpl tmpl_maa_astep = {"d", 3, tmpl_maa_astep_parts, 30};
+
+static const tmpl_part tmpl_maa_pdim_last_parts[] = {
+  {"\ti",
+   2, 0},
+  {"PDim    = 1;\n",
+   13, -1},
+};
+static const tmpl tmpl_maa_pdim_last = {"d", 2, tmpl_maa_pdim_last_parts, 15};
+
+static const tmpl_part tmpl_maa_pdim_parts[] = {
+  {"\ti",
+   2, 0},
+  {"PDim    = i",
+   11, 1},
+  {"PDim * i",
+   8, 1},
+  {"Dim;\n",
+   5, -1},
+};
+static const tmpl tmpl_maa_pdim = {"dd", 4, tmpl_maa_pdim_parts, 26};
+
+static const tmpl_part tmpl_maa_start_hw_parts[] = {
+  {"\ti",
+   2, 0},
+  {"Start   = gi",
+   12, 1},
+  {" * ci",
+   5, 1},
+  {";\n",
+   2, -1},
+};
+static const tmpl tmpl_maa_start_hw = {"dd", 4, tmpl_maa_start_hw_parts, 21};
+
+static const tmpl_part tmpl_maa_start_parts[] = {
+  {"\ti",
+   2, 0},
+  {"Start   = 0;\n",
+   13, -1},
+};
+static const tmpl tmpl_maa_start = {"d", 2, tmpl_maa_start_parts, 15};
+
+static const tmpl_part tmpl_maa_end_hw_parts[] = {
+  {"\ti",
+   2, 0},
+  {"End     = i",
+   11, 0},
+  {"Start + ci",
+   10, 1},
+  {";\n",
+   2, -1},
+};
+static const tmpl tmpl_maa_end_hw = {"dd", 4, tmpl_maa_end_hw_parts, 25};
+
+static const tmpl_part tmpl_maa_end_parts[] = {
+  {"\ti",
+   2, 0},
+  {"End     = i",
+   11, 0},
+  {"Start + i",
+   9, 0},
+  {"Dim;\n",
+   5, -1},
+};
+static const tmpl tmpl_maa_end = {"d", 4, tmpl_maa_end_parts, 27};
+
+static const tmpl_part tmpl_maa_loops_parts[] = {
+  {"\t/**\n"
+   "\t * FREE LOOPS.\n"
+   "\t */\n"
+   "\t\n"
+   "#define FOROVER(idx)    for(i##idx = i##idx##Start; i##idx < i##idx##End; i##idx++)\n"
+   "#define ESCAPE(idx)     if(i##idx >= i##idx##Dim){continue;}\n",
+   173, -1},
+};
+static const tmpl tmpl_maa_loops = {"", 1, tmpl_maa_loops_parts, 173};
+
+static const tmpl_part tmpl_maa_src_term_parts[] = {
+  {"i",
+   1, 0},
+  {"*i",
+   2, 0},
+  {"SStep + \\\n"
+   "                                            ",
+   54, -1},
+};
+static const tmpl tmpl_maa_src_term = {"d", 3, tmpl_maa_src_term_parts, 57};
+
+static const tmpl_part tmpl_maa_rdx_term_parts[] = {
+  {"i",
+   1, 0},
+  {"*i",
+   2, 0},
+  {"PDim + \\\n"
+   "                                        ",
+   49, -1},
+};
+static const tmpl tmpl_maa_rdx_term = {"d", 3, tmpl_maa_rdx_term_parts, 52};
+
+static const tmpl_part tmpl_maa_dstm_term_parts[] = {
+  {"i",
+   1, 0},
+  {"*i",
+   2, 0},
+  {"MStep + \\\n"
+   "                                                  ",
+   60, -1},
+};
+static const tmpl tmpl_maa_dstm_term = {"d", 3, tmpl_maa_dstm_term_parts, 63};
+
+static const tmpl_part tmpl_maa_dsta_term_parts[] = {
+  {"i",
+   1, 0},
+  {"*i",
+   2, 0},
+  {"AStep + \\\n"
+   "                                                     ",
+   63, -1},
+};
+static const tmpl tmpl_maa_dsta_term = {"d", 3, tmpl_maa_dsta_term_parts, 66};
+
+static const tmpl_part tmpl_maa_for_parts[] = {
+  {"\tFOROVER(",
+   9, 0},
+  {"){ESCAPE(",
+   9, 0},
+  {")\n",
+   2, -1},
+};
+static const tmpl tmpl_maa_for = {"d", 3, tmpl_maa_for_parts, 20};
+
+static const tmpl_part tmpl_maa_init_parts[] = {
+  {"\t/**\n"
+   "\t * Reduction initialization.\n"
+   "\t */\n"
+   "\t\n",
+   42, -1},
+};
+static const tmpl tmpl_maa_init = {"", 1, tmpl_maa_init_parts, 42};
+
+static const tmpl_part tmpl_maa_reduction_parts[] = {
+  {"\t\n"
+   "\t/**\n"
+   "\t * REDUCTION LOOPS.\n"
+   "\t */\n"
+   "\t\n",
+   35, -1},
+};
+static const tmpl tmpl_maa_reduction = {"", 1, tmpl_maa_reduction_parts, 35};
+
+static const tmpl_part tmpl_maa_update_parts[] = {
+  {"\t\n"
+   "\tif(V > maxV){\n"
+   "\t\tmaxV = V;\n",
+   29, -1},
+};
+static const tmpl tmpl_maa_update = {"", 1, tmpl_maa_update_parts, 29};
+
+static const tmpl_part tmpl_maa_writeback_parts[] = {
+  {"\t\n"
+   "\t/**\n"
+   "\t * Destination writeback.\n"
+   "\t */\n"
+   "\t\n",
+   41, -1},
+};
+static const tmpl tmpl_maa_writeback = {"", 1, tmpl_maa_writeback_parts, 41};
+
+static const tmpl_part tmpl_maa_undefs_parts[] = {
+  {"#undef FOROVER\n"
+   "#undef ESCAPE\n"
+   "#undef SRCINDEXER\n"
+   "#undef RDXINDEXER\n"
+   "#undef DSTMINDEXER\n"
+   "#undef DSTAINDEXER\n",
+   103, -1},
+};
+static const tmpl tmpl_maa_undefs = {"", 1, tmpl_maa_undefs_parts, 103};
@@ -15,9 +15,12 @@
 #include <gpuarray/buffer.h>
 #include <gpuarray/buffer_blas.h>
 #include <gpuarray/buffer_collectives.h>
+#include <gpuarray/elemwise.h>
 
 #include "util/strb.h"
 #include "util/error.h"
+#include "util/thread.h"
+#include "util/sched.h"
 #include "cache.h"
 
 #ifdef __cplusplus
@@ -50,6 +53,11 @@ typedef struct _gpuarray_comm_ops gpuarray_comm_ops;
   int flags;                                    \
   struct _gpudata *errbuf;                      \
   cache *extcopy_cache;                         \
+  cache *keyed_kernels;                         \
+  struct _gpugraph *capture;                    \
+  struct _alloc_trace *trace;                   \
+  struct _ga_lock *lock;                        \
+  sched_dev sched;                              \
   char bin_id[64];                              \
   char tag[8]
 
@@ -64,12 +72,13 @@ struct _gpucontext_props {
   const char *kernel_cache_path;
   size_t max_cache_size;
   size_t initial_cache_size;
+  const char *alloc_trace_path;
 };
 
 struct _gpucontext {
   GPUCONTEXT_HEAD;
   void *ctx_ptr;
-  void *private[11];
+  void *private[18];
 };
 
 /* The real gpudata struct is likely bigger but we only care about the
@@ -118,6 +127,25 @@ struct _gpuarray_buffer_ops {
   int (*property)(gpucontext *ctx, gpudata *buf, gpukernel *k, int prop_id,
                   void *res);
   const char *(*ctx_error)(gpucontext *ctx);
+  int (*buffer_read_rect)(void *dst, size_t dst_rpitch, size_t dst_spitch,
+                          gpudata *src, size_t srcoff,
+                          size_t src_rpitch, size_t src_spitch,
+                          size_t width, size_t height, size_t depth);
+  int (*buffer_write_rect)(gpudata *dst, size_t dstoff,
+                           size_t dst_rpitch, size_t dst_spitch,
+                           const void *src,
+                           size_t src_rpitch, size_t src_spitch,
+                           size_t width, size_t height, size_t depth);
+  int (*graph_instantiate)(gpugraph *g);
+  int (*graph_launch)(gpugraph *g);
+  void (*graph_free)(gpugraph *g);
+  int (*buffer_prefetch)(gpudata *b, size_t off, size_t sz, int location);
+  int (*buffer_advise)(gpudata *b, size_t off, size_t sz, int advice,
+                       int location);
+  int (*ctx_trim_cache)(gpucontext *ctx, size_t *freed);
+  int (*buffer_transfer_many)(gpudata **dst, const size_t *dstoff,
+                              gpudata **src, const size_t *srcoff,
+                              const size_t *sz, size_t n);
 };
 
 struct _gpuarray_blas_ops {
@@ -244,6 +272,25 @@ struct _gpuarray_blas_ops {
                  gpudata *B, size_t offB, size_t ldb, ssize_t strideB,
                  double beta, gpudata *C, size_t offC, size_t ldc, ssize_t strideC,
                  size_t batchCount);
+  /* alpha and beta point to a (real, imaginary) pair */
+  int (*cgemv)(cb_order order, cb_transpose transA, size_t M, size_t N,
+               const float *alpha, gpudata *A, size_t offA, size_t lda,
+               gpudata *X, size_t offX, int incX, const float *beta,
+               gpudata *Y, size_t offY, int incY);
+  int (*zgemv)(cb_order order, cb_transpose transA, size_t M, size_t N,
+               const double *alpha, gpudata *A, size_t offA, size_t lda,
+               gpudata *X, size_t offX, int incX, const double *beta,
+               gpudata *Y, size_t offY, int incY);
+  int (*cgemm)(cb_order order, cb_transpose transA, cb_transpose transB,
+               size_t M, size_t N, size_t K, const float *alpha,
+               gpudata *A, size_t offA, size_t lda,
+               gpudata *B, size_t offB, size_t ldb,
+               const float *beta, gpudata *C, size_t offC, size_t ldc);
+  int (*zgemm)(cb_order order, cb_transpose transA, cb_transpose transB,
+               size_t M, size_t N, size_t K, const double *alpha,
+               gpudata *A, size_t offA, size_t lda,
+               gpudata *B, size_t offB, size_t ldb,
+               const double *beta, gpudata *C, size_t offC, size_t ldc);
 };
 
 struct _gpuarray_comm_ops {
@@ -284,10 +331,80 @@ static inline void *memdup(const void *p, size_t s) {
   return res;
 }
 
+enum graph_node_type {
+  GRAPH_KERNEL,
+  GRAPH_MOVE,
+  GRAPH_MEMSET,
+  GRAPH_WRITE
+};
+
+typedef struct _graph_node {
+  int type;
+  /* GRAPH_KERNEL */
+  gpukernel *k;
+  unsigned int nd;
+  size_t gs[3];
+  size_t ls[3];
+  size_t shared;
+  void **args;
+  /* GRAPH_MOVE, GRAPH_MEMSET, GRAPH_WRITE */
+  gpudata *dst;
+  size_t dstoff;
+  gpudata *src;
+  size_t srcoff;
+  size_t sz;
+  int data;
+  void *host;
+} graph_node;
+
+/* Arguments set with gpukernel_setarg() during a capture */
+typedef struct _graph_kargs {
+  gpukernel *k;
+  unsigned int numargs;
+  const int *types;
+  void **vals;
+} graph_kargs;
+
+struct _gpugraph {
+  gpucontext *ctx;
+  graph_node *nodes;
+  size_t nnodes;
+  size_t anodes;
+  /* Distinct buffers referenced by the nodes, each holds a reference */
+  gpudata **bufs;
+  size_t nbufs;
+  size_t abufs;
+  graph_kargs *kargs;
+  size_t nkargs;
+  /* Backend replay object, if any */
+  void *exec;
+};
+
+int graph_record_call(gpukernel *k, unsigned int n, const size_t *gs,
+                      const size_t *ls, size_t shared, void **args);
+int graph_record_setarg(gpukernel *k, unsigned int i, void *a);
+int graph_record_move(gpudata *dst, size_t dstoff, gpudata *src,
+                      size_t srcoff, size_t sz);
+int graph_record_memset(gpudata *dst, size_t dstoff, int data);
+int graph_record_write(gpudata *dst, size_t dstoff, const void *src,
+                       size_t sz);
+
+#define GRAPH_CHECK(ctx, what)                                          \
+  do {                                                                  \
+    if ((ctx)->capture != NULL)                                         \
+      return error_set((ctx)->err, GA_INVALID_ERROR,                    \
+                       what " is not allowed during a capture");        \
+  } while (0)
+
 int GpuArray_is_c_contiguous(const GpuArray *a);
 int GpuArray_is_f_contiguous(const GpuArray *a);
 int GpuArray_is_aligned(const GpuArray *a);
 
+/* The kernel GpuElemwise_call() uses on contiguous arrays (for tests) */
+gpukernel *GpuElemwise_contig_kernel(GpuElemwise *ge);
+/* The number of specialised kernels built by GpuElemwise_call() (for tests) */
+unsigned int GpuElemwise_spec_kernels(GpuElemwise *ge);
+
 extern const gpuarray_type scalar_types[];
 extern const gpuarray_type vector_types[];
 
@@ -67,17 +67,35 @@ static inline int error_cuda(error *e, const char *msg, CUresult err) {
     }                                           \
   } while (0)
 
+/* Copy stream for the transfers from another context */
+typedef struct _cuda_peer {
+  struct _cuda_peer *next;
+  CUcontext src;
+  /* NULL if there is no peer access, mem_s is used then */
+  CUstream s;
+} cuda_peer;
+
 typedef struct _cuda_context {
   GPUCONTEXT_HEAD;
   CUcontext ctx;
   CUstream s;
   CUstream mem_s;
+  cuda_peer *peers;
+  /* Orders the writes to our buffers after the copies that other
+     contexts made from them, created on first use */
+  CUstream peer_s;
   gpudata *freeblocks;
+  gpudata *managedblocks;
   size_t cache_size;
   size_t max_cache_size;
+  size_t reclaimed;
+  size_t in_use;
+  size_t peak;
+  size_t nblocks;
+  size_t nsplits;
+  size_t nmerges;
   cache *kernel_cache;
   cache *disk_cache; // This is per-context to avoid lock contention
-  unsigned int enter;
   unsigned char major;
   unsigned char minor;
 } cuda_context;
@@ -100,6 +118,10 @@ STATIC_ASSERT(sizeof(cuda_context) <= sizeof(gpucontext),
  * will be merged with their neighbours, but not across original
  * allocation lines (which are kept track of with the CUDA_HEAD_ALLOC
  * flag.
+ *
+ * Managed allocations (CUDA_MANAGED_PTR) are kept in a separate list,
+ * managedblocks, so that they are never handed out for device-only
+ * requests and vice versa.
  */
 
 #define ARCH_PREFIX "compute_"
@@ -120,6 +142,7 @@ struct _gpudata {
   unsigned int refcnt;
   int flags;
   size_t sz;
+  size_t asz; /* size of the driver allocation for CUDA_HEAD_ALLOC */
   gpudata *next;
 #ifdef DEBUG
   char tag[8];
@@ -141,6 +164,9 @@ int cuda_record(gpudata *, int);
 #define CUDA_IPC_MEMORY 0x100000
 #define CUDA_HEAD_ALLOC 0x200000
 #define CUDA_MAPPED_PTR 0x400000
+#define CUDA_MANAGED_PTR 0x800000
+/* The allocation is in the trace of the context */
+#define CUDA_TRACED 0x1000000
 
 struct _gpukernel {
   cuda_context *ctx; /* Keep the context first */
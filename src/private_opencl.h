@@ -85,6 +85,7 @@ struct _gpudata {
      struct _partial_gpudata */
   cl_event ev;
   unsigned int refcnt;
+  int traced; /* The allocation is in the trace of the context */
 #ifdef DEBUG
   char tag[8];
 #endif
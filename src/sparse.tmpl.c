@@ -0,0 +1,328 @@
+/* Generated by tmpl.py from sparse.tmpl, do not edit. */
+
+static const tmpl_part tmpl_sparse_head_parts[] = {
+  {"#include \"cluda.h\"\n"
+   "typedef ",
+   27, 0},
+  {" T;\n"
+   "typedef ",
+   12, 1},
+  {" I;\n"
+   "#define T_atom_add(a, b) ",
+   29, 2},
+  {"(a, b)\n"
+   "#define ADD_OFF(t, p, o) p = (GLOBAL_MEM t *)(((GLOBAL_MEM const char *)p) + o)\n",
+   87, -1},
+};
+static const tmpl tmpl_sparse_head = {"tts", 4, tmpl_sparse_head_parts, 155};
+
+static const tmpl_part tmpl_sparse_scale_parts[] = {
+  {"KERNEL void sparse_scale(GLOBAL_MEM T *y, ga_size y_off,\n"
+   "                         ga_ssize s0, ga_ssize s1,\n"
+   "                         ga_size n0, ga_size n1, T beta) {\n"
+   "  const ga_size n = n0 * n1;\n"
+   "  ga_size i;\n"
+   "  ADD_OFF(T, y, y_off);\n"
+   "  for (i = GID_0 * LDIM_0 + LID_0; i < n; i += GDIM_0 * LDIM_0) {\n"
+   "    GLOBAL_MEM T *p = y + (ga_ssize)(i / n1) * s0 + (ga_ssize)(i % n1) * s1;\n"
+   "    *p = (beta == 0) ? 0 : beta * *p;\n"
+   "  }\n"
+   "}\n",
+   420, -1},
+};
+static const tmpl tmpl_sparse_scale = {"", 1, tmpl_sparse_scale_parts, 420};
+
+static const tmpl_part tmpl_sparse_csr_vector_parts[] = {
+  {"/* ",
+   3, 0},
+  {" threads per row, the partial sums are added in local memory */\n"
+   "KERNEL void csr_vector(GLOBAL_MEM const T *data, ga_size d_off,\n"
+   "                       GLOBAL_MEM const I *indices, ga_size i_off,\n"
+   "                       GLOBAL_MEM const I *ptr, ga_size p_off,\n"
+   "                       GLOBAL_MEM const T *x, ga_size x_off, ga_ssize xs,\n"
+   "                       GLOBAL_MEM T *y, ga_size y_off, ga_ssize ys,\n"
+   "                       ga_size rows, T alpha, T beta) {\n"
+   "  LOCAL_MEM T buf[",
+   474, 1},
+  {"];\n"
+   "  const ga_size lane = LID_0 % ",
+   34, 0},
+  {";\n"
+   "  const ga_size grp = (GID_0 * LDIM_0 + LID_0) / ",
+   51, 0},
+  {";\n"
+   "  const ga_size ngrp = (GDIM_0 * LDIM_0) / ",
+   45, 0},
+  {";\n"
+   "  ga_size r0, row, j, end;\n"
+   "  ga_uint s;\n"
+   "  T sum;\n"
+   "  ADD_OFF(const T, data, d_off);\n"
+   "  ADD_OFF(const I, indices, i_off);\n"
+   "  ADD_OFF(const I, ptr, p_off);\n"
+   "  ADD_OFF(const T, x, x_off);\n"
+   "  ADD_OFF(T, y, y_off);\n"
+   "  /* All the threads of a block go through the same number of\n"
+   "     iterations because of the barriers */\n"
+   "  for (r0 = 0; r0 < rows; r0 += ngrp) {\n"
+   "    row = r0 + grp;\n"
+   "    sum = 0;\n"
+   "    if (row < rows) {\n"
+   "      end = ptr[row + 1];\n"
+   "      for (j = ptr[row] + lane; j < end; j += ",
+   478, 0},
+  {")\n"
+   "        sum += data[j] * x[(ga_ssize)indices[j] * xs];\n"
+   "    }\n"
+   "    buf[LID_0] = sum;\n"
+   "    local_barrier();\n"
+   "    for (s = ",
+   119, 0},
+  {" / 2; s > 0; s >>= 1) {\n"
+   "      if (lane < s)\n"
+   "        buf[LID_0] += buf[LID_0 + s];\n"
+   "      local_barrier();\n"
+   "    }\n"
+   "    if (lane == 0 && row < rows) {\n"
+   "      GLOBAL_MEM T *p = y + (ga_ssize)row * ys;\n"
+   "      *p = alpha * buf[LID_0] + ((beta == 0) ? 0 : beta * *p);\n"
+   "    }\n"
+   "  }\n"
+   "}\n",
+   269, -1},
+};
+static const tmpl tmpl_sparse_csr_vector = {"uu", 8, tmpl_sparse_csr_vector_parts, 1473};
+
+static const tmpl_part tmpl_sparse_merge_path_parts[] = {
+  {"/*\n"
+   " * Each thread consumes ",
+   27, 0},
+  {" items of the merge of the row ends\n"
+   " * (ptr[1:]) with the element indices, so long rows are split between\n"
+   " * threads.  y must already be scaled by beta.  The rows that may be\n"
+   " * shared with other threads (the first and the one left unfinished)\n"
+   " * are added atomically, the others belong to this thread.\n"
+   " */\n"
+   "KERNEL void merge_path(GLOBAL_MEM const T *data, ga_size d_off,\n"
+   "                       GLOBAL_MEM const I *indices, ga_size i_off,\n"
+   "                       GLOBAL_MEM const I *ptr, ga_size p_off,\n"
+   "                       GLOBAL_MEM const T *x, ga_size x_off, ga_ssize xs,\n"
+   "                       GLOBAL_MEM T *y, ga_size y_off, ga_ssize ys,\n"
+   "                       ga_size rows, ga_size nnz, T alpha) {\n"
+   "  const ga_size total = rows + nnz;\n"
+   "  ga_size t, d, end, lo, hi, mid, r, r0, j;\n"
+   "  T sum;\n"
+   "  ADD_OFF(const T, data, d_off);\n"
+   "  ADD_OFF(const I, indices, i_off);\n"
+   "  ADD_OFF(const I, ptr, p_off);\n"
+   "  ADD_OFF(const T, x, x_off);\n"
+   "  ADD_OFF(T, y, y_off);\n"
+   "  for (t = (GID_0 * LDIM_0 + LID_0) * ",
+   986, 0},
+  {"; t < total;\n"
+   "       t += GDIM_0 * LDIM_0 * ",
+   43, 0},
+  {") {\n"
+   "    end = (t + ",
+   19, 0},
+  {" < total) ? t + ",
+   16, 0},
+  {" : total;\n"
+   "    /* Find where diagonal t crosses the merge path */\n"
+   "    lo = (t > nnz) ? t - nnz : 0;\n"
+   "    hi = (t < rows) ? t : rows;\n"
+   "    while (lo < hi) {\n"
+   "      mid = (lo + hi) / 2;\n"
+   "      if ((ga_size)ptr[mid + 1] <= t - mid - 1)\n"
+   "        lo = mid + 1;\n"
+   "      else\n"
+   "        hi = mid;\n"
+   "    }\n"
+   "    r = r0 = lo;\n"
+   "    j = t - lo;\n"
+   "    sum = 0;\n"
+   "    for (d = t; d < end; d++) {\n"
+   "      if (r < rows && j < (ga_size)ptr[r + 1]) {\n"
+   "        sum += data[j] * x[(ga_ssize)indices[j] * xs];\n"
+   "        j++;\n"
+   "      } else {\n"
+   "        if (r == r0)\n"
+   "          T_atom_add(y + (ga_ssize)r * ys, alpha * sum);\n"
+   "        else\n"
+   "          y[(ga_ssize)r * ys] += alpha * sum;\n"
+   "        sum = 0;\n"
+   "        r++;\n"
+   "      }\n"
+   "    }\n"
+   "    if (r < rows && sum != 0)\n"
+   "      T_atom_add(y + (ga_ssize)r * ys, alpha * sum);\n"
+   "  }\n"
+   "}\n",
+   765, -1},
+};
+static const tmpl tmpl_sparse_merge_path = {"u", 6, tmpl_sparse_merge_path_parts, 1856};
+
+static const tmpl_part tmpl_sparse_coo_spmv_parts[] = {
+  {"/* y must already be scaled by beta */\n"
+   "KERNEL void coo_spmv(GLOBAL_MEM const T *data, ga_size d_off,\n"
+   "                     GLOBAL_MEM const I *col, ga_size c_off,\n"
+   "                     GLOBAL_MEM const I *row, ga_size r_off,\n"
+   "                     GLOBAL_MEM const T *x, ga_size x_off, ga_ssize xs,\n"
+   "                     GLOBAL_MEM T *y, ga_size y_off, ga_ssize ys,\n"
+   "                     ga_size nnz, T alpha) {\n"
+   "  ga_size i;\n"
+   "  ADD_OFF(const T, data, d_off);\n"
+   "  ADD_OFF(const I, col, c_off);\n"
+   "  ADD_OFF(const I, row, r_off);\n"
+   "  ADD_OFF(const T, x, x_off);\n"
+   "  ADD_OFF(T, y, y_off);\n"
+   "  for (i = GID_0 * LDIM_0 + LID_0; i < nnz; i += GDIM_0 * LDIM_0)\n"
+   "    T_atom_add(y + (ga_ssize)row[i] * ys,\n"
+   "               alpha * data[i] * x[(ga_ssize)col[i] * xs]);\n"
+   "}\n",
+   740, -1},
+};
+static const tmpl tmpl_sparse_coo_spmv = {"", 1, tmpl_sparse_coo_spmv_parts, 740};
+
+static const tmpl_part tmpl_sparse_csr_spmm_parts[] = {
+  {"/* Dimension 0 goes over the columns of C, dimension 1 over the rows */\n"
+   "KERNEL void csr_spmm(GLOBAL_MEM const T *data, ga_size d_off,\n"
+   "                     GLOBAL_MEM const I *indices, ga_size i_off,\n"
+   "                     GLOBAL_MEM const I *ptr, ga_size p_off,\n"
+   "                     GLOBAL_MEM const T *B, ga_size b_off,\n"
+   "                     ga_ssize bs0, ga_ssize bs1,\n"
+   "                     GLOBAL_MEM T *C, ga_size c_off,\n"
+   "                     ga_ssize cs0, ga_ssize cs1,\n"
+   "                     ga_size rows, ga_size k, T alpha, T beta) {\n"
+   "  ga_size r, c, j, start, end;\n"
+   "  T sum;\n"
+   "  ADD_OFF(const T, data, d_off);\n"
+   "  ADD_OFF(const I, indices, i_off);\n"
+   "  ADD_OFF(const I, ptr, p_off);\n"
+   "  ADD_OFF(const T, B, b_off);\n"
+   "  ADD_OFF(T, C, c_off);\n"
+   "  for (r = GID_1 * LDIM_1 + LID_1; r < rows; r += GDIM_1 * LDIM_1) {\n"
+   "    start = ptr[r];\n"
+   "    end = ptr[r + 1];\n"
+   "    for (c = GID_0 * LDIM_0 + LID_0; c < k; c += GDIM_0 * LDIM_0) {\n"
+   "      GLOBAL_MEM T *p = C + (ga_ssize)r * cs0 + (ga_ssize)c * cs1;\n"
+   "      sum = 0;\n"
+   "      for (j = start; j < end; j++)\n"
+   "        sum += data[j] * B[(ga_ssize)indices[j] * bs0 + (ga_ssize)c * bs1];\n"
+   "      *p = alpha * sum + ((beta == 0) ? 0 : beta * *p);\n"
+   "    }\n"
+   "  }\n"
+   "}\n",
+   1171, -1},
+};
+static const tmpl tmpl_sparse_csr_spmm = {"", 1, tmpl_sparse_csr_spmm_parts, 1171};
+
+static const tmpl_part tmpl_sparse_coo_spmm_parts[] = {
+  {"/* C must already be scaled by beta */\n"
+   "KERNEL void coo_spmm(GLOBAL_MEM const T *data, ga_size d_off,\n"
+   "                     GLOBAL_MEM const I *col, ga_size c_off,\n"
+   "                     GLOBAL_MEM const I *row, ga_size r_off,\n"
+   "                     GLOBAL_MEM const T *B, ga_size b_off,\n"
+   "                     ga_ssize bs0, ga_ssize bs1,\n"
+   "                     GLOBAL_MEM T *C, ga_size C_off,\n"
+   "                     ga_ssize cs0, ga_ssize cs1,\n"
+   "                     ga_size nnz, ga_size k, T alpha) {\n"
+   "  ga_size i, c;\n"
+   "  ADD_OFF(const T, data, d_off);\n"
+   "  ADD_OFF(const I, col, c_off);\n"
+   "  ADD_OFF(const I, row, r_off);\n"
+   "  ADD_OFF(const T, B, b_off);\n"
+   "  ADD_OFF(T, C, C_off);\n"
+   "  for (i = GID_1 * LDIM_1 + LID_1; i < nnz; i += GDIM_1 * LDIM_1) {\n"
+   "    const T v = alpha * data[i];\n"
+   "    GLOBAL_MEM const T *b = B + (ga_ssize)col[i] * bs0;\n"
+   "    GLOBAL_MEM T *p = C + (ga_ssize)row[i] * cs0;\n"
+   "    for (c = GID_0 * LDIM_0 + LID_0; c < k; c += GDIM_0 * LDIM_0)\n"
+   "      T_atom_add(p + (ga_ssize)c * cs1, v * b[(ga_ssize)c * bs1]);\n"
+   "  }\n"
+   "}\n",
+   1002, -1},
+};
+static const tmpl tmpl_sparse_coo_spmm = {"", 1, tmpl_sparse_coo_spmm_parts, 1002};
+
+static const tmpl_part tmpl_sparse_dense_count_parts[] = {
+  {"KERNEL void dense_count(GLOBAL_MEM const T *a, ga_size a_off,\n"
+   "                        ga_ssize s0, ga_ssize s1,\n"
+   "                        ga_size rows, ga_size cols,\n"
+   "                        GLOBAL_MEM I *cnt, ga_size c_off) {\n"
+   "  ga_size r, c;\n"
+   "  I n;\n"
+   "  ADD_OFF(const T, a, a_off);\n"
+   "  ADD_OFF(I, cnt, c_off);\n"
+   "  for (r = GID_0 * LDIM_0 + LID_0; r < rows; r += GDIM_0 * LDIM_0) {\n"
+   "    n = 0;\n"
+   "    for (c = 0; c < cols; c++)\n"
+   "      if (a[(ga_ssize)r * s0 + (ga_ssize)c * s1] != 0)\n"
+   "        n++;\n"
+   "    cnt[r] = n;\n"
+   "  }\n"
+   "}\n",
+   504, -1},
+};
+static const tmpl tmpl_sparse_dense_count = {"", 1, tmpl_sparse_dense_count_parts, 504};
+
+static const tmpl_part tmpl_sparse_dense_fill_parts[] = {
+  {"KERNEL void dense_fill(GLOBAL_MEM const T *a, ga_size a_off,\n"
+   "                       ga_ssize s0, ga_ssize s1,\n"
+   "                       ga_size rows, ga_size cols,\n"
+   "                       GLOBAL_MEM const I *ptr, ga_size p_off,\n"
+   "                       GLOBAL_MEM T *data, ga_size d_off,\n"
+   "                       GLOBAL_MEM I *indices, ga_size i_off) {\n"
+   "  ga_size r, c, j;\n"
+   "  T v;\n"
+   "  ADD_OFF(const T, a, a_off);\n"
+   "  ADD_OFF(const I, ptr, p_off);\n"
+   "  ADD_OFF(T, data, d_off);\n"
+   "  ADD_OFF(I, indices, i_off);\n"
+   "  for (r = GID_0 * LDIM_0 + LID_0; r < rows; r += GDIM_0 * LDIM_0) {\n"
+   "    j = ptr[r];\n"
+   "    for (c = 0; c < cols; c++) {\n"
+   "      v = a[(ga_ssize)r * s0 + (ga_ssize)c * s1];\n"
+   "      if (v != 0) {\n"
+   "        data[j] = v;\n"
+   "        indices[j] = c;\n"
+   "        j++;\n"
+   "      }\n"
+   "    }\n"
+   "  }\n"
+   "}\n",
+   756, -1},
+};
+static const tmpl tmpl_sparse_dense_fill = {"", 1, tmpl_sparse_dense_fill_parts, 756};
+
+static const tmpl_part tmpl_sparse_csr_expand_parts[] = {
+  {"KERNEL void csr_expand(GLOBAL_MEM const I *ptr, ga_size p_off,\n"
+   "                       GLOBAL_MEM I *row, ga_size r_off, ga_size rows) {\n"
+   "  ga_size r, j, end;\n"
+   "  ADD_OFF(const I, ptr, p_off);\n"
+   "  ADD_OFF(I, row, r_off);\n"
+   "  for (r = GID_0 * LDIM_0 + LID_0; r < rows; r += GDIM_0 * LDIM_0) {\n"
+   "    end = ptr[r + 1];\n"
+   "    for (j = ptr[r]; j < end; j++)\n"
+   "      row[j] = r;\n"
+   "  }\n"
+   "}\n",
+   365, -1},
+};
+static const tmpl tmpl_sparse_csr_expand = {"", 1, tmpl_sparse_csr_expand_parts, 365};
+
+static const tmpl_part tmpl_sparse_check_index_parts[] = {
+  {"/* Set *bad if one of the n indices is negative or not below bound */\n"
+   "KERNEL void check_index(GLOBAL_MEM const I *idx, ga_size i_off, ga_size n,\n"
+   "                        ga_size bound, GLOBAL_MEM ga_int *bad,\n"
+   "                        ga_size b_off) {\n"
+   "  ga_size i;\n"
+   "  ADD_OFF(const I, idx, i_off);\n"
+   "  ADD_OFF(ga_int, bad, b_off);\n"
+   "  for (i = GID_0 * LDIM_0 + LID_0; i < n; i += GDIM_0 * LDIM_0)\n"
+   "    if (idx[i] < 0 || (ga_size)idx[i] >= bound)\n"
+   "      *bad = 1;\n"
+   "}\n",
+   455, -1},
+};
+static const tmpl tmpl_sparse_check_index = {"", 1, tmpl_sparse_check_index_parts, 455};
@@ -0,0 +1,149 @@
+/* Generated by tmpl.py from take1.tmpl, do not edit. */
+
+static const tmpl_part tmpl_take1_head_parts[] = {
+  {"#include \"cluda.h\"\n"
+   "KERNEL void take1(GLOBAL_MEM ",
+   48, 0},
+  {" *r, ga_size r_off, GLOBAL_MEM const ",
+   37, 1},
+  {" *v, ga_size v_off,",
+   19, -1},
+};
+static const tmpl tmpl_take1_head = {"tt", 3, tmpl_take1_head_parts, 104};
+
+static const tmpl_part tmpl_take1_arg_parts[] = {
+  {" ga_ssize s",
+   11, 0},
+  {", ga_size d",
+   11, 0},
+  {",",
+   1, -1},
+};
+static const tmpl tmpl_take1_arg = {"u", 3, tmpl_take1_arg_parts, 23};
+
+static const tmpl_part tmpl_take1_start_parts[] = {
+  {" GLOBAL_MEM const ",
+   18, 1},
+  {" *ind, ga_size i_off, ga_size n0, ga_size n1, GLOBAL_MEM int* err) {\n"
+   "  const ",
+   77, 2},
+  {" idx0 = LDIM_0 * GID_0 + LID_0;\n"
+   "  const ",
+   40, 2},
+  {" numThreads0 = LDIM_0 * GDIM_0;\n"
+   "  const ",
+   40, 2},
+  {" idx1 = LDIM_1 * GID_1 + LID_1;\n"
+   "  const ",
+   40, 2},
+  {" numThreads1 = LDIM_1 * GDIM_1;\n"
+   "  ",
+   34, 2},
+  {" i0, i1;\n"
+   "  if (idx0 >= n0 || idx1 >= n1) return;\n"
+   "  r = (GLOBAL_MEM ",
+   67, 0},
+  {" *)(((GLOBAL_MEM char *)r) + r_off);\n"
+   "  ind = (GLOBAL_MEM ",
+   57, 1},
+  {" *)(((GLOBAL_MEM char *)ind) + i_off);\n"
+   "  for (i0 = idx0; i0 < n0; i0 += numThreads0) {\n",
+   87, -1},
+};
+static const tmpl tmpl_take1_start = {"tts", 9, tmpl_take1_start_parts, 460};
+
+static const tmpl_part tmpl_take1_ind_signed_parts[] = {
+  {"    ga_ssize ii0 = ind[i0];\n"
+   "    ",
+   32, 0},
+  {" pos0 = v_off;\n"
+   "    if (ii0 < 0) ii0 += d0;\n"
+   "    if ((ii0 < 0) || (ii0 >= (ga_ssize)d0)) {\n"
+   "      *err = -1;\n"
+   "      continue;\n"
+   "    }\n"
+   "    pos0 += (",
+   141, 0},
+  {")ii0 * (",
+   8, 0},
+  {")s0;\n",
+   5, -1},
+};
+static const tmpl tmpl_take1_ind_signed = {"s", 4, tmpl_take1_ind_signed_parts, 186};
+
+static const tmpl_part tmpl_take1_ind_unsigned_parts[] = {
+  {"    ga_size ii0 = ind[i0];\n"
+   "    ",
+   31, 0},
+  {" pos0 = v_off;\n"
+   "    if (ii0 >= d0) {\n"
+   "      *err = -1;\n"
+   "      continue;\n"
+   "    }\n"
+   "    pos0 += (",
+   88, 0},
+  {")ii0 * (",
+   8, 0},
+  {")s0;\n",
+   5, -1},
+};
+static const tmpl tmpl_take1_ind_unsigned = {"s", 4, tmpl_take1_ind_unsigned_parts, 132};
+
+static const tmpl_part tmpl_take1_loop_parts[] = {
+  {"    for (i1 = idx1; i1 < n1; i1 += numThreads1) {\n"
+   "      ",
+   56, 0},
+  {" p = pos0;\n",
+   11, -1},
+};
+static const tmpl tmpl_take1_loop = {"s", 2, tmpl_take1_loop_parts, 67};
+
+static const tmpl_part tmpl_take1_pos_parts[] = {
+  {"      ",
+   6, 0},
+  {" pos, ii = i1;\n",
+   15, -1},
+};
+static const tmpl tmpl_take1_pos = {"s", 2, tmpl_take1_pos_parts, 21};
+
+static const tmpl_part tmpl_take1_dim_parts[] = {
+  {"      pos = ii % (",
+   18, 0},
+  {")d",
+   2, 2},
+  {";\n"
+   "      ii /= (",
+   15, 0},
+  {")d",
+   2, 2},
+  {";\n"
+   "      p += pos * (",
+   20, 1},
+  {")s",
+   2, 2},
+  {";\n",
+   2, -1},
+};
+static const tmpl tmpl_take1_dim = {"ssu", 7, tmpl_take1_dim_parts, 61};
+
+static const tmpl_part tmpl_take1_dim1_parts[] = {
+  {"      pos = ii;\n"
+   "      p += pos * (",
+   34, 0},
+  {")s1;\n",
+   5, -1},
+};
+static const tmpl tmpl_take1_dim1 = {"s", 2, tmpl_take1_dim1_parts, 39};
+
+static const tmpl_part tmpl_take1_end_parts[] = {
+  {"      r[i0*((",
+   13, 0},
+  {")n1) + i1] = *((GLOBAL_MEM ",
+   27, 1},
+  {" *)(((GLOBAL_MEM char *)v) + p));\n"
+   "    }\n"
+   "  }\n"
+   "}\n",
+   46, -1},
+};
+static const tmpl tmpl_take1_end = {"st", 3, tmpl_take1_end_parts, 86};
@@ -0,0 +1,142 @@
+# Compiles kernel source templates to C tables for util/tmpl.h.
+# Usage: python tmpl.py <file>
+# This will output <file>.c
+#
+# A template starts with a line of the form
+#
+#   %% name(param:type, ...)
+#
+# and runs until the next one.  The text before the first template is
+# a comment.  In the text of a template, ${param} is replaced by the
+# value of the parameter, $$ is a literal $ and a $ at the end of a
+# line removes the newline.  The types are those of util/tmpl.h:
+# s (const char *), u (unsigned int), d (int), z (size_t), Z (ssize_t)
+# and t (a typecode, replaced by the name of the type in cluda).
+
+import re
+import sys
+
+TYPES = 'sudzZt'
+# TMPL_MAX_PARAMS in util/tmpl.h
+MAX_PARAMS = 8
+
+header_re = re.compile(r'^%%\s*([A-Za-z_]\w*)\s*(?:\((.*)\))?\s*$')
+hole_re = re.compile(r'\$(\$|\{([A-Za-z_]\w*)\}|\n)')
+
+
+class TemplateError(Exception):
+    pass
+
+
+def parse_params(spec, where):
+    names = []
+    types = ''
+    if spec is None or spec.strip() == '':
+        return names, types
+    for p in spec.split(','):
+        try:
+            name, typ = [s.strip() for s in p.split(':')]
+        except ValueError:
+            raise TemplateError('%s: bad parameter %r' % (where, p))
+        if typ not in TYPES:
+            raise TemplateError('%s: unknown type %r' % (where, typ))
+        if name in names:
+            raise TemplateError('%s: duplicate parameter %r' % (where, name))
+        names.append(name)
+        types += typ
+    if len(names) > MAX_PARAMS:
+        raise TemplateError('%s: more than %d parameters' % (where, MAX_PARAMS))
+    return names, types
+
+
+def split(text, names, where):
+    """Return the list of (text, param index) pieces of a template."""
+    parts = []
+    cur = ''
+    pos = 0
+    used = set()
+    for m in hole_re.finditer(text):
+        if '$' in text[pos:m.start()]:
+            raise TemplateError('%s: stray $' % (where,))
+        cur += text[pos:m.start()]
+        pos = m.end()
+        if m.group(1) == '$':
+            cur += '$'
+        elif m.group(1) == '\n':
+            pass
+        else:
+            name = m.group(2)
+            if name not in names:
+                raise TemplateError('%s: unknown parameter %r' % (where, name))
+            used.add(name)
+            parts.append((cur, names.index(name)))
+            cur = ''
+    if '$' in text[pos:]:
+        raise TemplateError('%s: stray $' % (where,))
+    cur += text[pos:]
+    parts.append((cur, -1))
+    for n in names:
+        if n not in used:
+            raise TemplateError('%s: unused parameter %r' % (where, n))
+    return parts
+
+
+def parse(src, fname):
+    templates = []
+    cur = None
+    for lineno, line in enumerate(src.splitlines(True), 1):
+        m = header_re.match(line.rstrip('\n'))
+        if line.startswith('%%'):
+            if m is None:
+                raise TemplateError('%s:%d: bad template header' %
+                                    (fname, lineno))
+            where = '%s:%d' % (fname, lineno)
+            names, types = parse_params(m.group(2), where)
+            cur = [m.group(1), names, types, '', where]
+            templates.append(cur)
+        elif cur is not None:
+            cur[3] += line
+    seen = set()
+    res = []
+    for name, names, types, text, where in templates:
+        if name in seen:
+            raise TemplateError('%s: duplicate template %r' % (where, name))
+        seen.add(name)
+        res.append((name, types, split(text, names, where)))
+    return res
+
+
+def c_string(s):
+    """Format `s` as C string literals, one per line of text."""
+    if s == '':
+        return '""'
+    out = []
+    for line in s.splitlines(True):
+        esc = (line.replace('\\', '\\\\').replace('"', '\\"')
+               .replace('\t', '\\t').replace('\n', '\\n'))
+        out.append('"%s"' % (esc,))
+    return '\n   '.join(out)
+
+
+def convert(src, dst):
+    with open(src) as f:
+        templates = parse(f.read(), src)
+    with open(dst, 'w') as f:
+        f.write('/* Generated by tmpl.py from %s, do not edit. */\n' % (src,))
+        for name, types, parts in templates:
+            f.write('\nstatic const tmpl_part tmpl_%s_parts[] = {\n' % (name,))
+            for text, param in parts:
+                f.write('  {%s,\n   %d, %d},\n' % (c_string(text), len(text),
+                                                  param))
+            f.write('};\n')
+            f.write('static const tmpl tmpl_%s = {"%s", %d, tmpl_%s_parts, '
+                    '%d};\n' % (name, types, len(parts), name,
+                                sum(len(t) for t, _ in parts)))
+
+
+if __name__ == '__main__':
+    try:
+        convert(sys.argv[1], sys.argv[1] + '.c')
+    except TemplateError as e:
+        sys.stderr.write('%s\n' % (e,))
+        sys.exit(1)
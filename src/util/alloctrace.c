@@ -0,0 +1,195 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/alloctrace.h"
+#include "util/thread.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+/*
+ * The events of all the threads using a context go to the same trace,
+ * so everything below is done under `lock`.
+ */
+struct _alloc_trace {
+  ga_lock *lock;
+  FILE *f;
+  uint64_t start;
+  char **tags;
+  uint32_t ntags;
+  uint32_t cur;
+};
+
+static uint64_t now_ns(void) {
+#ifdef _WIN32
+  LARGE_INTEGER c, f;
+  QueryPerformanceCounter(&c);
+  QueryPerformanceFrequency(&f);
+  return (uint64_t)((double)c.QuadPart * 1e9 / (double)f.QuadPart);
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+alloc_trace *alloc_trace_open(const char *path, error *e) {
+  alloc_trace *res = calloc(1, sizeof(*res));
+
+  if (res == NULL) {
+    error_sys(e, "calloc");
+    return NULL;
+  }
+  res->lock = ga_lock_new();
+  if (res->lock == NULL) {
+    error_set(e, GA_SYS_ERROR, "Could not create trace lock");
+    free(res);
+    return NULL;
+  }
+  res->f = fopen(path, "wb");
+  if (res->f == NULL) {
+    error_fmt(e, GA_SYS_ERROR, "Could not open allocation trace \"%s\": %s",
+              path, strerror(errno));
+    ga_lock_free(res->lock);
+    free(res);
+    return NULL;
+  }
+  if (fwrite(ALLOC_TRACE_MAGIC, ALLOC_TRACE_MAGIC_LEN, 1, res->f) != 1) {
+    error_sys(e, "fwrite");
+    fclose(res->f);
+    ga_lock_free(res->lock);
+    free(res);
+    return NULL;
+  }
+  res->start = now_ns();
+  return res;
+}
+
+void alloc_trace_close(alloc_trace *t) {
+  uint32_t i;
+
+  if (t == NULL) return;
+  if (t->f != NULL)
+    fclose(t->f);
+  for (i = 0; i < t->ntags; i++)
+    free(t->tags[i]);
+  free(t->tags);
+  ga_lock_free(t->lock);
+  free(t);
+}
+
+/* Must be called with t->lock held */
+static void put(alloc_trace *t, alloc_trace_rec *r, const char *extra) {
+  if (t->f == NULL) return;
+  r->ts = now_ns() - t->start;
+  r->tag = t->cur;
+  if (fwrite(r, sizeof(*r), 1, t->f) != 1 ||
+      (extra != NULL && fwrite(extra, r->size, 1, t->f) != 1)) {
+    /* Stop recording rather than produce a corrupt trace */
+    fclose(t->f);
+    t->f = NULL;
+  }
+}
+
+void alloc_trace_alloc(alloc_trace *t, const void *id, size_t size,
+                       int flags) {
+  alloc_trace_rec r;
+
+  if (t == NULL) return;
+  memset(&r, 0, sizeof(r));
+  r.type = ALLOC_TRACE_ALLOC;
+  r.id = (uint64_t)(uintptr_t)id;
+  r.size = size;
+  r.flags = (uint32_t)flags;
+  ga_lock_acquire(t->lock);
+  put(t, &r, NULL);
+  ga_lock_release(t->lock);
+}
+
+void alloc_trace_free(alloc_trace *t, const void *id) {
+  alloc_trace_rec r;
+
+  if (t == NULL) return;
+  memset(&r, 0, sizeof(r));
+  r.type = ALLOC_TRACE_FREE;
+  r.id = (uint64_t)(uintptr_t)id;
+  ga_lock_acquire(t->lock);
+  put(t, &r, NULL);
+  ga_lock_release(t->lock);
+}
+
+void alloc_trace_tag(alloc_trace *t, const char *name) {
+  alloc_trace_rec r;
+  char **tmp;
+  uint32_t i;
+
+  if (t == NULL) return;
+  ga_lock_acquire(t->lock);
+  if (t->f == NULL)
+    goto out;
+  if (name == NULL) {
+    t->cur = 0;
+    goto out;
+  }
+  /* Tag numbers start at 1 */
+  for (i = 0; i < t->ntags; i++) {
+    if (strcmp(t->tags[i], name) == 0) {
+      t->cur = i + 1;
+      goto out;
+    }
+  }
+  tmp = realloc(t->tags, sizeof(char *) * (t->ntags + 1));
+  if (tmp == NULL)
+    goto out;
+  t->tags = tmp;
+  t->tags[t->ntags] = strdup(name);
+  if (t->tags[t->ntags] == NULL)
+    goto out;
+  t->ntags++;
+
+  memset(&r, 0, sizeof(r));
+  r.type = ALLOC_TRACE_TAG;
+  r.id = t->ntags;
+  r.size = strlen(name);
+  t->cur = 0;
+  put(t, &r, name);
+  t->cur = t->ntags;
+ out:
+  ga_lock_release(t->lock);
+}
+
+int alloc_trace_check(FILE *f) {
+  char magic[ALLOC_TRACE_MAGIC_LEN];
+
+  if (fread(magic, ALLOC_TRACE_MAGIC_LEN, 1, f) != 1 ||
+      memcmp(magic, ALLOC_TRACE_MAGIC, ALLOC_TRACE_MAGIC_LEN) != 0)
+    return -1;
+  return 0;
+}
+
+int alloc_trace_read(FILE *f, alloc_trace_rec *r, char **name) {
+  char *tmp;
+
+  if (fread(r, sizeof(*r), 1, f) != 1)
+    return feof(f) ? 0 : -1;
+  if (r->type != ALLOC_TRACE_TAG)
+    return 1;
+  tmp = malloc(r->size + 1);
+  if (tmp == NULL)
+    return -1;
+  if (r->size != 0 && fread(tmp, r->size, 1, f) != 1) {
+    free(tmp);
+    return -1;
+  }
+  tmp[r->size] = '\0';
+  if (name != NULL)
+    *name = tmp;
+  else
+    free(tmp);
+  return 1;
+}
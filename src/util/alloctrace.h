@@ -0,0 +1,99 @@
+#ifndef UTIL_ALLOCTRACE_H
+#define UTIL_ALLOCTRACE_H
+
+#include <stdio.h>
+
+#include "gpuarray/config.h"
+#include "util/error.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#ifdef CONFUSE_EMACS
+}
+#endif
+
+/*
+ * Allocation traces.
+ *
+ * A trace is a binary file that starts with ALLOC_TRACE_MAGIC and
+ * continues with a sequence of alloc_trace_rec in host byte order.
+ * ALLOC_TRACE_TAG records are followed by `size` bytes holding the
+ * name of the tag (not nul-terminated).
+ */
+
+#define ALLOC_TRACE_MAGIC "GAATRC01"
+#define ALLOC_TRACE_MAGIC_LEN 8
+
+enum alloc_trace_type {
+  ALLOC_TRACE_ALLOC = 1,
+  ALLOC_TRACE_FREE = 2,
+  ALLOC_TRACE_TAG = 3
+};
+
+typedef struct _alloc_trace_rec {
+  uint64_t ts;    /* nanoseconds since the trace was opened */
+  uint64_t id;    /* buffer identity, or tag number for TAG */
+  uint64_t size;  /* requested size, or length of the name for TAG */
+  uint32_t flags; /* allocation flags (GA_BUFFER_*) */
+  uint32_t tag;   /* tag active at the time of the event (0 for none) */
+  uint8_t type;   /* one of enum alloc_trace_type */
+  uint8_t pad[7];
+} alloc_trace_rec;
+
+typedef struct _alloc_trace alloc_trace;
+
+/*
+ * Create (or truncate) the trace file at `path`.
+ *
+ * Returns NULL on error.
+ */
+alloc_trace *alloc_trace_open(const char *path, error *e);
+
+/*
+ * Flush and close a trace.  `t` may be NULL.
+ */
+void alloc_trace_close(alloc_trace *t);
+
+/*
+ * Record events.  These do nothing if `t` is NULL.  Errors while
+ * writing stop the recording silently.  They may be called from
+ * multiple threads.
+ *
+ * The backends record the free when the last reference to a buffer
+ * goes away, before its memory can be handed out again.
+ */
+void alloc_trace_alloc(alloc_trace *t, const void *id, size_t size,
+                       int flags);
+void alloc_trace_free(alloc_trace *t, const void *id);
+
+/*
+ * Set the tag attached to the following events.  Each distinct name
+ * is written once to the trace.  NULL clears the tag.
+ */
+void alloc_trace_tag(alloc_trace *t, const char *name);
+
+/*
+ * Read the next record of a trace opened with fopen().  The magic
+ * must have been checked with alloc_trace_check().
+ *
+ * For TAG records, the name is returned in `name` (nul-terminated,
+ * must be freed).  `name` may be NULL to skip it.
+ *
+ * Returns 1 if a record was read, 0 at the end of the file and -1 on
+ * error.
+ */
+int alloc_trace_read(FILE *f, alloc_trace_rec *r, char **name);
+
+/*
+ * Check that the trace starts with the right magic.
+ *
+ * Returns 0 if it does, -1 otherwise.
+ */
+int alloc_trace_check(FILE *f);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
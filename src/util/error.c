@@ -4,40 +4,208 @@
 
 #include "private_config.h"
 #include "util/error.h"
+#include "util/thread.h"
 
-static error _global_err = {{0}, 0};
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+static error _global_err = {{0}, 0, 0};
 error *global_err = &_global_err;
 
+/* Identifies error objects so that a stale per-thread copy is not
+   mistaken for the copy of a new object at the same address. */
+static volatile unsigned int next_id = 0;
+
+/*
+ * Each thread has a few slots for the errors it recently set.  The
+ * least recently set slot is reused when they are all taken.
+ */
+#define ERROR_SLOTS 8
+
+/*
+ * Covers the copy of the last error that is kept in the error object
+ * itself for the threads whose slot for it was reused.
+ */
+static ga_lock *shared_lock = NULL;
+
+typedef struct _error_slot {
+  const error *key;
+  unsigned int id;
+  unsigned int age;
+  error val;
+} error_slot;
+
+typedef struct _error_tls {
+  unsigned int clock;
+  error_slot slots[ERROR_SLOTS];
+} error_tls;
+
+#ifdef _WIN32
+static INIT_ONCE tls_once = INIT_ONCE_STATIC_INIT;
+static DWORD tls_key = FLS_OUT_OF_INDEXES;
+
+static VOID WINAPI tls_free(PVOID p) {
+  free(p);
+}
+
+static BOOL CALLBACK tls_init(PINIT_ONCE o, PVOID p, PVOID *c) {
+  tls_key = FlsAlloc(tls_free);
+  shared_lock = ga_lock_new();
+  return TRUE;
+}
+
+static error_tls *tls_get(int create) {
+  error_tls *t;
+  InitOnceExecuteOnce(&tls_once, tls_init, NULL, NULL);
+  if (tls_key == FLS_OUT_OF_INDEXES) return NULL;
+  t = FlsGetValue(tls_key);
+  if (t == NULL && create) {
+    t = calloc(1, sizeof(*t));
+    if (t != NULL && !FlsSetValue(tls_key, t)) {
+      free(t);
+      t = NULL;
+    }
+  }
+  return t;
+}
+#else
+static pthread_once_t tls_once = PTHREAD_ONCE_INIT;
+static pthread_key_t tls_key;
+static int tls_ok = 0;
+
+static void tls_init(void) {
+  tls_ok = (pthread_key_create(&tls_key, free) == 0);
+  shared_lock = ga_lock_new();
+}
+
+static error_tls *tls_get(int create) {
+  error_tls *t;
+  pthread_once(&tls_once, tls_init);
+  if (!tls_ok) return NULL;
+  t = pthread_getspecific(tls_key);
+  if (t == NULL && create) {
+    t = calloc(1, sizeof(*t));
+    if (t != NULL && pthread_setspecific(tls_key, t) != 0) {
+      free(t);
+      t = NULL;
+    }
+  }
+  return t;
+}
+#endif
+
+static error_slot *find_slot(error_tls *t, const error *e) {
+  unsigned int i;
+
+  for (i = 0; i < ERROR_SLOTS; i++) {
+    if (t->slots[i].key == e && t->slots[i].id == e->id)
+      return &t->slots[i];
+  }
+  return NULL;
+}
+
+/*
+ * Get the copy of `e` for the calling thread to write to.  If we
+ * can't get per-thread storage this falls back to `e` itself.
+ */
+static error *get_w(error *e) {
+  error_tls *t = tls_get(1);
+  error_slot *s;
+  unsigned int i;
+
+  if (t == NULL) return e;
+  s = find_slot(t, e);
+  if (s == NULL) {
+    /* Empty slots have an age of 0 so they go first */
+    s = &t->slots[0];
+    for (i = 1; i < ERROR_SLOTS; i++) {
+      if (t->slots[i].age < s->age)
+        s = &t->slots[i];
+    }
+    s->key = e;
+    s->id = e->id;
+  }
+  s->age = ++t->clock;
+  return &s->val;
+}
+
+/*
+ * Also store the error in `e` itself, which get_r() falls back to.
+ */
+static void set_shared(error *e, const error *v) {
+  if (v == e) return;
+  ga_lock_acquire(shared_lock);
+  e->code = v->code;
+  strlcpy(e->msg, v->msg, ERROR_MSGBUF_LEN);
+  ga_lock_release(shared_lock);
+}
+
+static const error *get_r(error *e) {
+  error_tls *t = tls_get(0);
+  error_slot *s;
+
+  if (t == NULL) return e;
+  s = find_slot(t, e);
+  if (s == NULL) return e;
+  return &s->val;
+}
+
 int error_alloc(error **_e) {
   error *e;
   e = calloc(sizeof(error), 1);
   if (e == NULL) return -1;
+  e->id = ga_atomic_inc(&next_id);
   *_e = e;
   return 0;
 }
 
 void error_free(error *e) {
+  error_tls *t = tls_get(0);
+  error_slot *s;
+
+  if (t != NULL) {
+    s = find_slot(t, e);
+    if (s != NULL) {
+      s->key = NULL;
+      s->age = 0;
+    }
+  }
   free(e);
 }
 
 int error_set(error *e, int code, const char *msg) {
-  e->code = code;
-  strlcpy(e->msg, msg, ERROR_MSGBUF_LEN);
+  error *w = get_w(e);
+  w->code = code;
+  strlcpy(w->msg, msg, ERROR_MSGBUF_LEN);
+  set_shared(e, w);
 #ifdef DEBUG
-  fprintf(stderr, "ERROR %d: %s\n", e->code, e->msg);
+  fprintf(stderr, "ERROR %d: %s\n", w->code, w->msg);
 #endif
   return code;
 }
 
 int error_fmt(error *e, int code, const char *fmt, ...) {
+  error *w = get_w(e);
   va_list ap;
 
-  e->code = code;
+  w->code = code;
   va_start(ap, fmt);
-  vsnprintf(e->msg, ERROR_MSGBUF_LEN, fmt, ap);
+  vsnprintf(w->msg, ERROR_MSGBUF_LEN, fmt, ap);
   va_end(ap);
+  set_shared(e, w);
 #ifdef DEBUG
-  fprintf(stderr, "ERROR %d: %s\n", e->code, e->msg);
+  fprintf(stderr, "ERROR %d: %s\n", w->code, w->msg);
 #endif
   return code;
 }
+
+int error_code(error *e) {
+  return get_r(e)->code;
+}
+
+const char *error_msg(error *e) {
+  return get_r(e)->msg;
+}
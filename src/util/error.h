@@ -6,12 +6,23 @@
 
 #include <gpuarray/error.h>
 
-/* 1024 - 4 for the int that goes after */
-#define ERROR_MSGBUF_LEN 1020
-
+/* 1024 - 8 for the two ints that go after */
+#define ERROR_MSGBUF_LEN 1016
+
+/*
+ * Error reporting object.
+ *
+ * The message and code are kept per thread: error_set() and
+ * error_fmt() store them in storage private to the calling thread and
+ * error_code()/error_msg() read them back from there.  This way a
+ * context shared between threads will not mix up the errors from
+ * different threads.  The members of the struct should not be
+ * accessed directly.
+ */
 typedef struct _error {
   char msg[ERROR_MSGBUF_LEN];
   int code;
+  unsigned int id;
 } error;
 
 int error_alloc(error **e);
@@ -19,6 +30,15 @@ void error_free(error *e);
 int error_set(error *e, int code, const char *msg);
 int error_fmt(error *e, int code, const char *fmt, ...);
 
+/*
+ * Return the last error code or message set on `e` by the calling
+ * thread.  A thread only keeps its copy for the last few error
+ * objects it used; past that, or if it set none, the last error set
+ * on `e` by any thread is returned (GA_NO_ERROR and "" if none).
+ */
+int error_code(error *e);
+const char *error_msg(error *e);
+
 extern error *global_err;
 
 static inline int error_sys(error *e, const char *msg) {
@@ -0,0 +1,106 @@
+#include "util/sched.h"
+
+static size_t ceil_div(size_t a, size_t b) {
+  return (a + b - 1) / b;
+}
+
+unsigned int sched_blocks_mp(const sched_dev *d, const sched_kernel *k,
+                             size_t ls) {
+  size_t b, per_block;
+
+  if (d->threads_mp == 0 || ls == 0 || ls > k->max_l)
+    return 0;
+  b = d->threads_mp / ls;
+  if (d->blocks_mp != 0 && b > d->blocks_mp)
+    b = d->blocks_mp;
+  if (d->regs_mp != 0 && k->regs != 0) {
+    per_block = ceil_div((size_t)k->regs * d->warp, SCHED_REG_UNIT) *
+      SCHED_REG_UNIT * ceil_div(ls, d->warp);
+    if (b > d->regs_mp / per_block)
+      b = d->regs_mp / per_block;
+  }
+  if (d->lmem_mp != 0 && k->lmem != 0) {
+    if (b > d->lmem_mp / k->lmem)
+      b = d->lmem_mp / k->lmem;
+  }
+  return (unsigned int)b;
+}
+
+/* What we did before we knew about occupancy */
+static void sched_fixed(const sched_dev *d, const sched_kernel *k, size_t n,
+                        size_t *gs, size_t *ls) {
+  size_t min_l = d->warp;
+  size_t target_l = 512;
+  size_t target_g = (size_t)d->numprocs * 32;
+  int want_ls = 0;
+
+  if (target_g > d->max_g)
+    target_g = d->max_g;
+  if (target_l > k->max_l)
+    target_l = k->max_l;
+
+  if (*ls == 0) {
+    want_ls = 1;
+    *ls = min_l;
+  }
+
+  if (*gs == 0) {
+    *gs = ((n-1) / *ls) + 1;
+    if (*gs > target_g)
+      *gs = target_g;
+  }
+
+  if (want_ls && n > (*ls * *gs)) {
+    /* The division and multiplication by min_l is to ensure we end up
+     * with a multiple of min_l */
+    *ls = ((n / min_l) / *gs) * min_l;
+    if (*ls > target_l)
+      *ls = target_l;
+  }
+}
+
+void sched_launch(const sched_dev *d, const sched_kernel *k, size_t n,
+                  size_t *gs, size_t *ls) {
+  size_t l, best, best_occ, occ, need, wave;
+  unsigned int b;
+
+  if (n == 0) n = 1;
+
+  if (d->threads_mp == 0 || d->warp == 0 || k->max_l < d->warp) {
+    sched_fixed(d, k, n, gs, ls);
+    return;
+  }
+
+  if (*ls == 0) {
+    best = d->warp;
+    best_occ = 0;
+    /* Ties go to the larger block */
+    for (l = d->warp; l <= k->max_l; l += d->warp) {
+      occ = (size_t)sched_blocks_mp(d, k, l) * l;
+      if (occ >= best_occ && occ != 0) {
+        best = l;
+        best_occ = occ;
+      }
+    }
+    /* Don't use bigger blocks than the work needs */
+    need = *gs != 0 ? ceil_div(n, *gs) : n;
+    need = ceil_div(need, d->warp) * d->warp;
+    if (best > need)
+      best = need;
+    *ls = best;
+  }
+
+  if (*gs == 0) {
+    *gs = ceil_div(n, *ls);
+    b = sched_blocks_mp(d, k, *ls);
+    wave = (size_t)(b != 0 ? b : 1) * d->numprocs;
+    if (wave != 0 && *gs > wave) {
+      l = ceil_div(*gs, wave);
+      if (l > SCHED_MAX_WAVES)
+        l = SCHED_MAX_WAVES;
+      *gs = l * wave;
+    }
+    if (*gs > d->max_g)
+      *gs = d->max_g;
+  }
+}
@@ -0,0 +1,73 @@
+#ifndef UTIL_SCHED_H
+#define UTIL_SCHED_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#ifdef CONFUSE_EMACS
+}
+#endif
+
+/*
+ * Launch configuration.
+ *
+ * These functions only look at the descriptions below so that they
+ * can be checked against recorded device properties without a
+ * device.  For all the fields marked "optional", 0 means that the
+ * value is unknown and the corresponding limit is ignored.
+ */
+
+typedef struct _sched_dev {
+  unsigned int numprocs;   /* number of multiprocessors (compute units) */
+  unsigned int warp;       /* block sizes are multiples of this */
+  size_t max_g;            /* largest grid size */
+  unsigned int threads_mp; /* resident threads per multiprocessor (optional) */
+  unsigned int blocks_mp;  /* resident blocks per multiprocessor (optional) */
+  unsigned int regs_mp;    /* registers per multiprocessor (optional) */
+  size_t lmem_mp;          /* local memory per multiprocessor (optional) */
+} sched_dev;
+
+typedef struct _sched_kernel {
+  size_t max_l;            /* largest block size for the kernel */
+  unsigned int regs;       /* registers per thread (optional) */
+  size_t lmem;             /* static local memory per block (optional) */
+} sched_kernel;
+
+/* Registers are allocated to warps in chunks of this size */
+#define SCHED_REG_UNIT 256
+
+/* Grids are limited to this many full waves */
+#define SCHED_MAX_WAVES 4
+
+/*
+ * Number of blocks of `ls` threads of kernel `k` that can be resident
+ * on one multiprocessor at the same time.
+ *
+ * Returns 0 if a block of that size can't run or if
+ * `d->threads_mp` is unknown.
+ */
+unsigned int sched_blocks_mp(const sched_dev *d, const sched_kernel *k,
+                             size_t ls);
+
+/*
+ * Pick the block size (`*ls`) and grid size (`*gs`) to process `n`
+ * elements with a kernel that loops over its elements in steps of the
+ * total number of threads.  Non-zero values for `*ls` or `*gs` are
+ * kept.
+ *
+ * When the occupancy can be computed, the block size is the one that
+ * keeps the most threads resident and the grid is a whole number of
+ * waves (the number of blocks resident on the whole device at once),
+ * up to SCHED_MAX_WAVES, unless the work needs less than one wave.
+ * Otherwise a fixed heuristic is used.
+ */
+void sched_launch(const sched_dev *d, const sched_kernel *k, size_t n,
+                  size_t *gs, size_t *ls);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,54 @@
+#include <stdlib.h>
+
+#include "util/staging.h"
+
+int staging_copy(error *e, const staging_ops *ops, void *data,
+                 size_t dstoff, size_t srcoff, size_t sz, size_t chunk) {
+  char *buf[2] = {NULL, NULL};
+  int pending[2] = {0, 0};
+  unsigned int nbuf, slot = 0, i;
+  size_t done, n;
+  int err = GA_NO_ERROR, err2;
+
+  if (sz == 0)
+    return GA_NO_ERROR;
+  if (chunk == 0 || chunk > sz)
+    chunk = sz;
+  /* A second buffer is only useful if reads and writes can overlap */
+  nbuf = (ops->wait != NULL && sz > chunk) ? 2 : 1;
+  for (i = 0; i < nbuf; i++) {
+    buf[i] = malloc(chunk);
+    if (buf[i] == NULL) {
+      err = error_sys(e, "malloc");
+      goto out;
+    }
+  }
+
+  for (done = 0; done < sz; done += n) {
+    n = (sz - done < chunk) ? sz - done : chunk;
+    if (pending[slot]) {
+      pending[slot] = 0;
+      err = ops->wait(slot, data);
+      if (err != GA_NO_ERROR) goto out;
+    }
+    err = ops->read(buf[slot], srcoff + done, n, data);
+    if (err != GA_NO_ERROR) goto out;
+    err = ops->write(dstoff + done, buf[slot], n, slot, data);
+    if (err != GA_NO_ERROR) goto out;
+    pending[slot] = (ops->wait != NULL);
+    slot = (slot + 1) % nbuf;
+  }
+
+ out:
+  /* The buffers can't go away while a write from them is in flight */
+  for (i = 0; i < 2; i++) {
+    if (pending[i]) {
+      err2 = ops->wait(i, data);
+      if (err == GA_NO_ERROR)
+        err = err2;
+    }
+  }
+  free(buf[0]);
+  free(buf[1]);
+  return err;
+}
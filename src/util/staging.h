@@ -0,0 +1,63 @@
+#ifndef UTIL_STAGING_H
+#define UTIL_STAGING_H
+
+#include <stddef.h>
+
+#include "util/error.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#ifdef CONFUSE_EMACS
+}
+#endif
+
+/*
+ * Copies through host memory.
+ *
+ * Data that can't be copied directly between two devices is read from
+ * the source into a host buffer and written to the destination from
+ * there, one chunk at a time so that the amount of host memory used
+ * stays bounded.  If the writes can complete asynchronously, two
+ * buffers are used so that the next chunk is read while the previous
+ * one is written.
+ *
+ * The operations on the devices go through callbacks so that this
+ * doesn't depend on a backend.  They return GA_NO_ERROR or an error
+ * code and should set the error on their context.
+ */
+
+typedef struct _staging_ops {
+  /* Read `sz` bytes at offset `off` of the source to `dst` (blocking) */
+  int (*read)(void *dst, size_t off, size_t sz, void *data);
+  /*
+   * Write `sz` bytes from `src` at offset `off` of the destination.
+   * If `wait` is not NULL, this may return before the write is
+   * complete and `src` is not reused until wait() was called with the
+   * same `slot` (0 or 1).
+   */
+  int (*write)(size_t off, const void *src, size_t sz, unsigned int slot,
+               void *data);
+  /* Wait for the last write from `slot` or NULL for blocking writes */
+  int (*wait)(unsigned int slot, void *data);
+} staging_ops;
+
+/* Default chunk size */
+#define STAGING_CHUNK ((size_t)4 << 20)
+
+/*
+ * Copy `sz` bytes from offset `srcoff` of the source to offset
+ * `dstoff` of the destination in chunks of at most `chunk` bytes
+ * (0 for a single chunk).  `data` is passed to the callbacks.
+ *
+ * All the writes are complete when this returns, even on error.
+ * Allocation failures are reported on `e`.
+ */
+int staging_copy(error *e, const staging_ops *ops, void *data,
+                 size_t dstoff, size_t srcoff, size_t sz, size_t chunk);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,81 @@
+#include <stdlib.h>
+
+#include "util/thread.h"
+
+#ifdef _WIN32
+#include <windows.h>
+
+struct _ga_lock {
+  CRITICAL_SECTION cs;
+};
+
+ga_lock *ga_lock_new(void) {
+  ga_lock *res = malloc(sizeof(*res));
+  if (res == NULL) return NULL;
+  /* Critical sections are always recursive */
+  InitializeCriticalSection(&res->cs);
+  return res;
+}
+
+void ga_lock_free(ga_lock *l) {
+  if (l == NULL) return;
+  DeleteCriticalSection(&l->cs);
+  free(l);
+}
+
+void ga_lock_acquire(ga_lock *l) {
+  if (l != NULL) EnterCriticalSection(&l->cs);
+}
+
+void ga_lock_release(ga_lock *l) {
+  if (l != NULL) LeaveCriticalSection(&l->cs);
+}
+
+unsigned int ga_atomic_inc(volatile unsigned int *v) {
+  return (unsigned int)InterlockedIncrement((volatile LONG *)v);
+}
+
+#else
+#include <pthread.h>
+
+struct _ga_lock {
+  pthread_mutex_t m;
+};
+
+ga_lock *ga_lock_new(void) {
+  pthread_mutexattr_t attr;
+  ga_lock *res = malloc(sizeof(*res));
+  if (res == NULL) return NULL;
+  if (pthread_mutexattr_init(&attr) != 0) {
+    free(res);
+    return NULL;
+  }
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  if (pthread_mutex_init(&res->m, &attr) != 0) {
+    pthread_mutexattr_destroy(&attr);
+    free(res);
+    return NULL;
+  }
+  pthread_mutexattr_destroy(&attr);
+  return res;
+}
+
+void ga_lock_free(ga_lock *l) {
+  if (l == NULL) return;
+  pthread_mutex_destroy(&l->m);
+  free(l);
+}
+
+void ga_lock_acquire(ga_lock *l) {
+  if (l != NULL) pthread_mutex_lock(&l->m);
+}
+
+void ga_lock_release(ga_lock *l) {
+  if (l != NULL) pthread_mutex_unlock(&l->m);
+}
+
+unsigned int ga_atomic_inc(volatile unsigned int *v) {
+  return __sync_add_and_fetch(v, 1);
+}
+
+#endif
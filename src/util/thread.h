@@ -0,0 +1,47 @@
+#ifndef UTIL_THREAD_H
+#define UTIL_THREAD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#ifdef CONFUSE_EMACS
+}
+#endif
+
+/*
+ * Recursive lock.
+ *
+ * The same thread may acquire a lock multiple times, it must release
+ * it as many times.  All the functions accept a NULL lock and do
+ * nothing in that case, which is what contexts that are not shared
+ * between threads use.
+ */
+typedef struct _ga_lock ga_lock;
+
+/*
+ * Returns NULL on error.
+ */
+ga_lock *ga_lock_new(void);
+void ga_lock_free(ga_lock *l);
+void ga_lock_acquire(ga_lock *l);
+void ga_lock_release(ga_lock *l);
+
+/*
+ * Atomically increment `*v` and return the new value.
+ */
+unsigned int ga_atomic_inc(volatile unsigned int *v);
+
+/*
+ * Storage class for variables that have one instance per thread.
+ */
+#ifdef _MSC_VER
+#define GA_THREAD_LOCAL __declspec(thread)
+#else
+#define GA_THREAD_LOCAL __thread
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
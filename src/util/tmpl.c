@@ -0,0 +1,106 @@
+#include <assert.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gpuarray/util.h"
+#include "util/tmpl.h"
+
+/* Enough for the digits and sign of a 64-bit int */
+#define NUMBUF 24
+
+/* Writes the digits of `v` backwards from `end` */
+static char *fmt_u(char *end, size_t v) {
+  do {
+    *--end = '0' + (char)(v % 10);
+    v /= 10;
+  } while (v != 0);
+  return end;
+}
+
+void tmpl_render(strb *sb, const tmpl *t, ...) {
+  const char *val[TMPL_MAX_PARAMS];
+  size_t vlen[TMPL_MAX_PARAMS];
+  char num[TMPL_MAX_PARAMS][NUMBUF];
+  const gpuarray_type *ty;
+  va_list ap;
+  ssize_t z;
+  char *p, *q;
+  size_t len = t->len;
+  unsigned int i;
+  int d;
+
+  /* tmpl.py rejects templates with more parameters */
+  assert(strlen(t->params) <= TMPL_MAX_PARAMS);
+  if (strb_error(sb)) return;
+
+  va_start(ap, t);
+  for (i = 0; t->params[i] != '\0'; i++) {
+    if (i == TMPL_MAX_PARAMS) {
+      va_end(ap);
+      strb_seterror(sb);
+      return;
+    }
+    switch (t->params[i]) {
+    case 's':
+      val[i] = va_arg(ap, const char *);
+      vlen[i] = strlen(val[i]);
+      break;
+    case 'u':
+      val[i] = fmt_u(num[i] + NUMBUF, va_arg(ap, unsigned int));
+      vlen[i] = num[i] + NUMBUF - val[i];
+      break;
+    case 'd':
+      d = va_arg(ap, int);
+      q = fmt_u(num[i] + NUMBUF, d < 0 ? -(size_t)d : (size_t)d);
+      if (d < 0)
+        *--q = '-';
+      val[i] = q;
+      vlen[i] = num[i] + NUMBUF - val[i];
+      break;
+    case 'z':
+      val[i] = fmt_u(num[i] + NUMBUF, va_arg(ap, size_t));
+      vlen[i] = num[i] + NUMBUF - val[i];
+      break;
+    case 'Z':
+      z = va_arg(ap, ssize_t);
+      q = fmt_u(num[i] + NUMBUF, z < 0 ? -(size_t)z : (size_t)z);
+      if (z < 0)
+        *--q = '-';
+      val[i] = q;
+      vlen[i] = num[i] + NUMBUF - val[i];
+      break;
+    case 't':
+      ty = gpuarray_get_type(va_arg(ap, int));
+      if (ty->cluda_name == NULL) {
+        va_end(ap);
+        strb_seterror(sb);
+        return;
+      }
+      val[i] = ty->cluda_name;
+      vlen[i] = strlen(val[i]);
+      break;
+    default:
+      va_end(ap);
+      strb_seterror(sb);
+      return;
+    }
+  }
+  va_end(ap);
+
+  for (i = 0; i < t->nparts; i++)
+    if (t->parts[i].param >= 0)
+      len += vlen[t->parts[i].param];
+  if (strb_ensure(sb, len)) return;
+
+  p = sb->s + sb->l;
+  for (i = 0; i < t->nparts; i++) {
+    memcpy(p, t->parts[i].s, t->parts[i].len);
+    p += t->parts[i].len;
+    if (t->parts[i].param >= 0) {
+      memcpy(p, val[t->parts[i].param], vlen[t->parts[i].param]);
+      p += vlen[t->parts[i].param];
+    }
+  }
+  sb->l += len;
+}
@@ -0,0 +1,64 @@
+#ifndef UTIL_TMPL_H
+#define UTIL_TMPL_H
+
+#include "util/strb.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#ifdef CONFUSE_EMACS
+}
+#endif
+
+/*
+ * Kernel source templates.
+ *
+ * A template is a sequence of fixed pieces of text, each followed by
+ * the value of one of its parameters.  They are written in .tmpl
+ * files and compiled to static tables by src/tmpl.py (see there for
+ * the syntax), so there is nothing to parse at runtime and the fixed
+ * text is shared by all the kernels that use it.
+ */
+
+/*
+ * Types of the parameters:
+ *   's': const char *, copied as is
+ *   'u': unsigned int, in decimal
+ *   'd': int, in decimal
+ *   'z': size_t, in decimal
+ *   'Z': ssize_t, in decimal
+ *   't': int typecode, replaced by the cluda name of the type
+ */
+#define TMPL_MAX_PARAMS 8
+
+typedef struct _tmpl_part {
+  const char *s;
+  size_t len;
+  /* Index of the parameter that follows the text or -1 for none */
+  int param;
+} tmpl_part;
+
+typedef struct _tmpl {
+  /* One type character per parameter */
+  const char *params;
+  unsigned int nparts;
+  const tmpl_part *parts;
+  /* Total length of the fixed text */
+  size_t len;
+} tmpl;
+
+/*
+ * Append the template `t` to `sb` with the values of its parameters
+ * following in the order they are declared.
+ *
+ * The length of the result is computed before writing it so that the
+ * strb grows at most once.  An unknown typecode or a failure to grow
+ * places the strb in error mode.
+ */
+void tmpl_render(strb *sb, const tmpl *t, ...);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
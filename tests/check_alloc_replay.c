@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <check.h>
+
+#include "util/alloctrace.h"
+#include "alloc_sim.h"
+
+static alloc_trace_rec *recs;
+static size_t nrecs;
+
+/*
+ * Two small buffers carved out of one block, one buffer bigger than a
+ * block, then everything is freed.
+ */
+static void record(void) {
+  char path[] = "/tmp/gpuarray_allocreplayXXXXXX";
+  alloc_trace *t;
+  error *e;
+  FILE *f;
+  int a, b, c;
+  int fd;
+
+  fd = mkstemp(path);
+  ck_assert_int_ne(fd, -1);
+  close(fd);
+
+  ck_assert_int_eq(error_alloc(&e), 0);
+  t = alloc_trace_open(path, e);
+  ck_assert_ptr_ne(t, NULL);
+  alloc_trace_alloc(t, &a, 100, 0);
+  alloc_trace_alloc(t, &b, 1000, 0);
+  alloc_trace_tag(t, "big");
+  alloc_trace_alloc(t, &c, 5 * 1024 * 1024, 0);
+  alloc_trace_free(t, &a);
+  alloc_trace_free(t, &b);
+  alloc_trace_free(t, &c);
+  alloc_trace_close(t);
+  error_free(e);
+
+  f = fopen(path, "rb");
+  ck_assert_ptr_ne(f, NULL);
+  ck_assert_int_eq(alloc_trace_check(f), 0);
+  ck_assert_int_eq(sim_load(f, &recs, &nrecs), 0);
+  fclose(f);
+  remove(path);
+  /* The tag is skipped */
+  ck_assert_uint_eq(nrecs, 6);
+}
+
+START_TEST(test_replay_default) {
+  sim s;
+
+  record();
+  sim_init(&s);
+  sim_run(&s, recs, nrecs);
+  /* One 4M block and the 5M buffer on its own */
+  ck_assert(s.peak_reserved == 9 * 1024 * 1024);
+  ck_assert(s.peak_in_use == 128 + 1024 + 5 * 1024 * 1024);
+  ck_assert(s.waste_at_peak == s.peak_reserved -
+            (100 + 1000 + 5 * 1024 * 1024));
+  ck_assert_uint_eq(s.driver_allocs, 2);
+  ck_assert_uint_eq(s.driver_frees, 0);
+  /* Both small buffers are split from the block and merged back */
+  ck_assert_uint_eq(s.splits, 2);
+  ck_assert_uint_eq(s.merges, 2);
+  ck_assert_uint_eq(s.failures, 0);
+  ck_assert_uint_eq(s.unknown, 0);
+  ck_assert(s.in_use == 0);
+  sim_clear(&s);
+  free(recs);
+}
+END_TEST
+
+START_TEST(test_replay_limit) {
+  sim s;
+
+  record();
+  sim_init(&s);
+  s.max_cache = 8 * 1024 * 1024;
+  sim_run(&s, recs, nrecs);
+  /* The block is in use so it can't be trimmed for the big buffer */
+  ck_assert(s.peak_reserved == 4 * 1024 * 1024);
+  ck_assert_uint_eq(s.driver_allocs, 1);
+  ck_assert_uint_eq(s.failures, 1);
+  ck_assert_uint_eq(s.unknown, 1);
+  sim_clear(&s);
+  free(recs);
+}
+END_TEST
+
+START_TEST(test_replay_nocache) {
+  sim s;
+
+  record();
+  sim_init(&s);
+  s.max_cache = 0;
+  sim_run(&s, recs, nrecs);
+  ck_assert(s.peak_reserved == 100 + 1000 + 5 * 1024 * 1024);
+  ck_assert(s.waste_at_peak == 0);
+  ck_assert_uint_eq(s.driver_allocs, 3);
+  ck_assert_uint_eq(s.driver_frees, 3);
+  ck_assert_uint_eq(s.splits, 0);
+  ck_assert_uint_eq(s.merges, 0);
+  ck_assert_uint_eq(s.failures, 0);
+  ck_assert(s.reserved == 0);
+  sim_clear(&s);
+  free(recs);
+}
+END_TEST
+
+Suite *get_suite(void) {
+  Suite *s = suite_create("alloc_replay");
+  TCase *tc = tcase_create("All");
+  tcase_add_test(tc, test_replay_default);
+  tcase_add_test(tc, test_replay_limit);
+  tcase_add_test(tc, test_replay_nocache);
+  suite_add_tcase(s, tc);
+  return s;
+}
@@ -1,16 +1,19 @@
 #include <limits.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <check.h>
 
 #include "gpuarray/array.h"
 #include "gpuarray/error.h"
+#include "gpuarray/kernel.h"
 #include "gpuarray/types.h"
 
 extern void *ctx;
 
 void setup(void);
 void teardown(void);
+int get_env_dev(const char **name, gpucontext_props *p);
 
 #define ga_assert_ok(e) ck_assert_int_eq(e, GA_NO_ERROR)
 
@@ -291,6 +294,265 @@ START_TEST(test_reshape_0) {
 }
 END_TEST
 
+START_TEST(test_shape_inline) {
+  /* Move between inline and heap shape storage */
+  const size_t dims[2] = {64, 32};
+  const size_t big[11] = {2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2};
+  const ssize_t starts[11] = {1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+  const ssize_t stops[11] = {2, 2, 2, 2, 1, 2, 2, 2, 2, 2, 2};
+  const ssize_t steps[11] = {0, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1};
+  GpuArray v;
+  GpuArray w;
+  unsigned int i;
+
+  ga_assert_ok(GpuArray_empty(&v, ctx, GA_FLOAT, 2, dims, GA_C_ORDER));
+  ck_assert_ptr_eq(v.dimensions, v._dimensions_inline);
+
+  ga_assert_ok(GpuArray_reshape_inplace(&v, 11, big, GA_C_ORDER));
+  ck_assert_ptr_ne(v.dimensions, v._dimensions_inline);
+  ck_assert_int_eq(v.strides[10], 4);
+  ck_assert_int_eq(v.strides[0], 4096);
+
+  ga_assert_ok(GpuArray_view(&w, &v));
+  ck_assert_ptr_ne(w.dimensions, v.dimensions);
+  ga_assert_ok(GpuArray_transpose_inplace(&w, NULL));
+  ck_assert_int_eq(w.strides[0], 4);
+  ck_assert_int_eq(w.strides[10], 4096);
+
+  ga_assert_ok(GpuArray_index_inplace(&v, starts, stops, steps));
+  ck_assert_int_eq(v.nd, 8);
+  ck_assert_ptr_eq(v.dimensions, v._dimensions_inline);
+  for (i = 0; i < v.nd; i++)
+    ck_assert_int_eq(v.dimensions[i], 2);
+  ck_assert(GpuArray_IS_C_CONTIGUOUS(&v) == 0);
+
+  ga_assert_ok(GpuArray_reshape_inplace(&w, 2, dims, GA_F_ORDER));
+  ck_assert_ptr_eq(w.dimensions, w._dimensions_inline);
+  ck_assert_int_eq(w.dimensions[0], 64);
+  ck_assert_int_eq(w.strides[1], 256);
+
+  GpuArray_clear(&w);
+  GpuArray_clear(&v);
+}
+END_TEST
+
+START_TEST(test_write_read_strided) {
+  const size_t dims[2] = {6, 8};
+  const ssize_t starts[2] = {0, 2};
+  const ssize_t stops[2] = {6, 5};
+  const ssize_t steps[2] = {1, 1};
+  const ssize_t cstr[2] = {3 * sizeof(uint32_t), sizeof(uint32_t)};
+  const ssize_t fstr[2] = {sizeof(uint32_t), 6 * sizeof(uint32_t)};
+  uint32_t data[48];
+  uint32_t buf[48];
+  GpuArray a;
+  GpuArray v;
+  unsigned int i, j;
+
+  for (i = 0; i < 48; i++)
+    data[i] = i;
+
+  ga_assert_ok(GpuArray_empty(&a, ctx, GA_UINT, 2, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_write(&a, data, sizeof(data)));
+  ga_assert_ok(GpuArray_view(&v, &a));
+  ga_assert_ok(GpuArray_index_inplace(&v, starts, stops, steps));
+
+  /* a[:, 2:5] into C and F ordered host buffers */
+  ga_assert_ok(GpuArray_read_strided(buf, cstr, &v));
+  for (i = 0; i < 6; i++)
+    for (j = 0; j < 3; j++)
+      ck_assert_int_eq(buf[i * 3 + j], i * 8 + j + 2);
+  ga_assert_ok(GpuArray_read_strided(buf, fstr, &v));
+  for (i = 0; i < 6; i++)
+    for (j = 0; j < 3; j++)
+      ck_assert_int_eq(buf[j * 6 + i], i * 8 + j + 2);
+
+  /* Non-contiguous plain read is in C order */
+  ga_assert_ok(GpuArray_read(buf, 18 * sizeof(uint32_t), &v));
+  for (i = 0; i < 6; i++)
+    for (j = 0; j < 3; j++)
+      ck_assert_int_eq(buf[i * 3 + j], i * 8 + j + 2);
+
+  for (i = 0; i < 18; i++)
+    data[i] = 100 + i;
+  ga_assert_ok(GpuArray_write_strided(&v, data, fstr));
+  ga_assert_ok(GpuArray_read(buf, sizeof(buf), &a));
+  for (i = 0; i < 6; i++)
+    for (j = 0; j < 8; j++) {
+      if (j >= 2 && j < 5)
+        ck_assert_int_eq(buf[i * 8 + j], 100 + (j - 2) * 6 + i);
+      else
+        ck_assert_int_eq(buf[i * 8 + j], i * 8 + j);
+    }
+
+  GpuArray_clear(&v);
+  GpuArray_clear(&a);
+}
+END_TEST
+
+START_TEST(test_transfer_strided) {
+  const size_t dims[2] = {6, 8};
+  const size_t vdims[2] = {6, 3};
+  const ssize_t starts[2] = {0, 2};
+  const ssize_t stops[2] = {6, 5};
+  const ssize_t steps[2] = {1, 1};
+  const char *name = NULL;
+  gpucontext_props *p;
+  gpucontext *ctx2;
+  uint32_t data[48];
+  uint32_t buf[48];
+  GpuArray a, v, r, b, w;
+  unsigned int i, j;
+
+  /* A second context on the same device is enough to go through the
+     cross-context path */
+  ga_assert_ok(gpucontext_props_new(&p));
+  ck_assert_int_eq(get_env_dev(&name, p), 0);
+  ga_assert_ok(gpucontext_init(&ctx2, name, p));
+
+  for (i = 0; i < 48; i++)
+    data[i] = i;
+
+  ga_assert_ok(GpuArray_empty(&a, ctx, GA_UINT, 2, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_write(&a, data, sizeof(data)));
+  ga_assert_ok(GpuArray_view(&v, &a));
+  ga_assert_ok(GpuArray_index_inplace(&v, starts, stops, steps));
+
+  /* a[:, 2:5] into a contiguous array */
+  ga_assert_ok(GpuArray_empty(&r, ctx2, GA_UINT, 2, vdims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_transfer(&r, &v));
+  ga_assert_ok(GpuArray_read(buf, 18 * sizeof(uint32_t), &r));
+  for (i = 0; i < 6; i++)
+    for (j = 0; j < 3; j++)
+      ck_assert_int_eq(buf[i * 3 + j], i * 8 + j + 2);
+
+  /* a[:, 2:5] into b[:, 2:5] */
+  ga_assert_ok(GpuArray_empty(&b, ctx2, GA_UINT, 2, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_memset(&b, 0));
+  ga_assert_ok(GpuArray_view(&w, &b));
+  ga_assert_ok(GpuArray_index_inplace(&w, starts, stops, steps));
+  ga_assert_ok(GpuArray_transfer(&w, &v));
+  ga_assert_ok(GpuArray_read(buf, sizeof(buf), &b));
+  for (i = 0; i < 6; i++)
+    for (j = 0; j < 8; j++) {
+      if (j >= 2 && j < 5)
+        ck_assert_int_eq(buf[i * 8 + j], i * 8 + j);
+      else
+        ck_assert_int_eq(buf[i * 8 + j], 0);
+    }
+
+  /* Shapes must match when the arrays are not contiguous */
+  ck_assert_int_eq(GpuArray_transfer(&b, &v), GA_VALUE_ERROR);
+
+  GpuArray_clear(&w);
+  GpuArray_clear(&b);
+  GpuArray_clear(&r);
+  GpuArray_clear(&v);
+  GpuArray_clear(&a);
+  gpucontext_deref(ctx2);
+}
+END_TEST
+
+START_TEST(test_transfer_many) {
+  const size_t dims[2] = {6, 8};
+  const ssize_t starts[2] = {0, 2};
+  const ssize_t stops[2] = {6, 5};
+  const ssize_t steps[2] = {1, 1};
+  const char *name = NULL;
+  gpucontext_props *p;
+  gpucontext *ctx2;
+  uint32_t data[48];
+  uint32_t buf[48];
+  GpuArray a[3], r[3];
+  GpuArray *rs[3];
+  const GpuArray *as[3];
+  unsigned int i, j, k;
+
+  ga_assert_ok(gpucontext_props_new(&p));
+  ck_assert_int_eq(get_env_dev(&name, p), 0);
+  ga_assert_ok(gpucontext_init(&ctx2, name, p));
+
+  for (k = 0; k < 3; k++) {
+    for (i = 0; i < 48; i++)
+      data[i] = k * 100 + i;
+    ga_assert_ok(GpuArray_empty(&a[k], ctx, GA_UINT, 2, dims, GA_C_ORDER));
+    ga_assert_ok(GpuArray_write(&a[k], data, sizeof(data)));
+    ga_assert_ok(GpuArray_empty(&r[k], ctx2, GA_UINT, 2, dims, GA_C_ORDER));
+    ga_assert_ok(GpuArray_memset(&r[k], 0));
+    rs[k] = &r[k];
+    as[k] = &a[k];
+  }
+  /* The last pair is strided and goes through GpuArray_transfer() */
+  ga_assert_ok(GpuArray_index_inplace(&a[2], starts, stops, steps));
+  ga_assert_ok(GpuArray_index_inplace(&r[2], starts, stops, steps));
+
+  ga_assert_ok(GpuArray_transfer_many(rs, as, 3));
+
+  for (k = 0; k < 2; k++) {
+    ga_assert_ok(GpuArray_read(buf, sizeof(buf), &r[k]));
+    for (i = 0; i < 48; i++)
+      ck_assert_int_eq(buf[i], k * 100 + i);
+  }
+  ga_assert_ok(GpuArray_read(buf, 18 * sizeof(uint32_t), &r[2]));
+  for (i = 0; i < 6; i++)
+    for (j = 0; j < 3; j++)
+      ck_assert_int_eq(buf[i * 3 + j], 200 + i * 8 + j + 2);
+
+  ga_assert_ok(GpuArray_transfer_many(rs, as, 0));
+
+  for (k = 0; k < 3; k++) {
+    GpuArray_clear(&r[k]);
+    GpuArray_clear(&a[k]);
+  }
+  gpucontext_deref(ctx2);
+}
+END_TEST
+
+static const char keyed_src[] =
+  "#include \"cluda.h\"\n"
+  "KERNEL void keyed(GLOBAL_MEM ga_uint *a, ga_size off) {\n"
+  "  a = (GLOBAL_MEM ga_uint *)(((GLOBAL_MEM char *)a) + off);\n"
+  "  a[LID_0] = LID_0;\n"
+  "}\n";
+
+static int keyed_gen(void *data, char **src, size_t *len) {
+  (*(int *)data)++;
+  *len = sizeof(keyed_src) - 1;
+  *src = malloc(*len);
+  if (*src == NULL)
+    return GA_MEMORY_ERROR;
+  memcpy(*src, keyed_src, *len);
+  return GA_NO_ERROR;
+}
+
+START_TEST(test_kernel_keyed) {
+  const int types[2] = {GA_BUFFER, GA_SIZE};
+  const int key[2] = {1, 2};
+  const int other[2] = {1, 3};
+  GpuKernel k1, k2, k3;
+  int ncalls = 0;
+
+  ga_assert_ok(GpuKernel_init_keyed(&k1, ctx, key, sizeof(key), keyed_gen,
+                                    &ncalls, "keyed", 2, types, 0, NULL));
+  ck_assert_int_eq(ncalls, 1);
+
+  /* Same signature, the source is not generated again */
+  ga_assert_ok(GpuKernel_init_keyed(&k2, ctx, key, sizeof(key), keyed_gen,
+                                    &ncalls, "keyed", 2, types, 0, NULL));
+  ck_assert_int_eq(ncalls, 1);
+  ck_assert_ptr_eq(k1.k, k2.k);
+
+  ga_assert_ok(GpuKernel_init_keyed(&k3, ctx, other, sizeof(other),
+                                    keyed_gen, &ncalls, "keyed", 2, types, 0,
+                                    NULL));
+  ck_assert_int_eq(ncalls, 2);
+
+  GpuKernel_clear(&k1);
+  GpuKernel_clear(&k2);
+  GpuKernel_clear(&k3);
+}
+END_TEST
+
 Suite *get_suite(void) {
   Suite *s = suite_create("array");
   TCase *tc = tcase_create("take1");
@@ -299,6 +561,11 @@ Suite *get_suite(void) {
   tcase_add_test(tc, test_take1_ok);
   tcase_add_test(tc, test_take1_offset);
   tcase_add_test(tc, test_reshape_0);
+  tcase_add_test(tc, test_shape_inline);
+  tcase_add_test(tc, test_write_read_strided);
+  tcase_add_test(tc, test_transfer_strided);
+  tcase_add_test(tc, test_transfer_many);
+  tcase_add_test(tc, test_kernel_keyed);
   suite_add_tcase(s, tc);
   return s;
 }
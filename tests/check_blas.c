@@ -111,6 +111,36 @@ START_TEST(test_gemmBatch_3d_S) {
 }
 END_TEST
 
+START_TEST(test_cgemm_conj) {
+  GpuArray A;
+  GpuArray B;
+  GpuArray C;
+
+  size_t dims[2] = {2, 2};
+  /* (r, i) pairs, A = [[1+i, 2], [0, 1-i]], B = [[1, i], [2, 0]] */
+  static const float dA[] = {1, 1, 2, 0, 0, 0, 1, -1};
+  static const float dB[] = {1, 0, 0, 1, 2, 0, 0, 0};
+  const float res_n[] = {5, 1, -1, 1, 2, -2, 0, 0};
+  const float res_c[] = {1, -1, 1, 1, 4, 2, 0, 2};
+  float data[8];
+
+  ga_assert_ok(GpuArray_empty(&A, ctx, GA_CFLOAT, 2, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_empty(&B, ctx, GA_CFLOAT, 2, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_empty(&C, ctx, GA_CFLOAT, 2, dims, GA_C_ORDER));
+
+  ga_assert_ok(GpuArray_write(&A, dA, sizeof(dA)));
+  ga_assert_ok(GpuArray_write(&B, dB, sizeof(dB)));
+
+  ga_assert_ok(GpuArray_rgemm(cb_no_trans, cb_no_trans, 1, &A, &B, 0, &C, 1));
+  ga_assert_ok(GpuArray_read(data, sizeof(data), &C));
+  ck_assert_fbuf_eq(data, res_n, sizeof(res_n)/sizeof(float));
+
+  ga_assert_ok(GpuArray_rgemm(cb_conj_trans, cb_no_trans, 1, &A, &B, 0, &C, 1));
+  ga_assert_ok(GpuArray_read(data, sizeof(data), &C));
+  ck_assert_fbuf_eq(data, res_c, sizeof(res_c)/sizeof(float));
+}
+END_TEST
+
 Suite *get_suite(void) {
   Suite *s = suite_create("blas");
   TCase *tc = tcase_create("all");
@@ -119,6 +149,7 @@ Suite *get_suite(void) {
   tcase_add_test(tc, test_gemmBatch_3d_C);
   tcase_add_test(tc, test_gemmBatch_3d_F);
   tcase_add_test(tc, test_gemmBatch_3d_S);
+  tcase_add_test(tc, test_cgemm_conj);
   suite_add_tcase(s, tc);
   return s;
 }
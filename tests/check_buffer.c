@@ -10,6 +10,8 @@ extern void *ctx;
 void setup(void);
 void teardown(void);
 
+#define ga_assert_ok(e) ck_assert_int_eq(e, GA_NO_ERROR)
+
 static unsigned int refcnt(gpudata *b) {
   unsigned int res;
   int err;
@@ -176,6 +178,122 @@ START_TEST(test_buffer_move) {
 }
 END_TEST
 
+START_TEST(test_buffer_managed) {
+  const int32_t data[] = {0, 1, 2, 3, 4, 5, 6, 7};
+  int32_t buf[nelems(data)];
+  int32_t *p;
+  gpudata *d;
+  gpudata *d2;
+  int err;
+  unsigned int i;
+
+  d = gpudata_alloc(ctx, sizeof(data), NULL, GA_BUFFER_MANAGED, &err);
+  if (d == NULL) {
+    ck_assert_int_eq(err, GA_DEVSUP_ERROR);
+    return;
+  }
+
+  d2 = gpudata_alloc(ctx, sizeof(data), NULL, 0, NULL);
+  ck_assert(d2 != NULL);
+  ck_assert_int_eq(gpudata_property(d2, GA_BUFFER_PROP_HOSTPOINTER, &p),
+                   GA_VALUE_ERROR);
+  ck_assert_int_eq(gpudata_prefetch(d2, 0, sizeof(data), GA_LOCATION_HOST),
+                   GA_VALUE_ERROR);
+
+  err = gpudata_property(d, GA_BUFFER_PROP_HOSTPOINTER, &p);
+  ck_assert_int_eq(err, GA_NO_ERROR);
+  memcpy(p, data, sizeof(data));
+
+  err = gpudata_advise(d, 0, sizeof(data), GA_ADVISE_READ_MOSTLY,
+                       GA_LOCATION_DEVICE);
+  ck_assert(err == GA_NO_ERROR || err == GA_DEVSUP_ERROR);
+  err = gpudata_prefetch(d, 0, sizeof(data), GA_LOCATION_DEVICE);
+  ck_assert(err == GA_NO_ERROR || err == GA_DEVSUP_ERROR);
+
+  ck_assert_int_eq(gpudata_move(d2, 0, d, 0, sizeof(data)), GA_NO_ERROR);
+  ck_assert_int_eq(gpudata_read(buf, d2, 0, sizeof(data)), GA_NO_ERROR);
+  for (i = 0; i < nelems(data); i++) {
+    ck_assert_int_eq(buf[i], data[i]);
+  }
+
+  ck_assert_int_eq(gpudata_memset(d, 0, 0), GA_NO_ERROR);
+  ck_assert_int_eq(gpudata_sync(d), GA_NO_ERROR);
+  for (i = 0; i < nelems(data); i++) {
+    ck_assert_int_eq(p[i], 0);
+  }
+
+  gpudata_release(d);
+  gpudata_release(d2);
+}
+END_TEST
+
+START_TEST(test_buffer_trim_cache) {
+  gpudata *d;
+  size_t before, after, freed;
+
+  ck_assert_int_eq(gpucontext_property(ctx, GA_CTX_PROP_CACHE_RECLAIMED,
+                                       &before), GA_NO_ERROR);
+
+  d = gpudata_alloc(ctx, 1024 * 1024, NULL, 0, NULL);
+  ck_assert(d != NULL);
+  gpudata_release(d);
+
+  ck_assert_int_eq(gpucontext_trim_cache(ctx, &freed), GA_NO_ERROR);
+  ck_assert_int_eq(gpucontext_property(ctx, GA_CTX_PROP_CACHE_RECLAIMED,
+                                       &after), GA_NO_ERROR);
+  ck_assert(after == before + freed);
+
+  /* Nothing left to free */
+  ck_assert_int_eq(gpucontext_trim_cache(ctx, &freed), GA_NO_ERROR);
+  ck_assert(freed == 0);
+
+  /* The allocator still works after a trim */
+  d = gpudata_alloc(ctx, 1024, NULL, 0, NULL);
+  ck_assert(d != NULL);
+  gpudata_release(d);
+}
+END_TEST
+
+START_TEST(test_buffer_alloc_stats) {
+  gpudata *d;
+  size_t in_use, blocks, reserved, cached, peak, n;
+  char *dump;
+  int err;
+
+  err = gpucontext_property(ctx, GA_CTX_PROP_MEM_IN_USE, &in_use);
+  if (err == GA_DEVSUP_ERROR)
+    return;
+  ck_assert_int_eq(err, GA_NO_ERROR);
+  ga_assert_ok(gpucontext_property(ctx, GA_CTX_PROP_MEM_BLOCKS, &blocks));
+
+  d = gpudata_alloc(ctx, 4096, NULL, 0, NULL);
+  ck_assert(d != NULL);
+
+  ga_assert_ok(gpucontext_property(ctx, GA_CTX_PROP_MEM_IN_USE, &n));
+  ck_assert(n >= in_use + 4096);
+  ga_assert_ok(gpucontext_property(ctx, GA_CTX_PROP_MEM_BLOCKS, &n));
+  ck_assert(n == blocks + 1);
+  ga_assert_ok(gpucontext_property(ctx, GA_CTX_PROP_MEM_RESERVED, &reserved));
+  ga_assert_ok(gpucontext_property(ctx, GA_CTX_PROP_MEM_CACHED, &cached));
+  ga_assert_ok(gpucontext_property(ctx, GA_CTX_PROP_MEM_IN_USE, &n));
+  ck_assert(reserved == n + cached);
+  ga_assert_ok(gpucontext_property(ctx, GA_CTX_PROP_MEM_PEAK, &peak));
+  ck_assert(peak >= n);
+
+  gpudata_release(d);
+  ga_assert_ok(gpucontext_property(ctx, GA_CTX_PROP_MEM_IN_USE, &n));
+  ck_assert(n == in_use);
+
+  ga_assert_ok(gpucontext_dump_allocator(ctx, &dump, 0));
+  ck_assert(strstr(dump, "in_use") != NULL);
+  free(dump);
+  ga_assert_ok(gpucontext_dump_allocator(ctx, &dump, GA_DUMP_JSON));
+  ck_assert(dump[0] == '{');
+  ck_assert(strstr(dump, "\"free_buckets\"") != NULL);
+  free(dump);
+}
+END_TEST
+
 Suite *get_suite(void) {
   Suite *s = suite_create("buffer");
   TCase *tc = tcase_create("API");
@@ -185,6 +303,9 @@ Suite *get_suite(void) {
   tcase_add_test(tc, test_buffer_share);
   tcase_add_test(tc, test_buffer_read_write);
   tcase_add_test(tc, test_buffer_move);
+  tcase_add_test(tc, test_buffer_managed);
+  tcase_add_test(tc, test_buffer_trim_cache);
+  tcase_add_test(tc, test_buffer_alloc_stats);
   suite_add_tcase(s, tc);
   return s;
 }
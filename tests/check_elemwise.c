@@ -6,6 +6,8 @@
 #include "gpuarray/error.h"
 #include "gpuarray/types.h"
 
+#include "private.h"
+
 extern void *ctx;
 
 void setup(void);
@@ -72,6 +74,94 @@ START_TEST(test_contig_simple) {
 }
 END_TEST
 
+START_TEST(test_contig_canonical) {
+  GpuArray a;
+  GpuArray b;
+  GpuArray c;
+
+  GpuElemwise *ge1, *ge2, *ge3;
+
+  static const uint32_t data1[3] = {1, 2, 3};
+  static const uint32_t data2[3] = {4, 5, 6};
+  uint32_t data3[3] = {0};
+
+  size_t dims[1];
+
+  gpuelemwise_arg args1[3] = {{0}};
+  gpuelemwise_arg args2[3] = {{0}};
+  void *rargs[3];
+
+  dims[0] = 3;
+
+  ga_assert_ok(GpuArray_empty(&a, ctx, GA_UINT, 1, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_write(&a, data1, sizeof(data1)));
+
+  ga_assert_ok(GpuArray_empty(&b, ctx, GA_UINT, 1, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_write(&b, data2, sizeof(data2)));
+
+  ga_assert_ok(GpuArray_empty(&c, ctx, GA_UINT, 1, dims, GA_C_ORDER));
+
+  args1[0].name = "a";
+  args1[0].typecode = GA_UINT;
+  args1[0].flags = GE_READ;
+  args1[1].name = "b";
+  args1[1].typecode = GA_UINT;
+  args1[1].flags = GE_READ;
+  args1[2].name = "c";
+  args1[2].typecode = GA_UINT;
+  args1[2].flags = GE_WRITE;
+
+  args2[0].name = "x";
+  args2[0].typecode = GA_UINT;
+  args2[0].flags = GE_READ;
+  args2[1].name = "y";
+  args2[1].typecode = GA_UINT;
+  args2[1].flags = GE_READ;
+  args2[2].name = "out";
+  args2[2].typecode = GA_UINT;
+  args2[2].flags = GE_WRITE;
+
+  /* Same kernel under different names and spacing */
+  ge1 = GpuElemwise_new(ctx, "", "c = a + b", 3, args1, 1, 0);
+  ck_assert_ptr_ne(ge1, NULL);
+  ge2 = GpuElemwise_new(ctx, "", "out=x  +\ty", 3, args2, 1, 0);
+  ck_assert_ptr_ne(ge2, NULL);
+  /* The preamble refers to an argument so names are kept */
+  ge3 = GpuElemwise_new(ctx, "#define ADD(u) ((u) + b * 2)\n", "c = ADD(a)",
+                        3, args1, 1, 0);
+  ck_assert_ptr_ne(ge3, NULL);
+
+  /* The renamed kernels come from the same cache entry */
+  ck_assert_ptr_eq(GpuElemwise_contig_kernel(ge1),
+                   GpuElemwise_contig_kernel(ge2));
+  ck_assert_ptr_ne(GpuElemwise_contig_kernel(ge1),
+                   GpuElemwise_contig_kernel(ge3));
+
+  rargs[0] = &a;
+  rargs[1] = &b;
+  rargs[2] = &c;
+
+  ga_assert_ok(GpuElemwise_call(ge2, rargs, GE_NOCOLLAPSE));
+  ga_assert_ok(GpuArray_read(data3, sizeof(data3), &c));
+  ck_assert_int_eq(data3[0], 5);
+  ck_assert_int_eq(data3[1], 7);
+  ck_assert_int_eq(data3[2], 9);
+
+  ga_assert_ok(GpuElemwise_call(ge3, rargs, GE_NOCOLLAPSE));
+  ga_assert_ok(GpuArray_read(data3, sizeof(data3), &c));
+  ck_assert_int_eq(data3[0], 9);
+  ck_assert_int_eq(data3[1], 12);
+  ck_assert_int_eq(data3[2], 15);
+
+  GpuElemwise_free(ge1);
+  GpuElemwise_free(ge2);
+  GpuElemwise_free(ge3);
+  GpuArray_clear(&a);
+  GpuArray_clear(&b);
+  GpuArray_clear(&c);
+}
+END_TEST
+
 START_TEST(test_contig_f16) {
   GpuArray a;
   GpuArray b;
@@ -177,6 +267,159 @@ START_TEST(test_contig_0) {
 }
 END_TEST
 
+START_TEST(test_contig_capture) {
+  GpuArray a;
+  GpuArray b;
+  GpuArray c;
+
+  GpuElemwise *ge;
+  gpugraph *g;
+
+  static const uint32_t data1[3] = {1, 2, 3};
+  static const uint32_t data2[3] = {4, 5, 6};
+  static const uint32_t data4[3] = {10, 20, 30};
+  uint32_t data3[3] = {0};
+
+  size_t dims[1];
+
+  gpuelemwise_arg args[3] = {{0}};
+  void *rargs[3];
+  int err;
+
+  dims[0] = 3;
+
+  ga_assert_ok(GpuArray_empty(&a, ctx, GA_UINT, 1, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_write(&a, data1, sizeof(data1)));
+
+  ga_assert_ok(GpuArray_empty(&b, ctx, GA_UINT, 1, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_write(&b, data2, sizeof(data2)));
+
+  ga_assert_ok(GpuArray_empty(&c, ctx, GA_UINT, 1, dims, GA_C_ORDER));
+
+  args[0].name = "a";
+  args[0].typecode = GA_UINT;
+  args[0].flags = GE_READ;
+
+  args[1].name = "b";
+  args[1].typecode = GA_UINT;
+  args[1].flags = GE_READ;
+
+  args[2].name = "c";
+  args[2].typecode = GA_UINT;
+  args[2].flags = GE_WRITE;
+
+  ge = GpuElemwise_new(ctx, "", "c = a + b", 3, args, 1, 0);
+
+  ck_assert_ptr_ne(ge, NULL);
+
+  rargs[0] = &a;
+  rargs[1] = &b;
+  rargs[2] = &c;
+
+  ga_assert_ok(gpucontext_capture_begin(ctx));
+  ga_assert_ok(GpuElemwise_call(ge, rargs, GE_NOCOLLAPSE));
+  ck_assert_int_eq(GpuArray_read(data3, sizeof(data3), &c), GA_INVALID_ERROR);
+  g = gpucontext_capture_end(ctx, &err);
+  ck_assert_ptr_ne(g, NULL);
+
+  /* Nothing ran during the capture */
+  ga_assert_ok(GpuArray_memset(&c, 0));
+  ga_assert_ok(GpuArray_read(data3, sizeof(data3), &c));
+  ck_assert_int_eq(data3[0], 0);
+
+  ga_assert_ok(gpugraph_launch(g));
+  ga_assert_ok(GpuArray_read(data3, sizeof(data3), &c));
+  ck_assert_int_eq(data3[0], 5);
+  ck_assert_int_eq(data3[1], 7);
+  ck_assert_int_eq(data3[2], 9);
+
+  /* Replays see the new contents of the buffers */
+  ga_assert_ok(GpuArray_write(&a, data4, sizeof(data4)));
+  ga_assert_ok(gpugraph_launch(g));
+  ga_assert_ok(GpuArray_read(data3, sizeof(data3), &c));
+  ck_assert_int_eq(data3[0], 14);
+  ck_assert_int_eq(data3[1], 25);
+  ck_assert_int_eq(data3[2], 36);
+
+  gpugraph_release(g);
+  GpuElemwise_free(ge);
+  GpuArray_clear(&a);
+  GpuArray_clear(&b);
+  GpuArray_clear(&c);
+}
+END_TEST
+
+START_TEST(test_contig_complex) {
+  GpuArray a;
+  GpuArray b;
+  GpuArray c;
+  GpuArray d;
+
+  GpuElemwise *ge;
+
+  /* (r, i) pairs */
+  static const float data1[6] = {0, 2, 3, -4, 0, 1};
+  static const float data2[6] = {3, -4, 1, 0, 0, 1};
+  float data3[6] = {0};
+  float data4[3] = {0};
+
+  size_t dims[1];
+
+  gpuelemwise_arg args[4] = {{0}};
+  void *rargs[4];
+
+  dims[0] = 3;
+
+  ga_assert_ok(GpuArray_empty(&a, ctx, GA_CFLOAT, 1, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_write(&a, data1, sizeof(data1)));
+
+  ga_assert_ok(GpuArray_empty(&b, ctx, GA_CFLOAT, 1, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_write(&b, data2, sizeof(data2)));
+
+  ga_assert_ok(GpuArray_empty(&c, ctx, GA_CFLOAT, 1, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_empty(&d, ctx, GA_FLOAT, 1, dims, GA_C_ORDER));
+
+  args[0].name = "a";
+  args[0].typecode = GA_CFLOAT;
+  args[0].flags = GE_READ;
+
+  args[1].name = "b";
+  args[1].typecode = GA_CFLOAT;
+  args[1].flags = GE_READ;
+
+  args[2].name = "c";
+  args[2].typecode = GA_CFLOAT;
+  args[2].flags = GE_WRITE;
+
+  args[3].name = "d";
+  args[3].typecode = GA_FLOAT;
+  args[3].flags = GE_WRITE;
+
+  ge = GpuElemwise_new(ctx, "", "c = ga_cfloat_mul(a, b); d = ga_cfloat_abs(a)",
+                       4, args, 1, 0);
+
+  ck_assert_ptr_ne(ge, NULL);
+
+  rargs[0] = &a;
+  rargs[1] = &b;
+  rargs[2] = &c;
+  rargs[3] = &d;
+
+  ga_assert_ok(GpuElemwise_call(ge, rargs, GE_NOCOLLAPSE));
+
+  ga_assert_ok(GpuArray_read(data3, sizeof(data3), &c));
+  ga_assert_ok(GpuArray_read(data4, sizeof(data4), &d));
+
+  ck_assert(data3[0] == 8 && data3[1] == 6);
+  ck_assert(data3[2] == 3 && data3[3] == -4);
+  ck_assert(data3[4] == -1 && data3[5] == 0);
+
+  ck_assert(data4[0] == 2);
+  ck_assert(data4[1] == 5);
+  ck_assert(data4[2] == 1);
+}
+END_TEST
+
 START_TEST(test_basic_simple) {
   GpuArray a;
   GpuArray b;
@@ -760,6 +1003,107 @@ START_TEST(test_basic_neg_strides) {
 }
 END_TEST
 
+START_TEST(test_basic_specialize) {
+  GpuArray a;
+  GpuArray b;
+  GpuArray c;
+
+  GpuElemwise *ge;
+
+  static const uint32_t data1[6] = {1, 2, 3, 4, 5, 6};
+  static const uint32_t data2[6] = {7, 8, 9, 10, 11, 12};
+  static const uint32_t res1[6] = {8, 12, 11, 15, 14, 18};
+  static const uint32_t res2[6] = {8, 11, 14, 12, 15, 18};
+  uint32_t data3[6] = {0};
+
+  size_t dims[2];
+
+  gpuelemwise_arg args[3] = {{0}};
+  void *rargs[3];
+  unsigned int i, j;
+
+  dims[0] = 3;
+  dims[1] = 2;
+
+  ga_assert_ok(GpuArray_empty(&a, ctx, GA_UINT, 2, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_write(&a, data1, sizeof(data1)));
+
+  ga_assert_ok(GpuArray_empty(&b, ctx, GA_UINT, 2, dims, GA_F_ORDER));
+  ga_assert_ok(GpuArray_write(&b, data2, sizeof(data2)));
+
+  ga_assert_ok(GpuArray_empty(&c, ctx, GA_UINT, 2, dims, GA_C_ORDER));
+
+  args[0].name = "a";
+  args[0].typecode = GA_UINT;
+  args[0].flags = GE_READ;
+
+  args[1].name = "b";
+  args[1].typecode = GA_UINT;
+  args[1].flags = GE_READ;
+
+  args[2].name = "c";
+  args[2].typecode = GA_UINT;
+  args[2].flags = GE_WRITE;
+
+  ge = GpuElemwise_new(ctx, "", "c = a + b", 3, args, 2, 0);
+
+  ck_assert_ptr_ne(ge, NULL);
+  ga_assert_ok(GpuElemwise_specialize(ge, 1));
+
+  rargs[0] = &a;
+  rargs[1] = &b;
+  rargs[2] = &c;
+
+  /* The first call uses the generic kernel, the others the specialised one */
+  for (i = 0; i < 3; i++) {
+    ga_assert_ok(GpuArray_memset(&c, 0));
+    ga_assert_ok(GpuElemwise_call(ge, rargs, 0));
+    ck_assert_uint_eq(GpuElemwise_spec_kernels(ge), i == 0 ? 0 : 1);
+    ga_assert_ok(GpuArray_read(data3, sizeof(data3), &c));
+    for (j = 0; j < 6; j++)
+      ck_assert_int_eq(data3[j], res1[j]);
+  }
+
+  GpuArray_clear(&a);
+  GpuArray_clear(&b);
+  GpuArray_clear(&c);
+
+  /* Another shape must not use the kernel for the first one */
+  dims[0] = 2;
+  dims[1] = 3;
+
+  ga_assert_ok(GpuArray_empty(&a, ctx, GA_UINT, 2, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_write(&a, data1, sizeof(data1)));
+
+  ga_assert_ok(GpuArray_empty(&b, ctx, GA_UINT, 2, dims, GA_F_ORDER));
+  ga_assert_ok(GpuArray_write(&b, data2, sizeof(data2)));
+
+  ga_assert_ok(GpuArray_empty(&c, ctx, GA_UINT, 2, dims, GA_C_ORDER));
+
+  for (i = 0; i < 3; i++) {
+    ga_assert_ok(GpuArray_memset(&c, 0));
+    ga_assert_ok(GpuElemwise_call(ge, rargs, 0));
+    ck_assert_uint_eq(GpuElemwise_spec_kernels(ge), i == 0 ? 1 : 2);
+    ga_assert_ok(GpuArray_read(data3, sizeof(data3), &c));
+    for (j = 0; j < 6; j++)
+      ck_assert_int_eq(data3[j], res2[j]);
+  }
+
+  ga_assert_ok(GpuElemwise_specialize(ge, 0));
+  ga_assert_ok(GpuArray_memset(&c, 0));
+  ga_assert_ok(GpuElemwise_call(ge, rargs, 0));
+  ck_assert_uint_eq(GpuElemwise_spec_kernels(ge), 0);
+  ga_assert_ok(GpuArray_read(data3, sizeof(data3), &c));
+  for (j = 0; j < 6; j++)
+    ck_assert_int_eq(data3[j], res2[j]);
+
+  GpuElemwise_free(ge);
+  GpuArray_clear(&a);
+  GpuArray_clear(&b);
+  GpuArray_clear(&c);
+}
+END_TEST
+
 START_TEST(test_basic_0) {
   GpuArray a;
   GpuArray b;
@@ -813,6 +1157,9 @@ Suite *get_suite(void) {
   tcase_add_test(tc, test_contig_simple);
   tcase_add_test(tc, test_contig_f16);
   tcase_add_test(tc, test_contig_0);
+  tcase_add_test(tc, test_contig_capture);
+  tcase_add_test(tc, test_contig_canonical);
+  tcase_add_test(tc, test_contig_complex);
   suite_add_tcase(s, tc);
   tc = tcase_create("basic");
   tcase_set_timeout(tc, 8.0);
@@ -826,6 +1173,7 @@ Suite *get_suite(void) {
   tcase_add_test(tc, test_basic_padshape);
   tcase_add_test(tc, test_basic_collapse);
   tcase_add_test(tc, test_basic_neg_strides);
+  tcase_add_test(tc, test_basic_specialize);
   tcase_add_test(tc, test_basic_0);
   suite_add_tcase(s, tc);
   return s;
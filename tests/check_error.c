@@ -1,6 +1,11 @@
+#include <pthread.h>
+#include <string.h>
+
 #include <check.h>
 
+#include "gpuarray/buffer.h"
 #include "gpuarray/error.h"
+#include "util/error.h"
 
 START_TEST(test_error_str) {
   const char *msg;
@@ -14,10 +19,72 @@ START_TEST(test_error_str) {
 }
 END_TEST
 
+struct other_error {
+  gpucontext_props *p;
+  int code;
+  char msg[256];
+};
+
+static void *set_other_error(void *arg) {
+  struct other_error *o = arg;
+
+  o->code = gpucontext_props_sched(o->p, 99);
+  /* The message lives in storage private to this thread */
+  strncpy(o->msg, gpucontext_error(NULL, 0), sizeof(o->msg) - 1);
+  return NULL;
+}
+
+START_TEST(test_error_per_thread) {
+  struct other_error o;
+  pthread_t th;
+
+  memset(&o, 0, sizeof(o));
+  ck_assert_int_eq(gpucontext_props_new(&o.p), GA_NO_ERROR);
+  ck_assert_int_eq(gpucontext_props_alloc_cache(o.p, 2, 1), GA_VALUE_ERROR);
+  ck_assert_str_eq(gpucontext_error(NULL, 0),
+                   "Initial size can't be bigger than max size");
+
+  ck_assert_int_eq(pthread_create(&th, NULL, set_other_error, &o), 0);
+  ck_assert_int_eq(pthread_join(th, NULL), 0);
+  ck_assert_int_eq(o.code, GA_INVALID_ERROR);
+  ck_assert_str_eq(o.msg, "Invalid value for sched: 99");
+
+  /* The error from the other thread doesn't replace ours */
+  ck_assert_str_eq(gpucontext_error(NULL, 0),
+                   "Initial size can't be bigger than max size");
+  gpucontext_props_del(o.p);
+}
+END_TEST
+
+START_TEST(test_error_slot_reuse) {
+  error *e[20];
+  unsigned int i;
+
+  for (i = 0; i < 20; i++)
+    ck_assert_int_eq(error_alloc(&e[i]), 0);
+  ck_assert_int_eq(error_code(e[0]), GA_NO_ERROR);
+  ck_assert_str_eq(error_msg(e[0]), "");
+
+  error_set(e[0], GA_VALUE_ERROR, "first");
+  /* More objects than this thread keeps a copy for */
+  for (i = 1; i < 20; i++)
+    error_fmt(e[i], GA_MISC_ERROR, "error %u", i);
+
+  ck_assert_int_eq(error_code(e[0]), GA_VALUE_ERROR);
+  ck_assert_str_eq(error_msg(e[0]), "first");
+  ck_assert_str_eq(error_msg(e[19]), "error 19");
+
+  for (i = 0; i < 20; i++)
+    error_free(e[i]);
+}
+END_TEST
+
 Suite *get_suite(void) {
   Suite *s = suite_create("error");
   TCase *tc = tcase_create("All");
   tcase_add_test(tc, test_error_str);
+  tcase_add_test(tc, test_error_per_thread);
+  tcase_add_test(tc, test_error_slot_reuse);
   suite_add_tcase(s, tc);
   return s;
 }
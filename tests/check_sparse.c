@@ -0,0 +1,318 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <check.h>
+
+#include "gpuarray/array.h"
+#include "gpuarray/error.h"
+#include "gpuarray/sparse.h"
+#include "gpuarray/types.h"
+
+extern void *ctx;
+
+void setup(void);
+void teardown(void);
+
+#define ga_assert_ok(e) ck_assert_int_eq(e, GA_NO_ERROR)
+
+#define ROWS 40
+#define COLS 33
+#define K 3
+
+/* Mostly short rows, some empty ones and a full one */
+static void fill_dense(float *a) {
+  unsigned int r, c, seed = 7;
+  for (r = 0; r < ROWS; r++) {
+    for (c = 0; c < COLS; c++) {
+      seed = seed * 1103515245 + 12345;
+      if (r == 5 || (r % 4 != 0 && (seed >> 16) % 6 == 0))
+        a[r * COLS + c] = (float)((int)((seed >> 8) % 19) - 9);
+      else
+        a[r * COLS + c] = 0;
+    }
+  }
+}
+
+static void fill_vec(float *x, unsigned int n) {
+  unsigned int i;
+  for (i = 0; i < n; i++)
+    x[i] = (float)((int)(i * 7 % 11) - 5) / 4;
+}
+
+/* Host reference for y = alpha * A x + beta * y with A dense */
+static void ref_spmv(float alpha, const float *a, const float *x,
+                     float beta, float *y) {
+  unsigned int r, c;
+  for (r = 0; r < ROWS; r++) {
+    float s = 0;
+    for (c = 0; c < COLS; c++)
+      s += a[r * COLS + c] * x[c];
+    y[r] = alpha * s + beta * y[r];
+  }
+}
+
+/* Host reference for C = alpha * A B + beta * C with A dense */
+static void ref_spmm(float alpha, const float *a, const float *b,
+                     float beta, float *cm) {
+  unsigned int r, c, j;
+  for (r = 0; r < ROWS; r++) {
+    for (j = 0; j < K; j++) {
+      float s = 0;
+      for (c = 0; c < COLS; c++)
+        s += a[r * COLS + c] * b[c * K + j];
+      cm[r * K + j] = alpha * s + beta * cm[r * K + j];
+    }
+  }
+}
+
+static void ck_assert_fbuf_near(const float *b, const float *r,
+                                unsigned int n) {
+  unsigned int i;
+  for (i = 0; i < n; i++) {
+    ck_assert_msg(fabs(b[i] - r[i]) < 1e-3, "Difference at %u: %f != %f(ref)",
+                  i, b[i], r[i]);
+  }
+}
+
+static void check_spmv(const GpuSparse *s, const float *a, int algo) {
+  GpuArray X, Y;
+  float x[COLS], y[ROWS], ref[ROWS];
+  size_t n;
+  unsigned int i;
+
+  fill_vec(x, COLS);
+  for (i = 0; i < ROWS; i++)
+    y[i] = ref[i] = (float)(i % 3);
+  ref_spmv(2, a, x, 0.5, ref);
+
+  n = COLS;
+  ga_assert_ok(GpuArray_empty(&X, ctx, GA_FLOAT, 1, &n, GA_C_ORDER));
+  n = ROWS;
+  ga_assert_ok(GpuArray_empty(&Y, ctx, GA_FLOAT, 1, &n, GA_C_ORDER));
+  ga_assert_ok(GpuArray_write(&X, x, sizeof(x)));
+  ga_assert_ok(GpuArray_write(&Y, y, sizeof(y)));
+
+  ga_assert_ok(GpuSparse_spmv(2, s, &X, 0.5, &Y, algo));
+  ga_assert_ok(GpuArray_read(y, sizeof(y), &Y));
+  ck_assert_fbuf_near(y, ref, ROWS);
+
+  GpuArray_clear(&X);
+  GpuArray_clear(&Y);
+}
+
+static void check_spmm(const GpuSparse *s, const float *a) {
+  GpuArray B, C;
+  float b[COLS * K], cm[ROWS * K], ref[ROWS * K];
+  size_t dims[2];
+  unsigned int i;
+
+  fill_vec(b, COLS * K);
+  for (i = 0; i < ROWS * K; i++)
+    cm[i] = ref[i] = (float)(i % 5);
+  ref_spmm(-1, a, b, 2, ref);
+
+  dims[0] = COLS;
+  dims[1] = K;
+  ga_assert_ok(GpuArray_empty(&B, ctx, GA_FLOAT, 2, dims, GA_C_ORDER));
+  dims[0] = ROWS;
+  ga_assert_ok(GpuArray_empty(&C, ctx, GA_FLOAT, 2, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_write(&B, b, sizeof(b)));
+  ga_assert_ok(GpuArray_write(&C, cm, sizeof(cm)));
+
+  ga_assert_ok(GpuSparse_spmm(-1, s, &B, 2, &C));
+  ga_assert_ok(GpuArray_read(cm, sizeof(cm), &C));
+  ck_assert_fbuf_near(cm, ref, ROWS * K);
+
+  GpuArray_clear(&B);
+  GpuArray_clear(&C);
+}
+
+START_TEST(test_csr_from_dense) {
+  GpuArray A;
+  GpuSparse s;
+  float a[ROWS * COLS];
+  float data[ROWS * COLS];
+  int indices[ROWS * COLS];
+  int ptr[ROWS + 1];
+  size_t dims[2] = {ROWS, COLS};
+  unsigned int r, c, j;
+
+  fill_dense(a);
+  ga_assert_ok(GpuArray_empty(&A, ctx, GA_FLOAT, 2, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_write(&A, a, sizeof(a)));
+  ga_assert_ok(GpuSparse_from_dense(&s, &A, GA_SPARSE_CSR, GA_INT));
+  ck_assert_int_eq(s.format, GA_SPARSE_CSR);
+  ck_assert_uint_eq(s.max_row, COLS);
+
+  ga_assert_ok(GpuArray_read(ptr, sizeof(ptr), &s.ptr));
+  ga_assert_ok(GpuArray_read(data, s.nnz * sizeof(float), &s.data));
+  ga_assert_ok(GpuArray_read(indices, s.nnz * sizeof(int), &s.indices));
+  j = 0;
+  for (r = 0; r < ROWS; r++) {
+    ck_assert_int_eq(ptr[r], j);
+    for (c = 0; c < COLS; c++) {
+      if (a[r * COLS + c] != 0) {
+        ck_assert(data[j] == a[r * COLS + c]);
+        ck_assert_int_eq(indices[j], c);
+        j++;
+      }
+    }
+  }
+  ck_assert_uint_eq(s.nnz, j);
+  ck_assert_int_eq(ptr[ROWS], j);
+
+  check_spmv(&s, a, GA_SPMV_AUTO);
+  check_spmv(&s, a, GA_SPMV_CSR_VECTOR);
+  check_spmv(&s, a, GA_SPMV_MERGE_PATH);
+  check_spmm(&s, a);
+
+  GpuSparse_clear(&s);
+  GpuArray_clear(&A);
+}
+END_TEST
+
+START_TEST(test_coo_from_dense) {
+  GpuArray A;
+  GpuSparse s;
+  float a[ROWS * COLS];
+  size_t dims[2] = {ROWS, COLS};
+
+  fill_dense(a);
+  ga_assert_ok(GpuArray_empty(&A, ctx, GA_FLOAT, 2, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_write(&A, a, sizeof(a)));
+
+  ga_assert_ok(GpuSparse_from_dense(&s, &A, GA_SPARSE_COO, GA_LONG));
+  ck_assert_int_eq(s.format, GA_SPARSE_COO);
+  ck_assert_int_eq(GpuSparse_spmv_algo(&s), GA_SPMV_COO);
+  ck_assert_int_eq(GpuSparse_spmv(1, &s, &A, 0, &A, GA_SPMV_CSR_VECTOR),
+                   GA_VALUE_ERROR);
+
+  check_spmv(&s, a, GA_SPMV_AUTO);
+  check_spmm(&s, a);
+
+  GpuSparse_clear(&s);
+  GpuArray_clear(&A);
+}
+END_TEST
+
+START_TEST(test_csr_arrays) {
+  GpuArray D, I, P;
+  GpuSparse s;
+  /* [[1, 0, 2], [0, 0, 0], [0, 3, 0]] */
+  const float data[] = {1, 2, 3};
+  const int indices[] = {0, 2, 1};
+  int ptr[] = {0, 2, 2, 3};
+  size_t n;
+
+  n = 3;
+  ga_assert_ok(GpuArray_empty(&D, ctx, GA_FLOAT, 1, &n, GA_C_ORDER));
+  ga_assert_ok(GpuArray_empty(&I, ctx, GA_INT, 1, &n, GA_C_ORDER));
+  n = 4;
+  ga_assert_ok(GpuArray_empty(&P, ctx, GA_INT, 1, &n, GA_C_ORDER));
+  ga_assert_ok(GpuArray_write(&D, data, sizeof(data)));
+  ga_assert_ok(GpuArray_write(&I, indices, sizeof(indices)));
+  ga_assert_ok(GpuArray_write(&P, ptr, sizeof(ptr)));
+
+  ga_assert_ok(GpuSparse_csr(&s, &D, &I, &P, 3, 3));
+  ck_assert_uint_eq(s.nnz, 3);
+  ck_assert_uint_eq(s.max_row, 2);
+  ck_assert_int_eq(GpuSparse_spmv_algo(&s), GA_SPMV_CSR_VECTOR);
+  GpuSparse_clear(&s);
+
+  ck_assert_int_eq(GpuSparse_csr(&s, &D, &I, &P, 2, 3), GA_VALUE_ERROR);
+  ptr[2] = 1;
+  ga_assert_ok(GpuArray_write(&P, ptr, sizeof(ptr)));
+  ck_assert_int_eq(GpuSparse_csr(&s, &D, &I, &P, 3, 3), GA_VALUE_ERROR);
+
+  /* Columns past the end */
+  ptr[2] = 2;
+  ga_assert_ok(GpuArray_write(&P, ptr, sizeof(ptr)));
+  ck_assert_int_eq(GpuSparse_csr(&s, &D, &I, &P, 3, 2), GA_VALUE_ERROR);
+  ck_assert_int_eq(GpuSparse_csr(&s, &D, &I, &P, 3, (size_t)INT32_MAX + 1),
+                   GA_XLARGE_ERROR);
+
+  GpuArray_clear(&D);
+  GpuArray_clear(&I);
+  GpuArray_clear(&P);
+}
+END_TEST
+
+START_TEST(test_coo_arrays) {
+  GpuArray D, R, C;
+  GpuSparse s;
+  const float data[] = {1, 2, 3};
+  int row[] = {0, 0, 2};
+  const int col[] = {0, 2, 1};
+  size_t n = 3;
+
+  ga_assert_ok(GpuArray_empty(&D, ctx, GA_FLOAT, 1, &n, GA_C_ORDER));
+  ga_assert_ok(GpuArray_empty(&R, ctx, GA_INT, 1, &n, GA_C_ORDER));
+  ga_assert_ok(GpuArray_empty(&C, ctx, GA_INT, 1, &n, GA_C_ORDER));
+  ga_assert_ok(GpuArray_write(&D, data, sizeof(data)));
+  ga_assert_ok(GpuArray_write(&R, row, sizeof(row)));
+  ga_assert_ok(GpuArray_write(&C, col, sizeof(col)));
+
+  ga_assert_ok(GpuSparse_coo(&s, &D, &R, &C, 3, 3));
+  ck_assert_uint_eq(s.nnz, 3);
+  GpuSparse_clear(&s);
+
+  ck_assert_int_eq(GpuSparse_coo(&s, &D, &R, &C, 3, 2), GA_VALUE_ERROR);
+  ck_assert_int_eq(GpuSparse_coo(&s, &D, &R, &C, 2, 3), GA_VALUE_ERROR);
+  row[1] = -1;
+  ga_assert_ok(GpuArray_write(&R, row, sizeof(row)));
+  ck_assert_int_eq(GpuSparse_coo(&s, &D, &R, &C, 3, 3), GA_VALUE_ERROR);
+  ck_assert_int_eq(GpuSparse_coo(&s, &D, &R, &C, (size_t)INT32_MAX + 1, 3),
+                   GA_XLARGE_ERROR);
+
+  GpuArray_clear(&D);
+  GpuArray_clear(&R);
+  GpuArray_clear(&C);
+}
+END_TEST
+
+START_TEST(test_spmv_algo) {
+  GpuArray A;
+  GpuSparse s;
+  float *a;
+  size_t dims[2] = {1024, 1024};
+  unsigned int i;
+
+  a = calloc(1024 * 1024, sizeof(float));
+  ck_assert_ptr_ne(a, NULL);
+  /* A diagonal matrix with one full row */
+  for (i = 0; i < 1024; i++) {
+    a[i * 1024 + i] = 1;
+    a[3 * 1024 + i] = 2;
+  }
+  ga_assert_ok(GpuArray_empty(&A, ctx, GA_FLOAT, 2, dims, GA_C_ORDER));
+  ga_assert_ok(GpuArray_write(&A, a, 1024 * 1024 * sizeof(float)));
+  ga_assert_ok(GpuSparse_from_dense(&s, &A, GA_SPARSE_CSR, GA_INT));
+  ck_assert_int_eq(GpuSparse_spmv_algo(&s), GA_SPMV_MERGE_PATH);
+  GpuSparse_clear(&s);
+
+  for (i = 0; i < 1024; i++)
+    a[3 * 1024 + i] = (i == 3);
+  ga_assert_ok(GpuArray_write(&A, a, 1024 * 1024 * sizeof(float)));
+  ga_assert_ok(GpuSparse_from_dense(&s, &A, GA_SPARSE_CSR, GA_INT));
+  ck_assert_int_eq(GpuSparse_spmv_algo(&s), GA_SPMV_CSR_VECTOR);
+  GpuSparse_clear(&s);
+
+  GpuArray_clear(&A);
+  free(a);
+}
+END_TEST
+
+Suite *get_suite(void) {
+  Suite *s = suite_create("sparse");
+  TCase *tc = tcase_create("all");
+  tcase_add_checked_fixture(tc, setup, teardown);
+  tcase_set_timeout(tc, 16.0);
+  tcase_add_test(tc, test_csr_from_dense);
+  tcase_add_test(tc, test_coo_from_dense);
+  tcase_add_test(tc, test_csr_arrays);
+  tcase_add_test(tc, test_coo_arrays);
+  tcase_add_test(tc, test_spmv_algo);
+  suite_add_tcase(s, tc);
+  return s;
+}
@@ -0,0 +1,167 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <check.h>
+
+#include "util/alloctrace.h"
+
+START_TEST(test_alloctrace_roundtrip) {
+  char path[] = "/tmp/gpuarray_alloctraceXXXXXX";
+  alloc_trace_rec r;
+  alloc_trace *t;
+  error *e;
+  char *name;
+  FILE *f;
+  int a, b;
+  int fd;
+
+  fd = mkstemp(path);
+  ck_assert_int_ne(fd, -1);
+  close(fd);
+
+  ck_assert_int_eq(error_alloc(&e), 0);
+  t = alloc_trace_open(path, e);
+  ck_assert_ptr_ne(t, NULL);
+
+  alloc_trace_alloc(t, &a, 100, 0);
+  alloc_trace_tag(t, "layer1");
+  alloc_trace_alloc(t, &b, 200, 0x20);
+  alloc_trace_free(t, &a);
+  alloc_trace_tag(t, NULL);
+  alloc_trace_free(t, &b);
+  alloc_trace_close(t);
+  /* Recording to a NULL trace is a no-op */
+  alloc_trace_alloc(NULL, &a, 1, 0);
+  error_free(e);
+
+  f = fopen(path, "rb");
+  ck_assert_ptr_ne(f, NULL);
+  ck_assert_int_eq(alloc_trace_check(f), 0);
+
+  ck_assert_int_eq(alloc_trace_read(f, &r, NULL), 1);
+  ck_assert_int_eq(r.type, ALLOC_TRACE_ALLOC);
+  ck_assert(r.id == (uint64_t)(uintptr_t)&a);
+  ck_assert(r.size == 100);
+  ck_assert_int_eq(r.tag, 0);
+
+  ck_assert_int_eq(alloc_trace_read(f, &r, &name), 1);
+  ck_assert_int_eq(r.type, ALLOC_TRACE_TAG);
+  ck_assert(r.id == 1);
+  ck_assert_str_eq(name, "layer1");
+  free(name);
+
+  ck_assert_int_eq(alloc_trace_read(f, &r, NULL), 1);
+  ck_assert_int_eq(r.type, ALLOC_TRACE_ALLOC);
+  ck_assert(r.id == (uint64_t)(uintptr_t)&b);
+  ck_assert(r.size == 200);
+  ck_assert_int_eq(r.flags, 0x20);
+  ck_assert_int_eq(r.tag, 1);
+
+  ck_assert_int_eq(alloc_trace_read(f, &r, NULL), 1);
+  ck_assert_int_eq(r.type, ALLOC_TRACE_FREE);
+  ck_assert(r.id == (uint64_t)(uintptr_t)&a);
+  ck_assert_int_eq(r.tag, 1);
+
+  ck_assert_int_eq(alloc_trace_read(f, &r, NULL), 1);
+  ck_assert_int_eq(r.type, ALLOC_TRACE_FREE);
+  ck_assert(r.id == (uint64_t)(uintptr_t)&b);
+  ck_assert_int_eq(r.tag, 0);
+
+  ck_assert_int_eq(alloc_trace_read(f, &r, NULL), 0);
+  fclose(f);
+  remove(path);
+}
+END_TEST
+
+#define NTHREADS 4
+#define NEVENTS 2000
+
+static void *record_events(void *arg) {
+  alloc_trace *t = arg;
+  static const char *tags[] = {"a", "b", "c"};
+  char ids[NEVENTS];
+  unsigned int i;
+
+  for (i = 0; i < NEVENTS; i++) {
+    alloc_trace_alloc(t, &ids[i], i + 1, 0);
+    if (i % 100 == 0)
+      alloc_trace_tag(t, tags[(i / 100) % 3]);
+    alloc_trace_free(t, &ids[i]);
+  }
+  return NULL;
+}
+
+/* Threads sharing a trace must not interleave the records */
+START_TEST(test_alloctrace_threads) {
+  char path[] = "/tmp/gpuarray_alloctraceXXXXXX";
+  pthread_t th[NTHREADS];
+  alloc_trace_rec r;
+  alloc_trace *t;
+  error *e;
+  FILE *f;
+  size_t allocs = 0, frees = 0, tags = 0;
+  unsigned int i;
+  int fd, res;
+
+  fd = mkstemp(path);
+  ck_assert_int_ne(fd, -1);
+  close(fd);
+
+  ck_assert_int_eq(error_alloc(&e), 0);
+  t = alloc_trace_open(path, e);
+  ck_assert_ptr_ne(t, NULL);
+  for (i = 0; i < NTHREADS; i++)
+    ck_assert_int_eq(pthread_create(&th[i], NULL, record_events, t), 0);
+  for (i = 0; i < NTHREADS; i++)
+    ck_assert_int_eq(pthread_join(th[i], NULL), 0);
+  alloc_trace_close(t);
+  error_free(e);
+
+  f = fopen(path, "rb");
+  ck_assert_ptr_ne(f, NULL);
+  ck_assert_int_eq(alloc_trace_check(f), 0);
+  while ((res = alloc_trace_read(f, &r, NULL)) == 1) {
+    if (r.type == ALLOC_TRACE_ALLOC) {
+      ck_assert(r.size >= 1 && r.size <= NEVENTS);
+      allocs++;
+    } else if (r.type == ALLOC_TRACE_FREE) {
+      frees++;
+    } else {
+      ck_assert_int_eq(r.type, ALLOC_TRACE_TAG);
+      ck_assert(r.size == 1);
+      tags++;
+    }
+    ck_assert(r.tag <= 3);
+  }
+  ck_assert_int_eq(res, 0);
+  ck_assert_uint_eq(allocs, NTHREADS * NEVENTS);
+  ck_assert_uint_eq(frees, NTHREADS * NEVENTS);
+  /* Each name is written once */
+  ck_assert_uint_eq(tags, 3);
+  fclose(f);
+  remove(path);
+}
+END_TEST
+
+START_TEST(test_alloctrace_badmagic) {
+  FILE *f = tmpfile();
+
+  ck_assert_ptr_ne(f, NULL);
+  fputs("NOTATRACE", f);
+  rewind(f);
+  ck_assert_int_eq(alloc_trace_check(f), -1);
+  fclose(f);
+}
+END_TEST
+
+Suite *get_suite(void) {
+  Suite *s = suite_create("util_alloctrace");
+  TCase *tc = tcase_create("All");
+  tcase_add_test(tc, test_alloctrace_roundtrip);
+  tcase_add_test(tc, test_alloctrace_badmagic);
+  tcase_add_test(tc, test_alloctrace_threads);
+  suite_add_tcase(s, tc);
+  return s;
+}
@@ -0,0 +1,135 @@
+#include <check.h>
+
+#include "util/sched.h"
+
+/* Recorded device properties */
+
+/* Tesla V100 (sm_70) */
+static const sched_dev v100 = {80, 32, 2147483647, 2048, 32, 65536, 98304};
+/* Tesla K80 (sm_37) */
+static const sched_dev k80 = {13, 32, 2147483647, 2048, 16, 131072, 114688};
+/* GeForce RTX 3090 (sm_86) */
+static const sched_dev rtx3090 = {82, 32, 2147483647, 1536, 16, 65536, 102400};
+/* An OpenCL device, which doesn't report occupancy limits */
+static const sched_dev cldev = {36, 64, 4294967295U, 0, 0, 0, 32768};
+
+START_TEST(test_sched_blocks) {
+  sched_kernel k = {1024, 32, 0};
+
+  /* Limited by the threads */
+  ck_assert_uint_eq(sched_blocks_mp(&v100, &k, 1024), 2);
+  ck_assert_uint_eq(sched_blocks_mp(&v100, &k, 256), 8);
+  /* Limited by the blocks */
+  ck_assert_uint_eq(sched_blocks_mp(&k80, &k, 64), 16);
+  ck_assert_uint_eq(sched_blocks_mp(&v100, &k, 32), 32);
+  /* Limited by the registers (40 regs round up to 1280 per warp) */
+  k.regs = 40;
+  ck_assert_uint_eq(sched_blocks_mp(&v100, &k, 1024), 1);
+  ck_assert_uint_eq(sched_blocks_mp(&v100, &k, 768), 2);
+  ck_assert_uint_eq(sched_blocks_mp(&v100, &k, 256), 6);
+  /* Limited by the local memory */
+  k.regs = 16;
+  k.lmem = 40960;
+  ck_assert_uint_eq(sched_blocks_mp(&v100, &k, 128), 2);
+  /* Too big for the kernel */
+  ck_assert_uint_eq(sched_blocks_mp(&v100, &k, 2048), 0);
+  /* Unknown occupancy */
+  ck_assert_uint_eq(sched_blocks_mp(&cldev, &k, 64), 0);
+}
+END_TEST
+
+START_TEST(test_sched_block_size) {
+  sched_kernel k = {1024, 32, 0};
+  size_t gs, ls;
+
+  /* Everything gets full occupancy, use the biggest block */
+  gs = ls = 0;
+  sched_launch(&v100, &k, 1 << 24, &gs, &ls);
+  ck_assert_uint_eq(ls, 1024);
+
+  /* 51 warps out of 64 at best (3 blocks of 17 warps), while the
+     round sizes only get 48 */
+  k.regs = 40;
+  gs = ls = 0;
+  sched_launch(&v100, &k, 1 << 24, &gs, &ls);
+  ck_assert_uint_eq(ls, 544);
+  ck_assert_uint_eq(sched_blocks_mp(&v100, &k, ls) * ls, 1632);
+
+  /* 1536 threads per multiprocessor: 1024 would leave 512 idle */
+  k.regs = 32;
+  gs = ls = 0;
+  sched_launch(&rtx3090, &k, 1 << 24, &gs, &ls);
+  ck_assert_uint_eq(sched_blocks_mp(&rtx3090, &k, ls) * ls, 1536);
+  ck_assert_uint_eq(ls, 768);
+
+  /* Small problems don't get bigger blocks than needed */
+  gs = ls = 0;
+  sched_launch(&v100, &k, 100, &gs, &ls);
+  ck_assert_uint_eq(ls, 128);
+  ck_assert_uint_eq(gs, 1);
+}
+END_TEST
+
+START_TEST(test_sched_waves) {
+  sched_kernel k = {1024, 32, 0};
+  size_t gs, ls;
+
+  /* Large problems get SCHED_MAX_WAVES waves of 2 * 80 blocks */
+  gs = ls = 0;
+  sched_launch(&v100, &k, 1 << 24, &gs, &ls);
+  ck_assert_uint_eq(gs, SCHED_MAX_WAVES * 160);
+
+  /* 1.5 waves of work is rounded to 2 waves */
+  gs = ls = 0;
+  sched_launch(&v100, &k, 240 * 1024, &gs, &ls);
+  ck_assert_uint_eq(ls, 1024);
+  ck_assert_uint_eq(gs, 320);
+
+  /* Less than a wave is left as is */
+  gs = ls = 0;
+  sched_launch(&v100, &k, 100 * 1024, &gs, &ls);
+  ck_assert_uint_eq(gs, 100);
+
+  /* A given block size is kept */
+  gs = 0;
+  ls = 256;
+  sched_launch(&v100, &k, 1 << 24, &gs, &ls);
+  ck_assert_uint_eq(ls, 256);
+  ck_assert_uint_eq(gs, SCHED_MAX_WAVES * 8 * 80);
+
+  /* So is a given grid size */
+  gs = 10;
+  ls = 0;
+  sched_launch(&v100, &k, 1000, &gs, &ls);
+  ck_assert_uint_eq(gs, 10);
+  ck_assert_uint_eq(ls, 128);
+}
+END_TEST
+
+START_TEST(test_sched_fixed) {
+  sched_kernel k = {256, 0, 0};
+  size_t gs, ls;
+
+  /* Without occupancy information, use the fixed heuristic */
+  gs = ls = 0;
+  sched_launch(&cldev, &k, 1000000, &gs, &ls);
+  ck_assert_uint_eq(gs, 36 * 32);
+  ck_assert_uint_eq(ls, 256);
+
+  gs = ls = 0;
+  sched_launch(&cldev, &k, 100, &gs, &ls);
+  ck_assert_uint_eq(gs, 2);
+  ck_assert_uint_eq(ls, 64);
+}
+END_TEST
+
+Suite *get_suite(void) {
+  Suite *s = suite_create("util_sched");
+  TCase *tc = tcase_create("All");
+  tcase_add_test(tc, test_sched_blocks);
+  tcase_add_test(tc, test_sched_block_size);
+  tcase_add_test(tc, test_sched_waves);
+  tcase_add_test(tc, test_sched_fixed);
+  suite_add_tcase(s, tc);
+  return s;
+}
@@ -0,0 +1,150 @@
+#include <check.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/staging.h"
+
+/*
+ * Host memory mock of two devices.  Asynchronous writes only land in
+ * the destination when they are waited for, so reusing a buffer too
+ * early shows up as corrupted data.
+ */
+#define MOCK_SZ 1000
+
+struct mock {
+  unsigned char src[MOCK_SZ];
+  unsigned char dst[MOCK_SZ];
+  /* In flight writes */
+  const void *p[2];
+  size_t off[2];
+  size_t sz[2];
+  unsigned int nread;
+  unsigned int nwrite;
+  unsigned int nwait;
+  unsigned int fail_read; /* Fail the read with that number (from 1) */
+};
+
+static int mock_read(void *dst, size_t off, size_t sz, void *data) {
+  struct mock *m = data;
+  if (++m->nread == m->fail_read)
+    return GA_DEVSUP_ERROR;
+  ck_assert(off + sz <= MOCK_SZ);
+  memcpy(dst, m->src + off, sz);
+  return GA_NO_ERROR;
+}
+
+static int mock_write_sync(size_t off, const void *src, size_t sz,
+                           unsigned int slot, void *data) {
+  struct mock *m = data;
+  m->nwrite++;
+  ck_assert(off + sz <= MOCK_SZ);
+  memcpy(m->dst + off, src, sz);
+  return GA_NO_ERROR;
+}
+
+static int mock_write_async(size_t off, const void *src, size_t sz,
+                            unsigned int slot, void *data) {
+  struct mock *m = data;
+  m->nwrite++;
+  ck_assert_uint_lt(slot, 2);
+  ck_assert_ptr_eq(m->p[slot], NULL);
+  m->p[slot] = src;
+  m->off[slot] = off;
+  m->sz[slot] = sz;
+  return GA_NO_ERROR;
+}
+
+static int mock_wait(unsigned int slot, void *data) {
+  struct mock *m = data;
+  m->nwait++;
+  ck_assert_ptr_ne(m->p[slot], NULL);
+  memcpy(m->dst + m->off[slot], m->p[slot], m->sz[slot]);
+  m->p[slot] = NULL;
+  return GA_NO_ERROR;
+}
+
+static const staging_ops sync_ops = {mock_read, mock_write_sync, NULL};
+static const staging_ops async_ops = {mock_read, mock_write_async, mock_wait};
+
+static void mock_init(struct mock *m) {
+  unsigned int i;
+  memset(m, 0, sizeof(*m));
+  for (i = 0; i < MOCK_SZ; i++)
+    m->src[i] = (unsigned char)(i * 7 + 1);
+}
+
+START_TEST(test_staging_sync) {
+  struct mock m;
+  error *e;
+
+  ck_assert_int_eq(error_alloc(&e), 0);
+  mock_init(&m);
+  ck_assert_int_eq(staging_copy(e, &sync_ops, &m, 0, 0, MOCK_SZ, 300),
+                   GA_NO_ERROR);
+  ck_assert_int_eq(memcmp(m.src, m.dst, MOCK_SZ), 0);
+  ck_assert_uint_eq(m.nread, 4);
+  ck_assert_uint_eq(m.nwrite, 4);
+
+  /* With offsets in one chunk */
+  mock_init(&m);
+  ck_assert_int_eq(staging_copy(e, &sync_ops, &m, 10, 500, 400, 0),
+                   GA_NO_ERROR);
+  ck_assert_int_eq(memcmp(m.src + 500, m.dst + 10, 400), 0);
+  ck_assert_uint_eq(m.dst[9], 0);
+  ck_assert_uint_eq(m.dst[410], 0);
+  ck_assert_uint_eq(m.nread, 1);
+
+  mock_init(&m);
+  ck_assert_int_eq(staging_copy(e, &sync_ops, &m, 0, 0, 0, 300),
+                   GA_NO_ERROR);
+  ck_assert_uint_eq(m.nread, 0);
+  error_free(e);
+}
+END_TEST
+
+START_TEST(test_staging_async) {
+  struct mock m;
+  error *e;
+
+  ck_assert_int_eq(error_alloc(&e), 0);
+  mock_init(&m);
+  ck_assert_int_eq(staging_copy(e, &async_ops, &m, 0, 0, MOCK_SZ, 64),
+                   GA_NO_ERROR);
+  ck_assert_int_eq(memcmp(m.src, m.dst, MOCK_SZ), 0);
+  ck_assert_uint_eq(m.nread, 16);
+  ck_assert_uint_eq(m.nwait, 16);
+  /* Nothing left in flight */
+  ck_assert_ptr_eq(m.p[0], NULL);
+  ck_assert_ptr_eq(m.p[1], NULL);
+  error_free(e);
+}
+END_TEST
+
+START_TEST(test_staging_error) {
+  struct mock m;
+  error *e;
+
+  ck_assert_int_eq(error_alloc(&e), 0);
+  mock_init(&m);
+  m.fail_read = 3;
+  ck_assert_int_eq(staging_copy(e, &async_ops, &m, 0, 0, MOCK_SZ, 100),
+                   GA_DEVSUP_ERROR);
+  /* The writes that were started are complete */
+  ck_assert_uint_eq(m.nwrite, 2);
+  ck_assert_uint_eq(m.nwait, 2);
+  ck_assert_int_eq(memcmp(m.src, m.dst, 200), 0);
+  ck_assert_uint_eq(m.dst[200], 0);
+  error_free(e);
+}
+END_TEST
+
+Suite *get_suite(void) {
+  Suite *s = suite_create("util_staging");
+  TCase *tc = tcase_create("All");
+  tcase_add_test(tc, test_staging_sync);
+  tcase_add_test(tc, test_staging_async);
+  tcase_add_test(tc, test_staging_error);
+  suite_add_tcase(s, tc);
+  return s;
+}
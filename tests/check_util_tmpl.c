@@ -0,0 +1,71 @@
+#include <check.h>
+
+#include <string.h>
+
+#include "gpuarray/types.h"
+#include "util/tmpl.h"
+
+/* What tmpl.py makes of "%% t(a:t, n:u, s:s, d:d)" followed by
+   "${a} x${n} = ${s}${n} + ${d};\n" */
+static const tmpl_part t_parts[] = {
+  {"", 0, 0},
+  {" x", 2, 1},
+  {" = ", 3, 2},
+  {"", 0, 1},
+  {" + ", 3, 3},
+  {";\n", 2, -1},
+};
+static const tmpl t = {"tusd", 6, t_parts, 10};
+
+/* "%% w(n:z, s:Z)" followed by "${n}*${s}" */
+static const tmpl_part w_parts[] = {
+  {"", 0, 0},
+  {"*", 1, 1},
+  {"", 0, -1},
+};
+static const tmpl w = {"zZ", 3, w_parts, 1};
+
+static const tmpl_part fixed_parts[] = {
+  {"}\n", 2, -1},
+};
+static const tmpl fixed = {"", 1, fixed_parts, 2};
+
+START_TEST(test_tmpl_render) {
+  strb sb = STRB_STATIC_INIT;
+  char *s;
+
+  tmpl_render(&sb, &t, GA_FLOAT, 12u, "y", -305);
+  tmpl_render(&sb, &t, GA_ULONG, 0u, "", 0);
+  tmpl_render(&sb, &fixed);
+  tmpl_render(&sb, &w, (size_t)4000000000UL, (ssize_t)-7);
+  s = strb_cstr(&sb);
+  ck_assert_ptr_ne(s, NULL);
+  ck_assert_str_eq(s, "ga_float x12 = y12 + -305;\n"
+                      "ga_ulong x0 = 0 + 0;\n"
+                      "}\n"
+                      "4000000000*-7");
+  free(s);
+}
+END_TEST
+
+START_TEST(test_tmpl_render_error) {
+  strb sb = STRB_STATIC_INIT;
+
+  strb_appends(&sb, "abc");
+  /* Not a valid typecode */
+  tmpl_render(&sb, &t, 1000, 1u, "y", 1);
+  ck_assert(strb_error(&sb));
+  tmpl_render(&sb, &fixed);
+  ck_assert(strb_error(&sb));
+  ck_assert_ptr_eq(strb_cstr(&sb), NULL);
+}
+END_TEST
+
+Suite *get_suite(void) {
+  Suite *s = suite_create("util_tmpl");
+  TCase *tc = tcase_create("All");
+  tcase_add_test(tc, test_tmpl_render);
+  tcase_add_test(tc, test_tmpl_render_error);
+  suite_add_tcase(s, tc);
+  return s;
+}
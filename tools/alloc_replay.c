@@ -0,0 +1,160 @@
+/*
+ * Replay an allocation trace (see gpucontext_props_alloc_trace())
+ * against a host simulation of the pooling allocator of the cuda
+ * backend.  See alloc_sim.h for the rules of the simulation.
+ */
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "alloc_sim.h"
+
+static uint64_t now_ns(void) {
+#ifdef _WIN32
+  LARGE_INTEGER c, f;
+  QueryPerformanceCounter(&c);
+  QueryPerformanceFrequency(&f);
+  return (uint64_t)((double)c.QuadPart * 1e9 / (double)f.QuadPart);
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static int parse_size(const char *s, uint64_t *res) {
+  char *end;
+  unsigned long long v = strtoull(s, &end, 10);
+
+  switch (*end) {
+  case 'k': case 'K': v <<= 10; end++; break;
+  case 'm': case 'M': v <<= 20; end++; break;
+  case 'g': case 'G': v <<= 30; end++; break;
+  }
+  if (end == s || *end != '\0')
+    return -1;
+  *res = v;
+  return 0;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [--frag N] [--block N] [--max-cache N]\n"
+          "          [--policy best|classes] trace\n"
+          "\n"
+          "Sizes accept a K, M or G suffix.  Defaults match the cuda\n"
+          "backend: --frag 64 --block 4M and no cache limit.\n"
+          "--max-cache 0 disables the cache.\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+  sim s;
+  alloc_trace_rec *recs;
+  const char *path = NULL;
+  FILE *f;
+  uint64_t start, elapsed;
+  size_t nops, j;
+  unsigned long long nallocs = 0, nfrees = 0;
+  int i, res;
+
+  sim_init(&s);
+
+  for (i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--policy") == 0 && i + 1 < argc) {
+      i++;
+      if (strcmp(argv[i], "best") == 0) {
+        s.policy = POLICY_BEST;
+      } else if (strcmp(argv[i], "classes") == 0) {
+        s.policy = POLICY_CLASSES;
+      } else {
+        usage(argv[0]);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--frag") == 0 && i + 1 < argc) {
+      if (parse_size(argv[++i], &s.frag) != 0 || s.frag == 0) {
+        usage(argv[0]);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--block") == 0 && i + 1 < argc) {
+      if (parse_size(argv[++i], &s.blocksz) != 0 || s.blocksz == 0) {
+        usage(argv[0]);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--max-cache") == 0 && i + 1 < argc) {
+      if (parse_size(argv[++i], &s.max_cache) != 0) {
+        usage(argv[0]);
+        return 1;
+      }
+    } else if (argv[i][0] != '-' && path == NULL) {
+      path = argv[i];
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (path == NULL) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  f = fopen(path, "rb");
+  if (f == NULL) {
+    perror(path);
+    return 1;
+  }
+  if (alloc_trace_check(f) != 0) {
+    fprintf(stderr, "%s: not an allocation trace\n", path);
+    fclose(f);
+    return 1;
+  }
+
+  res = sim_load(f, &recs, &nops);
+  fclose(f);
+  if (res != 0) {
+    fprintf(stderr, "%s: truncated or corrupt trace\n", path);
+    return 1;
+  }
+  for (j = 0; j < nops; j++) {
+    if (recs[j].type == ALLOC_TRACE_ALLOC)
+      nallocs++;
+    else
+      nfrees++;
+  }
+
+  /* A single operation is too short to time on its own */
+  start = now_ns();
+  sim_run(&s, recs, nops);
+  elapsed = now_ns() - start;
+
+  printf("policy:             %s\n",
+         s.policy == POLICY_BEST ? "best-fit" : "size classes");
+  printf("fragment size:      %llu\n", (unsigned long long)s.frag);
+  printf("block size:         %llu\n", (unsigned long long)s.blocksz);
+  printf("operations:         %llu (%llu allocs, %llu frees)\n",
+         (unsigned long long)nops, nallocs, nfrees);
+  printf("peak reserved:      %llu\n", (unsigned long long)s.peak_reserved);
+  printf("peak in use:        %llu\n", (unsigned long long)s.peak_in_use);
+  printf("waste at peak:      %llu (%.2f%%)\n",
+         (unsigned long long)s.waste_at_peak,
+         s.peak_reserved ?
+         100.0 * (double)s.waste_at_peak / (double)s.peak_reserved : 0.0);
+  printf("free space frag:    %.2f%%\n", 100.0 * s.ext_frag_at_peak);
+  printf("driver allocs:      %llu\n", s.driver_allocs);
+  printf("driver frees:       %llu\n", s.driver_frees);
+  printf("splits:             %llu\n", s.splits);
+  printf("merges:             %llu\n", s.merges);
+  printf("failed allocs:      %llu\n", s.failures);
+  printf("unknown frees:      %llu\n", s.unknown);
+  printf("time per operation: %.1f ns\n",
+         nops ? (double)elapsed / (double)nops : 0.0);
+  sim_clear(&s);
+  free(recs);
+  return 0;
+}
@@ -0,0 +1,352 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdlib.h>
+#include <string.h>
+
+#include "gpuarray/buffer.h"
+#include "alloc_sim.h"
+
+static void *xmalloc(size_t sz) {
+  void *res = calloc(1, sz);
+  if (res == NULL) {
+    fprintf(stderr, "out of memory\n");
+    exit(2);
+  }
+  return res;
+}
+
+static size_t hash_id(uint64_t id, size_t n) {
+  id ^= id >> 33;
+  id *= 0xff51afd7ed558ccdULL;
+  id ^= id >> 33;
+  return (size_t)(id & (n - 1));
+}
+
+static void live_put(sim *s, block *b);
+
+static void live_grow(sim *s) {
+  block **old = s->live;
+  size_t n = s->alive;
+  size_t i;
+
+  s->alive = n ? n * 2 : 1024;
+  s->live = xmalloc(sizeof(block *) * s->alive);
+  s->nlive = 0;
+  for (i = 0; i < n; i++)
+    if (old[i] != NULL)
+      live_put(s, old[i]);
+  free(old);
+}
+
+static void live_put(sim *s, block *b) {
+  size_t i;
+
+  if ((s->nlive + 1) * 2 > s->alive)
+    live_grow(s);
+  for (i = hash_id(b->id, s->alive); s->live[i] != NULL;
+       i = (i + 1) & (s->alive - 1));
+  s->live[i] = b;
+  s->nlive++;
+}
+
+static block *live_take(sim *s, uint64_t id) {
+  size_t i, j, k;
+  block *res;
+
+  if (s->alive == 0)
+    return NULL;
+  for (i = hash_id(id, s->alive); s->live[i] != NULL;
+       i = (i + 1) & (s->alive - 1)) {
+    if (s->live[i]->id == id)
+      break;
+  }
+  res = s->live[i];
+  if (res == NULL)
+    return NULL;
+  /* Backward shift deletion */
+  s->live[i] = NULL;
+  for (j = (i + 1) & (s->alive - 1); s->live[j] != NULL;
+       j = (j + 1) & (s->alive - 1)) {
+    k = hash_id(s->live[j]->id, s->alive);
+    if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j))) {
+      s->live[i] = s->live[j];
+      s->live[j] = NULL;
+      i = j;
+    }
+  }
+  s->nlive--;
+  return res;
+}
+
+static uint64_t roundup(uint64_t s, uint64_t m) {
+  return ((s + (m - 1)) / m) * m;
+}
+
+static uint64_t size_class(uint64_t s) {
+  uint64_t c = 1;
+  while (c < s)
+    c <<= 1;
+  return c;
+}
+
+static void free_stats(sim *s, uint64_t *total, uint64_t *largest) {
+  block *b;
+  int i;
+
+  *total = 0;
+  *largest = 0;
+  for (i = 0; i < 2; i++) {
+    for (b = s->free[i]; b != NULL; b = b->next) {
+      *total += b->sz;
+      if (b->sz > *largest) *largest = b->sz;
+    }
+  }
+}
+
+static void update_peaks(sim *s) {
+  uint64_t total, largest;
+
+  if (s->in_use > s->peak_in_use)
+    s->peak_in_use = s->in_use;
+  if (s->reserved > s->peak_reserved) {
+    s->peak_reserved = s->reserved;
+    s->waste_at_peak = s->reserved - s->requested;
+    free_stats(s, &total, &largest);
+    s->ext_frag_at_peak = total ? 1.0 - (double)largest / (double)total : 0.0;
+  }
+}
+
+static void insert_free(sim *s, block *b) {
+  block **head = &s->free[b->managed];
+  block *prev = NULL, *next;
+
+  for (next = *head; next && next->ptr < b->ptr; next = next->next)
+    prev = next;
+  b->next = next;
+  if (prev)
+    prev->next = b;
+  else
+    *head = b;
+}
+
+static void trim(sim *s) {
+  block *curr, *prev, *next;
+  int i;
+
+  for (i = 0; i < 2; i++) {
+    prev = NULL;
+    for (curr = s->free[i]; curr != NULL; curr = next) {
+      next = curr->next;
+      if (curr->head && curr->sz == curr->asz) {
+        if (prev != NULL)
+          prev->next = next;
+        else
+          s->free[i] = next;
+        s->reserved -= curr->sz;
+        s->driver_frees++;
+        free(curr);
+      } else {
+        prev = curr;
+      }
+    }
+  }
+}
+
+static block *allocate(sim *s, uint64_t size, int managed) {
+  block *b;
+
+  if (s->max_cache != 0) {
+    if (size < s->blocksz) size = s->blocksz;
+    if (s->reserved + size > s->max_cache) {
+      trim(s);
+      if (s->reserved + size > s->max_cache)
+        return NULL;
+    }
+  }
+  b = xmalloc(sizeof(*b));
+  b->ptr = s->next_addr;
+  /* Leave a gap so driver allocations never look contiguous */
+  s->next_addr += roundup(size, s->blocksz) + s->blocksz;
+  b->sz = size;
+  b->asz = size;
+  b->head = 1;
+  b->managed = managed;
+  s->reserved += size;
+  s->driver_allocs++;
+  insert_free(s, b);
+  return b;
+}
+
+void sim_alloc(sim *s, uint64_t id, uint64_t size, int managed) {
+  block *best = NULL, *bprev = NULL, *prev = NULL, *b, *split;
+  uint64_t asize;
+
+  if (size == 0) size = 1;
+  if (s->max_cache == 0) {
+    /* No cache, the freelist stays empty */
+    asize = size;
+  } else {
+    asize = roundup(size, s->frag);
+    if (s->policy == POLICY_CLASSES)
+      asize = size_class(asize);
+  }
+
+  for (b = s->free[managed]; b != NULL; prev = b, b = b->next) {
+    if (b->sz >= asize && (best == NULL || b->sz < best->sz)) {
+      best = b;
+      bprev = prev;
+      if (b->sz == asize)
+        break;
+    }
+  }
+  if (best == NULL) {
+    best = allocate(s, asize, managed);
+    if (best == NULL) {
+      s->failures++;
+      return;
+    }
+    bprev = NULL;
+    for (b = s->free[managed]; b != best; b = b->next)
+      bprev = b;
+  }
+
+  if (best->sz - asize < s->frag) {
+    b = best->next;
+  } else {
+    split = xmalloc(sizeof(*split));
+    split->ptr = best->ptr + asize;
+    split->sz = best->sz - asize;
+    split->managed = managed;
+    split->next = best->next;
+    best->sz = asize;
+    b = split;
+    s->splits++;
+  }
+  if (bprev != NULL)
+    bprev->next = b;
+  else
+    s->free[managed] = b;
+
+  best->next = NULL;
+  best->id = id;
+  best->req = size;
+  s->in_use += best->sz;
+  s->requested += size;
+  live_put(s, best);
+  update_peaks(s);
+}
+
+void sim_free(sim *s, uint64_t id) {
+  block *d = live_take(s, id);
+  block **head;
+  block *prev = NULL, *next;
+
+  if (d == NULL) {
+    /* Allocated before the trace started or failed in the replay */
+    s->unknown++;
+    return;
+  }
+  s->in_use -= d->sz;
+  s->requested -= d->req;
+
+  if (s->max_cache == 0) {
+    s->reserved -= d->sz;
+    s->driver_frees++;
+    free(d);
+    return;
+  }
+
+  head = &s->free[d->managed];
+  for (next = *head; next && next->ptr < d->ptr; next = next->next)
+    prev = next;
+
+  if (!d->head && prev != NULL && prev->ptr + prev->sz == d->ptr) {
+    prev->sz += d->sz;
+    free(d);
+    d = prev;
+    s->merges++;
+  } else if (prev != NULL) {
+    prev->next = d;
+  } else {
+    *head = d;
+  }
+
+  if (next && !next->head && d->ptr + d->sz == next->ptr) {
+    d->sz += next->sz;
+    d->next = next->next;
+    free(next);
+    s->merges++;
+  } else {
+    d->next = next;
+  }
+}
+
+void sim_init(sim *s) {
+  memset(s, 0, sizeof(*s));
+  s->frag = 64;
+  s->blocksz = 4 * 1024 * 1024;
+  s->max_cache = (uint64_t)-1;
+  s->policy = POLICY_BEST;
+  /* Never hand out address 0 */
+  s->next_addr = s->blocksz;
+}
+
+void sim_clear(sim *s) {
+  block *b, *next;
+  size_t i;
+  int j;
+
+  for (j = 0; j < 2; j++) {
+    for (b = s->free[j]; b != NULL; b = next) {
+      next = b->next;
+      free(b);
+    }
+    s->free[j] = NULL;
+  }
+  for (i = 0; i < s->alive; i++)
+    free(s->live[i]);
+  free(s->live);
+  s->live = NULL;
+  s->nlive = 0;
+  s->alive = 0;
+}
+
+int sim_load(FILE *f, alloc_trace_rec **recs, size_t *n) {
+  alloc_trace_rec r;
+  alloc_trace_rec *res = NULL, *tmp;
+  size_t len = 0, alen = 0;
+  int err;
+
+  while ((err = alloc_trace_read(f, &r, NULL)) == 1) {
+    if (r.type != ALLOC_TRACE_ALLOC && r.type != ALLOC_TRACE_FREE)
+      continue;
+    if (len == alen) {
+      alen = alen ? alen * 2 : 4096;
+      tmp = realloc(res, alen * sizeof(*res));
+      if (tmp == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(2);
+      }
+      res = tmp;
+    }
+    res[len++] = r;
+  }
+  if (err != 0) {
+    free(res);
+    return -1;
+  }
+  *recs = res;
+  *n = len;
+  return 0;
+}
+
+void sim_run(sim *s, const alloc_trace_rec *recs, size_t n) {
+  size_t i;
+
+  for (i = 0; i < n; i++) {
+    if (recs[i].type == ALLOC_TRACE_ALLOC)
+      sim_alloc(s, recs[i].id, recs[i].size,
+                (recs[i].flags & GA_BUFFER_MANAGED) != 0);
+    else
+      sim_free(s, recs[i].id);
+  }
+}
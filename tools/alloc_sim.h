@@ -0,0 +1,94 @@
+#ifndef ALLOC_SIM_H
+#define ALLOC_SIM_H
+
+/*
+ * Host simulation of the pooling allocator of the cuda backend, used
+ * by gpuarray-alloc-replay to replay allocation traces (see
+ * gpucontext_props_alloc_trace()).
+ *
+ * The simulation follows the same rules as cuda_alloc()/cuda_free():
+ * requests are rounded up to the fragment size, served best-fit from
+ * an address-ordered freelist, split if the remainder is at least
+ * one fragment and merged back with their neighbours on free, except
+ * across driver allocations.  Driver allocations are at least one
+ * block in size and are released when the cache limit is reached.
+ * A cache limit of 0 disables the cache like it does for the cuda
+ * backend: every request is its own driver allocation, released on
+ * free.
+ *
+ * Addresses are only simulated, so this runs without a GPU.
+ */
+
+#include <stdio.h>
+
+#include "util/alloctrace.h"
+
+#define POLICY_BEST 0
+#define POLICY_CLASSES 1
+
+typedef struct _block {
+  struct _block *next;
+  uint64_t ptr;
+  uint64_t sz;
+  uint64_t asz;    /* size of the driver allocation if head */
+  uint64_t req;    /* requested size while in use */
+  uint64_t id;
+  int head;
+  int managed;
+} block;
+
+typedef struct _sim {
+  block *free[2];
+  block **live;    /* hash table on id, open addressing */
+  size_t nlive;
+  size_t alive;
+  uint64_t frag;
+  uint64_t blocksz;
+  uint64_t max_cache;  /* (uint64_t)-1 for no limit, 0 for no cache */
+  int policy;
+  uint64_t next_addr;
+
+  uint64_t reserved;
+  uint64_t in_use;
+  uint64_t requested;
+  uint64_t peak_reserved;
+  uint64_t peak_in_use;
+  uint64_t waste_at_peak;
+  double ext_frag_at_peak;
+  unsigned long long driver_allocs;
+  unsigned long long driver_frees;
+  unsigned long long splits;
+  unsigned long long merges;
+  unsigned long long failures;
+  unsigned long long unknown;
+} sim;
+
+/*
+ * Set up a simulation with the defaults of the cuda backend.  The
+ * parameters can be changed before the first operation.
+ */
+void sim_init(sim *s);
+
+/*
+ * Release the memory held by a simulation.
+ */
+void sim_clear(sim *s);
+
+void sim_alloc(sim *s, uint64_t id, uint64_t size, int managed);
+void sim_free(sim *s, uint64_t id);
+
+/*
+ * Read the allocations and frees of a trace whose magic was checked
+ * with alloc_trace_check().  Tags are skipped.  The records are
+ * returned in `*recs` which must be freed.
+ *
+ * Returns 0 on success and -1 if the trace is truncated or corrupt.
+ */
+int sim_load(FILE *f, alloc_trace_rec **recs, size_t *n);
+
+/*
+ * Replay records read by sim_load().
+ */
+void sim_run(sim *s, const alloc_trace_rec *recs, size_t n);
+
+#endif